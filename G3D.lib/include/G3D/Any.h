@@ -329,6 +329,15 @@ private:
         return ! m_placeholderName.empty();
     }
 
+    /** Encodes Any trees in the compiled format.  Defined in Any_binary.cpp */
+    class BinaryWriter;
+
+    /** Decodes the compiled format.  Defined in Any_binary.cpp */
+    class BinaryReader;
+
+    friend class BinaryWriter;
+    friend class BinaryReader;
+
 public:
 
     /** Base class for all Any exceptions.*/
@@ -591,9 +600,49 @@ public:
     void clear();
 
     /** Parse from a file.
-     \sa deserialize, parse */
+
+     If compiledFilename(filename) exists and none of the files that
+     it was compiled from (\a filename and anything that it includes)
+     has been modified since, and the compiled file is not older than
+     \a filename, the compiled file is loaded instead of
+     parsing the text.  If the compiled file is missing or stale and
+     compileOnLoad() is true, it is rewritten after parsing.
+
+     \sa deserialize, parse, loadCompiled */
     void load(const std::string& filename);
 
+    /** \brief Writes this Any in the compact binary "compiled Any" format.
+
+     Keys, names, comments, strings, and source filenames are interned
+     in a string table, and arrays and tables address their elements
+     by offset, so loading performs no tokenizing and no string
+     comparisons.  Sources are preserved, so errors reported against a
+     compiled Any still refer to the text file and line it came from.
+     The modification times and sizes of the source files are recorded
+     so that loadCompiled() can detect stale data.
+
+     \sa load, compiledFilename */
+    void saveCompiled(const std::string& filename) const;
+
+    /** Replaces this with the Any stored in compiled file \a filename.
+
+     Returns false, leaving this unchanged, if the file does not exist,
+     is not a compiled Any of the current version, or (when \a
+     checkDependencies is true) any of the text files that it was
+     compiled from has a different modification time or size than when
+     it was compiled. */
+    bool loadCompiled(const std::string& filename, bool checkDependencies = true);
+
+    /** The name of the compiled file that load() uses for \a sourceFilename:
+        "scene.any" becomes "scene.anyb", and other names have ".anyb" appended. */
+    static std::string compiledFilename(const std::string& sourceFilename);
+
+    /** If true, load() writes the compiled file for each text file that
+        it parses.  Default is false. */
+    static void setCompileOnLoad(bool b);
+
+    static bool compileOnLoad();
+
     /** Uses the serialize method. */
     void save(const std::string& filename) const;
 
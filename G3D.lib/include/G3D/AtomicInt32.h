@@ -68,6 +68,41 @@ public:
         return m_value;
     }
 
+    /** Returns the current value.  Memory accesses that follow this
+        call are not moved before it, so data published by another
+        thread's releaseSet() is visible afterwards. */
+    int32 acquireValue() const {
+#       if defined(G3D_WIN32)
+            // Volatile reads have acquire semantics under VC8 and later
+            return m_value;
+#       elif defined(G3D_LINUX) || defined(G3D_FREEBSD)
+            // x86 does not reorder loads with later memory accesses; only
+            // the compiler must be prevented from doing so.
+            const int32 x = m_value;
+            asm volatile ("" : : : "memory");
+            return x;
+#       elif defined(G3D_OSX)
+            const int32 x = m_value;
+            OSMemoryBarrier();
+            return x;
+#       endif
+    }
+
+    /** Sets the value.  Memory accesses that precede this call are
+        completed before it.  \sa acquireValue() */
+    void releaseSet(const int32 x) {
+#       if defined(G3D_WIN32)
+            // Volatile writes have release semantics under VC8 and later
+            m_value = x;
+#       elif defined(G3D_LINUX) || defined(G3D_FREEBSD)
+            asm volatile ("" : : : "memory");
+            m_value = x;
+#       elif defined(G3D_OSX)
+            OSMemoryBarrier();
+            m_value = x;
+#       endif
+    }
+
     /** Returns the old value, before the add. */
     int32 add(const int32 x) {
 #       if defined(G3D_WIN32)
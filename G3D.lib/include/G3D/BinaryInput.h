@@ -39,6 +39,44 @@
 
 namespace G3D {
 
+namespace _internal {
+/**
+ Layout of files written with BinaryOutput::setStreamingCompression.
+ All fields are little-endian regardless of the file's endianness.
+
+ <pre>
+   uint32  MAGIC
+   uint32  VERSION
+   uint32  block size (uncompressed bytes in every block but the last)
+   uint32  flags (FLAG_BLOCK_INDEX)
+
+   per block:
+     uint32  compressed length
+     uint32  uncompressed length
+     uint8   zlib data[compressed length]
+
+   if FLAG_BLOCK_INDEX:
+     uint64  file offset of each block
+     uint64  total uncompressed length
+     uint32  number of blocks
+     uint32  INDEX_MAGIC
+ </pre>
+ */
+class CompressedBlockFormat {
+public:
+    enum {
+        /** "G3DZ" */
+        MAGIC            = 0x5A443347,
+        /** "G3DI" */
+        INDEX_MAGIC      = 0x49443347,
+        VERSION          = 1,
+        HEADER_SIZE      = 16,
+        BLOCK_HEADER_SIZE = 8,
+        FLAG_BLOCK_INDEX = 1
+    };
+};
+} // namespace _internal
+
 #if defined(G3D_WIN32) || defined(G3D_LINUX)
     // Allow writing of integers to non-word aligned locations.
     // This is legal on x86, but not on other platforms.
@@ -117,6 +155,42 @@ private:
      */
     bool            m_freeBuffer;
 
+    /** When true, m_buffer is a read-only mapping of the whole file
+        and is unmapped in the destructor. */
+    bool            m_memoryMapped;
+
+    /** Maps the whole file into m_buffer.  Returns false, leaving
+        the object unchanged, if the file cannot be mapped. */
+    bool mapIntoMemory();
+
+    /** File offset of each compressed block when streaming a file
+        written with BinaryOutput::setStreamingCompression; empty
+        otherwise. */
+    Array<int64>    m_blockOffset;
+
+    /** Uncompressed size of every block but the last, when m_blockOffset is non-empty */
+    int64           m_blockSize;
+
+    /** Allocated size of m_buffer when m_blockOffset is non-empty */
+    int64           m_blockBufferCapacity;
+
+    /** The file, kept open for the lifetime of this object when
+        m_blockOffset is non-empty; NULL otherwise */
+    FILE*           m_blockFile;
+
+    /** Reads the block table of a streaming compressed file.  Returns
+        false if \a file is not in that format, and throws a
+        std::string if the header, block headers, or index are corrupt. */
+    bool openCompressedBlocks(FILE* file);
+
+    /** Decompresses the blocks covering [startPosition, startPosition + minLength)
+        into m_buffer. */
+    void loadBlocks(int64 startPosition, int64 minLength);
+
+    /** Replaces the buffer with the decompression of an entire
+        streaming compressed file held in memory. */
+    void decompressBlocks(const uint8* data, int64 dataLen);
+
     /** Ensures that we are able to read at least minLength from startPosition (relative
         to start of file). */
     void loadIntoMemory(int64 startPosition, int64 minLength = 0);
@@ -150,11 +224,28 @@ public:
        @param compressed Set to true if and only if the file was
        compressed using BinaryOutput's zlib compression.  This has
        nothing to do with whether the input is in a zipfile.
+       Files written with BinaryOutput::setStreamingCompression are
+       detected automatically and decompressed one block at a time as
+       they are read, so only the blocks around the current position
+       are held in memory and setPosition() may seek anywhere.
+
+       @param memoryMap If true, the file is mapped read-only into the
+       address space instead of being read into a heap buffer.  The
+       constructor returns immediately regardless of file size, reads
+       are served directly from the operating system's page cache
+       (which is shared with other processes reading the same file),
+       and setPosition() never rereads the file.  Files larger than
+       physical memory are paged in on demand.  Falls back to reading
+       the file when it cannot be mapped (e.g., it is in a zipfile, is
+       empty, or does not fit in the address space of a 32-bit
+       process).  A compressed file is mapped only while it is
+       decompressed.  The file must not be modified while it is mapped.
     */
     BinaryInput(
         const std::string&  filename,
         G3DEndian           fileEndian,
-        bool                compressed = false);
+        bool                compressed = false,
+        bool                memoryMap = false);
 
     /**
      Creates input stream from an in memory source.
@@ -199,6 +290,12 @@ public:
         return m_filename;
     }
 
+    /** True if the data is being read directly from a memory mapping
+        of the file.  \sa BinaryInput::BinaryInput */
+    bool memoryMapped() const {
+        return m_memoryMapped;
+    }
+
     /**
      Returns a pointer to the internal memory buffer.
      May throw an exception for huge files.
@@ -28,6 +28,7 @@
 #include "G3D/debug.h"
 #include "G3D/BinaryInput.h"
 #include "G3D/System.h"
+#include "G3D/TaskScheduler.h"
 
 #ifdef _MSC_VER
 #   pragma warning (push)
@@ -36,6 +37,24 @@
 #endif
 namespace G3D {
 
+namespace _internal {
+
+/** One block of a BinaryOutput in chunked mode.  \sa BinaryOutput::setChunkedOutput */
+class BinaryOutputBlock {
+public:
+    uint8*          data;
+
+    /** Bytes used */
+    int             length;
+
+    /** Bytes allocated */
+    int             capacity;
+};
+
+class BinaryOutputFlusher;
+
+} // namespace _internal
+
 /**
  Sequential or random access byte-order independent binary file access.
 
@@ -84,11 +103,69 @@ private:
     /** is this initialized? */
     bool            m_init;
 
-    /** Number of bytes already written to the file.*/
+    /** Number of bytes already written to the file (or, in chunked
+        mode, handed off in full blocks to be written).*/
     size_t          m_alreadyWritten;             
 
     bool            m_ok;
 
+    /** Uncompressed bytes per block when streaming compression is
+        enabled, otherwise 0.  \sa setStreamingCompression */
+    int             m_compressedBlockSize;
+
+    bool            m_writeBlockIndex;
+
+    /** File offset of each compressed block written so far */
+    Array<int64>    m_blockOffset;
+
+    /** Bytes written to the file so far in streaming compression mode,
+        including the header */
+    int64           m_compressedLength;
+
+    /** The file in streaming compression mode, opened by the first
+        writeCompressedBlocks() and closed by commit(); NULL otherwise */
+    FILE*           m_compressedFile;
+
+    /** Bytes per block when chunked output is enabled, otherwise 0.
+        \sa setChunkedOutput */
+    int             m_blockSize;
+
+    bool            m_backgroundFlush;
+
+    /** True if background flushing was requested but the scheduler has
+        no workers, so each full block is written as soon as it is retired */
+    bool            m_syncFlush;
+
+    /** Full blocks, in file order, that have not been handed to
+        m_flusher yet */
+    Array<_internal::BinaryOutputBlock> m_fullBlock;
+
+    /** Total length of m_fullBlock */
+    int64           m_fullBlockBytes;
+
+    /** Written blocks of m_blockSize bytes kept for reuse */
+    Array<uint8*>   m_freeBlock;
+
+    /** Writes full blocks in chunked mode, otherwise NULL */
+    _internal::BinaryOutputFlusher* m_flusher;
+
+    /** Moves the current buffer to the end of m_fullBlock, leaving
+        the buffer empty */
+    void retireBlock();
+
+    /** Recycles the blocks from the previous flush and starts
+        writing m_fullBlock.  If the previous flush is still in
+        progress, returns immediately unless \a wait is true. */
+    void flushBlocks(bool wait);
+
+    /** Frees every block held in chunked mode */
+    void releaseBlocks();
+
+    /** Compresses the first \a numBytes of the buffer into blocks,
+        appends them to m_compressedFile (opening it on the first call),
+        and shifts the rest of the buffer down. */
+    void writeCompressedBlocks(int numBytes);
+
     void reserveBytesWhenOutOfMemory(size_t bytes);
 
     void reallocBuffer(size_t bytes, size_t oldBufferLen);
@@ -141,11 +218,60 @@ public:
      */
     void compress();
 
+    /** 
+      Compresses the data with zlib in independent blocks of \a blockSize 
+      bytes as it is written.  Each block is appended to the file as soon as 
+      the write position moves past it, so at most a few blocks are held in 
+      memory no matter how large the file grows.  BinaryInput
+      (with <code>compressed = true</code>) decompresses such files one
+      block at a time on demand.
+
+      Call immediately after construction, before anything is
+      written.  Not supported for "<memory>" output, and cannot be
+      combined with compress().  Seeking backwards is limited to the
+      block containing the write position.
+
+      \param writeBlockIndex If true, a table of block offsets is
+      appended at commit() so that BinaryInput can open the file and
+      seek within it without scanning the block headers.
+     */
+    void setStreamingCompression(int blockSize = 1024 * 1024, bool writeBlockIndex = true);
+
+    /**
+      Stores the data in blocks of \a blockSize bytes instead of one
+      contiguous buffer.  When a write does not fit in the current
+      block a new one is started, so the buffer is never grown by
+      copying it.  Full blocks are appended to the file with one
+      scatter-gather (writev) call per batch of blocks rather than
+      being copied together first.
+
+      Useful for serializing large files, such as caches of spatial
+      data structures and video frames.
+
+      Call immediately after construction, before anything is written.
+      Not supported for "<memory>" output, and cannot be combined with
+      compress() or setStreamingCompression().  Seeking backwards is
+      limited to the current block, and getCArray() returns only the
+      current block.
+
+      \param backgroundFlush If true, full blocks are written by a
+      TaskScheduler::global() task while the caller continues to write
+      new ones, and writing waits for the disk once a few blocks are
+      queued.  If \a scheduler has no workers, each full block is written
+      synchronously as it fills.  If false, full blocks are held in memory
+      and written by commit() (or earlier, if the file grows very large).
+
+      \param scheduler Runs the background writes
+     */
+    void setChunkedOutput(int blockSize = 1024 * 1024, bool backgroundFlush = true,
+                          const TaskScheduler::Ref& scheduler = TaskScheduler::global());
+
     /** True if no errors have been encountered.*/
     bool ok() const;
 
     /**
-     Returns a pointer to the internal memory buffer.
+     Returns a pointer to the internal memory buffer.  In chunked mode
+     this is only the current block.
      */
     inline const uint8* getCArray() const {
         return m_buffer;
@@ -0,0 +1,223 @@
+/**
+ @file DynamicBVH.h
+
+ Bounding volume hierarchy of axis-aligned boxes for frustum culling.
+
+ @sa G3D::KDTree
+ */
+
+#ifndef G3D_DynamicBVH_h
+#define G3D_DynamicBVH_h
+
+#include "G3D/platform.h"
+#include "G3D/Array.h"
+#include "G3D/AABox.h"
+#include "G3D/Plane.h"
+
+namespace G3D {
+
+/**
+ \brief A four-way bounding volume hierarchy of boxes that can be
+ culled against a set of planes and refit as the boxes move.
+
+ Each leaf is an AABox and an integer value chosen by the caller,
+ such as an index into an array of objects.  insert() returns a handle
+ for the leaf that is passed to update() and remove().  After clear(),
+ handles are assigned as 0, 1, 2, ... in insertion order.
+
+ Every node stores the boxes of its four children in
+ structure-of-arrays form, so cull() tests one plane against all four
+ children at once (with SSE2 when available).  Children that are
+ entirely inside a plane skip that plane in their subtrees, and
+ subtrees that are inside every plane are appended without further
+ tests.  Each node also remembers the last plane that rejected one of
+ its children and tests it first on the next call, since the same
+ plane usually rejects the same subtree from frame to frame.
+
+ update() only records the new box.  The hierarchy is refit on the
+ next call to cull() or refit(), visiting just the ancestors of the
+ moved leaves when few have moved.  insert() and remove() change the
+ hierarchy incrementally; after many of them cull() rebuilds it from
+ scratch so that its quality does not degrade.
+
+ <pre>
+    DynamicBVH tree;
+    for (int i = 0; i < model.size(); ++i) {
+        tree.insert(model[i]->worldSpaceBoundingBox(), i);
+    }
+
+    Array<Plane> clip;
+    camera.getClipPlanes(viewport, clip);
+    Array<int> visible;
+    tree.cull(clip, visible);
+ </pre>
+
+ Box coordinates are clamped to +/-1e18 so that infinite boxes can be
+ culled without producing NaN.
+
+ <B>BETA API</B>  This is unsupported and may change
+ */
+class DynamicBVH {
+public:
+
+    /** Maximum number of planes accepted by cull() */
+    enum {MAX_PLANES = 32};
+
+private:
+
+    /** Child slot contents that are not node indices */
+    enum {EMPTY = -1};
+
+    /** A child slot that holds leaf \a h stores -2 - h */
+    static int leafSlot(int h) {
+        return -2 - h;
+    }
+
+    class Node {
+    public:
+        /** Child boxes as lo[axis][child] and hi[axis][child] */
+        float       lo[3][4];
+        float       hi[3][4];
+
+        /** Node index, leafSlot(handle), or EMPTY */
+        int         child[4];
+
+        /** -1 for the root */
+        int         parent;
+        int         parentSlot;
+
+        /** Index of the last plane that culled one of the children, for the coherency cache */
+        int         cachedPlane;
+
+        /** False after the node has been removed from the hierarchy */
+        bool        inUse;
+
+        Node();
+
+        void setChildBox(int slot, const AABox& box);
+        void getChildBox(int slot, AABox& box) const;
+
+        /** Union of the child boxes.  Returns false if there are no children. */
+        bool getBounds(AABox& box) const;
+
+        bool hasChildren() const {
+            return (child[0] != EMPTY) || (child[1] != EMPTY) || (child[2] != EMPTY) || (child[3] != EMPTY);
+        }
+    };
+
+    class Leaf {
+    public:
+        AABox       box;
+        int         value;
+
+        /** Node and child slot holding the leaf, or -1 if not yet placed */
+        int         node;
+        int         slot;
+
+        bool        inUse;
+        bool        dirty;
+    };
+
+    Array<Node>     m_node;
+    Array<Leaf>     m_leaf;
+
+    /** Handles of unused leaves */
+    Array<int>      m_freeHandle;
+
+    int             m_numLeaves;
+
+    /** -1 when the hierarchy is empty or must be rebuilt */
+    int             m_root;
+
+    /** Handles of leaves moved since the last refit */
+    Array<int>      m_dirtyLeaf;
+
+    /** Inserts and removes since the last build */
+    int             m_numStructuralChanges;
+
+    /** Scratch space for building */
+    Array<int>      m_buildHandle;
+
+    /** Scratch space for building, indexed by handle */
+    Array<Vector3>  m_center;
+
+    /** Allocates a node at the end of m_node */
+    int allocateNode(int parent, int parentSlot);
+
+    /** Reorders m_buildHandle[begin..end) so that the leaves before \a mid have
+        centers no greater than those after it along the longest axis */
+    void splitMedian(int begin, int mid, int end);
+
+    /** Builds a subtree over m_buildHandle[begin..end) in slot \a parentSlot of node \a parent.
+        Returns the node index or leaf slot value to store in the parent. */
+    int build(int begin, int end, int parent, int parentSlot);
+
+    /** Places leaf \a h in the existing hierarchy */
+    void insertIntoHierarchy(int h);
+
+    /** Recomputes the boxes along the path from \a node to the root */
+    void refitUpward(int node);
+
+    /** Recomputes every box in the hierarchy */
+    void refitAll();
+
+    /** Appends the values of every leaf below \a node */
+    void appendSubtree(int node, Array<int>& result) const;
+
+    /** \a planeData holds the normal and distance of each plane as four floats.
+        Only the planes whose bits are set in \a planeMask are tested. */
+    void cullNode(int node, uint32 planeMask, const float* planeData, bool sse, Array<int>& result);
+
+public:
+
+    DynamicBVH();
+
+    /** Removes all leaves */
+    void clear();
+
+    /** Number of leaves */
+    int size() const {
+        return m_numLeaves;
+    }
+
+    /** Adds a leaf with bounds \a box and returns its handle */
+    int insert(const AABox& box, int value);
+
+    /** Changes the bounds of leaf \a handle.  Does nothing if \a box is unchanged. */
+    void update(int handle, const AABox& box);
+
+    void remove(int handle);
+
+    const AABox& bounds(int handle) const {
+        debugAssert(handle >= 0 && handle < m_leaf.size() && m_leaf[handle].inUse);
+        return m_leaf[handle].box;
+    }
+
+    int value(int handle) const {
+        debugAssert(handle >= 0 && handle < m_leaf.size() && m_leaf[handle].inUse);
+        return m_leaf[handle].value;
+    }
+
+    /** Rebuilds the hierarchy from the current leaves.  Called
+        automatically by cull() after many inserts and removes. */
+    void rebuild();
+
+    /** Brings the hierarchy up to date with the calls to update().
+        Called automatically by cull(). */
+    void refit();
+
+    /** Appends to \a result the values of the leaves that are not
+        entirely in the negative half space of some plane (i.e., the
+        same conservative test as AABox::culledBy).  \a result is
+        not cleared first.
+
+        Not const because it updates the hierarchy and its coherency cache. */
+    void cull(const Array<Plane>& plane, Array<int>& result);
+
+    /** Appends the values of all leaves to \a result */
+    void getValues(Array<int>& result) const;
+};
+
+} // namespace G3D
+
+#endif
@@ -12,6 +12,7 @@
 #include "G3D/platform.h"
 #include "G3D/Array.h"
 #include "G3D/Table.h"
+#include "G3D/GMutex.h"
 
 namespace G3D {
 
@@ -37,8 +38,10 @@ namespace G3D {
  The extension requirement allows G3D to quickly identify whether a path could enter a
  zipfile without forcing it to open all parent directories for reading.
 
+ The static methods are threadsafe.  They are serialized by one
+ recursive mutex, because they share the cache.
+
  \sa FilePath
- TODO: make threadsafe!
 */
 class FileSystem {
 public:
@@ -133,6 +136,9 @@ private:
 
     static FileSystem& instance();
 
+    /** Held by every static method that uses instance() */
+    static GMutex& mutex();
+
 #   ifdef G3D_WIN32
     /** On Windows, the drive letters that form the file system roots.*/
     const Array<std::string>& _drives();
@@ -223,6 +229,11 @@ private:
     /** Returns the length of the file in bytes, or -1 if the file could not be opened. */
     int64 _size(const std::string& path);
 
+    /** Returns the time of the last modification of the file, in seconds since
+        the epoch, or -1 if it does not exist.  Files inside a zipfile report the
+        time stored in the zipfile's directory. */
+    int64 _modificationTime(const std::string& path);
+
     /** Called from list() */
     void listHelper(const std::string& shortSpec, const std::string& parentPath, Array<std::string>& result, const ListSettings& settings);
 
@@ -275,22 +286,26 @@ public:
 #   ifdef G3D_WIN32
     /** \copydoc _drives */
     static const Array<std::string>& drives() {
+        GMutexLock lock(&mutex());
         return instance()._drives();
     }
 #   endif
 
     /** \copydoc _inZipfile */
     static bool inZipfile(const std::string& path, std::string& zipfile) {
+        GMutexLock lock(&mutex());
         return instance()._inZipfile(path, zipfile);
     }
 
     /** \copydoc _clearCache */
     static void clearCache(const std::string& path = "") {
+        GMutexLock lock(&mutex());
         instance()._clearCache(path);
     }
 
     /** \copydoc _fopen */
     static FILE* fopen(const char* filename, const char* mode) {
+        GMutexLock lock(&mutex());
         return instance()._fopen(filename, mode);
     }
 
@@ -299,82 +314,104 @@ public:
     }
 
     static bool inZipfile(const std::string& path) {
+        GMutexLock lock(&mutex());
         return instance()._inZipfile(path);
     }
 
     /** \copydoc isZipfile */
     static bool isZipfile(const std::string& path) {
+        GMutexLock lock(&mutex());
         return instance()._isZipfile(path);
     }
 
     /** \copydoc _setCacheLifetime */
     void setCacheLifetime(float t) {
+        GMutexLock lock(&mutex());
         instance()._setCacheLifetime(t);
     }
 
     /** \copydoc _cacheLifetime */
     static float cacheLifetime() {
+        GMutexLock lock(&mutex());
         return instance()._cacheLifetime();
     }
 
     /** \copydoc _createDirectory */
     static void createDirectory(const std::string& path) {
+        GMutexLock lock(&mutex());
         instance()._createDirectory(path);
     }
 
     /** \copydoc _currentDirectory */
     static std::string currentDirectory() {
+        GMutexLock lock(&mutex());
         return instance()._currentDirectory();
     }
 
     /** \copydoc _copyFile */
     static void copyFile(const std::string& srcPath, const std::string& dstPath) {
+        GMutexLock lock(&mutex());
         instance()._copyFile(srcPath, dstPath);
     }
 
     /** \copydoc _exists */
     static bool exists(const std::string& f, bool trustCache = true) {
+        GMutexLock lock(&mutex());
         return instance()._exists(f, trustCache);
     }
 
     /** \copydoc _isDirectory */
     static bool isDirectory(const std::string& path) {
+        GMutexLock lock(&mutex());
         return instance()._isDirectory(path);
     }
 
     /** \copydoc _isFile */
     static bool isFile(const std::string& path) {
+        GMutexLock lock(&mutex());
         return instance()._isFile(path);
     }
 
     /** \copydoc _resolve */
     static std::string resolve(const std::string& path, const std::string& cwd = currentDirectory()) {
+        GMutexLock lock(&mutex());
         return instance()._resolve(path, cwd);
     }
 
     /** \copydoc _isNewer */
     static bool isNewer(const std::string& src, const std::string& dst) {
+        GMutexLock lock(&mutex());
         return instance()._isNewer(src, dst);
     }
 
     /** \copydoc _size */
     static int64 size(const std::string& path) {
+        GMutexLock lock(&mutex());
         return instance()._size(path);
     }
 
+    /** \copydoc _modificationTime */
+    static int64 modificationTime(const std::string& path) {
+        GMutexLock lock(&mutex());
+        return instance()._modificationTime(path);
+    }
+
     /** \copydoc _list */
     static void list(const std::string& spec, Array<std::string>& result,
         const ListSettings& listSettings = ListSettings()) {
+        GMutexLock lock(&mutex());
         return instance()._list(spec, result, listSettings);
     }
 
     /** \copydoc _getFiles */
     static void getFiles(const std::string& spec, Array<std::string>& result, bool includeParentPath = false) {
+        GMutexLock lock(&mutex());
         return instance()._getFiles(spec, result, includeParentPath);
     }
 
     /** \copydoc getDirectories */
     static void getDirectories(const std::string& spec, Array<std::string>& result, bool includeParentPath = false) {
+        GMutexLock lock(&mutex());
         return instance()._getDirectories(spec, result, includeParentPath);
     }
 };
@@ -0,0 +1,638 @@
+/**
+  @file FlatTable.h
+
+  Open-addressing hash table with Robin Hood probing.
+ */
+
+#ifndef G3D_FlatTable_h
+#define G3D_FlatTable_h
+
+#include <cstddef>
+#include <new>
+
+#include "G3D/platform.h"
+#include "G3D/Array.h"
+#include "G3D/debug.h"
+#include "G3D/System.h"
+#include "G3D/g3dmath.h"
+#include "G3D/EqualsTrait.h"
+#include "G3D/HashTrait.h"
+#include "G3D/MemoryManager.h"
+
+#ifdef _MSC_VER
+#   pragma warning (push)
+    // Debug name too long warning
+#   pragma warning (disable : 4786)
+#endif
+
+namespace G3D {
+
+/**
+ An unordered data structure mapping keys to values, with the same
+ interface as G3D::Table but stored in a single contiguous array
+ instead of per-entry linked list nodes.
+
+ Each slot has a one-byte control value holding its distance from the
+ slot that its hash code maps to (or zero when empty).  Insertion uses
+ Robin Hood probing: an entry that is further from home than the
+ current occupant takes its slot, so every probe sequence is short and
+ a lookup can stop at the first entry that is closer to home than the
+ key would be.  Removal shifts the following entries back rather than
+ leaving tombstones.
+
+ Compared to Table, FlatTable performs no allocation per insert and
+ lookups touch one or two cache lines.  In exchange:
+
+ <ul>
+  <li> Inserting or removing may move other entries, so pointers
+       returned by getPointer(), getCreate(), and the iterator are only
+       valid until the next set(), getCreate(), or remove().
+  <li> Key and Value are copied when entries move and when the table grows.
+  <li> At most 254 keys may share a hash code.
+ </ul>
+
+ HashFunc and EqualsFunc are the same as for Table.  The hash codes
+ are scrambled before use, so weak hash functions such as the identity
+ on <code>int</code> still distribute well.
+
+ The table grows (doubling) when size() would exceed
+ maxLoadFactor() * capacity().  Higher load factors use less memory;
+ lower ones make unsuccessful lookups faster.
+
+ <pre>
+    FlatTable<int, std::string> t;
+    t.set(3, "three");
+    std::string* s = t.getPointer(3);
+ </pre>
+
+ \sa G3D::Table
+ */
+template<class Key, class Value, class HashFunc = HashTrait<Key>, class EqualsFunc = EqualsTrait<Key> >
+class FlatTable {
+public:
+
+    /** The pairs returned by iterator. */
+    class Entry {
+    public:
+        Key    key;
+        Value  value;
+        Entry() {}
+        Entry(const Key& k) : key(k), value() {}
+        Entry(const Key& k, const Value& v) : key(k), value(v) {}
+        bool operator==(const Entry &peer) const { return (key == peer.key && value == peer.value); }
+        bool operator!=(const Entry &peer) const { return !operator==(peer); }
+    };
+
+private:
+
+    typedef FlatTable<Key, Value, HashFunc, EqualsFunc> ThisType;
+
+    class Slot {
+    public:
+        Entry       entry;
+        size_t      hashCode;
+
+        Slot(const Entry& e, size_t h) : entry(e), hashCode(h) {}
+    };
+
+    enum {
+        /** Control value of an empty slot */
+        EMPTY = 0,
+
+        /** Largest control value; one more than the longest probe distance */
+        MAX_CONTROL = 255,
+
+        MIN_CAPACITY = 16
+    };
+
+    /** m_control[i] is 0 for an empty slot, otherwise one more than
+        the distance of m_slot[i] from its home slot.  Kept separate from
+        m_slot so that probing touches as little memory as possible. */
+    uint8*              m_control;
+
+    /** Only slots with non-zero control values are constructed */
+    Slot*               m_slot;
+
+    /** Number of slots; zero or a power of two */
+    size_t              m_capacity;
+
+    /** Number of entries */
+    size_t              m_size;
+
+    /** 64 - log2(m_capacity) */
+    int                 m_shift;
+
+    float               m_maxLoadFactor;
+
+    MemoryManager::Ref  m_memoryManager;
+
+    /** Index of the home slot for a hash code.  Fibonacci hashing
+        mixes the high and low bits of \a code. */
+    inline size_t home(size_t code) const {
+        return (size_t)(((uint64)code * 0x9E3779B97F4A7C15ULL) >> m_shift);
+    }
+
+    inline size_t nextIndex(size_t i) const {
+        return (i + 1) & (m_capacity - 1);
+    }
+
+    /** Index of the slot holding \a key, or -1 */
+    int find(const Key& key, size_t code) const {
+        if (m_size == 0) {
+            return -1;
+        }
+
+        size_t i = home(code);
+        for (int distance = 1; ; ++distance) {
+            const int c = m_control[i];
+            if (c < distance) {
+                // Empty, or an entry closer to its home than key would be
+                return -1;
+            }
+            if ((c == distance) && (m_slot[i].hashCode == code) && EqualsFunc::equals(m_slot[i].entry.key, key)) {
+                return (int)i;
+            }
+            i = nextIndex(i);
+        }
+    }
+
+    /** Allocates empty storage with \a n slots */
+    void allocate(size_t n) {
+        debugAssertM(isPow2((int)n), "FlatTable capacity must be a power of two");
+        m_capacity = n;
+        m_shift    = 64 - iRound(log2((double)n));
+        m_control  = (uint8*)m_memoryManager->alloc(n);
+        m_slot     = (Slot*)m_memoryManager->alloc(n * sizeof(Slot));
+        debugAssertM((m_control != NULL) && (m_slot != NULL), "MemoryManager::alloc returned NULL. Out of memory.");
+        System::memset(m_control, EMPTY, n);
+    }
+
+    /** Destroys all entries and releases the storage */
+    void freeMemory() {
+        for (size_t i = 0; i < m_capacity; ++i) {
+            if (m_control[i] != EMPTY) {
+                m_slot[i].~Slot();
+            }
+        }
+        if (m_capacity > 0) {
+            m_memoryManager->free(m_control);
+            m_memoryManager->free(m_slot);
+        }
+        m_control  = NULL;
+        m_slot     = NULL;
+        m_capacity = 0;
+        m_size     = 0;
+        m_shift    = 64;
+    }
+
+    /** Re-inserts every entry into storage with \a newCapacity slots */
+    void rehash(size_t newCapacity) {
+        uint8*  oldControl  = m_control;
+        Slot*   oldSlot     = m_slot;
+        size_t  oldCapacity = m_capacity;
+
+        allocate(newCapacity);
+        m_size = 0;
+
+        for (size_t i = 0; i < oldCapacity; ++i) {
+            if (oldControl[i] != EMPTY) {
+                const bool inserted = (insertNew(oldSlot[i].entry, oldSlot[i].hashCode) >= 0);
+                alwaysAssertM(inserted, "Too many FlatTable keys share a hash code");
+                (void)inserted;
+                oldSlot[i].~Slot();
+            }
+        }
+
+        if (oldCapacity > 0) {
+            m_memoryManager->free(oldControl);
+            m_memoryManager->free(oldSlot);
+        }
+    }
+
+    /** Rehashes into twice as many slots (or the minimum capacity) */
+    void grow() {
+        rehash(iMax(MIN_CAPACITY, (int)m_capacity * 2));
+    }
+
+    /** Number of slots needed to hold \a n entries under the load factor */
+    size_t capacityFor(size_t n) const {
+        size_t c = MIN_CAPACITY;
+        while ((double)n > c * (double)m_maxLoadFactor) {
+            c *= 2;
+        }
+        return c;
+    }
+
+    /**
+     Inserts an entry known not to be present, without growing.
+     Returns its slot index, or -1 if a probe distance would overflow
+     the control byte (in which case the table is unchanged).
+     */
+    int insertNew(const Entry& entry, size_t code) {
+        debugAssert(m_size < m_capacity);
+
+        // Find the first slot that is empty or whose entry is closer to
+        // home than the new one would be
+        size_t i = home(code);
+        int distance = 1;
+        while ((m_control[i] != EMPTY) && (m_control[i] >= distance)) {
+            i = nextIndex(i);
+            ++distance;
+        }
+        if (distance > MAX_CONTROL) {
+            return -1;
+        }
+
+        // Find the end of the run that must shift forward one slot
+        size_t end = i;
+        while (m_control[end] != EMPTY) {
+            if (m_control[end] == MAX_CONTROL) {
+                return -1;
+            }
+            end = nextIndex(end);
+        }
+
+        // Shift [i, end) forward, farthest first
+        while (end != i) {
+            const size_t prev = (end + m_capacity - 1) & (m_capacity - 1);
+            new (m_slot + end) Slot(m_slot[prev]);
+            m_control[end] = m_control[prev] + 1;
+            m_slot[prev].~Slot();
+            end = prev;
+        }
+
+        new (m_slot + i) Slot(entry, code);
+        m_control[i] = (uint8)distance;
+        ++m_size;
+        return (int)i;
+    }
+
+    /** Destroys the entry in slot \a i and shifts the rest of its run back */
+    void removeAt(size_t i) {
+        m_slot[i].~Slot();
+        size_t next = nextIndex(i);
+        while (m_control[next] > 1) {
+            new (m_slot + i) Slot(m_slot[next]);
+            m_control[i] = m_control[next] - 1;
+            m_slot[next].~Slot();
+            i = next;
+            next = nextIndex(next);
+        }
+        m_control[i] = EMPTY;
+        --m_size;
+    }
+
+    void copyFrom(const ThisType& h) {
+        debugAssert(m_capacity == 0);
+        m_maxLoadFactor = h.m_maxLoadFactor;
+        if (h.m_capacity == 0) {
+            return;
+        }
+
+        allocate(h.m_capacity);
+        System::memcpy(m_control, h.m_control, m_capacity);
+        for (size_t i = 0; i < m_capacity; ++i) {
+            if (m_control[i] != EMPTY) {
+                new (m_slot + i) Slot(h.m_slot[i]);
+            }
+        }
+        m_size = h.m_size;
+    }
+
+public:
+
+    /**
+     Creates an empty hash table using the default MemoryManager.
+     \param maxLoadFactor Fraction of the slots that may be filled before the table grows,
+     between 0.25 and 0.95.
+     */
+    FlatTable(float maxLoadFactor = 0.8f) :
+        m_control(NULL), m_slot(NULL), m_capacity(0), m_size(0), m_shift(64),
+        m_maxLoadFactor(clamp(maxLoadFactor, 0.25f, 0.95f)),
+        m_memoryManager(MemoryManager::create()) {
+    }
+
+    /** Uses the default memory manager */
+    FlatTable(const ThisType& h) :
+        m_control(NULL), m_slot(NULL), m_capacity(0), m_size(0), m_shift(64),
+        m_maxLoadFactor(h.m_maxLoadFactor),
+        m_memoryManager(MemoryManager::create()) {
+        copyFrom(h);
+    }
+
+    FlatTable& operator=(const ThisType& h) {
+        if (this != &h) {
+            freeMemory();
+            copyFrom(h);
+        }
+        return *this;
+    }
+
+    /**
+       Destroys all of the memory allocated by the table, but does <B>not</B>
+       call delete on keys or values if they are pointers.
+    */
+    virtual ~FlatTable() {
+        freeMemory();
+    }
+
+    /** Changes the internal memory manager to m */
+    void clearAndSetMemoryManager(const MemoryManager::Ref& m) {
+        clear();
+        m_memoryManager = m;
+    }
+
+    /** Grows the table so that at least \a n elements fit without rehashing. */
+    void setSizeHint(size_t n) {
+        const size_t c = capacityFor(n);
+        if (c > m_capacity) {
+            rehash(c);
+        }
+    }
+
+    float maxLoadFactor() const {
+        return m_maxLoadFactor;
+    }
+
+    /** Takes effect at the next insertion.  Clamped to [0.25, 0.95]. */
+    void setMaxLoadFactor(float f) {
+        m_maxLoadFactor = clamp(f, 0.25f, 0.95f);
+    }
+
+    /** Number of slots */
+    size_t capacity() const {
+        return m_capacity;
+    }
+
+    /** Fraction of the slots that are occupied */
+    float load() const {
+        return (m_capacity == 0) ? 0.0f : (float)((double)m_size / m_capacity);
+    }
+
+    /** Returns the longest probe sequence, in slots.  This is 1 when
+        every key is in its home slot. */
+    int debugGetLongestProbe() const {
+        int longest = 0;
+        for (size_t i = 0; i < m_capacity; ++i) {
+            longest = iMax(longest, (int)m_control[i]);
+        }
+        return longest;
+    }
+
+    /**
+     C++ STL style iterator variable.  See begin().
+     */
+    class Iterator {
+    private:
+        friend class FlatTable<Key, Value, HashFunc, EqualsFunc>;
+
+        const ThisType*     table;
+
+        /** Current slot; table->m_capacity when done */
+        size_t              index;
+
+        Iterator(const ThisType* table, size_t index) : table(table), index(index) {
+            findNext();
+        }
+
+        /** Advances to the next occupied slot, starting with the current one */
+        void findNext() {
+            while ((index < table->m_capacity) && (table->m_control[index] == EMPTY)) {
+                ++index;
+            }
+        }
+
+    public:
+        inline bool operator!=(const Iterator& other) const {
+            return !(*this == other);
+        }
+
+        bool operator==(const Iterator& other) const {
+            return (table == other.table) && (index == other.index);
+        }
+
+        /** Pre increment. */
+        Iterator& operator++() {
+            ++index;
+            findNext();
+            return *this;
+        }
+
+        /** Post increment (slower than preincrement). */
+        Iterator operator++(int) {
+            Iterator old = *this;
+            ++(*this);
+            return old;
+        }
+
+        const Entry& operator*() const {
+            return table->m_slot[index].entry;
+        }
+
+        Entry* operator->() const {
+            return &(table->m_slot[index].entry);
+        }
+
+        operator Entry*() const {
+            return &(table->m_slot[index].entry);
+        }
+
+        bool hasMore() const {
+            return index < table->m_capacity;
+        }
+    };
+
+    /**
+     C++ STL style iterator method.  Returns the first Entry, which
+     contains a key and value.  Use preincrement (++entry) to get to
+     the next element.  Do not modify the table while iterating.
+     */
+    Iterator begin() const {
+        return Iterator(this, 0);
+    }
+
+    /**
+     C++ STL style iterator method.  Returns one after the last iterator
+     element.
+     */
+    const Iterator end() const {
+        return Iterator(this, m_capacity);
+    }
+
+    /** Removes all elements and releases the storage */
+    void clear() {
+        freeMemory();
+    }
+
+    /** Returns the number of keys. */
+    size_t size() const {
+        return m_size;
+    }
+
+    /**
+     If you insert a pointer into the key or value of a table, you are
+     responsible for deallocating the object eventually.
+     */
+    void set(const Key& key, const Value& value) {
+        getCreateEntry(key).value = value;
+    }
+
+    /** Called by getCreate() and set()
+
+        \param created Set to true if the entry was created by this method.
+    */
+    Entry& getCreateEntry(const Key& key, bool& created) {
+        const size_t code = HashFunc::hashCode(key);
+        const int existing = find(key, code);
+        if (existing >= 0) {
+            created = false;
+            return m_slot[existing].entry;
+        }
+
+        if ((double)(m_size + 1) > m_capacity * (double)m_maxLoadFactor) {
+            grow();
+        }
+
+        int i = insertNew(Entry(key), code);
+        while (i < 0) {
+            // A probe sequence overflowed; spread the keys out
+            alwaysAssertM(m_capacity < m_size * 64, "Too many FlatTable keys share a hash code");
+            grow();
+            i = insertNew(Entry(key), code);
+        }
+        created = true;
+        return m_slot[i].entry;
+    }
+
+    Entry& getCreateEntry(const Key& key) {
+        bool ignore;
+        return getCreateEntry(key, ignore);
+    }
+
+    /** Returns the current value that key maps to, creating it if necessary.*/
+    Value& getCreate(const Key& key) {
+        return getCreateEntry(key).value;
+    }
+
+    /** \param created True if the element was created. */
+    Value& getCreate(const Key& key, bool& created) {
+        return getCreateEntry(key, created).value;
+    }
+
+    /** If @a member is present, sets @a removed to the element
+        being removed and returns true.  Otherwise returns false
+        and does not write to @a removed. */
+    bool getRemove(const Key& key, Key& removedKey, Value& removedValue) {
+        const int i = find(key, HashFunc::hashCode(key));
+        if (i < 0) {
+            return false;
+        }
+        removedKey   = m_slot[i].entry.key;
+        removedValue = m_slot[i].entry.value;
+        removeAt(i);
+        return true;
+    }
+
+    /**
+    Removes an element from the table if it is present.
+    @return true if the element was found and removed, otherwise  false
+    */
+    bool remove(const Key& key) {
+        const int i = find(key, HashFunc::hashCode(key));
+        if (i < 0) {
+            return false;
+        }
+        removeAt(i);
+        return true;
+    }
+
+    /** If a value that is EqualsFunc to @a member is present, returns a pointer to the
+        version stored in the data structure, otherwise returns NULL.
+     */
+    const Key* getKeyPointer(const Key& key) const {
+        const int i = find(key, HashFunc::hashCode(key));
+        return (i < 0) ? NULL : &(m_slot[i].entry.key);
+    }
+
+    /** Returns the value associated with key. */
+    Value& get(const Key& key) const {
+        Value* v = getPointer(key);
+        debugAssertM(v != NULL, "Key not found");
+        return *v;
+    }
+
+    /** Returns a pointer to the element if it exists, or NULL if it does not.
+        The pointer is invalidated by the next insertion or removal. */
+    Value* getPointer(const Key& key) const {
+        const int i = find(key, HashFunc::hashCode(key));
+        return (i < 0) ? NULL : &(m_slot[i].entry.value);
+    }
+
+    /**
+    If the key is present in the table, val is set to the associated value and returns true.
+    If the key is not present, returns false.
+    */
+    bool get(const Key& key, Value& val) const {
+        const Value* v = getPointer(key);
+        if (v != NULL) {
+            val = *v;
+            return true;
+        } else {
+            return false;
+        }
+    }
+
+    /** Returns true if key is in the table. */
+    bool containsKey(const Key& key) const {
+        return find(key, HashFunc::hashCode(key)) >= 0;
+    }
+
+    /** Short syntax for get. */
+    inline Value& operator[](const Key &key) const {
+        return get(key);
+    }
+
+    void getKeys(Array<Key>& keyArray) const {
+        keyArray.resize(0, DONT_SHRINK_UNDERLYING_ARRAY);
+        for (size_t i = 0; i < m_capacity; ++i) {
+            if (m_control[i] != EMPTY) {
+                keyArray.append(m_slot[i].entry.key);
+            }
+        }
+    }
+
+    /** Calls delete on all of the keys and then clears the table. */
+    void deleteKeys() {
+        for (size_t i = 0; i < m_capacity; ++i) {
+            if (m_control[i] != EMPTY) {
+                delete m_slot[i].entry.key;
+            }
+        }
+        clear();
+    }
+
+    /**
+    Calls delete on all of the values.  This is unsafe--
+    do not call unless you know that each value appears
+    at most once.
+
+    Does not clear the table, so you are left with a table
+    of NULL pointers.
+    */
+    void deleteValues() {
+        for (size_t i = 0; i < m_capacity; ++i) {
+            if (m_control[i] != EMPTY) {
+                delete m_slot[i].entry.value;
+                m_slot[i].entry.value = NULL;
+            }
+        }
+    }
+};
+
+} // namespace
+
+#ifdef _MSC_VER
+#   pragma warning (pop)
+#endif
+
+#endif
@@ -31,6 +31,7 @@
 #include "G3D/Array.h"
 #include "G3D/SmallArray.h"
 #include "G3D/Queue.h"
+#include "G3D/LockFreeQueue.h"
 #include "G3D/Crypto.h"
 #include "G3D/format.h"
 #include "G3D/Vector2.h"
@@ -58,6 +59,7 @@
 #include "G3D/stringutils.h"
 #include "G3D/prompt.h"
 #include "G3D/Table.h"
+#include "G3D/FlatTable.h"
 #include "G3D/FileSystem.h"
 #include "G3D/Set.h"
 #include "G3D/GUniqueID.h"
@@ -112,16 +114,22 @@ template<class T> struct HashTrait< G3D::ReferenceCountedPointer<T> > {
 #include "G3D/GLight.h"
 #include "G3D/KDTree.h"
 #include "G3D/PointKDTree.h"
+#include "G3D/DynamicBVH.h"
+#include "G3D/OcclusionBuffer.h"
 #include "G3D/TextOutput.h"
 #include "G3D/MeshBuilder.h"
 #include "G3D/Stopwatch.h"
 #include "G3D/AtomicInt32.h"
 #include "G3D/GThread.h"
 #include "G3D/ThreadSet.h"
+#include "G3D/TaskScheduler.h"
 #include "G3D/RegistryUtil.h"
 #include "G3D/Any.h"
 #include "G3D/XML.h"
+#include "G3D/XMLReader.h"
 #include "G3D/PointHashGrid.h"
+#include "G3D/MortonGrid.h"
+#include "G3D/radixSort.h"
 #include "G3D/Map2D.h"
 #include "G3D/Image1.h"
 #include "G3D/Image1uint8.h"
@@ -134,6 +142,7 @@ template<class T> struct HashTrait< G3D::ReferenceCountedPointer<T> > {
 #include "G3D/Pointer.h"
 #include "G3D/Matrix.h"
 #include "G3D/ImageFormat.h"
+#include "G3D/ImageLoader.h"
 
 #ifdef _MSC_VER
 #   pragma comment(lib, "zlib")
@@ -14,7 +14,7 @@
   \maintainer Morgan McGuire, http://graphics.cs.williams.edu
 
   \created 2002-05-27
-  \edited  2010-01-04
+  \edited  2010-06-23
 
   Copyright 2000-2010, Morgan McGuire.
   All rights reserved.
@@ -37,6 +37,7 @@
 namespace G3D {
 class BinaryInput;
 class BinaryOutput;
+class ImageFormat;
 
 
 /**
@@ -108,6 +109,44 @@ public:
         std::string filename;
     };
 
+    /**
+     \brief Receives an image from GImage::decodeRows one band of rows at a time.
+     */
+    class RowCallback {
+    public:
+        virtual ~RowCallback() {}
+
+        /** Called once, before any rows, with the size of the image
+            that will be delivered. */
+        virtual void beginRows(int width, int height, int channels) {
+            (void)width; (void)height; (void)channels;
+        }
+
+        /** Optionally returns memory for rows [y, y + numRows), packed
+            with no padding, into which the decoder writes directly.  The
+            default returns NULL and the decoder uses its own band buffer. */
+        virtual uint8* rowDestination(int y, int numRows) {
+            (void)y; (void)numRows;
+            return NULL;
+        }
+
+        /** Rows [y, y + numRows) are ready in \a pixels, packed with no
+            padding.  Unless \a pixels came from rowDestination(), it is
+            reused for the next band. */
+        virtual void processRows(int y, int numRows, const uint8* pixels) = 0;
+    };
+
+    /**
+     \brief Supplies an image to GImage::encodeRows one band of rows at a time.
+     */
+    class RowSource {
+    public:
+        virtual ~RowSource() {}
+
+        /** Fills \a pixels with rows [y, y + numRows), packed with no padding */
+        virtual void fetchRows(int y, int numRows, uint8* pixels) = 0;
+    };
+
     /** PGM, PPM, and PBM all come in two versions and are classified as PPM_* files */
     enum Format {JPEG, BMP, TGA, PCX, ICO, PNG, 
         PPM_BINARY, PGM_BINARY = PPM_BINARY,
@@ -231,6 +270,18 @@ public:
 
 private:
 
+    /** Converts m_width x m_height pixels from \a src to \a dst,
+        splitting large images across TaskScheduler threads. */
+    void convertPixels(const uint8* src, const ImageFormat* srcFormat, uint8* dst, const ImageFormat* dstFormat) const;
+
+    static void decodePNGRows(BinaryInput& input, RowCallback& callback, int scaleDenominator, int bandHeight);
+
+    static void decodeJPEGRows(BinaryInput& input, RowCallback& callback, int scaleDenominator, int bandHeight);
+
+    static void encodePNGRows(int width, int height, int channels, RowSource& source, BinaryOutput& out, int bandHeight);
+
+    static void encodeJPEGRows(int width, int height, int channels, RowSource& source, BinaryOutput& out, int bandHeight);
+
     void encodeBMP(
         BinaryOutput&       out) const;
 
@@ -241,18 +292,6 @@ private:
     void encodeTGA(
         BinaryOutput&       out) const;
 
-    /**
-     Converts this image into a JPEG
-     */
-    void encodeJPEG(
-        BinaryOutput&       out) const;
-
-    /**
-     Converts this image into a JPEG
-     */
-    void encodePNG(
-        BinaryOutput&       out) const;
-
     void encodePPM(
         BinaryOutput&       out) const;
 
@@ -265,18 +304,12 @@ private:
     void decodeBMP(
         BinaryInput&        input);
 
-    void decodeJPEG(
-        BinaryInput&        input);
-
     void decodePCX(
         BinaryInput&        input);
 
     void decodeICO(
         BinaryInput&        input);
 
-    void decodePNG(
-        BinaryInput&        input);
-
     void decodePPM(
         BinaryInput&        input);
 
@@ -451,12 +484,69 @@ public:
 
     /**
      Decodes the buffer into this image.
-     @param format Must be the correct format.
+     @param format Must be the correct format, or AUTODETECT to guess it
+     from the filename of \a input and its contents.
      */
     void decode(
         BinaryInput&        input,
         Format              format);
 
+    /**
+     Decodes a PNG or JPEG image \a bandHeight rows at a time, passing
+     each band to \a callback, so that the full-size image never has to
+     be in memory.  Rows are delivered top to bottom.  Channels are as
+     decode() would produce: 1, 3, or 4 for PNG and 3 for JPEG.
+
+     \param scaleDenominator 1, 2, 4, or 8.  The image is delivered at
+     iCeil(width / scaleDenominator) x iCeil(height / scaleDenominator).
+     JPEG images are scaled inside the inverse DCT, so most of the
+     decoding work is skipped; PNG rows are box filtered as they are
+     decoded.
+
+     Interlaced PNG files are decoded into a full-size buffer first,
+     because no row is final until the last pass.
+
+     Throws GImage::Error for other formats.
+     */
+    static void decodeRows(
+        BinaryInput&        input,
+        Format              format,
+        RowCallback&        callback,
+        int                 scaleDenominator = 1,
+        int                 bandHeight = 64);
+
+    /** Memory maps \a filename and decodes it with decodeRows(BinaryInput&, ...) */
+    static void decodeRows(
+        const std::string&  filename,
+        RowCallback&        callback,
+        int                 scaleDenominator = 1,
+        int                 bandHeight = 64);
+
+    /**
+     Loads a PNG or JPEG at 1 / \a scaleDenominator of its size, e.g., for
+     thumbnails, without holding the full-size image in memory.
+     \sa decodeRows
+     */
+    void loadScaled(
+        const std::string&  filename,
+        int                 scaleDenominator);
+
+    /**
+     Encodes a \a width x \a height PNG or JPEG image whose pixels are
+     fetched from \a source \a bandHeight rows at a time, so that the
+     full-size image never has to be in memory.  \a channels may be 1, 3,
+     or 4; alpha is dropped for JPEG.  The compressed data is written to
+     \a out as it is produced.  Does not commit \a out.
+     */
+    static void encodeRows(
+        int                 width,
+        int                 height,
+        int                 channels,
+        RowSource&          source,
+        Format              format,
+        BinaryOutput&       out,
+        int                 bandHeight = 64);
+
     /** Returns the size of this object in bytes */
     int sizeInMemory() const;
 
@@ -4,7 +4,7 @@
   @maintainer Morgan McGuire, http://graphics.cs.williams.edu
 
   @created 2007-01-31
-  @edited  2007-01-31
+  @edited  2010-06-22
 */
 
 
@@ -79,6 +79,9 @@ public:
 
     /** Saves in any of the formats supported by G3D::GImage. */
     void save(const std::string& filename, GImage::Format fmt = GImage::AUTODETECT);
+
+    /** Appends the mip levels below this image to \a chain, as Image4 instances.  \sa Map2D::generateMipChain */
+    void generateMipChain(Array<Ref>& chain, ResampleFilter filter = ResampleFilter::BOX, bool parallel = true) const;
 };
 
 } // G3D
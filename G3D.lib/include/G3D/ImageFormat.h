@@ -4,7 +4,7 @@
   @maintainer Morgan McGuire, http://graphics.cs.williams.edu
 
   @created 2003-05-23
-  @edited  2010-05-01
+  @edited  2010-06-21
 */
 
 #ifndef GLG3D_ImageFormat_H
@@ -417,14 +417,35 @@ public:
 
         YUV422 expects data in YUY2 format (Y, U, Y2, v).  Most YUV formats require width and heights that are multiples of 2.
 
+        If \a parallel is true, large images are split into bands of rows that are converted
+        concurrently on TaskScheduler::global().  The result is identical to a serial conversion.
+        Conversions to and from Bayer formats and plain copies always run on the calling thread.
+
         Returns true if a conversion was available, false if none occurred.
     */
     static bool convert(const Array<const void*>& srcBytes, int srcWidth, int srcHeight, const ImageFormat* srcFormat, int srcRowPadBits,
 	                    const Array<void*>& dstBytes, const ImageFormat* dstFormat, int dstRowPadBits,
-	                    bool invertY = false, BayerAlgorithm bayerAlg = BayerAlgorithm::MHC);
+	                    bool invertY = false, BayerAlgorithm bayerAlg = BayerAlgorithm::MHC, bool parallel = false);
 
     /* Checks if a conversion between two formats is available. */
     static bool conversionAvailable(const ImageFormat* srcFormat, int srcRowPadBits, const ImageFormat* dstFormat, int dstRowPadBits, bool invertY = false);
+
+    /** Instruction set extensions that convert() may use for its most common conversions. */
+    enum SIMDLevel {
+        /** Portable scalar code only; the reference implementation */
+        SIMD_NONE,
+        SIMD_SSE2,
+        SIMD_SSSE3
+    };
+
+    /** The most capable instruction set that convert() currently uses.  Defaults to the best
+        one that both this processor (System::hasSSE2, System::hasSSSE3) and this build support. */
+    static SIMDLevel convertSIMDLevel();
+
+    /** Restricts convert() to instruction sets up to \a maxLevel, e.g., to compare the SIMD
+        converters against the scalar reference.  Levels that the processor does not support
+        are never used.  Do not call while another thread is inside convert(). */
+    static void setConvertSIMDLevel(SIMDLevel maxLevel);
 };
 
 typedef ImageFormat TextureFormat;
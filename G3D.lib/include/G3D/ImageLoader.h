@@ -0,0 +1,278 @@
+/**
+  @file ImageLoader.h
+
+  Decodes batches of image files on a TaskScheduler and caches the results.
+
+  @sa G3D::GImage, G3D::TaskScheduler
+ */
+
+#ifndef G3D_ImageLoader_h
+#define G3D_ImageLoader_h
+
+#include "G3D/platform.h"
+#include "G3D/ReferenceCount.h"
+#include "G3D/AtomicInt32.h"
+#include "G3D/GMutex.h"
+#include "G3D/GImage.h"
+#include "G3D/Table.h"
+#include "G3D/Array.h"
+#include "G3D/TaskScheduler.h"
+#include <string>
+
+namespace G3D {
+
+/**
+ \brief Loads image files asynchronously on a TaskScheduler, keeping
+ recently decoded images in a size-bounded LRU cache.
+
+ load() returns immediately with one Future per file.  The files are
+ read and decoded by the scheduler's workers, so a batch of N files
+ decodes on roughly as many cores as the scheduler has threads.
+ Filenames may refer to files inside zipfiles (see FileSystem).
+
+ Decoded images are cached by resolved path and modification time, so
+ loading the same unchanged file again returns the Future of the
+ earlier load without touching the disk, and a file that has changed
+ on disk since it was cached is decoded again.  Loading a file whose
+ decode is still in progress also returns the pending Future.  The
+ cache is trimmed to maxCacheSize() bytes, least recently loaded
+ first, on each call to load() and trimCache() and whenever a decode
+ completes, so the cache does not grow past its limit while a large
+ batch finishes between calls.  Evicted images stay alive for as
+ long as the caller holds their Futures.
+
+ <pre>
+    ImageLoader::Ref loader = ImageLoader::create();
+
+    Array<ImageLoader::Future::Ref> future;
+    loader->load(filenameArray, future);
+
+    // ... other work ...
+
+    for (int i = 0; i < future.size(); ++i) {
+        if (future[i]->failed()) {
+            debugPrintf("%s\n", future[i]->error().c_str());
+        } else {
+            use(future[i]->image());
+        }
+    }
+ </pre>
+
+ load() resolves the filenames and reads their modification times on
+ the calling thread before it locks the cache.  load() and the cache
+ methods may be called from any thread.
+
+ <B>BETA API</B>  This is unsupported and may change
+ */
+class ImageLoader : public ReferenceCountedObject {
+public:
+
+    typedef ReferenceCountedPointer<ImageLoader> Ref;
+
+    /**
+     \brief The result of loading one file, which may still be in progress.
+
+     The accessors other than filename() and isReady() block until the
+     file has been decoded, executing other scheduler tasks while they wait.
+     */
+    class Future : public ReferenceCountedObject, private Task {
+    private:
+        friend class ImageLoader;
+
+        std::string         m_filename;
+
+        /** Modification time of the file when the load was requested */
+        int64               m_modificationTime;
+
+        GImage              m_image;
+
+        /** Empty unless the load failed */
+        std::string         m_error;
+
+        /** Non-zero once m_image or m_error is final */
+        AtomicInt32         m_ready;
+
+        /** Holds the decode task.  Mutable because waiting does not change the result. */
+        mutable TaskGroup   m_group;
+
+        /** Notified when the decode completes.  NULL if no decode was
+            started.  The loader waits for every started decode before
+            it is destroyed. */
+        ImageLoader*        m_loader;
+
+        /** Non-zero once run() no longer touches m_loader */
+        AtomicInt32         m_finished;
+
+        Future(const std::string& filename, int64 modificationTime, const TaskScheduler::Ref& scheduler);
+
+        /** Sets the error and marks this ready */
+        void fail(const std::string& error);
+
+        /** Reads and decodes the file, then marks this ready */
+        void decode();
+
+        /** Decodes on a worker thread and notifies m_loader */
+        virtual void run();
+
+    public:
+
+        typedef ReferenceCountedPointer<Future> Ref;
+
+        /** Waits for the decode task, if it is still pending */
+        ~Future();
+
+        /** The resolved filename */
+        const std::string& filename() const {
+            return m_filename;
+        }
+
+        /** True if the image has been decoded or the load has failed.  Never blocks. */
+        bool isReady() const {
+            return m_ready.acquireValue() != 0;
+        }
+
+        /** Blocks until isReady() */
+        void wait() const;
+
+        bool failed() const {
+            wait();
+            return ! m_error.empty();
+        }
+
+        /** Empty unless failed() */
+        const std::string& error() const {
+            wait();
+            return m_error;
+        }
+
+        /** The decoded image, which is 0x0 if failed().  Images returned
+            from the cache are shared by all of their Futures, so copy
+            before modifying. */
+        const GImage& image() const {
+            wait();
+            return m_image;
+        }
+    };
+
+private:
+
+    class CacheEntry {
+    public:
+        Future::Ref         future;
+
+        /** Value of m_clock when this entry was last returned by load() */
+        uint64              lastUse;
+    };
+
+    /** Orders cache entries from least to most recently used */
+    class LastUseLessThan {
+    public:
+        bool operator()(const CacheEntry* a, const CacheEntry* b) const {
+            return a->lastUse < b->lastUse;
+        }
+    };
+
+    /** Trims the cache on a worker after decodes complete */
+    class TrimTask : public Task {
+    public:
+        ImageLoader*        loader;
+        virtual void run();
+    };
+
+    TaskScheduler::Ref                  m_scheduler;
+
+    TrimTask                            m_trimTask;
+
+    /** Holds m_trimTask */
+    TaskGroup                           m_trimGroup;
+
+    /** Number of trims requested since m_trimTask last started a pass.
+        m_trimTask is queued only when this rises from zero. */
+    AtomicInt32                         m_trimRequests;
+
+    /** Guards every member below */
+    mutable GMutex                      m_mutex;
+
+    /** Keyed by resolved filename */
+    Table<std::string, CacheEntry>      m_cache;
+
+    /** Every Future whose decode task may still use this loader,
+        whether or not it is still cached */
+    Array<Future::Ref>                  m_decoding;
+
+    int64                               m_maxCacheSize;
+
+    /** Incremented by every load() of a single file */
+    uint64                              m_clock;
+
+    int                                 m_numCacheHits;
+    int                                 m_numCacheMisses;
+
+    ImageLoader(int64 maxCacheSize, const TaskScheduler::Ref& scheduler);
+
+    /** Loads one file, given its resolved \a path and the modification
+        time of that path.  The caller holds m_mutex.
+
+        Futures that the cache drops are appended to \a released
+        rather than destroyed, because destroying a Future may wait for
+        scheduler tasks; callers release them after unlocking m_mutex.
+        The same applies to trimCacheLocked(). */
+    Future::Ref loadLocked(const std::string& path, int64 modificationTime, Array<Future::Ref>& released);
+
+    /** Removes failed loads and evicts the least recently used images
+        until the cache fits.  The caller holds m_mutex. */
+    void trimCacheLocked(Array<Future::Ref>& released);
+
+    /** Called by a Future's decode task when it completes */
+    void requestTrim();
+
+    /** Bytes used by the decoded images in the cache.  The caller holds m_mutex. */
+    int64 cacheSizeLocked() const;
+
+public:
+
+    /** Waits for all pending decodes */
+    ~ImageLoader();
+
+    /**
+     \param maxCacheSize Bytes of decoded images to keep cached after
+     their Futures are released.  Zero disables caching, although
+     concurrent requests for a file that is still decoding share one load.
+     */
+    static Ref create(int64 maxCacheSize = 256 * 1024 * 1024,
+                      const TaskScheduler::Ref& scheduler = TaskScheduler::global());
+
+    /** Starts loading \a filename and returns immediately.  If the file
+        does not exist, the returned Future has already failed. */
+    Future::Ref load(const std::string& filename);
+
+    /** Starts loading every file in \a filenameArray, setting
+        <code>futureArray[i]</code> to the Future for
+        <code>filenameArray[i]</code>. */
+    void load(const Array<std::string>& filenameArray, Array<Future::Ref>& futureArray);
+
+    /** Bytes used by the decoded images that are currently cached */
+    int64 cacheSize() const;
+
+    int64 maxCacheSize() const;
+
+    /** Takes effect on the next call to load() or trimCache(), or when a decode completes */
+    void setMaxCacheSize(int64 bytes);
+
+    /** Enforces maxCacheSize() immediately */
+    void trimCache();
+
+    /** Forgets every cached image.  Pending loads still complete for
+        the holders of their Futures. */
+    void clearCache();
+
+    /** Number of load() calls satisfied by a cached or pending Future */
+    int numCacheHits() const;
+
+    /** Number of load() calls that started a new decode */
+    int numCacheMisses() const;
+};
+
+} // namespace G3D
+
+#endif
@@ -186,6 +186,12 @@ namespace G3D {
  for data distributed along 2 or 1 axes by simply returning bounds
  that are always zero along one or more dimensions.
 
+ <B>Static Content</B>
+ For sets that do not change after they are built, call KDTree::freeze
+ after balancing.  This copies the tree into a compact depth-first
+ array so that queries touch contiguous memory instead of chasing
+ pointers between heap-allocated nodes.
+
 */
 template< class T, 
           class BoundsFunc = BoundsTrait<T>, 
@@ -327,6 +333,55 @@ protected:
 	    }
     };
 
+    /** Returns true if the ray can reach \a bounds before travelling \a distance */
+    static bool rayCanHit(const Ray& ray, const AABox& bounds, float distance) {
+        Vector3 location;
+        bool alreadyInsideBounds = false;
+        bool rayWillHitBounds = 
+            CollisionDetection::collisionLocationForMovingPointFixedAABox(
+                ray.origin(), ray.direction(), bounds, location, alreadyInsideBounds);
+        
+        return (alreadyInsideBounds ||                
+                (rayWillHitBounds && ((location - ray.origin()).squaredLength() < square(distance))));
+    }
+
+    /** Node of the contiguous tree built by freeze().  
+
+        Nodes are stored in depth-first order, so the low child of
+        node i (if present) is node i + 1, and the values at node i
+        are frozenHandle[firstValue ... frozenNode[i + 1].firstValue - 1].
+        The final node is a sentinel that only marks the end of the
+        values. 16 bytes, so that four nodes share a cache line. 
+        Split bounds are not stored; they are recomputed from the
+        splitting planes during traversal.*/
+    class FrozenNode {
+    public:
+        float               splitLocation;
+
+        /** Split axis in bits 0-1, bit 2 is set if the node has a low child */
+        uint32              flags;
+
+        /** Index of the high child, or -1 if there is none */
+        int32               highChild;
+
+        /** Index into frozenHandle and frozenBounds */
+        int32               firstValue;
+
+        enum {LOW_CHILD_BIT = 4};
+
+        inline Vector3::Axis splitAxis() const {
+            return Vector3::Axis(flags & 3);
+        }
+
+        inline bool hasLowChild() const {
+            return (flags & LOW_CHILD_BIT) != 0;
+        }
+
+        inline bool isLeaf() const {
+            return ! hasLowChild() && (highChild == -1);
+        }
+    };
+
     // Using System::malloc with this class provided no speed improvement.
     class Node {
     public:
@@ -491,9 +546,15 @@ protected:
             }
         }
 
-        /** Clears the member table */
+        /** Reads the recursive format written by previous versions of
+            serializeStructure.  Clears the member table */
         static Node* deserializeStructure(BinaryInput& bi) {
-            if (bi.readUInt8() == 0) {
+            return deserializeStructure(bi.readUInt8(), bi);
+        }
+
+        /** \param tag The first byte of the node, which has already been read */
+        static Node* deserializeStructure(uint8 tag, BinaryInput& bi) {
+            if (tag == 0) {
                 return NULL;
             } else {
                 Node* n = new Node();
@@ -587,16 +648,7 @@ protected:
         /** Returns true if the ray intersects this node */
         bool intersects(const Ray& ray, float distance) const {
             // See if the ray will ever hit this node or its children
-            Vector3 location;
-            bool alreadyInsideBounds = false;
-            bool rayWillHitBounds = 
-                CollisionDetection::collisionLocationForMovingPointFixedAABox(
-                    ray.origin(), ray.direction(), splitBounds, location, alreadyInsideBounds);
-           
-            bool canHitThisNode = (alreadyInsideBounds ||                
-                (rayWillHitBounds && ((location - ray.origin()).squaredLength() < square(distance))));
-
-            return canHitThisNode;
+            return rayCanHit(ray, splitBounds, distance);
         }
 
         template<typename RayCallback>
@@ -868,6 +920,204 @@ protected:
         return dst;
     }
 
+    /** Appends \a node and its descendants to \a out in depth-first
+        order.  If \a handleArray is not NULL, the values at each node
+        are appended to it and FrozenNode::firstValue is set.  Does
+        not append the sentinel.*/
+    static void flatten(const Node* node, Array<FrozenNode>& out, Array<Handle*>* handleArray) {
+        const int i = out.size();
+        out.next();
+        out[i].splitLocation = node->splitLocation;
+        out[i].flags         = uint32(node->splitAxis) | ((node->child[0] != NULL) ? FrozenNode::LOW_CHILD_BIT : 0);
+        out[i].highChild     = -1;
+        out[i].firstValue    = 0;
+
+        if (handleArray != NULL) {
+            out[i].firstValue = handleArray->size();
+            handleArray->append(node->valueArray);
+        }
+
+        if (node->child[0] != NULL) {
+            flatten(node->child[0], out, handleArray);
+        }
+
+        if (node->child[1] != NULL) {
+            // out may have been reallocated by the recursive call
+            out[i].highChild = out.size();
+            flatten(node->child[1], out, handleArray);
+        }
+    }
+
+    /** Discards the frozen tree.  Called by every method that modifies the set. */
+    void thaw() {
+        frozenNode.clear();
+        frozenHandle.clear();
+        frozenBounds.clear();
+    }
+
+    /** Frozen version of Node::getIntersectingMembers */
+    void getFrozenIntersectingMembers(
+        int                 n,
+        const AABox&        box,
+        const Sphere&       sphere,
+        Array<T*>&          members,
+        bool                useSphere) const {
+
+        const FrozenNode& node = frozenNode[n];
+
+        // Test all values at this node
+        const int end = frozenNode[n + 1].firstValue;
+        for (int v = node.firstValue; v < end; ++v) {
+            const AABox& bounds = frozenBounds[v];
+            if (bounds.intersects(box) &&
+                (! useSphere || bounds.intersects(sphere))) {
+                members.append(& (frozenHandle[v]->value));
+            }
+        }
+
+        const Vector3::Axis splitAxis = node.splitAxis();
+
+        // If the left child overlaps the box, recurse into it
+        if (node.hasLowChild() && (box.low()[splitAxis] < node.splitLocation)) {
+            getFrozenIntersectingMembers(n + 1, box, sphere, members, useSphere);
+        }
+
+        // If the right child overlaps the box, recurse into it
+        if ((node.highChild != -1) && (box.high()[splitAxis] > node.splitLocation)) {
+            getFrozenIntersectingMembers(node.highChild, box, sphere, members, useSphere);
+        }
+    }
+
+    /** Frozen version of the plane getIntersectingMembers.
+        \param splitBounds Bounds of node \a n */
+    void getFrozenIntersectingMembers(
+        const Array<Plane>&         plane,
+        Array<T*>&                  members,
+        int                         n,
+        const AABox&                splitBounds,
+        uint32                      parentMask) const {
+
+        int dummy;
+        const FrozenNode& node = frozenNode[n];
+
+        if (parentMask == 0) {
+            // None of these planes can cull anything.  The subtree is
+            // contiguous in depth-first order, so find its last node and
+            // append every value in one pass.
+            int last = n;
+            while (! frozenNode[last].isLeaf()) {
+                last = (frozenNode[last].highChild != -1) ? frozenNode[last].highChild : (last + 1);
+            }
+            const int subtreeEnd = frozenNode[last + 1].firstValue;
+            for (int v = node.firstValue; v < subtreeEnd; ++v) {
+                members.append(& (frozenHandle[v]->value));
+            }
+        } else {
+            // Test values at this node against remaining planes
+            const int end = frozenNode[n + 1].firstValue;
+            for (int v = node.firstValue; v < end; ++v) {
+                if (! frozenBounds[v].culledBy(plane, dummy, parentMask)) {
+                    members.append(& (frozenHandle[v]->value));
+                }
+            }
+
+            if (node.isLeaf()) {
+                return;
+            }
+
+            AABox childBounds[2];
+            splitBounds.split(node.splitAxis(), node.splitLocation, childBounds[0], childBounds[1]);
+            const int child[2] = {node.hasLowChild() ? (n + 1) : -1, node.highChild};
+
+            uint32 childMask  = 0xFFFFFF;
+
+            // Iterate through child nodes
+            for (int c = 0; c < 2; ++c) {
+                if ((child[c] != -1) &&
+                    ! childBounds[c].culledBy(plane, dummy, parentMask, childMask)) {
+                    // This node was not culled
+                    getFrozenIntersectingMembers(plane, members, child[c], childBounds[c], childMask);
+                }
+            }
+        }
+    }
+
+    /** Frozen version of Node::intersectRay.
+        \param splitBounds Bounds of node \a n */
+    template<typename RayCallback>
+    void intersectFrozenRay(
+        int                 n,
+        const AABox&        splitBounds,
+        const Ray&          ray, 
+        RayCallback&        intersectCallback, 
+        float&              distance,
+        bool                intersectCallbackIsFast) const {
+
+        if (! rayCanHit(ray, splitBounds, distance)) {
+            // The ray doesn't hit this node, so it can't hit the children of the node.
+            return;
+        }
+
+        const FrozenNode& node = frozenNode[n];
+
+        // Test for intersection against every object at this node.
+        const int end = frozenNode[n + 1].firstValue;
+        for (int v = node.firstValue; v < end; ++v) {
+            if (intersectCallbackIsFast || rayCanHit(ray, frozenBounds[v], distance)) {
+                intersectCallback(ray, frozenHandle[v]->value, distance);
+            }
+        }
+
+        if (node.isLeaf()) {
+            return;
+        }
+
+        // Same traversal order as Node::intersectRay
+        const Vector3::Axis splitAxis = node.splitAxis();
+        const float splitLocation = node.splitLocation;
+        const int child[2] = {node.hasLowChild() ? (n + 1) : -1, node.highChild};
+
+        AABox childBounds[2];
+        splitBounds.split(splitAxis, splitLocation, childBounds[0], childBounds[1]);
+
+        enum {NONE = -1};
+        int firstChild = NONE;
+        int secondChild = NONE;
+
+        if (ray.origin()[splitAxis] < splitLocation) {
+            firstChild = 0;
+            if (ray.direction()[splitAxis] > 0) {
+                secondChild = 1;
+            }
+        } else if (ray.origin()[splitAxis] > splitLocation) {
+            firstChild = 1;
+            if (ray.direction()[splitAxis] < 0) {
+                secondChild = 0;
+            }
+        } else {
+            if (ray.direction()[splitAxis] < 0) {
+                firstChild = 0;
+            } else if (ray.direction()[splitAxis] > 0) {
+                firstChild = 1;
+            }
+        }
+
+        if ((firstChild != NONE) && (child[firstChild] != -1)) {
+            intersectFrozenRay(child[firstChild], childBounds[firstChild], ray, intersectCallback, distance, intersectCallbackIsFast);
+        }
+
+        if (ray.direction()[splitAxis] != 0) {
+            float distanceToSplittingPlane = (splitLocation - ray.origin()[splitAxis]) / ray.direction()[splitAxis];
+            if (distanceToSplittingPlane > distance) {
+                return;
+            }
+        }
+
+        if ((secondChild != NONE) && (child[secondChild] != -1)) {
+            intersectFrozenRay(child[secondChild], childBounds[secondChild], ray, intersectCallback, distance, intersectCallbackIsFast);
+        }
+    }
+
    /**
     Wrapper for a Handle; used to create a memberTable that acts like Table<Handle, Node*> but
     stores only Handle* internally to avoid memory copies.
@@ -876,11 +1126,26 @@ protected:
 
     typedef Table<Member, Node*> MemberTable;
 
+    /** First byte of the flat format written by serializeStructure.  The
+        recursive format begins with 0 or 1. */
+    enum {FLAT_STRUCTURE_TAG = 2};
+
     /** Maps members to the node containing them */
     MemberTable             memberTable;
 
     Node*                   root;
 
+    /** Depth-first copy of the tree structure built by freeze(), 
+        including a final sentinel.  Empty when the tree is not frozen.*/
+    Array<FrozenNode>       frozenNode;
+
+    /** Values of the frozen tree, grouped by node in depth-first order.
+        The handles are owned by memberTable.*/
+    Array<Handle*>          frozenHandle;
+
+    /** frozenHandle[i]->bounds, packed for cache coherence */
+    Array<AABox>            frozenBounds;
+
 public:
 
     /** To construct a balanced tree, insert the elements and then call
@@ -894,6 +1159,7 @@ public:
 
 
     KDTree& operator=(const KDTree& src) {
+        thaw();
         delete root;
         // Clone tree takes care of filling out the memberTable.
         root = cloneTree(src.root);
@@ -924,6 +1190,8 @@ public:
         // Delete the tree structure itself
         delete root;
         root = NULL;
+
+        thaw();
     }
 
     int size() const {
@@ -940,6 +1208,7 @@ public:
             // Already in the set
             return;
         }
+        thaw();
 
         Handle* h = new Handle(value);
 
@@ -964,6 +1233,7 @@ public:
         than inserting each element in turn.  You still need to balance
         the tree at the end.*/
     void insert(const Array<T>& valueArray) {
+        thaw();
         if (root == NULL) {
             // Optimized case for an empty tree; don't bother
             // searching or reallocating the root node's valueArray
@@ -1016,6 +1286,7 @@ public:
         debugAssertM(contains(value),
             "Tried to remove an element from a "
             "KDTree that was not present");
+        thaw();
 
         // Get the list of elements at the node
         Handle h(value);
@@ -1095,6 +1366,7 @@ public:
             // Tree is empty
             return;
         }
+        thaw();
 
         // Get all handles and delete the old tree structure
         Node* oldRoot = root;
@@ -1140,6 +1412,46 @@ public:
     }
 
 
+    /**
+     Copies the tree into contiguous arrays of compact nodes, 
+     values, and bounds in depth-first order, which
+     getIntersectingMembers and intersectRay then traverse instead of
+     the individual heap-allocated nodes.  Use for static content
+     such as level geometry: call after balance() (or
+     deserializeStructure() and insert()).
+
+     Any subsequent insert, remove, update, balance, or clear discards
+     the frozen copy, returning the tree to normal operation.  Freezing
+     does not change the results of any query.
+     */
+    void freeze() {
+        thaw();
+        if (root == NULL) {
+            return;
+        }
+
+        flatten(root, frozenNode, &frozenHandle);
+
+        // Sentinel marking the end of the last node's values
+        FrozenNode& sentinel = frozenNode.next();
+        sentinel.splitLocation = 0;
+        sentinel.flags         = 0;
+        sentinel.highChild     = -1;
+        sentinel.firstValue    = frozenHandle.size();
+
+        frozenBounds.resize(frozenHandle.size());
+        for (int i = 0; i < frozenHandle.size(); ++i) {
+            frozenBounds[i] = frozenHandle[i]->bounds;
+        }
+    }
+
+
+    /** True if freeze() has been called since the last modification */
+    bool isFrozen() const {
+        return frozenNode.size() > 0;
+    }
+
+
 protected:
 
     /**
@@ -1198,12 +1510,16 @@ public:
             return;
         }
 
-        getIntersectingMembers(plane, members, root, 0xFFFFFF);
+        if (isFrozen()) {
+            getFrozenIntersectingMembers(plane, members, 0, AABox::large(), 0xFFFFFF);
+        } else {
+            getIntersectingMembers(plane, members, root, 0xFFFFFF);
+        }
     }
 
     void getIntersectingMembers(const Array<Plane>& plane, Array<T>& members) const {
         Array<T*> temp;
-        getIntersectingMembers(plane, temp, root, 0xFFFFFF);
+        getIntersectingMembers(plane, temp);
         for (int i = 0; i < temp.size(); ++i) {
             members.append(*temp[i]);
         }
@@ -1435,7 +1751,12 @@ public:
         if (root == NULL) {
             return;
         }
-        root->getIntersectingMembers(box, Sphere(Vector3::zero(), 0), members, false);
+
+        if (isFrozen()) {
+            getFrozenIntersectingMembers(0, box, Sphere(Vector3::zero(), 0), members, false);
+        } else {
+            root->getIntersectingMembers(box, Sphere(Vector3::zero(), 0), members, false);
+        }
     }
 
     void getIntersectingMembers(const AABox& box, Array<T>& members) const {
@@ -1511,7 +1832,11 @@ public:
         float& distance,
         bool intersectCallbackIsFast = false) const {
         
-        root->intersectRay(ray, intersectCallback, distance, intersectCallbackIsFast);
+        if (isFrozen()) {
+            intersectFrozenRay(0, AABox::large(), ray, intersectCallback, distance, intersectCallbackIsFast);
+        } else {
+            root->intersectRay(ray, intersectCallback, distance, intersectCallbackIsFast);
+        }
     }
 
 
@@ -1528,7 +1853,11 @@ public:
 
         AABox box;
         sphere.getBounds(box);
-        root->getIntersectingMembers(box, sphere, members, true);
+        if (isFrozen()) {
+            getFrozenIntersectingMembers(0, box, sphere, members, true);
+        } else {
+            root->getIntersectingMembers(box, sphere, members, true);
+        }
     }
 
     void getIntersectingMembers(const Sphere& sphere, Array<T>& members) const {
@@ -1543,15 +1872,112 @@ public:
       Stores the locations of the splitting planes (the structure but not the content)
       so that the tree can be quickly rebuilt from a previous configuration without 
       calling balance.
+
+      The nodes are written as one depth-first array in the layout used by freeze(),
+      so deserializeStructure reads them without recursion and links the tree by index.
      */
     void serializeStructure(BinaryOutput& bo) const {
-        Node::serializeStructure(root, bo);
+        if (root == NULL) {
+            // Same as the recursive format's empty tree
+            bo.writeUInt8(0);
+            return;
+        }
+
+        Array<FrozenNode> node;
+        flatten(root, node, NULL);
+
+        bo.writeUInt8(FLAT_STRUCTURE_TAG);
+        bo.writeInt32(node.size());
+        for (int i = 0; i < node.size(); ++i) {
+            bo.writeFloat32(node[i].splitLocation);
+            bo.writeUInt32(node[i].flags);
+            bo.writeInt32(node[i].highChild);
+        }
     }
 
-    /** Clears the member table */
+    /** Clears the member table.  Also reads the recursive format written by
+        previous versions of serializeStructure.
+
+        The tree is not frozen afterward, since it has no members until insert() is called.
+
+        Throws a const char* if the flat format is corrupt.*/
     void deserializeStructure(BinaryInput& bi) {
         clear();
-        root = Node::deserializeStructure(bi);
+        const uint8 tag = bi.readUInt8();
+        if (tag != FLAT_STRUCTURE_TAG) {
+            root = Node::deserializeStructure(tag, bi);
+            return;
+        }
+
+        // Each record is 12 bytes
+        const int n = bi.readInt32();
+        if ((n < 0) || (int64(n) * 12 > bi.getLength() - bi.getPosition())) {
+            throw "Corrupt KDTree structure: bad node count";
+        }
+
+        // Read and validate every record before allocating any nodes.
+        // In depth-first order, every node but the root is the child of
+        // exactly one earlier node.
+        Array<FrozenNode> record;
+        record.resize(n);
+        Array<bool> isChild;
+        isChild.resize(n);
+        System::memset(isChild.getCArray(), 0, n * sizeof(bool));
+        for (int i = 0; i < n; ++i) {
+            FrozenNode& r = record[i];
+            r.splitLocation = bi.readFloat32();
+            r.flags         = bi.readUInt32();
+            r.highChild     = bi.readInt32();
+
+            if (((r.flags & ~uint32(FrozenNode::LOW_CHILD_BIT)) > 2) ||
+                ((r.highChild != -1) && ((r.highChild <= i) || (r.highChild >= n)))) {
+                throw "Corrupt KDTree structure: bad node";
+            }
+
+            if (r.hasLowChild()) {
+                if ((i + 1 >= n) || isChild[i + 1]) {
+                    throw "Corrupt KDTree structure: bad low child";
+                }
+                isChild[i + 1] = true;
+            }
+
+            if (r.highChild != -1) {
+                if (isChild[r.highChild]) {
+                    throw "Corrupt KDTree structure: bad high child";
+                }
+                isChild[r.highChild] = true;
+            }
+        }
+
+        for (int i = 1; i < n; ++i) {
+            if (! isChild[i]) {
+                throw "Corrupt KDTree structure: unreachable node";
+            }
+        }
+
+        if (n == 0) {
+            return;
+        }
+
+        Array<Node*> node;
+        node.resize(n);
+        for (int i = 0; i < n; ++i) {
+            node[i] = new Node();
+            node[i]->splitAxis     = record[i].splitAxis();
+            node[i]->splitLocation = record[i].splitLocation;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            if (record[i].hasLowChild()) {
+                node[i]->child[0] = node[i + 1];
+            }
+            if (record[i].highChild != -1) {
+                node[i]->child[1] = node[record[i].highChild];
+            }
+        }
+
+        root = node[0];
+        root->assignSplitBounds(AABox::large());
     }
 
     /**
@@ -1561,7 +1987,7 @@ public:
         Array<Member> temp;
         memberTable.getKeys(temp);
         for (int i = 0; i < temp.size(); ++i) {
-            members.append(*(temp.handle));
+            members.append(temp[i].handle->value);
         }
     }
 
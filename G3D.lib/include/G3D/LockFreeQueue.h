@@ -0,0 +1,279 @@
+/**
+  @file LockFreeQueue.h
+
+  Bounded queues for passing values between threads without locks.
+ */
+
+#ifndef G3D_LockFreeQueue_h
+#define G3D_LockFreeQueue_h
+
+#include "G3D/platform.h"
+#include "G3D/AtomicInt32.h"
+#include "G3D/Array.h"
+#include "G3D/g3dmath.h"
+#include "G3D/debug.h"
+
+namespace G3D {
+
+namespace _internal {
+
+/** An AtomicInt32 alone on its cache line, so that indices written
+    by different threads do not invalidate each other's caches. */
+class PaddedAtomicInt32 {
+public:
+    enum {CACHE_LINE_SIZE = 64};
+
+    AtomicInt32         value;
+    char                pad[CACHE_LINE_SIZE - sizeof(AtomicInt32)];
+
+    PaddedAtomicInt32() : value(0) {}
+};
+
+} // namespace _internal
+
+
+/**
+ \brief Bounded queue for exactly one producer thread and one consumer thread.
+
+ pushBack() and popFront() never block or allocate; they return false
+ when the queue is full or empty respectively.  Each operation costs
+ one atomic store and, occasionally, one read of the other thread's
+ index.  Use MPMCQueue if more than one thread pushes or pops.
+
+ T must be default constructible and assignable.  Popped slots are
+ reset to T() so that reference counted values are released promptly.
+
+ <pre>
+    SPSCQueue<Frame*> decoded(16);
+
+    // Decoder thread
+    while (! decoded.pushBack(frame)) { yield(); }
+
+    // Render thread
+    Frame* f;
+    if (decoded.popFront(f)) { ... }
+ </pre>
+
+ \sa G3D::MPMCQueue, G3D::Queue
+
+ <B>BETA API</B>  This is unsupported and may change
+ */
+template<class T>
+class SPSCQueue {
+private:
+
+    /** Next slot to pop; written only by the consumer */
+    _internal::PaddedAtomicInt32    m_head;
+
+    /** Next slot to push; written only by the producer */
+    _internal::PaddedAtomicInt32    m_tail;
+
+    /** Producer's possibly stale copy of m_head, to avoid reading the
+        consumer's cache line on every push. */
+    int32                           m_cachedHead;
+    char                            m_pad0[_internal::PaddedAtomicInt32::CACHE_LINE_SIZE - sizeof(int32)];
+
+    /** Consumer's possibly stale copy of m_tail */
+    int32                           m_cachedTail;
+    char                            m_pad1[_internal::PaddedAtomicInt32::CACHE_LINE_SIZE - sizeof(int32)];
+
+    /** Length is a power of two */
+    Array<T>                        m_data;
+    int32                           m_mask;
+
+    // Not implemented on purpose, don't use
+    SPSCQueue(const SPSCQueue&);
+    SPSCQueue& operator=(const SPSCQueue&);
+
+public:
+
+    /** \param capacity Rounded up to a power of two */
+    explicit SPSCQueue(int capacity = 1024) : m_cachedHead(0), m_cachedTail(0) {
+        debugAssertM(capacity > 0, "Capacity must be positive");
+        m_data.resize(ceilPow2(iMax(capacity, 2)));
+        m_mask = m_data.size() - 1;
+    }
+
+    int capacity() const {
+        return m_data.size();
+    }
+
+    /** Producer only.  Returns false without modifying the queue if it is full. */
+    bool pushBack(const T& value) {
+        const int32 tail = m_tail.value.value();
+        if ((uint32)tail - (uint32)m_cachedHead == (uint32)m_data.size()) {
+            m_cachedHead = m_head.value.acquireValue();
+            if ((uint32)tail - (uint32)m_cachedHead == (uint32)m_data.size()) {
+                return false;
+            }
+        }
+
+        m_data[tail & m_mask] = value;
+        m_tail.value.releaseSet(tail + 1);
+        return true;
+    }
+
+    /** Consumer only.  Returns false without modifying \a value if the queue is empty. */
+    bool popFront(T& value) {
+        const int32 head = m_head.value.value();
+        if (head == m_cachedTail) {
+            m_cachedTail = m_tail.value.acquireValue();
+            if (head == m_cachedTail) {
+                return false;
+            }
+        }
+
+        T& slot = m_data[head & m_mask];
+        value = slot;
+        slot = T();
+        m_head.value.releaseSet(head + 1);
+        return true;
+    }
+
+    /** Number of elements.  Only exact when neither thread is modifying the queue. */
+    int size() const {
+        const int32 head = m_head.value.acquireValue();
+        return (int)((uint32)m_tail.value.acquireValue() - (uint32)head);
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+};
+
+
+/**
+ \brief Bounded queue for any number of producer and consumer threads.
+
+ pushBack() and popFront() never block or allocate; they return false
+ when the queue is full or empty respectively.  Each slot carries a
+ sequence number that tells producers and consumers whether it is
+ ready for them, so an operation costs one compare-and-set on the
+ shared index plus one store to the slot (after D. Vyukov's bounded
+ MPMC queue).  A thread that is suspended in the middle of an
+ operation delays only the threads waiting for its slot.
+
+ Values are popped in the order in which their pushes claimed slots.
+ Values pushed by one thread are popped in the order that thread
+ pushed them.
+
+ T must be default constructible and assignable.  Popped slots are
+ reset to T() so that reference counted values are released promptly.
+
+ \sa G3D::SPSCQueue, G3D::Queue
+
+ <B>BETA API</B>  This is unsupported and may change
+ */
+template<class T>
+class MPMCQueue {
+private:
+
+    class Cell {
+    public:
+        /** Equals the push position when the cell is free, one more
+            than the push position when it holds a value. */
+        AtomicInt32     sequence;
+        T               value;
+    };
+
+    _internal::PaddedAtomicInt32    m_head;
+    _internal::PaddedAtomicInt32    m_tail;
+
+    /** Length is a power of two */
+    Array<Cell>                     m_cell;
+    int32                           m_mask;
+
+    // Not implemented on purpose, don't use
+    MPMCQueue(const MPMCQueue&);
+    MPMCQueue& operator=(const MPMCQueue&);
+
+    /** a - b, correct across wraparound of the positions */
+    static inline int32 difference(int32 a, int32 b) {
+        return (int32)((uint32)a - (uint32)b);
+    }
+
+public:
+
+    /** \param capacity Rounded up to a power of two */
+    explicit MPMCQueue(int capacity = 1024) {
+        debugAssertM(capacity > 0, "Capacity must be positive");
+        m_cell.resize(ceilPow2(iMax(capacity, 2)));
+        m_mask = m_cell.size() - 1;
+        for (int i = 0; i < m_cell.size(); ++i) {
+            m_cell[i].sequence = i;
+        }
+    }
+
+    int capacity() const {
+        return m_cell.size();
+    }
+
+    /** Returns false without modifying the queue if it is full. */
+    bool pushBack(const T& value) {
+        int32 pos = m_tail.value.value();
+        Cell* cell;
+        while (true) {
+            cell = &m_cell[pos & m_mask];
+            const int32 d = difference(cell->sequence.acquireValue(), pos);
+            if (d == 0) {
+                // The cell is free; try to claim it
+                const int32 old = m_tail.value.compareAndSet(pos, pos + 1);
+                if (old == pos) {
+                    break;
+                }
+                pos = old;
+            } else if (d < 0) {
+                // The cell still holds the value pushed one lap ago
+                return false;
+            } else {
+                // Another producer claimed this cell
+                pos = m_tail.value.value();
+            }
+        }
+
+        cell->value = value;
+        cell->sequence.releaseSet(pos + 1);
+        return true;
+    }
+
+    /** Returns false without modifying \a value if the queue is empty. */
+    bool popFront(T& value) {
+        int32 pos = m_head.value.value();
+        Cell* cell;
+        while (true) {
+            cell = &m_cell[pos & m_mask];
+            const int32 d = difference(cell->sequence.acquireValue(), pos + 1);
+            if (d == 0) {
+                const int32 old = m_head.value.compareAndSet(pos, pos + 1);
+                if (old == pos) {
+                    break;
+                }
+                pos = old;
+            } else if (d < 0) {
+                // Nothing has been pushed into this cell yet
+                return false;
+            } else {
+                // Another consumer claimed this cell
+                pos = m_head.value.value();
+            }
+        }
+
+        value = cell->value;
+        cell->value = T();
+        cell->sequence.releaseSet(pos + m_mask + 1);
+        return true;
+    }
+
+    /** Approximate number of elements.  Only exact when no thread is modifying the queue. */
+    int size() const {
+        return iMax(0, difference(m_tail.value.acquireValue(), m_head.value.acquireValue()));
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+};
+
+} // namespace G3D
+
+#endif
@@ -5,7 +5,7 @@
 
  @maintainer Morgan McGuire, morgan@cs.brown.edu
  @created 2004-10-10
- @edited  2009-03-24
+ @edited  2010-06-22
  */
 #ifndef G3D_Map2D_h
 #define G3D_Map2D_h
@@ -20,6 +20,11 @@
 #include "G3D/GThread.h"
 #include "G3D/Rect2D.h"
 #include "G3D/WrapMode.h"
+#include "G3D/filter.h"
+#include "G3D/TaskScheduler.h"
+#include "G3D/Color1uint8.h"
+#include "G3D/Color3uint8.h"
+#include "G3D/Color4uint8.h"
 
 #include <string>
 
@@ -32,6 +37,75 @@ public:
     typedef Storage Type;
 };
 
+
+/** How Map2D::resample reads and writes a Storage type.  \a channels is
+    nonzero for types made of that many packed floats, which are filtered
+    with G3D::_internal::resampleFloat; all other types are filtered in
+    their Compute type and converted back with store(). */
+template<typename Storage> class _ResampleTrait {
+public:
+    enum {channels = 0};
+
+    template<typename Compute>
+    static Storage store(const Compute& c) {
+        return Storage(c);
+    }
+};
+
+#define DECLARE_RESAMPLE_CHANNELS(StorageType, numChannels)       \
+    template<> class _ResampleTrait < StorageType > {             \
+    public:                                                       \
+        enum {channels = numChannels};                            \
+        template<typename Compute>                                \
+        static StorageType store(const Compute& c) {              \
+            return StorageType(c);                                \
+        }                                                         \
+    };
+
+DECLARE_RESAMPLE_CHANNELS(float32, 1)
+DECLARE_RESAMPLE_CHANNELS(Color1,  1)
+DECLARE_RESAMPLE_CHANNELS(Vector2, 2)
+DECLARE_RESAMPLE_CHANNELS(Vector3, 3)
+DECLARE_RESAMPLE_CHANNELS(Color3,  3)
+DECLARE_RESAMPLE_CHANNELS(Vector4, 4)
+DECLARE_RESAMPLE_CHANNELS(Color4,  4)
+#undef DECLARE_RESAMPLE_CHANNELS
+
+// Sharp filters overshoot, so 8-bit results must be clamped at zero as
+// well as at the top of the range
+
+template<> class _ResampleTrait<uint8> {
+public:
+    enum {channels = 0};
+    static uint8 store(float c) {
+        return (uint8)iClamp(iRound(c), 0, 255);
+    }
+};
+
+template<> class _ResampleTrait<Color1uint8> {
+public:
+    enum {channels = 0};
+    static Color1uint8 store(const Color1& c) {
+        return Color1uint8(c.max(Color1::zero()));
+    }
+};
+
+template<> class _ResampleTrait<Color3uint8> {
+public:
+    enum {channels = 0};
+    static Color3uint8 store(const Color3& c) {
+        return Color3uint8(c.max(Color3::zero()));
+    }
+};
+
+template<> class _ResampleTrait<Color4uint8> {
+public:
+    enum {channels = 0};
+    static Color4uint8 store(const Color4& c) {
+        return Color4uint8(c.max(Color4::zero()));
+    }
+};
+
 } // _internal
 } // G3D
 
@@ -622,6 +696,150 @@ public:
         return bicubic(p.x, p.y, _wrapMode);
     }
 
+protected:
+
+    /** parallelFor body for the horizontal pass of resample() on storage that is not made of floats */
+    class ResampleHorizontal {
+    public:
+        const Storage*          src;
+        Compute*                dst;
+        const ResampleWeights*  weights;
+
+        void operator()(int begin, int end) const {
+            const int taps = weights->taps;
+            for (int y = begin; y < end; ++y) {
+                const Storage* s      = src + y * weights->srcSize;
+                Compute*       d      = dst + y * weights->dstSize;
+                const int*     index  = weights->index.getCArray();
+                const float*   weight = weights->weight.getCArray();
+                for (int x = 0; x < weights->dstSize; ++x, index += taps, weight += taps) {
+                    Compute sum = Compute(s[index[0]]) * weight[0];
+                    for (int k = 1; k < taps; ++k) {
+                        sum += Compute(s[index[k]]) * weight[k];
+                    }
+                    d[x] = sum;
+                }
+            }
+        }
+    };
+
+    /** parallelFor body for the vertical pass of resample() on storage that is not made of floats */
+    class ResampleVertical {
+    public:
+        const Compute*          src;
+        Storage*                dst;
+        int                     width;
+        const ResampleWeights*  weights;
+
+        void operator()(int begin, int end) const {
+            const int taps = weights->taps;
+            for (int y = begin; y < end; ++y) {
+                const int*   index  = weights->index.getCArray()  + y * taps;
+                const float* weight = weights->weight.getCArray() + y * taps;
+                Storage*     d      = dst + y * width;
+                for (int x = 0; x < width; ++x) {
+                    Compute sum = src[index[0] * width + x] * weight[0];
+                    for (int k = 1; k < taps; ++k) {
+                        sum += src[index[k] * width + x] * weight[k];
+                    }
+                    d[x] = _internal::_ResampleTrait<Storage>::store(sum);
+                }
+            }
+        }
+    };
+
+    /** Implementation of generateMipChain() for subclasses, which
+        create their levels with \a create. */
+    template<class LevelRef>
+    void buildMipChain(Array<LevelRef>& chain, LevelRef (*create)(int, int, WrapMode), ResampleFilter filter, bool parallel) const {
+        const Map2D* previous = this;
+        int levelW = w;
+        int levelH = h;
+        while ((levelW > 1) || (levelH > 1)) {
+            levelW = iMax(1, levelW / 2);
+            levelH = iMax(1, levelH / 2);
+            LevelRef level = create(levelW, levelH, _wrapMode);
+            previous->resample(*level, levelW, levelH, filter, parallel);
+            chain.append(level);
+            previous = level.pointer();
+        }
+    }
+
+public:
+
+    /**
+      Resizes \a dst to \a newW x \a newH and fills it with this map resampled
+      through \a filter.  \a dst takes this map's wrap mode.
+
+      Pixel centers are aligned, so halving with ResampleFilter::BOX averages
+      2 x 2 blocks.  Source pixels beyond the edges wrap under WrapMode::TILE,
+      contribute nothing under WrapMode::ZERO, and are clamped to the edge
+      under the other modes.  An axis whose size does not change is copied
+      rather than filtered.
+
+      The filter is separable: it is applied along rows and then along columns
+      through G3D::ResampleWeights tables, so each output pixel costs a few
+      multiply-adds per axis instead of a bicubic() call.  Storage made of
+      packed floats (float32, Color1, Color3, Color4, Vector2, Vector3,
+      Vector4) uses SSE inner loops; other types are filtered in Compute and
+      clamped back to Storage.  When \a parallel is true, rows are spread
+      across TaskScheduler::global().
+
+      \sa generateMipChain
+     */
+    void resample(Map2D& dst, int newW, int newH, ResampleFilter filter = ResampleFilter::MITCHELL, bool parallel = true) const {
+        debugAssertM(&dst != this, "Cannot resample a map into itself");
+        debugAssert(newW >= 0 && newH >= 0);
+
+        dst.resize(newW, newH);
+        dst._wrapMode = _wrapMode;
+        dst.setChanged(true);
+
+        if ((newW == 0) || (newH == 0)) {
+            return;
+        } else if ((w == 0) || (h == 0)) {
+            dst.setAll(ZERO);
+            return;
+        }
+
+        const ResampleWeights horizontal(w, newW, filter, _wrapMode);
+        const ResampleWeights vertical(h, newH, filter, _wrapMode);
+
+        if (_internal::_ResampleTrait<Storage>::channels > 0) {
+            _internal::resampleFloat(reinterpret_cast<const float*>(data.getCArray()), 
+                                     _internal::_ResampleTrait<Storage>::channels,
+                                     horizontal, vertical, 
+                                     reinterpret_cast<float*>(dst.data.getCArray()), parallel);
+        } else {
+            Array<Compute> temp;
+            temp.resize(h * newW);
+
+            ResampleHorizontal horizontalPass;
+            horizontalPass.src     = data.getCArray();
+            horizontalPass.dst     = temp.getCArray();
+            horizontalPass.weights = &horizontal;
+            _internal::resampleRows(horizontalPass, h, newW * horizontal.taps, parallel);
+
+            ResampleVertical verticalPass;
+            verticalPass.src     = temp.getCArray();
+            verticalPass.dst     = dst.data.getCArray();
+            verticalPass.width   = newW;
+            verticalPass.weights = &vertical;
+            _internal::resampleRows(verticalPass, newH, newW * vertical.taps, parallel);
+        }
+    }
+
+    /**
+      Appends to \a chain the mip levels below this map: each level is half
+      the size of the previous one (rounded down, at least 1) until 1 x 1.
+      Each level is resampled from the level before it, not from this map,
+      so the whole chain costs about a third of one resample() of this map.
+      chain[0] is the first level below this map.
+     */
+    void generateMipChain(Array<Ref>& chain, ResampleFilter filter = ResampleFilter::BOX, bool parallel = true) const {
+        buildMipChain(chain, &Map2D::create, filter, parallel);
+    }
+
     /** Pixel width */
     inline int32 width() const {
         return (int32)w;
@@ -183,6 +183,33 @@ public:
         /** Use Gaussian elimination with pivots to solve for the inverse destructively in place. */
         void inverseInPlaceGaussJordan();
 
+        /** Replaces a square matrix with its LU decomposition with
+            partial pivoting: the strictly lower triangle holds L (whose
+            diagonal is all ones) and the upper triangle holds U.  Row i
+            of L*U is row \a permutation[i] of the original matrix.
+            \a sign is the determinant of the permutation.  Returns false
+            if the matrix is singular, in which case the result is
+            incomplete. */
+        bool luInPlace(Array<int>& permutation, int& sign);
+
+        /** Solves this * X = B in place of \a B, where this was produced by luInPlace */
+        void luSolve(const Array<int>& permutation, Impl& B) const;
+
+        /** Replaces a symmetric positive definite matrix with L such that
+            the original matrix is L * L<sup>T</sup>.  The upper triangle is
+            set to zero.  Returns false if the matrix is not positive
+            definite, in which case the result is incomplete. */
+        bool choleskyInPlace();
+
+        /** Solves this * X = B in place of \a B, where this was produced by choleskyInPlace */
+        void choleskySolve(Impl& B) const;
+
+        /** Sets \a X to the least-squares solution of this * X = B for a
+            matrix with more rows than columns, using Householder QR in
+            double precision.  Returns false, leaving \a X unchanged, if
+            this is numerically rank deficient. */
+        bool qrSolve(const Impl& B, Impl& X) const;
+
         void adjoint(Impl& out) const;
 
         /** Matrix of all cofactors */
@@ -358,7 +385,10 @@ public:
     Matrix subMatrix(int r1, int r2, int c1, int c2) const;
 
     /** Matrix multiplication.  To perform element-by-element multiplication, 
-        see arrayMul. */
+        see arrayMul. 
+
+        Uses a cache-blocked, SIMD kernel, and multiplies large
+        matrices in parallel on TaskScheduler::global(). */
     inline Matrix operator*(const Matrix& B) const {
         Matrix C(impl->R, B.impl->C);
         impl->mul(*B.impl, *C.impl);
@@ -478,6 +508,7 @@ public:
         return Matrix(A);
     }
 
+    /** Computed with lu() for matrices larger than 3x3 */
     inline T determinant() const {
         return impl->determinant();
     }
@@ -520,6 +551,43 @@ public:
         return (trans * (*this)).inverse() * trans;
     }
 
+    /** LU decomposition with partial pivoting of a square matrix, such that
+        row i of @a L * @a U is row @a permutation[i] of @a this.
+        @a L is lower triangular with ones on the diagonal and @a U is
+        upper triangular.
+
+        Run time is <I>O(R<sup>3</sup>)</I>.  Large matrices are
+        factored in blocks that are multiplied in parallel.
+
+        @return false if the matrix is singular
+     */
+    bool lu(Matrix& L, Matrix& U, Array<int>& permutation) const;
+
+    /** Cholesky decomposition of a symmetric positive definite matrix,
+        such that @a this = @a L * @a L.transpose(), where @a L is
+        lower triangular.  Only the lower triangle of @a this is read.
+
+        Run time is <I>O(R<sup>3</sup>)</I>, about half that of lu().
+
+        @return false if the matrix is not positive definite
+     */
+    bool cholesky(Matrix& L) const;
+
+    /** 
+     Returns X such that @a this * X = @a B, solving for every column
+     of @a B at once.
+
+     For a square matrix this uses lu().  For a matrix with more rows
+     than columns, X is the least-squares solution, computed by
+     Householder QR factorization in double precision.  Unlike the
+     normal equations A<SUP>T</SUP>A X = A<SUP>T</SUP>B, this does not
+     square the condition number of the problem, and it is much faster
+     than pseudoInverse() * B for fitting thousands of samples.
+     Singular, rank-deficient, and underdetermined systems fall back
+     to pseudoInverse().
+     */
+    Matrix solve(const Matrix& B) const;
+
     /** Singular value decomposition.  Factors into three matrices 
         such that @a this = @a U * fromDiagonal(@a d) * @a V.transpose().
 
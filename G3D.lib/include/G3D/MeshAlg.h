@@ -19,6 +19,7 @@
 #include "G3D/SmallArray.h"
 #include "G3D/constants.h"
 #include "G3D/Image1.h"
+#include "G3D/Welder.h"
 
 #ifdef G3D_WIN32
 // Turn off "conditional expression is constant" warning; MSVC generates this
@@ -225,6 +226,60 @@ public:
         }
     };
 
+
+    /**
+     Vertex adjacency in compressed sparse row form.  Holds the same
+     information as an Array<Vertex> in four flat arrays instead of two
+     SmallArrays per vertex, so it is much cheaper to build and to free
+     for large meshes.
+
+     The faces containing vertex v are 
+     <CODE>faceIndex[faceStart[v]]</CODE> ... 
+     <CODE>faceIndex[faceStart[v + 1] - 1]</CODE>, in increasing order,
+     and likewise for edges, with the same sign conventions as
+     Vertex::faceIndex and Vertex::edgeIndex.
+
+     \sa computeAdjacency
+     */
+    class CompactVertexArray {
+    public:
+        /** size() + 1 elements */
+        Array<int>              faceStart;
+        Array<int>              faceIndex;
+
+        /** size() + 1 elements */
+        Array<int>              edgeStart;
+        Array<int>              edgeIndex;
+
+        /** Number of vertices */
+        inline int size() const {
+            return iMax(faceStart.size() - 1, 0);
+        }
+
+        inline int numFaces(int v) const {
+            return faceStart[v + 1] - faceStart[v];
+        }
+
+        /** Pointer to the numFaces(v) faces containing \a v */
+        inline const int* face(int v) const {
+            return faceIndex.getCArray() + faceStart[v];
+        }
+
+        inline int numEdges(int v) const {
+            return edgeStart[v + 1] - edgeStart[v];
+        }
+
+        /** Pointer to the numEdges(v) edges adjacent to \a v */
+        inline const int* edge(int v) const {
+            return edgeIndex.getCArray() + edgeStart[v];
+        }
+
+        void clear();
+
+        /** Expands to the equivalent Array<Vertex> */
+        void getVertexArray(Array<Vertex>& vertexArray) const;
+    };
+
     /**
      Given a set of vertices and a set of indices for traversing them
      to create triangles, computes other mesh properties.  
@@ -249,6 +304,11 @@ public:
      @param faceArray       <I>Output</I>
      @param edgeArray       <I>Output</I>.  Sorted so that boundary edges are at the end of the array. 
      @param vertexArray     <I>Output</I> 
+
+     Edges are paired by radix sorting the directed edges of all faces
+     and the work is split across TaskScheduler::global(), so this takes
+     O(n) time for n faces.  The output is deterministic and independent
+     of the number of threads.
      */
     static void computeAdjacency(
         const Array<Vector3>&   vertexGeometry,
@@ -257,6 +317,19 @@ public:
         Array<Edge>&            edgeArray,
         Array<Vertex>&          vertexArray);
 
+    /**
+     Same as the version that takes Array<Vertex>, but produces the
+     vertex adjacency in the more compact CompactVertexArray form.
+     This is the fastest version; use it for large meshes or when only
+     \a faceArray and \a edgeArray are needed.
+     */
+    static void computeAdjacency(
+        const Array<Vector3>&   vertexGeometry,
+        const Array<int>&       indexArray,
+        Array<Face>&            faceArray,
+        Array<Edge>&            edgeArray,
+        CompactVertexArray&     vertexArray);
+
     /**
      @deprecated Use the other version of computeAdjacency, which takes Array<Vertex>.
      @param facesAdjacentToVertex <I>Output</I> adjacentFaceArray[v] is an array of
@@ -296,6 +369,153 @@ public:
         double&                 medianFaceArea,
         double&                 maxFaceArea);
 
+    /**
+     Simulates a FIFO post-transform vertex cache, as found on most GPUs,
+     while drawing the triangle list \a indexArray.  Use this to measure
+     the effect of optimizeVertexCache and optimizeOverdraw without a GPU.
+
+     @param acmr  Average cache miss ratio: vertices transformed per
+                  triangle.  Ranges from 3 (no reuse) down to about 0.5
+                  for a regular grid with an ideal order.
+     @param atvr  Average transform to vertex ratio: vertices transformed
+                  per distinct vertex referenced.  1 is ideal.
+     @param cacheSize Number of vertices the simulated cache holds
+     */
+    static void computeVertexCacheStatistics(
+        const Array<int>&       indexArray,
+        int                     numVertices,
+        float&                  acmr,
+        float&                  atvr,
+        int                     cacheSize = 16);
+
+    /**
+     Reorders the triangles of a triangle list so that the vertices
+     they share are likely to still be in the GPU's post-transform
+     vertex cache, reducing the number of vertex shader invocations.
+     The triangles themselves, and the winding of each, are unchanged.
+
+     This is independent of the exact cache size and replacement policy
+     of the hardware.  Runs in time linear in the number of triangles.
+
+     @cite Tom Forsyth, Linear-Speed Vertex Cache Optimisation, 2006.
+
+     @param numVertices One more than the largest index
+     */
+    static void optimizeVertexCache(
+        Array<int>&             indexArray,
+        int                     numVertices);
+
+    /**
+     Reorders groups of triangles to reduce overdraw while keeping most
+     of the vertex cache locality produced by optimizeVertexCache, which
+     should be called first.
+
+     The triangle list is split into clusters at points where the
+     simulated cache is (nearly) cold anyway, or where the miss ratio of
+     the cluster so far is within \a threshold of that of the whole
+     list.  Clusters are then sorted so that those facing away from the
+     center of the mesh, which are likely to occlude the rest from any
+     view, are drawn first.
+
+     @param threshold Largest acceptable increase in the ACMR, e.g., 1.05 for 5%.
+                      Larger values produce smaller clusters and less overdraw.
+
+     @cite Sander, Nehab, and Barczak, Fast Triangle Reordering for Vertex
+     Locality and Reduced Overdraw, SIGGRAPH 2007.
+     */
+    static void optimizeOverdraw(
+        const Array<Vector3>&   vertexArray,
+        Array<int>&             indexArray,
+        float                   threshold = 1.05f,
+        int                     cacheSize = 16);
+
+    /**
+     Renumbers the vertices in the order that the index arrays first
+     use them, so that vertex fetches are mostly sequential.  Call after
+     optimizeVertexCache and optimizeOverdraw, and then permute every
+     per-vertex array so that <code>newArray[ni] = oldArray[toOld[ni]]</code>.
+
+     Vertices that no index refers to are kept at the end, in their
+     original order, so that toNew and toOld are inverse permutations of
+     0 ... numVertices - 1.
+
+     @param indexArrayArray Index arrays that share the vertices, in the order
+                            that they are drawn.  NULL elements are ignored.
+     */
+    static void optimizeVertexFetch(
+        Array<Array<int>*>&     indexArrayArray,
+        int                     numVertices,
+        Array<int>&             toNew,
+        Array<int>&             toOld);
+
+    static void optimizeVertexFetch(
+        Array<int>&             indexArray,
+        int                     numVertices,
+        Array<int>&             toNew,
+        Array<int>&             toOld) {
+
+        Array<Array<int>*> indexArrayArray;
+        indexArrayArray.append(&indexArray);
+        optimizeVertexFetch(indexArrayArray, numVertices, toNew, toOld);
+    }
+
+    /**
+     Reduces the number of triangles by repeatedly collapsing the edge
+     whose removal least changes the surface, as measured by the
+     quadric error metric.  Each collapse moves one vertex onto a
+     neighbor, so the vertices themselves are unchanged and only the
+     index arrays are rewritten.  Several levels of detail computed
+     from the same geometry can therefore share one vertex buffer.
+
+     Vertices whose positions are within \a settings.vertexWeldRadius
+     and whose texture coordinates and normals are within the
+     corresponding radii are treated as one vertex.  Vertices that
+     share a position but not attributes lie on a UV or normal seam and
+     are never removed, nor are vertices used by more than one index
+     array.  Border vertices only move along the border.
+
+     Stops when the number of triangles reaches \a targetNumFaces, when
+     every remaining collapse would exceed \a maxError, or when no
+     further collapse is possible.
+
+     @param geometry normalArray may be empty, in which case normals
+            are ignored.
+     @param texCoordArray May be empty, in which case texture
+            coordinates are ignored.
+     @param indexArrayArray Triangle lists, modified in place.  NULL
+            elements are ignored.  The surviving triangles keep their
+            relative order and winding.
+     @param error Output.  The largest error of any collapse performed:
+            approximately the distance in object space by which the
+            simplified surface deviates from the original.
+
+     @cite Garland and Heckbert, Surface Simplification Using Quadric Error Metrics, SIGGRAPH 1997.
+
+     <B>BETA API</B>
+     */
+    static void simplify(
+        const Geometry&         geometry,
+        const Array<Vector2>&   texCoordArray,
+        Array<Array<int>*>&     indexArrayArray,
+        int                     targetNumFaces,
+        float&                  error,
+        float                   maxError = finf(),
+        const Welder::Settings& settings = Welder::Settings());
+
+    static void simplify(
+        const Geometry&         geometry,
+        const Array<Vector2>&   texCoordArray,
+        Array<int>&             indexArray,
+        int                     targetNumFaces,
+        float&                  error,
+        float                   maxError = finf(),
+        const Welder::Settings& settings = Welder::Settings()) {
+
+        Array<Array<int>*> indexArrayArray;
+        indexArrayArray.append(&indexArray);
+        simplify(geometry, texCoordArray, indexArrayArray, targetNumFaces, error, maxError, settings);
+    }
+
 private:
 
     /** Helper for weldAdjacency */
@@ -409,14 +629,17 @@ public:
      </PRE>
 
      Note that newVertexPositions is never longer than oldVertexPositions
-     and is shorter when vertices are welded.
+     and is shorter when vertices are welded.  New vertices appear in the
+     order of their first occurrence, each old vertex maps to the closest
+     new vertex within radius (the lowest-indexed one on ties), and 
+     toOld[ni] is the last old vertex that maps to ni.
 
      Welding with a large radius will effectively compute a lower level of detail for
      the mesh.
 
      The welding method runs in roughly linear time in the length of oldVertexArray--
-     a uniform spatial grid is used to achieve nearly constant time vertex collapses
-     for uniformly distributed vertices.
+     a G3D::MortonGrid is used to achieve nearly constant time vertex collapses,
+     and the collapses are computed in parallel on TaskScheduler::global().
 
      It is sometimes desirable to keep the original vertex ordering but 
      identify the unique vertices.  The following code computes 
@@ -0,0 +1,480 @@
+/**
+  @file MortonGrid.h
+
+  Static uniform grid of points stored in Morton (Z-curve) order.
+
+  @sa G3D::PointHashGrid, G3D::MeshAlg::computeWeld, G3D::Welder
+ */
+#ifndef G3D_MortonGrid_h
+#define G3D_MortonGrid_h
+
+#include "G3D/platform.h"
+#include "G3D/g3dmath.h"
+#include "G3D/Array.h"
+#include "G3D/Vector3.h"
+#include "G3D/AABox.h"
+#include "G3D/TaskScheduler.h"
+#include "G3D/System.h"
+#include <algorithm>
+
+namespace G3D {
+
+namespace _internal {
+class MortonCodeBody;
+} // namespace _internal
+
+/**
+ \brief Points bucketed into cubical cells that are stored contiguously
+ in Morton (Z-curve) order, for parallel neighborhood queries over large
+ point sets such as the vertices of a scanned mesh.
+
+ Unlike PointHashGrid, the grid is built all at once by set() (with a
+ parallel radix sort of the cell codes) and cannot be modified.  The
+ points of each cell are adjacent in memory, sorted by their index in
+ the array passed to set(), and cells that are adjacent in space are
+ usually adjacent in memory.  Queries are read-only and may be made
+ from many threads at once.
+
+ cluster() implements the greedy "grouper" used for welding: scanning
+ the points in index order, each point that matches no earlier
+ representative becomes a representative itself, and every other point
+ is then assigned to its best matching representative.  It computes
+ exactly the result of that serial scan, but decides whole cells in
+ parallel.
+
+ <B>BETA API</B>  This is unsupported and may change
+ */
+class MortonGrid {
+public:
+
+    /** Cell coordinates are clamped to [0, MAX_CELL_COORD] on each axis, so that
+        a Morton code fits in 63 bits. */
+    enum {MAX_CELL_COORD = (1 << 21) - 1};
+
+private:
+
+    friend class _internal::MortonCodeBody;
+
+    enum State {UNDECIDED = 0, REPRESENTATIVE, REPRESENTED};
+
+    Vector3             m_origin;
+    float               m_cellWidth;
+    float               m_invCellWidth;
+
+    /** Index in the original array of each point, in cell order */
+    Array<int>          m_index;
+
+    /** Position of each point, in cell order */
+    Array<Vector3>      m_position;
+
+    /** Points of cell c are [m_cellStart[c], m_cellStart[c + 1]) */
+    Array<int>          m_cellStart;
+
+    /** Morton code of each cell, increasing */
+    Array<uint64>       m_cellCode;
+
+    /** Open-addressed table of cell indices by Morton code; -1 is empty */
+    Array<int>          m_hashTable;
+    int                 m_hashShift;
+
+    static uint64 spreadBits(uint32 x) {
+        uint64 v = x & MAX_CELL_COORD;
+        v = (v | (v << 32)) & 0x001F00000000FFFFULL;
+        v = (v | (v << 16)) & 0x001F0000FF0000FFULL;
+        v = (v | (v <<  8)) & 0x100F00F00F00F00FULL;
+        v = (v | (v <<  4)) & 0x10C30C30C30C30C3ULL;
+        v = (v | (v <<  2)) & 0x1249249249249249ULL;
+        return v;
+    }
+
+    static uint64 mortonCode(int x, int y, int z) {
+        return spreadBits(x) | (spreadBits(y) << 1) | (spreadBits(z) << 2);
+    }
+
+    int hashSlot(uint64 code) const {
+        return (int)((code * 0x9E3779B97F4A7C15ULL) >> m_hashShift);
+    }
+
+    int cellCoord(float x, float origin) const {
+        // Compare as float so that NaN and huge values clamp without overflowing an int
+        const float c = (x - origin) * m_invCellWidth;
+        if (c >= (float)MAX_CELL_COORD) {
+            return MAX_CELL_COORD;
+        } else if (c > 0.0f) {
+            return (int)c;
+        } else {
+            return 0;
+        }
+    }
+
+    /** Index of the cell with Morton code \a code, or -1 if it is empty */
+    int findCell(uint64 code) const {
+        const int mask = m_hashTable.size() - 1;
+        for (int s = hashSlot(code); ; s = (s + 1) & mask) {
+            const int c = m_hashTable[s];
+            if ((c < 0) || (m_cellCode[c] == code)) {
+                return c;
+            }
+        }
+    }
+
+    /** Bounds of the points in cell \a c */
+    AABox cellPointBounds(int c) const {
+        Vector3 lo = m_position[m_cellStart[c]];
+        Vector3 hi = lo;
+        for (int k = m_cellStart[c] + 1; k < m_cellStart[c + 1]; ++k) {
+            lo = lo.min(m_position[k]);
+            hi = hi.max(m_position[k]);
+        }
+        return AABox(lo, hi);
+    }
+
+    /** Appends the cells that may contain points within \a radius of cell \a c to \a cell */
+    void getNearbyCells(int c, float radius, Array<int>& cell) const {
+        const AABox& bounds = cellPointBounds(c);
+        const Vector3 r(radius, radius, radius);
+        getCells(AABox(bounds.low() - r, bounds.high() + r), cell);
+    }
+
+    /** Decides the undecided points of cell \a c whose earlier
+        matches are all decided.  Reads other cells from \a prev and
+        cell c, which is processed in index order, from \a next. */
+    template<class Rule>
+    void clusterCell(int c, float radius, const Rule& rule, const uint8* prev, uint8* next, Array<int>& nearby) const {
+        nearby.fastClear();
+        getNearbyCells(c, radius, nearby);
+
+        for (int k = m_cellStart[c]; k < m_cellStart[c + 1]; ++k) {
+            if (next[k] != UNDECIDED) {
+                continue;
+            }
+
+            const int i = m_index[k];
+            bool represented = false;
+            bool waiting = false;
+            for (int n = 0; (n < nearby.size()) && ! represented; ++n) {
+                const int d = nearby[n];
+                const uint8* state = (d == c) ? next : prev;
+                for (int kk = m_cellStart[d]; kk < m_cellStart[d + 1]; ++kk) {
+                    const int j = m_index[kk];
+                    if ((j >= i) || (state[kk] == REPRESENTED) || ! rule.match(i, j)) {
+                        continue;
+                    }
+
+                    if (state[kk] == REPRESENTATIVE) {
+                        represented = true;
+                        break;
+                    } else {
+                        waiting = true;
+                    }
+                }
+            }
+
+            if (represented) {
+                next[k] = REPRESENTED;
+            } else if (! waiting) {
+                next[k] = REPRESENTATIVE;
+            }
+        }
+    }
+
+    /** parallelFor body for one round of cluster() over a list of cells */
+    template<class Rule>
+    class ClusterRound {
+    public:
+        const MortonGrid*   grid;
+        const Rule*         rule;
+        float               radius;
+        const int*          cell;
+        const uint8*        prev;
+        uint8*              next;
+
+        void operator()(int begin, int end) const {
+            Array<int> nearby;
+            for (int i = begin; i < end; ++i) {
+                grid->clusterCell(cell[i], radius, *rule, prev, next, nearby);
+            }
+        }
+    };
+
+    /** parallelFor body that copies the decisions of a round back and
+        flags the cells that still have undecided points */
+    class ClusterCommit {
+    public:
+        const MortonGrid*   grid;
+        const int*          cell;
+        const uint8*        next;
+        uint8*              prev;
+        bool*               pending;
+
+        void operator()(int begin, int end) const {
+            for (int i = begin; i < end; ++i) {
+                const int c = cell[i];
+                pending[i] = false;
+                for (int k = grid->m_cellStart[c]; k < grid->m_cellStart[c + 1]; ++k) {
+                    prev[k] = next[k];
+                    pending[i] = pending[i] || (next[k] == UNDECIDED);
+                }
+            }
+        }
+    };
+
+    /** parallelFor body that maps each point to its preferred representative */
+    template<class Rule>
+    class ClusterAssign {
+    public:
+        const MortonGrid*   grid;
+        const Rule*         rule;
+        float               radius;
+        const uint8*        state;
+        int*                representative;
+
+        void operator()(int begin, int end) const {
+            Array<int> nearby;
+            for (int c = begin; c < end; ++c) {
+                nearby.fastClear();
+                grid->getNearbyCells(c, radius, nearby);
+
+                for (int k = grid->m_cellStart[c]; k < grid->m_cellStart[c + 1]; ++k) {
+                    const int i = grid->m_index[k];
+                    if (state[k] == REPRESENTATIVE) {
+                        representative[i] = i;
+                        continue;
+                    }
+
+                    int best = -1;
+                    float bestCost = finf();
+                    for (int n = 0; n < nearby.size(); ++n) {
+                        const int d = nearby[n];
+                        for (int kk = grid->m_cellStart[d]; kk < grid->m_cellStart[d + 1]; ++kk) {
+                            const int j = grid->m_index[kk];
+                            if ((state[kk] == REPRESENTATIVE) && rule->match(i, j)) {
+                                const float cost = rule->cost(i, j);
+                                if ((best < 0) || (cost < bestCost) || ((cost == bestCost) && (j < best))) {
+                                    best = j;
+                                    bestCost = cost;
+                                }
+                            }
+                        }
+                    }
+                    debugAssertM(best >= 0, "A point that is not a representative matched none");
+                    representative[i] = best;
+                }
+            }
+        }
+    };
+
+    enum {CELL_GRAIN_SIZE = 256};
+
+public:
+
+    MortonGrid() : m_cellWidth(1.0f), m_invCellWidth(1.0f), m_hashShift(63) {
+        m_cellStart.append(0);
+    }
+
+    /** Replaces the contents of the grid with \a point.  The cell width is
+        chosen from the bounds and number of points so that points on a
+        surface usually fall about one to a cell, and is at least
+        \a minCellWidth.  It is also increased as needed to keep the
+        number of cells along each axis within MAX_CELL_COORD + 1. */
+    void set(const Array<Vector3>& point, float minCellWidth, bool useThreads = true);
+
+    /** Number of points */
+    int size() const {
+        return m_index.size();
+    }
+
+    /** Number of non-empty cells */
+    int numCells() const {
+        return m_cellCode.size();
+    }
+
+    float cellWidth() const {
+        return m_cellWidth;
+    }
+
+    /** Sorted points [cellBegin(c), cellEnd(c)) are in cell \a c, in increasing index() order */
+    int cellBegin(int c) const {
+        return m_cellStart[c];
+    }
+
+    int cellEnd(int c) const {
+        return m_cellStart[c + 1];
+    }
+
+    /** Index in the array passed to set() of the <i>k</i>th point in cell order */
+    int index(int k) const {
+        return m_index[k];
+    }
+
+    /** Position of the <i>k</i>th point in cell order */
+    const Vector3& position(int k) const {
+        return m_position[k];
+    }
+
+    /** Appends the non-empty cells that overlap \a box to \a cell */
+    void getCells(const AABox& box, Array<int>& cell) const;
+
+    /** Appends the cells that may contain points within \a radius of \a p to \a cell */
+    void getCellsNear(const Vector3& p, float radius, Array<int>& cell) const {
+        const Vector3 r(radius, radius, radius);
+        getCells(AABox(p - r, p + r), cell);
+    }
+
+    /**
+     Greedily groups the points.  Visiting the points in index order,
+     point <i>i</i> becomes a representative unless
+     <code>rule.match(i, j)</code> for some earlier representative
+     <i>j</i>.  Each point that is not a representative is then
+     assigned to the representative <i>j</i> that matches it with the
+     lowest <code>rule.cost(i, j)</code>, breaking ties by lower index.
+
+     \a Rule must provide
+     <pre>
+        bool  match(int i, int j) const;
+        float cost(int i, int j) const;
+     </pre>
+     where <code>match</code> is false whenever points i and j are
+     farther than \a radius apart.  Both are called concurrently when
+     \a useThreads is true.
+
+     Cells whose points depend only on decided points are decided in
+     parallel, in rounds.  Dependency chains that span many cells
+     (which arise when \a radius is large compared to the spacing of
+     the points) are finished serially.
+
+     \param representative Output, indexed like the array passed to
+     set().  <code>representative[i] == i</code> exactly for the
+     representatives.
+     */
+    template<class Rule>
+    void cluster(float radius, const Rule& rule, Array<int>& representative, bool useThreads = true) const {
+        const int n = size();
+        representative.resize(n);
+
+        Array<uint8> prev, next;
+        prev.resize(n);
+        next.resize(n);
+        System::memset(prev.getCArray(), UNDECIDED, n);
+        System::memset(next.getCArray(), UNDECIDED, n);
+
+        Array<int> cell;
+        cell.resize(numCells());
+        for (int c = 0; c < cell.size(); ++c) {
+            cell[c] = c;
+        }
+
+        Array<bool> pending;
+        int numUndecided = n;
+        while (cell.size() > 0) {
+            ClusterRound<Rule> round;
+            round.grid   = this;
+            round.rule   = &rule;
+            round.radius = radius;
+            round.cell   = cell.getCArray();
+            round.prev   = prev.getCArray();
+            round.next   = next.getCArray();
+
+            ClusterCommit commit;
+            pending.resize(cell.size());
+            commit.grid    = this;
+            commit.cell    = cell.getCArray();
+            commit.next    = next.getCArray();
+            commit.prev    = prev.getCArray();
+            commit.pending = pending.getCArray();
+
+            if (useThreads) {
+                TaskScheduler::global()->parallelFor(0, cell.size(), CELL_GRAIN_SIZE, round);
+                TaskScheduler::global()->parallelFor(0, cell.size(), CELL_GRAIN_SIZE, commit);
+            } else {
+                round(0, cell.size());
+                commit(0, cell.size());
+            }
+
+            int numPending = 0;
+            for (int i = 0; i < cell.size(); ++i) {
+                if (pending[i]) {
+                    cell[numPending] = cell[i];
+                    ++numPending;
+                }
+            }
+            cell.resize(numPending, DONT_SHRINK_UNDERLYING_ARRAY);
+
+            int stillUndecided = 0;
+            for (int i = 0; i < cell.size(); ++i) {
+                for (int k = m_cellStart[cell[i]]; k < m_cellStart[cell[i] + 1]; ++k) {
+                    stillUndecided += (prev[k] == UNDECIDED) ? 1 : 0;
+                }
+            }
+
+            if (stillUndecided * 2 > numUndecided) {
+                // Long chains; more rounds would each decide only a few points
+                break;
+            }
+            numUndecided = stillUndecided;
+        }
+
+        if (cell.size() > 0) {
+            // Finish serially in index order, when every earlier point is decided
+            Array<int> remaining;
+            for (int i = 0; i < cell.size(); ++i) {
+                for (int k = m_cellStart[cell[i]]; k < m_cellStart[cell[i] + 1]; ++k) {
+                    if (prev[k] == UNDECIDED) {
+                        remaining.append(k);
+                    }
+                }
+            }
+
+            std::sort(remaining.begin(), remaining.end(), IndexOrder(this));
+
+            Array<int> nearby;
+            for (int r = 0; r < remaining.size(); ++r) {
+                const int k = remaining[r];
+                const int i = m_index[k];
+                nearby.fastClear();
+                getCellsNear(m_position[k], radius, nearby);
+
+                uint8 s = REPRESENTATIVE;
+                for (int n = 0; (n < nearby.size()) && (s == REPRESENTATIVE); ++n) {
+                    const int d = nearby[n];
+                    for (int kk = m_cellStart[d]; kk < m_cellStart[d + 1]; ++kk) {
+                        if ((prev[kk] == REPRESENTATIVE) && (m_index[kk] < i) && rule.match(i, m_index[kk])) {
+                            s = REPRESENTED;
+                            break;
+                        }
+                    }
+                }
+                prev[k] = s;
+            }
+        }
+
+        ClusterAssign<Rule> assign;
+        assign.grid           = this;
+        assign.rule           = &rule;
+        assign.radius         = radius;
+        assign.state          = prev.getCArray();
+        assign.representative = representative.getCArray();
+
+        if (useThreads) {
+            TaskScheduler::global()->parallelFor(0, numCells(), CELL_GRAIN_SIZE, assign);
+        } else {
+            assign(0, numCells());
+        }
+    }
+
+private:
+
+    /** Orders sorted point positions by their original index */
+    class IndexOrder {
+    public:
+        const MortonGrid* grid;
+        IndexOrder(const MortonGrid* g) : grid(g) {}
+        bool operator()(int a, int b) const {
+            return grid->m_index[a] < grid->m_index[b];
+        }
+    };
+};
+
+} // namespace G3D
+
+#endif
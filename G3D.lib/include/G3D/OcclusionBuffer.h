@@ -0,0 +1,238 @@
+/**
+ @file OcclusionBuffer.h
+
+ Low-resolution software depth buffer for occlusion culling.
+
+ @sa G3D::DynamicBVH, G3D::GCamera
+ */
+
+#ifndef G3D_OcclusionBuffer_h
+#define G3D_OcclusionBuffer_h
+
+#include "G3D/platform.h"
+#include "G3D/ReferenceCount.h"
+#include "G3D/Array.h"
+#include "G3D/AABox.h"
+#include "G3D/Matrix4.h"
+#include "G3D/CoordinateFrame.h"
+#include "G3D/MeshAlg.h"
+
+namespace G3D {
+
+class GCamera;
+class Rect2D;
+
+namespace _internal {
+class OcclusionTransform;
+class OcclusionSetup;
+class OcclusionRaster;
+} // namespace _internal
+
+/**
+ \brief Rasterizes occluder meshes into a small depth buffer on the
+ CPU and tests bounding boxes against it, so that surfaces hidden
+ behind walls and buildings need not be submitted to the GPU.
+
+ Each frame, call setCamera(), then addOccluder() for a few large
+ meshes that are likely to hide others (usually simplified versions
+ of buildings and terrain), then render().  After render(),
+ occluded() reports whether a box is certainly hidden behind the
+ occluders and may be called from any thread.
+
+ <pre>
+    OcclusionBuffer::Ref occlusion = OcclusionBuffer::create();
+
+    occlusion->setCamera(camera, viewport);
+    for (int i = 0; i < occluder.size(); ++i) {
+        occlusion->addOccluder(occluder[i].frame, occluder[i].geometry, occluder[i].index);
+    }
+    occlusion->render();
+
+    for (int i = 0; i < model.size(); ++i) {
+        if (! occlusion->occluded(model[i]->worldSpaceBoundingBox())) {
+            visible.append(model[i]);
+        }
+    }
+ </pre>
+
+ The buffer is divided into TILE_WIDTH x TILE_HEIGHT pixel tiles.
+ render() transforms and sets up the occluder triangles on the
+ TaskScheduler's workers, sorts them into per-tile bins, and then
+ rasterizes the tiles in parallel, four pixels at a time with SSE2
+ when available.  Triangles are rasterized from both sides, and only
+ pixels whose centers they cover are written, so silhouettes are not
+ conservative by up to one pixel.  The buffer stores 1/w (larger is
+ nearer), which is linear in screen space, and keeps the farthest
+ value in each tile so that occluded() can usually accept a box
+ after one comparison per tile that it overlaps.
+
+ Boxes that cross the near plane are never occluded.
+
+ <B>BETA API</B>  This is unsupported and may change
+ */
+class OcclusionBuffer : public ReferenceCountedObject {
+public:
+
+    typedef ReferenceCountedPointer<OcclusionBuffer> Ref;
+
+    enum {TILE_WIDTH = 32, TILE_HEIGHT = 16};
+
+private:
+
+    /** A triangle set up for rasterization in screen space, with
+        edge functions a*x + b*y + c that are non-negative inside. */
+    class Triangle {
+    public:
+        float       edgeA[3];
+        float       edgeB[3];
+        double      edgeC[3];
+
+        /** 1/w = depthA * x + depthB * y + depthC */
+        float       depthA;
+        float       depthB;
+        double      depthC;
+
+        /** Pixel bounds, exclusive at the top */
+        int         x0, y0, x1, y1;
+    };
+
+    class Occluder {
+    public:
+        CoordinateFrame             frame;
+        const Array<Vector3>*       vertex;
+        const Array<int>*           index;
+
+        /** Clip-space vertices, written by render() */
+        Array<Vector4>              clip;
+    };
+
+    /** A range of the vertices or triangles of one occluder, so that
+        large occluders are processed on several threads */
+    class Batch {
+    public:
+        int                         occluder;
+        int                         begin;
+        int                         end;
+
+        /** Set-up triangles, for triangle batches */
+        Array<Triangle>             triangle;
+    };
+
+    enum {VERTICES_PER_BATCH = 2048, TRIANGLES_PER_BATCH = 512};
+
+    friend class _internal::OcclusionTransform;
+    friend class _internal::OcclusionSetup;
+    friend class _internal::OcclusionRaster;
+
+    int                 m_width;
+    int                 m_height;
+    int                 m_tilesX;
+    int                 m_tilesY;
+
+    /** Tile-major 1/w, TILE_WIDTH * TILE_HEIGHT values per tile */
+    float*              m_depth;
+
+    /** Farthest (minimum) 1/w in each tile */
+    Array<float>        m_tileDepth;
+
+    Matrix4             m_worldToClip;
+
+    /** Clip-space w of the near plane */
+    float               m_nearW;
+
+    Array<Occluder>     m_occluder;
+    int                 m_numOccluders;
+
+    Array<Batch>        m_vertexBatch;
+    int                 m_numVertexBatches;
+
+    Array<Batch>        m_triangleBatch;
+    int                 m_numTriangleBatches;
+
+    /** Triangles overlapping each tile */
+    Array< Array<const Triangle*> > m_bin;
+
+    int                 m_numTriangles;
+
+    OcclusionBuffer(int width, int height);
+
+    // Not copyable
+    OcclusionBuffer(const OcclusionBuffer&);
+    OcclusionBuffer& operator=(const OcclusionBuffer&);
+
+    /** Transforms the vertices of \a batch to clip space */
+    void transformVertices(const Batch& batch);
+
+    /** Clips and sets up the triangles of \a batch */
+    void setupTriangles(Batch& batch) const;
+
+    /** Appends a batch for [begin, end) of \a occluder to \a batch, reusing its triangle array */
+    static void appendBatch(Array<Batch>& batch, int& numBatches, int occluder, int begin, int end);
+
+    /** Appends the triangle with clip-space vertices \a v to \a out, if it covers any pixel center */
+    void setupTriangle(const Vector4* v, Array<Triangle>& out) const;
+
+    void rasterizeTile(int t, bool sse);
+
+    /** Projects \a p from clip space to pixels */
+    Vector2 toScreen(const Vector4& p) const;
+
+public:
+
+    /** \param width, height Size of the buffer in pixels, which is
+        rounded up to a whole number of tiles.  Small buffers are fast
+        and are usually good enough for culling. */
+    static Ref create(int width = 256, int height = 128);
+
+    ~OcclusionBuffer();
+
+    int width() const {
+        return m_width;
+    }
+
+    int height() const {
+        return m_height;
+    }
+
+    /** Sets the projection for the next render() and removes all occluders. */
+    void setCamera(const GCamera& camera, const Rect2D& viewport);
+
+    /** Sets the projection for the next render() and removes all occluders.
+        \param worldToClip Maps world space to clip space with the
+        conventions of GCamera::getProjectUnitMatrix, in which y = -1
+        is the top of the viewport.  This is usually that matrix times
+        the inverse of the camera frame.
+        \param nearW The clip-space w of the near plane, which is greater than zero. */
+    void setProjection(const Matrix4& worldToClip, float nearW);
+
+    /** Adds a triangle list to draw in the next render().  The arrays
+        are referenced, not copied, and must not change until render()
+        returns.  For SuperSurface::CPUGeom, pass <code>*geom.geometry</code>
+        and <code>*geom.index</code>. */
+    void addOccluder(const CoordinateFrame& objectToWorld, const Array<Vector3>& vertex, const Array<int>& index);
+
+    void addOccluder(const CoordinateFrame& objectToWorld, const MeshAlg::Geometry& geometry, const Array<int>& index) {
+        addOccluder(objectToWorld, geometry.vertexArray, index);
+    }
+
+    /** Clears the buffer and draws the occluders added since setCamera() on the TaskScheduler. */
+    void render();
+
+    /** True if every point of \a worldBox that is inside the view is
+        behind an occluder drawn by render().  Boxes entirely outside
+        the view are not occluded, since frustum culling handles them. */
+    bool occluded(const AABox& worldBox) const;
+
+    /** 1/w of the nearest occluder at pixel (x, y), or 0 where there
+        is no occluder.  As in viewport coordinates, y = 0 is the top row. */
+    float depth(int x, int y) const;
+
+    /** Number of triangles drawn by the last render(), after clipping */
+    int numTriangles() const {
+        return m_numTriangles;
+    }
+};
+
+} // namespace G3D
+
+#endif
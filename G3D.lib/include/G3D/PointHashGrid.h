@@ -21,6 +21,7 @@
 #include "G3D/AABox.h"
 #include "G3D/Sphere.h"
 #include "G3D/SmallArray.h"
+#include "G3D/TaskScheduler.h"
 
 namespace G3D {
 
@@ -883,6 +884,390 @@ public:
     ///////////////////////////////////////////////////////////////////////////
     ///////////////////////////////////////////////////////////////////////////
 
+private:
+
+    /** A query position and its index in the caller's array, sorted by cell
+        by the batch queries so that consecutive queries share cell lookups. */
+    class SortedQuery {
+    public:
+        Vector3int32        cellCoord;
+        int                 index;
+
+        inline bool operator<(const SortedQuery& other) const {
+            if (cellCoord.z != other.cellCoord.z) {
+                return cellCoord.z < other.cellCoord.z;
+            } else if (cellCoord.y != other.cellCoord.y) {
+                return cellCoord.y < other.cellCoord.y;
+            } else if (cellCoord.x != other.cellCoord.x) {
+                return cellCoord.x < other.cellCoord.x;
+            } else {
+                return index < other.index;
+            }
+        }
+
+        /** Required by Array::sort */
+        inline bool operator>(const SortedQuery& other) const {
+            return other < *this;
+        }
+    };
+
+    /** Sorts the indices of \a query by cell */
+    void sortQueries(const Array<Vector3>& query, Array<SortedQuery>& sorted) const {
+        sorted.resize(query.size());
+        for (int i = 0; i < query.size(); ++i) {
+            getCellCoord(query[i], sorted[i].cellCoord);
+            sorted[i].index = i;
+        }
+        sorted.sort();
+    }
+
+    /** Appends the non-empty cells whose Chebyshev distance from \a center
+        is exactly \a ring, visiting only the part of the ring inside the
+        cell box [\a lo, \a hi].  Every value lies in the cell box of
+        m_bounds, so passing that box skips only empty cells. */
+    void getRingCells(const Vector3int32& center, int ring, const Vector3int32& lo, const Vector3int32& hi, 
+                      Array<const Cell*>& cells) const {
+        const Vector3int32 dLo(iMax(-ring, lo.x - center.x), iMax(-ring, lo.y - center.y), iMax(-ring, lo.z - center.z));
+        const Vector3int32 dHi(iMin(ring, hi.x - center.x), iMin(ring, hi.y - center.y), iMin(ring, hi.z - center.z));
+
+        Vector3int32 d;
+        for (d.z = dLo.z; d.z <= dHi.z; ++d.z) {
+            const bool zFace = (iAbs(d.z) == ring);
+            for (d.y = dLo.y; d.y <= dHi.y; ++d.y) {
+                if (zFace || (iAbs(d.y) == ring)) {
+                    for (d.x = dLo.x; d.x <= dHi.x; ++d.x) {
+                        appendCell(center + d, cells);
+                    }
+                } else {
+                    // Interior rows only touch the ring at their ends
+                    if (dLo.x == -ring) {
+                        appendCell(center + Vector3int32(-ring, d.y, d.z), cells);
+                    }
+                    if (dHi.x == ring) {
+                        appendCell(center + Vector3int32(ring, d.y, d.z), cells);
+                    }
+                }
+            }
+        }
+    }
+
+    void appendCell(const Vector3int32& coord, Array<const Cell*>& cells) const {
+        const Cell* cell = m_data.getPointer(coord);
+        if ((cell != NULL) && (cell->size() > 0)) {
+            cells.append(cell);
+        }
+    }
+
+    /** The cell box of m_bounds */
+    void getBoundsCells(Vector3int32& lo, Vector3int32& hi) const {
+        getCellCoord(m_bounds.low(), lo);
+        getCellCoord(m_bounds.high(), hi);
+    }
+
+    /** Per-chunk output of radiusSearchAll */
+    class RadiusChunk {
+    public:
+        Array<const Value*> result;
+    };
+
+    /** parallelFor body for radiusSearchAll.  Each range of sorted
+        queries is one chunk. */
+    class RadiusSearchBody {
+    public:
+        const ThisType*             grid;
+        const Array<Vector3>*       query;
+        const Array<SortedQuery>*   sorted;
+        float                       radius;
+        int                         grainSize;
+
+        /** Number of results per query, in the caller's order */
+        int*                        count;
+        /** Start of each query's results within its chunk */
+        int*                        start;
+        RadiusChunk*                chunk;
+
+        void operator()(int begin, int end) const {
+            RadiusChunk& out = chunk[begin / grainSize];
+            const float r2 = square(radius);
+            const int reach = iMax(1, iCeil(radius * grid->m_invCellWidth));
+            Vector3int32 boundsLo, boundsHi;
+            grid->getBoundsCells(boundsLo, boundsHi);
+
+            // Cells around the current query cell, reused while consecutive
+            // sorted queries fall in the same cell
+            Array<const Cell*> cells;
+            Vector3int32 cachedCoord;
+            bool cacheValid = false;
+
+            for (int s = begin; s < end; ++s) {
+                const SortedQuery& q = (*sorted)[s];
+                if (! cacheValid || (q.cellCoord != cachedCoord)) {
+                    cells.fastClear();
+                    for (int ring = 0; ring <= reach; ++ring) {
+                        grid->getRingCells(q.cellCoord, ring, boundsLo, boundsHi, cells);
+                    }
+                    cachedCoord = q.cellCoord;
+                    cacheValid = true;
+                }
+
+                const Vector3& center = (*query)[q.index];
+                start[q.index] = out.result.size();
+                for (int c = 0; c < cells.size(); ++c) {
+                    const Cell& cell = *cells[c];
+                    for (int e = 0; e < cell.size(); ++e) {
+                        if ((cell[e].position - center).squaredLength() <= r2) {
+                            out.result.append(&cell[e].value);
+                        }
+                    }
+                }
+                count[q.index] = out.result.size() - start[q.index];
+            }
+        }
+    };
+
+    /** parallelFor body for kNearest */
+    class KNearestBody {
+    public:
+        const ThisType*             grid;
+        const Array<Vector3>*       query;
+        const Array<SortedQuery>*   sorted;
+        int                         k;
+        float                       maxDistance;
+        const Value**               result;
+
+        void operator()(int begin, int end) const {
+            const float maxDistance2 = square(maxDistance);
+
+            // Every value is in this box of cells
+            Vector3int32 boundsLo, boundsHi;
+            grid->getBoundsCells(boundsLo, boundsHi);
+
+            // ringCell[r - minRing] holds the non-empty cells in ring r around cachedCoord
+            Array< Array<const Cell*> > ringCell;
+            Vector3int32 cachedCoord;
+            bool cacheValid = false;
+
+            // Current k best, sorted by increasing distance
+            Array<float> bestDistance2;
+            Array<const Value*> best;
+
+            for (int s = begin; s < end; ++s) {
+                const SortedQuery& q = (*sorted)[s];
+                if (! cacheValid || (q.cellCoord != cachedCoord)) {
+                    ringCell.fastClear();
+                    cachedCoord = q.cellCoord;
+                    cacheValid = true;
+                }
+
+                // Rings closer than minRing miss the bounds and rings past
+                // maxRing lie entirely outside them, so queries far from
+                // the values do not walk the empty space between
+                int minRing = 0, maxRing = 0;
+                for (int a = 0; a < 3; ++a) {
+                    minRing = iMax(minRing, iMax(boundsLo[a] - q.cellCoord[a], q.cellCoord[a] - boundsHi[a]));
+                    maxRing = iMax(maxRing, iMax(q.cellCoord[a] - boundsLo[a], boundsHi[a] - q.cellCoord[a]));
+                }
+                if (maxDistance < finf()) {
+                    maxRing = iMin(maxRing, iCeil(maxDistance * grid->m_invCellWidth));
+                }
+
+                const Vector3& center = (*query)[q.index];
+                bestDistance2.fastClear();
+                best.fastClear();
+
+                for (int ring = minRing; ring <= maxRing; ++ring) {
+                    if (ring - minRing >= ringCell.size()) {
+                        ringCell.next().fastClear();
+                        grid->getRingCells(cachedCoord, ring, boundsLo, boundsHi, ringCell.last());
+                    }
+
+                    const Array<const Cell*>& cells = ringCell[ring - minRing];
+                    for (int c = 0; c < cells.size(); ++c) {
+                        const Cell& cell = *cells[c];
+                        for (int e = 0; e < cell.size(); ++e) {
+                            const float d2 = (cell[e].position - center).squaredLength();
+                            if ((d2 > maxDistance2) || 
+                                ((best.size() == k) && (d2 >= bestDistance2.last()))) {
+                                continue;
+                            }
+
+                            // Insertion sort into the k best
+                            if (best.size() < k) {
+                                best.append(NULL);
+                                bestDistance2.append(0.0f);
+                            }
+                            int i = best.size() - 1;
+                            while ((i > 0) && (bestDistance2[i - 1] > d2)) {
+                                best[i] = best[i - 1];
+                                bestDistance2[i] = bestDistance2[i - 1];
+                                --i;
+                            }
+                            best[i] = &cell[e].value;
+                            bestDistance2[i] = d2;
+                        }
+                    }
+
+                    // Everything closer than ring * cellWidth has now been seen
+                    if ((best.size() == k) && (bestDistance2.last() <= square(ring * grid->m_cellWidth))) {
+                        break;
+                    }
+                }
+
+                const Value** out = result + q.index * k;
+                for (int i = 0; i < k; ++i) {
+                    out[i] = (i < best.size()) ? best[i] : NULL;
+                }
+            }
+        }
+    };
+
+    /** Number of sorted queries per parallel task in the batch queries */
+    enum {BATCH_GRAIN_SIZE = 1024};
+
+public:
+
+    /**
+       Finds all values within \a radius of each query point, in
+       compressed sparse row form: the values near
+       <code>query[i]</code> are
+       <code>result[offset[i]]</code> ... <code>result[offset[i + 1] - 1]</code>,
+       in no particular order.  \a offset has query.size() + 1 elements.
+
+       Much faster than one beginSphereIntersection per point: the
+       queries are sorted by cell so that consecutive queries reuse
+       the cell lookups, and with \a useThreads the work is divided
+       among TaskScheduler::global()'s workers.
+
+       The pointers are valid until the grid is mutated.
+
+       <pre>
+        Array<int> offset;
+        Array<const Vector3*> neighbor;
+        grid.radiusSearchAll(particle, weldRadius, offset, neighbor);
+        for (int i = 0; i < particle.size(); ++i) {
+            for (int j = offset[i]; j < offset[i + 1]; ++j) {
+                ... *neighbor[j] ...
+            }
+        }
+       </pre>
+     */
+    void radiusSearchAll
+    (const Array<Vector3>&      query,
+     float                      radius,
+     Array<int>&                offset,
+     Array<const Value*>&       result,
+     bool                       useThreads = true) const {
+
+        offset.resize(query.size() + 1);
+        result.fastClear();
+        if (query.size() == 0) {
+            offset[0] = 0;
+            return;
+        }
+
+        Array<SortedQuery> sorted;
+        sortQueries(query, sorted);
+
+        Array<int> count, start;
+        count.resize(query.size());
+        start.resize(query.size());
+
+        Array<RadiusChunk> chunk;
+        chunk.resize((query.size() + BATCH_GRAIN_SIZE - 1) / BATCH_GRAIN_SIZE);
+
+        RadiusSearchBody body;
+        body.grid      = this;
+        body.query     = &query;
+        body.sorted    = &sorted;
+        body.radius    = radius;
+        body.grainSize = BATCH_GRAIN_SIZE;
+        body.count     = count.getCArray();
+        body.start     = start.getCArray();
+        body.chunk     = chunk.getCArray();
+
+        if (useThreads) {
+            TaskScheduler::global()->parallelFor(0, sorted.size(), BATCH_GRAIN_SIZE, body);
+        } else {
+            for (int b = 0; b < sorted.size(); b += BATCH_GRAIN_SIZE) {
+                body(b, iMin(sorted.size(), b + BATCH_GRAIN_SIZE));
+            }
+        }
+
+        // Gather the chunks into the caller's order
+        offset[0] = 0;
+        for (int i = 0; i < query.size(); ++i) {
+            offset[i + 1] = offset[i] + count[i];
+        }
+        result.resize(offset.last());
+
+        for (int s = 0; s < sorted.size(); ++s) {
+            const int i = sorted[s].index;
+            const Array<const Value*>& src = chunk[s / BATCH_GRAIN_SIZE].result;
+            for (int j = 0; j < count[i]; ++j) {
+                result[offset[i] + j] = src[start[i] + j];
+            }
+        }
+    }
+
+
+    /**
+       Finds the \a k values closest to each query point.  The
+       neighbors of <code>query[i]</code> are
+       <code>result[i * k]</code> ... <code>result[i * k + k - 1]</code>
+       in order of increasing distance.  If fewer than \a k values lie within
+       \a maxDistance, the remaining entries are NULL.
+
+       Queries are sorted by cell and searched in expanding shells of
+       cells, reusing each shell's cell lookups across neighboring
+       queries.  With \a useThreads the work is divided among
+       TaskScheduler::global()'s workers.
+
+       The shells start at the first one that reaches bounds() and are
+       clipped to it, so a query visits at most the cells of bounds()
+       within distance D of it, where D is the distance to its k-th
+       neighbor (or \a maxDistance, if smaller).  That is O(D<sup>3</sup>)
+       cells when the values are sparse relative to the cell size; pass a
+       finite \a maxDistance to bound the cost of such queries.
+
+       The pointers are valid until the grid is mutated.
+     */
+    void kNearest
+    (const Array<Vector3>&      query,
+     int                        k,
+     Array<const Value*>&       result,
+     float                      maxDistance = finf(),
+     bool                       useThreads = true) const {
+
+        debugAssertM(k > 0, "k must be positive");
+        result.resize(query.size() * k);
+        if ((query.size() == 0) || (size() == 0)) {
+            for (int i = 0; i < result.size(); ++i) {
+                result[i] = NULL;
+            }
+            return;
+        }
+
+        Array<SortedQuery> sorted;
+        sortQueries(query, sorted);
+
+        KNearestBody body;
+        body.grid        = this;
+        body.query       = &query;
+        body.sorted      = &sorted;
+        body.k           = k;
+        body.maxDistance = maxDistance;
+        body.result      = result.getCArray();
+
+        if (useThreads) {
+            TaskScheduler::global()->parallelFor(0, sorted.size(), BATCH_GRAIN_SIZE, body);
+        } else {
+            body(0, sorted.size());
+        }
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    ///////////////////////////////////////////////////////////////////////////
+
     /** Returns true if there is a value that is exactly equal to @a v. This will 
         check all neighboring cells to avoid roundoff error at cell boundaries. 
     */
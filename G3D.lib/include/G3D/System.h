@@ -101,6 +101,7 @@ private:
     bool           m_hasSSE;
     bool           m_hasSSE2;
     bool           m_hasSSE3;
+    bool           m_hasSSSE3;
     bool           m_has3DNOW;
     bool           m_has3DNOW2;
     bool           m_hasAMDMMX;
@@ -206,6 +207,11 @@ public:
         return instance().m_hasSSE3;
     }
 
+    /** Supplemental SSE3, which adds byte shuffles (pshufb) */
+    inline static bool hasSSSE3() {
+        return instance().m_hasSSSE3;
+    }
+
     inline static bool hasMMX() {
         return instance().m_hasMMX;
     }
@@ -253,9 +259,11 @@ public:
        
        The result must be freed with free.
        
-       Threadsafe on Win32.
+       Threadsafe.  Each thread allocates from and frees into its own
+       cache of buffers, so threads only contend for the shared pools
+       when a cache must be refilled or drained.
        
-       @sa calloc realloc OutOfMemoryCallback free
+       @sa calloc realloc OutOfMemoryCallback free flushThreadMallocCache
     */
     static void* malloc(size_t bytes);
     
@@ -270,8 +278,21 @@ public:
         its internal pooled storage.  "heap" memory was slow to
         allocate; the other data sizes are comparatively fast.*/
     static std::string mallocPerformance();
+
+    /** Like mallocPerformance(), but only counts allocations made by
+        the calling thread since its cache was created. */
+    static std::string threadMallocPerformance();
+
     static void resetMallocPerformanceCounters();
 
+    /**
+       Returns the buffers cached by the calling thread to the shared
+       pools used by System::malloc so that other threads can reuse them.
+       GThread invokes this automatically when threadMain() returns, and
+       on non-Windows platforms it also happens when any thread exits.
+     */
+    static void flushThreadMallocCache();
+
     /** 
        Returns a string describing the current usage of the buffer pools used for
        optimizing System::malloc.
@@ -281,7 +302,7 @@ public:
     /**
      Free data allocated with System::malloc.
 
-     Threadsafe on Win32.
+     Threadsafe.
      */
     static void free(void* p);
 
@@ -0,0 +1,250 @@
+/**
+  @file TaskScheduler.h
+
+  A persistent pool of worker threads that execute fork/join tasks
+  using work stealing.
+
+  @sa G3D::GThread, G3D::ThreadSet
+ */
+
+#ifndef G3D_TaskScheduler_h
+#define G3D_TaskScheduler_h
+
+#include "G3D/platform.h"
+#include "G3D/ReferenceCount.h"
+#include "G3D/AtomicInt32.h"
+#include "G3D/Array.h"
+#include "G3D/GThread.h"
+#include "G3D/GMutex.h"
+#include "G3D/System.h"
+
+namespace G3D {
+
+class TaskGroup;
+
+namespace _internal {
+    class TaskDeque;
+    class TaskWorker;
+    class TaskSemaphore;
+}
+
+/**
+ \brief A unit of work executed by a TaskScheduler.
+
+ Subclass and override run().  The Task is not deleted by the
+ scheduler; it must remain valid until the TaskGroup it was submitted
+ to has finished waiting.
+
+ \sa G3D::TaskGroup
+ */
+class Task {
+public:
+    virtual ~Task() {}
+    virtual void run() = 0;
+};
+
+
+/**
+ \brief Persistent work-stealing thread pool.
+
+ Each worker thread owns a deque of tasks.  A thread pushes and pops
+ its own tasks at the bottom of its deque (so that recently spawned,
+ cache-warm work runs first) and steals from the top of other threads'
+ deques when it runs out.  Threads that wait on a TaskGroup execute
+ tasks while they wait, so task groups may be nested arbitrarily
+ without deadlocking or oversubscribing the machine.
+
+ Unlike GThread and ThreadSet, no OS threads are created per batch of
+ work.  Most programs should share the global() instance.
+
+ Example:
+ <pre>
+    class Scale {
+    public:
+        float* data;
+        void operator()(int begin, int end) const {
+            for (int i = begin; i < end; ++i) {
+                data[i] *= 2.0f;
+            }
+        }
+    };
+
+    Scale s;
+    s.data = array.getCArray();
+    TaskScheduler::global()->parallelFor(0, array.size(), 1024, s);
+ </pre>
+
+ \sa G3D::Task, G3D::TaskGroup
+
+ <B>BETA API</B>  This is unsupported and may change
+ */
+class TaskScheduler : public ReferenceCountedObject {
+public:
+
+    typedef ReferenceCountedPointer<TaskScheduler> Ref;
+
+private:
+
+    friend class TaskGroup;
+    friend class _internal::TaskWorker;
+
+    /** One per worker, plus one at the end shared by threads outside of the pool. */
+    Array<_internal::TaskDeque*>    m_deque;
+
+    Array<_internal::TaskWorker*>   m_worker;
+
+    /** Signalled when tasks are pushed and workers may be asleep */
+    _internal::TaskSemaphore*       m_wake;
+
+    /** Number of workers blocked on m_wake */
+    AtomicInt32                     m_numSleeping;
+
+    /** Non-zero when the workers should exit */
+    AtomicInt32                     m_stop;
+
+    explicit TaskScheduler(int numWorkers);
+
+    /** Index of the deque owned by the calling thread, or the shared
+        deque if the calling thread is not one of this scheduler's workers. */
+    int currentDequeIndex() const;
+
+    /** Queues \a task for execution on behalf of \a group. */
+    void push(Task* task, TaskGroup* group);
+
+    /** Pops from the caller's own deque, or steals from another.
+        Returns false if no work was found. */
+    bool tryRunOne(int dequeIndex);
+
+    /** Called by workers */
+    void workerMain(int index);
+
+    template<class Body>
+    class RangeTask : public Task {
+    public:
+        const Body*     body;
+        int             begin;
+        int             end;
+
+        virtual void run() {
+            (*body)(begin, end);
+        }
+    };
+
+public:
+
+    /**
+      @param numWorkers Number of threads to spawn.  Threads that call
+      TaskGroup::wait() also execute tasks, so the default of one fewer
+      than the number of cores keeps every core busy.
+     */
+    static Ref create(int numWorkers = iMax(0, System::numCores() - 1));
+
+    /** The shared scheduler used by G3D, created on first use with one
+        worker per core beyond the first. */
+    static const Ref& global();
+
+    /** Stops and joins all worker threads.  Tasks must not be pending. */
+    ~TaskScheduler();
+
+    /** Number of worker threads, not counting threads that help while waiting. */
+    int numWorkers() const {
+        return m_worker.size();
+    }
+
+    /**
+       Invokes <code>body(b, e)</code> for disjoint subranges
+       <code>[b, e)</code> that cover <code>[begin, end)</code>, in
+       parallel.  Each subrange contains at most \a grainSize indices.
+       Returns after all subranges have completed.
+
+       \a Body must provide <code>void operator()(int b, int e) const</code>
+       and be safe to invoke concurrently.
+     */
+    template<class Body>
+    void parallelFor(int begin, int end, int grainSize, const Body& body);
+};
+
+
+/**
+ \brief Fork/join group of tasks submitted to a TaskScheduler.
+
+ The destructor waits for all tasks that were run in the group.
+
+ <pre>
+    TaskGroup group;
+    group.run(&leftTask);
+    group.run(&rightTask);
+    group.wait();
+ </pre>
+ */
+class TaskGroup {
+private:
+    friend class TaskScheduler;
+
+    TaskScheduler::Ref      m_scheduler;
+
+    /** Tasks submitted but not yet completed */
+    AtomicInt32             m_pending;
+
+    // Not implemented on purpose, don't use
+    TaskGroup(const TaskGroup&);
+    TaskGroup& operator=(const TaskGroup&);
+
+public:
+
+    TaskGroup(const TaskScheduler::Ref& scheduler = TaskScheduler::global()) :
+        m_scheduler(scheduler), m_pending(0) {}
+
+    ~TaskGroup() {
+        wait();
+    }
+
+    /** Schedules \a task to execute asynchronously.  \a task must not be
+        destroyed until wait() returns. */
+    void run(Task* task) {
+        m_pending.increment();
+        m_scheduler->push(task, this);
+    }
+
+    /** Executes queued tasks (from this or any other group) on the
+        calling thread until every task run in this group has completed. */
+    void wait();
+};
+
+
+template<class Body>
+void TaskScheduler::parallelFor(int begin, int end, int grainSize, const Body& body) {
+    if (end <= begin) {
+        return;
+    }
+    grainSize = iMax(grainSize, 1);
+
+    const int numTasks = (end - begin + grainSize - 1) / grainSize;
+    if ((numTasks == 1) || (numWorkers() == 0)) {
+        // Not worth the scheduling overhead
+        for (int b = begin; b < end; b += grainSize) {
+            body(b, iMin(end, b + grainSize));
+        }
+        return;
+    }
+
+    Array<RangeTask<Body> > task;
+    task.resize(numTasks);
+
+    TaskGroup group(this);
+    // Push in reverse order so that the calling thread, which pops
+    // from the bottom of its deque, processes the range front to back
+    // while thieves take the far end.
+    for (int t = numTasks - 1; t >= 0; --t) {
+        RangeTask<Body>& r = task[t];
+        r.body  = &body;
+        r.begin = begin + t * grainSize;
+        r.end   = iMin(end, r.begin + grainSize);
+        group.run(&r);
+    }
+    group.wait();
+}
+
+} // namespace G3D
+
+#endif
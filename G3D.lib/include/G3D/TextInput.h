@@ -147,6 +147,112 @@ public:
 };
 
 
+/**
+ \brief A token returned by TextInput::readView() whose text refers to
+ the characters of the TextInput instead of a copy of them.
+
+ Reading a TokenView performs no heap allocation, and the value of a
+ number is computed while the token is read, so number() is
+ free.  The characters returned by data() remain valid only until the
+ next call to a method of the TextInput that produced the view; call
+ string() or token() to keep them longer.
+
+ The text is <i>not</i> NUL-terminated.
+
+ \sa Token, TextInput::readView
+ */
+class TokenView {
+private:
+
+    friend class TextInput;
+
+    const char*             _data;
+    int                     _length;
+    double                  _number;
+    bool                    _bool;
+    int                     _line;
+    int                     _character;
+    uint64                  _bytePosition;
+    Token::Type             _type;
+    Token::ExtendedType     _extendedType;
+
+public:
+
+    TokenView() :
+        _data(""),
+        _length(0),
+        _number(0.0),
+        _bool(false),
+        _line(0),
+        _character(0),
+        _bytePosition(0),
+        _type(Token::END),
+        _extendedType(Token::END_TYPE) {}
+
+    Token::Type type() const {
+        return _type;
+    }
+
+    Token::ExtendedType extendedType() const {
+        return _extendedType;
+    }
+
+    /** The same characters as Token::string(), which are not NUL-terminated. */
+    const char* data() const {
+        return _data;
+    }
+
+    /** Number of characters at data() */
+    int length() const {
+        return _length;
+    }
+
+    /** Copies the text */
+    std::string string() const {
+        return std::string(_data, _length);
+    }
+
+    /** True if the text is exactly \a s */
+    bool equals(const char* s) const {
+        int i = 0;
+        while ((i < _length) && (s[i] == _data[i])) {
+            ++i;
+        }
+        return (i == _length) && (s[i] == '\0');
+    }
+
+    bool equals(const std::string& s) const {
+        return ((int)s.length() == _length) && (s.compare(0, _length, _data, _length) == 0);
+    }
+
+    bool boolean() const {
+        return _bool;
+    }
+
+    /** The numeric value for a number type, or zero if this is not a number type. */
+    double number() const {
+        return _number;
+    }
+
+    int line() const {
+        return _line;
+    }
+
+    int character() const {
+        return _character;
+    }
+
+    uint64 bytePosition() const {
+        return _bytePosition;
+    }
+
+    /** Copies this into a Token */
+    Token token() const {
+        return Token(_type, _extendedType, string(), _bool, _line, _character, _bytePosition);
+    }
+};
+
+
 /**
  A simple style tokenizer for reading text files.  TextInput handles a
  superset of C++,Java, Matlab, and Bash code text including single
@@ -437,6 +543,15 @@ private:
     /** Configuration options.  This includes the file name that will be
         reported in tokens and exceptions.  */
     Settings                options;
+
+    /** options.trueSymbols and options.falseSymbols, for comparing
+        against TokenView text without copying it. */
+    Array<std::string>      trueSymbolArray;
+    Array<std::string>      falseSymbolArray;
+
+    /** Backs the TokenView returned by readView() when the token was
+        read by nextToken(). */
+    Token                   viewToken;
   
     void init();
 
@@ -488,6 +603,21 @@ private:
     */
     void parseQuotedString(unsigned char delimiter, Token& t);
 
+    /**
+       Reads the next token into \a v without copying its text, using
+       character class tables instead of the chain of tests in
+       nextToken().  Produces exactly the token that nextToken() would.
+
+       Returns false, leaving the input positioned at the start of the
+       token, for the tokens that need nextToken(): strings containing
+       escape sequences or newlines, comment tokens, MSVC float
+       specials, proof symbols, and unusual characters.
+    */
+    bool readFastToken(TokenView& v);
+
+    /** True if [s, s + len) is one of \a symbols, respecting options.caseSensitive */
+    bool matchesSymbol(const Array<std::string>& symbols, const char* s, int len) const;
+
 public:
 
     class TokenException : public ParseError {
@@ -592,6 +722,16 @@ public:
     /** Calls read() until the result is not a newline or comment */
     Token readSignificant();
 
+    /** Reads the same token as read(), but without copying its text.
+        This is the fastest way to tokenize large files such as OBJ
+        models.
+
+        The text of the result is only valid until the next call to a
+        method of this TextInput; see TokenView.  readView() may be
+        freely mixed with read(), peek(), and push().
+    */
+    TokenView readView();
+
     /** Read one token (or possibly two) as a number or throws
         WrongTokenType, and returns the number.
 
@@ -0,0 +1,223 @@
+/**
+ @file XMLReader.h
+
+ Pull-style streaming XML parser.
+
+ @sa G3D::XML
+ */
+
+#ifndef G3D_XMLReader_h
+#define G3D_XMLReader_h
+
+#include "G3D/platform.h"
+#include "G3D/Array.h"
+#include "G3D/XML.h"
+#include <string>
+
+namespace G3D {
+
+class BinaryInput;
+
+/**
+ \brief Reads XML as a stream of start-tag, attribute, text, and
+ end-tag events without building a tree.
+
+ G3D::XML builds a tree with an attribute Table and a child Array for
+ every element, which takes many times the size of the file in heap
+ for large documents such as COLLADA files.  XMLReader instead walks a
+ memory-mapped view of the file and reports one event per call to
+ next().  The name and value of the current event are held in buffers
+ that are reused from event to event, so the reader does not allocate
+ per node once those buffers have grown to the longest name and value.
+ Use readSubtree() or materialize() to build G3D::XML trees for only
+ the parts of a document that are needed.
+
+ <pre>
+    XMLReader reader("scene.dae");
+    while (reader.next()) {
+        if ((reader.event() == XMLReader::START_TAG) && (reader.name() == "float_array")) {
+            ...
+        } else if (reader.event() == XMLReader::ATTRIBUTE) {
+            debugPrintf("%s = %s\n", reader.name().c_str(), reader.value().c_str());
+        }
+    }
+ </pre>
+
+ An empty-element tag such as <code>&lt;br/&gt;</code> produces a
+ START_TAG event, its ATTRIBUTE events, and then an END_TAG event.
+ The attributes of an element immediately follow its START_TAG.
+
+ TEXT events carry the characters between tags with leading and
+ trailing white space removed; white space between tags produces no
+ event.  The predefined entities (e.g., <code>&amp;lt;</code>) and
+ numeric character references in text and attribute values are
+ decoded (to UTF-8).  CDATA sections produce TEXT events containing
+ their exact contents.  Comments, processing instructions such as
+ <code>&lt;?xml ...?&gt;</code>, and <code>&lt;!DOCTYPE&gt;</code> are
+ skipped.
+
+ Mismatched and unterminated tags throw ParseError.  No other
+ validation is performed.
+
+ <B>BETA API</B>  This is unsupported and may change
+ */
+class XMLReader {
+public:
+
+    enum Event {
+        /** name() is the element name */
+        START_TAG,
+
+        /** name() and value() are the attribute name and value */
+        ATTRIBUTE,
+
+        /** value() is the text */
+        TEXT,
+
+        /** name() is the element name */
+        END_TAG,
+
+        /** next() returned false */
+        END_OF_INPUT
+    };
+
+private:
+
+    /** Owns the memory-mapped file, if reading from a file */
+    BinaryInput*        m_input;
+
+    /** Holds the document, if reading from a string */
+    std::string         m_string;
+
+    std::string         m_filename;
+
+    const char*         m_data;
+    int64               m_size;
+
+    /** Offset of the next character to parse */
+    int64               m_pos;
+
+    Event               m_event;
+
+    /** Names of the open elements; entries above m_depth are reused */
+    Array<std::string>  m_stack;
+    int                 m_depth;
+
+    /** The current element is closed at the beginning of the next call to next() */
+    bool                m_popPending;
+
+    /** True between a START_TAG and the end of that tag's attributes */
+    bool                m_inTag;
+
+    /** Name of the current ATTRIBUTE */
+    std::string         m_attributeName;
+
+    /** Undecoded value of the current ATTRIBUTE or TEXT */
+    const char*         m_rawValue;
+    int                 m_rawValueLength;
+
+    /** False for CDATA, which is not decoded */
+    bool                m_decodeValue;
+
+    /** Decoded from m_rawValue on the first call to value() */
+    mutable std::string m_value;
+    mutable bool        m_valueReady;
+
+    /** Offset of the start of the current event, for error messages */
+    int64               m_eventPos;
+
+    // Not copyable
+    XMLReader(const XMLReader&);
+    XMLReader& operator=(const XMLReader&);
+
+    void init();
+
+    void parseError(int64 pos, const std::string& message) const;
+
+    /** Parses the next attribute, or the end of the current start tag */
+    bool readAttributeOrTagEnd();
+
+    /** Parses content between tags */
+    bool readContent();
+
+    /** Moves past the next occurrence of \a terminator, or throws \a message */
+    void skipPast(const char* terminator, const std::string& message);
+
+    /** Length of the name starting at m_pos */
+    int nameLength() const;
+
+    void setValue(const char* raw, int length, bool decode);
+
+public:
+
+    /** Memory-maps \a filename, which may be inside a zipfile (see FileSystem). */
+    explicit XMLReader(const std::string& filename);
+
+    enum FS {FROM_STRING};
+
+    /** Parses a copy of \a str.  The first argument must be XMLReader::FROM_STRING. */
+    XMLReader(FS fs, const std::string& str);
+
+    ~XMLReader();
+
+    /** Advances to the next event.  Returns false at the end of the
+        document, and throws ParseError if the document is malformed. */
+    bool next();
+
+    Event event() const {
+        return m_event;
+    }
+
+    /** The element name for START_TAG and END_TAG events, the attribute name for ATTRIBUTE events, and "" otherwise. */
+    const std::string& name() const;
+
+    /** The decoded value of an ATTRIBUTE or TEXT event, and "" otherwise. */
+    const std::string& value() const;
+
+    /** Parses value() as a number */
+    double number() const;
+
+    /** Number of open elements.  During START_TAG, ATTRIBUTE, and
+        END_TAG events this includes the element whose tag it is. */
+    int depth() const {
+        return m_depth;
+    }
+
+    /** Name of the open element at depth \a i + 1, where 0 is the root element. */
+    const std::string& pathName(int i) const {
+        debugAssert(i >= 0 && i < m_depth);
+        return m_stack[i];
+    }
+
+    /** True if the open elements match \a path, a list of element
+        names separated by slashes beginning at the root element,
+        e.g., "COLLADA/library_geometries/geometry".  "*" matches any
+        one name. */
+    bool pathMatches(const std::string& path) const;
+
+    /** Reads the rest of the element whose START_TAG is the current
+        event, through its END_TAG, and returns it as a tree. */
+    XML readSubtree();
+
+    /** Advances past the END_TAG of the element whose START_TAG is the current event */
+    void skipSubtree();
+
+    /** Reads the rest of the document, appending to \a result a tree
+        for each element whose path matches one of \a paths (see
+        pathMatches).  Elements nested inside a matching element are
+        not matched separately. */
+    void materialize(const Array<std::string>& paths, Array<XML>& result);
+
+    /** The file being read, or a prefix of the string in quotes */
+    const std::string& filename() const {
+        return m_filename;
+    }
+
+    /** Line number of the start of the current event.  Counts the
+        preceding lines, so it is intended for error reporting. */
+    int line() const;
+};
+
+} // namespace G3D
+
+#endif
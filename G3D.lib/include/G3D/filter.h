@@ -3,9 +3,9 @@
 
   @author Morgan McGuire, http://graphics.cs.williams.edu
   @created 2007-03-01
-  @edited  2007-03-01
+  @edited  2010-06-22
 
-  Copyright 2000-2007, Morgan McGuire.
+  Copyright 2000-2010, Morgan McGuire.
   All rights reserved.
  */
 #ifndef G3D_FILTER_H
@@ -14,6 +14,9 @@
 #include "G3D/platform.h"
 #include "G3D/Array.h"
 #include "G3D/g3dmath.h"
+#include "G3D/enumclass.h"
+#include "G3D/WrapMode.h"
+#include "G3D/TaskScheduler.h"
 
 namespace G3D {
 /**
@@ -24,6 +27,119 @@ namespace G3D {
  Matches the results returned by Matlab <code>fspecial('gaussian', [1, N], std)</code>
  */ 
 void gaussian1D(Array<float>& coeff, int N = 5, float std = 0.5f);
+
+
+/**
+ \brief Reconstruction filter for G3D::Map2D::resample.
+
+ BOX averages the source pixels that each destination pixel covers and
+ is the usual choice for mip maps.  TENT is bilinear interpolation.
+ LANCZOS3 is the sharpest but rings around hard edges.  MITCHELL
+ (B = C = 1/3) balances blurring against ringing.
+
+ When minifying, the filter is stretched by the scale factor so that
+ every source pixel contributes.
+ */
+class ResampleFilter {
+public:
+    /** Don't use this enum; use ResampleFilter instances instead. */
+    enum Value {
+        BOX,
+        TENT,
+        LANCZOS3,
+        MITCHELL
+    };
+
+private:
+
+    static const char* toString(int i, Value& v) {
+        static const char* str[] = {"BOX", "TENT", "LANCZOS3", "MITCHELL", NULL}; 
+        static const Value val[] = {BOX, TENT, LANCZOS3, MITCHELL};
+        const char* s = str[i];
+        if (s) {
+            v = val[i];
+        }
+        return s;
+    }
+
+    Value value;
+
+public:
+
+    G3D_DECLARE_ENUM_CLASS_METHODS(ResampleFilter);
+
+    /** Half-width of the filter at unit scale, in pixels */
+    float support() const;
+
+    /** Filter value at \a offset pixels from the center, at unit scale */
+    float evaluate(float offset) const;
+};
+
+
+/**
+ \brief Precomputed weights for resampling one axis of an image from
+ srcSize to dstSize samples with a ResampleFilter.
+
+ Every destination sample has the same number of taps; unused taps
+ have zero weight.  Source indices are already resolved for the wrap
+ mode, so they are always in [0, srcSize).  Pixel centers are aligned:
+ destination sample i is centered on source position (i + 0.5) * srcSize / dstSize - 0.5.
+
+ \sa G3D::Map2D::resample
+ */
+class ResampleWeights {
+public:
+
+    int             srcSize;
+    int             dstSize;
+
+    /** Taps per destination sample */
+    int             taps;
+
+    /** dstSize * taps source indices */
+    Array<int>      index;
+
+    /** dstSize * taps weights */
+    Array<float>    weight;
+
+    ResampleWeights() : srcSize(0), dstSize(0), taps(0) {}
+
+    /** Out-of-range source samples wrap under WrapMode::TILE, contribute nothing
+        under WrapMode::ZERO, and are clamped to the edge otherwise.  Resampling
+        to the same size copies. */
+    ResampleWeights(int srcSize, int dstSize, ResampleFilter filter, WrapMode wrap);
+};
+
+
+namespace _internal {
+
+/** Work per task for the resampling passes, in multiply-adds */
+enum {RESAMPLE_GRAIN_WORK = 32 * 1024};
+
+/** Runs body over rows [0, numRows), spread across TaskScheduler::global() if \a parallel is true */
+template<class Body>
+void resampleRows(const Body& body, int numRows, int workPerRow, bool parallel) {
+    if (parallel && (numRows > 1) && (TaskScheduler::global()->numWorkers() > 0)) {
+        TaskScheduler::global()->parallelFor(0, numRows, iMax(1, RESAMPLE_GRAIN_WORK / iMax(workPerRow, 1)), body);
+    } else {
+        body(0, numRows);
+    }
+}
+
+/** Resamples an image of horizontal.srcSize x vertical.srcSize pixels, each
+    made of \a channels packed floats, to horizontal.dstSize x vertical.dstSize
+    pixels.  Used by Map2D::resample for float-based storage.  Uses SSE when
+    the processor supports it. */
+void resampleFloat
+(const float*           src,
+ int                    channels,
+ const ResampleWeights& horizontal,
+ const ResampleWeights& vertical,
+ float*                 dst,
+ bool                   parallel);
+
+} // _internal
+
 }
 
 #endif
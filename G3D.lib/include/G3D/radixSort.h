@@ -0,0 +1,38 @@
+/**
+  @file G3D/radixSort.h
+
+  Parallel least-significant-digit radix sort of integer keys.
+
+  @sa G3D::MortonGrid, G3D::MeshAlg::computeAdjacency
+ */
+#ifndef G3D_radixSort_h
+#define G3D_radixSort_h
+
+#include "G3D/platform.h"
+#include "G3D/g3dmath.h"
+#include "G3D/Array.h"
+
+namespace G3D {
+
+/**
+ Sorts the parallel arrays \a key and \a value in place by increasing
+ key.  The sort is stable, so elements with equal keys keep their
+ relative order; filling \a value with 0, 1, 2, ... therefore yields
+ the sorting permutation with ties broken by index.
+
+ Only the low \a numBits of each key are compared and the higher bits
+ must be zero.  The sort makes one counting pass per 11 bits, so
+ packing keys into as few bits as possible (for example, two vertex
+ indices of a mesh with n vertices into 2 * (highestBit(n) + 1) bits)
+ makes it proportionally faster.  Passes over digits on which all
+ keys agree are skipped.
+
+ Each pass is split into blocks that are counted and scattered on
+ TaskScheduler::global() when \a useThreads is true.  Uses
+ O(key.size()) temporary memory.
+ */
+void radixSort(Array<uint64>& key, Array<int>& value, int numBits = 64, bool useThreads = true);
+
+} // namespace G3D
+
+#endif
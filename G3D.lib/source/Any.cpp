@@ -766,11 +766,24 @@ void Any::parse(const std::string& src) {
 
 void Any::load(const std::string& filename) {
     beforeRead();
+    const std::string& path = FileSystem::resolve(filename);
+    const std::string& compiled = compiledFilename(path);
+    if (FileSystem::exists(compiled) && 
+        (FileSystem::modificationTime(compiled) >= FileSystem::modificationTime(path)) &&
+        loadCompiled(compiled)) {
+        return;
+    }
+
     TextInput::Settings settings;
     getDeserializeSettings(settings);
 
-    TextInput ti(FileSystem::resolve(filename), settings);
+    TextInput ti(path, settings);
     deserialize(ti);
+
+    std::string zipfile;
+    if (compileOnLoad() && ! FileSystem::inZipfile(path, zipfile)) {
+        saveCompiled(compiled);
+    }
 }
 
 
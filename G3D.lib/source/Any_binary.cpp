@@ -0,0 +1,436 @@
+/**
+ @file Any_binary.cpp
+
+ Compiled (binary) Any files.
+
+ A compiled Any is little-endian and laid out as:
+
+ <pre>
+   "G3DANYB\0"
+   uint32  version
+   uint32  number of dependencies
+           { uint32 length, chars, int64 modification time, int64 size }
+           per dependency
+   uint32  number of strings
+           { uint32 length, chars } per string
+   uint32  offset of the root node
+   uint32  length of the node section
+           nodes
+ </pre>
+
+ Each node is a uint8 Type, a uint8 set of flags, the optional
+ name, comment, and source fields selected by the flags (as string
+ indices and, for the source, the line and character), and then the
+ value: uint8 for BOOLEAN, float64 for NUMBER, a string index for
+ STRING, a uint32 count and that many child offsets for ARRAY, and a
+ uint32 count and that many (key string index, child offset) pairs for
+ TABLE.  Offsets are relative to the start of the node section.
+ Children are written before their parents, so every child offset is
+ less than its parent's offset.
+ */
+
+#include "G3D/Any.h"
+#include "G3D/BinaryInput.h"
+#include "G3D/BinaryOutput.h"
+#include "G3D/FileSystem.h"
+#include "G3D/Set.h"
+
+namespace G3D {
+
+static const char   COMPILED_MAGIC[8]   = {'G', '3', 'D', 'A', 'N', 'Y', 'B', '\0'};
+static const uint32 COMPILED_VERSION    = 2;
+
+enum {HAS_NAME = 1, HAS_COMMENT = 2, HAS_SOURCE = 4};
+
+static bool s_compileOnLoad = false;
+
+/** Strips the " [included from ...]" suffix that #include adds to a source filename */
+static std::string sourceFile(const std::string& filename) {
+    const size_t i = filename.find(" [included from ");
+    if (i == std::string::npos) {
+        return filename;
+    } else {
+        return filename.substr(0, i);
+    }
+}
+
+
+static void writeBytes32(BinaryOutput& b, const std::string& s) {
+    b.writeUInt32((uint32)s.size());
+    if (! s.empty()) {
+        b.writeBytes(s.data(), (int)s.size());
+    }
+}
+
+
+class Any::BinaryWriter {
+public:
+    Table<std::string, uint32>  stringIndex;
+    Array<std::string>          stringArray;
+
+    /** Files that contributed values */
+    Set<std::string>            dependencies;
+
+    BinaryOutput                nodes;
+
+    BinaryWriter() {
+        nodes.setEndian(G3D_LITTLE_ENDIAN);
+    }
+
+    uint32 intern(const std::string& s) {
+        const uint32* i = stringIndex.getPointer(s);
+        if (i != NULL) {
+            return *i;
+        }
+
+        const uint32 index = (uint32)stringArray.size();
+        stringIndex.set(s, index);
+        stringArray.append(s);
+        return index;
+    }
+
+    /** Writes the children of \a a and then \a a, returning the offset of \a a */
+    uint32 write(const Any& a) {
+        a.beforeRead();
+
+        Array<uint32> keyIndex;
+        Array<uint32> childOffset;
+        if (a.m_type == ARRAY) {
+            const Array<Any>& array = *(a.m_data->value.a);
+            childOffset.resize(array.size());
+            for (int i = 0; i < array.size(); ++i) {
+                childOffset[i] = write(array[i]);
+            }
+        } else if (a.m_type == TABLE) {
+            // Sorted so that compiling the same data always produces the same file
+            const AnyTable& table = *(a.m_data->value.t);
+            Array<std::string> keys;
+            table.getKeys(keys);
+            keys.sort();
+            for (int i = 0; i < keys.size(); ++i) {
+                const Any& value = table[keys[i]];
+                if (! value.isPlaceholder()) {
+                    keyIndex.append(intern(keys[i]));
+                    childOffset.append(write(value));
+                }
+            }
+        }
+
+        const uint32 offset = (uint32)nodes.position();
+        const Data* d = a.m_data;
+
+        uint8 flags = 0;
+        if (d != NULL) {
+            if (! d->name.empty()) {
+                flags |= HAS_NAME;
+            }
+            if (! d->comment.empty()) {
+                flags |= HAS_COMMENT;
+            }
+            if (! d->source.filename.empty() || (d->source.line != 0)) {
+                flags |= HAS_SOURCE;
+            }
+        }
+
+        nodes.writeUInt8((uint8)a.m_type);
+        nodes.writeUInt8(flags);
+        if (flags & HAS_NAME) {
+            nodes.writeUInt32(intern(d->name));
+        }
+        if (flags & HAS_COMMENT) {
+            nodes.writeUInt32(intern(d->comment));
+        }
+        if (flags & HAS_SOURCE) {
+            nodes.writeUInt32(intern(d->source.filename));
+            nodes.writeInt32(d->source.line);
+            nodes.writeInt32(d->source.character);
+
+            const std::string& file = sourceFile(d->source.filename);
+            if (! file.empty()) {
+                dependencies.insert(file);
+            }
+        }
+
+        switch (a.m_type) {
+        case NONE:
+            break;
+
+        case BOOLEAN:
+            nodes.writeUInt8(a.m_simpleValue.b ? 1 : 0);
+            break;
+
+        case NUMBER:
+            nodes.writeFloat64(a.m_simpleValue.n);
+            break;
+
+        case STRING:
+            nodes.writeUInt32(intern(*(d->value.s)));
+            break;
+
+        case ARRAY:
+            nodes.writeUInt32(childOffset.size());
+            for (int i = 0; i < childOffset.size(); ++i) {
+                nodes.writeUInt32(childOffset[i]);
+            }
+            break;
+
+        case TABLE:
+            nodes.writeUInt32(childOffset.size());
+            for (int i = 0; i < childOffset.size(); ++i) {
+                nodes.writeUInt32(keyIndex[i]);
+                nodes.writeUInt32(childOffset[i]);
+            }
+            break;
+        }
+
+        return offset;
+    }
+};
+
+
+class Any::BinaryReader {
+public:
+    BinaryInput&            input;
+    const uint8*            data;
+
+    Array<std::string>      stringArray;
+
+    int64                   nodeStart;
+    int64                   nodeLength;
+
+    BinaryReader(BinaryInput& input) : input(input), data(input.getCArray()), nodeStart(0), nodeLength(0) {}
+
+    /** Throws if fewer than \a n bytes remain */
+    void require(int64 n) const {
+        if ((n < 0) || (input.getPosition() + n > input.size())) {
+            throw std::string("Truncated compiled Any");
+        }
+    }
+
+    uint32 readUInt32() {
+        require(4);
+        return input.readUInt32();
+    }
+
+    int32 readInt32() {
+        require(4);
+        return input.readInt32();
+    }
+
+    std::string readBytes32() {
+        const uint32 n = readUInt32();
+        require(n);
+        const int64 p = input.getPosition();
+        input.skip(n);
+        return std::string((const char*)data + p, n);
+    }
+
+    const std::string& readStringIndex() {
+        const uint32 i = readUInt32();
+        if (i >= (uint32)stringArray.size()) {
+            throw std::string("Corrupt string index in compiled Any");
+        }
+        return stringArray[i];
+    }
+
+    /** Reads the node at \a offset into \a a, which must be NONE.
+        \a limit is the offset of the parent node. */
+    void read(uint32 offset, uint32 limit, Any& a) {
+        if (offset >= limit) {
+            throw std::string("Corrupt node offset in compiled Any");
+        }
+        input.setPosition(nodeStart + offset);
+
+        require(2);
+        const uint8 type  = input.readUInt8();
+        const uint8 flags = input.readUInt8();
+        if (type > TABLE) {
+            throw std::string("Corrupt node type in compiled Any");
+        }
+
+        a.m_type = (Type)type;
+        Data* d = NULL;
+        if ((type == STRING) || (type == ARRAY) || (type == TABLE) || (flags != 0)) {
+            a.ensureData();
+            d = a.m_data;
+        }
+
+        if (flags & HAS_NAME) {
+            d->name = readStringIndex();
+        }
+        if (flags & HAS_COMMENT) {
+            d->comment = readStringIndex();
+        }
+        if (flags & HAS_SOURCE) {
+            d->source.filename  = readStringIndex();
+            d->source.line      = readInt32();
+            d->source.character = readInt32();
+        }
+
+        switch (a.m_type) {
+        case NONE:
+            break;
+
+        case BOOLEAN:
+            require(1);
+            a.m_simpleValue.b = (input.readUInt8() != 0);
+            break;
+
+        case NUMBER:
+            require(8);
+            a.m_simpleValue.n = input.readFloat64();
+            break;
+
+        case STRING:
+            *(d->value.s) = readStringIndex();
+            break;
+
+        case ARRAY: {
+            const uint32 n = readUInt32();
+            require((int64)n * 4);
+            const int64 childTable = input.getPosition();
+            Array<Any>& array = *(d->value.a);
+            array.resize(n);
+            for (uint32 i = 0; i < n; ++i) {
+                input.setPosition(childTable + i * 4);
+                read(input.readUInt32(), offset, array[i]);
+            }
+            break;
+        }
+
+        case TABLE: {
+            const uint32 n = readUInt32();
+            require((int64)n * 8);
+            const int64 childTable = input.getPosition();
+            AnyTable& table = *(d->value.t);
+            for (uint32 i = 0; i < n; ++i) {
+                input.setPosition(childTable + i * 8);
+                const std::string& key = readStringIndex();
+                const uint32 childOffset = input.readUInt32();
+                read(childOffset, offset, table.getCreate(key));
+            }
+            break;
+        }
+        }
+    }
+};
+
+
+std::string Any::compiledFilename(const std::string& sourceFilename) {
+    if (toLower(FilePath::ext(sourceFilename)) == "any") {
+        return sourceFilename + "b";
+    } else {
+        return sourceFilename + ".anyb";
+    }
+}
+
+
+void Any::setCompileOnLoad(bool b) {
+    s_compileOnLoad = b;
+}
+
+
+bool Any::compileOnLoad() {
+    return s_compileOnLoad;
+}
+
+
+void Any::saveCompiled(const std::string& filename) const {
+    beforeRead();
+
+    BinaryWriter writer;
+    const uint32 root = writer.write(*this);
+
+    BinaryOutput b(filename, G3D_LITTLE_ENDIAN);
+    b.writeBytes(COMPILED_MAGIC, sizeof(COMPILED_MAGIC));
+    b.writeUInt32(COMPILED_VERSION);
+
+    // Values parsed from strings have sources that are not files
+    Array<std::string> dependencies;
+    Array<int64> modificationTime;
+    Array<int64> fileSize;
+    for (Set<std::string>::Iterator it = writer.dependencies.begin(); it != writer.dependencies.end(); ++it) {
+        const int64 t = FileSystem::modificationTime(*it);
+        if (t != -1) {
+            dependencies.append(*it);
+            modificationTime.append(t);
+            fileSize.append(FileSystem::size(*it));
+        }
+    }
+
+    b.writeUInt32(dependencies.size());
+    for (int i = 0; i < dependencies.size(); ++i) {
+        writeBytes32(b, dependencies[i]);
+        b.writeInt64(modificationTime[i]);
+        b.writeInt64(fileSize[i]);
+    }
+
+    b.writeUInt32(writer.stringArray.size());
+    for (int i = 0; i < writer.stringArray.size(); ++i) {
+        writeBytes32(b, writer.stringArray[i]);
+    }
+
+    b.writeUInt32(root);
+    b.writeUInt32((uint32)writer.nodes.size());
+    b.writeBytes(writer.nodes.getCArray(), writer.nodes.size());
+    b.commit();
+}
+
+
+bool Any::loadCompiled(const std::string& filename, bool checkDependencies) {
+    beforeRead();
+
+    BinaryInput b(filename, G3D_LITTLE_ENDIAN, false, true);
+    if ((b.size() < (int64)sizeof(COMPILED_MAGIC) + 4) ||
+        (memcmp(b.getCArray(), COMPILED_MAGIC, sizeof(COMPILED_MAGIC)) != 0)) {
+        return false;
+    }
+    b.skip(sizeof(COMPILED_MAGIC));
+
+    Any result;
+    try {
+        BinaryReader reader(b);
+        if (reader.readUInt32() != COMPILED_VERSION) {
+            return false;
+        }
+
+        const uint32 numDependencies = reader.readUInt32();
+        for (uint32 i = 0; i < numDependencies; ++i) {
+            const std::string& dependency = reader.readBytes32();
+            reader.require(16);
+            const int64 modificationTime = b.readInt64();
+            const int64 fileSize = b.readInt64();
+            // Modification times have a resolution of one second on
+            // many filesystems, so an edit made within a second of
+            // compiling is only caught by the size
+            if (checkDependencies && 
+                ((FileSystem::modificationTime(dependency) != modificationTime) ||
+                 (FileSystem::size(dependency) != fileSize))) {
+                return false;
+            }
+        }
+
+        const uint32 numStrings = reader.readUInt32();
+        // Each string occupies at least four bytes
+        reader.require((int64)numStrings * 4);
+        reader.stringArray.resize(numStrings);
+        for (uint32 i = 0; i < numStrings; ++i) {
+            reader.stringArray[i] = reader.readBytes32();
+        }
+
+        const uint32 root   = reader.readUInt32();
+        reader.nodeLength   = reader.readUInt32();
+        reader.nodeStart    = b.getPosition();
+        reader.require(reader.nodeLength);
+
+        reader.read(root, (uint32)reader.nodeLength, result);
+    } catch (const std::string&) {
+        // Corrupt; the caller falls back to the text file
+        return false;
+    }
+
+    *this = result;
+    return true;
+}
+
+}    // namespace G3D
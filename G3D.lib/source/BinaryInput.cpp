@@ -41,6 +41,11 @@
 #include <zlib.h>
 #include "zip.h"
 #include <cstring>
+#ifndef G3D_WIN32
+#   include <sys/mman.h>
+#   include <fcntl.h>
+#   include <unistd.h>
+#endif
 
 namespace G3D {
 
@@ -128,7 +133,240 @@ IMPLEMENT_READER(Float64, float64)
 
 #undef IMPLEMENT_READER
 
+static uint32 readLittleEndian32(const uint8* p) {
+    return (uint32)p[0] | ((uint32)p[1] << 8) | ((uint32)p[2] << 16) | ((uint32)p[3] << 24);
+}
+
+
+static uint64 readLittleEndian64(const uint8* p) {
+    return (uint64)readLittleEndian32(p) | ((uint64)readLittleEndian32(p + 4) << 32);
+}
+
+
+static bool isCompressedBlocks(const uint8* data, int64 dataLen) {
+    return (dataLen >= _internal::CompressedBlockFormat::HEADER_SIZE) && 
+        (readLittleEndian32(data) == (uint32)_internal::CompressedBlockFormat::MAGIC);
+}
+
+
+static int seekFile(FILE* file, int64 offset) {
+#   ifdef G3D_WIN32
+        return _fseeki64(file, offset, SEEK_SET);
+#   else
+        return fseeko(file, (off_t)offset, SEEK_SET);
+#   endif
+}
+
+
+bool BinaryInput::openCompressedBlocks(FILE* file) {
+    typedef _internal::CompressedBlockFormat Format;
+
+    uint8 header[Format::HEADER_SIZE];
+    if ((fread(header, 1, Format::HEADER_SIZE, file) != Format::HEADER_SIZE) ||
+        ! isCompressedBlocks(header, Format::HEADER_SIZE)) {
+        return false;
+    }
+    if (readLittleEndian32(header + 4) != Format::VERSION) {
+        throw format("Unsupported compressed block version in \"%s\"", m_filename.c_str());
+    }
+    const std::string corrupt = format("Corrupt compressed block index in \"%s\"", m_filename.c_str());
+
+    m_blockSize = readLittleEndian32(header + 8);
+    if (m_blockSize <= 0) {
+        throw corrupt;
+    }
+    const uint32 flags = readLittleEndian32(header + 12);
+    const int64 fileLength = m_length;
+    m_blockOffset.fastClear();
+    m_length = 0;
+
+    if (flags & Format::FLAG_BLOCK_INDEX) {
+        // Read the index from the end of the file
+        uint8 trailer[16];
+        if ((fileLength < Format::HEADER_SIZE + 16) ||
+            (seekFile(file, fileLength - 16) != 0) ||
+            (fread(trailer, 1, 16, file) != 16) ||
+            (readLittleEndian32(trailer + 12) != (uint32)Format::INDEX_MAGIC)) {
+            throw corrupt;
+        }
+
+        // Validate the counts before allocating or seeking with them
+        const int64 numBlocks = readLittleEndian32(trailer + 8);
+        const int64 indexStart = fileLength - 16 - 8 * numBlocks;
+        m_length = (int64)readLittleEndian64(trailer);
+        if ((numBlocks > (fileLength - Format::HEADER_SIZE - 16) / 8) ||
+            (m_length < 0) || (m_length > numBlocks * m_blockSize) ||
+            ((numBlocks > 0) && (m_length <= (numBlocks - 1) * m_blockSize))) {
+            throw corrupt;
+        }
+
+        Array<uint8> index;
+        index.resize((int)(numBlocks * 8));
+        if ((index.size() > 0) && 
+            ((seekFile(file, indexStart) != 0) ||
+             (fread(index.getCArray(), 1, index.size(), file) != (size_t)index.size()))) {
+            throw corrupt;
+        }
+
+        // Offsets increase, and each block header lies before the index
+        m_blockOffset.resize((int)numBlocks);
+        int64 previous = Format::HEADER_SIZE - Format::BLOCK_HEADER_SIZE;
+        for (int b = 0; b < numBlocks; ++b) {
+            const int64 offset = (int64)readLittleEndian64(index.getCArray() + 8 * b);
+            if ((offset < previous + Format::BLOCK_HEADER_SIZE) || 
+                (offset > indexStart - Format::BLOCK_HEADER_SIZE)) {
+                m_blockOffset.fastClear();
+                throw corrupt;
+            }
+            m_blockOffset[b] = offset;
+            previous = offset;
+        }
+    } else {
+        // Walk the block headers
+        int64 offset = Format::HEADER_SIZE;
+        while (offset < fileLength) {
+            uint8 blockHeader[Format::BLOCK_HEADER_SIZE];
+            if ((offset + Format::BLOCK_HEADER_SIZE > fileLength) ||
+                (seekFile(file, offset) != 0) ||
+                (fread(blockHeader, 1, Format::BLOCK_HEADER_SIZE, file) != Format::BLOCK_HEADER_SIZE) ||
+                ((int64)readLittleEndian32(blockHeader) > fileLength - offset - Format::BLOCK_HEADER_SIZE) ||
+                ((int64)readLittleEndian32(blockHeader + 4) > m_blockSize)) {
+                const int b = m_blockOffset.size();
+                m_blockOffset.fastClear();
+                throw format("Corrupt compressed block %d in \"%s\"", b, m_filename.c_str());
+            }
+
+            m_blockOffset.append(offset);
+            m_length += readLittleEndian32(blockHeader + 4);
+            offset += Format::BLOCK_HEADER_SIZE + readLittleEndian32(blockHeader);
+        }
+    }
+
+    m_buffer              = NULL;
+    m_bufferLength        = 0;
+    m_blockBufferCapacity = 0;
+    m_alreadyRead         = 0;
+    m_pos                 = 0;
+    m_freeBuffer          = true;
+    return true;
+}
+
+
+void BinaryInput::loadBlocks(int64 startPosition, int64 minLength) {
+    typedef _internal::CompressedBlockFormat Format;
+
+    const int64 absPos = m_alreadyRead + m_pos;
+    const int first = (int)(startPosition / m_blockSize);
+    const int last  = iMin(m_blockOffset.size() - 1, 
+                           (int)((startPosition + G3D::max(minLength, (int64)1) - 1) / m_blockSize));
+    debugAssertM(first <= last, "Read past end of file.");
+
+    const int64 capacity = (last - first + 1) * m_blockSize;
+    if (capacity > m_blockBufferCapacity) {
+        System::alignedFree(m_buffer);
+        m_buffer = (uint8*)System::alignedMalloc((size_t)capacity, 16);
+        if (m_buffer == NULL) {
+            throw "Tried to read a larger memory chunk than could fit in memory. (3)";
+        }
+        m_blockBufferCapacity = capacity;
+    }
+
+    // Every block but the last decompresses to exactly m_blockSize bytes
+    const unsigned long maxCompressedLength = compressBound((unsigned long)m_blockSize);
+    Array<uint8> compressed;
+    m_bufferLength = 0;
+    for (int b = first; b <= last; ++b) {
+        uint8 blockHeader[Format::BLOCK_HEADER_SIZE];
+        bool ok = (seekFile(m_blockFile, m_blockOffset[b]) == 0) &&
+            (fread(blockHeader, 1, Format::BLOCK_HEADER_SIZE, m_blockFile) == Format::BLOCK_HEADER_SIZE);
+
+        const uint32 compressedLength = ok ? readLittleEndian32(blockHeader) : 0;
+        const uint32 length = ok ? readLittleEndian32(blockHeader + 4) : 0;
+        const bool isLastBlock = (b == m_blockOffset.size() - 1);
+        ok = ok && (compressedLength <= maxCompressedLength) && 
+            (isLastBlock ? (length <= m_blockSize) : (length == m_blockSize));
+
+        if (ok) {
+            compressed.resize(compressedLength, false);
+            ok = (fread(compressed.getCArray(), 1, compressedLength, m_blockFile) == compressedLength);
+        }
+
+        unsigned long L = length;
+        ok = ok && (uncompress(m_buffer + m_bufferLength, &L, compressed.getCArray(), compressedLength) == Z_OK) &&
+            (L == length);
+
+        if (! ok) {
+            m_bufferLength = 0;
+            throw format("Corrupt compressed block %d in \"%s\"", b, m_filename.c_str());
+        }
+        m_bufferLength += L;
+    }
+
+    m_alreadyRead = first * m_blockSize;
+    m_pos = absPos - m_alreadyRead;
+}
+
+
+void BinaryInput::decompressBlocks(const uint8* data, int64 dataLen) {
+    typedef _internal::CompressedBlockFormat Format;
+    const std::string corrupt = format("Corrupt compressed blocks in \"%s\"", m_filename.c_str());
+
+    // Validate the block headers and sum the block lengths before allocating
+    const uint32 blockSize = readLittleEndian32(data + 8);
+    int64 end = dataLen;
+    if ((readLittleEndian32(data + 12) & Format::FLAG_BLOCK_INDEX) != 0) {
+        if (dataLen < Format::HEADER_SIZE + 16) {
+            throw corrupt;
+        }
+        end = dataLen - 16 - 8 * (int64)readLittleEndian32(data + dataLen - 8);
+        if (end < Format::HEADER_SIZE) {
+            throw corrupt;
+        }
+    }
+
+    int64 total = 0;
+    int64 offset = Format::HEADER_SIZE;
+    while (offset < end) {
+        if ((offset + Format::BLOCK_HEADER_SIZE > end) || 
+            ((int64)readLittleEndian32(data + offset) > end - offset - Format::BLOCK_HEADER_SIZE) ||
+            (readLittleEndian32(data + offset + 4) > blockSize)) {
+            throw corrupt;
+        }
+        total  += readLittleEndian32(data + offset + 4);
+        offset += Format::BLOCK_HEADER_SIZE + readLittleEndian32(data + offset);
+    }
+
+    m_buffer = (uint8*)System::alignedMalloc((size_t)G3D::max(total, (int64)1), 16);
+    if (m_buffer == NULL) {
+        throw "Not enough memory to load compressed file. (3)";
+    }
+    m_length = 0;
+    offset = Format::HEADER_SIZE;
+    while (offset < end) {
+        const uint32 length = readLittleEndian32(data + offset + 4);
+        unsigned long L = length;
+        int result = uncompress(m_buffer + m_length, &L, 
+                                data + offset + Format::BLOCK_HEADER_SIZE, readLittleEndian32(data + offset));
+        if ((result != Z_OK) || (L != length)) {
+            System::alignedFree(m_buffer);
+            m_buffer = NULL;
+            m_length = 0;
+            throw corrupt;
+        }
+        m_length += L;
+        offset += Format::BLOCK_HEADER_SIZE + readLittleEndian32(data + offset);
+    }
+    m_bufferLength = m_length;
+    m_freeBuffer   = true;
+}
+
+
 void BinaryInput::loadIntoMemory(int64 startPosition, int64 minLength) {
+    if (m_blockOffset.size() > 0) {
+        loadBlocks(startPosition, minLength);
+        return;
+    }
+
     // Load the next section of the file
     debugAssertM(m_filename != "<memory>", "Read past end of file.");
 
@@ -177,6 +415,68 @@ void BinaryInput::loadIntoMemory(int64 startPosition, int64 minLength) {
 
 
 
+/** Maps \a length bytes of a file read-only.  Returns NULL on failure. */
+static uint8* mapFile(const std::string& filename, int64 length) {
+    if ((length <= 0) || ((uint64)length > (uint64)(size_t)-1)) {
+        // Empty, or too large for this process's address space
+        return NULL;
+    }
+
+#   ifdef G3D_WIN32
+        HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, 
+                                  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            return NULL;
+        }
+
+        HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        void* data = NULL;
+        if (mapping != NULL) {
+            data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, (SIZE_T)length);
+            // The view keeps the mapping alive
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+        return (uint8*)data;
+#   else
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd == -1) {
+            return NULL;
+        }
+        void* data = mmap(NULL, (size_t)length, PROT_READ, MAP_SHARED, fd, 0);
+        // The mapping keeps the file open
+        close(fd);
+        return (data == MAP_FAILED) ? NULL : (uint8*)data;
+#   endif
+}
+
+
+static void unmapFile(uint8* data, int64 length) {
+#   ifdef G3D_WIN32
+        (void)length;
+        UnmapViewOfFile(data);
+#   else
+        munmap(data, (size_t)length);
+#   endif
+}
+
+
+bool BinaryInput::mapIntoMemory() {
+    uint8* data = mapFile(m_filename, m_length);
+    if (data == NULL) {
+        return false;
+    }
+
+    m_buffer       = data;
+    m_bufferLength = m_length;
+    m_alreadyRead  = 0;
+    m_pos          = 0;
+    m_freeBuffer   = false;
+    m_memoryMapped = true;
+    return true;
+}
+
+
 const bool BinaryInput::NO_COPY = false;
     
 static bool needSwapBytes(G3DEndian fileEndian) {
@@ -217,13 +517,19 @@ BinaryInput::BinaryInput(
     m_beginEndBits(0),
     m_alreadyRead(0),
     m_bufferLength(0),
-    m_pos(0) {
+    m_pos(0),
+    m_memoryMapped(false),
+    m_blockSize(0),
+    m_blockBufferCapacity(0),
+    m_blockFile(NULL) {
 
     m_freeBuffer = copyMemory || compressed;
 
     setEndian(dataEndian);
 
-    if (compressed) {
+    if (compressed && isCompressedBlocks(data, dataLen)) {
+        decompressBlocks(data, dataLen);
+    } else if (compressed) {
         // Read the decompressed size from the first 4 bytes
         m_length = G3D::readUInt32(data, m_swapBytes);
 
@@ -255,7 +561,8 @@ BinaryInput::BinaryInput(
 BinaryInput::BinaryInput(
     const std::string&  filename,
     G3DEndian           fileEndian,
-    bool                compressed) :
+    bool                compressed,
+    bool                memoryMap) :
     m_filename(filename),
     m_bitPos(0),
     m_bitString(0),
@@ -265,7 +572,11 @@ BinaryInput::BinaryInput(
     m_bufferLength(0),
     m_buffer(NULL),
     m_pos(0),
-    m_freeBuffer(true) {
+    m_freeBuffer(true),
+    m_memoryMapped(false),
+    m_blockSize(0),
+    m_blockBufferCapacity(0),
+    m_blockFile(NULL) {
 
     setEndian(fileEndian);
 
@@ -316,6 +627,32 @@ BinaryInput::BinaryInput(
         return;
     }
 
+    bool blocks = false;
+    if (compressed) {
+        try {
+            blocks = openCompressedBlocks(file);
+        } catch (...) {
+            fclose(file);
+            throw;
+        }
+    }
+    if (blocks) {
+        // loadBlocks reads from the file as needed
+        m_blockFile = file;
+        return;
+    }
+    fseek(file, 0, SEEK_SET);
+
+    if (memoryMap && mapIntoMemory()) {
+        fclose(file);
+        file = NULL;
+
+        if (compressed) {
+            decompress();
+        }
+        return;
+    }
+
     if (! compressed && (m_length > INITIAL_BUFFER_LENGTH)) {
         // Read only a subset of the file so we don't consume
         // all available memory.
@@ -361,27 +698,47 @@ void BinaryInput::decompress() {
     // a new buffer to use as the destination.
     
     int64 tempLength = m_length;
-    m_length = G3D::readUInt32(m_buffer, m_swapBytes);
+    uint8* tempBuffer = m_buffer;
+    debugAssert(m_memoryMapped || isValidHeapPointer(tempBuffer));
+
+    if (isCompressedBlocks(tempBuffer, tempLength)) {
+        try {
+            decompressBlocks(tempBuffer, tempLength);
+        } catch (...) {
+            if (m_memoryMapped) {
+                unmapFile(tempBuffer, tempLength);
+            } else {
+                System::alignedFree(tempBuffer);
+            }
+            throw;
+        }
+    } else {
+        m_length = G3D::readUInt32(m_buffer, m_swapBytes);
     
-    // The file couldn't have better than 500:1 compression
-    alwaysAssertM(m_length < m_bufferLength * 500, "Compressed file header is corrupted");
+        // The file couldn't have better than 500:1 compression
+        alwaysAssertM(m_length < m_bufferLength * 500, "Compressed file header is corrupted");
     
-    uint8* tempBuffer = m_buffer;
-    m_buffer = (uint8*)System::alignedMalloc(m_length, 16);
+        m_buffer = (uint8*)System::alignedMalloc(m_length, 16);
     
-    debugAssert(m_buffer);
-    debugAssert(isValidHeapPointer(tempBuffer));
-    debugAssert(isValidHeapPointer(m_buffer));
+        debugAssert(m_buffer);
+        debugAssert(isValidHeapPointer(m_buffer));
     
-    unsigned long L = m_length;
-    int64 result = uncompress(m_buffer, &L, tempBuffer + 4, tempLength - 4);
-    m_length = L;
-    m_bufferLength = m_length;
+        unsigned long L = m_length;
+        int64 result = uncompress(m_buffer, &L, tempBuffer + 4, tempLength - 4);
+        m_length = L;
+        m_bufferLength = m_length;
     
-    debugAssertM(result == Z_OK, "BinaryInput/zlib detected corruption in " + m_filename); 
-    (void)result;
+        debugAssertM(result == Z_OK, "BinaryInput/zlib detected corruption in " + m_filename); 
+        (void)result;
+    }
     
-    System::alignedFree(tempBuffer);
+    if (m_memoryMapped) {
+        unmapFile(tempBuffer, tempLength);
+        m_memoryMapped = false;
+        m_freeBuffer   = true;
+    } else {
+        System::alignedFree(tempBuffer);
+    }
 }
 
 
@@ -396,8 +753,15 @@ void BinaryInput::readBytes(void* bytes, int64 n) {
 
 BinaryInput::~BinaryInput() {
 
+    if (m_blockFile != NULL) {
+        fclose(m_blockFile);
+        m_blockFile = NULL;
+    }
+
     if (m_freeBuffer) {
         System::alignedFree(m_buffer);
+    } else if (m_memoryMapped) {
+        unmapFile(m_buffer, m_length);
     }
     m_buffer = NULL;
 }
@@ -16,12 +16,19 @@
 #include "G3D/Array.h"
 #include <zlib.h>
 #include "G3D/Log.h"
+#include "G3D/TaskScheduler.h"
+#include "G3D/AtomicInt32.h"
 #include <cstring>
 
 #ifdef G3D_LINUX
 #    include <errno.h>
 #endif
 
+#ifndef G3D_WIN32
+#    include <sys/uio.h>
+#    include <unistd.h>
+#endif
+
 // Largest memory buffer that the system will use for writing to
 // disk.  After this (or if the system runs out of memory)
 // chunks of the file will be dumped to disk.
@@ -29,8 +36,120 @@
 // Currently 400 MB
 #define MAX_BINARYOUTPUT_BUFFER_SIZE 400000000
 
+// Number of written blocks that chunked mode keeps for reuse
+#define MAX_BINARYOUTPUT_FREE_BLOCKS 8
+
+// Number of full blocks that chunked mode with a background flush
+// queues behind the block being written before it waits for the disk
+#define MAX_BINARYOUTPUT_PENDING_BLOCKS 4
+
 namespace G3D {
 
+namespace _internal {
+
+/** Appends the full blocks of a chunked BinaryOutput to its file,
+    optionally as a TaskScheduler task. */
+class BinaryOutputFlusher : public Task {
+public:
+
+    /** Opened by the BinaryOutput on the first flush */
+    FILE*                       file;
+
+    /** Blocks being written; owned by the task while it is running */
+    Array<BinaryOutputBlock>    block;
+
+    /** Non-zero once the task has written block */
+    AtomicInt32                 done;
+
+    /** True if the task has been submitted to group */
+    bool                        running;
+
+    bool                        ok;
+
+    TaskGroup                   group;
+
+    BinaryOutputFlusher(const TaskScheduler::Ref& scheduler) :
+        file(NULL), done(0), running(false), ok(true), group(scheduler) {}
+
+    /** Writes all of \a block to \a file with as few system calls as possible */
+    static bool scatterWrite(FILE* file, const Array<BinaryOutputBlock>& block) {
+#       ifdef G3D_WIN32
+            for (int b = 0; b < block.size(); ++b) {
+                if ((block[b].length > 0) && (fwrite(block[b].data, block[b].length, 1, file) != 1)) {
+                    return false;
+                }
+            }
+            return true;
+#       else
+            enum {MAX_IOV = 64};
+            struct iovec iov[MAX_IOV];
+            const int fd = fileno(file);
+
+            // Next block to write, and the number of its bytes already written
+            int b = 0;
+            size_t offset = 0;
+            while (b < block.size()) {
+                int n = 0;
+                for (int i = b; (i < block.size()) && (n < MAX_IOV); ++i, ++n) {
+                    const size_t skip = (i == b) ? offset : 0;
+                    iov[n].iov_base = block[i].data + skip;
+                    iov[n].iov_len  = block[i].length - skip;
+                }
+
+                const ssize_t count = ::writev(fd, iov, n);
+                if (count < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return false;
+                }
+
+                // writev may stop early; advance past the bytes written
+                size_t remaining = (size_t)count;
+                while ((b < block.size()) && (remaining >= block[b].length - offset)) {
+                    remaining -= block[b].length - offset;
+                    offset = 0;
+                    ++b;
+                }
+                offset += remaining;
+            }
+            return true;
+#       endif
+    }
+
+    virtual void run() {
+        ok = scatterWrite(file, block) && ok;
+        done.releaseSet(1);
+    }
+
+    /** True if a task is writing block */
+    bool busy() const {
+        return running && (done.acquireValue() == 0);
+    }
+
+    /** Waits for the task, if any */
+    void finish() {
+        if (running) {
+            group.wait();
+            running = false;
+        }
+    }
+
+    /** Writes block, on another thread if \a background */
+    void start(bool background) {
+        debugAssert(! running);
+        if (background) {
+            done = 0;
+            running = true;
+            group.run(this);
+        } else {
+            run();
+        }
+    }
+};
+
+} // namespace _internal
+
 void BinaryOutput::writeBool8(const std::vector<bool>& out, int n) {
     for (int i = 0; i < n; ++i) {
         writeBool8(out[i]);
@@ -110,13 +229,223 @@ IMPLEMENT_WRITER(Float64, float64)
 #undef IMPLEMENT_WRITER
 
 
+static void writeLittleEndian32(uint32 x, uint8* p) {
+    p[0] = (uint8)x;
+    p[1] = (uint8)(x >> 8);
+    p[2] = (uint8)(x >> 16);
+    p[3] = (uint8)(x >> 24);
+}
+
+
+static void writeLittleEndian64(uint64 x, uint8* p) {
+    writeLittleEndian32((uint32)x, p);
+    writeLittleEndian32((uint32)(x >> 32), p + 4);
+}
+
+
+void BinaryOutput::setStreamingCompression(int blockSize, bool writeBlockIndex) {
+    alwaysAssertM(m_filename != "<memory>", "Streaming compression requires a file");
+    alwaysAssertM((m_bufferLen == 0) && (m_alreadyWritten == 0), 
+                  "setStreamingCompression must be called before writing");
+    debugAssert(blockSize > 0);
+    m_compressedBlockSize = blockSize;
+    m_writeBlockIndex     = writeBlockIndex;
+}
+
+
+void BinaryOutput::setChunkedOutput(int blockSize, bool backgroundFlush, const TaskScheduler::Ref& scheduler) {
+    alwaysAssertM(m_filename != "<memory>", "Chunked output requires a file");
+    alwaysAssertM(m_compressedBlockSize == 0, "Chunked output cannot be combined with streaming compression");
+    alwaysAssertM((m_bufferLen == 0) && (m_alreadyWritten == 0) && (m_flusher == NULL), 
+                  "setChunkedOutput must be called before writing");
+    debugAssert(blockSize > 0);
+
+    m_blockSize       = blockSize;
+
+    // Without workers a background task would not run until commit(),
+    // so write each block as soon as it fills instead
+    m_backgroundFlush = backgroundFlush && (scheduler->numWorkers() > 0);
+    m_syncFlush       = backgroundFlush && ! m_backgroundFlush;
+    m_flusher         = new _internal::BinaryOutputFlusher(scheduler);
+
+    // Start with a full-size block so that the first one is not grown
+    System::free(m_buffer);
+    m_buffer = (uint8*)System::malloc(m_blockSize);
+    if (m_buffer == NULL) {
+        throw "Out of memory while writing to disk in BinaryOutput (could not create a large enough buffer).";
+    }
+    m_maxBufferLen = m_blockSize;
+}
+
+
+void BinaryOutput::retireBlock() {
+    _internal::BinaryOutputBlock& b = m_fullBlock.next();
+    b.data     = m_buffer;
+    b.length   = m_bufferLen;
+    b.capacity = m_maxBufferLen;
+
+    m_fullBlockBytes += m_bufferLen;
+    m_alreadyWritten += m_bufferLen;
+
+    m_buffer       = NULL;
+    m_bufferLen    = 0;
+    m_maxBufferLen = 0;
+    m_pos          = 0;
+}
+
+
+void BinaryOutput::flushBlocks(bool wait) {
+    _internal::BinaryOutputFlusher* f = m_flusher;
+    if (f->busy() && ! wait) {
+        return;
+    }
+    f->finish();
+    m_ok = m_ok && f->ok;
+
+    // Reuse the written blocks
+    for (int b = 0; b < f->block.size(); ++b) {
+        if ((f->block[b].capacity == m_blockSize) && (m_freeBlock.size() < MAX_BINARYOUTPUT_FREE_BLOCKS)) {
+            m_freeBlock.append(f->block[b].data);
+        } else {
+            System::free(f->block[b].data);
+        }
+    }
+    f->block.fastClear();
+
+    if (m_fullBlock.size() == 0) {
+        return;
+    }
+
+    if (f->file == NULL) {
+        f->file = FileSystem::fopen(m_filename.c_str(), "wb");
+        if (f->file == NULL) {
+            logPrintf("Error %d while trying to open \"%s\"\n", errno, m_filename.c_str());
+            m_ok = false;
+            throw "Could not write to file in BinaryOutput";
+        }
+    }
+
+    f->block.swap(m_fullBlock);
+    m_fullBlockBytes = 0;
+    f->start(m_backgroundFlush);
+}
+
+
+void BinaryOutput::releaseBlocks() {
+    for (int b = 0; b < m_freeBlock.size(); ++b) {
+        System::free(m_freeBlock[b]);
+    }
+    m_freeBlock.clear();
+
+    for (int b = 0; b < m_fullBlock.size(); ++b) {
+        System::free(m_fullBlock[b].data);
+    }
+    m_fullBlock.clear();
+    m_fullBlockBytes = 0;
+
+    if (m_flusher != NULL) {
+        for (int b = 0; b < m_flusher->block.size(); ++b) {
+            System::free(m_flusher->block[b].data);
+        }
+        m_flusher->block.clear();
+    }
+}
+
+
+void BinaryOutput::writeCompressedBlocks(int numBytes) {
+    typedef _internal::CompressedBlockFormat Format;
+    debugAssert(numBytes <= m_bufferLen);
+
+    if (m_compressedFile == NULL) {
+        debugAssert(m_compressedLength == 0);
+        m_compressedFile = FileSystem::fopen(m_filename.c_str(), "wb");
+        if (m_compressedFile == NULL) {
+            logPrintf("Error %d while trying to open \"%s\"\n", errno, m_filename.c_str());
+            m_ok = false;
+            throw "Could not write to file in BinaryOutput";
+        }
+    }
+    FILE* file = m_compressedFile;
+
+    if (m_compressedLength == 0) {
+        uint8 header[Format::HEADER_SIZE];
+        writeLittleEndian32(Format::MAGIC, header);
+        writeLittleEndian32(Format::VERSION, header + 4);
+        writeLittleEndian32(m_compressedBlockSize, header + 8);
+        writeLittleEndian32(m_writeBlockIndex ? Format::FLAG_BLOCK_INDEX : 0, header + 12);
+        fwrite(header, 1, Format::HEADER_SIZE, file);
+        m_compressedLength = Format::HEADER_SIZE;
+    }
+
+    Array<uint8> temp;
+    for (int start = 0; start < numBytes; start += m_compressedBlockSize) {
+        const int len = iMin(m_compressedBlockSize, numBytes - start);
+        unsigned long compressedLen = compressBound(len);
+        temp.resize(Format::BLOCK_HEADER_SIZE + compressedLen, false);
+
+        int result = compress2(temp.getCArray() + Format::BLOCK_HEADER_SIZE, &compressedLen, m_buffer + start, len, 9);
+        debugAssert(result == Z_OK); (void)result;
+
+        writeLittleEndian32(compressedLen, temp.getCArray());
+        writeLittleEndian32(len, temp.getCArray() + 4);
+        const size_t count = fwrite(temp.getCArray(), 1, Format::BLOCK_HEADER_SIZE + compressedLen, file);
+        m_ok = m_ok && (count == Format::BLOCK_HEADER_SIZE + compressedLen);
+
+        m_blockOffset.append(m_compressedLength);
+        m_compressedLength += Format::BLOCK_HEADER_SIZE + compressedLen;
+    }
+
+    // Shift the unwritten data back
+    m_alreadyWritten += numBytes;
+    m_bufferLen      -= numBytes;
+    m_pos            -= numBytes;
+    debugAssert(m_pos >= 0);
+    memmove(m_buffer, m_buffer + numBytes, m_bufferLen);
+}
+
+
 void BinaryOutput::reallocBuffer(size_t bytes, size_t oldBufferLen) {
     //debugPrintf("reallocBuffer(%d, %d)\n", bytes, oldBufferLen);
 
+    if ((m_compressedBlockSize > 0) && (m_pos >= m_compressedBlockSize)) {
+        // Compress the whole blocks before the write position 
+        // instead of growing the buffer
+        m_bufferLen = oldBufferLen;
+        writeCompressedBlocks((m_pos / m_compressedBlockSize) * m_compressedBlockSize);
+        reserveBytes(bytes);
+        return;
+    }
+
+    if ((m_blockSize > 0) && (m_pos > 0) && ((size_t)m_pos == oldBufferLen)) {
+        // Appending past the end of the block: start a new block
+        // instead of growing (and copying) this one
+        m_bufferLen = oldBufferLen;
+        retireBlock();
+
+        if (m_backgroundFlush) {
+            // Bound memory use if the disk cannot keep up
+            flushBlocks(m_fullBlockBytes >= (int64)MAX_BINARYOUTPUT_PENDING_BLOCKS * m_blockSize);
+        } else if (m_syncFlush || (m_fullBlockBytes >= MAX_BINARYOUTPUT_BUFFER_SIZE)) {
+            flushBlocks(true);
+        }
+
+        if (m_freeBlock.size() > 0) {
+            m_buffer = m_freeBlock.pop();
+        } else {
+            m_buffer = (uint8*)System::malloc(m_blockSize);
+            if (m_buffer == NULL) {
+                throw "Out of memory while writing to disk in BinaryOutput (could not create a large enough buffer).";
+            }
+        }
+        m_maxBufferLen = m_blockSize;
+        reserveBytes(bytes);
+        return;
+    }
+
     size_t newBufferLen = (int)(m_bufferLen * 1.5) + 100;
     uint8* newBuffer = NULL;
 
-    if ((m_filename == "<memory>") || (newBufferLen < MAX_BINARYOUTPUT_BUFFER_SIZE)) {
+    if ((m_filename == "<memory>") || (m_blockSize > 0) || (newBufferLen < MAX_BINARYOUTPUT_BUFFER_SIZE)) {
         // We're either writing to memory (in which case we *have* to try and allocate)
         // or we've been asked to allocate a reasonable size buffer.
 
@@ -207,6 +536,15 @@ BinaryOutput::BinaryOutput() {
     m_bitPos = 0;
     m_ok = true;
     m_committed = false;
+    m_compressedBlockSize = 0;
+    m_writeBlockIndex = false;
+    m_compressedLength = 0;
+    m_compressedFile = NULL;
+    m_blockSize = 0;
+    m_backgroundFlush = false;
+    m_syncFlush = false;
+    m_fullBlockBytes = 0;
+    m_flusher = NULL;
 }
 
 
@@ -225,6 +563,15 @@ BinaryOutput::BinaryOutput(
     m_bitString = 0;
     m_bitPos = 0;
     m_committed = false;
+    m_compressedBlockSize = 0;
+    m_writeBlockIndex = false;
+    m_compressedLength = 0;
+    m_compressedFile = NULL;
+    m_blockSize = 0;
+    m_backgroundFlush = false;
+    m_syncFlush = false;
+    m_fullBlockBytes = 0;
+    m_flusher = NULL;
 
     m_ok = true;    
     /** Verify ability to write to disk */
@@ -250,6 +597,23 @@ void BinaryOutput::reset() {
 
 
 BinaryOutput::~BinaryOutput() {
+    if (m_compressedFile != NULL) {
+        // Not committed
+        FileSystem::fclose(m_compressedFile);
+        m_compressedFile = NULL;
+    }
+
+    if (m_flusher != NULL) {
+        // Not committed
+        m_flusher->finish();
+        if (m_flusher->file != NULL) {
+            FileSystem::fclose(m_flusher->file);
+        }
+        releaseBlocks();
+        delete m_flusher;
+        m_flusher = NULL;
+    }
+
     debugAssert((m_buffer == NULL) || isValidHeapPointer(m_buffer));
     System::free(m_buffer);
     m_buffer = NULL;
@@ -270,6 +634,14 @@ bool BinaryOutput::ok() const {
 
 
 void BinaryOutput::compress() {
+    if (m_compressedBlockSize > 0) {
+        throw "Cannot compress a BinaryOutput that uses streaming compression.";
+    }
+
+    if (m_blockSize > 0) {
+        throw "Cannot compress a BinaryOutput that uses chunked output.";
+    }
+
     if (m_alreadyWritten > 0) {
         throw "Cannot compress huge files (part of this file has already been written to disk).";
     }
@@ -326,6 +698,55 @@ void BinaryOutput::commit(bool flush) {
         FileSystem::createDirectory(path);
     }
 
+    if (m_compressedBlockSize > 0) {
+        // Writes the header even if the file is empty
+        writeCompressedBlocks(m_bufferLen);
+
+        if (m_writeBlockIndex) {
+            typedef _internal::CompressedBlockFormat Format;
+            Array<uint8> index;
+            index.resize(m_blockOffset.size() * 8 + 16);
+            for (int b = 0; b < m_blockOffset.size(); ++b) {
+                writeLittleEndian64(m_blockOffset[b], index.getCArray() + 8 * b);
+            }
+            uint8* trailer = index.getCArray() + m_blockOffset.size() * 8;
+            writeLittleEndian64(m_alreadyWritten, trailer);
+            writeLittleEndian32(m_blockOffset.size(), trailer + 8);
+            writeLittleEndian32(Format::INDEX_MAGIC, trailer + 12);
+
+            m_ok = m_ok && (fwrite(index.getCArray(), index.size(), 1, m_compressedFile) == 1);
+        }
+
+        if (flush) {
+            fflush(m_compressedFile);
+        }
+        FileSystem::fclose(m_compressedFile);
+        m_compressedFile = NULL;
+        return;
+    }
+
+    if (m_flusher != NULL) {
+        // The partially filled block is written with the full ones
+        retireBlock();
+        flushBlocks(true);
+        m_flusher->finish();
+        m_ok = m_ok && m_flusher->ok;
+
+        // The file was created by the constructor, so it exists even if nothing was written
+        if (m_flusher->file != NULL) {
+            if (flush) {
+                fflush(m_flusher->file);
+            }
+            FileSystem::fclose(m_flusher->file);
+            m_flusher->file = NULL;
+        }
+
+        releaseBlocks();
+        delete m_flusher;
+        m_flusher = NULL;
+        return;
+    }
+
     const char* mode = (m_alreadyWritten > 0) ? "ab" : "wb";
 
     FILE* file = FileSystem::fopen(m_filename.c_str(), mode);
@@ -357,6 +778,7 @@ void BinaryOutput::commit(bool flush) {
 void BinaryOutput::commit(
     uint8*                  out) {
     debugAssertM(! m_committed, "Cannot commit twice");
+    debugAssertM(m_blockSize == 0, "Cannot commit chunked output to memory");
     m_committed = true;
 
     System::memcpy(out, m_buffer, m_bufferLen);
@@ -0,0 +1,609 @@
+/**
+ @file DynamicBVH.cpp
+
+ The hierarchy is built top-down by splitting the leaves at the median
+ centroid along the longest axis twice per level, which produces up to
+ four children per node.  Nodes are allocated after their parents, so
+ a backwards pass over m_node visits every child before its parent.
+ */
+
+#include "G3D/DynamicBVH.h"
+#include "G3D/System.h"
+#include <algorithm>
+
+#if defined(G3D_WIN32) || defined(__i386__) || defined(__x86_64__)
+#   define G3D_BVH_SIMD
+#   include <emmintrin.h>
+
+    // GCC only emits instructions beyond the compiler's target for functions that ask for them
+#   if defined(__GNUC__) && ! defined(__SSE2__)
+#       define G3D_TARGET_SSE2 __attribute__((target("sse2")))
+#   else
+#       define G3D_TARGET_SSE2
+#   endif
+#endif
+
+namespace G3D {
+
+/** Large enough to be outside any scene, small enough that plane dot products stay finite */
+static const float MAX_COORDINATE = 1e18f;
+
+static float clampCoordinate(float x) {
+    return (x < -MAX_COORDINATE) ? -MAX_COORDINATE : ((x > MAX_COORDINATE) ? MAX_COORDINATE : x);
+}
+
+
+static AABox clampBox(const AABox& box) {
+    const Vector3& lo = box.low();
+    const Vector3& hi = box.high();
+    return AABox(Vector3(clampCoordinate(lo.x), clampCoordinate(lo.y), clampCoordinate(lo.z)),
+                 Vector3(clampCoordinate(hi.x), clampCoordinate(hi.y), clampCoordinate(hi.z)));
+}
+
+
+/** Bit c of \a outside is set if child c is entirely in the negative
+    half space of the plane, and bit c of \a inside is set if it is
+    entirely in the positive half space. */
+static void planeMasks(const float lo[3][4], const float hi[3][4], const float* plane, int& outside, int& inside) {
+    outside = 0;
+    inside = 0;
+    for (int c = 0; c < 4; ++c) {
+        // The box corners farthest along and against the normal
+        float far = 0.0f, near = 0.0f;
+        for (int a = 0; a < 3; ++a) {
+            const float l = plane[a] * lo[a][c];
+            const float h = plane[a] * hi[a][c];
+            far  += max(l, h);
+            near += min(l, h);
+        }
+        if (far < plane[3]) {
+            outside |= 1 << c;
+        }
+        if (near >= plane[3]) {
+            inside |= 1 << c;
+        }
+    }
+}
+
+
+#ifdef G3D_BVH_SIMD
+G3D_TARGET_SSE2
+static void planeMasks_sse2(const float lo[3][4], const float hi[3][4], const float* plane, int& outside, int& inside) {
+    __m128 far  = _mm_setzero_ps();
+    __m128 near = _mm_setzero_ps();
+    for (int a = 0; a < 3; ++a) {
+        const __m128 n = _mm_set1_ps(plane[a]);
+        const __m128 l = _mm_mul_ps(n, _mm_loadu_ps(lo[a]));
+        const __m128 h = _mm_mul_ps(n, _mm_loadu_ps(hi[a]));
+        far  = _mm_add_ps(far,  _mm_max_ps(l, h));
+        near = _mm_add_ps(near, _mm_min_ps(l, h));
+    }
+    const __m128 d = _mm_set1_ps(plane[3]);
+    outside = _mm_movemask_ps(_mm_cmplt_ps(far, d));
+    inside  = _mm_movemask_ps(_mm_cmpge_ps(near, d));
+}
+#endif
+
+
+DynamicBVH::Node::Node() : parent(-1), parentSlot(-1), cachedPlane(0), inUse(true) {
+    for (int c = 0; c < 4; ++c) {
+        child[c] = EMPTY;
+        setChildBox(c, AABox(Vector3::zero()));
+    }
+}
+
+
+void DynamicBVH::Node::setChildBox(int slot, const AABox& box) {
+    for (int a = 0; a < 3; ++a) {
+        lo[a][slot] = box.low()[a];
+        hi[a][slot] = box.high()[a];
+    }
+}
+
+
+void DynamicBVH::Node::getChildBox(int slot, AABox& box) const {
+    box = AABox(Vector3(lo[0][slot], lo[1][slot], lo[2][slot]), Vector3(hi[0][slot], hi[1][slot], hi[2][slot]));
+}
+
+
+bool DynamicBVH::Node::getBounds(AABox& box) const {
+    bool any = false;
+    for (int c = 0; c < 4; ++c) {
+        if (child[c] != EMPTY) {
+            AABox b;
+            getChildBox(c, b);
+            if (any) {
+                box.merge(b);
+            } else {
+                box = b;
+                any = true;
+            }
+        }
+    }
+    return any;
+}
+
+
+DynamicBVH::DynamicBVH() : m_numLeaves(0), m_root(-1), m_numStructuralChanges(0) {}
+
+
+void DynamicBVH::clear() {
+    m_node.clear();
+    m_leaf.clear();
+    m_freeHandle.clear();
+    m_dirtyLeaf.clear();
+    m_buildHandle.clear();
+    m_center.clear();
+    m_numLeaves = 0;
+    m_root = -1;
+    m_numStructuralChanges = 0;
+}
+
+
+int DynamicBVH::insert(const AABox& box, int value) {
+    int h;
+    if (m_freeHandle.size() > 0) {
+        h = m_freeHandle.pop();
+    } else {
+        h = m_leaf.size();
+        m_leaf.next();
+    }
+
+    Leaf& leaf = m_leaf[h];
+    leaf.box   = clampBox(box);
+    leaf.value = value;
+    leaf.node  = -1;
+    leaf.slot  = -1;
+    leaf.inUse = true;
+    leaf.dirty = false;
+    ++m_numLeaves;
+
+    if (m_root != -1) {
+        insertIntoHierarchy(h);
+        ++m_numStructuralChanges;
+    }
+
+    return h;
+}
+
+
+void DynamicBVH::update(int handle, const AABox& box) {
+    debugAssert(handle >= 0 && handle < m_leaf.size() && m_leaf[handle].inUse);
+    Leaf& leaf = m_leaf[handle];
+
+    const AABox& b = clampBox(box);
+    if (b == leaf.box) {
+        return;
+    }
+    leaf.box = b;
+
+    if ((leaf.node != -1) && ! leaf.dirty) {
+        leaf.dirty = true;
+        m_dirtyLeaf.append(handle);
+    }
+}
+
+
+void DynamicBVH::remove(int handle) {
+    debugAssert(handle >= 0 && handle < m_leaf.size() && m_leaf[handle].inUse);
+    Leaf& leaf = m_leaf[handle];
+    leaf.inUse = false;
+    leaf.dirty = false;
+    m_freeHandle.append(handle);
+    --m_numLeaves;
+
+    if (m_numLeaves == 0) {
+        m_node.fastClear();
+        m_dirtyLeaf.fastClear();
+        m_root = -1;
+        m_numStructuralChanges = 0;
+        return;
+    }
+
+    if (leaf.node == -1) {
+        return;
+    }
+
+    // Remove the leaf and then any ancestors that it leaves empty
+    int n = leaf.node;
+    int slot = leaf.slot;
+    leaf.node = -1;
+    while (true) {
+        Node& node = m_node[n];
+        node.child[slot] = EMPTY;
+        node.setChildBox(slot, AABox(Vector3::zero()));
+        if (node.hasChildren() || (node.parent == -1)) {
+            break;
+        }
+        node.inUse = false;
+        slot = node.parentSlot;
+        n = node.parent;
+    }
+
+    refitUpward(n);
+    ++m_numStructuralChanges;
+}
+
+
+int DynamicBVH::allocateNode(int parent, int parentSlot) {
+    const int n = m_node.size();
+    m_node.next();
+    m_node[n].parent = parent;
+    m_node[n].parentSlot = parentSlot;
+    return n;
+}
+
+
+/** Orders leaf handles by one coordinate of their box centers */
+class BVHCentroidLess {
+public:
+    const Vector3*  center;
+    int             axis;
+
+    bool operator()(int a, int b) const {
+        return center[a][axis] < center[b][axis];
+    }
+};
+
+
+void DynamicBVH::splitMedian(int begin, int mid, int end) {
+    int* handle = m_buildHandle.getCArray();
+
+    AABox bounds(m_center[handle[begin]]);
+    for (int i = begin + 1; i < end; ++i) {
+        bounds.merge(m_center[handle[i]]);
+    }
+    const Vector3& extent = bounds.extent();
+
+    BVHCentroidLess less;
+    less.center = m_center.getCArray();
+    less.axis   = ((extent.x >= extent.y) && (extent.x >= extent.z)) ? 0 : ((extent.y >= extent.z) ? 1 : 2);
+    std::nth_element(handle + begin, handle + mid, handle + end, less);
+}
+
+
+int DynamicBVH::build(int begin, int end, int parent, int parentSlot) {
+    if (end - begin == 1) {
+        const int h = m_buildHandle[begin];
+        m_leaf[h].node = parent;
+        m_leaf[h].slot = parentSlot;
+        return leafSlot(h);
+    }
+
+    const int n = allocateNode(parent, parentSlot);
+
+    // Boundaries of up to four groups of leaves
+    int split[5];
+    int numGroups;
+    if (end - begin <= 4) {
+        numGroups = end - begin;
+        for (int g = 0; g <= numGroups; ++g) {
+            split[g] = begin + g;
+        }
+    } else {
+        // Each half has at least two leaves, so both can be split again
+        numGroups = 4;
+        split[0] = begin;
+        split[2] = (begin + end) / 2;
+        split[4] = end;
+        splitMedian(begin, split[2], end);
+
+        split[1] = (split[0] + split[2]) / 2;
+        split[3] = (split[2] + split[4]) / 2;
+        splitMedian(split[0], split[1], split[2]);
+        splitMedian(split[2], split[3], split[4]);
+    }
+
+    for (int g = 0; g < numGroups; ++g) {
+        const int c = build(split[g], split[g + 1], n, g);
+        m_node[n].child[g] = c;
+
+        AABox box;
+        if (c < 0) {
+            box = m_leaf[-2 - c].box;
+        } else {
+            m_node[c].getBounds(box);
+        }
+        m_node[n].setChildBox(g, box);
+    }
+
+    return n;
+}
+
+
+void DynamicBVH::rebuild() {
+    m_node.fastClear();
+    m_dirtyLeaf.fastClear();
+    m_root = -1;
+    m_numStructuralChanges = 0;
+
+    m_buildHandle.fastClear();
+    m_center.resize(m_leaf.size(), DONT_SHRINK_UNDERLYING_ARRAY);
+    for (int h = 0; h < m_leaf.size(); ++h) {
+        Leaf& leaf = m_leaf[h];
+        leaf.dirty = false;
+        if (leaf.inUse) {
+            m_buildHandle.append(h);
+            m_center[h] = leaf.box.center();
+        }
+    }
+
+    if (m_buildHandle.size() == 0) {
+        return;
+    } else if (m_buildHandle.size() == 1) {
+        // The root is always a node
+        m_root = allocateNode(-1, -1);
+        const int h = m_buildHandle[0];
+        m_node[m_root].child[0] = leafSlot(h);
+        m_node[m_root].setChildBox(0, m_leaf[h].box);
+        m_leaf[h].node = m_root;
+        m_leaf[h].slot = 0;
+    } else {
+        m_root = build(0, m_buildHandle.size(), -1, -1);
+    }
+}
+
+
+void DynamicBVH::insertIntoHierarchy(int h) {
+    const AABox& box = m_leaf[h].box;
+
+    int n = m_root;
+    while (true) {
+        Node& node = m_node[n];
+
+        // Use an empty slot if there is one
+        for (int c = 0; c < 4; ++c) {
+            if (node.child[c] == EMPTY) {
+                node.child[c] = leafSlot(h);
+                node.setChildBox(c, box);
+                m_leaf[h].node = n;
+                m_leaf[h].slot = c;
+                refitUpward(n);
+                return;
+            }
+        }
+
+        // Otherwise descend into the child whose surface area grows least
+        int best = 0;
+        float bestGrowth = finf();
+        float bestArea = finf();
+        for (int c = 0; c < 4; ++c) {
+            AABox b;
+            node.getChildBox(c, b);
+            const float area = b.area();
+            b.merge(box);
+            const float growth = b.area() - area;
+            if ((growth < bestGrowth) || ((growth == bestGrowth) && (area < bestArea))) {
+                best = c;
+                bestGrowth = growth;
+                bestArea = area;
+            }
+        }
+
+        const int c = node.child[best];
+        if (c >= 0) {
+            n = c;
+        } else {
+            // Replace the leaf in that slot with a node holding both leaves
+            const int m = allocateNode(n, best);
+            const int other = -2 - c;
+
+            Node& pair = m_node[m];
+            pair.child[0] = c;
+            pair.setChildBox(0, m_leaf[other].box);
+            pair.child[1] = leafSlot(h);
+            pair.setChildBox(1, box);
+            m_leaf[other].node = m;
+            m_leaf[other].slot = 0;
+            m_leaf[h].node = m;
+            m_leaf[h].slot = 1;
+
+            m_node[n].child[best] = m;
+            refitUpward(m);
+            return;
+        }
+    }
+}
+
+
+void DynamicBVH::refitUpward(int n) {
+    while (n != -1) {
+        const Node& node = m_node[n];
+        if (node.parent == -1) {
+            return;
+        }
+
+        AABox box;
+        node.getBounds(box);
+
+        Node& parent = m_node[node.parent];
+        AABox old;
+        parent.getChildBox(node.parentSlot, old);
+        if (old == box) {
+            // The remaining ancestors are already correct
+            return;
+        }
+        parent.setChildBox(node.parentSlot, box);
+        n = node.parent;
+    }
+}
+
+
+void DynamicBVH::refitAll() {
+    for (int n = m_node.size() - 1; n > 0; --n) {
+        const Node& node = m_node[n];
+        if (node.inUse && (node.parent != -1)) {
+            AABox box;
+            node.getBounds(box);
+            m_node[node.parent].setChildBox(node.parentSlot, box);
+        }
+    }
+}
+
+
+void DynamicBVH::refit() {
+    if (m_dirtyLeaf.size() == 0) {
+        return;
+    }
+
+    // Walking up from each leaf touches about log4(n) nodes, so a
+    // single pass over all nodes is cheaper when many leaves moved
+    const bool incremental = (m_dirtyLeaf.size() * 8 < m_node.size());
+
+    for (int i = 0; i < m_dirtyLeaf.size(); ++i) {
+        Leaf& leaf = m_leaf[m_dirtyLeaf[i]];
+        if (leaf.dirty && (leaf.node != -1)) {
+            leaf.dirty = false;
+            m_node[leaf.node].setChildBox(leaf.slot, leaf.box);
+            if (incremental) {
+                refitUpward(leaf.node);
+            }
+        }
+    }
+    m_dirtyLeaf.fastClear();
+
+    if (! incremental) {
+        refitAll();
+    }
+}
+
+
+void DynamicBVH::appendSubtree(int n, Array<int>& result) const {
+    const Node& node = m_node[n];
+    for (int c = 0; c < 4; ++c) {
+        const int child = node.child[c];
+        if (child >= 0) {
+            appendSubtree(child, result);
+        } else if (child != EMPTY) {
+            result.append(m_leaf[-2 - child].value);
+        }
+    }
+}
+
+
+void DynamicBVH::cullNode(int n, uint32 planeMask, const float* planeData, bool sse, Array<int>& result) {
+    Node& node = m_node[n];
+
+    int live = 0;
+    for (int c = 0; c < 4; ++c) {
+        if (node.child[c] != EMPTY) {
+            live |= 1 << c;
+        }
+    }
+
+    // Planes that each child straddles, which its subtree must test
+    uint32 straddle[4] = {0, 0, 0, 0};
+
+    // Test the plane that last culled a child first, because
+    // it is likely to cull the same children again
+    int p = node.cachedPlane;
+    uint32 remaining = planeMask;
+    if ((remaining & (1u << p)) == 0) {
+        p = 0;
+        while ((remaining & (1u << p)) == 0) {
+            ++p;
+        }
+    }
+
+    while (true) {
+        remaining &= ~(1u << p);
+
+        int outside, inside;
+#       ifdef G3D_BVH_SIMD
+        if (sse) {
+            planeMasks_sse2(node.lo, node.hi, planeData + p * 4, outside, inside);
+        } else
+#       endif
+        {
+            planeMasks(node.lo, node.hi, planeData + p * 4, outside, inside);
+        }
+
+        if ((outside & live) != 0) {
+            live &= ~outside;
+            node.cachedPlane = p;
+            if (live == 0) {
+                return;
+            }
+        }
+
+        const int partial = live & ~inside;
+        for (int c = 0; c < 4; ++c) {
+            if (partial & (1 << c)) {
+                straddle[c] |= 1u << p;
+            }
+        }
+
+        if (remaining == 0) {
+            break;
+        }
+        p = 0;
+        while ((remaining & (1u << p)) == 0) {
+            ++p;
+        }
+    }
+
+    for (int c = 0; c < 4; ++c) {
+        if (live & (1 << c)) {
+            const int child = node.child[c];
+            if (child < 0) {
+                result.append(m_leaf[-2 - child].value);
+            } else if (straddle[c] == 0) {
+                // Inside every plane
+                appendSubtree(child, result);
+            } else {
+                cullNode(child, straddle[c], planeData, sse, result);
+            }
+        }
+    }
+}
+
+
+void DynamicBVH::cull(const Array<Plane>& plane, Array<int>& result) {
+    alwaysAssertM(plane.size() <= MAX_PLANES, "Too many culling planes");
+
+    if (((m_root == -1) && (m_numLeaves > 0)) || (m_numStructuralChanges > max(64, m_numLeaves / 2))) {
+        rebuild();
+    } else {
+        refit();
+    }
+
+    if (m_root == -1) {
+        return;
+    }
+
+    if (plane.size() == 0) {
+        appendSubtree(m_root, result);
+        return;
+    }
+
+    float planeData[MAX_PLANES * 4];
+    for (int p = 0; p < plane.size(); ++p) {
+        Vector3 normal;
+        float d;
+        plane[p].getEquation(normal, d);
+        planeData[p * 4 + 0] = normal.x;
+        planeData[p * 4 + 1] = normal.y;
+        planeData[p * 4 + 2] = normal.z;
+        // getEquation produces normal.dot(x) + d = 0
+        planeData[p * 4 + 3] = -d;
+    }
+
+    bool sse = false;
+#   ifdef G3D_BVH_SIMD
+        sse = System::hasSSE2();
+#   endif
+
+    const uint32 allPlanes = (plane.size() == 32) ? 0xFFFFFFFF : ((1u << plane.size()) - 1);
+    cullNode(m_root, allPlanes, planeData, sse, result);
+}
+
+
+void DynamicBVH::getValues(Array<int>& result) const {
+    for (int h = 0; h < m_leaf.size(); ++h) {
+        if (m_leaf[h].inUse) {
+            result.append(m_leaf[h].value);
+        }
+    }
+}
+
+} // namespace G3D
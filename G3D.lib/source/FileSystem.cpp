@@ -43,7 +43,14 @@ FileSystem& FileSystem::instance() {
 }
 
 
+GMutex& FileSystem::mutex() {
+    static GMutex m;
+    return m;
+}
+
+
 void FileSystem::init() {
+    GMutexLock lock(&mutex());
     if (common == NULL) {
         common = new FileSystem();
     }
@@ -51,6 +58,7 @@ void FileSystem::init() {
 
 
 void FileSystem::cleanup() {
+    GMutexLock lock(&mutex());
     if (common != NULL) {
         delete common;
         common = NULL;
@@ -546,6 +554,31 @@ int64 FileSystem::_size(const std::string& filename) {
 }
 
 
+int64 FileSystem::_modificationTime(const std::string& filename) {
+    struct _stat st;
+    if (_stat(filename.c_str(), &st) != -1) {
+        return st.st_mtime;
+    }
+
+    std::string zip, contents;
+    if (zipfileExists(filename, zip, contents)) {
+        int64 mtime = -1;
+        struct zip* z = zip_open(zip.c_str(), ZIP_CHECKCONS, NULL);
+        if (z != NULL) {
+            struct zip_stat info;
+            zip_stat_init(&info);
+            if (zip_stat(z, contents.c_str(), ZIP_FL_NOCASE, &info) == 0) {
+                mtime = info.mtime;
+            }
+            zip_close(z);
+        }
+        return mtime;
+    }
+
+    return -1;
+}
+
+
 void FileSystem::listHelper(const std::string& shortSpec, const std::string& parentPath, Array<std::string>& result, const ListSettings& settings) {
     Dir& dir = getContents(parentPath, false);
 
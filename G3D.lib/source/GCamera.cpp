@@ -261,11 +261,13 @@ Vector3 GCamera::unproject(const Vector3& v, const Rect2D& viewport) const {
 
 
 float GCamera::worldToScreenSpaceArea(float area, float z, const Rect2D& viewport) const {
-    (void)viewport;
     if (z >= 0) {
         return finf();
     }
-    return area * (float)square(imagePlaneDepth() / z);
+
+    // Area on the image plane, scaled from world units to pixels
+    const float pixelsPerUnit = viewport.width() / viewportWidth(viewport);
+    return area * (float)square(imagePlaneDepth() / z) * square(pixelsPerUnit);
 }
 
 
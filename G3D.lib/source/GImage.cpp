@@ -16,6 +16,7 @@
 #include "G3D/BinaryOutput.h"
 #include "G3D/Log.h"
 #include "G3D/fileutils.h"
+#include "G3D/ImageFormat.h"
 
 #ifdef G3D_LINUX
 #    include <png.h>
@@ -225,10 +226,131 @@ void GImage::flipRGBAVertical(
 
 ////////////////////////////////////////////////////////////////////////////////////////
 
+/** Decodes rows directly into the pixels of a GImage */
+class DecodeIntoImage : public GImage::RowCallback {
+public:
+    GImage*     image;
+
+    DecodeIntoImage(GImage* image) : image(image) {}
+
+    virtual void beginRows(int width, int height, int channels) {
+        image->resize(width, height, channels, false);
+    }
+
+    virtual uint8* rowDestination(int y, int numRows) {
+        (void)numRows;
+        return image->byte() + y * image->width() * image->channels();
+    }
+
+    virtual void processRows(int y, int numRows, const uint8* pixels) {
+        (void)y; (void)numRows; (void)pixels;
+    }
+};
+
+
+/** Supplies the rows of a GImage to encodeRows */
+class EncodeFromImage : public GImage::RowSource {
+public:
+    const GImage*   image;
+
+    EncodeFromImage(const GImage* image) : image(image) {}
+
+    virtual void fetchRows(int y, int numRows, uint8* pixels) {
+        const int rowBytes = image->width() * image->channels();
+        System::memcpy(pixels, image->byte() + y * rowBytes, numRows * rowBytes);
+    }
+};
+
+
+void GImage::decodeRows(
+    BinaryInput&        input,
+    Format              format,
+    RowCallback&        callback,
+    int                 scaleDenominator,
+    int                 bandHeight) {
+
+    if (! ((scaleDenominator == 1) || (scaleDenominator == 2) || 
+           (scaleDenominator == 4) || (scaleDenominator == 8))) {
+        throw Error(G3D::format("Unsupported scale denominator: %d", scaleDenominator), input.getFilename());
+    }
+
+    if (format == AUTODETECT) {
+        format = resolveFormat(input.getFilename(), input.getCArray() + input.getPosition(), 
+                               (int)(input.size() - input.getPosition()), AUTODETECT);
+    }
+
+    switch (format) {
+    case PNG:
+        decodePNGRows(input, callback, scaleDenominator, bandHeight);
+        break;
+
+    case JPEG:
+        decodeJPEGRows(input, callback, scaleDenominator, bandHeight);
+        break;
+
+    default:
+        throw Error("Only PNG and JPEG can be decoded by rows.", input.getFilename());
+    }
+}
+
+
+void GImage::decodeRows(
+    const std::string&  filename,
+    RowCallback&        callback,
+    int                 scaleDenominator,
+    int                 bandHeight) {
+
+    BinaryInput b(filename, G3D_LITTLE_ENDIAN, false, true);
+    if (b.size() <= 0) {
+        throw Error("File not found.", filename);
+    }
+    decodeRows(b, AUTODETECT, callback, scaleDenominator, bandHeight);
+}
+
+
+void GImage::loadScaled(
+    const std::string&  filename,
+    int                 scaleDenominator) {
+
+    clear();
+    DecodeIntoImage callback(this);
+    decodeRows(filename, callback, scaleDenominator);
+}
+
+
+void GImage::encodeRows(
+    int                 width,
+    int                 height,
+    int                 channels,
+    RowSource&          source,
+    Format              format,
+    BinaryOutput&       out,
+    int                 bandHeight) {
+
+    switch (format) {
+    case PNG:
+        encodePNGRows(width, height, channels, source, out, bandHeight);
+        break;
+
+    case JPEG:
+        encodeJPEGRows(width, height, channels, source, out, bandHeight);
+        break;
+
+    default:
+        throw Error("Only PNG and JPEG can be encoded by rows.", out.getFilename());
+    }
+}
+
+
 void GImage::decode(
     BinaryInput&        input,
     Format              format) {
 
+    if (format == AUTODETECT) {
+        format = resolveFormat(input.getFilename(), input.getCArray() + input.getPosition(), 
+                               (int)(input.size() - input.getPosition()), AUTODETECT);
+    }
+
     switch (format) {
     case PPM_ASCII:
         decodePPMASCII(input);
@@ -239,11 +361,11 @@ void GImage::decode(
         break;
 
     case PNG:
-        decodePNG(input);
-        break;
-
     case JPEG:
-        decodeJPEG(input);
+        {
+            DecodeIntoImage callback(this);
+            decodeRows(input, format, callback);
+        }
         break;
 
     case TGA:
@@ -263,7 +385,7 @@ void GImage::decode(
         break;
 
     default:
-        debugAssert(false);
+        throw Error("Unrecognized image format.", input.getFilename());
     }
 
     debugAssert(m_width >= 0);
@@ -813,11 +935,11 @@ void GImage::encode(
         break;
 
     case PNG:
-        encodePNG(out);
-        break;
-
     case JPEG:
-        encodeJPEG(out);
+        {
+            EncodeFromImage source(this);
+            encodeRows(m_width, m_height, m_channels, source, format, out);
+        }
         break;
 
     case BMP:
@@ -986,6 +1108,17 @@ void GImage::computeNormalMap(
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+void GImage::convertPixels(const uint8* src, const ImageFormat* srcFormat, uint8* dst, const ImageFormat* dstFormat) const {
+    Array<const void*> srcBytes;
+    srcBytes.append(src);
+    Array<void*> dstBytes;
+    dstBytes.append(dst);
+    bool converted = ImageFormat::convert(srcBytes, m_width, m_height, srcFormat, 0, dstBytes, dstFormat, 0, 
+                                          false, ImageFormat::BayerAlgorithm::MHC, true);
+    debugAssert(converted); (void)converted;
+}
+
+
 void GImage::convertToL8() {
     switch (m_channels) {
     case 1:
@@ -1041,24 +1174,17 @@ void GImage::convertToRGBA() {
                 d.r = d.g = d.b = s;
                 d.a = 255;
             }
-            m_memMan->free(m_byte);
+            m_memMan->free(old);
         }
         break;
 
     case 3:
         {            
             // Add alpha
-            Color3uint8* old = (Color3uint8*)m_byte;
+            uint8* old = m_byte;
             m_byte = NULL;
             resize(m_width, m_height, 4);
-            for (int i = m_width * m_height - 1; i >= 0; --i) {
-                const Color3uint8   s = old[i];
-                Color4uint8&        d = ((Color4uint8*)m_byte)[i]; 
-                d.r = s.r;
-                d.g = s.g;
-                d.b = s.b;
-                d.a = 255;
-            }
+            convertPixels(old, ImageFormat::RGB8(), m_byte, ImageFormat::RGBA8());
             m_memMan->free(old);
         }
         break;
@@ -1081,11 +1207,7 @@ void GImage::convertToRGB() {
             uint8* old = m_byte;
             m_byte = NULL;
             resize(m_width, m_height, 3);
-            for (int i = m_width * m_height - 1; i >= 0; --i) {
-                const uint8  s = old[i];
-                Color3uint8& d = ((Color3uint8*)m_byte)[i]; 
-                d.r = d.g = d.b = s;
-            }
+            convertPixels(old, ImageFormat::L8(), m_byte, ImageFormat::RGB8());
             m_memMan->free(old);
         }
         break;
@@ -1096,16 +1218,10 @@ void GImage::convertToRGB() {
     case 4:
 		// Strip alpha
         {            
-            Color4uint8* old = (Color4uint8*)m_byte;
+            uint8* old = m_byte;
             m_byte = NULL;
             resize(m_width, m_height, 3);
-            for (int i = m_width * m_height - 1; i >= 0; --i) {
-                const Color4uint8   s = old[i];
-                Color3uint8&        d = ((Color3uint8*)m_byte)[i]; 
-                d.r = s.r;
-                d.g = s.g;
-                d.b = s.b;
-            }
+            convertPixels(old, ImageFormat::RGBA8(), m_byte, ImageFormat::RGB8());
             m_memMan->free(old);
         }
         break;
@@ -2,12 +2,13 @@
   @file GImage_jpeg.cpp
   @author Morgan McGuire, http://graphics.cs.williams.edu
   @created 2002-05-27
-  @edited  2009-04-20
+  @edited  2010-06-23
  */
 #include "G3D/platform.h"
 #include "G3D/GImage.h"
 #include "G3D/BinaryInput.h"
 #include "G3D/BinaryOutput.h"
+#include "G3D/System.h"
 
 #include <cstring>
 
@@ -26,22 +27,38 @@ namespace G3D {
 
 const int jpegQuality = 96;
 
+/** Larger images are encoded with the default Huffman tables, because
+    optimizing the tables makes libjpeg buffer the whole image. */
+static const int jpegMaxOptimizedPixels = 16 * 1024 * 1024;
+
+/**
+ Signature dictated by IJG.  Replaces the default handler, which exits
+ the process.
+ */
+static void jpeg_error_exit(
+    j_common_ptr                cinfo) {
+
+    char message[JMSG_LENGTH_MAX];
+    (*cinfo->err->format_message)(cinfo, message);
+    throw GImage::Error(message, "JPEG");
+}
+
+#define OUTPUT_BUF_SIZE  4096
+
 /**
- The IJG library needs special setup for compress/decompressing
- from memory.  These classes provide them.  
+ Streams compressed data into a BinaryOutput.
  
  The format of this class is defined by the IJG library; do not
  change it.
  */ 
-class memory_destination_mgr {
+class binaryoutput_destination_mgr {
 public:
 	struct jpeg_destination_mgr pub;
-	JOCTET*                     buffer;
-	int                         size;
-	int                         count;
+    BinaryOutput*               out;
+	JOCTET                      buffer[OUTPUT_BUF_SIZE];
 };
 
-typedef memory_destination_mgr* mem_dest_ptr;
+typedef binaryoutput_destination_mgr* bo_dest_ptr;
 
 /**
  Signature dictated by IJG.
@@ -49,23 +66,24 @@ typedef memory_destination_mgr* mem_dest_ptr;
 static void init_destination (
     j_compress_ptr              cinfo) {
 
-	mem_dest_ptr dest = (mem_dest_ptr) cinfo->dest;
+	bo_dest_ptr dest = (bo_dest_ptr) cinfo->dest;
 
 	dest->pub.next_output_byte = dest->buffer;
-	dest->pub.free_in_buffer = dest->size;
-	dest->count=0;
+	dest->pub.free_in_buffer = OUTPUT_BUF_SIZE;
 }
 
 /**
- Signature dictated by IJG.
+ Signature dictated by IJG.  Always flushes the whole buffer,
+ regardless of free_in_buffer.
  */
 static boolean empty_output_buffer (
     j_compress_ptr              cinfo) {
 
-	mem_dest_ptr dest = (mem_dest_ptr) cinfo->dest;
+	bo_dest_ptr dest = (bo_dest_ptr) cinfo->dest;
 
+    dest->out->writeBytes(dest->buffer, OUTPUT_BUF_SIZE);
 	dest->pub.next_output_byte = dest->buffer;
-	dest->pub.free_in_buffer = dest->size;
+	dest->pub.free_in_buffer = OUTPUT_BUF_SIZE;
 
 	return TRUE;
 }
@@ -76,19 +94,19 @@ static boolean empty_output_buffer (
 static void term_destination (
     j_compress_ptr              cinfo) {
 
-	mem_dest_ptr dest = (mem_dest_ptr) cinfo->dest;
-	dest->count = dest->size - dest->pub.free_in_buffer;
+	bo_dest_ptr dest = (bo_dest_ptr) cinfo->dest;
+    const int count = OUTPUT_BUF_SIZE - (int)dest->pub.free_in_buffer;
+    if (count > 0) {
+        dest->out->writeBytes(dest->buffer, count);
+    }
 }
 
 /**
  Signature dictated by IJG.
  */
-static void jpeg_memory_dest (
+static void jpeg_binaryoutput_dest (
     j_compress_ptr              cinfo,
-    JOCTET*                     buffer,
-    int                         size) {
-
-	mem_dest_ptr dest;
+    BinaryOutput*               out) {
 
 	if (cinfo->dest == NULL) {
         // First time for this JPEG object; call the
@@ -96,16 +114,37 @@ static void jpeg_memory_dest (
 		cinfo->dest = (struct jpeg_destination_mgr*)
 			(*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, 
                                         JPOOL_PERMANENT,
-                       				    sizeof(memory_destination_mgr));
+                       				    sizeof(binaryoutput_destination_mgr));
 	}
 
-	dest                            = (mem_dest_ptr) cinfo->dest;
-	dest->size                      = size;
-	dest->buffer                    = buffer;
+	bo_dest_ptr dest                = (bo_dest_ptr) cinfo->dest;
+	dest->out                       = out;
 	dest->pub.init_destination      = init_destination;
 	dest->pub.empty_output_buffer   = empty_output_buffer;
 	dest->pub.term_destination      = term_destination;
 }
+
+
+/** Destroys a compression object when encoding ends, including by an exception */
+class JPEGCompressGuard {
+public:
+    jpeg_compress_struct*   cinfo;
+    JPEGCompressGuard(jpeg_compress_struct* c) : cinfo(c) {}
+    ~JPEGCompressGuard() {
+        jpeg_destroy_compress(cinfo);
+    }
+};
+
+
+/** Destroys a decompression object when decoding ends, including by an exception */
+class JPEGDecompressGuard {
+public:
+    jpeg_decompress_struct* cinfo;
+    JPEGDecompressGuard(jpeg_decompress_struct* c) : cinfo(c) {}
+    ~JPEGDecompressGuard() {
+        jpeg_destroy_decompress(cinfo);
+    }
+};
   
 ////////////////////////////////////////////////////////////////////////////////////////
 
@@ -246,18 +285,14 @@ static void jpeg_memory_src (
 }
 
 
-void GImage::encodeJPEG(
-    BinaryOutput&           out) const {
-
-	if (m_channels != 3) {
-		// Convert to three channel
-		GImage tmp = *this;
-		tmp.convertToRGB();
-		tmp.encodeJPEG(out);
-		return;
-	}
+void GImage::encodeJPEGRows(int width, int height, int channels, RowSource& source, BinaryOutput& out, int bandHeight) {
+    if (! (channels == 1 || channels == 3 || channels == 4)) {
+        throw GImage::Error(format("Illegal channels for JPEG: %d", channels), out.getFilename());
+    }
+    if ((width <= 0) || (height <= 0)) {
+        throw GImage::Error(format("Illegal size for JPEG: %d x %d", width, height), out.getFilename());
+    }
 
-    debugAssert(m_channels == 3);
     out.setEndian(G3D_LITTLE_ENDIAN);
 
     // Allocate and initialize a compression object
@@ -265,181 +300,162 @@ void GImage::encodeJPEG(
     jpeg_error_mgr          jerr;
 
 	cinfo.err = jpeg_std_error(&jerr);
+    jerr.error_exit = jpeg_error_exit;
 	jpeg_create_compress(&cinfo);
+    JPEGCompressGuard guard(&cinfo);
 
-    // Specify the destination for the compressed data.
-    // (Overestimate the size)
-    int buffer_size = m_width * m_height * 3 + 200;
-    JOCTET* compressed_data = (JOCTET*)System::malloc(buffer_size);
-	jpeg_memory_dest(&cinfo, compressed_data, buffer_size);
-
+    // Compressed data goes straight to out as it is produced
+	jpeg_binaryoutput_dest(&cinfo, &out);
 
-    cinfo.image_width       = m_width;
-    cinfo.image_height      = m_height;
+    cinfo.image_width       = width;
+    cinfo.image_height      = height;
 
-	// # of color components per pixel
-    cinfo.input_components  = 3;
+	// # of color components per pixel; alpha is dropped
+    cinfo.input_components  = (channels == 1) ? 1 : 3;
 
     // colorspace of input image
-    cinfo.in_color_space    = JCS_RGB; 
+    cinfo.in_color_space    = (channels == 1) ? JCS_GRAYSCALE : JCS_RGB; 
     cinfo.input_gamma       = 1.0;
     
     // Set parameters for compression, including image size & colorspace
     jpeg_set_defaults(&cinfo);
     jpeg_set_quality(&cinfo, jpegQuality, false);
     cinfo.smoothing_factor = 0;
-    cinfo.optimize_coding = TRUE;
+    cinfo.optimize_coding = ((int64)width * height <= jpegMaxOptimizedPixels) ? TRUE : FALSE;
 //    cinfo.dct_method = JDCT_FLOAT;
     cinfo.dct_method = JDCT_ISLOW;
-    cinfo.jpeg_color_space = JCS_YCbCr;
+    if (channels != 1) {
+        cinfo.jpeg_color_space = JCS_YCbCr;
+    }
 
     // Initialize the compressor
     jpeg_start_compress(&cinfo, TRUE);
 
+    const int rowBytes    = width * channels;
+    const int sampleBytes = width * cinfo.input_components;
+    bandHeight = iClamp(bandHeight, 1, height);
+    Array<uint8> band;
+    band.resize(rowBytes * bandHeight);
+    Array<JSAMPROW> rowPointer;
+    rowPointer.resize(bandHeight);
+    for (int i = 0; i < bandHeight; ++i) {
+        rowPointer[i] = band.getCArray() + i * sampleBytes;
+    }
+
     // Iterate over all scanlines from top to bottom
-	// pointer to a single row
-    JSAMPROW row_pointer[1];
-    
-    // JSAMPLEs per row in image_buffer
-    int row_stride = cinfo.image_width * 3;
-    while (cinfo.next_scanline < cinfo.image_height) {
-	    row_pointer[0] = &(m_byte[cinfo.next_scanline * row_stride]);
-	    jpeg_write_scanlines(&cinfo, row_pointer, 1);
+    for (int y = 0; y < height; y += bandHeight) {
+        const int n = iMin(bandHeight, height - y);
+        source.fetchRows(y, n, band.getCArray());
+
+        if (channels == 4) {
+            // Pack RGBA to RGB in place; the destination never passes the source
+            const uint8* src = band.getCArray();
+            uint8*       dst = band.getCArray();
+            for (int i = width * n; i > 0; --i, src += 4, dst += 3) {
+                dst[0] = src[0];
+                dst[1] = src[1];
+                dst[2] = src[2];
+            }
+        }
+
+        int written = 0;
+        while (written < n) {
+            written += jpeg_write_scanlines(&cinfo, rowPointer.getCArray() + written, n - written);
+        }
     }
 
     // Shut down the compressor
     jpeg_finish_compress(&cinfo);
-    
-    // Figure out how big the result was.
-    int outLength = ((mem_dest_ptr)cinfo.dest)->count;
-
-    //	Release the JPEG compression object
-    jpeg_destroy_compress(&cinfo);
-
-    // Copy into an appropriately sized output buffer.
-    out.writeBytes(compressed_data, outLength);
-
-    // Free the conservative buffer.
-    System::free(compressed_data);
-    compressed_data = NULL;
 }
 
 
-void GImage::decodeJPEG(
-    BinaryInput&                input) {
-
+void GImage::decodeJPEGRows(BinaryInput& input, RowCallback& callback, int scaleDenominator, int bandHeight) {
 	struct jpeg_decompress_struct   cinfo;
 	struct jpeg_error_mgr           jerr;
-    int                             loc = 0;
 
-    m_channels = 3;
     // We have to set up the error handler, in case initialization fails.
 	cinfo.err = jpeg_std_error(&jerr);
+    jerr.error_exit = jpeg_error_exit;
 
     // Initialize the JPEG decompression object.
 	jpeg_create_decompress(&cinfo);
+    JPEGDecompressGuard guard(&cinfo);
 
 	// Specify data source (eg, a file, for us, memory)
-	jpeg_memory_src(&cinfo, const_cast<uint8*>(input.getCArray()), input.size());
+	jpeg_memory_src(&cinfo, const_cast<uint8*>(input.getCArray()) + input.getPosition(), 
+                    (int)(input.size() - input.getPosition()));
 
 	// Read the parameters with jpeg_read_header()
 	jpeg_read_header(&cinfo, TRUE);
 
-	// Set parameters for decompression
-	// (We do nothing here since the defaults are fine)
+    // Let the inverse DCT produce the reduced image
+    cinfo.scale_num   = 1;
+    cinfo.scale_denom = scaleDenominator;
+
+    // Grayscale is expanded to RGB by the library; four-component
+    // images are read as-is and their last channel is dropped
+    if (cinfo.num_components != 4) {
+        cinfo.out_color_space = JCS_RGB;
+    }
 
 	// Start decompressor
 	jpeg_start_decompress(&cinfo);
 
-	// Get and set the values of interest to this object
-	m_width     = cinfo.output_width;
-	m_height    = cinfo.output_height;
-
-	// Prepare the pointer object for the pixel data
-    m_byte = (uint8*)m_memMan->alloc(m_width * m_height * 3);
-
- 	// JSAMPLEs per row in output buffer
-    int bpp         = cinfo.output_components;
-    int row_stride  = cinfo.output_width * bpp;
-
-	// Make a one-row-high sample array that will go away when done with image
-    JSAMPARRAY temp = (*cinfo.mem->alloc_sarray)
-		((j_common_ptr) &cinfo, JPOOL_IMAGE, row_stride, 1);
-
-    // Read data on a scanline by scanline basis
-	while (cinfo.output_scanline < cinfo.output_height) {
-
-        // We may need to adjust the output based on the
-        // number of channels it has.
-        switch (bpp) {
-	    case 1:
-            // Grayscale; decompress to temp.
-    		jpeg_read_scanlines(&cinfo, temp, 1);
-
-            // Expand to three channels
-            {
-                uint8* scan     = &(m_byte[loc * 3]);
-                uint8* endScan  = scan + (m_width * 3);
-                uint8* t        = *temp;
-
-                while (scan < endScan) {
-                    uint8 value = t[0];
-
-                    // Spread the value 3x.
-                    scan[0] = value;
-                    scan[1] = value;
-                    scan[2] = value;
+    const int width      = cinfo.output_width;
+    const int height     = cinfo.output_height;
+    const int rowBytes   = width * 3;
+    const int components = cinfo.output_components;
+    callback.beginRows(width, height, 3);
+
+    bandHeight = iClamp(bandHeight, 1, height);
+    Array<uint8> band;
+    band.resize(rowBytes * bandHeight);
+    Array<JSAMPROW> rowPointer;
+    rowPointer.resize(bandHeight);
+    Array<uint8> temp;
+    if (components != 3) {
+        temp.resize(width * components);
+    }
 
-                    scan    += 3;
-                    t       += 1;
-                }
+    // Read data a band of scanlines at a time
+    for (int y = 0; y < height; y += bandHeight) {
+        const int n = iMin(bandHeight, height - y);
+        uint8* dst = callback.rowDestination(y, n);
+        if (dst == NULL) {
+            dst = band.getCArray();
+        }
+
+        if (components == 3) {
+            // Read directly into the band
+            for (int i = 0; i < n; ++i) {
+                rowPointer[i] = dst + i * rowBytes;
             }
-		    break;
-
-	    case 3:
-            // Read directly into the array
-            {
-                // Need one extra level of indirection.
-                uint8*     scan = m_byte + loc;
-                JSAMPARRAY ptr  = &scan;
-    		    jpeg_read_scanlines(&cinfo, ptr, 1);
+            int read = 0;
+            while (read < n) {
+                read += jpeg_read_scanlines(&cinfo, rowPointer.getCArray() + read, n - read);
             }
-		    break;
-
-	    case 4:
-            // RGBA; decompress to temp.
-    		jpeg_read_scanlines(&cinfo, temp, 1);
-
-            // Drop the 3rd channel
-            {
-                uint8* scan     = &(m_byte[loc * 3]);
-                uint8* endScan  = scan + m_width * 3;
-                uint8* t        = *temp;
-
-                while (scan < endScan) {
+        } else if (components == 4) {
+            for (int i = 0; i < n; ++i) {
+                JSAMPROW t = temp.getCArray();
+                jpeg_read_scanlines(&cinfo, &t, 1);
+
+                // Drop the 4th channel
+                uint8* scan = dst + i * rowBytes;
+                for (int x = 0; x < width; ++x, scan += 3, t += 4) {
                     scan[0] = t[0];
                     scan[1] = t[1];
                     scan[2] = t[2];
-                    
-                    scan    += 3;
-                    t       += 4;
                 }
             }
-		    break;
-
-	    default:
+        } else {
 		    throw Error("Unexpected number of channels.", input.getFilename());
-	    }
+        }
 
-		loc += row_stride;
-	}
+        callback.processRows(y, n, dst);
+    }
 
 	// Finish decompression
 	jpeg_finish_decompress(&cinfo);
-
-    alwaysAssertM(this, "Corrupt GImage");
-	// Release JPEG decompression object
-	jpeg_destroy_decompress(&cinfo);
 }
 
 
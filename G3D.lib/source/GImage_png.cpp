@@ -2,13 +2,14 @@
   @file GImage_png.cpp
   @author Morgan McGuire, http://graphics.cs.williams.edu
   @created 2002-05-27
-  @edited  2009-04-20
+  @edited  2010-06-23
  */
 #include "G3D/platform.h"
 #include "G3D/GImage.h"
 #include "G3D/BinaryInput.h"
 #include "G3D/BinaryOutput.h"
 #include "G3D/Log.h"
+#include "G3D/System.h"
 #include <png.h>
 
 namespace G3D {
@@ -68,44 +69,90 @@ void png_warning(
 }
 
 
-void GImage::encodePNG(
-    BinaryOutput&           out) const {
+/** Destroys the libpng read structures when decoding ends, including by an exception */
+class PNGReadStructs {
+public:
+    png_structp     png;
+    png_infop       info;
+    png_infop       endInfo;
 
-    if (! (m_channels == 1 || m_channels == 3 || m_channels == 4)) {
-        throw GImage::Error(format("Illegal channels for PNG: %d", m_channels), out.getFilename());
+    PNGReadStructs() : png(NULL), info(NULL), endInfo(NULL) {}
+
+    ~PNGReadStructs() {
+        if (png != NULL) {
+            png_destroy_read_struct(&png, (info != NULL) ? &info : NULL, (endInfo != NULL) ? &endInfo : NULL);
+        }
     }
-    if (m_width <= 0) {
-        throw GImage::Error(format("Illegal width for PNG: %d", m_width), out.getFilename());
+};
+
+
+/** Destroys the libpng write structures when encoding ends, including by an exception */
+class PNGWriteStructs {
+public:
+    png_structp     png;
+    png_infop       info;
+
+    PNGWriteStructs() : png(NULL), info(NULL) {}
+
+    ~PNGWriteStructs() {
+        if (png != NULL) {
+            png_destroy_write_struct(&png, (info != NULL) ? &info : NULL);
+        }
     }
-    if (m_height <= 0) {
-        throw GImage::Error(format("Illegal height for PNG: %d", m_height), out.getFilename());
+};
+
+
+/** Returns decoded rows in order, either straight from libpng or, for
+    interlaced images, from a buffer holding the whole image. */
+class PNGRowInput {
+public:
+    png_structp     png;
+    Array<uint8>    image;
+    int             rowBytes;
+    int             next;
+
+    void read(uint8* dst) {
+        if (image.size() > 0) {
+            System::memcpy(dst, image.getCArray() + next * rowBytes, rowBytes);
+        } else {
+            png_read_rows(png, &dst, NULL, 1);
+        }
+        ++next;
     }
+};
+
 
-    // PNG library requires that the height * pointer size fit within an int
-    if (png_uint_32(m_height) * png_sizeof(png_bytep) > PNG_UINT_32_MAX) {
-        throw GImage::Error("Unsupported PNG height.", out.getFilename());
+void GImage::encodePNGRows(int width, int height, int channels, RowSource& source, BinaryOutput& out, int bandHeight) {
+    if (! (channels == 1 || channels == 3 || channels == 4)) {
+        throw GImage::Error(format("Illegal channels for PNG: %d", channels), out.getFilename());
+    }
+    if (width <= 0) {
+        throw GImage::Error(format("Illegal width for PNG: %d", width), out.getFilename());
+    }
+    if (height <= 0) {
+        throw GImage::Error(format("Illegal height for PNG: %d", height), out.getFilename());
     }
 
     out.setEndian(G3D_LITTLE_ENDIAN);
 
-    png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, png_error, png_warning);
-    if (! png_ptr) {
+    PNGWriteStructs s;
+    s.png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, png_error, png_warning);
+    if (! s.png) {
         throw GImage::Error("Unable to initialize PNG encoder.", out.getFilename());
     }
 
-    png_infop info_ptr = png_create_info_struct(png_ptr);
-    if (! info_ptr) {
-        png_destroy_write_struct(&png_ptr, &info_ptr);
+    s.info = png_create_info_struct(s.png);
+    if (! s.info) {
         throw GImage::Error("Unable to initialize PNG encoder.", out.getFilename());
     }
 
     //setup libpng write handler so can use BinaryOutput
-    png_set_write_fn(png_ptr, (void*)&out, png_write_data, png_flush_data);
+    png_set_write_fn(s.png, (void*)&out, png_write_data, png_flush_data);
     png_color_8_struct sig_bit;
 
-    switch (m_channels) {
+    switch (channels) {
     case 1:
-        png_set_IHDR(png_ptr, info_ptr, m_width, m_height, 8, PNG_COLOR_TYPE_GRAY,
+        png_set_IHDR(s.png, s.info, width, height, 8, PNG_COLOR_TYPE_GRAY,
             PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
         sig_bit.red = 0;
         sig_bit.green = 0;
@@ -115,7 +162,7 @@ void GImage::encodePNG(
         break;
 
     case 3:
-        png_set_IHDR(png_ptr, info_ptr, m_width, m_height, 8, PNG_COLOR_TYPE_RGB,
+        png_set_IHDR(s.png, s.info, width, height, 8, PNG_COLOR_TYPE_RGB,
             PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
 
         sig_bit.red = 8;
@@ -126,7 +173,7 @@ void GImage::encodePNG(
         break;
 
     case 4:
-        png_set_IHDR(png_ptr, info_ptr, m_width, m_height, 8, PNG_COLOR_TYPE_RGBA,
+        png_set_IHDR(s.png, s.info, width, height, 8, PNG_COLOR_TYPE_RGBA,
             PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
         sig_bit.red = 8;
         sig_bit.green = 8;
@@ -134,143 +181,190 @@ void GImage::encodePNG(
         sig_bit.alpha = 8;
         sig_bit.gray = 0;
         break;
-
-    default:
-        png_destroy_write_struct(&png_ptr, &info_ptr);
-        throw GImage::Error("Unsupported number of channels for PNG.", out.getFilename());
     }
 
-
-    png_set_sBIT(png_ptr, info_ptr, &sig_bit);
+    png_set_sBIT(s.png, s.info, &sig_bit);
 
     //write the png header
-    png_write_info(png_ptr, info_ptr);
-
-    png_bytepp row_pointers = new png_bytep[m_height];
-
-    for (int i=0; i < m_height; ++i) {
-        row_pointers[i] = (png_bytep)&m_byte[m_width * m_channels * i];
+    png_write_info(s.png, s.info);
+
+    const int rowBytes = width * channels;
+    bandHeight = iClamp(bandHeight, 1, height);
+    Array<uint8> band;
+    band.resize(rowBytes * bandHeight);
+    Array<png_bytep> rowPointer;
+    rowPointer.resize(bandHeight);
+    for (int i = 0; i < bandHeight; ++i) {
+        rowPointer[i] = band.getCArray() + i * rowBytes;
     }
 
-    png_write_image(png_ptr, row_pointers);
-
-    png_write_end(png_ptr, info_ptr);
-
-    delete[] row_pointers;
+    for (int y = 0; y < height; y += bandHeight) {
+        const int n = iMin(bandHeight, height - y);
+        source.fetchRows(y, n, band.getCArray());
+        png_write_rows(s.png, rowPointer.getCArray(), n);
+    }
 
-    png_destroy_write_struct(&png_ptr, &info_ptr);
+    png_write_end(s.png, s.info);
 }
 
 
-void GImage::decodePNG(
-    BinaryInput&        input) {
-
-    png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, png_error, png_warning);
-    if (png_ptr == NULL) {
+void GImage::decodePNGRows(BinaryInput& input, RowCallback& callback, int scaleDenominator, int bandHeight) {
+    PNGReadStructs s;
+    s.png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, png_error, png_warning);
+    if (s.png == NULL) {
         throw GImage::Error("Unable to initialize PNG decoder.", input.getFilename());
     }
 
-    png_infop info_ptr = png_create_info_struct(png_ptr);
-    if (info_ptr == NULL) {
-        png_destroy_read_struct(&png_ptr, (png_infopp)NULL, (png_infopp)NULL);
+    s.info = png_create_info_struct(s.png);
+    if (s.info == NULL) {
         throw GImage::Error("Unable to initialize PNG decoder.", input.getFilename());
     }
 
-    png_infop end_info = png_create_info_struct(png_ptr);
-    if (end_info == NULL) {
-        png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
+    s.endInfo = png_create_info_struct(s.png);
+    if (s.endInfo == NULL) {
         throw GImage::Error("Unable to initialize PNG decoder.", input.getFilename());
     }
 
     // now that the libpng structures are setup, change the error handlers and read routines
     // to use G3D functions so that BinaryInput can be used.
 
-    png_set_read_fn(png_ptr, (png_voidp)&input, png_read_data);
+    png_set_read_fn(s.png, (png_voidp)&input, png_read_data);
     
     // read in sequentially so that three copies of the file are not in memory at once
-    png_read_info(png_ptr, info_ptr);
+    png_read_info(s.png, s.info);
 
     png_uint_32 png_width, png_height;
     int bit_depth, color_type, interlace_type;
     // this will validate the data it extracts from info_ptr
-    png_get_IHDR(png_ptr, info_ptr, &png_width, &png_height, &bit_depth, &color_type,
+    png_get_IHDR(s.png, s.info, &png_width, &png_height, &bit_depth, &color_type,
        &interlace_type, NULL, NULL);
 
     if (color_type == PNG_COLOR_TYPE_GRAY_ALPHA) {
-        png_destroy_read_struct(&png_ptr, &info_ptr, &end_info);
         throw GImage::Error("Unsupported PNG color type - PNG_COLOR_TYPE_GRAY_ALPHA.", input.getFilename());
     }
 
-    m_width  = static_cast<uint32>(png_width);
-    m_height = static_cast<uint32>(png_height);
+    const int width  = static_cast<int>(png_width);
+    const int height = static_cast<int>(png_height);
 
     //swap bytes of 16 bit files to least significant byte first
-    png_set_swap(png_ptr);
+    png_set_swap(s.png);
 
-    png_set_strip_16(png_ptr);
+    png_set_strip_16(s.png);
 
     //Expand paletted colors into true RGB triplets
     if (color_type == PNG_COLOR_TYPE_PALETTE) {
-        png_set_palette_to_rgb(png_ptr);
+        png_set_palette_to_rgb(s.png);
     }
 
     //Expand grayscale images to the full 8 bits from 1, 2, or 4 bits/pixel
     if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8) {
-        png_set_expand(png_ptr);
+        png_set_expand(s.png);
     }
 
     //Expand paletted or RGB images with transparency to full alpha channels
     //so the data will be available as RGBA quartets.
-    if (png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS)) {
-        png_set_tRNS_to_alpha(png_ptr);
+    if (png_get_valid(s.png, s.info, PNG_INFO_tRNS)) {
+        png_set_tRNS_to_alpha(s.png);
     }
 
     // Fix sub-8 bit_depth to 8bit
     if (bit_depth < 8) {
-        png_set_packing(png_ptr);
+        png_set_packing(s.png);
     }
 
+    int channels = 0;
     if ((color_type == PNG_COLOR_TYPE_RGBA) ||
-        ((color_type == PNG_COLOR_TYPE_PALETTE) && (png_ptr->num_trans > 0)) ) {
-
-        m_channels = 4;
-        m_byte = (uint8*)m_memMan->alloc(m_width * m_height * 4);
-
+        ((color_type == PNG_COLOR_TYPE_PALETTE) && (s.png->num_trans > 0)) ) {
+        channels = 4;
     } else if ((color_type == PNG_COLOR_TYPE_RGB) || 
                (color_type == PNG_COLOR_TYPE_PALETTE)) {
-
-        m_channels = 3;
-        m_byte = (uint8*)System::malloc(m_width * m_height * 3);
-
+        channels = 3;
     } else if (color_type == PNG_COLOR_TYPE_GRAY) {
-
-        m_channels = 1;
-
-        // Round up to the nearest 8 rows to avoid a bug in the PNG decoder
-        int h = iCeil(m_height / 8) * 8;
-        int sz = m_width * h;
-        m_byte = (uint8*)m_memMan->alloc(sz);
-
+        channels = 1;
     } else {
         throw GImage::Error("Unsupported PNG bit-depth or type.", input.getFilename());
     }
 
     //since we are reading row by row, required to handle interlacing
-    uint32 number_passes = png_set_interlace_handling(png_ptr);
+    const int numPasses = png_set_interlace_handling(s.png);
+
+    png_read_update_info(s.png, s.info);
+
+    PNGRowInput in;
+    in.png      = s.png;
+    in.rowBytes = width * channels;
+    in.next     = 0;
+
+    if (numPasses > 1) {
+        // No row is final until the last pass
+        in.image.resize(in.rowBytes * height);
+        for (int pass = 0; pass < numPasses; ++pass) {
+            for (int y = 0; y < height; ++y) {
+                png_bytep rowPointer = in.image.getCArray() + y * in.rowBytes;
+                png_read_rows(s.png, &rowPointer, NULL, 1);
+            }
+        }
+    }
+
+    const int scale       = scaleDenominator;
+    const int outWidth    = (width + scale - 1) / scale;
+    const int outHeight   = (height + scale - 1) / scale;
+    const int outRowBytes = outWidth * channels;
+    callback.beginRows(outWidth, outHeight, channels);
+
+    bandHeight = iClamp(bandHeight, 1, outHeight);
+    Array<uint8> band;
+    band.resize(outRowBytes * bandHeight);
+
+    // Box filter state for scale > 1
+    Array<uint8>  row;
+    Array<uint32> sum;
+    if (scale > 1) {
+        row.resize(in.rowBytes);
+        sum.resize(outRowBytes);
+    }
 
-    png_read_update_info(png_ptr, info_ptr);
+    for (int y = 0; y < outHeight; y += bandHeight) {
+        const int n = iMin(bandHeight, outHeight - y);
+        uint8* dst = callback.rowDestination(y, n);
+        if (dst == NULL) {
+            dst = band.getCArray();
+        }
 
-    for (uint32 pass = 0; pass < number_passes; ++pass) {
-        for (uint32 y = 0; y < (uint32)m_height; ++y) {
-            png_bytep rowPointer = &m_byte[m_width * m_channels * y]; 
-            png_read_rows(png_ptr, &rowPointer, NULL, 1);
+        if (scale == 1) {
+            for (int i = 0; i < n; ++i) {
+                in.read(dst + i * outRowBytes);
+            }
+        } else {
+            for (int i = 0; i < n; ++i) {
+                System::memset(sum.getCArray(), 0, sizeof(uint32) * outRowBytes);
+                const int numRows = iMin(scale, height - in.next);
+                for (int r = 0; r < numRows; ++r) {
+                    in.read(row.getCArray());
+                    const uint8* src = row.getCArray();
+                    for (int x = 0; x < width; ++x) {
+                        uint32* s = sum.getCArray() + (x / scale) * channels;
+                        for (int c = 0; c < channels; ++c) {
+                            s[c] += src[c];
+                        }
+                        src += channels;
+                    }
+                }
+
+                uint8* out = dst + i * outRowBytes;
+                for (int x = 0; x < outWidth; ++x) {
+                    const uint32 count = numRows * iMin(scale, width - x * scale);
+                    for (int c = 0; c < channels; ++c) {
+                        out[x * channels + c] = (uint8)((sum[x * channels + c] + count / 2) / count);
+                    }
+                }
+            }
         }
-    }
 
-//    png_read_image(png_ptr, &_byte);
-    png_read_end(png_ptr, info_ptr);
+        callback.processRows(y, n, dst);
+    }
 
-    png_destroy_read_struct(&png_ptr, &info_ptr, &end_info);
+    png_read_end(s.png, s.info);
 }
 
 }
@@ -160,6 +160,7 @@ DWORD WINAPI GThread::internalThreadProc(LPVOID param) {
     debugAssert(current->m_event);
     current->m_status = STATUS_RUNNING;
     current->threadMain();
+    System::flushThreadMallocCache();
     current->m_status = STATUS_COMPLETED;
     ::SetEvent(current->m_event);
     return 0;
@@ -169,6 +170,7 @@ void* GThread::internalThreadProc(void* param) {
     GThread* current = reinterpret_cast<GThread*>(param);
     current->m_status = STATUS_RUNNING;
     current->threadMain();
+    System::flushThreadMallocCache();
     current->m_status = STATUS_COMPLETED;
     return (void*)NULL;
 }
@@ -4,7 +4,7 @@
   @maintainer Morgan McGuire, http://graphics.cs.williams.edu
 
   @created 2007-01-31
-  @edited  2007-01-31
+  @edited  2010-06-22
 */
 
 
@@ -61,6 +61,11 @@ Image3::Ref Image3::createEmpty(int width, int height, WrapMode wrap) {
 }
 
 
+void Image3::generateMipChain(Array<Ref>& chain, ResampleFilter filter, bool parallel) const {
+    buildMipChain(chain, &Image3::createEmpty, filter, parallel);
+}
+
+
 Image3::Ref Image3::createEmpty(WrapMode wrap) {
     return createEmpty(0, 0, wrap);
 }
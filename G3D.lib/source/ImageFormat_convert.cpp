@@ -5,6 +5,7 @@
 #include "G3D/Color1.h"
 #include "G3D/Color3.h"
 #include "G3D/Color4.h"
+#include "G3D/TaskScheduler.h"
 
 
 namespace G3D {
@@ -160,9 +161,10 @@ bool conversionAvailable(const ImageFormat* srcFormat, int srcRowPadBits, const
     return conversionAvailable;
 }
 
-bool ImageFormat::convert(const Array<const void*>& srcBytes, int srcWidth, int srcHeight, const ImageFormat* srcFormat, int srcRowPadBits,
+/** Converts the whole image on the calling thread */
+static bool convertSerial(const Array<const void*>& srcBytes, int srcWidth, int srcHeight, const ImageFormat* srcFormat, int srcRowPadBits,
                           const Array<void*>& dstBytes, const ImageFormat* dstFormat, int dstRowPadBits, 
-                          bool invertY, BayerAlgorithm bayerAlg) {
+                          bool invertY, ImageFormat::BayerAlgorithm bayerAlg) {
 
     bool conversionAvailable = false;
 
@@ -204,6 +206,382 @@ bool ImageFormat::convert(const Array<const void*>& srcBytes, int srcWidth, int
 }
 
 
+static bool isBayer(const ImageFormat* format) {
+    return (format->code >= ImageFormat::CODE_BAYER_RGGB8) && (format->code <= ImageFormat::CODE_BAYER_BGGR32F);
+}
+
+
+/** Byte offset of row \a y (which must be even) in \a plane */
+static size_t rowOffset(const ImageFormat* format, int width, int rowPadBits, int plane, int y) {
+    if (format->code == ImageFormat::CODE_YUV420_PLANAR) {
+        // Full resolution luminance, then two chrominance planes at half resolution
+        return (plane == 0) ? ((size_t)y * width) : ((size_t)(y / 2) * (width / 2));
+    } else {
+        return (size_t)y * (width * format->cpuBitsPerPixel + rowPadBits) / 8;
+    }
+}
+
+
+/** True if every row of every plane starts on a byte boundary, so that a band of rows can be converted as an image of its own */
+static bool byteAlignedRows(const ImageFormat* format, int width, int rowPadBits) {
+    return (format->code == ImageFormat::CODE_YUV420_PLANAR) || ((width * format->cpuBitsPerPixel + rowPadBits) % 8 == 0);
+}
+
+
+/** Converts bands of rows for ImageFormat::convert with parallel = true */
+class ConvertBands {
+public:
+    const Array<const void*>*       srcBytes;
+    int                             srcWidth;
+    int                             srcHeight;
+    const ImageFormat*              srcFormat;
+    int                             srcRowPadBits;
+    const Array<void*>*             dstBytes;
+    const ImageFormat*              dstFormat;
+    int                             dstRowPadBits;
+    bool                            invertY;
+    ImageFormat::BayerAlgorithm     bayerAlg;
+
+    /** Even, so that YUV 2x2 blocks are never split */
+    int                             bandHeight;
+
+    void operator()(int begin, int end) const {
+        Array<const void*> src;
+        Array<void*> dst;
+        for (int band = begin; band < end; ++band) {
+            const int y0 = band * bandHeight;
+            const int h  = iMin(bandHeight, srcHeight - y0);
+
+            // Destination rows [y0, y0 + h) come from the mirrored source rows when inverting.
+            // The converters invert within the band, which completes the flip.
+            const int srcY = invertY ? (srcHeight - y0 - h) : y0;
+
+            src.fastClear();
+            for (int p = 0; p < srcBytes->size(); ++p) {
+                src.append(static_cast<const uint8*>((*srcBytes)[p]) + rowOffset(srcFormat, srcWidth, srcRowPadBits, p, srcY));
+            }
+            dst.fastClear();
+            for (int p = 0; p < dstBytes->size(); ++p) {
+                dst.append(static_cast<uint8*>((*dstBytes)[p]) + rowOffset(dstFormat, srcWidth, dstRowPadBits, p, y0));
+            }
+
+            convertSerial(src, srcWidth, h, srcFormat, srcRowPadBits, dst, dstFormat, dstRowPadBits, invertY, bayerAlg);
+        }
+    }
+};
+
+
+bool ImageFormat::convert(const Array<const void*>& srcBytes, int srcWidth, int srcHeight, const ImageFormat* srcFormat, int srcRowPadBits,
+                          const Array<void*>& dstBytes, const ImageFormat* dstFormat, int dstRowPadBits, 
+                          bool invertY, BayerAlgorithm bayerAlg, bool parallel) {
+
+    // Plain copies are limited by memory bandwidth.  The Bayer filters
+    // read neighboring rows with wraparound at the image edges and
+    // rgb8_to_bayer skips the last row, so they must see the whole image.
+    const bool copy = (srcFormat->code == dstFormat->code) && (srcRowPadBits == dstRowPadBits) && ! invertY;
+    const int numThreads = TaskScheduler::global()->numWorkers() + 1;
+    const int minBandPixels = 64 * 1024;
+
+    if (! parallel || copy || (numThreads == 1) || isBayer(srcFormat) || isBayer(dstFormat) ||
+        ((size_t)srcWidth * srcHeight < (size_t)minBandPixels * 2) ||
+        ! byteAlignedRows(srcFormat, srcWidth, srcRowPadBits) || ! byteAlignedRows(dstFormat, srcWidth, dstRowPadBits)) {
+        return convertSerial(srcBytes, srcWidth, srcHeight, srcFormat, srcRowPadBits, dstBytes, dstFormat, dstRowPadBits, invertY, bayerAlg);
+    }
+
+    if (! G3D::conversionAvailable(srcFormat, srcRowPadBits, dstFormat, dstRowPadBits, invertY)) {
+        return false;
+    }
+
+    // Several bands per thread balance the load when some threads are busy elsewhere
+    int bandHeight = iMax(srcHeight / (numThreads * 4), iCeil(minBandPixels / (float)srcWidth));
+    bandHeight = iMin(srcHeight, bandHeight + (bandHeight & 1));
+
+    ConvertBands body;
+    body.srcBytes       = &srcBytes;
+    body.srcWidth       = srcWidth;
+    body.srcHeight      = srcHeight;
+    body.srcFormat      = srcFormat;
+    body.srcRowPadBits  = srcRowPadBits;
+    body.dstBytes       = &dstBytes;
+    body.dstFormat      = dstFormat;
+    body.dstRowPadBits  = dstRowPadBits;
+    body.invertY        = invertY;
+    body.bayerAlg       = bayerAlg;
+    body.bandHeight     = bandHeight;
+
+    const int numBands = (srcHeight + bandHeight - 1) / bandHeight;
+    TaskScheduler::global()->parallelFor(0, numBands, 1, body);
+
+    return true;
+}
+
+
+// *******************
+// SIMD kernels
+// *******************
+//
+// The most common converters hand whole rows to these kernels when the
+// processor supports them.  A row kernel converts as many pixels from
+// the start of the row as it can without touching memory past the end
+// of the row and returns that count; the converter finishes the row
+// with its scalar loop.  The scalar code is the reference: every kernel
+// produces bit-identical output.
+
+typedef int (*RowKernel)(const uint8* src, uint8* dst, int width);
+
+/** Converts two RGB8 rows of a YUV420 block row; returns the number of pixels (a multiple of 2) converted */
+typedef int (*YUV420Kernel)(const uint8* srcTop, const uint8* srcBottom, uint8* dstYTop, uint8* dstYBottom, uint8* dstU, uint8* dstV, int width);
+
+class ConvertKernels {
+public:
+    ImageFormat::SIMDLevel  level;
+
+    RowKernel       l8_to_rgb8;
+    RowKernel       rgb8_to_rgba8;
+    RowKernel       bgr8_to_rgba8;
+    /** rgb8_to_bgr8 and bgr8_to_rgb8 */
+    RowKernel       swap3x8;
+    RowKernel       rgba8_to_rgb8;
+    RowKernel       rgba8_to_bgr8;
+    RowKernel       rgb8_to_rgba32f;
+    RowKernel       bgr8_to_rgba32f;
+    RowKernel       rgba8_to_rgba32f;
+    RowKernel       rgba32f_to_rgb8;
+    RowKernel       rgba32f_to_bgr8;
+    RowKernel       rgba32f_to_rgba8;
+    YUV420Kernel    rgb8_to_yuv420p;
+};
+
+#if defined(G3D_WIN32) || defined(__i386__) || defined(__x86_64__)
+#   define G3D_CONVERT_SIMD
+#   include <emmintrin.h>
+#   include <tmmintrin.h>
+
+    // GCC only emits instructions beyond the compiler's target for functions that ask for them
+#   if defined(__GNUC__) && ! defined(__SSE2__)
+#       define G3D_TARGET_SSE2 __attribute__((target("sse2")))
+#   else
+#       define G3D_TARGET_SSE2
+#   endif
+#   if defined(__GNUC__) && ! defined(__SSSE3__)
+#       define G3D_TARGET_SSSE3 __attribute__((target("ssse3")))
+#   else
+#       define G3D_TARGET_SSSE3
+#   endif
+
+/** Four float channels to iMin(255, iFloor(c * 256)) truncated to the low byte, as Color4uint8(const Color4&) computes */
+static G3D_TARGET_SSE2 inline __m128i quantize_sse2(__m128 c) {
+    const __m128 v = _mm_mul_ps(c, _mm_set1_ps(256.0f));
+    __m128i i = _mm_cvttps_epi32(v);
+    // Truncation rounds negative values up; step those down to the floor
+    i = _mm_add_epi32(i, _mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(i), v)));
+    const __m128i max = _mm_set1_epi32(255);
+    const __m128i over = _mm_cmpgt_epi32(i, max);
+    i = _mm_or_si128(_mm_andnot_si128(over, i), _mm_and_si128(over, max));
+    return _mm_and_si128(i, max);
+}
+
+/** Four Color4 to four Color4uint8 */
+static G3D_TARGET_SSE2 inline __m128i quantize4_sse2(const float* src) {
+    const __m128i a = _mm_packs_epi32(quantize_sse2(_mm_loadu_ps(src)),      quantize_sse2(_mm_loadu_ps(src + 4)));
+    const __m128i b = _mm_packs_epi32(quantize_sse2(_mm_loadu_ps(src + 8)),  quantize_sse2(_mm_loadu_ps(src + 12)));
+    return _mm_packus_epi16(a, b);
+}
+
+static G3D_TARGET_SSE2 int rgba8_to_rgba32f_sse2(const uint8* src, uint8* _dst, int width) {
+    float* dst = reinterpret_cast<float*>(_dst);
+    const __m128i zero = _mm_setzero_si128();
+    // Color4(const Color4uint8&) multiplies by the reciprocal
+    const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+    int x = 0;
+    for (; x + 4 <= width; x += 4, src += 16, dst += 16) {
+        const __m128i p  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        const __m128i lo = _mm_unpacklo_epi8(p, zero);
+        const __m128i hi = _mm_unpackhi_epi8(p, zero);
+        _mm_storeu_ps(dst,      _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale));
+        _mm_storeu_ps(dst + 4,  _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale));
+        _mm_storeu_ps(dst + 8,  _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale));
+        _mm_storeu_ps(dst + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale));
+    }
+    return x;
+}
+
+static G3D_TARGET_SSE2 int rgba32f_to_rgba8_sse2(const uint8* _src, uint8* dst, int width) {
+    const float* src = reinterpret_cast<const float*>(_src);
+    int x = 0;
+    for (; x + 4 <= width; x += 4, src += 16, dst += 16) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), quantize4_sse2(src));
+    }
+    return x;
+}
+
+static G3D_TARGET_SSSE3 inline int shuffle3to4_ssse3(const uint8* src, uint8* dst, int width, __m128i mask) {
+    const __m128i alpha = _mm_set1_epi32(0xFF000000);
+    int x = 0;
+    // Four pixels per iteration; the 16-byte load needs 3 * x + 16 <= 3 * width
+    for (; x + 6 <= width; x += 4, src += 12, dst += 16) {
+        const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_or_si128(_mm_shuffle_epi8(p, mask), alpha));
+    }
+    return x;
+}
+
+static G3D_TARGET_SSSE3 int rgb8_to_rgba8_ssse3(const uint8* src, uint8* dst, int width) {
+    return shuffle3to4_ssse3(src, dst, width, _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1));
+}
+
+static G3D_TARGET_SSSE3 int bgr8_to_rgba8_ssse3(const uint8* src, uint8* dst, int width) {
+    return shuffle3to4_ssse3(src, dst, width, _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1));
+}
+
+static G3D_TARGET_SSSE3 int swap3x8_ssse3(const uint8* src, uint8* dst, int width) {
+    const __m128i mask = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+    int x = 0;
+    // Five pixels per iteration; byte 15 is rewritten by the next iteration
+    for (; x + 6 <= width; x += 5, src += 15, dst += 15) {
+        const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_shuffle_epi8(p, mask));
+    }
+    return x;
+}
+
+static G3D_TARGET_SSSE3 inline int shuffle4to3_ssse3(const uint8* src, uint8* dst, int width, __m128i mask) {
+    int x = 0;
+    for (; x + 4 <= width; x += 4, src += 16, dst += 12) {
+        const __m128i p = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)), mask);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), p);
+        *reinterpret_cast<int32*>(dst + 8) = _mm_cvtsi128_si32(_mm_srli_si128(p, 8));
+    }
+    return x;
+}
+
+static G3D_TARGET_SSSE3 int rgba8_to_rgb8_ssse3(const uint8* src, uint8* dst, int width) {
+    return shuffle4to3_ssse3(src, dst, width, _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1));
+}
+
+static G3D_TARGET_SSSE3 int rgba8_to_bgr8_ssse3(const uint8* src, uint8* dst, int width) {
+    return shuffle4to3_ssse3(src, dst, width, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+static G3D_TARGET_SSSE3 int l8_to_rgb8_ssse3(const uint8* src, uint8* dst, int width) {
+    const __m128i mask0 = _mm_setr_epi8(0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5);
+    const __m128i mask1 = _mm_setr_epi8(5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10);
+    const __m128i mask2 = _mm_setr_epi8(10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15);
+    int x = 0;
+    for (; x + 16 <= width; x += 16, src += 16, dst += 48) {
+        const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst),      _mm_shuffle_epi8(p, mask0));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), _mm_shuffle_epi8(p, mask1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 32), _mm_shuffle_epi8(p, mask2));
+    }
+    return x;
+}
+
+static G3D_TARGET_SSSE3 inline int expand3to32f_ssse3(const uint8* src, uint8* _dst, int width, int r, int g, int b) {
+    float* dst = reinterpret_cast<float*>(_dst);
+    // Color3(const Color3uint8&) divides rather than multiplying by the reciprocal
+    const __m128 scale = _mm_set1_ps(255.0f);
+    const __m128 alpha = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+    const __m128i mask0 = _mm_setr_epi8(r, -1, -1, -1, g, -1, -1, -1, b, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i step  = _mm_setr_epi8(3, 0, 0, 0, 3, 0, 0, 0, 3, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask1 = _mm_add_epi8(mask0, step);
+    const __m128i mask2 = _mm_add_epi8(mask1, step);
+    const __m128i mask3 = _mm_add_epi8(mask2, step);
+    int x = 0;
+    for (; x + 6 <= width; x += 4, src += 12, dst += 16) {
+        const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        _mm_storeu_ps(dst,      _mm_or_ps(_mm_div_ps(_mm_cvtepi32_ps(_mm_shuffle_epi8(p, mask0)), scale), alpha));
+        _mm_storeu_ps(dst + 4,  _mm_or_ps(_mm_div_ps(_mm_cvtepi32_ps(_mm_shuffle_epi8(p, mask1)), scale), alpha));
+        _mm_storeu_ps(dst + 8,  _mm_or_ps(_mm_div_ps(_mm_cvtepi32_ps(_mm_shuffle_epi8(p, mask2)), scale), alpha));
+        _mm_storeu_ps(dst + 12, _mm_or_ps(_mm_div_ps(_mm_cvtepi32_ps(_mm_shuffle_epi8(p, mask3)), scale), alpha));
+    }
+    return x;
+}
+
+static G3D_TARGET_SSSE3 int rgb8_to_rgba32f_ssse3(const uint8* src, uint8* dst, int width) {
+    return expand3to32f_ssse3(src, dst, width, 0, 1, 2);
+}
+
+static G3D_TARGET_SSSE3 int bgr8_to_rgba32f_ssse3(const uint8* src, uint8* dst, int width) {
+    return expand3to32f_ssse3(src, dst, width, 2, 1, 0);
+}
+
+static G3D_TARGET_SSSE3 inline int quantize4to3_ssse3(const uint8* _src, uint8* dst, int width, __m128i mask) {
+    const float* src = reinterpret_cast<const float*>(_src);
+    int x = 0;
+    for (; x + 4 <= width; x += 4, src += 16, dst += 12) {
+        const __m128i p = _mm_shuffle_epi8(quantize4_sse2(src), mask);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), p);
+        *reinterpret_cast<int32*>(dst + 8) = _mm_cvtsi128_si32(_mm_srli_si128(p, 8));
+    }
+    return x;
+}
+
+static G3D_TARGET_SSSE3 int rgba32f_to_rgb8_ssse3(const uint8* src, uint8* dst, int width) {
+    return quantize4to3_ssse3(src, dst, width, _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1));
+}
+
+static G3D_TARGET_SSSE3 int rgba32f_to_bgr8_ssse3(const uint8* src, uint8* dst, int width) {
+    return quantize4to3_ssse3(src, dst, width, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+/** Dot products of two pixels stored as 16-bit (r, g, b, 0) with \a coeff; the results are in 32-bit lanes 0 and 1 */
+static G3D_TARGET_SSE2 inline __m128i dot2_sse2(__m128i pixels, __m128i coeff) {
+    __m128i d = _mm_madd_epi16(pixels, coeff);
+    d = _mm_add_epi32(d, _mm_srli_epi64(d, 32));
+    return _mm_shuffle_epi32(d, _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+static G3D_TARGET_SSSE3 int rgb8_to_yuv420p_ssse3(const uint8* srcTop, const uint8* srcBottom, uint8* dstYTop, uint8* dstYBottom, uint8* dstU, uint8* dstV, int width) {
+    const __m128i coeffY  = _mm_setr_epi16(66, 129, 25, 0, 66, 129, 25, 0);
+    const __m128i coeffUV = _mm_setr_epi16(-38, -74, 112, 0, 112, -94, -18, 0);
+    const __m128i round   = _mm_set1_epi32(128);
+    const __m128i offsetY = _mm_set1_epi32(16);
+    const __m128i offsetUV = _mm_set1_epi32(128);
+    const __m128i one     = _mm_set1_epi8(1);
+    // Pixels 0 and 1, and 2 and 3, widened to 16-bit (r, g, b, 0)
+    const __m128i lo      = _mm_setr_epi8(0, -1, 1, -1, 2, -1, -1, -1, 3, -1, 4, -1, 5, -1, -1, -1);
+    const __m128i hi      = _mm_setr_epi8(6, -1, 7, -1, 8, -1, -1, -1, 9, -1, 10, -1, 11, -1, -1, -1);
+    // Pixel 0 twice, pixel 2 twice, for the U and V coefficients
+    const __m128i chroma0 = _mm_setr_epi8(0, -1, 1, -1, 2, -1, -1, -1, 0, -1, 1, -1, 2, -1, -1, -1);
+    const __m128i chroma2 = _mm_setr_epi8(6, -1, 7, -1, 8, -1, -1, -1, 6, -1, 7, -1, 8, -1, -1, -1);
+
+    int x = 0;
+    for (; x + 6 <= width; x += 4, srcTop += 12, srcBottom += 12) {
+        const __m128i top    = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcTop));
+        const __m128i bottom = _mm_loadu_si128(reinterpret_cast<const __m128i*>(srcBottom));
+
+        // Luminance of all eight pixels
+        const __m128i yTop    = _mm_unpacklo_epi64(dot2_sse2(_mm_shuffle_epi8(top, lo), coeffY),    dot2_sse2(_mm_shuffle_epi8(top, hi), coeffY));
+        const __m128i yBottom = _mm_unpacklo_epi64(dot2_sse2(_mm_shuffle_epi8(bottom, lo), coeffY), dot2_sse2(_mm_shuffle_epi8(bottom, hi), coeffY));
+        const __m128i y8 = _mm_packus_epi16(_mm_packs_epi32(
+            _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(yTop, round), 8), offsetY),
+            _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(yBottom, round), 8), offsetY)), _mm_setzero_si128());
+        *reinterpret_cast<int32*>(dstYTop + x)    = _mm_cvtsi128_si32(y8);
+        *reinterpret_cast<int32*>(dstYBottom + x) = _mm_cvtsi128_si32(_mm_srli_si128(y8, 4));
+
+        // Chrominance from the truncated average of each block's left column, as blendPixels computes
+        const __m128i average = _mm_sub_epi8(_mm_avg_epu8(top, bottom), _mm_and_si128(_mm_xor_si128(top, bottom), one));
+        // (u0, v0) and (u2, v2), then (u0, u2, v0, v2)
+        const __m128i uv0 = dot2_sse2(_mm_shuffle_epi8(average, chroma0), coeffUV);
+        const __m128i uv2 = dot2_sse2(_mm_shuffle_epi8(average, chroma2), coeffUV);
+        const __m128i uv  = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(_mm_unpacklo_epi32(uv0, uv2), round), 8), offsetUV);
+        const int32 uv8   = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(uv, uv), _mm_setzero_si128()));
+        const int uvIndex = x / 2;
+        dstU[uvIndex]     = uv8 & 0xFF;
+        dstU[uvIndex + 1] = (uv8 >> 8) & 0xFF;
+        dstV[uvIndex]     = (uv8 >> 16) & 0xFF;
+        dstV[uvIndex + 1] = (uv8 >> 24) & 0xFF;
+    }
+    return x;
+}
+
+#endif // G3D_CONVERT_SIMD
+
+/** The kernels for the current ImageFormat::convertSIMDLevel(); NULL entries use the scalar code */
+static const ConvertKernels& convertKernels();
+
+
 // *******************
 // RGB -> RGB color space conversions
 // *******************
@@ -214,14 +592,21 @@ static void l8_to_rgb8(const Array<const void*>& srcBytes, int srcWidth, int src
     (void)dstRowPadBits;
     uint8* dst = static_cast<uint8*>(dstBytes[0]);
     const uint8* src = static_cast<const uint8*>(srcBytes[0]);
+    const RowKernel kernel = convertKernels().l8_to_rgb8;
     for (int y = 0; y < srcHeight; ++y) {
-        for (int x = 0; x < srcWidth; ++x) {
-            int i = (invertY) ? ((srcHeight-1-y) * srcWidth +x) : (y * srcWidth + x);
-            int i3 = i * 3;
-
-            dst[i3 + 0] = src[i]; 
-            dst[i3 + 1] = src[i]; 
-            dst[i3 + 2] = src[i]; 
+        const int srcRow = (invertY) ? (srcHeight - 1 - y) : y;
+        int x = 0;
+        if (kernel) {
+            x = kernel(src + srcRow * srcWidth, dst + y * srcWidth * 3, srcWidth);
+        }
+        for (; x < srcWidth; ++x) {
+            int i = srcRow * srcWidth + x;
+            int j = y * srcWidth + x;
+            int j3 = j * 3;
+
+            dst[j3 + 0] = src[i]; 
+            dst[j3 + 1] = src[i]; 
+            dst[j3 + 2] = src[i]; 
         }
     }
 }
@@ -252,16 +637,23 @@ static void l32f_to_rgb8(const Array<const void*>& srcBytes, int srcWidth, int s
 static void rgb8_to_rgba8(const Array<const void*>& srcBytes, int srcWidth, int srcHeight, const ImageFormat* srcFormat, int srcRowPadBits, const Array<void*>& dstBytes, const ImageFormat* dstFormat, int dstRowPadBits, bool invertY, ImageFormat::BayerAlgorithm bayerAlg) {
     uint8* dst = static_cast<uint8*>(dstBytes[0]);
     const uint8* src = static_cast<const uint8*>(srcBytes[0]);
+    const RowKernel kernel = convertKernels().rgb8_to_rgba8;
     for (int y = 0; y < srcHeight; ++y) {
-        for (int x = 0; x < srcWidth; ++x) {
-            int i = (invertY) ? ((srcHeight-1-y) * srcWidth +x) : (y * srcWidth + x);
+        const int srcRow = (invertY) ? (srcHeight - 1 - y) : y;
+        int x = 0;
+        if (kernel) {
+            x = kernel(src + srcRow * srcWidth * 3, dst + y * srcWidth * 4, srcWidth);
+        }
+        for (; x < srcWidth; ++x) {
+            int i = srcRow * srcWidth + x;
+            int j = y * srcWidth + x;
             int i3 = i * 3;
-            int i4 = i3 + i; 
+            int j4 = j * 4;
 
-            dst[i4 + 0] = src[i3 + 0]; 
-            dst[i4 + 1] = src[i3 + 1]; 
-            dst[i4 + 2] = src[i3 + 2]; 
-            dst[i4 + 3] = 255; 
+            dst[j4 + 0] = src[i3 + 0]; 
+            dst[j4 + 1] = src[i3 + 1]; 
+            dst[j4 + 2] = src[i3 + 2]; 
+            dst[j4 + 3] = 255; 
         }
     }
 }
@@ -269,13 +661,21 @@ static void rgb8_to_rgba8(const Array<const void*>& srcBytes, int srcWidth, int
 static void rgb8_to_bgr8(const Array<const void*>& srcBytes, int srcWidth, int srcHeight, const ImageFormat* srcFormat, int srcRowPadBits, const Array<void*>& dstBytes, const ImageFormat* dstFormat, int dstRowPadBits, bool invertY, ImageFormat::BayerAlgorithm bayerAlg) {
     uint8* dst = static_cast<uint8*>(dstBytes[0]);
     const uint8* src = static_cast<const uint8*>(srcBytes[0]);
+    const RowKernel kernel = convertKernels().swap3x8;
     for (int y = 0; y < srcHeight; ++y) {
-        for (int x = 0; x < srcWidth; ++x) {
-            int i = (invertY) ? ((srcHeight-1-y) * srcWidth +x) : (y * srcWidth + x);
+        const int srcRow = (invertY) ? (srcHeight - 1 - y) : y;
+        int x = 0;
+        if (kernel) {
+            x = kernel(src + srcRow * srcWidth * 3, dst + y * srcWidth * 3, srcWidth);
+        }
+        for (; x < srcWidth; ++x) {
+            int i = srcRow * srcWidth + x;
+            int j = y * srcWidth + x;
             int i3 = i * 3;
-            dst[i3 + 0] = src[i3 + 2];
-            dst[i3 + 1] = src[i3 + 1];
-            dst[i3 + 2] = src[i3 + 0];
+            int j3 = j * 3;
+            dst[j3 + 0] = src[i3 + 2];
+            dst[j3 + 1] = src[i3 + 1];
+            dst[j3 + 2] = src[i3 + 0];
         }
     }
 }
@@ -289,11 +689,18 @@ static void rgb8_to_rgba32f(const Array<const void*>& srcBytes, int srcWidth, in
     Color4* dst = static_cast<Color4*>(dstBytes[0]);
     const uint8* src = static_cast<const uint8*>(srcBytes[0]);
 
+    const RowKernel kernel = convertKernels().rgb8_to_rgba32f;
     for (int y = 0; y < srcHeight; ++y) {
         if (invertY) {
             dstIndex = srcWidth * (srcHeight - 1 - y);
         }
-        for (int x = 0; x < srcWidth; ++x, ++dstIndex, srcByteOffset += 3) {
+        int x = 0;
+        if (kernel) {
+            x = kernel(src + srcByteOffset, reinterpret_cast<uint8*>(dst + dstIndex), srcWidth);
+            dstIndex += x;
+            srcByteOffset += x * 3;
+        }
+        for (; x < srcWidth; ++x, ++dstIndex, srcByteOffset += 3) {
             const Color3uint8& s = *reinterpret_cast<const Color3uint8*>(src + srcByteOffset);
             dst[dstIndex] = Color4(Color3(s), 1.0f);
         }
@@ -305,13 +712,21 @@ static void rgb8_to_rgba32f(const Array<const void*>& srcBytes, int srcWidth, in
 static void bgr8_to_rgb8(const Array<const void*>& srcBytes, int srcWidth, int srcHeight, const ImageFormat* srcFormat, int srcRowPadBits, const Array<void*>& dstBytes, const ImageFormat* dstFormat, int dstRowPadBits, bool invertY, ImageFormat::BayerAlgorithm bayerAlg) {
     uint8* dst = static_cast<uint8*>(dstBytes[0]);
     const uint8* src = static_cast<const uint8*>(srcBytes[0]);
+    const RowKernel kernel = convertKernels().swap3x8;
     for (int y = 0; y < srcHeight; ++y) {
-        for (int x = 0; x < srcWidth; ++x) {
-            int i = (invertY) ? ((srcHeight-1-y) * srcWidth +x) : (y * srcWidth + x);
+        const int srcRow = (invertY) ? (srcHeight - 1 - y) : y;
+        int x = 0;
+        if (kernel) {
+            x = kernel(src + srcRow * srcWidth * 3, dst + y * srcWidth * 3, srcWidth);
+        }
+        for (; x < srcWidth; ++x) {
+            int i = srcRow * srcWidth + x;
+            int j = y * srcWidth + x;
             int i3 = i * 3;
-            dst[i3 + 0] = src[i3 + 2];
-            dst[i3 + 1] = src[i3 + 1];
-            dst[i3 + 2] = src[i3 + 0];
+            int j3 = j * 3;
+            dst[j3 + 0] = src[i3 + 2];
+            dst[j3 + 1] = src[i3 + 1];
+            dst[j3 + 2] = src[i3 + 0];
         }
     }
 }
@@ -319,16 +734,23 @@ static void bgr8_to_rgb8(const Array<const void*>& srcBytes, int srcWidth, int s
 static void bgr8_to_rgba8(const Array<const void*>& srcBytes, int srcWidth, int srcHeight, const ImageFormat* srcFormat, int srcRowPadBits, const Array<void*>& dstBytes, const ImageFormat* dstFormat, int dstRowPadBits, bool invertY, ImageFormat::BayerAlgorithm bayerAlg) {
     uint8* dst = static_cast<uint8*>(dstBytes[0]);
     const uint8* src = static_cast<const uint8*>(srcBytes[0]);
+    const RowKernel kernel = convertKernels().bgr8_to_rgba8;
     for (int y = 0; y < srcHeight; ++y) {
-        for (int x = 0; x < srcWidth; ++x) {
-            int i = (invertY) ? ((srcHeight-1-y) * srcWidth +x) : (y * srcWidth + x);
+        const int srcRow = (invertY) ? (srcHeight - 1 - y) : y;
+        int x = 0;
+        if (kernel) {
+            x = kernel(src + srcRow * srcWidth * 3, dst + y * srcWidth * 4, srcWidth);
+        }
+        for (; x < srcWidth; ++x) {
+            int i = srcRow * srcWidth + x;
+            int j = y * srcWidth + x;
             int i3 = i * 3;
-            int i4 = i3 + i; 
+            int j4 = j * 4;
 
-            dst[i4 + 0] = src[i3 + 2]; 
-            dst[i4 + 1] = src[i3 + 1]; 
-            dst[i4 + 2] = src[i3 + 0]; 
-            dst[i4 + 3] = 255; 
+            dst[j4 + 0] = src[i3 + 2]; 
+            dst[j4 + 1] = src[i3 + 1]; 
+            dst[j4 + 2] = src[i3 + 0]; 
+            dst[j4 + 3] = 255; 
         }
     }
 }
@@ -342,12 +764,19 @@ static void bgr8_to_rgba32f(const Array<const void*>& srcBytes, int srcWidth, in
     Color4* dst = static_cast<Color4*>(dstBytes[0]);
     const uint8* src = static_cast<const uint8*>(srcBytes[0]);
 
+    const RowKernel kernel = convertKernels().bgr8_to_rgba32f;
     for (int y = 0; y < srcHeight; ++y) {
         if (invertY) {
             dstIndex = srcWidth * (srcHeight - 1 - y);
         }
 
-        for (int x = 0; x < srcWidth; ++x, ++dstIndex, srcByteOffset += 3) {
+        int x = 0;
+        if (kernel) {
+            x = kernel(src + srcByteOffset, reinterpret_cast<uint8*>(dst + dstIndex), srcWidth);
+            dstIndex += x;
+            srcByteOffset += x * 3;
+        }
+        for (; x < srcWidth; ++x, ++dstIndex, srcByteOffset += 3) {
             const Color3uint8& s = *reinterpret_cast<const Color3uint8*>(src + srcByteOffset);
             dst[dstIndex] = Color4(Color3(s).bgr(), 1.0f);
         }
@@ -359,15 +788,22 @@ static void bgr8_to_rgba32f(const Array<const void*>& srcBytes, int srcWidth, in
 static void rgba8_to_rgb8(const Array<const void*>& srcBytes, int srcWidth, int srcHeight, const ImageFormat* srcFormat, int srcRowPadBits, const Array<void*>& dstBytes, const ImageFormat* dstFormat, int dstRowPadBits, bool invertY, ImageFormat::BayerAlgorithm bayerAlg) {
     uint8* dst = static_cast<uint8*>(dstBytes[0]);
     const uint8* src = static_cast<const uint8*>(srcBytes[0]);
+    const RowKernel kernel = convertKernels().rgba8_to_rgb8;
     for (int y = 0; y < srcHeight; ++y) {
-        for (int x = 0; x < srcWidth; ++x) {
-            int i = (invertY) ? ((srcHeight-1-y) * srcWidth +x) : (y * srcWidth + x);
-            int i3 = i * 3;
-            int i4 = i3 + i;
-
-            dst[i3 + 0] = src[i4 + 0]; 
-            dst[i3 + 1] = src[i4 + 1]; 
-            dst[i3 + 2] = src[i4 + 2]; 
+        const int srcRow = (invertY) ? (srcHeight - 1 - y) : y;
+        int x = 0;
+        if (kernel) {
+            x = kernel(src + srcRow * srcWidth * 4, dst + y * srcWidth * 3, srcWidth);
+        }
+        for (; x < srcWidth; ++x) {
+            int i = srcRow * srcWidth + x;
+            int j = y * srcWidth + x;
+            int i4 = i * 4;
+            int j3 = j * 3;
+
+            dst[j3 + 0] = src[i4 + 0]; 
+            dst[j3 + 1] = src[i4 + 1]; 
+            dst[j3 + 2] = src[i4 + 2]; 
         }
     }
 }
@@ -375,15 +811,22 @@ static void rgba8_to_rgb8(const Array<const void*>& srcBytes, int srcWidth, int
 static void rgba8_to_bgr8(const Array<const void*>& srcBytes, int srcWidth, int srcHeight, const ImageFormat* srcFormat, int srcRowPadBits, const Array<void*>& dstBytes, const ImageFormat* dstFormat, int dstRowPadBits, bool invertY, ImageFormat::BayerAlgorithm bayerAlg) {
     uint8* dst = static_cast<uint8*>(dstBytes[0]);
     const uint8* src = static_cast<const uint8*>(srcBytes[0]);
+    const RowKernel kernel = convertKernels().rgba8_to_bgr8;
     for (int y = 0; y < srcHeight; ++y) {
-        for (int x = 0; x < srcWidth; ++x) {
-            int i = (invertY) ? ((srcHeight-1-y) * srcWidth +x) : (y * srcWidth + x);
-            int i3 = i * 3;
-            int i4 = i3 + i;
-
-            dst[i3 + 0] = src[i4 + 2]; 
-            dst[i3 + 1] = src[i4 + 1]; 
-            dst[i3 + 2] = src[i4 + 0]; 
+        const int srcRow = (invertY) ? (srcHeight - 1 - y) : y;
+        int x = 0;
+        if (kernel) {
+            x = kernel(src + srcRow * srcWidth * 4, dst + y * srcWidth * 3, srcWidth);
+        }
+        for (; x < srcWidth; ++x) {
+            int i = srcRow * srcWidth + x;
+            int j = y * srcWidth + x;
+            int i4 = i * 4;
+            int j3 = j * 3;
+
+            dst[j3 + 0] = src[i4 + 2]; 
+            dst[j3 + 1] = src[i4 + 1]; 
+            dst[j3 + 2] = src[i4 + 0]; 
         }
     }
 }
@@ -397,12 +840,19 @@ static void rgba8_to_rgba32f(const Array<const void*>& srcBytes, int srcWidth, i
     Color4* dst = static_cast<Color4*>(dstBytes[0]);
     const uint8* src = static_cast<const uint8*>(srcBytes[0]);
 
+    const RowKernel kernel = convertKernels().rgba8_to_rgba32f;
     for (int y = 0; y < srcHeight; ++y) {
         if (invertY) {
             dstIndex = srcWidth * (srcHeight - 1 - y);
         }
 
-        for (int x = 0; x < srcWidth; ++x, ++dstIndex, srcByteOffset += 4) {
+        int x = 0;
+        if (kernel) {
+            x = kernel(src + srcByteOffset, reinterpret_cast<uint8*>(dst + dstIndex), srcWidth);
+            dstIndex += x;
+            srcByteOffset += x * 4;
+        }
+        for (; x < srcWidth; ++x, ++dstIndex, srcByteOffset += 4) {
             const Color4uint8& s = *reinterpret_cast<const Color4uint8*>(src + srcByteOffset);
             dst[dstIndex] = Color4(s);
         }
@@ -443,12 +893,19 @@ static void rgba32f_to_rgb8(const Array<const void*>& srcBytes, int srcWidth, in
     uint8* dst = static_cast<uint8*>(dstBytes[0]);
     const Color4* src = static_cast<const Color4*>(srcBytes[0]);
 
+    const RowKernel kernel = convertKernels().rgba32f_to_rgb8;
     for (int y = 0; y < srcHeight; ++y) {
         if (invertY) {
             srcIndex = srcWidth * (srcHeight - y - 1);
         }
         
-        for (int x = 0; x < srcWidth; ++x, ++srcIndex, dstByteOffset += 3) {
+        int x = 0;
+        if (kernel) {
+            x = kernel(reinterpret_cast<const uint8*>(src + srcIndex), dst + dstByteOffset, srcWidth);
+            srcIndex += x;
+            dstByteOffset += x * 3;
+        }
+        for (; x < srcWidth; ++x, ++srcIndex, dstByteOffset += 3) {
             Color3uint8&  d = *reinterpret_cast<Color3uint8*>(dst + dstByteOffset);
             const Color4& s = src[srcIndex];
 
@@ -467,11 +924,18 @@ static void rgba32f_to_rgba8(const Array<const void*>& srcBytes, int srcWidth, i
     uint8* dst = static_cast<uint8*>(dstBytes[0]);
     const Color4* src = static_cast<const Color4*>(srcBytes[0]);
 
+    const RowKernel kernel = convertKernels().rgba32f_to_rgba8;
     for (int y = 0; y < srcHeight; ++y) {
         if (invertY) {
             srcIndex = srcWidth * (srcHeight - 1 - y);
         }
-        for (int x = 0; x < srcWidth; ++x, ++srcIndex, dstByteOffset += 4) {
+        int x = 0;
+        if (kernel) {
+            x = kernel(reinterpret_cast<const uint8*>(src + srcIndex), dst + dstByteOffset, srcWidth);
+            srcIndex += x;
+            dstByteOffset += x * 4;
+        }
+        for (; x < srcWidth; ++x, ++srcIndex, dstByteOffset += 4) {
             Color4uint8&  d = *reinterpret_cast<Color4uint8*>(dst + dstByteOffset);
             const Color4& s = src[srcIndex];
 
@@ -490,12 +954,19 @@ static void rgba32f_to_bgr8(const Array<const void*>& srcBytes, int srcWidth, in
     uint8* dst = static_cast<uint8*>(dstBytes[0]);
     const Color4* src = static_cast<const Color4*>(srcBytes[0]);
 
+    const RowKernel kernel = convertKernels().rgba32f_to_bgr8;
     for (int y = 0; y < srcHeight; ++y) {
         if (invertY) {
             srcIndex = srcWidth * (srcHeight - y - 1);
         }
         
-        for (int x = 0; x < srcWidth; ++x, ++srcIndex, dstByteOffset += 3) {
+        int x = 0;
+        if (kernel) {
+            x = kernel(reinterpret_cast<const uint8*>(src + srcIndex), dst + dstByteOffset, srcWidth);
+            srcIndex += x;
+            dstByteOffset += x * 3;
+        }
+        for (; x < srcWidth; ++x, ++srcIndex, dstByteOffset += 3) {
             Color3uint8&  d = *reinterpret_cast<Color3uint8*>(dst + dstByteOffset);
             const Color4& s = src[srcIndex];
 
@@ -559,8 +1030,14 @@ static void rgb8_to_yuv420p(const Array<const void*>& srcBytes, int srcWidth, in
     uint8* dstU = static_cast<uint8*>(dstBytes[1]);
     uint8* dstV = static_cast<uint8*>(dstBytes[2]);
 
+    const YUV420Kernel kernel = convertKernels().rgb8_to_yuv420p;
     for (int y = 0; y < srcHeight; y += 2) {
-        for (int x = 0; x < srcWidth; x += 2) {
+        int x = 0;
+        if (kernel) {
+            x = kernel(reinterpret_cast<const uint8*>(src + y * srcWidth), reinterpret_cast<const uint8*>(src + (y + 1) * srcWidth),
+                       dstY + y * srcWidth, dstY + (y + 1) * srcWidth, dstU + y / 2 * srcWidth / 2, dstV + y / 2 * srcWidth / 2, srcWidth);
+        }
+        for (; x < srcWidth; x += 2) {
 
             // convert 4-pixel block at a time
             int srcPixelOffset0 = y * srcWidth + x;
@@ -1302,6 +1779,68 @@ static void bayer_bggr8_to_rgba32f(const Array<const void*>& srcBytes, int srcWi
 
 
 
+// *******************
+// SIMD kernel selection
+// *******************
+
+static ImageFormat::SIMDLevel supportedSIMDLevel() {
+#   ifdef G3D_CONVERT_SIMD
+        if (System::hasSSSE3()) {
+            return ImageFormat::SIMD_SSSE3;
+        } else if (System::hasSSE2()) {
+            return ImageFormat::SIMD_SSE2;
+        }
+#   endif
+    return ImageFormat::SIMD_NONE;
+}
+
+static ConvertKernels   s_convertKernels;
+static bool             s_convertKernelsInitialized = false;
+
+static void selectConvertKernels(ImageFormat::SIMDLevel maxLevel) {
+    ConvertKernels& k = s_convertKernels;
+    System::memset(&k, 0, sizeof(k));
+    k.level = (ImageFormat::SIMDLevel)iMin(maxLevel, supportedSIMDLevel());
+
+#   ifdef G3D_CONVERT_SIMD
+        if (k.level >= ImageFormat::SIMD_SSE2) {
+            k.rgba8_to_rgba32f  = rgba8_to_rgba32f_sse2;
+            k.rgba32f_to_rgba8  = rgba32f_to_rgba8_sse2;
+        }
+
+        if (k.level >= ImageFormat::SIMD_SSSE3) {
+            k.l8_to_rgb8        = l8_to_rgb8_ssse3;
+            k.rgb8_to_rgba8     = rgb8_to_rgba8_ssse3;
+            k.bgr8_to_rgba8     = bgr8_to_rgba8_ssse3;
+            k.swap3x8           = swap3x8_ssse3;
+            k.rgba8_to_rgb8     = rgba8_to_rgb8_ssse3;
+            k.rgba8_to_bgr8     = rgba8_to_bgr8_ssse3;
+            k.rgb8_to_rgba32f   = rgb8_to_rgba32f_ssse3;
+            k.bgr8_to_rgba32f   = bgr8_to_rgba32f_ssse3;
+            k.rgba32f_to_rgb8   = rgba32f_to_rgb8_ssse3;
+            k.rgba32f_to_bgr8   = rgba32f_to_bgr8_ssse3;
+            k.rgb8_to_yuv420p   = rgb8_to_yuv420p_ssse3;
+        }
+#   endif
+
+    s_convertKernelsInitialized = true;
+}
+
+static const ConvertKernels& convertKernels() {
+    if (! s_convertKernelsInitialized) {
+        selectConvertKernels(ImageFormat::SIMD_SSSE3);
+    }
+    return s_convertKernels;
+}
+
+ImageFormat::SIMDLevel ImageFormat::convertSIMDLevel() {
+    return convertKernels().level;
+}
+
+void ImageFormat::setConvertSIMDLevel(SIMDLevel maxLevel) {
+    selectConvertKernels(maxLevel);
+}
+
 ///////////////////////////////////////////////////
 
 } // namespace G3D
@@ -0,0 +1,318 @@
+/**
+  @file ImageLoader.cpp
+
+  Asynchronous image decoding with an LRU cache.
+ */
+
+#include "G3D/ImageLoader.h"
+#include "G3D/BinaryInput.h"
+#include "G3D/FileSystem.h"
+#include "G3D/debugAssert.h"
+
+namespace G3D {
+
+ImageLoader::Future::Future(const std::string& filename, int64 modificationTime, const TaskScheduler::Ref& scheduler) :
+    m_filename(filename),
+    m_modificationTime(modificationTime),
+    m_ready(0),
+    m_group(scheduler),
+    m_loader(NULL),
+    m_finished(0) {
+}
+
+
+ImageLoader::Future::~Future() {
+    // The task must not outlive the members that it writes
+    m_group.wait();
+}
+
+
+void ImageLoader::Future::wait() const {
+    if (! isReady()) {
+        m_group.wait();
+    }
+    debugAssert(isReady());
+}
+
+
+void ImageLoader::Future::fail(const std::string& error) {
+    m_image.clear();
+    m_error = error.empty() ? "Unknown error" : error;
+    m_ready.releaseSet(1);
+}
+
+
+void ImageLoader::Future::run() {
+    decode();
+
+    m_loader->requestTrim();
+    m_finished.releaseSet(1);
+}
+
+
+void ImageLoader::Future::decode() {
+    try {
+        // Memory mapped, so pages are read as the decoder consumes them
+        BinaryInput* input = new BinaryInput(m_filename, G3D_LITTLE_ENDIAN, false, true);
+
+        if (input->size() <= 0) {
+            delete input;
+            fail("File not found.");
+            return;
+        }
+
+        try {
+            m_image.decode(*input, GImage::AUTODETECT);
+        } catch (...) {
+            delete input;
+            throw;
+        }
+        delete input;
+
+    } catch (const GImage::Error& e) {
+        fail(e.reason);
+        return;
+    } catch (const std::string& e) {
+        fail(e);
+        return;
+    } catch (...) {
+        fail("Could not decode the image.");
+        return;
+    }
+
+    m_ready.releaseSet(1);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+void ImageLoader::TrimTask::run() {
+    int32 requests;
+    do {
+        requests = loader->m_trimRequests.value();
+
+        // Released after the lock
+        Array<Future::Ref> released;
+        {
+            GMutexLock lock(&loader->m_mutex);
+            loader->trimCacheLocked(released);
+        }
+    } while (loader->m_trimRequests.compareAndSet(requests, 0) != requests);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+ImageLoader::ImageLoader(int64 maxCacheSize, const TaskScheduler::Ref& scheduler) :
+    m_scheduler(scheduler),
+    m_trimGroup(scheduler),
+    m_trimRequests(0),
+    m_maxCacheSize(maxCacheSize),
+    m_clock(0),
+    m_numCacheHits(0),
+    m_numCacheMisses(0) {
+
+    debugAssertM(maxCacheSize >= 0, "Cache size must not be negative");
+    m_trimTask.loader = this;
+}
+
+
+ImageLoader::~ImageLoader() {
+    Array<Future::Ref> decoding;
+    {
+        GMutexLock lock(&m_mutex);
+        decoding = m_decoding;
+    }
+
+    // Decode tasks notify this loader, and each notification may queue m_trimTask
+    for (int i = 0; i < decoding.size(); ++i) {
+        decoding[i]->m_group.wait();
+    }
+    m_trimGroup.wait();
+}
+
+
+ImageLoader::Ref ImageLoader::create(int64 maxCacheSize, const TaskScheduler::Ref& scheduler) {
+    return new ImageLoader(maxCacheSize, scheduler);
+}
+
+
+void ImageLoader::requestTrim() {
+    if (m_trimRequests.add(1) == 0) {
+        m_trimGroup.run(&m_trimTask);
+    }
+}
+
+
+ImageLoader::Future::Ref ImageLoader::loadLocked(const std::string& path, int64 modificationTime, Array<Future::Ref>& released) {
+    ++m_clock;
+
+    CacheEntry* entry = m_cache.getPointer(path);
+    if ((entry != NULL) && (entry->future->m_modificationTime == modificationTime) && (modificationTime != -1)) {
+        // A failed load is only retried once the cache is trimmed
+        entry->lastUse = m_clock;
+        ++m_numCacheHits;
+        return entry->future;
+    }
+
+    Future::Ref future = new Future(path, modificationTime, m_scheduler);
+    if (modificationTime == -1) {
+        future->fail("File not found.");
+        if (entry != NULL) {
+            released.append(entry->future);
+            m_cache.remove(path);
+        }
+        return future;
+    }
+
+    ++m_numCacheMisses;
+    if (entry != NULL) {
+        released.append(entry->future);
+    }
+    CacheEntry e;
+    e.future  = future;
+    e.lastUse = m_clock;
+    m_cache.set(path, e);
+
+    future->m_loader = this;
+    m_decoding.append(future);
+    future->m_group.run(static_cast<Task*>(future.pointer()));
+    return future;
+}
+
+
+ImageLoader::Future::Ref ImageLoader::load(const std::string& filename) {
+    // Touches the disk (or a zipfile), so it is kept outside of the lock
+    const std::string path = FileSystem::resolve(filename);
+    const int64 modificationTime = FileSystem::modificationTime(path);
+
+    // Declared first so that it is destroyed after the lock is released
+    Array<Future::Ref> released;
+    GMutexLock lock(&m_mutex);
+    trimCacheLocked(released);
+    return loadLocked(path, modificationTime, released);
+}
+
+
+void ImageLoader::load(const Array<std::string>& filenameArray, Array<Future::Ref>& futureArray) {
+    Array<std::string> path;
+    Array<int64> modificationTime;
+    path.resize(filenameArray.size());
+    modificationTime.resize(filenameArray.size());
+    for (int i = 0; i < filenameArray.size(); ++i) {
+        path[i] = FileSystem::resolve(filenameArray[i]);
+        modificationTime[i] = FileSystem::modificationTime(path[i]);
+    }
+
+    Array<Future::Ref> released;
+    GMutexLock lock(&m_mutex);
+    trimCacheLocked(released);
+    futureArray.resize(filenameArray.size());
+    for (int i = 0; i < filenameArray.size(); ++i) {
+        futureArray[i] = loadLocked(path[i], modificationTime[i], released);
+    }
+}
+
+
+void ImageLoader::trimCacheLocked(Array<Future::Ref>& released) {
+    for (int i = 0; i < m_decoding.size(); ++i) {
+        if (m_decoding[i]->m_finished.acquireValue() != 0) {
+            released.append(m_decoding[i]);
+            m_decoding.fastRemove(i);
+            --i;
+        }
+    }
+
+    Array<std::string> failed;
+    Array<CacheEntry*> ready;
+    int64 size = 0;
+    for (Table<std::string, CacheEntry>::Iterator it = m_cache.begin(); it != m_cache.end(); ++it) {
+        const Future::Ref& future = it->value.future;
+        if (future->isReady()) {
+            if (future->m_error.empty()) {
+                size += future->m_image.sizeInMemory();
+                ready.append(&it->value);
+            } else {
+                failed.append(it->key);
+            }
+        }
+    }
+
+    if (size > m_maxCacheSize) {
+        ready.sort(LastUseLessThan());
+        Array<std::string> evicted;
+        for (int i = 0; (i < ready.size()) && (size > m_maxCacheSize); ++i) {
+            size -= ready[i]->future->m_image.sizeInMemory();
+            released.append(ready[i]->future);
+            evicted.append(ready[i]->future->m_filename);
+        }
+        for (int i = 0; i < evicted.size(); ++i) {
+            m_cache.remove(evicted[i]);
+        }
+    }
+
+    for (int i = 0; i < failed.size(); ++i) {
+        released.append(m_cache[failed[i]].future);
+        m_cache.remove(failed[i]);
+    }
+}
+
+
+int64 ImageLoader::cacheSizeLocked() const {
+    int64 size = 0;
+    for (Table<std::string, CacheEntry>::Iterator it = m_cache.begin(); it != m_cache.end(); ++it) {
+        const Future::Ref& future = it->value.future;
+        if (future->isReady()) {
+            size += future->m_image.sizeInMemory();
+        }
+    }
+    return size;
+}
+
+
+int64 ImageLoader::cacheSize() const {
+    GMutexLock lock(&m_mutex);
+    return cacheSizeLocked();
+}
+
+
+int64 ImageLoader::maxCacheSize() const {
+    GMutexLock lock(&m_mutex);
+    return m_maxCacheSize;
+}
+
+
+void ImageLoader::setMaxCacheSize(int64 bytes) {
+    debugAssertM(bytes >= 0, "Cache size must not be negative");
+    GMutexLock lock(&m_mutex);
+    m_maxCacheSize = bytes;
+}
+
+
+void ImageLoader::trimCache() {
+    Array<Future::Ref> released;
+    GMutexLock lock(&m_mutex);
+    trimCacheLocked(released);
+}
+
+
+void ImageLoader::clearCache() {
+    Array<Future::Ref> released;
+    GMutexLock lock(&m_mutex);
+    for (Table<std::string, CacheEntry>::Iterator it = m_cache.begin(); it != m_cache.end(); ++it) {
+        released.append(it->value.future);
+    }
+    m_cache.clear();
+}
+
+
+int ImageLoader::numCacheHits() const {
+    GMutexLock lock(&m_mutex);
+    return m_numCacheHits;
+}
+
+
+int ImageLoader::numCacheMisses() const {
+    GMutexLock lock(&m_mutex);
+    return m_numCacheMisses;
+}
+
+} // namespace G3D
@@ -4,6 +4,19 @@
  */
 #include "G3D/Matrix.h"
 #include "G3D/TextOutput.h"
+#include "G3D/TaskScheduler.h"
+
+#if defined(G3D_WIN32) || defined(__i386__) || defined(__x86_64__)
+#   define G3D_MATRIX_SIMD
+#   include <emmintrin.h>
+
+    // GCC only emits instructions beyond the compiler's target for functions that ask for them
+#   if defined(__GNUC__) && ! defined(__SSE2__)
+#       define G3D_TARGET_SSE2 __attribute__((target("sse2")))
+#   else
+#       define G3D_TARGET_SSE2
+#   endif
+#endif
 
 static inline G3D::Matrix::T negate(G3D::Matrix::T x) {
     return -x;
@@ -209,7 +222,7 @@ Matrix Matrix::row(int r) const {
     debugAssert(r >= 0);
     debugAssert(r < rows());
     Matrix out(1, cols());
-    out.impl->setRow(1, impl->elt[r]);
+    out.impl->setRow(0, impl->elt[r]);
     return out;
 }
 
@@ -480,6 +493,62 @@ void Matrix::svd(Matrix& U, Array<T>& d, Matrix& V, bool sort) const {
 }
 
 
+bool Matrix::lu(Matrix& L, Matrix& U, Array<int>& permutation) const {
+    const int n = rows();
+    debugAssertM(n == cols(), "lu requires a square matrix");
+
+    Impl A(*impl);
+    int sign = 1;
+    const bool ok = A.luInPlace(permutation, sign);
+
+    L = Matrix::identity(n);
+    U = Matrix::zero(n, n);
+    for (int r = 0; r < n; ++r) {
+        for (int c = 0; c < r; ++c) {
+            L.impl->elt[r][c] = A.elt[r][c];
+        }
+        for (int c = r; c < n; ++c) {
+            U.impl->elt[r][c] = A.elt[r][c];
+        }
+    }
+
+    return ok;
+}
+
+
+bool Matrix::cholesky(Matrix& L) const {
+    Impl* A = new Impl(*impl);
+    const bool ok = A->choleskyInPlace();
+    L = Matrix(A);
+    return ok;
+}
+
+
+Matrix Matrix::solve(const Matrix& B) const {
+    debugAssertM(B.rows() == rows(), "solve requires B to have as many rows as this matrix");
+
+    if (rows() == cols()) {
+        Impl A(*impl);
+        Array<int> permutation;
+        int sign = 1;
+        if (A.luInPlace(permutation, sign)) {
+            Impl* X = new Impl(*B.impl);
+            A.luSolve(permutation, *X);
+            return Matrix(X);
+        }
+    } else if (rows() > cols()) {
+        Impl* X = new Impl(cols(), B.cols());
+        if (impl->qrSolve(*B.impl, *X)) {
+            return Matrix(X);
+        }
+        delete X;
+    }
+
+    // Singular, rank deficient, or underdetermined
+    return pseudoInverse() * B;
+}
+
+
 #define COMPARE_SCALAR(OP)\
 Matrix Matrix::operator OP (const T& scalar) const {\
     int R = rows();\
@@ -629,6 +698,210 @@ void Matrix::Impl::mulRow(int r, const T& v) {
 }
 
 
+static bool useSSE2() {
+#   ifdef G3D_MATRIX_SIMD
+        static const bool sse = System::hasSSE2();
+        return sse;
+#   else
+        return false;
+#   endif
+}
+
+
+#ifdef G3D_MATRIX_SIMD
+/** Returns the number of leading elements processed */
+static G3D_TARGET_SSE2 int axpy_sse2(float a, const float* x, float* y, int n) {
+    const __m128 s = _mm_set1_ps(a);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(s, _mm_loadu_ps(x + i))));
+    }
+    return i;
+}
+
+
+/** Returns the number of leading elements processed, and their dot product in \a sum */
+static G3D_TARGET_SSE2 int dot_sse2(const float* a, const float* b, int n, float& sum) {
+    __m128 s0 = _mm_setzero_ps();
+    __m128 s1 = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    float v[4];
+    _mm_storeu_ps(v, _mm_add_ps(s0, s1));
+    sum = (v[0] + v[1]) + (v[2] + v[3]);
+    return i;
+}
+#endif
+
+
+/** y += a * x */
+static void axpy(float a, const float* x, float* y, int n) {
+    int i = 0;
+#   ifdef G3D_MATRIX_SIMD
+        if (useSSE2()) {
+            i = axpy_sse2(a, x, y, n);
+        }
+#   endif
+    for (; i < n; ++i) {
+        y[i] += a * x[i];
+    }
+}
+
+
+static float dot(const float* a, const float* b, int n) {
+    float sum = 0.0f;
+    int i = 0;
+#   ifdef G3D_MATRIX_SIMD
+        if (useSSE2()) {
+            i = dot_sse2(a, b, n, sum);
+        }
+#   endif
+    for (; i < n; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+
+
+namespace _internal {
+
+/** 
+ Computes out += alpha * A * B for a range of rows of row-major
+ matrices, where A is rows x depth, B is depth x cols, and lda, ldb,
+ and ldo are the distances between rows.
+
+ The product is computed in blocks of depth KC and width NC so that
+ the block of B stays in cache while every row in the range uses it,
+ and each block is computed in 4 x 8 tiles held in registers.
+ */
+class GEMMRows {
+public:
+    enum {KC = 128, NC = 512, MR = 4, NR = 8};
+
+    const float*    A;
+    int             lda;
+    const float*    B;
+    int             ldb;
+    float*          out;
+    int             ldo;
+    int             cols;
+    int             depth;
+    float           alpha;
+    bool            sse;
+
+    void operator()(int begin, int end) const {
+        for (int j0 = 0; j0 < cols; j0 += NC) {
+            const int nc = iMin(NC, cols - j0);
+            for (int k0 = 0; k0 < depth; k0 += KC) {
+                const int kc = iMin(KC, depth - k0);
+                block(A + begin * lda + k0, B + k0 * ldb + j0, out + begin * ldo + j0, end - begin, nc, kc);
+            }
+        }
+    }
+
+private:
+
+    void block(const float* a, const float* b, float* c, int m, int n, int k) const {
+        int i = 0;
+        for (; i + MR <= m; i += MR) {
+            int j = 0;
+#           ifdef G3D_MATRIX_SIMD
+                if (sse) {
+                    for (; j + NR <= n; j += NR) {
+                        tile_sse2(a + i * lda, lda, b + j, ldb, c + i * ldo + j, ldo, k, alpha);
+                    }
+                }
+#           endif
+            edge(a + i * lda, b, c + i * ldo, MR, j, n, k);
+        }
+        edge(a + i * lda, b, c + i * ldo, m - i, 0, n, k);
+    }
+
+    /** Scalar loops for rows [0, m) and columns [j0, n) */
+    void edge(const float* a, const float* b, float* c, int m, int j0, int n, int k) const {
+        for (int i = 0; i < m; ++i) {
+            const float* arow = a + i * lda;
+            float* crow = c + i * ldo;
+            for (int p = 0; p < k; ++p) {
+                const float s = alpha * arow[p];
+                const float* brow = b + p * ldb;
+                for (int j = j0; j < n; ++j) {
+                    crow[j] += s * brow[j];
+                }
+            }
+        }
+    }
+
+#   ifdef G3D_MATRIX_SIMD
+    static G3D_TARGET_SSE2 void tile_sse2(const float* a, int lda, const float* b, int ldb, float* c, int ldo, int k, float alpha) {
+        __m128 c00 = _mm_setzero_ps(), c01 = _mm_setzero_ps();
+        __m128 c10 = _mm_setzero_ps(), c11 = _mm_setzero_ps();
+        __m128 c20 = _mm_setzero_ps(), c21 = _mm_setzero_ps();
+        __m128 c30 = _mm_setzero_ps(), c31 = _mm_setzero_ps();
+
+        for (int p = 0; p < k; ++p) {
+            const __m128 b0 = _mm_loadu_ps(b + p * ldb);
+            const __m128 b1 = _mm_loadu_ps(b + p * ldb + 4);
+            __m128 x;
+
+            x = _mm_set1_ps(a[p]);
+            c00 = _mm_add_ps(c00, _mm_mul_ps(x, b0));    c01 = _mm_add_ps(c01, _mm_mul_ps(x, b1));
+            x = _mm_set1_ps(a[lda + p]);
+            c10 = _mm_add_ps(c10, _mm_mul_ps(x, b0));    c11 = _mm_add_ps(c11, _mm_mul_ps(x, b1));
+            x = _mm_set1_ps(a[2 * lda + p]);
+            c20 = _mm_add_ps(c20, _mm_mul_ps(x, b0));    c21 = _mm_add_ps(c21, _mm_mul_ps(x, b1));
+            x = _mm_set1_ps(a[3 * lda + p]);
+            c30 = _mm_add_ps(c30, _mm_mul_ps(x, b0));    c31 = _mm_add_ps(c31, _mm_mul_ps(x, b1));
+        }
+
+        const __m128 s = _mm_set1_ps(alpha);
+#       define ACCUMULATE(row, v0, v1)\
+            _mm_storeu_ps(c + row * ldo,     _mm_add_ps(_mm_loadu_ps(c + row * ldo),     _mm_mul_ps(s, v0)));\
+            _mm_storeu_ps(c + row * ldo + 4, _mm_add_ps(_mm_loadu_ps(c + row * ldo + 4), _mm_mul_ps(s, v1)));
+        ACCUMULATE(0, c00, c01)
+        ACCUMULATE(1, c10, c11)
+        ACCUMULATE(2, c20, c21)
+        ACCUMULATE(3, c30, c31)
+#       undef ACCUMULATE
+    }
+#   endif
+};
+
+} // namespace _internal
+
+
+/** out += alpha * A * B; see _internal::GEMMRows.  Large products are split across rows in parallel. */
+static void gemm(const float* A, int lda, const float* B, int ldb, float* out, int ldo, 
+                 int rows, int cols, int depth, float alpha) {
+    if ((rows == 0) || (cols == 0) || (depth == 0)) {
+        return;
+    }
+
+    _internal::GEMMRows body;
+    body.A      = A;
+    body.lda    = lda;
+    body.B      = B;
+    body.ldb    = ldb;
+    body.out    = out;
+    body.ldo    = ldo;
+    body.cols   = cols;
+    body.depth  = depth;
+    body.alpha  = alpha;
+    body.sse    = useSSE2();
+
+    // About 64^3 multiply-adds is enough to pay for scheduling
+    if ((int64)rows * cols * depth >= 64 * 64 * 64) {
+        TaskScheduler::global()->parallelFor(0, rows, 32, body);
+    } else {
+        body(0, rows);
+    }
+}
+
+
 void Matrix::Impl::mul(const Impl& B, Impl& out) const {
     const Impl& A = *this;
 
@@ -640,18 +913,58 @@ void Matrix::Impl::mul(const Impl& B, Impl& out) const {
     debugAssert(A.R == out.R);
     debugAssert(B.C == out.C);
 
-    for (int r = 0; r < out.R; ++r) {
-        for (int c = 0; c < out.C; ++c) {
-            T sum = 0.0;
-            for (int i = 0; i < A.C; ++i) {
-                sum += A.get(r, i) * B.get(i, c);
-            }
-            out.set(r, c, sum);
-        }
-    }
+    out.setZero();
+    gemm(A.data, A.C, B.data, B.C, out.data, out.C, out.R, out.C, A.C, 1.0f);
 }
 
 
+// Elementwise kernels for the methods below.  Each returns the number
+// of leading elements that it processed; data is 16-byte aligned.
+#ifdef G3D_MATRIX_SIMD
+#   define IMPLEMENT_SIMD_2(name, SSE_OP)\
+    static G3D_TARGET_SSE2 int name(const float* a, const float* b, float* out, int n) {\
+        int i = 0;\
+        for (; i + 4 <= n; i += 4) {\
+            _mm_store_ps(out + i, SSE_OP(_mm_load_ps(a + i), _mm_load_ps(b + i)));\
+        }\
+        return i;\
+    }
+
+#   define IMPLEMENT_SIMD_SCALAR(name, SSE_OP)\
+    static G3D_TARGET_SSE2 int name(const float* a, float b, float* out, int n) {\
+        const __m128 v = _mm_set1_ps(b);\
+        int i = 0;\
+        for (; i + 4 <= n; i += 4) {\
+            _mm_store_ps(out + i, SSE_OP(_mm_load_ps(a + i), v));\
+        }\
+        return i;\
+    }
+#else
+#   define IMPLEMENT_SIMD_2(name, SSE_OP)\
+    static inline int name(const float*, const float*, float*, int) {\
+        return 0;\
+    }
+
+#   define IMPLEMENT_SIMD_SCALAR(name, SSE_OP)\
+    static inline int name(const float*, float, float*, int) {\
+        return 0;\
+    }
+#endif
+
+IMPLEMENT_SIMD_2(add_sse2,      _mm_add_ps)
+IMPLEMENT_SIMD_2(sub_sse2,      _mm_sub_ps)
+IMPLEMENT_SIMD_2(arrayMul_sse2, _mm_mul_ps)
+IMPLEMENT_SIMD_2(arrayDiv_sse2, _mm_div_ps)
+
+IMPLEMENT_SIMD_SCALAR(addScalar_sse2, _mm_add_ps)
+IMPLEMENT_SIMD_SCALAR(subScalar_sse2, _mm_sub_ps)
+IMPLEMENT_SIMD_SCALAR(mulScalar_sse2, _mm_mul_ps)
+IMPLEMENT_SIMD_SCALAR(divScalar_sse2, _mm_div_ps)
+
+#undef IMPLEMENT_SIMD_SCALAR
+#undef IMPLEMENT_SIMD_2
+
+
 // We're about to define several similar methods,
 // so use a macro to share implementations.  This
 // must be a macro because the difference between
@@ -665,7 +978,9 @@ void Matrix::Impl::method(const Impl& B, Impl& out) const {\
     debugAssert(A.C == out.C);\
     debugAssert(A.R == out.R);\
                             \
-    for (int i = R * C - 1; i >= 0; --i) {\
+    const int N = R * C;\
+    int i = useSSE2() ? method##_sse2(A.data, B.data, out.data, N) : 0;\
+    for (; i < N; ++i) {\
         out.data[i] = A.data[i] OP B.data[i];\
     }\
 }
@@ -691,7 +1006,9 @@ void Matrix::Impl::method(Matrix::T B, Impl& out) const {\
     debugAssert(A.C == out.C);\
     debugAssert(A.R == out.R);\
                             \
-    for (int i = R * C - 1; i >= 0; --i) {\
+    const int N = R * C;\
+    int i = useSSE2() ? method##Scalar_sse2(A.data, B, out.data, N) : 0;\
+    for (; i < N; ++i) {\
         out.data[i] = A.data[i] OP B;\
     }\
 }
@@ -764,9 +1081,19 @@ void Matrix::Impl::transpose(Impl& out) const {
             }
         }
     } else {
-        for (int r = 0; r < R; ++r) {
-            for (int c = 0; c < C; ++c) {
-                out.set(c, r, get(r, c)); 
+        // Copy in square tiles so that both matrices are traversed
+        // along cache lines
+        static const int TILE = 32;
+        for (int r0 = 0; r0 < R; r0 += TILE) {
+            const int r1 = iMin(R, r0 + TILE);
+            for (int c0 = 0; c0 < C; c0 += TILE) {
+                const int c1 = iMin(C, c0 + TILE);
+                for (int r = r0; r < r1; ++r) {
+                    const T* row = elt[r];
+                    for (int c = c0; c < c1; ++c) {
+                        out.elt[c][r] = row[c];
+                    }
+                }
             }
         }
     }
@@ -856,15 +1183,21 @@ Matrix::T Matrix::Impl::determinant() const {
       
     default:
         {
-            // Determinant of an n x n matrix is the dot product of the first
-            // row with the first row of cofactors
-            T det = 0;
+            // Expanding by cofactors takes O(n!) time, so use the
+            // product of the diagonal of the LU decomposition instead
+            Impl A(*this);
+            Array<int> permutation;
+            int sign = 1;
+            if (! A.luInPlace(permutation, sign)) {
+                return 0;
+            }
 
-            for (int c = 0; c < C; ++c) {
-                det += elt[0][c] * cofactor(0, c);
+            double det = sign;
+            for (int i = 0; i < R; ++i) {
+                det *= A.elt[i][i];
             }
 
-            return det;
+            return T(det);
         }
     }
 }
@@ -1458,6 +1791,299 @@ void Matrix::Impl::inverseInPlaceGaussJordan() {
 }
 
 
+namespace _internal {
+
+/** Computes column \a j of L below the diagonal for Matrix::Impl::choleskyInPlace */
+class CholeskyColumn {
+public:
+    float**         elt;
+    int             j;
+
+    void operator()(int begin, int end) const {
+        const float* rowJ = elt[j];
+        const float  inv  = 1.0f / rowJ[j];
+        for (int i = begin; i < end; ++i) {
+            float* row = elt[i];
+            row[j] = (row[j] - dot(row, rowJ, j)) * inv;
+        }
+    }
+};
+
+/** Applies the Householder reflection I - 2 v v<sup>T</sup> / |v|<sup>2</sup>
+    to columns [begin, end) of the column-major matrix for
+    Matrix::Impl::qrSolve.  v occupies rows [k, R) of column k. */
+class HouseholderColumns {
+public:
+    double**        col;
+    int             k;
+    int             R;
+    /** 2 / |v|<sup>2</sup> */
+    double          scale;
+
+    void operator()(int begin, int end) const {
+        const double* v = col[k] + k;
+        const int n = R - k;
+        for (int j = begin; j < end; ++j) {
+            double* x = col[j] + k;
+            double s = 0.0;
+            for (int i = 0; i < n; ++i) {
+                s += v[i] * x[i];
+            }
+            s *= scale;
+            for (int i = 0; i < n; ++i) {
+                x[i] -= s * v[i];
+            }
+        }
+    }
+};
+
+} // namespace _internal
+
+
+bool Matrix::Impl::luInPlace(Array<int>& permutation, int& sign) {
+    debugAssertM(R == C, "LU decomposition requires a square matrix");
+    const int n = R;
+
+    // Columns per panel.  Each panel is factored with scalar loops and
+    // then the rest of the matrix is updated with one matrix multiply.
+    static const int NB = 32;
+
+    permutation.resize(n);
+    for (int i = 0; i < n; ++i) {
+        permutation[i] = i;
+    }
+    sign = 1;
+
+    for (int k0 = 0; k0 < n; k0 += NB) {
+        const int k1 = iMin(n, k0 + NB);
+
+        // Factor the panel of columns [k0, k1)
+        for (int k = k0; k < k1; ++k) {
+            int p = k;
+            T largest = ::fabs(elt[k][k]);
+            for (int i = k + 1; i < n; ++i) {
+                const T m = ::fabs(elt[i][k]);
+                if (m > largest) {
+                    largest = m;
+                    p = i;
+                }
+            }
+
+            if (largest == 0) {
+                // Singular
+                return false;
+            }
+
+            if (p != k) {
+                swapRows(p, k);
+                const int temp = permutation[p];
+                permutation[p] = permutation[k];
+                permutation[k] = temp;
+                sign = -sign;
+            }
+
+            const T* rowK = elt[k];
+            const T inv = T(1) / rowK[k];
+            for (int i = k + 1; i < n; ++i) {
+                T* row = elt[i];
+                const T l = (row[k] *= inv);
+                for (int j = k + 1; j < k1; ++j) {
+                    row[j] -= l * rowK[j];
+                }
+            }
+        }
+
+        if (k1 < n) {
+            // U12 = inverse(L11) * A12
+            for (int k = k0; k < k1; ++k) {
+                for (int i = k + 1; i < k1; ++i) {
+                    axpy(-elt[i][k], elt[k] + k1, elt[i] + k1, n - k1);
+                }
+            }
+
+            // A22 -= L21 * U12
+            gemm(elt[k1] + k0, n, elt[k0] + k1, n, elt[k1] + k1, n, n - k1, n - k1, k1 - k0, -1.0f);
+        }
+    }
+
+    return true;
+}
+
+
+void Matrix::Impl::luSolve(const Array<int>& permutation, Impl& B) const {
+    debugAssert(B.R == R);
+    const int n = R;
+    const int m = B.C;
+
+    Impl X(n, m);
+    for (int i = 0; i < n; ++i) {
+        X.setRow(i, B.elt[permutation[i]]);
+    }
+
+    // L Y = P B
+    for (int i = 0; i < n; ++i) {
+        for (int k = 0; k < i; ++k) {
+            axpy(-elt[i][k], X.elt[k], X.elt[i], m);
+        }
+    }
+
+    // U X = Y
+    for (int i = n - 1; i >= 0; --i) {
+        for (int k = i + 1; k < n; ++k) {
+            axpy(-elt[i][k], X.elt[k], X.elt[i], m);
+        }
+        X.mulRow(i, T(1) / elt[i][i]);
+    }
+
+    B = X;
+}
+
+
+bool Matrix::Impl::choleskyInPlace() {
+    debugAssertM(R == C, "Cholesky decomposition requires a square matrix");
+    const int n = R;
+
+    _internal::CholeskyColumn column;
+    column.elt = elt;
+
+    for (int j = 0; j < n; ++j) {
+        T* rowJ = elt[j];
+        const T d = rowJ[j] - dot(rowJ, rowJ, j);
+        if (! (d > 0)) {
+            // Not positive definite (or NaN)
+            return false;
+        }
+        rowJ[j] = ::sqrt(d);
+
+        column.j = j;
+        if ((int64)(n - j) * j >= 64 * 64 * 4) {
+            TaskScheduler::global()->parallelFor(j + 1, n, 64, column);
+        } else {
+            column(j + 1, n);
+        }
+    }
+
+    for (int i = 0; i < n; ++i) {
+        for (int j = i + 1; j < n; ++j) {
+            elt[i][j] = 0;
+        }
+    }
+
+    return true;
+}
+
+
+void Matrix::Impl::choleskySolve(Impl& B) const {
+    debugAssert(B.R == R);
+    const int n = R;
+    const int m = B.C;
+
+    // L Y = B
+    for (int i = 0; i < n; ++i) {
+        for (int k = 0; k < i; ++k) {
+            axpy(-elt[i][k], B.elt[k], B.elt[i], m);
+        }
+        B.mulRow(i, T(1) / elt[i][i]);
+    }
+
+    // L' X = Y
+    for (int i = n - 1; i >= 0; --i) {
+        for (int k = i + 1; k < n; ++k) {
+            axpy(-elt[k][i], B.elt[k], B.elt[i], m);
+        }
+        B.mulRow(i, T(1) / elt[i][i]);
+    }
+}
+
+
+bool Matrix::Impl::qrSolve(const Impl& B, Impl& X) const {
+    debugAssert(B.R == R);
+    debugAssert(R > C);
+    const int m = B.C;
+    // Columns of [this | B]
+    const int n = C + m;
+
+    // Column-major, so that each reflection streams down contiguous columns
+    Array<double> data;
+    data.resize(R * n);
+    Array<double*> col;
+    col.resize(n);
+    for (int j = 0; j < n; ++j) {
+        col[j] = data.getCArray() + j * R;
+    }
+    double maxNorm = 0.0;
+    for (int j = 0; j < C; ++j) {
+        double s = 0.0;
+        for (int i = 0; i < R; ++i) {
+            col[j][i] = elt[i][j];
+            s += square(col[j][i]);
+        }
+        maxNorm = G3D::max(maxNorm, ::sqrt(s));
+    }
+    for (int j = 0; j < m; ++j) {
+        for (int i = 0; i < R; ++i) {
+            col[C + j][i] = B.elt[i][j];
+        }
+    }
+
+    // The elements are single precision, so columns that are dependent to
+    // within float rounding are treated as exactly dependent
+    const double tolerance = R * FLT_EPSILON * maxNorm;
+
+    // Diagonal of the triangular factor; the rest is stored above the
+    // diagonal of col
+    Array<double> diagonal;
+    diagonal.resize(C);
+
+    _internal::HouseholderColumns reflect;
+    reflect.col = col.getCArray();
+    reflect.R   = R;
+    for (int k = 0; k < C; ++k) {
+        double* v = col[k];
+        double s = 0.0;
+        for (int i = k; i < R; ++i) {
+            s += square(v[i]);
+        }
+        const double norm = ::sqrt(s);
+        if (norm <= tolerance) {
+            return false;
+        }
+
+        // Reflect column k onto -sign(v[k]) * norm * e_k, choosing the
+        // sign that avoids cancellation in v[k] - alpha
+        const double alpha = (v[k] > 0.0) ? -norm : norm;
+        v[k] -= alpha;
+        diagonal[k] = alpha;
+
+        reflect.k     = k;
+        reflect.scale = 1.0 / (norm * (norm + ::fabs(v[k] + alpha)));
+        if ((int64)(n - k - 1) * (R - k) >= 64 * 64 * 4) {
+            TaskScheduler::global()->parallelFor(k + 1, n, 4, reflect);
+        } else {
+            reflect(k + 1, n);
+        }
+    }
+
+    // Back substitution with the triangular factor for the first C rows of Q' B
+    X.setSize(C, m);
+    Array<double> x;
+    x.resize(C);
+    for (int j = 0; j < m; ++j) {
+        const double* qb = col[C + j];
+        for (int k = C - 1; k >= 0; --k) {
+            double s = qb[k];
+            for (int c = k + 1; c < C; ++c) {
+                s -= col[c][k] * x[c];
+            }
+            x[k] = s / diagonal[k];
+            X.elt[k][j] = (T)x[k];
+        }
+    }
+
+    return true;
+}
+
+
 bool Matrix::Impl::anyNonZero() const {
     int N = R * C;
     for (int i = 0; i < N; ++i) {
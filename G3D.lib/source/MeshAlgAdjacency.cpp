@@ -15,148 +15,415 @@
 #include "G3D/Set.h"
 #include "G3D/Stopwatch.h"
 #include "G3D/SmallArray.h"
-#include "G3D/AreaMemoryManager.h"
+#include "G3D/TaskScheduler.h"
+#include "G3D/System.h"
+#include "G3D/radixSort.h"
 
 namespace G3D {
 
-/** Two-level table mapping index 0 -> index 1 -> list of face indices */
-class MeshEdgeTable {
+/*
+ computeAdjacency pairs directed edges by sorting them.  Every face
+ contributes three "slots" s = 3f + j, the directed edge from its jth
+ vertex to the next one.  Each slot gets the key (lo << bits) | hi,
+ where lo and hi are its vertex indices in increasing order, and the
+ keys are radix sorted.  The slots with a given lo vertex (a "run")
+ are then contiguous, and within a run the slots of each undirected
+ edge (a "group") are contiguous and in slot order.
+
+ Runs are paired in parallel.  The edges of a run are numbered in the
+ order of the first slot of each group, which is the order in which
+ the older table-based implementation created them, so the output is
+ the same as before for every mesh.
+ */
+namespace _internal {
+
+static const int nextIndex[] = {1, 2, 0};
+
+/** Sets up faces, face normals, and the sort key of each slot */
+class AdjacencyFaces {
 public:
+    const Vector3*      vertexGeometry;
+    const int*          index;
+    int                 bits;
+
+    MeshAlg::Face*      face;
+    Vector3*            faceNormal;
+    uint64*             key;
+    int*                slot;
+
+    void operator()(int begin, int end) const {
+        for (int f = begin; f < end; ++f) {
+            const int q = 3 * f;
+            MeshAlg::Face& F = face[f];
+            for (int j = 0; j < 3; ++j) {
+                F.vertexIndex[j] = index[q + j];
+                F.edgeIndex[j]   = MeshAlg::Face::NONE;
+            }
+
+            const Vector3& v0 = vertexGeometry[F.vertexIndex[0]];
+            const Vector3& N = (vertexGeometry[F.vertexIndex[1]] - v0).cross(vertexGeometry[F.vertexIndex[2]] - v0);
+            faceNormal[f] = N.directionOrZero();
 
-    /** We  expect 2 faces per edge. */
-    typedef SmallArray<int, 2> FaceIndexArray;
+            for (int j = 0; j < 3; ++j) {
+                const int i0 = F.vertexIndex[j];
+                const int i1 = F.vertexIndex[nextIndex[j]];
+                key[q + j]  = (uint64(iMin(i0, i1)) << bits) | uint64(iMax(i0, i1));
+                slot[q + j] = q + j;
+            }
+        }
+    }
+};
 
-    class Edge {
-    public:
-        int i1;
 
-        FaceIndexArray faceIndexArray;
-    };
+/** Finds where each vertex's run begins in an array of keys sorted by (key >> shift) */
+class AdjacencyRunStart {
+public:
+    const uint64*       key;
+    int                 shift;
+    int*                runStart;
+
+    void operator()(int begin, int end) const {
+        for (int p = begin; p < end; ++p) {
+            const int v = int(key[p] >> shift);
+            const int prev = (p == 0) ? -1 : int(key[p - 1] >> shift);
+            for (int u = prev + 1; u <= v; ++u) {
+                runStart[u] = p;
+            }
+        }
+    }
+};
 
-    /** We expect at most 6 edges per vertex; that matches a typical regular grid mesh */
-    typedef SmallArray<Edge, 6> EdgeArray;
 
-    typedef Array< EdgeArray > ET;
+/** True if the directed edge of \a slot points from its lower-indexed
+    vertex to its higher one.  Degenerate edges are backward. */
+inline bool slotIsForward(const MeshAlg::Face* face, int slot) {
+    const MeshAlg::Face& F = face[slot / 3];
+    const int j = slot % 3;
+    return F.vertexIndex[j] < F.vertexIndex[nextIndex[j]];
+}
 
-private:
-    
-    ET                   table;
 
+/** Orders group start positions by their first slot */
+class FirstSlotOrder {
 public:
-
-    MeshEdgeTable() {
-        AreaMemoryManager::Ref mm = AreaMemoryManager::create();
-        table.clearAndSetMemoryManager(mm);
+    const int*          slot;
+    FirstSlotOrder(const int* s) : slot(s) {}
+    bool operator()(int a, int b) const {
+        return slot[a] < slot[b];
     }
+};
 
-    void clear() {
-        table.clear();
-    }
-    
-    void resize(int maxV) {
-        table.resize(maxV);
-    }
 
-    /**
-     Inserts the faceIndex into the edge's face list.
-     The index may be a negative number indicating a backface.
-
-     \param v0 Vertex index 0
-     \param v1 Vertex index 1
-     */
-    void insert(int v0, int v1, int faceIndex) {
-        
-        debugAssert(v0 <= v1);
-        EdgeArray& edgeArray = table[v0];
-        for (int i = 0; i < edgeArray.size(); ++i) {
-            if (edgeArray[i].i1 == v1) {
-                edgeArray[i].faceIndexArray.push(faceIndex);
-                return;
+/** Pairs the slots of each group within a run.  Records for each sorted
+    position the order in which its edge was created within the run
+    (times two, plus one for the second face of the edge) and its index
+    among the run's interior or boundary edges (times two, plus one for
+    boundary edges). */
+class AdjacencyPair {
+public:
+    const uint64*           key;
+    const int*              slot;
+    const int*              runStart;
+    const MeshAlg::Face*    face;
+    const Vector3*          faceNormal;
+
+    int*                    created;
+    int*                    kind;
+    int*                    numEdges;
+    int*                    numBoundary;
+
+    void operator()(int begin, int end) const {
+        Array<int> group;
+        // Signed face index (~f for backward) and sorted position of the unpaired slots of a group
+        Array<int> faceIndexArray;
+        Array<int> position;
+
+        for (int v = begin; v < end; ++v) {
+            const int p0 = runStart[v];
+            const int p1 = runStart[v + 1];
+
+            group.fastClear();
+            for (int p = p0; p < p1; ++p) {
+                if ((p == p0) || (key[p] != key[p - 1])) {
+                    group.append(p);
+                }
+            }
+            const int numGroups = group.size();
+            if (numGroups > 1) {
+                std::sort(group.begin(), group.begin() + numGroups, FirstSlotOrder(slot));
             }
-        }
 
-        Edge& p = edgeArray.next();
-        p.i1 = v1;
-        p.faceIndexArray.push(faceIndex);
-    }
+            int e = 0;
+            int b = 0;
+            for (int g = 0; g < numGroups; ++g) {
+                faceIndexArray.fastClear();
+                position.fastClear();
+                const uint64 groupKey = key[group[g]];
+                for (int p = group[g]; (p < p1) && (key[p] == groupKey); ++p) {
+                    const int f = slot[p] / 3;
+                    faceIndexArray.append(slotIsForward(face, slot[p]) ? f : ~f);
+                    position.append(p);
+                }
 
-    class Iterator {
-        friend class MeshEdgeTable;
-    private:
+                // Same pairing as the original implementation
+                while (faceIndexArray.size() > 0) {
 
-        int                                   m_i0;
-        /** Pair index */
-        int                                   m_p;
-        ET&                                   m_array;
-        EdgeArray*                            m_edgeArray;
-        bool                                  m_end;
+                    // Remove the last index
+                    const int f0 = faceIndexArray.pop();
+                    const int q0 = position.pop();
 
-    public:
+                    // Find the normal to that face
+                    const Vector3& n0 = faceNormal[(f0 >= 0) ? f0 : ~f0];
 
-        int i0() const {
-            return m_i0;
-        }
+                    bool found = false;
 
-        int i1() const {
-            return (*m_edgeArray)[m_p].i1;
-        }
+                    // We try to find the matching face with the closest
+                    // normal.  This ensures that we don't introduce a lot
+                    // of artificial ridges into flat parts of a mesh.
+                    float ndotn = -2;
+                    int i1 = -1;
 
-        FaceIndexArray& faceIndex() {
-            return (*m_edgeArray)[m_p].faceIndexArray;
-        }
+                    // Try to find the face with the matching edge
+                    for (int i = faceIndexArray.size() - 1; i >= 0; --i) {
+                        const int f = faceIndexArray[i];
 
-        Iterator& operator++() {
-            if ((m_i0 >= 0) && (m_p < m_edgeArray->size() - 1)) {
-                ++m_p;
-            } else {
-                // Skip over elements with no face array
-                do {
-                    ++m_i0;
-                    if (m_i0 == m_array.size()) {
-                        m_end = true;
-                        return *this;
+                        if ((f >= 0) != (f0 >= 0)) {
+                            // This face contains the oppositely oriented edge
+                            const Vector3& n1 = faceNormal[(f >= 0) ? f : ~f];
+                            const float d = n1.dot(n0);
+
+                            if (! found || (d > ndotn)) {
+                                found = true;
+                                ndotn = d;
+                                i1    = i;
+                            }
+                        }
+                    }
+
+                    created[q0] = 2 * e;
+                    if (found) {
+                        kind[q0] = 2 * (e - b);
+
+                        const int q1 = position[i1];
+                        created[q1] = 2 * e + 1;
+                        kind[q1] = 2 * (e - b);
+
+                        // Remove the matched face from the active list
+                        faceIndexArray.fastRemove(i1);
+                        position.fastRemove(i1);
                     } else {
-                        m_edgeArray = &m_array[m_i0];
-                        m_p = 0;
+                        kind[q0] = 2 * b + 1;
+                        ++b;
                     }
-                } while (m_edgeArray->size() == 0);
+                    ++e;
+                }
             }
 
-            return *this;
+            numEdges[v]    = e;
+            numBoundary[v] = b;
         }
+    }
+};
+
+
+/** Creates the edges of each run, with interior edges first and
+    boundary edges in reverse order at the end of the array, and
+    records for each slot its edge and creation sequence */
+class AdjacencyEdges {
+public:
+    const uint64*           key;
+    const int*              slot;
+    const int*              runStart;
+    const MeshAlg::Face*    face;
+    const int*              created;
+    const int*              kind;
+    const int*              edgeBase;
+    const int*              boundaryBase;
+    int                     bits;
+
+    MeshAlg::Edge*          edge;
+    int                     numEdges;
+    int*                    slotEdge;
+    int*                    slotSequence;
+
+    void operator()(int begin, int end) const {
+        const uint64 hiMask = (uint64(1) << bits) - 1;
+
+        for (int v = begin; v < end; ++v) {
+            const int p0 = runStart[v];
+            const int p1 = runStart[v + 1];
+
+            // The interior edges of the runs before v precede these
+            const int interiorBase = edgeBase[v] - boundaryBase[v];
+            for (int p = p0; p < p1; ++p) {
+                const int k = kind[p] >> 1;
+                const int e = (kind[p] & 1) ?
+                    (numEdges - 1 - (boundaryBase[v] + k)) :
+                    (interiorBase + k);
+
+                if ((created[p] & 1) == 0) {
+                    // First face of the edge
+                    MeshAlg::Edge& E = edge[e];
+                    E.vertexIndex[0] = v;
+                    E.vertexIndex[1] = int(key[p] & hiMask);
+                    E.faceIndex[0]   = MeshAlg::Face::NONE;
+                    E.faceIndex[1]   = MeshAlg::Face::NONE;
+                }
 
-        bool hasMore() const {
-            return ! m_end;
+                const int s = slot[p];
+                slotEdge[s]     = slotIsForward(face, s) ? e : ~e;
+                slotSequence[s] = 2 * edgeBase[v] + created[p];
+            }
+
+            for (int p = p0; p < p1; ++p) {
+                const int s = slot[p];
+                const int e = slotEdge[s];
+                if (e >= 0) {
+                    edge[e].faceIndex[0] = s / 3;
+                } else {
+                    edge[~e].faceIndex[1] = s / 3;
+                }
+            }
         }
+    }
+};
+
+
+/** Assigns the edges of each face in the order in which they were
+    created and then orders them counter-clockwise */
+class AdjacencyFaceEdges {
+public:
+    const MeshAlg::Edge*    edge;
+    const int*              slotEdge;
+    const int*              slotSequence;
+    MeshAlg::Face*          face;
+
+    void operator()(int begin, int end) const {
+        for (int f = begin; f < end; ++f) {
+            MeshAlg::Face& F = face[f];
+            int order[3] = {3 * f, 3 * f + 1, 3 * f + 2};
+            for (int i = 1; i < 3; ++i) {
+                for (int j = i; (j > 0) && (slotSequence[order[j]] < slotSequence[order[j - 1]]); --j) {
+                    std::swap(order[j], order[j - 1]);
+                }
+            }
 
-    private:
+            const int e0 = slotEdge[order[0]];
+            const int e1 = slotEdge[order[1]];
+            const int e2 = slotEdge[order[2]];
 
-        Iterator(ET& a) : m_i0(-1), m_p(-1),  m_array(a), m_edgeArray(NULL), m_end(false) {
-            ++(*this);
+            // e0 will always remain first.  The only 
+            // question is whether e1 and e2 should be swapped.
+    
+            // See if e1 begins at the vertex where e1 ends.
+            const int e0End = (e0 < 0) ? 
+                edge[~e0].vertexIndex[0] :
+                edge[e0].vertexIndex[1];
+
+            const int e1Begin = (e1 < 0) ? 
+                edge[~e1].vertexIndex[1] :
+                edge[e1].vertexIndex[0];
+
+            F.edgeIndex[0] = e0;
+            if (e0End != e1Begin) {
+                // We must swap e1 and e2
+                F.edgeIndex[1] = e2;
+                F.edgeIndex[2] = e1;
+            } else {
+                F.edgeIndex[1] = e1;
+                F.edgeIndex[2] = e2;
+            }
         }
+    }
+};
 
-    };
 
-    Iterator begin() {
-        return Iterator(table);
+/** Lists the two ends of every edge for sorting by vertex */
+class AdjacencyEdgeEnds {
+public:
+    const MeshAlg::Edge*    edge;
+    int*                    vertex;
+    int*                    value;
+
+    void operator()(int begin, int end) const {
+        for (int e = begin; e < end; ++e) {
+            vertex[2 * e]     = edge[e].vertexIndex[0];
+            value[2 * e]      = e;
+            vertex[2 * e + 1] = edge[e].vertexIndex[1];
+            value[2 * e + 1]  = ~e;
+        }
     }
 };
 
 
-/**
- Assigns the edge index into the next unassigned edge
- index.  The edge index may be negative, indicating
- a reverse edge.
- */
-static void assignEdgeIndex(MeshAlg::Face& face, int e) {
-    for (int i = 0; i < 3; ++i) {
-        if (face.edgeIndex[i] == MeshAlg::Face::NONE) {
-            face.edgeIndex[i] = e;
-            return;
+/** Copies a CompactVertexArray to an Array<MeshAlg::Vertex> */
+class AdjacencyExpand {
+public:
+    const MeshAlg::CompactVertexArray*  compact;
+    MeshAlg::Vertex*                    vertex;
+
+    void operator()(int begin, int end) const {
+        for (int v = begin; v < end; ++v) {
+            MeshAlg::Vertex& V = vertex[v];
+
+            const int* f = compact->face(v);
+            V.faceIndex.resize(compact->numFaces(v));
+            for (int i = 0; i < V.faceIndex.size(); ++i) {
+                V.faceIndex[i] = f[i];
+            }
+
+            const int* e = compact->edge(v);
+            V.edgeIndex.resize(compact->numEdges(v));
+            for (int i = 0; i < V.edgeIndex.size(); ++i) {
+                V.edgeIndex[i] = e[i];
+            }
         }
     }
+};
 
-    debugAssertM(false, "Face has already been assigned 3 edges");
+enum {FACE_GRAIN_SIZE = 4096, VERTEX_GRAIN_SIZE = 4096};
+
+/** Counting sort of the (vertex, value) pairs by vertex into compressed
+    sparse row form.  The sort is stable, so each row lists its values
+    in input order. */
+static void buildRows(const Array<int>& vertex, const Array<int>& value, int numVertices, Array<int>& start, Array<int>& index) {
+    start.resize(numVertices + 1);
+    System::memset(start.getCArray(), 0, sizeof(int) * start.size());
+    for (int i = 0; i < vertex.size(); ++i) {
+        ++start[vertex[i] + 1];
+    }
+    for (int v = 0; v < numVertices; ++v) {
+        start[v + 1] += start[v];
+    }
+
+    index.resize(value.size());
+    Array<int> next;
+    next.resize(numVertices);
+    System::memcpy(next.getCArray(), start.getCArray(), sizeof(int) * numVertices);
+    for (int i = 0; i < vertex.size(); ++i) {
+        index[next[vertex[i]]++] = value[i];
+    }
+}
+
+} // namespace _internal
+
+
+void MeshAlg::CompactVertexArray::clear() {
+    faceStart.fastClear();
+    faceIndex.fastClear();
+    edgeStart.fastClear();
+    edgeIndex.fastClear();
+}
+
+
+void MeshAlg::CompactVertexArray::getVertexArray(Array<Vertex>& vertexArray) const {
+    vertexArray.clear();
+    vertexArray.resize(size());
+
+    _internal::AdjacencyExpand expand;
+    expand.compact = this;
+    expand.vertex  = vertexArray.getCArray();
+    TaskScheduler::global()->parallelFor(0, size(), _internal::VERTEX_GRAIN_SIZE, expand);
 }
 
 
@@ -167,7 +434,7 @@ void MeshAlg::computeAdjacency(
     Array<Edge>&            edgeArray,
     Array< Array<int> >&    adjacentFaceArray) {
 
-    Array<Vertex> vertexArray;
+    CompactVertexArray vertexArray;
 
     computeAdjacency(vertexGeometry, indexArray, faceArray, edgeArray, vertexArray);
 
@@ -175,9 +442,9 @@ void MeshAlg::computeAdjacency(
     adjacentFaceArray.clear();
     adjacentFaceArray.resize(vertexArray.size());
     for (int v = 0; v < adjacentFaceArray.size(); ++v) {
-        const SmallArray<int, 6>& src = vertexArray[v].faceIndex;
+        const int* src = vertexArray.face(v);
         Array<int>& dst = adjacentFaceArray[v];
-        dst.resize(src.size());
+        dst.resize(vertexArray.numFaces(v));
         for (int f = 0; f < dst.size(); ++f) {
             dst[f] = src[f];
         }
@@ -192,233 +459,142 @@ void MeshAlg::computeAdjacency(
     Array<Edge>&            edgeArray,
     Array<Vertex>&          vertexArray) {
 
-    MeshEdgeTable           edgeTable;
-
-    edgeArray.clear();
-    vertexArray.clear();
-    faceArray.clear();
-    
-    // Face normals
-    Array<Vector3> faceNormal;
-    faceNormal.resize(indexArray.size() / 3);
-    faceArray.resize(faceNormal.size());
-
-    // This array has the same size as the vertex array
-    vertexArray.resize(vertexGeometry.size());
-
-    edgeTable.resize(vertexArray.size());
-
-    // Iterate through the triangle list
-    for (int q = 0, f = 0; q < indexArray.size(); ++f, q += 3) {
-
-        Vector3 vertex[3];
-        MeshAlg::Face& face = faceArray[f];
-
-        // Construct the face
-        for (int j = 0; j < 3; ++j) {
-            int v = indexArray[q + j];
-            face.vertexIndex[j] = v;
-            face.edgeIndex[j]   = Face::NONE;
-
-            // Store back pointers in the vertices
-            vertexArray[v].faceIndex.append(f);
-
-            // We'll need these vertices to find the face normal
-            vertex[j]           = vertexGeometry[v];
-        }
-
-        // Compute the face normal
-        const Vector3& N = (vertex[1] - vertex[0]).cross(vertex[2] - vertex[0]);
-        faceNormal[f] = N.directionOrZero();
-
-        static const int nextIndex[] = {1, 2, 0};
-
-        // Add each edge to the edge table.
-        for (int j = 0; j < 3; ++j) {
-            const int      i0 = indexArray[q + j];
-            const int      i1 = indexArray[q + nextIndex[j]];
-
-            if (i0 < i1) {
-                // The edge was directed in the same manner as in the face
-                edgeTable.insert(i0, i1, f);
-            } else {
-                // The edge was directed in the opposite manner as in the face
-                edgeTable.insert(i1, i0, ~f);
-            }
-        }
-    }
-
-    // For each edge in the edge table, create an edge in the edge array.
-    // Collapse every 2 edges from adjacent faces.
-
-    MeshEdgeTable::Iterator cur = edgeTable.begin();
-
-    Array<Edge> tempEdgeArray;
-    while (cur.hasMore()) {
-        MeshEdgeTable::FaceIndexArray& faceIndexArray = cur.faceIndex();
-
-        // Process this edge
-        while (faceIndexArray.size() > 0) {
-
-            // Remove the last index
-            int f0 = faceIndexArray.pop();
-
-            // Find the normal to that face
-            const Vector3& n0 = faceNormal[(f0 >= 0) ? f0 : ~f0];
-
-            bool found = false;
-
-            // We try to find the matching face with the closest
-            // normal.  This ensures that we don't introduce a lot
-            // of artificial ridges into flat parts of a mesh.
-            float ndotn = -2;
-            int f1 = -1, i1 = -1;
-            
-            // Try to find the face with the matching edge
-            for (int i = faceIndexArray.size() - 1; i >= 0; --i) {
-                int f = faceIndexArray[i];
-
-                if ((f >= 0) != (f0 >= 0)) {
-                    // This face contains the oppositely oriented edge
-                    // and has not been assigned too many edges
-
-                    const Vector3& n1 = faceNormal[(f >= 0) ? f : ~f];
-                    float d = n1.dot(n0);
-
-                    if (found) {
-                        // We previously found a good face; see if this
-                        // one is better.
-                        if (d > ndotn) {
-                            // This face is better.
-                            ndotn = d;
-                            f1    = f;
-                            i1    = i;
-                        }
-                    } else {
-                        // This is the first face we've found
-                        found = true;
-                        ndotn = d;
-                        f1    = f;
-                        i1    = i;
-                    }
-                }
-            }
-
-            // Create the new edge
-            int e = tempEdgeArray.size();
-            Edge& edge = tempEdgeArray.next();
-            
-            edge.vertexIndex[0] = cur.i0();
-            edge.vertexIndex[1] = cur.i1();
-
-            if (f0 >= 0) {
-                edge.faceIndex[0] = f0;
-                edge.faceIndex[1] = Face::NONE;
-                assignEdgeIndex(faceArray[f0], e); 
-            } else {
-                // The face indices above are two's complemented.
-                // this code restores them to regular indices.
-                debugAssert((~f0) >= 0);
-                edge.faceIndex[1] = ~f0;
-                edge.faceIndex[0] = Face::NONE;
-
-                // The edge index *does* need to be inverted, however.
-                assignEdgeIndex(faceArray[~f0], ~e); 
-            }
-
-            if (found) {
-                // We found a matching face; remove both
-                // faces from the active list.
-                faceIndexArray.fastRemove(i1);
-
-                if (f1 >= 0) {
-                    edge.faceIndex[0] = f1;
-                    assignEdgeIndex(faceArray[f1], e); 
-                } else {
-                    edge.faceIndex[1] = ~f1;
-                    assignEdgeIndex(faceArray[~f1], ~e); 
-                }
-            }
-        }
+    CompactVertexArray compact;
+    computeAdjacency(vertexGeometry, indexArray, faceArray, edgeArray, compact);
+    compact.getVertexArray(vertexArray);
+}
 
-        ++cur;
-    }
 
-    edgeTable.clear();
+void MeshAlg::computeAdjacency(
+    const Array<Vector3>&   vertexGeometry,
+    const Array<int>&       indexArray,
+    Array<Face>&            faceArray,
+    Array<Edge>&            edgeArray,
+    CompactVertexArray&     vertexArray) {
 
-    // Move boundary edges to the end of the list and then
-    // clean up the face references into them
-    {
-        // Map old edge indices to new edge indices
-        Array<int> newIndex;
-        newIndex.resize(tempEdgeArray.size());
+    using namespace _internal;
+    debugAssertM(indexArray.size() % 3 == 0, "indexArray must be a triangle list");
+    TaskScheduler::Ref scheduler = TaskScheduler::global();
 
-        // Index of the start and end of the edge array
-        int i = 0;
-        int j = tempEdgeArray.size() - 1;
+    const int numVertices = vertexGeometry.size();
+    const int numFaces    = indexArray.size() / 3;
+    const int numSlots    = 3 * numFaces;
 
-        edgeArray.resize(tempEdgeArray.size());
-        for (int e = 0; e < tempEdgeArray.size(); ++e) {
-            if (tempEdgeArray[e].boundary()) {
-                newIndex[e] = j;
-                --j;
-            } else {
-                newIndex[e] = i;
-                ++i;
-            }
-            edgeArray[newIndex[e]] = tempEdgeArray[e];
-        }
+    // Bits needed to store a vertex index
+    const int bits = highestBit(uint32(iMax(numVertices - 1, 1))) + 1;
 
-        debugAssertM(i == j + 1, "Counting from front and back of array did not match");
+    faceArray.resize(numFaces);
 
-        // Fix the faces
-        for (int f = 0; f < faceArray.size(); ++f) {
-            Face& face = faceArray[f];
-            for (int q = 0; q < 3; ++q) {
-                int e = face.edgeIndex[q];
-                if (e < 0) {
-                    // Backwards edge; twiddle before and after conversion
-                    face.edgeIndex[q] = ~newIndex[~e];
-                } else {
-                    // Regular edge; remap the index
-                    face.edgeIndex[q] = newIndex[e];
-                }
-            }
-        }
+    Array<Vector3> faceNormal;
+    faceNormal.resize(numFaces);
+
+    Array<uint64> key;
+    Array<int> slot;
+    key.resize(numSlots);
+    slot.resize(numSlots);
+
+    AdjacencyFaces faces;
+    faces.vertexGeometry = vertexGeometry.getCArray();
+    faces.index          = indexArray.getCArray();
+    faces.bits           = bits;
+    faces.face           = faceArray.getCArray();
+    faces.faceNormal     = faceNormal.getCArray();
+    faces.key            = key.getCArray();
+    faces.slot           = slot.getCArray();
+    scheduler->parallelFor(0, numFaces, FACE_GRAIN_SIZE, faces);
+
+    radixSort(key, slot, 2 * bits);
+
+    // Runs of slots by lower vertex index
+    Array<int> runStart;
+    runStart.resize(numVertices + 1);
+    AdjacencyRunStart findRuns;
+    findRuns.key      = key.getCArray();
+    findRuns.shift    = bits;
+    findRuns.runStart = runStart.getCArray();
+    scheduler->parallelFor(0, numSlots, FACE_GRAIN_SIZE, findRuns);
+    for (int v = (numSlots > 0) ? int(key.last() >> bits) + 1 : 0; v <= numVertices; ++v) {
+        runStart[v] = numSlots;
     }
 
-    // Now order the edge indices inside the faces correctly.
-    for (int f = 0; f < faceArray.size(); ++f) {
-        Face& face = faceArray[f];
-        int e0 = face.edgeIndex[0];
-        int e1 = face.edgeIndex[1];
-        int e2 = face.edgeIndex[2];
-
-        // e0 will always remain first.  The only 
-        // question is whether e1 and e2 should be swapped.
-    
-        // See if e1 begins at the vertex where e1 ends.
-        const int e0End = (e0 < 0) ? 
-            edgeArray[~e0].vertexIndex[0] :
-            edgeArray[e0].vertexIndex[1];
-
-        const int e1Begin = (e1 < 0) ? 
-            edgeArray[~e1].vertexIndex[1] :
-            edgeArray[e1].vertexIndex[0];
-
-        if (e0End != e1Begin) {
-            // We must swap e1 and e2
-            face.edgeIndex[1] = e2;
-            face.edgeIndex[2] = e1;
-        }
+    // Pair the slots of each run
+    Array<int> created, kind, edgeBase, boundaryBase;
+    created.resize(numSlots);
+    kind.resize(numSlots);
+    edgeBase.resize(numVertices + 1);
+    boundaryBase.resize(numVertices + 1);
+
+    AdjacencyPair pair;
+    pair.key         = key.getCArray();
+    pair.slot        = slot.getCArray();
+    pair.runStart    = runStart.getCArray();
+    pair.face        = faceArray.getCArray();
+    pair.faceNormal  = faceNormal.getCArray();
+    pair.created     = created.getCArray();
+    pair.kind        = kind.getCArray();
+    pair.numEdges    = edgeBase.getCArray();
+    pair.numBoundary = boundaryBase.getCArray();
+    scheduler->parallelFor(0, numVertices, VERTEX_GRAIN_SIZE, pair);
+
+    // Convert the per-run counts to the number of edges in earlier runs
+    int numEdges = 0;
+    int numBoundaryEdges = 0;
+    for (int v = 0; v < numVertices; ++v) {
+        const int e = edgeBase[v];
+        const int b = boundaryBase[v];
+        edgeBase[v]     = numEdges;
+        boundaryBase[v] = numBoundaryEdges;
+        numEdges         += e;
+        numBoundaryEdges += b;
     }
-
-    // Fill out the edge adjacency information in the vertex array
-    for (int e = 0; e < edgeArray.size(); ++e) {
-        const Edge& edge = edgeArray[e];
-        vertexArray[edge.vertexIndex[0]].edgeIndex.append(e);
-        vertexArray[edge.vertexIndex[1]].edgeIndex.append(~e);
+    edgeBase[numVertices]     = numEdges;
+    boundaryBase[numVertices] = numBoundaryEdges;
+
+    edgeArray.resize(numEdges);
+
+    Array<int> slotEdge, slotSequence;
+    slotEdge.resize(numSlots);
+    slotSequence.resize(numSlots);
+
+    AdjacencyEdges edges;
+    edges.key          = key.getCArray();
+    edges.slot         = slot.getCArray();
+    edges.runStart     = runStart.getCArray();
+    edges.face         = faceArray.getCArray();
+    edges.created      = created.getCArray();
+    edges.kind         = kind.getCArray();
+    edges.edgeBase     = edgeBase.getCArray();
+    edges.boundaryBase = boundaryBase.getCArray();
+    edges.bits         = bits;
+    edges.edge         = edgeArray.getCArray();
+    edges.numEdges     = numEdges;
+    edges.slotEdge     = slotEdge.getCArray();
+    edges.slotSequence = slotSequence.getCArray();
+    scheduler->parallelFor(0, numVertices, VERTEX_GRAIN_SIZE, edges);
+
+    AdjacencyFaceEdges faceEdges;
+    faceEdges.edge         = edgeArray.getCArray();
+    faceEdges.slotEdge     = slotEdge.getCArray();
+    faceEdges.slotSequence = slotSequence.getCArray();
+    faceEdges.face         = faceArray.getCArray();
+    scheduler->parallelFor(0, numFaces, FACE_GRAIN_SIZE, faceEdges);
+
+    // Faces of each vertex, in face order
+    for (int s = 0; s < numSlots; ++s) {
+        slot[s] = s / 3;
     }
+    buildRows(indexArray, slot, numVertices, vertexArray.faceStart, vertexArray.faceIndex);
+
+    // Edges of each vertex, in edge order
+    Array<int> end;
+    end.resize(2 * numEdges);
+    slot.resize(2 * numEdges);
+    AdjacencyEdgeEnds ends;
+    ends.edge   = edgeArray.getCArray();
+    ends.vertex = end.getCArray();
+    ends.value  = slot.getCArray();
+    scheduler->parallelFor(0, numEdges, FACE_GRAIN_SIZE, ends);
+    buildRows(end, slot, numVertices, vertexArray.edgeStart, vertexArray.edgeIndex);
 }
 
 
@@ -0,0 +1,435 @@
+/**
+  @file MeshAlgOptimize.cpp
+
+  Triangle and vertex reordering for rendering throughput.
+ */
+
+#include "G3D/MeshAlg.h"
+#include "G3D/System.h"
+#include <algorithm>
+
+namespace G3D {
+
+namespace _internal {
+
+/** Simulated FIFO post-transform vertex cache.  A vertex is in the cache
+    if fewer than cacheSize vertices have been transformed since it was. */
+class FIFOVertexCache {
+private:
+    Array<int>          m_time;
+    int                 m_now;
+    int                 m_size;
+
+public:
+
+    FIFOVertexCache(int numVertices, int cacheSize) : m_now(cacheSize + 1), m_size(cacheSize) {
+        m_time.resize(numVertices);
+        System::memset(m_time.getCArray(), 0, sizeof(int) * numVertices);
+    }
+
+    /** Returns the number of vertices of the triangle that had to be transformed */
+    int draw(const int* tri) {
+        int misses = 0;
+        for (int j = 0; j < 3; ++j) {
+            const int v = tri[j];
+            if (m_now - m_time[v] > m_size) {
+                m_time[v] = m_now;
+                ++m_now;
+                ++misses;
+            }
+        }
+        return misses;
+    }
+
+    /** Empties the cache */
+    void clear() {
+        m_now += m_size + 1;
+    }
+};
+
+
+/** Vertex scoring from Forsyth's algorithm */
+class ForsythScore {
+public:
+    enum {CACHE_SIZE = 32, MAX_VALENCE = 32};
+
+private:
+    float               m_cache[CACHE_SIZE];
+    float               m_valence[MAX_VALENCE + 1];
+
+public:
+
+    ForsythScore() {
+        for (int i = 0; i < CACHE_SIZE; ++i) {
+            if (i < 3) {
+                // The vertices of the last triangle are penalized slightly
+                // so that strips do not reuse the same edge
+                m_cache[i] = 0.75f;
+            } else {
+                m_cache[i] = pow(1.0f - float(i - 3) / float(CACHE_SIZE - 3), 1.5f);
+            }
+        }
+
+        m_valence[0] = 0.0f;
+        for (int n = 1; n <= MAX_VALENCE; ++n) {
+            // Favor vertices with few triangles left, to avoid leaving lone triangles behind
+            m_valence[n] = 2.0f / sqrt(float(n));
+        }
+    }
+
+    /** \param cachePosition -1 if not in the cache */
+    float operator()(int cachePosition, int numActiveTriangles) const {
+        if (numActiveTriangles == 0) {
+            return -1.0f;
+        }
+
+        const float c = (cachePosition < 0) ? 0.0f : m_cache[cachePosition];
+        return c + m_valence[iMin(numActiveTriangles, int(MAX_VALENCE))];
+    }
+};
+
+
+/** A run of triangles in optimizeOverdraw */
+class TriangleCluster {
+public:
+    int                 begin;
+    int                 end;
+
+    /** Larger values are drawn first */
+    float               sortKey;
+
+    bool operator<(const TriangleCluster& other) const {
+        // Ties keep the original order
+        return (sortKey > other.sortKey) || ((sortKey == other.sortKey) && (begin < other.begin));
+    }
+};
+
+} // namespace _internal
+
+
+void MeshAlg::computeVertexCacheStatistics(
+    const Array<int>&       indexArray,
+    int                     numVertices,
+    float&                  acmr,
+    float&                  atvr,
+    int                     cacheSize) {
+
+    const int numFaces = indexArray.size() / 3;
+
+    _internal::FIFOVertexCache cache(numVertices, cacheSize);
+    int numTransformed = 0;
+    for (int f = 0; f < numFaces; ++f) {
+        numTransformed += cache.draw(indexArray.getCArray() + 3 * f);
+    }
+
+    Array<bool> used;
+    used.resize(numVertices);
+    System::memset(used.getCArray(), 0, sizeof(bool) * numVertices);
+    int numUsed = 0;
+    for (int i = 0; i < 3 * numFaces; ++i) {
+        if (! used[indexArray[i]]) {
+            used[indexArray[i]] = true;
+            ++numUsed;
+        }
+    }
+
+    acmr = (numFaces > 0) ? float(numTransformed) / float(numFaces) : 0.0f;
+    atvr = (numUsed > 0) ? float(numTransformed) / float(numUsed) : 0.0f;
+}
+
+
+void MeshAlg::optimizeVertexCache(
+    Array<int>&             indexArray,
+    int                     numVertices) {
+
+    typedef _internal::ForsythScore ForsythScore;
+    enum {CACHE_SIZE = ForsythScore::CACHE_SIZE};
+
+    const int numFaces = indexArray.size() / 3;
+    if (numFaces < 2) {
+        return;
+    }
+
+    const ForsythScore score;
+    const int* index = indexArray.getCArray();
+
+    // Triangles of each vertex; the first numActive[v] of them have not been drawn
+    Array<int> triStart, triOfVertex, numActive;
+    triStart.resize(numVertices + 1);
+    numActive.resize(numVertices);
+    System::memset(triStart.getCArray(), 0, sizeof(int) * triStart.size());
+    System::memset(numActive.getCArray(), 0, sizeof(int) * numActive.size());
+    for (int i = 0; i < 3 * numFaces; ++i) {
+        ++numActive[index[i]];
+    }
+    for (int v = 0; v < numVertices; ++v) {
+        triStart[v + 1] = triStart[v] + numActive[v];
+    }
+    triOfVertex.resize(3 * numFaces);
+    {
+        Array<int> next;
+        next.resize(numVertices);
+        System::memcpy(next.getCArray(), triStart.getCArray(), sizeof(int) * numVertices);
+        for (int i = 0; i < 3 * numFaces; ++i) {
+            triOfVertex[next[index[i]]++] = i / 3;
+        }
+    }
+
+    Array<int> cachePosition;
+    Array<float> vertexScore;
+    cachePosition.resize(numVertices);
+    vertexScore.resize(numVertices);
+    for (int v = 0; v < numVertices; ++v) {
+        cachePosition[v] = -1;
+        vertexScore[v] = score(-1, numActive[v]);
+    }
+
+    Array<float> triScore;
+    Array<bool> drawn;
+    triScore.resize(numFaces);
+    drawn.resize(numFaces);
+    int best = 0;
+    for (int f = 0; f < numFaces; ++f) {
+        triScore[f] = vertexScore[index[3 * f]] + vertexScore[index[3 * f + 1]] + vertexScore[index[3 * f + 2]];
+        drawn[f] = false;
+        if (triScore[f] > triScore[best]) {
+            best = f;
+        }
+    }
+
+    // The cache briefly holds three extra vertices while it is updated
+    int cache[CACHE_SIZE + 3];
+    int cacheSize = 0;
+
+    Array<int> output;
+    output.resize(3 * numFaces);
+
+    // Next triangle in the input to fall back to when no cached vertex has triangles left
+    int nextUndrawn = 0;
+
+    for (int n = 0; n < numFaces; ++n) {
+        if (best < 0) {
+            while (drawn[nextUndrawn]) {
+                ++nextUndrawn;
+            }
+            best = nextUndrawn;
+        }
+
+        const int f = best;
+        const int* tri = index + 3 * f;
+        drawn[f] = true;
+        output[3 * n]     = tri[0];
+        output[3 * n + 1] = tri[1];
+        output[3 * n + 2] = tri[2];
+
+        // Remove f from the active triangles of its vertices
+        for (int j = 0; j < 3; ++j) {
+            const int v = tri[j];
+            int* active = triOfVertex.getCArray() + triStart[v];
+            for (int k = 0; k < numActive[v]; ++k) {
+                if (active[k] == f) {
+                    std::swap(active[k], active[numActive[v] - 1]);
+                    --numActive[v];
+                    break;
+                }
+            }
+        }
+
+        // Move the triangle's vertices to the front of the LRU cache
+        int newCache[CACHE_SIZE + 3];
+        int newCacheSize = 0;
+        for (int j = 0; j < 3; ++j) {
+            if ((j == 0) || ((tri[j] != tri[0]) && ((j == 1) || (tri[j] != tri[1])))) {
+                newCache[newCacheSize++] = tri[j];
+            }
+        }
+        for (int i = 0; i < cacheSize; ++i) {
+            const int v = cache[i];
+            if ((v != tri[0]) && (v != tri[1]) && (v != tri[2])) {
+                newCache[newCacheSize++] = v;
+            }
+        }
+
+        for (int i = 0; i < newCacheSize; ++i) {
+            const int v = newCache[i];
+            cachePosition[v] = (i < CACHE_SIZE) ? i : -1;
+            vertexScore[v] = score(cachePosition[v], numActive[v]);
+        }
+
+        // Rescore the triangles that changed and choose the best among
+        // those that use cached vertices
+        best = -1;
+        float bestScore = 0.0f;
+        for (int i = 0; i < newCacheSize; ++i) {
+            const int v = newCache[i];
+            const int* active = triOfVertex.getCArray() + triStart[v];
+            for (int k = 0; k < numActive[v]; ++k) {
+                const int t = active[k];
+                const int* T = index + 3 * t;
+                triScore[t] = vertexScore[T[0]] + vertexScore[T[1]] + vertexScore[T[2]];
+                if ((i < CACHE_SIZE) && ((best < 0) || (triScore[t] > bestScore))) {
+                    best = t;
+                    bestScore = triScore[t];
+                }
+            }
+        }
+
+        cacheSize = iMin(newCacheSize, int(CACHE_SIZE));
+        for (int i = 0; i < cacheSize; ++i) {
+            cache[i] = newCache[i];
+        }
+    }
+
+    indexArray.resize(output.size());
+    System::memcpy(indexArray.getCArray(), output.getCArray(), sizeof(int) * output.size());
+}
+
+
+void MeshAlg::optimizeOverdraw(
+    const Array<Vector3>&   vertexArray,
+    Array<int>&             indexArray,
+    float                   threshold,
+    int                     cacheSize) {
+
+    using _internal::TriangleCluster;
+
+    const int numFaces = indexArray.size() / 3;
+    if (numFaces < 2) {
+        return;
+    }
+
+    const int* index = indexArray.getCArray();
+    _internal::FIFOVertexCache cache(vertexArray.size(), cacheSize);
+
+    // Hard boundaries, where the cache is cold because all three
+    // vertices of a triangle miss
+    Array<int> hardBegin;
+    for (int f = 0; f < numFaces; ++f) {
+        if ((cache.draw(index + 3 * f) == 3) || (f == 0)) {
+            hardBegin.append(f);
+        }
+    }
+    hardBegin.append(numFaces);
+
+    // Split each hard cluster where the miss ratio so far is already
+    // close to that of the whole hard cluster
+    Array<TriangleCluster> cluster;
+    for (int h = 0; h + 1 < hardBegin.size(); ++h) {
+        const int begin = hardBegin[h];
+        const int end   = hardBegin[h + 1];
+
+        cache.clear();
+        int misses = 0;
+        for (int f = begin; f < end; ++f) {
+            misses += cache.draw(index + 3 * f);
+        }
+        const float maxRatio = threshold * float(misses) / float(end - begin);
+
+        cache.clear();
+        misses = 0;
+        int start = begin;
+        for (int f = begin; f < end; ++f) {
+            misses += cache.draw(index + 3 * f);
+            if ((f + 1 < end) && (float(misses) <= maxRatio * float(f + 1 - start))) {
+                TriangleCluster& c = cluster.next();
+                c.begin = start;
+                c.end   = f + 1;
+                start   = f + 1;
+                misses  = 0;
+                cache.clear();
+            }
+        }
+        TriangleCluster& c = cluster.next();
+        c.begin = start;
+        c.end   = end;
+    }
+
+    // Area-weighted centroid of the mesh
+    Vector3 meshCenter;
+    float meshArea = 0.0f;
+    for (int f = 0; f < numFaces; ++f) {
+        const Vector3& v0 = vertexArray[index[3 * f]];
+        const Vector3& v1 = vertexArray[index[3 * f + 1]];
+        const Vector3& v2 = vertexArray[index[3 * f + 2]];
+        const float area = (v1 - v0).cross(v2 - v0).length();
+        meshCenter += (v0 + v1 + v2) * area;
+        meshArea += area;
+    }
+    meshCenter = (meshArea > 0.0f) ? meshCenter / (3.0f * meshArea) : Vector3::zero();
+
+    // Clusters that face away from the center occlude the rest of the mesh
+    for (int c = 0; c < cluster.size(); ++c) {
+        Vector3 center;
+        Vector3 normal;
+        float area = 0.0f;
+        for (int f = cluster[c].begin; f < cluster[c].end; ++f) {
+            const Vector3& v0 = vertexArray[index[3 * f]];
+            const Vector3& v1 = vertexArray[index[3 * f + 1]];
+            const Vector3& v2 = vertexArray[index[3 * f + 2]];
+            const Vector3& N = (v1 - v0).cross(v2 - v0);
+            const float a = N.length();
+            center += (v0 + v1 + v2) * a;
+            normal += N;
+            area += a;
+        }
+
+        if (area > 0.0f) {
+            center /= 3.0f * area;
+            cluster[c].sortKey = (center - meshCenter).dot(normal.directionOrZero());
+        } else {
+            cluster[c].sortKey = 0.0f;
+        }
+    }
+
+    std::sort(cluster.begin(), cluster.end());
+
+    Array<int> output;
+    output.resize(3 * numFaces);
+    int n = 0;
+    for (int c = 0; c < cluster.size(); ++c) {
+        const int count = 3 * (cluster[c].end - cluster[c].begin);
+        System::memcpy(output.getCArray() + n, index + 3 * cluster[c].begin, sizeof(int) * count);
+        n += count;
+    }
+
+    indexArray.resize(output.size());
+    System::memcpy(indexArray.getCArray(), output.getCArray(), sizeof(int) * output.size());
+}
+
+
+void MeshAlg::optimizeVertexFetch(
+    Array<Array<int>*>&     indexArrayArray,
+    int                     numVertices,
+    Array<int>&             toNew,
+    Array<int>&             toOld) {
+
+    toNew.resize(numVertices);
+    for (int v = 0; v < numVertices; ++v) {
+        toNew[v] = -1;
+    }
+
+    toOld.fastClear();
+    for (int a = 0; a < indexArrayArray.size(); ++a) {
+        if (indexArrayArray[a] != NULL) {
+            Array<int>& index = *indexArrayArray[a];
+            for (int i = 0; i < index.size(); ++i) {
+                int& v = toNew[index[i]];
+                if (v < 0) {
+                    v = toOld.size();
+                    toOld.append(index[i]);
+                }
+                index[i] = v;
+            }
+        }
+    }
+
+    // Unused vertices go at the end
+    for (int v = 0; v < numVertices; ++v) {
+        if (toNew[v] < 0) {
+            toNew[v] = toOld.size();
+            toOld.append(v);
+        }
+    }
+}
+
+} // namespace G3D
@@ -0,0 +1,575 @@
+/**
+  @file MeshAlgSimplify.cpp
+
+  The MeshAlg::simplify method.
+
+  Collapses are applied in passes.  Each pass scores every allowed
+  half-edge collapse, sorts them by cost, and greedily applies the
+  cheapest ones whose neighborhoods do not overlap, so that the costs
+  and validity tests computed at the start of the pass remain exact.
+ */
+
+#include "G3D/MeshAlg.h"
+#include "G3D/MortonGrid.h"
+#include <algorithm>
+
+namespace G3D {
+
+namespace _internal {
+
+/** Garland-Heckbert error quadric: a weighted sum of squared distances to planes */
+class Quadric {
+public:
+    double      a2, b2, c2, ab, ac, bc, ad, bd, cd, d2;
+
+    /** Sum of the weights of the planes */
+    double      weight;
+
+    Quadric() : a2(0), b2(0), c2(0), ab(0), ac(0), bc(0), ad(0), bd(0), cd(0), d2(0), weight(0) {}
+
+    /** The plane n.p + d = 0, where n has unit length */
+    Quadric(const Vector3& n, float d, double w) :
+        a2(w * n.x * n.x), b2(w * n.y * n.y), c2(w * n.z * n.z),
+        ab(w * n.x * n.y), ac(w * n.x * n.z), bc(w * n.y * n.z),
+        ad(w * n.x * d),   bd(w * n.y * d),   cd(w * n.z * d),
+        d2(w * d * d), weight(w) {}
+
+    void operator+=(const Quadric& q) {
+        a2 += q.a2; b2 += q.b2; c2 += q.c2;
+        ab += q.ab; ac += q.ac; bc += q.bc;
+        ad += q.ad; bd += q.bd; cd += q.cd;
+        d2 += q.d2; weight += q.weight;
+    }
+
+    /** Weighted mean squared distance from \a p to the planes */
+    double error(const Vector3& p) const {
+        if (weight <= 0.0) {
+            return 0.0;
+        }
+
+        const double x = p.x, y = p.y, z = p.z;
+        const double e =
+            a2 * x * x + b2 * y * y + c2 * z * z +
+            2.0 * (ab * x * y + ac * x * z + bc * y * z) +
+            2.0 * (ad * x + bd * y + cd * z) + d2;
+
+        return G3D::max(e, 0.0) / weight;
+    }
+};
+
+
+/** MortonGrid::cluster rule for MeshAlg::simplify. Vertices match when
+    their positions are within the weld radius and, if \a attributes,
+    their texture coordinates and normals are within those radii. */
+class SimplifyWeldRule {
+public:
+    const Vector3*          vertex;
+    const Vector2*          texCoord;
+    const Vector3*          normal;
+    const Welder::Settings* settings;
+    bool                    attributes;
+
+    bool match(int i, int j) const {
+        if ((vertex[i] - vertex[j]).squaredMagnitude() > square(settings->vertexWeldRadius)) {
+            return false;
+        }
+
+        if (attributes) {
+            if ((texCoord != NULL) && ((texCoord[i] - texCoord[j]).squaredLength() > square(settings->textureWeldRadius))) {
+                return false;
+            }
+            if ((normal != NULL) && ((normal[i] - normal[j]).squaredMagnitude() > square(settings->normalWeldRadius))) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    float cost(int i, int j) const {
+        return (vertex[i] - vertex[j]).squaredMagnitude();
+    }
+};
+
+
+/** Collapse of vertex u into vertex v */
+class EdgeCollapse {
+public:
+    float       cost;
+    int         u;
+    int         v;
+
+    bool operator<(const EdgeCollapse& other) const {
+        // Ties are broken by index so that the result is deterministic
+        return (cost < other.cost) ||
+            ((cost == other.cost) && ((u < other.u) || ((u == other.u) && (v < other.v))));
+    }
+};
+
+
+class Simplifier {
+public:
+    enum Kind {
+        /** Not referenced by any face */
+        UNUSED,
+
+        /** May collapse into any neighbor */
+        INTERIOR,
+
+        /** May collapse only along a border edge */
+        BORDER,
+
+        /** Never removed: on a seam, shared by index arrays, or non-manifold */
+        LOCKED
+    };
+
+    const Array<Vector3>&   vertex;
+
+    /** Three indices per face */
+    Array<int>              face;
+
+    /** Index array that each face came from */
+    Array<int>              faceSource;
+
+    /** Unit normal of the input face that each face came from, or zero
+        if it was degenerate.  Comparing against this instead of the
+        current normal keeps a sequence of small rotations from
+        turning a face over. */
+    Array<Vector3>          originalNormal;
+
+    Array<Quadric>          quadric;
+
+    /** True for vertices that can never be removed */
+    Array<bool>             locked;
+
+    Array<uint8>            kind;
+
+    /** Faces of vertex v are faceOf[faceStart[v] ... faceStart[v + 1] - 1] */
+    Array<int>              faceStart;
+    Array<int>              faceOf;
+
+    /** For marking neighbors in linkConditionHolds */
+    Array<int>              mark;
+    int                     stamp;
+
+    Simplifier(const Array<Vector3>& v) : vertex(v), stamp(0) {
+        mark.resize(v.size());
+        System::memset(mark.getCArray(), 0, sizeof(int) * mark.size());
+    }
+
+    /** Builds faceStart and faceOf for the current faces */
+    void computeVertexFaces() {
+        const int n = vertex.size();
+        faceStart.resize(n + 1);
+        System::memset(faceStart.getCArray(), 0, sizeof(int) * faceStart.size());
+        for (int i = 0; i < face.size(); ++i) {
+            ++faceStart[face[i] + 1];
+        }
+        for (int v = 0; v < n; ++v) {
+            faceStart[v + 1] += faceStart[v];
+        }
+
+        faceOf.resize(face.size());
+        Array<int> next;
+        next.resize(n);
+        System::memcpy(next.getCArray(), faceStart.getCArray(), sizeof(int) * n);
+        for (int i = 0; i < face.size(); ++i) {
+            faceOf[next[face[i]]++] = i / 3;
+        }
+    }
+
+    bool faceContains(int f, int v) const {
+        const int* F = face.getCArray() + 3 * f;
+        return (F[0] == v) || (F[1] == v) || (F[2] == v);
+    }
+
+    /** Number of faces that contain the edge (u, w) */
+    int numEdgeFaces(int u, int w) const {
+        int count = 0;
+        for (int i = faceStart[u]; i < faceStart[u + 1]; ++i) {
+            if (faceContains(faceOf[i], w)) {
+                ++count;
+            }
+        }
+        return count;
+    }
+
+    void computeKinds() {
+        kind.resize(vertex.size());
+        for (int u = 0; u < vertex.size(); ++u) {
+            if (faceStart[u] == faceStart[u + 1]) {
+                kind[u] = UNUSED;
+            } else if (locked[u]) {
+                kind[u] = LOCKED;
+            } else {
+                kind[u] = INTERIOR;
+                for (int i = faceStart[u]; (i < faceStart[u + 1]) && (kind[u] != LOCKED); ++i) {
+                    const int* F = face.getCArray() + 3 * faceOf[i];
+                    for (int j = 0; j < 3; ++j) {
+                        if (F[j] != u) {
+                            const int c = numEdgeFaces(u, F[j]);
+                            if (c > 2) {
+                                kind[u] = LOCKED;
+                                break;
+                            } else if (c == 1) {
+                                kind[u] = BORDER;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    /** Quadrics of the faces, plus planes perpendicular to the faces
+        through border edges so that borders keep their shape */
+    void computeQuadrics() {
+        // Relative to the area weight of the faces
+        static const double BORDER_WEIGHT = 10.0;
+
+        quadric.resize(vertex.size());
+        for (int f = 0; f < face.size() / 3; ++f) {
+            const int* F = face.getCArray() + 3 * f;
+            const Vector3& N = (vertex[F[1]] - vertex[F[0]]).cross(vertex[F[2]] - vertex[F[0]]);
+            const float len = N.length();
+            if (len <= 0.0f) {
+                continue;
+            }
+
+            const Vector3& n = N / len;
+            const Quadric Q(n, -n.dot(vertex[F[0]]), 0.5 * len);
+            for (int j = 0; j < 3; ++j) {
+                quadric[F[j]] += Q;
+            }
+
+            for (int j = 0; j < 3; ++j) {
+                const int a = F[j], b = F[(j + 1) % 3];
+                if (numEdgeFaces(a, b) == 1) {
+                    const Vector3& edge = vertex[b] - vertex[a];
+                    const Vector3& m = edge.cross(n).directionOrZero();
+                    const Quadric B(m, -m.dot(vertex[a]), BORDER_WEIGHT * edge.squaredLength());
+                    quadric[a] += B;
+                    quadric[b] += B;
+                }
+            }
+        }
+    }
+
+    /** Appends the collapses along the edges of the current faces that
+        the vertex kinds allow */
+    void getCandidates(Array<EdgeCollapse>& candidate) const {
+        candidate.fastClear();
+        for (int f = 0; f < face.size() / 3; ++f) {
+            const int* F = face.getCArray() + 3 * f;
+            for (int j = 0; j < 3; ++j) {
+                // Each interior edge appears in two faces, once in each
+                // direction, so consider only u -> v here and v -> u
+                // from the other face.  Border edges appear once.
+                const int u = F[j], v = F[(j + 1) % 3];
+                if ((kind[u] == LOCKED) && (kind[v] == LOCKED)) {
+                    continue;
+                }
+
+                const bool border = (numEdgeFaces(u, v) == 1);
+                tryAdd(u, v, border, candidate);
+                if (border) {
+                    tryAdd(v, u, border, candidate);
+                }
+            }
+        }
+    }
+
+    void tryAdd(int u, int v, bool borderEdge, Array<EdgeCollapse>& candidate) const {
+        if ((kind[u] == INTERIOR) || ((kind[u] == BORDER) && borderEdge)) {
+            Quadric Q = quadric[u];
+            Q += quadric[v];
+
+            EdgeCollapse& c = candidate.next();
+            c.u = u;
+            c.v = v;
+            c.cost = (float)Q.error(vertex[v]);
+        }
+    }
+
+    /** True if u and v have no common neighbors besides the third
+        vertices of the \a numShared faces containing both, so that
+        collapsing them cannot pinch the surface */
+    bool linkConditionHolds(int u, int v, int numShared) {
+        stamp += 2;
+        for (int i = faceStart[u]; i < faceStart[u + 1]; ++i) {
+            const int* F = face.getCArray() + 3 * faceOf[i];
+            for (int j = 0; j < 3; ++j) {
+                if (F[j] != u) {
+                    mark[F[j]] = stamp;
+                }
+            }
+        }
+
+        int numCommon = 0;
+        for (int i = faceStart[v]; i < faceStart[v + 1]; ++i) {
+            const int* F = face.getCArray() + 3 * faceOf[i];
+            for (int j = 0; j < 3; ++j) {
+                if ((F[j] != v) && (mark[F[j]] == stamp)) {
+                    // Count each neighbor once
+                    mark[F[j]] = stamp + 1;
+                    ++numCommon;
+                }
+            }
+        }
+
+        return numCommon == numShared;
+    }
+
+    /** True if moving u to v turns over or nearly flattens a face of u
+        that does not contain v, or makes it coincide with a face of v */
+    bool collapseFoldsFace(int u, int v) const {
+        for (int i = faceStart[u]; i < faceStart[u + 1]; ++i) {
+            const int f = faceOf[i];
+            if (faceContains(f, v)) {
+                continue;
+            }
+
+            const int* F = face.getCArray() + 3 * f;
+            const int a = (F[0] == u) ? F[1] : F[0];
+            const int b = (F[2] == u) ? F[1] : F[2];
+            for (int k = faceStart[v]; k < faceStart[v + 1]; ++k) {
+                if (faceContains(faceOf[k], a) && faceContains(faceOf[k], b)) {
+                    return true;
+                }
+            }
+
+            Vector3 p[3];
+            for (int j = 0; j < 3; ++j) {
+                p[j] = vertex[F[j]];
+            }
+            const Vector3& oldN = (p[1] - p[0]).cross(p[2] - p[0]);
+            for (int j = 0; j < 3; ++j) {
+                if (F[j] == u) {
+                    p[j] = vertex[v];
+                }
+            }
+            const Vector3& newN = (p[1] - p[0]).cross(p[2] - p[0]);
+
+            const float oldLen2 = oldN.squaredLength();
+            const float newLen2 = newN.squaredLength();
+            if (oldLen2 > 0.0f) {
+                // Reject rotations of more than about 75 degrees, and
+                // faces that would become (numerically) degenerate
+                if ((newLen2 < 1e-6f * oldLen2) || (newN.dot(originalNormal[f]) <= 0.25f * sqrt(newLen2))) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    /** Rewrites the faces through \a remap, removing degenerate faces */
+    void applyRemap(const Array<int>& remap) {
+        int out = 0;
+        for (int f = 0; f < face.size() / 3; ++f) {
+            const int a = remap[face[3 * f]], b = remap[face[3 * f + 1]], c = remap[face[3 * f + 2]];
+            if ((a != b) && (b != c) && (a != c)) {
+                face[3 * out]     = a;
+                face[3 * out + 1] = b;
+                face[3 * out + 2] = c;
+                faceSource[out]   = faceSource[f];
+                originalNormal[out] = originalNormal[f];
+                ++out;
+            }
+        }
+        face.resize(3 * out);
+        faceSource.resize(out);
+        originalNormal.resize(out);
+    }
+};
+
+} // namespace _internal
+
+
+void MeshAlg::simplify(
+    const Geometry&         geometry,
+    const Array<Vector2>&   texCoordArray,
+    Array<Array<int>*>&     indexArrayArray,
+    int                     targetNumFaces,
+    float&                  error,
+    float                   maxError,
+    const Welder::Settings& settings) {
+
+    using namespace _internal;
+
+    error = 0.0f;
+
+    const Array<Vector3>& vertex = geometry.vertexArray;
+    const int numVertices = vertex.size();
+
+    // Index array that uses each vertex, -1 if none, and -2 if several
+    Array<int> owner;
+    owner.resize(numVertices);
+    for (int v = 0; v < numVertices; ++v) {
+        owner[v] = -1;
+    }
+    for (int a = 0; a < indexArrayArray.size(); ++a) {
+        if (indexArrayArray[a] != NULL) {
+            const Array<int>& index = *indexArrayArray[a];
+            debugAssertM(index.size() % 3 == 0, "Index arrays must be triangle lists");
+            for (int i = 0; i < index.size(); ++i) {
+                int& o = owner[index[i]];
+                o = ((o == -1) || (o == a)) ? a : -2;
+            }
+        }
+    }
+
+    Simplifier simplifier(vertex);
+    Array<bool>& locked = simplifier.locked;
+    locked.resize(numVertices);
+
+    // Vertices that are within the weld radii are the same vertex.
+    // Vertices that share a position but not attributes lie on a seam.
+    Array<int> canonical;
+    {
+        MortonGrid grid;
+        grid.set(vertex, settings.vertexWeldRadius);
+
+        SimplifyWeldRule rule;
+        rule.vertex     = vertex.getCArray();
+        rule.texCoord   = (texCoordArray.size() == numVertices) ? texCoordArray.getCArray() : NULL;
+        rule.normal     = (geometry.normalArray.size() == numVertices) ? geometry.normalArray.getCArray() : NULL;
+        rule.settings   = &settings;
+
+        Array<int> position;
+        rule.attributes = false;
+        grid.cluster(settings.vertexWeldRadius, rule, position);
+        rule.attributes = true;
+        grid.cluster(settings.vertexWeldRadius, rule, canonical);
+
+        // Canonical vertex of the first used vertex at each position
+        Array<int> positionCanonical;
+        Array<bool> seam;
+        positionCanonical.resize(numVertices);
+        seam.resize(numVertices);
+        for (int v = 0; v < numVertices; ++v) {
+            positionCanonical[v] = -1;
+            seam[v] = false;
+        }
+        for (int v = 0; v < numVertices; ++v) {
+            if (owner[v] != -1) {
+                int& c = positionCanonical[position[v]];
+                if (c == -1) {
+                    c = canonical[v];
+                } else if (c != canonical[v]) {
+                    seam[position[v]] = true;
+                }
+            }
+        }
+
+        for (int v = 0; v < numVertices; ++v) {
+            locked[v] = (owner[v] == -2) || seam[position[v]];
+        }
+
+        // A canonical vertex must be locked if any vertex that maps to it is
+        for (int v = 0; v < numVertices; ++v) {
+            if (locked[v]) {
+                locked[canonical[v]] = true;
+            }
+        }
+    }
+
+    // Gather the faces
+    for (int a = 0; a < indexArrayArray.size(); ++a) {
+        if (indexArrayArray[a] != NULL) {
+            const Array<int>& index = *indexArrayArray[a];
+            for (int i = 0; i + 2 < index.size(); i += 3) {
+                simplifier.face.append(canonical[index[i]], canonical[index[i + 1]], canonical[index[i + 2]]);
+                simplifier.faceSource.append(a);
+
+                const Vector3& v0 = vertex[index[i]];
+                simplifier.originalNormal.append((vertex[index[i + 1]] - v0).cross(vertex[index[i + 2]] - v0).directionOrZero());
+            }
+        }
+    }
+
+    Array<int> remap;
+    remap.resize(numVertices);
+    for (int v = 0; v < numVertices; ++v) {
+        remap[v] = v;
+    }
+    simplifier.applyRemap(remap);
+
+    simplifier.computeVertexFaces();
+    simplifier.computeQuadrics();
+
+    const double maxCost = (maxError < finf()) ? square((double)maxError) : inf();
+
+    Array<EdgeCollapse> candidate;
+    Array<bool> touched;
+    touched.resize(numVertices);
+
+    bool first = true;
+    while (simplifier.faceSource.size() > targetNumFaces) {
+        if (! first) {
+            simplifier.computeVertexFaces();
+        }
+        first = false;
+
+        simplifier.computeKinds();
+        simplifier.getCandidates(candidate);
+        std::sort(candidate.begin(), candidate.end());
+
+        System::memset(touched.getCArray(), 0, sizeof(bool) * numVertices);
+
+        const int numFaces = simplifier.faceSource.size();
+        int numRemoved = 0;
+        int numCollapses = 0;
+        for (int i = 0; (i < candidate.size()) && (numFaces - numRemoved > targetNumFaces); ++i) {
+            const EdgeCollapse& c = candidate[i];
+            if (c.cost > maxCost) {
+                break;
+            }
+
+            const int u = c.u, v = c.v;
+            if (touched[u] || touched[v]) {
+                continue;
+            }
+
+            const int numShared = simplifier.numEdgeFaces(u, v);
+            if (! simplifier.linkConditionHolds(u, v, numShared) || simplifier.collapseFoldsFace(u, v)) {
+                continue;
+            }
+
+            remap[u] = v;
+            simplifier.quadric[v] += simplifier.quadric[u];
+
+            // Later collapses in this pass may not change the faces around u
+            for (int k = simplifier.faceStart[u]; k < simplifier.faceStart[u + 1]; ++k) {
+                const int* F = simplifier.face.getCArray() + 3 * simplifier.faceOf[k];
+                touched[F[0]] = touched[F[1]] = touched[F[2]] = true;
+            }
+
+            error = G3D::max(error, sqrt(c.cost));
+            numRemoved += numShared;
+            ++numCollapses;
+        }
+
+        if (numCollapses == 0) {
+            break;
+        }
+
+        simplifier.applyRemap(remap);
+        for (int v = 0; v < numVertices; ++v) {
+            remap[v] = v;
+        }
+    }
+
+    // Write the faces back in their original order
+    for (int a = 0; a < indexArrayArray.size(); ++a) {
+        if (indexArrayArray[a] != NULL) {
+            indexArrayArray[a]->fastClear();
+        }
+    }
+    for (int f = 0; f < simplifier.faceSource.size(); ++f) {
+        const int* F = simplifier.face.getCArray() + 3 * f;
+        indexArrayArray[simplifier.faceSource[f]]->append(F[0], F[1], F[2]);
+    }
+}
+
+} // namespace G3D
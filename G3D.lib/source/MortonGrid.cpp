@@ -0,0 +1,183 @@
+/**
+  @file MortonGrid.cpp
+ */
+
+#include "G3D/MortonGrid.h"
+#include "G3D/radixSort.h"
+
+namespace G3D {
+
+namespace _internal {
+
+class MortonCodeBody {
+public:
+    const MortonGrid*   grid;
+    const Vector3*      point;
+    uint64*             key;
+    int*                value;
+
+    void operator()(int begin, int end) const;
+};
+
+class MortonGatherBody {
+public:
+    const Vector3*      point;
+    const int*          index;
+    Vector3*            position;
+
+    void operator()(int begin, int end) const {
+        for (int k = begin; k < end; ++k) {
+            position[k] = point[index[k]];
+        }
+    }
+};
+
+} // namespace _internal
+
+/** Inverse of spreadBits */
+static uint32 compactBits(uint64 v) {
+    v &= 0x1249249249249249ULL;
+    v = (v | (v >>  2)) & 0x10C30C30C30C30C3ULL;
+    v = (v | (v >>  4)) & 0x100F00F00F00F00FULL;
+    v = (v | (v >>  8)) & 0x001F0000FF0000FFULL;
+    v = (v | (v >> 16)) & 0x001F00000000FFFFULL;
+    v = (v | (v >> 32)) & MortonGrid::MAX_CELL_COORD;
+    return (uint32)v;
+}
+
+
+void MortonGrid::set(const Array<Vector3>& point, float minCellWidth, bool useThreads) {
+    const int n = point.size();
+
+    // Bounds of the finite points
+    Vector3 lo = Vector3::inf();
+    Vector3 hi = -Vector3::inf();
+    for (int i = 0; i < n; ++i) {
+        if (point[i].isFinite()) {
+            lo = lo.min(point[i]);
+            hi = hi.max(point[i]);
+        }
+    }
+    if (lo.x > hi.x) {
+        lo = hi = Vector3::zero();
+    }
+    const Vector3& extent = hi - lo;
+    const float maxExtent = extent.max();
+
+    // About one point per cell for points on a surface
+    m_cellWidth = G3D::max(minCellWidth, maxExtent / sqrt((float)iMax(n, 1)));
+    m_cellWidth = G3D::max(m_cellWidth, maxExtent / (float)MAX_CELL_COORD);
+    if (! (m_cellWidth > 0.0f)) {
+        m_cellWidth = 1.0f;
+    }
+    m_invCellWidth = 1.0f / m_cellWidth;
+    m_origin = lo;
+
+    Array<uint64> key;
+    key.resize(n);
+    m_index.resize(n);
+
+    _internal::MortonCodeBody code;
+    code.grid  = this;
+    code.point = point.getCArray();
+    code.key   = key.getCArray();
+    code.value = m_index.getCArray();
+
+    enum {GRAIN_SIZE = 8192};
+    if (useThreads) {
+        TaskScheduler::global()->parallelFor(0, n, GRAIN_SIZE, code);
+    } else {
+        code(0, n);
+    }
+
+    const int maxCoord = iMax(cellCoord(hi.x, lo.x), iMax(cellCoord(hi.y, lo.y), cellCoord(hi.z, lo.z)));
+    const int numBits = (maxCoord > 0) ? 3 * (highestBit(maxCoord) + 1) : 0;
+    radixSort(key, m_index, numBits, useThreads);
+
+    m_position.resize(n);
+    _internal::MortonGatherBody gather;
+    gather.point    = point.getCArray();
+    gather.index    = m_index.getCArray();
+    gather.position = m_position.getCArray();
+    if (useThreads) {
+        TaskScheduler::global()->parallelFor(0, n, GRAIN_SIZE, gather);
+    } else {
+        gather(0, n);
+    }
+
+    m_cellCode.fastClear();
+    m_cellStart.fastClear();
+    for (int k = 0; k < n; ++k) {
+        if ((k == 0) || (key[k] != key[k - 1])) {
+            m_cellCode.append(key[k]);
+            m_cellStart.append(k);
+        }
+    }
+    m_cellStart.append(n);
+
+    // Hash table at most half full
+    int tableSize = 2;
+    m_hashShift = 63;
+    while (tableSize < 2 * numCells()) {
+        tableSize *= 2;
+        --m_hashShift;
+    }
+    m_hashTable.resize(tableSize);
+    for (int s = 0; s < tableSize; ++s) {
+        m_hashTable[s] = -1;
+    }
+    for (int c = 0; c < numCells(); ++c) {
+        int s = hashSlot(m_cellCode[c]);
+        while (m_hashTable[s] >= 0) {
+            s = (s + 1) & (tableSize - 1);
+        }
+        m_hashTable[s] = c;
+    }
+}
+
+
+void _internal::MortonCodeBody::operator()(int begin, int end) const {
+    const Vector3& origin = grid->m_origin;
+    for (int i = begin; i < end; ++i) {
+        const Vector3& p = point[i];
+        key[i]   = MortonGrid::mortonCode(grid->cellCoord(p.x, origin.x), grid->cellCoord(p.y, origin.y), grid->cellCoord(p.z, origin.z));
+        value[i] = i;
+    }
+}
+
+
+void MortonGrid::getCells(const AABox& box, Array<int>& cell) const {
+    if (numCells() == 0) {
+        return;
+    }
+
+    const int x0 = cellCoord(box.low().x, m_origin.x),  x1 = cellCoord(box.high().x, m_origin.x);
+    const int y0 = cellCoord(box.low().y, m_origin.y),  y1 = cellCoord(box.high().y, m_origin.y);
+    const int z0 = cellCoord(box.low().z, m_origin.z),  z1 = cellCoord(box.high().z, m_origin.z);
+
+    const double volume = double(x1 - x0 + 1) * double(y1 - y0 + 1) * double(z1 - z0 + 1);
+    if (volume > numCells()) {
+        // Cheaper to test every cell than to look up every coordinate
+        for (int c = 0; c < numCells(); ++c) {
+            const uint64 code = m_cellCode[c];
+            const int x = compactBits(code), y = compactBits(code >> 1), z = compactBits(code >> 2);
+            if ((x >= x0) && (x <= x1) && (y >= y0) && (y <= y1) && (z >= z0) && (z <= z1)) {
+                cell.append(c);
+            }
+        }
+        return;
+    }
+
+    for (int z = z0; z <= z1; ++z) {
+        for (int y = y0; y <= y1; ++y) {
+            for (int x = x0; x <= x1; ++x) {
+                const int c = findCell(mortonCode(x, y, z));
+                if (c >= 0) {
+                    cell.append(c);
+                }
+            }
+        }
+    }
+}
+
+} // namespace G3D
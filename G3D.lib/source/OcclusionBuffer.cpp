@@ -0,0 +1,480 @@
+/**
+ @file OcclusionBuffer.cpp
+
+ Edge functions and depth are evaluated at pixel centers.  The
+ constant terms are kept in double precision and each row starts from
+ a double-precision evaluation, because triangles clipped against the
+ near plane can have vertices far outside the buffer.
+ */
+
+#include "G3D/OcclusionBuffer.h"
+#include "G3D/GCamera.h"
+#include "G3D/Rect2D.h"
+#include "G3D/System.h"
+#include "G3D/TaskScheduler.h"
+#include <algorithm>
+
+#if defined(G3D_WIN32) || defined(__i386__) || defined(__x86_64__)
+#   define G3D_OCCLUSION_SIMD
+#   include <emmintrin.h>
+
+    // GCC only emits instructions beyond the compiler's target for functions that ask for them
+#   if defined(__GNUC__) && ! defined(__SSE2__)
+#       define G3D_TARGET_SSE2 __attribute__((target("sse2")))
+#   else
+#       define G3D_TARGET_SSE2
+#   endif
+#endif
+
+namespace G3D {
+
+namespace _internal {
+
+class OcclusionTransform {
+public:
+    OcclusionBuffer*    buffer;
+
+    void operator()(int begin, int end) const {
+        for (int i = begin; i < end; ++i) {
+            buffer->transformVertices(buffer->m_vertexBatch[i]);
+        }
+    }
+};
+
+
+class OcclusionSetup {
+public:
+    OcclusionBuffer*    buffer;
+
+    void operator()(int begin, int end) const {
+        for (int i = begin; i < end; ++i) {
+            buffer->setupTriangles(buffer->m_triangleBatch[i]);
+        }
+    }
+};
+
+
+class OcclusionRaster {
+public:
+    OcclusionBuffer*    buffer;
+    bool                sse;
+
+    void operator()(int begin, int end) const {
+        for (int t = begin; t < end; ++t) {
+            buffer->rasterizeTile(t, sse);
+        }
+    }
+};
+
+} // namespace _internal
+
+
+/** Pixels are clamped to this range before conversion to int */
+static const float MAX_PIXEL = 1e6f;
+
+/** Writes the depth of the pixels in [x, x + n) of one row whose centers are inside all three edges */
+static void rasterizeSpan
+(float* row, int n, const float e[3], const float a[3], float depth, float depthA) {
+
+    float e0 = e[0], e1 = e[1], e2 = e[2];
+    for (int i = 0; i < n; ++i) {
+        if ((e0 >= 0.0f) && (e1 >= 0.0f) && (e2 >= 0.0f)) {
+            row[i] = max(row[i], depth);
+        }
+        e0 += a[0];
+        e1 += a[1];
+        e2 += a[2];
+        depth += depthA;
+    }
+}
+
+
+#ifdef G3D_OCCLUSION_SIMD
+/** As rasterizeSpan, for \a n a multiple of four and \a row 16-byte aligned */
+G3D_TARGET_SSE2
+static void rasterizeSpan_sse2
+(float* row, int n, const float e[3], const float a[3], float depth, float depthA) {
+
+    const __m128 lane = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+    __m128 e0 = _mm_add_ps(_mm_set1_ps(e[0]), _mm_mul_ps(lane, _mm_set1_ps(a[0])));
+    __m128 e1 = _mm_add_ps(_mm_set1_ps(e[1]), _mm_mul_ps(lane, _mm_set1_ps(a[1])));
+    __m128 e2 = _mm_add_ps(_mm_set1_ps(e[2]), _mm_mul_ps(lane, _mm_set1_ps(a[2])));
+    __m128 z  = _mm_add_ps(_mm_set1_ps(depth), _mm_mul_ps(lane, _mm_set1_ps(depthA)));
+
+    const __m128 step0 = _mm_set1_ps(a[0] * 4.0f);
+    const __m128 step1 = _mm_set1_ps(a[1] * 4.0f);
+    const __m128 step2 = _mm_set1_ps(a[2] * 4.0f);
+    const __m128 stepZ = _mm_set1_ps(depthA * 4.0f);
+    const __m128 zero  = _mm_setzero_ps();
+
+    for (int i = 0; i < n; i += 4) {
+        const __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+        if (_mm_movemask_ps(inside) != 0) {
+            const __m128 d = _mm_load_ps(row + i);
+            _mm_store_ps(row + i, _mm_or_ps(_mm_and_ps(inside, _mm_max_ps(d, z)), _mm_andnot_ps(inside, d)));
+        }
+        e0 = _mm_add_ps(e0, step0);
+        e1 = _mm_add_ps(e1, step1);
+        e2 = _mm_add_ps(e2, step2);
+        z  = _mm_add_ps(z, stepZ);
+    }
+}
+#endif
+
+
+OcclusionBuffer::OcclusionBuffer(int width, int height) :
+    m_nearW(1.0f), m_numOccluders(0), m_numVertexBatches(0), m_numTriangleBatches(0), m_numTriangles(0) {
+
+    m_tilesX = iMax(1, (width  + TILE_WIDTH  - 1) / TILE_WIDTH);
+    m_tilesY = iMax(1, (height + TILE_HEIGHT - 1) / TILE_HEIGHT);
+    m_width  = m_tilesX * TILE_WIDTH;
+    m_height = m_tilesY * TILE_HEIGHT;
+
+    m_depth = (float*)System::alignedMalloc(sizeof(float) * m_width * m_height, 16);
+    System::memset(m_depth, 0, sizeof(float) * m_width * m_height);
+
+    m_tileDepth.resize(m_tilesX * m_tilesY);
+    for (int t = 0; t < m_tileDepth.size(); ++t) {
+        m_tileDepth[t] = 0.0f;
+    }
+    m_bin.resize(m_tilesX * m_tilesY);
+}
+
+
+OcclusionBuffer::Ref OcclusionBuffer::create(int width, int height) {
+    return new OcclusionBuffer(width, height);
+}
+
+
+OcclusionBuffer::~OcclusionBuffer() {
+    System::alignedFree(m_depth);
+}
+
+
+void OcclusionBuffer::setCamera(const GCamera& camera, const Rect2D& viewport) {
+    Matrix4 P;
+    camera.getProjectUnitMatrix(viewport, P);
+    setProjection(P * Matrix4(camera.coordinateFrame().inverse()), -camera.nearPlaneZ());
+}
+
+
+void OcclusionBuffer::setProjection(const Matrix4& worldToClip, float nearW) {
+    debugAssertM(nearW > 0, "The near plane must be in front of the camera");
+    m_worldToClip = worldToClip;
+    m_nearW = nearW;
+    m_numOccluders = 0;
+}
+
+
+void OcclusionBuffer::addOccluder(const CoordinateFrame& objectToWorld, const Array<Vector3>& vertex, const Array<int>& index) {
+    debugAssertM(index.size() % 3 == 0, "Occluders must be triangle lists");
+    if (m_numOccluders == m_occluder.size()) {
+        m_occluder.next();
+    }
+
+    // Reuse the arrays of the occluder that previously held this slot
+    Occluder& occluder = m_occluder[m_numOccluders];
+    occluder.frame  = objectToWorld;
+    occluder.vertex = &vertex;
+    occluder.index  = &index;
+    ++m_numOccluders;
+}
+
+
+Vector2 OcclusionBuffer::toScreen(const Vector4& p) const {
+    // GCamera's projection puts y = -1 at the top of the viewport
+    const float invW = 1.0f / p.w;
+    return Vector2((p.x * invW + 1.0f) * 0.5f * m_width, (p.y * invW + 1.0f) * 0.5f * m_height);
+}
+
+
+void OcclusionBuffer::setupTriangle(const Vector4* v, Array<Triangle>& out) const {
+    Vector2 s[3];
+    float z[3];
+    for (int i = 0; i < 3; ++i) {
+        s[i] = toScreen(v[i]);
+        z[i] = 1.0f / v[i].w;
+    }
+
+    double area = ((double)s[1].x - s[0].x) * ((double)s[2].y - s[0].y) - ((double)s[1].y - s[0].y) * ((double)s[2].x - s[0].x);
+    if (area < 0) {
+        // Rasterize both sides
+        std::swap(s[1], s[2]);
+        std::swap(z[1], z[2]);
+        area = -area;
+    }
+
+    if (! (area > 1e-8)) {
+        // Degenerate or NaN
+        return;
+    }
+
+    const float minX = clamp(min(s[0].x, min(s[1].x, s[2].x)), -MAX_PIXEL, MAX_PIXEL);
+    const float maxX = clamp(max(s[0].x, max(s[1].x, s[2].x)), -MAX_PIXEL, MAX_PIXEL);
+    const float minY = clamp(min(s[0].y, min(s[1].y, s[2].y)), -MAX_PIXEL, MAX_PIXEL);
+    const float maxY = clamp(max(s[0].y, max(s[1].y, s[2].y)), -MAX_PIXEL, MAX_PIXEL);
+
+    // Pixels whose centers may be inside
+    Triangle tri;
+    tri.x0 = iMax(0, iCeil(minX - 0.5f));
+    tri.x1 = iMin(m_width, iFloor(maxX - 0.5f) + 1);
+    tri.y0 = iMax(0, iCeil(minY - 0.5f));
+    tri.y1 = iMin(m_height, iFloor(maxY - 0.5f) + 1);
+    if ((tri.x0 >= tri.x1) || (tri.y0 >= tri.y1)) {
+        return;
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        const Vector2& p = s[i];
+        const Vector2& q = s[(i + 1) % 3];
+        const double a = (double)p.y - q.y;
+        const double b = (double)q.x - p.x;
+        tri.edgeA[i] = (float)a;
+        tri.edgeB[i] = (float)b;
+        tri.edgeC[i] = -(a * p.x + b * p.y);
+    }
+
+    const double dx1 = (double)s[1].x - s[0].x, dy1 = (double)s[1].y - s[0].y;
+    const double dx2 = (double)s[2].x - s[0].x, dy2 = (double)s[2].y - s[0].y;
+    const double dz1 = (double)z[1] - z[0],     dz2 = (double)z[2] - z[0];
+    const double depthA = (dz1 * dy2 - dz2 * dy1) / area;
+    const double depthB = (dx1 * dz2 - dx2 * dz1) / area;
+    tri.depthA = (float)depthA;
+    tri.depthB = (float)depthB;
+    tri.depthC = z[0] - depthA * s[0].x - depthB * s[0].y;
+
+    out.append(tri);
+}
+
+
+void OcclusionBuffer::appendBatch(Array<Batch>& batch, int& numBatches, int occluder, int begin, int end) {
+    if (numBatches == batch.size()) {
+        batch.next();
+    }
+    Batch& b = batch[numBatches];
+    b.occluder = occluder;
+    b.begin    = begin;
+    b.end      = end;
+    ++numBatches;
+}
+
+
+void OcclusionBuffer::transformVertices(const Batch& batch) {
+    Occluder& occluder = m_occluder[batch.occluder];
+    const Matrix4& M = m_worldToClip * Matrix4(occluder.frame);
+    const Array<Vector3>& vertex = *occluder.vertex;
+    for (int i = batch.begin; i < batch.end; ++i) {
+        occluder.clip[i] = M * Vector4(vertex[i], 1.0f);
+    }
+}
+
+
+void OcclusionBuffer::setupTriangles(Batch& batch) const {
+    batch.triangle.fastClear();
+
+    const Occluder& occluder = m_occluder[batch.occluder];
+    const Array<Vector4>& clip = occluder.clip;
+    const Array<int>& index = *occluder.index;
+    for (int i = batch.begin * 3; i < batch.end * 3; i += 3) {
+        const Vector4 v[3] = {clip[index[i]], clip[index[i + 1]], clip[index[i + 2]]};
+
+        const int numInFront = ((v[0].w >= m_nearW) ? 1 : 0) + ((v[1].w >= m_nearW) ? 1 : 0) + ((v[2].w >= m_nearW) ? 1 : 0);
+        if (numInFront == 3) {
+            setupTriangle(v, batch.triangle);
+        } else if (numInFront > 0) {
+            // Clip against the near plane, producing up to four vertices
+            Vector4 poly[4];
+            int n = 0;
+            for (int j = 0; j < 3; ++j) {
+                const Vector4& a = v[j];
+                const Vector4& b = v[(j + 1) % 3];
+                const bool aIn = (a.w >= m_nearW);
+                const bool bIn = (b.w >= m_nearW);
+                if (aIn) {
+                    poly[n++] = a;
+                }
+                if (aIn != bIn) {
+                    const float t = (m_nearW - a.w) / (b.w - a.w);
+                    poly[n++] = a + (b - a) * t;
+                }
+            }
+
+            for (int j = 1; j + 1 < n; ++j) {
+                const Vector4 fan[3] = {poly[0], poly[j], poly[j + 1]};
+                setupTriangle(fan, batch.triangle);
+            }
+        }
+    }
+}
+
+
+void OcclusionBuffer::rasterizeTile(int t, bool sse) {
+    float* tile = m_depth + t * (TILE_WIDTH * TILE_HEIGHT);
+    System::memset(tile, 0, sizeof(float) * TILE_WIDTH * TILE_HEIGHT);
+
+    const int tileX = (t % m_tilesX) * TILE_WIDTH;
+    const int tileY = (t / m_tilesX) * TILE_HEIGHT;
+
+    const Array<const Triangle*>& bin = m_bin[t];
+    for (int k = 0; k < bin.size(); ++k) {
+        const Triangle& tri = *bin[k];
+
+        // Start at a multiple of four pixels so that SIMD spans are aligned
+        const int x0 = (iMax(tri.x0, tileX) - tileX) & ~3;
+        const int x1 = iMin(tri.x1, tileX + TILE_WIDTH) - tileX;
+        const int y0 = iMax(tri.y0, tileY);
+        const int y1 = iMin(tri.y1, tileY + TILE_HEIGHT);
+
+        const double px = tileX + x0 + 0.5;
+        for (int y = y0; y < y1; ++y) {
+            const double py = y + 0.5;
+            float e[3];
+            for (int i = 0; i < 3; ++i) {
+                e[i] = (float)(tri.edgeA[i] * px + tri.edgeB[i] * py + tri.edgeC[i]);
+            }
+            const float depth = (float)(tri.depthA * px + tri.depthB * py + tri.depthC);
+            float* row = tile + (y - tileY) * TILE_WIDTH + x0;
+
+#           ifdef G3D_OCCLUSION_SIMD
+            if (sse) {
+                rasterizeSpan_sse2(row, (x1 - x0 + 3) & ~3, e, tri.edgeA, depth, tri.depthA);
+                continue;
+            }
+#           endif
+            rasterizeSpan(row, x1 - x0, e, tri.edgeA, depth, tri.depthA);
+        }
+    }
+
+    float farthest = tile[0];
+    for (int i = 1; i < TILE_WIDTH * TILE_HEIGHT; ++i) {
+        farthest = min(farthest, tile[i]);
+    }
+    m_tileDepth[t] = farthest;
+}
+
+
+void OcclusionBuffer::render() {
+    // Split the occluders into batches so that a few large occluders still use every worker
+    m_numVertexBatches = 0;
+    m_numTriangleBatches = 0;
+    for (int o = 0; o < m_numOccluders; ++o) {
+        Occluder& occluder = m_occluder[o];
+        const int numVertices = occluder.vertex->size();
+        occluder.clip.resize(numVertices, DONT_SHRINK_UNDERLYING_ARRAY);
+        for (int i = 0; i < numVertices; i += VERTICES_PER_BATCH) {
+            appendBatch(m_vertexBatch, m_numVertexBatches, o, i, iMin(i + VERTICES_PER_BATCH, numVertices));
+        }
+
+        const int numTriangles = occluder.index->size() / 3;
+        for (int i = 0; i < numTriangles; i += TRIANGLES_PER_BATCH) {
+            appendBatch(m_triangleBatch, m_numTriangleBatches, o, i, iMin(i + TRIANGLES_PER_BATCH, numTriangles));
+        }
+    }
+
+    _internal::OcclusionTransform transform;
+    transform.buffer = this;
+    TaskScheduler::global()->parallelFor(0, m_numVertexBatches, 1, transform);
+
+    _internal::OcclusionSetup setup;
+    setup.buffer = this;
+    TaskScheduler::global()->parallelFor(0, m_numTriangleBatches, 1, setup);
+
+    // Bin serially; this is cheap compared to setup and rasterization
+    for (int t = 0; t < m_bin.size(); ++t) {
+        m_bin[t].fastClear();
+    }
+    m_numTriangles = 0;
+    for (int b = 0; b < m_numTriangleBatches; ++b) {
+        const Array<Triangle>& triangle = m_triangleBatch[b].triangle;
+        m_numTriangles += triangle.size();
+        for (int i = 0; i < triangle.size(); ++i) {
+            const Triangle& tri = triangle[i];
+            const int tx1 = (tri.x1 - 1) / TILE_WIDTH;
+            const int ty1 = (tri.y1 - 1) / TILE_HEIGHT;
+            for (int ty = tri.y0 / TILE_HEIGHT; ty <= ty1; ++ty) {
+                for (int tx = tri.x0 / TILE_WIDTH; tx <= tx1; ++tx) {
+                    m_bin[tx + ty * m_tilesX].append(&tri);
+                }
+            }
+        }
+    }
+
+    _internal::OcclusionRaster raster;
+    raster.buffer = this;
+    raster.sse = false;
+#   ifdef G3D_OCCLUSION_SIMD
+        raster.sse = System::hasSSE2();
+#   endif
+    TaskScheduler::global()->parallelFor(0, m_bin.size(), 1, raster);
+}
+
+
+float OcclusionBuffer::depth(int x, int y) const {
+    debugAssert(x >= 0 && x < m_width && y >= 0 && y < m_height);
+    const int t = (x / TILE_WIDTH) + (y / TILE_HEIGHT) * m_tilesX;
+    return m_depth[t * (TILE_WIDTH * TILE_HEIGHT) + (y % TILE_HEIGHT) * TILE_WIDTH + (x % TILE_WIDTH)];
+}
+
+
+bool OcclusionBuffer::occluded(const AABox& worldBox) const {
+    if (! worldBox.isFinite()) {
+        return false;
+    }
+
+    const Vector3& lo = worldBox.low();
+    const Vector3& hi = worldBox.high();
+
+    float minX = finf(), minY = finf(), maxX = -finf(), maxY = -finf();
+    // 1/w of the nearest corner
+    float nearest = 0.0f;
+    for (int c = 0; c < 8; ++c) {
+        const Vector3 corner((c & 1) ? hi.x : lo.x, (c & 2) ? hi.y : lo.y, (c & 4) ? hi.z : lo.z);
+        const Vector4& p = m_worldToClip * Vector4(corner, 1.0f);
+        if (p.w < m_nearW) {
+            return false;
+        }
+        const Vector2& s = toScreen(p);
+        minX = min(minX, s.x);
+        maxX = max(maxX, s.x);
+        minY = min(minY, s.y);
+        maxY = max(maxY, s.y);
+        nearest = max(nearest, 1.0f / p.w);
+    }
+
+    // Every pixel that the projected box touches
+    const int x0 = iMax(0, iFloor(clamp(minX, -MAX_PIXEL, MAX_PIXEL)));
+    const int x1 = iMin(m_width, iCeil(clamp(maxX, -MAX_PIXEL, MAX_PIXEL)));
+    const int y0 = iMax(0, iFloor(clamp(minY, -MAX_PIXEL, MAX_PIXEL)));
+    const int y1 = iMin(m_height, iCeil(clamp(maxY, -MAX_PIXEL, MAX_PIXEL)));
+    if ((x0 >= x1) || (y0 >= y1)) {
+        return false;
+    }
+
+    for (int ty = y0 / TILE_HEIGHT; ty <= (y1 - 1) / TILE_HEIGHT; ++ty) {
+        for (int tx = x0 / TILE_WIDTH; tx <= (x1 - 1) / TILE_WIDTH; ++tx) {
+            const int t = tx + ty * m_tilesX;
+            if (nearest < m_tileDepth[t]) {
+                // Every occluder in this tile is nearer than the box
+                continue;
+            }
+
+            const float* tile = m_depth + t * (TILE_WIDTH * TILE_HEIGHT);
+            const int px0 = iMax(x0, tx * TILE_WIDTH) - tx * TILE_WIDTH;
+            const int px1 = iMin(x1, (tx + 1) * TILE_WIDTH) - tx * TILE_WIDTH;
+            const int py0 = iMax(y0, ty * TILE_HEIGHT) - ty * TILE_HEIGHT;
+            const int py1 = iMin(y1, (ty + 1) * TILE_HEIGHT) - ty * TILE_HEIGHT;
+            for (int y = py0; y < py1; ++y) {
+                const float* row = tile + y * TILE_WIDTH;
+                for (int x = px0; x < px1; ++x) {
+                    if (! (nearest < row[x])) {
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+} // namespace G3D
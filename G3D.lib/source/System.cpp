@@ -32,6 +32,7 @@
 
 #include <cstring>
 #include <cstdio>
+#include <new>
 
 // Uncomment the following line to turn off G3D::System memory
 // allocation and use the operating system's malloc.
@@ -112,6 +113,7 @@ System::System() :
     m_hasSSE(false),
     m_hasSSE2(false),
     m_hasSSE3(false),
+    m_hasSSSE3(false),
     m_has3DNOW(false),
     m_has3DNOW2(false),
     m_hasAMDMMX(false),
@@ -547,6 +549,7 @@ void System::getStandardProcessorExtensions() {
     // Bit 28 is HTT; not checked by G3D
 
     m_hasSSE3     = checkBit(ecxreg, 0);
+    m_hasSSSE3    = checkBit(ecxreg, 9);
 
     if (m_highestCPUIDFunction >= CPUID_EXTENDED_FEATURES) {
         cpuid(CPUID_EXTENDED_FEATURES, eaxreg, ebxreg, ecxreg, features);
@@ -939,7 +942,7 @@ public:
       */
     enum {tinyBufferSize = 128, smallBufferSize = 1024, medBufferSize = 4096};
 
-    /** 
+    /**
        Most buffers we're allowed to store.
        250000 * 128  = 32 MB (preallocated)
         10000 * 1024 = 10 MB (allocated on demand)
@@ -947,6 +950,14 @@ public:
      */
     enum {maxTinyBuffers = 250000, maxSmallBuffers = 10000, maxMedBuffers = 1024};
 
+    /**
+       Most buffers each thread may hold in its private cache.  When a
+       cache overflows, half of it is returned to the shared pool under a
+       single lock; when it runs dry, up to half of its capacity is
+       refilled from the shared pool under a single lock.
+     */
+    enum {maxThreadTinyBuffers = 256, maxThreadSmallBuffers = 32, maxThreadMedBuffers = 16};
+
 private:
 
     /** Pointer given to the program.  Unless in the tiny heap, the user size of the block is stored right in front of the pointer as a uint32.*/
@@ -964,6 +975,55 @@ private:
         inline MemBlock(UserPtr p, size_t b) : ptr(p), bytes(b) {}
     };
 
+    /** Allocation statistics reported by performance(). */
+    class Counters {
+    public:
+        /** Count of memory allocations that have occurred. */
+        int totalMallocs;
+        int mallocsFromTinyPool;
+        int mallocsFromSmallPool;
+        int mallocsFromMedPool;
+
+        inline Counters() : totalMallocs(0), mallocsFromTinyPool(0),
+            mallocsFromSmallPool(0), mallocsFromMedPool(0) {}
+
+        inline void operator+=(const Counters& c) {
+            totalMallocs         += c.totalMallocs;
+            mallocsFromTinyPool  += c.mallocsFromTinyPool;
+            mallocsFromSmallPool += c.mallocsFromSmallPool;
+            mallocsFromMedPool   += c.mallocsFromMedPool;
+        }
+    };
+
+    /**
+       Per-thread free lists, one per size class.  A thread allocates from
+       and frees into its own cache without taking the shared lock, so
+       threads only contend when a cache must be refilled or drained.
+
+       Allocated with ::malloc so that creating a cache never recurses
+       into the buffer pool.
+     */
+    class ThreadCache {
+    public:
+        UserPtr         tinyPool[maxThreadTinyBuffers];
+        int             tinyPoolSize;
+
+        MemBlock        smallPool[maxThreadSmallBuffers];
+        int             smallPoolSize;
+
+        MemBlock        medPool[maxThreadMedBuffers];
+        int             medPoolSize;
+
+        /** Updated only by the owning thread */
+        Counters        counters;
+
+        /** Intrusive list of all live caches, used for reporting */
+        ThreadCache*    next;
+        ThreadCache*    prev;
+
+        inline ThreadCache() : tinyPoolSize(0), smallPoolSize(0), medPoolSize(0), next(NULL), prev(NULL) {}
+    };
+
     MemBlock smallPool[maxSmallBuffers];
     int smallPoolSize;
 
@@ -980,6 +1040,19 @@ private:
     /** Pointer to the data in the tiny pool */
     void* tinyHeap;
 
+    /** Head of the list of live thread caches.  Protected by m_lock. */
+    ThreadCache*        m_threadCacheList;
+
+    /** Statistics from caches whose threads have exited.  Protected by m_lock. */
+    Counters            m_retiredCounters;
+
+    /** Key used to find the calling thread's ThreadCache */
+#   ifdef G3D_WIN32
+    DWORD               m_tlsIndex;
+#   else
+    pthread_key_t       m_tlsKey;
+#   endif
+
     Spinlock            m_lock;
 
     void lock() {
@@ -990,92 +1063,160 @@ private:
         m_lock.unlock();
     }
 
-#if 0 //-----------------------------------------------old mutex
-#   ifdef G3D_WIN32
-    CRITICAL_SECTION    mutex;
-#   else
-    pthread_mutex_t     mutex;
-#   endif
-
-    /** Provide synchronization between threads */
-    void lock() {
+    /** Returns the calling thread's cache, or NULL if it has none yet. */
+    inline ThreadCache* currentThreadCache() const {
 #       ifdef G3D_WIN32
-            EnterCriticalSection(&mutex);
+            return (ThreadCache*)::TlsGetValue(m_tlsIndex);
 #       else
-            pthread_mutex_lock(&mutex);
+            return (ThreadCache*)pthread_getspecific(m_tlsKey);
 #       endif
     }
 
-    void unlock() {
+    inline void setCurrentThreadCache(ThreadCache* cache) {
 #       ifdef G3D_WIN32
-            LeaveCriticalSection(&mutex);
+            ::TlsSetValue(m_tlsIndex, cache);
 #       else
-            pthread_mutex_unlock(&mutex);
+            pthread_setspecific(m_tlsKey, cache);
 #       endif
     }
-#endif //-------------------------------------------old mutex
 
-    /** 
-     Malloc out of the tiny heap. Returns NULL if allocation failed.
-     */
-    inline UserPtr tinyMalloc(size_t bytes) {
-        // Note that we ignore the actual byte size
-        // and create a constant size block.
-        (void)bytes;
-        assert(tinyBufferSize >= bytes);
+    /** Returns the calling thread's cache, creating it on first use. */
+    inline ThreadCache* threadCache() {
+        ThreadCache* cache = currentThreadCache();
+        if (cache == NULL) {
+            cache = createThreadCache();
+        }
+        return cache;
+    }
 
-        UserPtr ptr = NULL;
+    ThreadCache* createThreadCache() {
+        ThreadCache* cache = new (::malloc(sizeof(ThreadCache))) ThreadCache();
 
-        if (tinyPoolSize > 0) {
-            --tinyPoolSize;
+        lock();
+        cache->next = m_threadCacheList;
+        if (m_threadCacheList) {
+            m_threadCacheList->prev = cache;
+        }
+        m_threadCacheList = cache;
+        unlock();
+
+        setCurrentThreadCache(cache);
+        return cache;
+    }
+
+#   ifndef G3D_WIN32
+    /** pthread key destructor; invoked as each thread that used System::malloc exits */
+    static void threadExit(void* cache);
+#   endif
 
-            // Return the old last pointer from the freelist
-            ptr = tinyPool[tinyPoolSize];
+    /**
+     Malloc out of the tiny heap. Returns NULL if allocation failed.
+     */
+    inline UserPtr tinyMalloc(ThreadCache* cache) {
+        if (cache->tinyPoolSize == 0) {
+            // Refill half of the cache from the shared freelist
+            lock();
+            int n = iMin(tinyPoolSize, (int)maxThreadTinyBuffers / 2);
+            tinyPoolSize -= n;
+            System::memcpy(cache->tinyPool, tinyPool + tinyPoolSize, n * sizeof(UserPtr));
 
 #           ifdef G3D_DEBUG
-                if (tinyPoolSize > 0) {
-                    assert(tinyPool[tinyPoolSize - 1] != ptr); 
-                     //   "System::malloc heap corruption detected: "
-                     //   "the last two pointers on the freelist are identical (during tinyMalloc).");
-                }
+                // NULL out the entries to help detect corruption
+                System::memset(tinyPool + tinyPoolSize, 0, n * sizeof(UserPtr));
 #           endif
+            unlock();
+            cache->tinyPoolSize = n;
 
-            // NULL out the entry to help detect corruption
-            tinyPool[tinyPoolSize] = NULL;
+            if (n == 0) {
+                return NULL;
+            }
         }
 
+        --cache->tinyPoolSize;
+
+        // Return the old last pointer from the freelist
+        UserPtr ptr = cache->tinyPool[cache->tinyPoolSize];
+
+#       ifdef G3D_DEBUG
+            if (cache->tinyPoolSize > 0) {
+                assert(cache->tinyPool[cache->tinyPoolSize - 1] != ptr);
+                 //   "System::malloc heap corruption detected: "
+                 //   "the last two pointers on the freelist are identical (during tinyMalloc).");
+            }
+#       endif
+
         return ptr;
     }
 
     /** Returns true if this is a pointer into the tiny heap. */
     bool inTinyHeap(UserPtr ptr) {
-        return 
-            (ptr >= tinyHeap) && 
+        return
+            (ptr >= tinyHeap) &&
             (ptr < (uint8*)tinyHeap + maxTinyBuffers * tinyBufferSize);
     }
 
-    void tinyFree(UserPtr ptr) {
+    void tinyFree(ThreadCache* cache, UserPtr ptr) {
         assert(ptr);
-        assert(tinyPoolSize < maxTinyBuffers);
- //           "Tried to free a tiny pool buffer when the tiny pool freelist is full.");
 
 #       ifdef G3D_DEBUG
-            if (tinyPoolSize > 0) {
-                UserPtr prevOnHeap = tinyPool[tinyPoolSize - 1];
-                assert(prevOnHeap != ptr); 
+            if (cache->tinyPoolSize > 0) {
+                UserPtr prevOnHeap = cache->tinyPool[cache->tinyPoolSize - 1];
+                assert(prevOnHeap != ptr);
 //                    "System::malloc heap corruption detected: "
 //                    "the last two pointers on the freelist are identical (during tinyFree).");
             }
 #       endif
 
-        assert(tinyPool[tinyPoolSize] == NULL);
+        if (cache->tinyPoolSize == maxThreadTinyBuffers) {
+            // Drain half of the cache back to the shared freelist
+            lockedTinyDrain(cache, maxThreadTinyBuffers / 2);
+        }
 
         // Put the pointer back into the free list
-        tinyPool[tinyPoolSize] = ptr;
-        ++tinyPoolSize;
+        cache->tinyPool[cache->tinyPoolSize] = ptr;
+        ++cache->tinyPoolSize;
+    }
 
+    /** Moves the last \a n tiny pointers from the cache to the shared freelist. */
+    void lockedTinyDrain(ThreadCache* cache, int n) {
+        cache->tinyPoolSize -= n;
+        lock();
+        assert(tinyPoolSize + n <= maxTinyBuffers);
+        System::memcpy(tinyPool + tinyPoolSize, cache->tinyPool + cache->tinyPoolSize, n * sizeof(UserPtr));
+        tinyPoolSize += n;
+        unlock();
     }
 
+    /** Moves the last \a n blocks from a thread cache to the shared pool.
+        Blocks that do not fit in the shared pool are returned to the heap.
+        Caller must hold the lock. */
+    void drain(MemBlock* src, int& srcSize, int n, MemBlock* pool, int& poolSize, int maxPoolSize) {
+        for (int i = srcSize - n; i < srcSize; ++i) {
+            if (poolSize < maxPoolSize) {
+                pool[poolSize] = src[i];
+                ++poolSize;
+            } else {
+                bytesAllocated -= USERSIZE_TO_REALSIZE(src[i].bytes);
+                ::free(USERPTR_TO_REALPTR(src[i].ptr));
+            }
+        }
+        srcSize -= n;
+    }
+
+    /** Moves everything in \a cache to the shared pools */
+    void flushThreadCache(ThreadCache* cache) {
+        lock();
+        assert(tinyPoolSize + cache->tinyPoolSize <= maxTinyBuffers);
+        System::memcpy(tinyPool + tinyPoolSize, cache->tinyPool, cache->tinyPoolSize * sizeof(UserPtr));
+        tinyPoolSize += cache->tinyPoolSize;
+        cache->tinyPoolSize = 0;
+
+        drain(cache->smallPool, cache->smallPoolSize, cache->smallPoolSize, smallPool, smallPoolSize, maxSmallBuffers);
+        drain(cache->medPool, cache->medPoolSize, cache->medPoolSize, medPool, medPoolSize, maxMedBuffers);
+        unlock();
+    }
+
+    /** Caller must hold the lock */
     void flushPool(MemBlock* pool, int& poolSize) {
         for (int i = 0; i < poolSize; ++i) {
             bytesAllocated -= USERSIZE_TO_REALSIZE(pool[i].bytes);
@@ -1087,9 +1228,9 @@ private:
     }
 
 
-    /** Allocate out of a specific pool.  Return NULL if no suitable 
+    /** Allocate out of a specific pool.  Return NULL if no suitable
         memory was found. */
-    UserPtr malloc(MemBlock* pool, int& poolSize, size_t bytes) {
+    static UserPtr malloc(MemBlock* pool, int& poolSize, size_t bytes) {
 
         // OPT: find the smallest block that satisfies the request.
 
@@ -1114,15 +1255,52 @@ private:
         return NULL;
     }
 
-public:
+    /** Allocate out of a thread's cache for one size class, refilling
+        the cache from the shared pool on a miss.  Return NULL if no
+        suitable memory was found in either. */
+    UserPtr malloc(MemBlock* cachePool, int& cachePoolSize, int maxCacheSize,
+                   MemBlock* pool, int& poolSize, size_t bytes) {
 
-    /** Count of memory allocations that have occurred. */
-    int totalMallocs;
-    int mallocsFromTinyPool;
-    int mallocsFromSmallPool;
-    int mallocsFromMedPool;
+        UserPtr ptr = malloc(cachePool, cachePoolSize, bytes);
+        if (ptr) {
+            return ptr;
+        }
 
-    /** Amount of memory currently allocated (according to the application). 
+        lock();
+        ptr = malloc(pool, poolSize, bytes);
+        if (ptr) {
+            // Take a batch of other blocks while we hold the lock so
+            // that the next few requests do not need it.
+            int n = iMin(poolSize, maxCacheSize / 2 - cachePoolSize);
+            if (n > 0) {
+                poolSize -= n;
+                System::memcpy(cachePool + cachePoolSize, pool + poolSize, n * sizeof(MemBlock));
+                cachePoolSize += n;
+            }
+        }
+        unlock();
+
+        return ptr;
+    }
+
+    /** Free into a thread's cache for one size class, draining half of
+        the cache to the shared pool when it is full. */
+    void free(MemBlock* cachePool, int& cachePoolSize, int maxCacheSize,
+              MemBlock* pool, int& poolSize, int maxPoolSize, UserPtr ptr, size_t bytes) {
+
+        if (cachePoolSize == maxCacheSize) {
+            lock();
+            drain(cachePool, cachePoolSize, maxCacheSize / 2, pool, poolSize, maxPoolSize);
+            unlock();
+        }
+
+        cachePool[cachePoolSize] = MemBlock(ptr, bytes);
+        ++cachePoolSize;
+    }
+
+public:
+
+    /** Amount of memory currently allocated (according to the application).
         This does not count the memory still remaining in the buffer pool,
         but does count extra memory required for rounding off to the size
         of a buffer.
@@ -1131,12 +1309,6 @@ public:
     volatile int bytesAllocated;
 
     BufferPool() {
-        totalMallocs         = 0;
-
-        mallocsFromTinyPool  = 0;
-        mallocsFromSmallPool = 0;
-        mallocsFromMedPool   = 0;
-
         bytesAllocated       = true;
 
         tinyPoolSize         = 0;
@@ -1146,6 +1318,7 @@ public:
 
         medPoolSize          = 0;
 
+        m_threadCacheList    = NULL;
 
         // Initialize the tiny heap as a bunch of pointers into one
         // pre-allocated buffer.
@@ -1155,13 +1328,11 @@ public:
         }
         tinyPoolSize = maxTinyBuffers;
 
-#if 0        ///---------------------------------- old mutex
 #       ifdef G3D_WIN32
-            InitializeCriticalSection(&mutex);
+            m_tlsIndex = ::TlsAlloc();
 #       else
-            pthread_mutex_init(&mutex, NULL);
+            pthread_key_create(&m_tlsKey, &BufferPool::threadExit);
 #       endif
-#endif        ///---------------------------------- old mutex
     }
 
 
@@ -1169,16 +1340,14 @@ public:
         ::free(tinyHeap);
         flushPool(smallPool, smallPoolSize);
         flushPool(medPool, medPoolSize);
-#if 0 //-------------------------------- old mutex
 #       ifdef G3D_WIN32
-            DeleteCriticalSection(&mutex);
+            ::TlsFree(m_tlsIndex);
 #       else
-            // No destruction on pthreads
+            pthread_key_delete(m_tlsKey);
 #       endif
-#endif //--------------------------------old mutex
     }
 
-    
+
     UserPtr realloc(UserPtr ptr, size_t bytes) {
         if (ptr == NULL) {
             return malloc(bytes);
@@ -1190,10 +1359,10 @@ public:
                 return ptr;
             } else {
                 // Free the old pointer and malloc
-                
+
                 UserPtr newPtr = malloc(bytes);
                 System::memcpy(newPtr, ptr, tinyBufferSize);
-                tinyFree(ptr);
+                free(ptr);
                 return newPtr;
 
             }
@@ -1217,30 +1386,29 @@ public:
 
 
     UserPtr malloc(size_t bytes) {
-        lock();
-        ++totalMallocs;
+        ThreadCache* cache = threadCache();
+        ++cache->counters.totalMallocs;
 
         if (bytes <= tinyBufferSize) {
 
-            UserPtr ptr = tinyMalloc(bytes);
+            UserPtr ptr = tinyMalloc(cache);
 
             if (ptr) {
-                ++mallocsFromTinyPool;
-                unlock();
+                ++cache->counters.mallocsFromTinyPool;
                 return ptr;
             }
 
-        } 
-        
+        }
+
         // Failure to allocate a tiny buffer is allowed to flow
         // through to a small buffer
         if (bytes <= smallBufferSize) {
-            
-            UserPtr ptr = malloc(smallPool, smallPoolSize, bytes);
+
+            UserPtr ptr = malloc(cache->smallPool, cache->smallPoolSize, maxThreadSmallBuffers,
+                                 smallPool, smallPoolSize, bytes);
 
             if (ptr) {
-                ++mallocsFromSmallPool;
-                unlock();
+                ++cache->counters.mallocsFromSmallPool;
                 return ptr;
             }
 
@@ -1249,16 +1417,17 @@ public:
             // through into a medium allocation because that would
             // waste the medium buffer's resources.
 
-            UserPtr ptr = malloc(medPool, medPoolSize, bytes);
+            UserPtr ptr = malloc(cache->medPool, cache->medPoolSize, maxThreadMedBuffers,
+                                 medPool, medPoolSize, bytes);
 
             if (ptr) {
-                ++mallocsFromMedPool;
-                unlock();
+                ++cache->counters.mallocsFromMedPool;
                 debugAssertM(ptr != NULL, "BufferPool::malloc returned NULL");
                 return ptr;
             }
         }
 
+        lock();
         bytesAllocated += USERSIZE_TO_REALSIZE(bytes);
         unlock();
 
@@ -1270,8 +1439,11 @@ public:
 
         if (ptr == NULL) {
             // Flush memory pools to try and recover space
+            flushThreadCache(cache);
+            lock();
             flushPool(smallPool, smallPoolSize);
             flushPool(medPool, medPoolSize);
+            unlock();
             ptr = ::malloc(USERSIZE_TO_REALSIZE(bytes));
         }
 
@@ -1291,7 +1463,7 @@ public:
 #           ifdef G3D_DEBUG
             debugPrintf("::malloc(%d) returned NULL\n", (int)USERSIZE_TO_REALSIZE(bytes));
 #           endif
-            debugAssertM(ptr != NULL, 
+            debugAssertM(ptr != NULL,
                          "::malloc returned NULL. Either the "
                          "operating system is out of memory or the "
                          "heap is corrupt.");
@@ -1312,53 +1484,104 @@ public:
 
         assert(isValidPointer(ptr));
 
+        ThreadCache* cache = threadCache();
+
         if (inTinyHeap(ptr)) {
-            lock();
-            tinyFree(ptr);
-            unlock();
+            tinyFree(cache, ptr);
             return;
         }
 
         uint32 bytes = USERSIZE_FROM_USERPTR(ptr);
 
-        lock();
         if (bytes <= smallBufferSize) {
-            if (smallPoolSize < maxSmallBuffers) {
-                smallPool[smallPoolSize] = MemBlock(ptr, bytes);
-                ++smallPoolSize;
-                unlock();
-                return;
-            }
+            free(cache->smallPool, cache->smallPoolSize, maxThreadSmallBuffers,
+                 smallPool, smallPoolSize, maxSmallBuffers, ptr, bytes);
+            return;
         } else if (bytes <= medBufferSize) {
-            if (medPoolSize < maxMedBuffers) {
-                medPool[medPoolSize] = MemBlock(ptr, bytes);
-                ++medPoolSize;
-                unlock();
-                return;
-            }
+            free(cache->medPool, cache->medPoolSize, maxThreadMedBuffers,
+                 medPool, medPoolSize, maxMedBuffers, ptr, bytes);
+            return;
         }
+
+        lock();
         bytesAllocated -= USERSIZE_TO_REALSIZE(bytes);
         unlock();
 
-        // Free; the buffer pools are full or this is too big to store.
+        // Free; this is too big to store.
         ::free(USERPTR_TO_REALPTR(ptr));
     }
 
-    std::string performance() const {
-        if (totalMallocs > 0) {
-            int pooled = mallocsFromTinyPool +
-                         mallocsFromSmallPool + 
-                         mallocsFromMedPool;
+    /** Returns the calling thread's cached blocks to the shared pools
+        and releases its cache.  A new cache is created if the thread
+        allocates again. */
+    void flushCallingThread() {
+        ThreadCache* cache = currentThreadCache();
+        if (cache != NULL) {
+            setCurrentThreadCache(NULL);
+            retireThreadCache(cache);
+        }
+    }
 
-            int total = totalMallocs;
+    /** Returns the calling thread's allocation counters */
+    Counters threadCounters() {
+        return threadCache()->counters;
+    }
+
+    /** Sum of the counters of every thread, including those that have exited */
+    Counters totalCounters() {
+        lock();
+        Counters c = m_retiredCounters;
+        for (ThreadCache* cache = m_threadCacheList; cache != NULL; cache = cache->next) {
+            c += cache->counters;
+        }
+        unlock();
+        return c;
+    }
+
+    void resetCounters() {
+        lock();
+        m_retiredCounters = Counters();
+        for (ThreadCache* cache = m_threadCacheList; cache != NULL; cache = cache->next) {
+            cache->counters = Counters();
+        }
+        unlock();
+    }
+
+    /** Called when the thread that owns \a cache exits */
+    void retireThreadCache(ThreadCache* cache) {
+        flushThreadCache(cache);
+
+        lock();
+        m_retiredCounters += cache->counters;
+        if (cache->prev) {
+            cache->prev->next = cache->next;
+        } else {
+            m_threadCacheList = cache->next;
+        }
+        if (cache->next) {
+            cache->next->prev = cache->prev;
+        }
+        unlock();
+
+        cache->~ThreadCache();
+        ::free(cache);
+    }
+
+    static std::string performance(const Counters& counters) {
+        if (counters.totalMallocs > 0) {
+            int pooled = counters.mallocsFromTinyPool +
+                         counters.mallocsFromSmallPool +
+                         counters.mallocsFromMedPool;
+
+            int total = counters.totalMallocs;
 
             return format("malloc performance: %5.1f%% <= %db, %5.1f%% <= %db, "
                           "%5.1f%% <= %db, %5.1f%% > %db",
-                          100.0 * mallocsFromTinyPool  / total,
+                          100.0 * counters.mallocsFromTinyPool  / total,
                           BufferPool::tinyBufferSize,
-                          100.0 * mallocsFromSmallPool / total,
+                          100.0 * counters.mallocsFromSmallPool / total,
                           BufferPool::smallBufferSize,
-                          100.0 * mallocsFromMedPool   / total,
+                          100.0 * counters.mallocsFromMedPool   / total,
                           BufferPool::medBufferSize,
                           100.0 * (1.0 - (double)pooled / total),
                           BufferPool::medBufferSize);
@@ -1367,6 +1590,10 @@ public:
         }
     }
 
+    std::string performance() {
+        return performance(totalCounters());
+    }
+
     std::string status() const {
         return format("preallocated shared buffers: %5d/%d x %db",
             maxTinyBuffers - tinyPoolSize, maxTinyBuffers, tinyBufferSize);
@@ -1374,11 +1601,19 @@ public:
 };
 
 // Dynamically allocated because we need to ensure that
-// the buffer pool is still around when the last global variable 
+// the buffer pool is still around when the last global variable
 // is deallocated.
 static BufferPool* bufferpool = NULL;
 
-std::string System::mallocPerformance() {    
+#ifndef G3D_WIN32
+void BufferPool::threadExit(void* cache) {
+    if (bufferpool != NULL) {
+        bufferpool->retireThreadCache((ThreadCache*)cache);
+    }
+}
+#endif
+
+std::string System::mallocPerformance() {
 #ifndef NO_BUFFERPOOL
     return bufferpool->performance();
 #else
@@ -1386,7 +1621,17 @@ std::string System::mallocPerformance() {
 #endif
 }
 
-std::string System::mallocStatus() {    
+
+std::string System::threadMallocPerformance() {
+#ifndef NO_BUFFERPOOL
+    return BufferPool::performance(bufferpool->threadCounters());
+#else
+    return "NO_BUFFERPOOL";
+#endif
+}
+
+
+std::string System::mallocStatus() {
 #ifndef NO_BUFFERPOOL
     return bufferpool->status();
 #else
@@ -1397,10 +1642,7 @@ std::string System::mallocStatus() {
 
 void System::resetMallocPerformanceCounters() {
 #ifndef NO_BUFFERPOOL
-    bufferpool->totalMallocs         = 0;
-    bufferpool->mallocsFromMedPool   = 0;
-    bufferpool->mallocsFromSmallPool = 0;
-    bufferpool->mallocsFromTinyPool  = 0;
+    bufferpool->resetCounters();
 #endif
 }
 
@@ -1418,6 +1660,14 @@ inline void initMem() {
 #endif
 
 
+void System::flushThreadMallocCache() {
+#ifndef NO_BUFFERPOOL
+    initMem();
+    bufferpool->flushCallingThread();
+#endif
+}
+
+
 void* System::malloc(size_t bytes) {
 #ifndef NO_BUFFERPOOL
     initMem();
@@ -1489,12 +1739,12 @@ void* System::alignedMalloc(size_t bytes, size_t alignment) {
     size_t  alignedPtr = truePtr + sizeof(void*);
 
     // 2^n - 1 has the form 1111... in binary.
-    uint32 bitMask = (alignment - 1);
+    size_t bitMask = (alignment - 1);
 
-    // Advance forward until we reach an aligned location.
-    while ((alignedPtr & bitMask) != 0) {
-        alignedPtr += sizeof(void*);
-    }
+    // Round up to the next aligned location.  Stepping by sizeof(void*)
+    // would never terminate for pool blocks, whose user pointers are
+    // offset by a 4-byte size header.
+    alignedPtr = (alignedPtr + bitMask) & ~bitMask;
 
     debugAssert(alignedPtr - truePtr + bytes <= totalBytes);
 
@@ -1615,6 +1865,7 @@ void System::describeSystem(
         var(t, "hasSSE", System::hasSSE());
         var(t, "hasSSE2", System::hasSSE2());
         var(t, "hasSSE3", System::hasSSE3());
+        var(t, "hasSSSE3", System::hasSSSE3());
         var(t, "has3DNow", System::has3DNow());
         var(t, "hasRDTSC", System::hasRDTSC());
         var(t, "numCores", System::numCores());
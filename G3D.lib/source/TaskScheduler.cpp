@@ -0,0 +1,379 @@
+/**
+  @file TaskScheduler.cpp
+
+  Work-stealing thread pool.
+ */
+
+#include "G3D/TaskScheduler.h"
+#include "G3D/Queue.h"
+#include "G3D/debugAssert.h"
+#include "G3D/format.h"
+
+#ifndef G3D_WIN32
+#   include <pthread.h>
+#   include <sched.h>
+#endif
+
+namespace G3D {
+
+namespace _internal {
+
+/** Counting semaphore used to park idle workers. */
+class TaskSemaphore {
+private:
+#   ifdef G3D_WIN32
+    HANDLE              m_handle;
+#   else
+    pthread_mutex_t     m_mutex;
+    pthread_cond_t      m_cond;
+    int                 m_count;
+#   endif
+
+public:
+
+    TaskSemaphore() {
+#       ifdef G3D_WIN32
+            m_handle = ::CreateSemaphore(NULL, 0, 0x7FFFFFFF, NULL);
+            debugAssert(m_handle);
+#       else
+            m_count = 0;
+            pthread_mutex_init(&m_mutex, NULL);
+            pthread_cond_init(&m_cond, NULL);
+#       endif
+    }
+
+    ~TaskSemaphore() {
+#       ifdef G3D_WIN32
+            ::CloseHandle(m_handle);
+#       else
+            pthread_cond_destroy(&m_cond);
+            pthread_mutex_destroy(&m_mutex);
+#       endif
+    }
+
+    void signal(int n = 1) {
+#       ifdef G3D_WIN32
+            ::ReleaseSemaphore(m_handle, n, NULL);
+#       else
+            pthread_mutex_lock(&m_mutex);
+            m_count += n;
+            if (n == 1) {
+                pthread_cond_signal(&m_cond);
+            } else {
+                pthread_cond_broadcast(&m_cond);
+            }
+            pthread_mutex_unlock(&m_mutex);
+#       endif
+    }
+
+    void wait() {
+#       ifdef G3D_WIN32
+            ::WaitForSingleObject(m_handle, INFINITE);
+#       else
+            pthread_mutex_lock(&m_mutex);
+            while (m_count == 0) {
+                pthread_cond_wait(&m_cond, &m_mutex);
+            }
+            --m_count;
+            pthread_mutex_unlock(&m_mutex);
+#       endif
+    }
+};
+
+
+/** A task and the group that is waiting for it */
+class TaskEntry {
+public:
+    Task*           task;
+    TaskGroup*      group;
+
+    TaskEntry() : task(NULL), group(NULL) {}
+    TaskEntry(Task* t, TaskGroup* g) : task(t), group(g) {}
+};
+
+
+/** Double-ended queue of tasks.  The owner works at the back; thieves
+    take from the front.  Both ends are guarded by one Spinlock, which
+    is only contended when a thief and the owner meet. */
+class TaskDeque {
+private:
+    Spinlock            m_lock;
+    Queue<TaskEntry>    m_queue;
+
+    /** Unsynchronized copy of m_queue.size() so that empty deques can
+        be skipped without taking the lock. */
+    AtomicInt32         m_size;
+
+public:
+
+    TaskDeque() : m_size(0) {}
+
+    bool empty() const {
+        return m_size.value() == 0;
+    }
+
+    void pushBack(const TaskEntry& e) {
+        m_lock.lock();
+        m_queue.pushBack(e);
+        m_size = m_queue.size();
+        m_lock.unlock();
+    }
+
+    bool popBack(TaskEntry& e) {
+        if (empty()) {
+            return false;
+        }
+        m_lock.lock();
+        bool found = (m_queue.size() > 0);
+        if (found) {
+            e = m_queue.popBack();
+            m_size = m_queue.size();
+        }
+        m_lock.unlock();
+        return found;
+    }
+
+    bool popFront(TaskEntry& e) {
+        if (empty()) {
+            return false;
+        }
+        m_lock.lock();
+        bool found = (m_queue.size() > 0);
+        if (found) {
+            e = m_queue.popFront();
+            m_size = m_queue.size();
+        }
+        m_lock.unlock();
+        return found;
+    }
+};
+
+
+class TaskWorker : public GThread {
+public:
+    TaskScheduler*      m_scheduler;
+    int                 m_index;
+
+    TaskWorker(TaskScheduler* scheduler, int index) :
+        GThread(format("TaskScheduler worker %d", index)),
+        m_scheduler(scheduler), m_index(index) {}
+
+protected:
+
+    virtual void threadMain();
+};
+
+
+/** Maps the calling thread to the TaskWorker running it, if any. */
+class CurrentTaskWorker {
+private:
+#   ifdef G3D_WIN32
+    DWORD               m_tlsIndex;
+#   else
+    pthread_key_t       m_tlsKey;
+#   endif
+
+public:
+
+    CurrentTaskWorker() {
+#       ifdef G3D_WIN32
+            m_tlsIndex = ::TlsAlloc();
+#       else
+            pthread_key_create(&m_tlsKey, NULL);
+#       endif
+    }
+
+    TaskWorker* get() const {
+#       ifdef G3D_WIN32
+            return (TaskWorker*)::TlsGetValue(m_tlsIndex);
+#       else
+            return (TaskWorker*)pthread_getspecific(m_tlsKey);
+#       endif
+    }
+
+    void set(TaskWorker* w) {
+#       ifdef G3D_WIN32
+            ::TlsSetValue(m_tlsIndex, w);
+#       else
+            pthread_setspecific(m_tlsKey, w);
+#       endif
+    }
+};
+
+static CurrentTaskWorker& currentTaskWorker() {
+    static CurrentTaskWorker c;
+    return c;
+}
+
+
+void TaskWorker::threadMain() {
+    currentTaskWorker().set(this);
+    m_scheduler->workerMain(m_index);
+    currentTaskWorker().set(NULL);
+}
+
+static void yieldThread() {
+#   ifdef G3D_WIN32
+        Sleep(0);
+#   else
+        sched_yield();
+#   endif
+}
+
+} // namespace _internal
+
+
+TaskScheduler::TaskScheduler(int numWorkers) : m_numSleeping(0), m_stop(0) {
+    numWorkers = iMax(0, numWorkers);
+
+    // Ensure the thread map exists before any worker can query it
+    _internal::currentTaskWorker();
+
+    m_wake = new _internal::TaskSemaphore();
+
+    m_deque.resize(numWorkers + 1);
+    for (int i = 0; i < m_deque.size(); ++i) {
+        m_deque[i] = new _internal::TaskDeque();
+    }
+
+    m_worker.resize(numWorkers);
+    for (int i = 0; i < numWorkers; ++i) {
+        m_worker[i] = new _internal::TaskWorker(this, i);
+    }
+
+    for (int i = 0; i < numWorkers; ++i) {
+        bool started = m_worker[i]->start();
+        debugAssertM(started, "Could not start TaskScheduler worker thread");
+        (void)started;
+    }
+}
+
+
+TaskScheduler::Ref TaskScheduler::create(int numWorkers) {
+    return new TaskScheduler(numWorkers);
+}
+
+
+const TaskScheduler::Ref& TaskScheduler::global() {
+    static Spinlock lock;
+    static Ref instance;
+
+    // Set (with release semantics) only after instance is assigned, so
+    // a thread that observes it also observes the complete instance.
+    // Testing instance.isNull() without the lock would not guarantee that.
+    static AtomicInt32 initialized(0);
+
+    if (initialized.acquireValue() == 0) {
+        lock.lock();
+        if (initialized.acquireValue() == 0) {
+            instance = create();
+            initialized.releaseSet(1);
+        }
+        lock.unlock();
+    }
+    return instance;
+}
+
+
+TaskScheduler::~TaskScheduler() {
+    m_stop = 1;
+    m_wake->signal(m_worker.size());
+
+    for (int i = 0; i < m_worker.size(); ++i) {
+        m_worker[i]->waitForCompletion();
+        delete m_worker[i];
+    }
+    m_worker.clear();
+
+    for (int i = 0; i < m_deque.size(); ++i) {
+        debugAssertM(m_deque[i]->empty(), "TaskScheduler destroyed with pending tasks");
+        delete m_deque[i];
+    }
+    m_deque.clear();
+
+    delete m_wake;
+    m_wake = NULL;
+}
+
+
+int TaskScheduler::currentDequeIndex() const {
+    _internal::TaskWorker* w = _internal::currentTaskWorker().get();
+    if ((w != NULL) && (w->m_scheduler == this)) {
+        return w->m_index;
+    } else {
+        // The shared deque
+        return m_deque.size() - 1;
+    }
+}
+
+
+void TaskScheduler::push(Task* task, TaskGroup* group) {
+    m_deque[currentDequeIndex()]->pushBack(_internal::TaskEntry(task, group));
+
+    if (m_numSleeping.value() > 0) {
+        m_wake->signal();
+    }
+}
+
+
+bool TaskScheduler::tryRunOne(int dequeIndex) {
+    _internal::TaskEntry e;
+
+    // Newest local work first, for locality
+    bool found = m_deque[dequeIndex]->popBack(e);
+
+    // Steal the oldest work from someone else, which is typically
+    // the largest remaining piece of a recursive decomposition
+    for (int i = 1; (i < m_deque.size()) && ! found; ++i) {
+        found = m_deque[(dequeIndex + i) % m_deque.size()]->popFront(e);
+    }
+
+    if (found) {
+        e.task->run();
+        e.group->m_pending.decrement();
+    }
+
+    return found;
+}
+
+
+void TaskScheduler::workerMain(int index) {
+    // Number of failed attempts to find work before sleeping
+    static const int SPIN_COUNT = 64;
+
+    while (m_stop.value() == 0) {
+        bool found = false;
+        for (int spin = 0; (spin < SPIN_COUNT) && ! found; ++spin) {
+            found = tryRunOne(index);
+            if (! found) {
+                _internal::yieldThread();
+            }
+        }
+
+        if (! found) {
+            // Announce that we are about to sleep, then look once more so
+            // that a push racing with this check is not missed.
+            m_numSleeping.increment();
+            bool any = false;
+            for (int i = 0; (i < m_deque.size()) && ! any; ++i) {
+                any = ! m_deque[i]->empty();
+            }
+            if (! any && (m_stop.value() == 0)) {
+                m_wake->wait();
+            }
+            m_numSleeping.decrement();
+        }
+    }
+}
+
+
+void TaskGroup::wait() {
+    const int index = m_scheduler->currentDequeIndex();
+    while (m_pending.value() > 0) {
+        if (! m_scheduler->tryRunOne(index)) {
+            _internal::yieldThread();
+        }
+    }
+}
+
+} // namespace G3D
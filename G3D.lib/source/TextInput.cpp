@@ -44,7 +44,132 @@ bool TextInput::parseBoolean(const std::string& _string) {
      return toLower(_string) == "true";
 }
 
+/** Powers of ten that are exactly representable as doubles */
+static const double exactPowerOfTen[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+/**
+ Parses a decimal number of the form [-+]digits[.digits][(e|E)[-+]digits][f]
+ that exactly fills [s, s + len).
+
+ Returns false if the text has any other form, or if the value cannot be
+ computed with a single rounding (more than 19 significant digits, a
+ mantissa above 2^53, or a power of ten beyond 10^22).  In those cases
+ the caller falls back to sscanf.  When this succeeds the result is the
+ correctly rounded value, and so is identical to what sscanf produces.
+ */
+static bool parseDecimal(const char* s, int len, double& n) {
+    const char* p   = s;
+    const char* end = s + len;
+
+    bool negative = false;
+    if ((p < end) && ((*p == '-') || (*p == '+'))) {
+        negative = (*p == '-');
+        ++p;
+    }
+
+    if ((end - p >= 2) && (p[0] == '0') && ((p[1] == 'x') || (p[1] == 'X'))) {
+        // Hex
+        return false;
+    }
+
+    uint64 mantissa     = 0;
+    int numSignificant  = 0;
+    int exponent        = 0;
+    bool anyDigits      = false;
+
+    while ((p < end) && (*p >= '0') && (*p <= '9')) {
+        anyDigits = true;
+        if ((mantissa != 0) || (*p != '0')) {
+            if (numSignificant == 19) {
+                return false;
+            }
+            mantissa = mantissa * 10 + (*p - '0');
+            ++numSignificant;
+        }
+        ++p;
+    }
+
+    if ((p < end) && (*p == '.')) {
+        ++p;
+        while ((p < end) && (*p >= '0') && (*p <= '9')) {
+            anyDigits = true;
+            if ((mantissa != 0) || (*p != '0')) {
+                if (numSignificant == 19) {
+                    return false;
+                }
+                mantissa = mantissa * 10 + (*p - '0');
+                ++numSignificant;
+            }
+            --exponent;
+            ++p;
+        }
+    }
+
+    if (! anyDigits) {
+        return false;
+    }
+
+    if ((p < end) && ((*p == 'e') || (*p == 'E'))) {
+        ++p;
+        bool negativeExponent = false;
+        if ((p < end) && ((*p == '-') || (*p == '+'))) {
+            negativeExponent = (*p == '-');
+            ++p;
+        }
+
+        if ((p == end) || (*p < '0') || (*p > '9')) {
+            return false;
+        }
+
+        int e = 0;
+        while ((p < end) && (*p >= '0') && (*p <= '9')) {
+            if (e < 100000) {
+                e = e * 10 + (*p - '0');
+            }
+            ++p;
+        }
+        exponent += negativeExponent ? -e : e;
+    }
+
+    if ((p + 1 == end) && (*p == 'f')) {
+        // Trailing f on a float
+        ++p;
+    }
+
+    if (p != end) {
+        return false;
+    }
+
+    if (mantissa == 0) {
+        n = negative ? -0.0 : 0.0;
+        return true;
+    }
+
+    if ((mantissa > (uint64(1) << 53)) || (exponent < -22) || (exponent > 22)) {
+        return false;
+    }
+
+    double d = (double)mantissa;
+    if (exponent < 0) {
+        d /= exactPowerOfTen[-exponent];
+    } else {
+        d *= exactPowerOfTen[exponent];
+    }
+
+    n = negative ? -d : d;
+    return true;
+}
+
+
 double TextInput::parseNumber(const std::string& _string) {
+    double n;
+    if (parseDecimal(_string.data(), (int)_string.length(), n)) {
+        // The common case, which needs neither the specials nor sscanf
+        return n;
+    }
+
     std::string s = toLower(_string);
     if (s == "-1.#ind00" || s == "nan") {
         return nan();
@@ -58,7 +183,6 @@ double TextInput::parseNumber(const std::string& _string) {
         return -inf();
     }
     
-    double n;
     if ((_string.length() > 2) &&
         (_string[0] == '0') &&
         (_string[1] == 'x')) {
@@ -181,6 +305,9 @@ void TextInput::init() {
         toUpper(options.trueSymbols);
         toUpper(options.falseSymbols);
     }
+
+    options.trueSymbols.getMembers(trueSymbolArray);
+    options.falseSymbols.getMembers(falseSymbolArray);
 }
 
 
@@ -240,6 +367,435 @@ int TextInput::peekInputChar(int distance) {
 }
 
 
+/** Character classes for readFastToken */
+enum {
+    CC_SPACE    = 1,
+    CC_DIGIT    = 2,
+    CC_LETTER   = 4,
+    /** Letters, digits, and underscore */
+    CC_IDENT    = 8,
+    CC_HEX      = 16,
+    /** Characters that are always a one-character symbol */
+    CC_SIMPLE   = 32
+};
+
+class CharClassTable {
+public:
+    uint8 c[256];
+
+    CharClassTable() {
+        for (int i = 0; i < 256; ++i) {
+            c[i] = 0;
+            if (isWhiteSpace((unsigned char)i)) {
+                c[i] |= CC_SPACE;
+            }
+            if (isDigit((unsigned char)i)) {
+                c[i] |= CC_DIGIT | CC_IDENT | CC_HEX;
+            }
+            if (isLetter((unsigned char)i)) {
+                c[i] |= CC_LETTER | CC_IDENT;
+            }
+        }
+        c[(unsigned char)'_'] |= CC_IDENT;
+        for (const char* h = "abcdefABCDEF"; *h; ++h) {
+            c[(unsigned char)*h] |= CC_HEX;
+        }
+        for (const char* s = "@(),;{}[]#$?%"; *s; ++s) {
+            c[(unsigned char)*s] |= CC_SIMPLE;
+        }
+    }
+};
+
+static const CharClassTable charClassTable;
+
+static inline uint8 charClass(char c) {
+    return charClassTable.c[(unsigned char)c];
+}
+
+
+bool TextInput::matchesSymbol(const Array<std::string>& symbols, const char* s, int len) const {
+    for (int i = 0; i < symbols.size(); ++i) {
+        const std::string& symbol = symbols[i];
+        if ((int)symbol.length() == len) {
+            int k = 0;
+            if (options.caseSensitive) {
+                while ((k < len) && (s[k] == symbol[k])) {
+                    ++k;
+                }
+            } else {
+                while ((k < len) && ((char)toupper(s[k]) == symbol[k])) {
+                    ++k;
+                }
+            }
+            if (k == len) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+
+bool TextInput::readFastToken(TokenView& v) {
+    const char* const buf = buffer.getCArray();
+    const int   n    = buffer.size();
+    int         i    = currentCharOffset;
+    int         line = lineNumber;
+    int         ch   = charNumber;
+
+    // Character at offset k from i, or NUL past the end
+#   define PEEK(k) ((i + (k) < n) ? buf[i + (k)] : '\0')
+
+    // Skip white space and comments, tracking positions as eatInputChar does
+    while (true) {
+        while ((i < n) && (charClass(buf[i]) & CC_SPACE)) {
+            const char c = buf[i];
+            if ((c == '\r') || (c == '\n')) {
+                const int len = ((c == '\r') && (PEEK(1) == '\n')) ? 2 : 1;
+                if (options.generateNewlineTokens) {
+                    v._type         = Token::NEWLINE;
+                    v._extendedType = Token::NEWLINE_TYPE;
+                    v._data         = buf + i;
+                    v._length       = len;
+                    v._line         = line;
+                    v._character    = ch;
+                    v._bytePosition = i;
+
+                    currentCharOffset = i + len;
+                    lineNumber        = line + 1;
+                    charNumber        = 1;
+                    return true;
+                }
+                i += len;
+                ++line;
+                ch = 1;
+            } else {
+                ++i;
+                ++ch;
+            }
+        }
+
+        if (i >= n) {
+            break;
+        }
+
+        const char c  = buf[i];
+        const char c1 = PEEK(1);
+
+        int markerLength = 0;
+        if (options.cppLineComments && (c == '/') && (c1 == '/')) {
+            markerLength = 2;
+        } else if ((options.otherCommentCharacter != '\0') &&
+                   ((c == options.otherCommentCharacter) ||
+                    ((options.otherCommentCharacter2 != '\0') && (c == options.otherCommentCharacter2)))) {
+            markerLength = 1;
+        }
+
+        const bool blockComment = (markerLength == 0) && options.cppBlockComments && (c == '/') && (c1 == '*');
+
+        if ((markerLength == 0) && ! blockComment) {
+            break;
+        }
+
+        if (options.generateCommentTokens) {
+            // Comment tokens need their text copied
+            currentCharOffset = i;
+            lineNumber        = line;
+            charNumber        = ch;
+            return false;
+        }
+
+        if (markerLength > 0) {
+            i  += markerLength;
+            ch += markerLength;
+            while ((i < n) && (buf[i] != '\r') && (buf[i] != '\n')) {
+                ++i;
+                ++ch;
+            }
+        } else {
+            i  += 2;
+            ch += 2;
+            while ((i < n) && ! ((buf[i] == '*') && (PEEK(1) == '/'))) {
+                if (buf[i] == '\r') {
+                    i += (PEEK(1) == '\n') ? 2 : 1;
+                    ++line;
+                    ch = 1;
+                } else if (buf[i] == '\n') {
+                    ++i;
+                    ++line;
+                    ch = 1;
+                } else {
+                    ++i;
+                    ++ch;
+                }
+            }
+            // Closing marker, if not at the end of the input
+            const int closeLength = min(2, n - i);
+            i  += closeLength;
+            ch += closeLength;
+        }
+    }
+
+    // Commit the white space, so that the fallback starts at the token
+    currentCharOffset = i;
+    lineNumber        = line;
+    charNumber        = ch;
+
+    v._line         = line;
+    v._character    = ch;
+    v._bytePosition = i;
+
+    if (i >= n) {
+        v._type         = Token::END;
+        v._extendedType = Token::END_TYPE;
+        v._data         = "";
+        v._length       = 0;
+        return true;
+    }
+
+    const char c  = buf[i];
+    const char c1 = PEEK(1);
+    const char c2 = PEEK(2);
+
+    // Where the text of a number begins, and where its digits begin
+    int numberText  = -1;
+    int numberStart = -1;
+
+    // Length of a symbol token
+    int len = 0;
+
+    if (charClass(c) & CC_SIMPLE) {
+        len = 1;
+    } else {
+        switch (c) {
+        case '-':                   // negative number, -, --, -=, or ->
+        case '+':                   // positive number, +, ++, or +=
+            if ((c1 == c) || (c1 == '=') || ((c == '-') && (c1 == '>'))) {
+                len = 2;
+            } else if (options.signedNumbers && ((charClass(c1) & CC_DIGIT) || ((c1 == '.') && (charClass(c2) & CC_DIGIT)))) {
+                // As in nextToken, the text of a positive number omits the '+'
+                numberText  = (c == '-') ? i : i + 1;
+                numberStart = i + 1;
+            } else if (options.signedNumbers && options.simpleFloatSpecials && 
+                       (c1 == 'i') && (c2 == 'n') && (PEEK(3) == 'f') &&
+                       ! (charClass(PEEK(4)) & CC_LETTER) && (PEEK(4) != '_')) {
+                v._type         = Token::NUMBER;
+                v._extendedType = Token::FLOATING_POINT_TYPE;
+                v._data         = buf + i;
+                v._length       = 4;
+                v._number       = (c == '-') ? -inf() : inf();
+                currentCharOffset = i + 4;
+                charNumber        = ch + 4;
+                return true;
+            } else {
+                len = 1;
+            }
+            break;
+
+        case ':':                   // : or ::
+        case '=':                   // = or ==
+            if (options.proofSymbols) {
+                return false;
+            }
+            len = (c1 == c) ? 2 : 1;
+            break;
+
+        case '*':                   // * or *=
+        case '/':                   // / or /=
+        case '!':                   // ! or !=
+        case '~':                   // ~ or ~=
+        case '^':                   // ^ or ^=
+            len = (c1 == '=') ? 2 : 1;
+            break;
+
+        case '>':                   // >, >>,or >=
+        case '<':                   // <, <<, or <=
+        case '|':                   // |, ||, or |=
+        case '&':                   // &, &&, or &=
+            if (options.proofSymbols) {
+                return false;
+            }
+            len = ((c1 == '=') || (c1 == c)) ? 2 : 1;
+            break;
+
+        case '.':                   // number, ., .., or ...
+            if (charClass(c1) & CC_DIGIT) {
+                numberText  = i;
+                numberStart = i;
+            } else if (c1 == '.') {
+                len = (c2 == '.') ? 3 : 2;
+            } else {
+                len = 1;
+            }
+            break;
+
+        default:
+            if (charClass(c) & CC_DIGIT) {
+                numberText  = i;
+                numberStart = i;
+            }
+        }
+    }
+
+    if (len > 0) {
+        v._type           = Token::SYMBOL;
+        v._extendedType   = Token::SYMBOL_TYPE;
+        v._data           = buf + i;
+        v._length         = len;
+        currentCharOffset = i + len;
+        charNumber        = ch + len;
+        return true;
+    }
+
+    if (numberStart != -1) {
+        int j = numberStart;
+        Token::ExtendedType extendedType = (buf[j] == '.') ? Token::FLOATING_POINT_TYPE : Token::INTEGER_TYPE;
+        bool hex = false;
+
+        if ((buf[j] == '0') && (j + 1 < n) && (buf[j + 1] == 'x')) {
+            hex = true;
+            j += 2;
+            while ((j < n) && (charClass(buf[j]) & CC_HEX)) {
+                ++j;
+            }
+        } else {
+            while ((j < n) && (charClass(buf[j]) & CC_DIGIT)) {
+                ++j;
+            }
+
+            if ((j < n) && (buf[j] == '.')) {
+                extendedType = Token::FLOATING_POINT_TYPE;
+                ++j;
+                if (options.msvcFloatSpecials && (j < n) && (buf[j] == '#')) {
+                    return false;
+                }
+                while ((j < n) && (charClass(buf[j]) & CC_DIGIT)) {
+                    ++j;
+                }
+            }
+
+            if ((j < n) && ((buf[j] == 'e') || (buf[j] == 'E'))) {
+                extendedType = Token::FLOATING_POINT_TYPE;
+                ++j;
+                if ((j < n) && ((buf[j] == '-') || (buf[j] == '+'))) {
+                    ++j;
+                }
+                while ((j < n) && (charClass(buf[j]) & CC_DIGIT)) {
+                    ++j;
+                }
+            }
+
+            if ((extendedType == Token::FLOATING_POINT_TYPE) && (j < n) && (buf[j] == 'f')) {
+                ++j;
+            }
+        }
+
+        v._type         = Token::NUMBER;
+        v._extendedType = extendedType;
+        v._data         = buf + numberText;
+        v._length       = j - numberText;
+        if (hex || ! parseDecimal(v._data, v._length, v._number)) {
+            v._number = parseNumber(v.string());
+        }
+
+        currentCharOffset = j;
+        charNumber        = ch + (j - i);
+        return true;
+    }
+
+    if ((charClass(c) & CC_LETTER) || (c == '_')) {
+        // Identifier or keyword
+        int j = i + 1;
+        while ((j < n) && (charClass(buf[j]) & CC_IDENT)) {
+            ++j;
+        }
+
+        v._type         = Token::SYMBOL;
+        v._extendedType = Token::SYMBOL_TYPE;
+        v._data         = buf + i;
+        v._length       = j - i;
+
+        if (matchesSymbol(trueSymbolArray, v._data, v._length)) {
+            v._type         = Token::BOOLEAN;
+            v._extendedType = Token::BOOLEAN_TYPE;
+            v._bool         = true;
+        } else if (matchesSymbol(falseSymbolArray, v._data, v._length)) {
+            v._type         = Token::BOOLEAN;
+            v._extendedType = Token::BOOLEAN_TYPE;
+            v._bool         = false;
+        }
+
+        if (options.simpleFloatSpecials && (v._length == 3)) {
+            if (v.equals("nan")) {
+                v._type         = Token::NUMBER;
+                v._extendedType = Token::FLOATING_POINT_TYPE;
+                v._number       = nan();
+            } else if (v.equals("inf")) {
+                v._type         = Token::NUMBER;
+                v._extendedType = Token::FLOATING_POINT_TYPE;
+                v._number       = inf();
+            }
+        }
+
+        currentCharOffset = j;
+        charNumber        = ch + (j - i);
+        return true;
+    }
+
+    if ((c == '\"') || ((c == options.singleQuoteCharacter) && options.singleQuotedStrings)) {
+        // Only strings that are contiguous in the buffer
+        int j = i + 1;
+        while ((j < n) && (buf[j] != c)) {
+            if ((buf[j] == '\r') || (buf[j] == '\n') ||
+                ((buf[j] == '\\') && options.escapeSequencesInStrings)) {
+                return false;
+            }
+            ++j;
+        }
+
+        if (j == n) {
+            // Unterminated
+            return false;
+        }
+
+        v._type         = Token::STRING;
+        v._extendedType = (c == options.singleQuoteCharacter) ? Token::SINGLE_QUOTED_TYPE : Token::DOUBLE_QUOTED_TYPE;
+        v._data         = buf + i + 1;
+        v._length       = j - i - 1;
+
+        currentCharOffset = j + 1;
+        charNumber        = ch + (j + 1 - i);
+        return true;
+    }
+
+#   undef PEEK
+
+    // Everything else is rare enough to leave to nextToken
+    return false;
+}
+
+
+TokenView TextInput::readView() {
+    TokenView v;
+    if ((stack.size() == 0) && readFastToken(v)) {
+        return v;
+    }
+
+    viewToken = read();
+
+    v._type         = viewToken._type;
+    v._extendedType = viewToken._extendedType;
+    v._data         = viewToken._string.data();
+    v._length       = (int)viewToken._string.length();
+    v._bool         = viewToken._bool;
+    v._number       = viewToken.number();
+    v._line         = viewToken._line;
+    v._character    = viewToken._character;
+    v._bytePosition = viewToken._bytePosition;
+    return v;
+}
+
+
 Token TextInput::nextToken() {
     Token t;
 
@@ -931,6 +1487,14 @@ bool TextInput::readBoolean() {
 }
 
 double TextInput::readNumber() {
+    if (stack.size() == 0) {
+        const TokenView v = readView();
+        if (v._type == Token::NUMBER) {               // fast path
+            return v._number;
+        }
+        push(v.token());
+    }
+
     Token t(read());
 
     if (t._type == Token::NUMBER) {
@@ -1071,6 +1635,14 @@ std::string TextInput::readSymbol() {
 }
 
 void TextInput::readSymbol(const std::string& symbol) {
+    if (stack.size() == 0) {
+        const TokenView v = readView();
+        if ((v._type == Token::SYMBOL) && v.equals(symbol)) {   // fast path
+            return;
+        }
+        push(v.token());
+    }
+
     Token t(readSymbolToken());
 
     if (t._string == symbol) {                    // fast path
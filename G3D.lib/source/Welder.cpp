@@ -10,76 +10,109 @@
 #include "G3D/platform.h"
 #include "G3D/Vector2.h"
 #include "G3D/Vector3.h"
-#include "G3D/Sphere.h"
-#include "G3D/PointHashGrid.h"
+#include "G3D/MortonGrid.h"
+#include "G3D/TaskScheduler.h"
 #include "G3D/Welder.h"
-#include "G3D/Stopwatch.h" // for profiling
-#include "G3D/AreaMemoryManager.h"
 #include "G3D/Any.h"
 #include "G3D/stringutils.h"
 
-namespace G3D { namespace _internal{
-
+namespace G3D { namespace _internal {
 
-/** Used by WeldHelper2::smoothNormals. */
-class VN {
+/** MortonGrid::cluster rule for WeldHelper::updateTriLists.  A vertex
+    may be welded to an earlier one with a nearby position, normal, and
+    texture coordinate. */
+class WeldRule {
 public:
-    Vector3         vertex;
-    Vector3         normal;
-
-    VN() {}
-    VN(const Vector3& v, const Vector3& n) : vertex(v), normal(n) {}
-};
+    const Vector3*          vertex;
+    const Vector3*          normal;
+    const Vector2*          texCoord;
 
-/** Used by WeldHelper::getIndex to maintain a list of vertices by location. */
-class VNTi {
-public:
-    Vector3         vertex;
-    Vector3         normal;
-    Vector2         texCoord;
-    int             index;
+    float                   vertexWeldRadius2;
+    float                   normalWeldRadius2;
+    float                   texCoordWeldRadius2;
 
-    VNTi() : index(0) {}
+    bool match(int i, int j) const {
+        // A vertex with no surface normal (e.g., of a sliver triangle)
+        // matches any normal
+        return ((vertex[i] - vertex[j]).squaredMagnitude() <= vertexWeldRadius2) &&
+            (normal[i].isZero() || ((normal[i] - normal[j]).squaredLength() <= normalWeldRadius2)) &&
+            ((texCoord[i] - texCoord[j]).squaredLength() <= texCoordWeldRadius2);
+    }
 
-    VNTi(const Vector3& v, const Vector3& n, const Vector2& t, int i) : 
-        vertex(v), normal(n), texCoord(t), index(i) {}
+    /** All matches are equally good, so the earliest is chosen */
+    float cost(int i, int j) const {
+        (void)i;
+        (void)j;
+        return 0.0f;
+    }
 };
 
 
-}} // G3D
-
-template <> struct HashTrait <G3D::_internal::VN> {
-    static size_t hashCode(const G3D::_internal::VN& k) { return static_cast<size_t>(k.vertex.hashCode()); }
-};
-template <> struct HashTrait <G3D::_internal::VNTi> {
-    static size_t hashCode(const G3D::_internal::VNTi& k) { return static_cast<size_t>(k.vertex.hashCode()); }
-};
+/** parallelFor body for WeldHelper::smoothNormals over the cells of the grid */
+class SmoothNormals {
+public:
+    const MortonGrid*       grid;
+    const Vector3*          normal;
+    float                   radius;
+    float                   cosThresholdAngle;
+    Vector3*                smoothNormal;
+
+    void operator()(int begin, int end) const {
+        const float radius2 = square(radius);
+        Array<int> nearby;
+
+        for (int c = begin; c < end; ++c) {
+            for (int k = grid->cellBegin(c); k < grid->cellEnd(c); ++k) {
+                const Vector3& P = grid->position(k);
+                const int v = grid->index(k);
+
+                // Compute the sum of all nearby normals within the cutoff angle.
+                // Search within the vertexWeldRadius, since those are the vertices
+                // that will collapse to the same point.
+                nearby.fastClear();
+                grid->getCellsNear(P, radius, nearby);
+
+                Vector3 sum;
+
+                const Vector3& original = normal[v];
+                for (int n = 0; n < nearby.size(); ++n) {
+                    const int d = nearby[n];
+                    for (int kk = grid->cellBegin(d); kk < grid->cellEnd(d); ++kk) {
+                        if ((grid->position(kk) - P).squaredMagnitude() <= radius2) {
+                            const Vector3& N = normal[grid->index(kk)];
+                            const float cosAngle = N.dot(original);
+
+                            if (cosAngle > cosThresholdAngle) {
+                                // This normal is close enough to consider.  Avoid underflow by scaling up
+                                sum += (N * 256.0f);
+                            }
+                        }
+                    }
+                }
 
+                const Vector3& average = sum.directionOrZero();
 
-template<> struct EqualsTrait <G3D::_internal::VN> {
-    static bool equals(const G3D::_internal::VN& a, const G3D::_internal::VN& b) { return a.vertex == b.vertex; }
-};
-template<> struct EqualsTrait <G3D::_internal::VNTi> {
-    static bool equals(const G3D::_internal::VNTi& a, const G3D::_internal::VNTi& b) { return a.vertex == b.vertex; }
-};
+                const bool indeterminate = average.isZero();
+                // Never "smooth" a normal so far that it points backwards
+                const bool backFacing    = original.dot(average) < 0;
 
-template<> struct PositionTrait<G3D::_internal::VN> {
-    static void getPosition(const G3D::_internal::VN& v, G3D::Vector3& p) { p = v.vertex; }
-};
-template<> struct PositionTrait<G3D::_internal::VNTi> {
-    static void getPosition(const G3D::_internal::VNTi& v, G3D::Vector3& p) { p = v.vertex; }
+                if (indeterminate || backFacing) {
+                    // Revert to the face normal
+                    smoothNormal[v] = original;
+                } else {
+                    // Average available normals
+                    smoothNormal[v] = average;
+                }
+            }
+        }
+    }
 };
 
-namespace G3D { namespace _internal {
 
 class WeldHelper {
 private:
-    /** Used by getIndex and updateTriLists. Deallocating this is slow. */
-    PointHashGrid<VNTi>     weldGrid;
-
-    Array<Vector3>*         outputVertexArray;
-    Array<Vector3>*         outputNormalArray;
-    Array<Vector2>*         outputTexCoordArray;
+    /** The unrolled vertices in Morton order, shared by smoothNormals and updateTriLists */
+    MortonGrid              grid;
 
     float                   vertexWeldRadius;
     /** Squared radius allowed for welding similar normals. */
@@ -88,57 +121,13 @@ private:
 
     float                   normalSmoothingAngle;
 
-    /**
-     Returns the index of the vertex in 
-     outputVertexArray/outputNormalArray/outputTexCoordArray
-     that is within the global tolerances of v,n,t. If there 
-     is no such vertex, adds it to the arrays and returns that index.
-
-     Called from updateTriLists().
-     */
-    int getIndex(const Vector3& v, const Vector3& n, const Vector2& t) {
-        PointHashGrid<VNTi>::SphereIterator it = 
-                weldGrid.beginSphereIntersection(Sphere(v, vertexWeldRadius));
-
-        if (n.isZero()) {
-            // Don't bother trying to match the surface normal, since this vertex has no surface normal.
-            while (it.hasMore()) {
-                if ((t - it->texCoord).squaredLength() <= texCoordWeldRadius2) {
-                    // This is the vertex
-                    return it->index;
-                }
-                ++it;
-            }
-        } else {
-            while (it.hasMore()) {
-                if (((n - it->normal).squaredLength() <= normalWeldRadius2) &&
-                    ((t - it->texCoord).squaredLength() <= texCoordWeldRadius2)) {
-                    // This is the vertex
-                    return it->index;
-                }
-                ++it;
-            }
-        }
-
-        // Note that a sliver triangle processed before its neighbors may reach here
-        // with a zero length normal.
-
-        // The vertex does not exist. Create it.
-        const int i = outputVertexArray->size();
-        outputVertexArray->append(v);
-        outputNormalArray->append(n);
-        outputTexCoordArray->append(t);
-
-        // Store in the grid so that it will be remembered.
-        weldGrid.insert(VNTi(v, n, t, i));
-
-        return i;
-    }
-
+    enum {CELL_GRAIN_SIZE = 512};
 
     /**
-     Updates each indexArray to refer to vertices in the
-     outputVertexArray.
+     Updates each indexArray to refer to vertices in the output arrays.
+     Each unrolled vertex is welded to the first earlier vertex that is
+     within the global tolerances of it; vertices that match no
+     earlier vertex are appended to the outputs.
 
      Called from process()
      */
@@ -146,12 +135,38 @@ private:
         Array<Array<int>*>&         indexArrayArray, 
         const Array<Vector3>&       vertexArray,
         const Array<Vector3>&       normalArray,
-        const Array<Vector2>&       texCoordArray) {
-        
-        // Compute a hash grid so that we can find neighbors quickly.
-        // It begins empty and is extended as the tri lists are iterated
-        // through.
-        weldGrid.clear();
+        const Array<Vector2>&       texCoordArray,
+        Array<Vector3>&             outputVertexArray,
+        Array<Vector3>&             outputNormalArray,
+        Array<Vector2>&             outputTexCoordArray) {
+
+        WeldRule rule;
+        rule.vertex              = vertexArray.getCArray();
+        rule.normal              = normalArray.getCArray();
+        rule.texCoord            = texCoordArray.getCArray();
+        rule.vertexWeldRadius2   = square(vertexWeldRadius);
+        rule.normalWeldRadius2   = normalWeldRadius2;
+        rule.texCoordWeldRadius2 = texCoordWeldRadius2;
+
+        Array<int> representative;
+        grid.cluster(vertexWeldRadius, rule, representative);
+
+        // Number the representatives in order.  Every other vertex
+        // is welded to an earlier one.
+        Array<int> newIndex;
+        newIndex.resize(representative.size());
+        for (int u = 0; u < representative.size(); ++u) {
+            const int r = representative[u];
+            if (r == u) {
+                newIndex[u] = outputVertexArray.size();
+                outputVertexArray.append(vertexArray[u]);
+                outputNormalArray.append(normalArray[u]);
+                outputTexCoordArray.append(texCoordArray[u]);
+            } else {
+                debugAssert(r < u);
+                newIndex[u] = newIndex[r];
+            }
+        }
 
         // Process all triLists
         int numTriLists = indexArrayArray.size();
@@ -163,17 +178,7 @@ private:
                 // For all vertices in this list
                 for (int v = 0; v < triList.size(); ++v) {
                     // This vertex mapped to u in the flatVertexArray
-                    triList[v] = getIndex(vertexArray[u], normalArray[u], texCoordArray[u]);
-
-                    /*
-    #           ifdef G3D_DEBUG
-                {
-                    int i = triList[v];
-                    Vector3 N = normalArray[i];
-                    debugAssertM(N.length() > 0.9f, "Produced non-unit normal");
-                }
-    #           endif
-                */
+                    triList[v] = newIndex[u];
                     ++u;
                 }
             }
@@ -229,10 +234,9 @@ private:
 
     /**
      Computes @a smoothNormalArray, whose elements are those of normalArray averaged
-     with neighbors within the angular cutoff.
+     with neighbors within the angular cutoff.  Requires the grid to contain the vertices.
      */
     void smoothNormals(
-        const Array<Vector3>& vertexArray, 
         const Array<Vector3>& normalArray, 
         Array<Vector3>&       smoothNormalArray) {
         
@@ -241,57 +245,17 @@ private:
             return;
         }
 
-        
-        // Create an area memory manager for fast deallocation
-        MemoryManager::Ref mm = AreaMemoryManager::create(iRound(sizeof(VN) * normalArray.size() * 1.5));
-
-        const float cosThresholdAngle = (float)cos(normalSmoothingAngle);
-
-        debugAssert(vertexArray.size() == normalArray.size());
+        debugAssert(grid.size() == normalArray.size());
         smoothNormalArray.resize(normalArray.size());
 
-        // Compute a hash grid so that we can find neighbors quickly.
-        PointHashGrid<VN> grid(vertexWeldRadius, mm);
-        for (int v = 0; v < normalArray.size(); ++v) {
-            grid.insert(VN(vertexArray[v], normalArray[v]));
-        }
-
-        // TODO: this step could be done on multiple threads
-        for (int v = 0; v < normalArray.size(); ++v) {            
-            // Compute the sum of all nearby normals within the cutoff angle.
-            // Search within the vertexWeldRadius, since those are the vertices
-            // that will collapse to the same point.
-            PointHashGrid<VN>::SphereIterator it = 
-                grid.beginSphereIntersection(Sphere(vertexArray[v], vertexWeldRadius));
+        SmoothNormals body;
+        body.grid              = &grid;
+        body.normal            = normalArray.getCArray();
+        body.radius            = vertexWeldRadius;
+        body.cosThresholdAngle = (float)cos(normalSmoothingAngle);
+        body.smoothNormal      = smoothNormalArray.getCArray();
 
-            Vector3 sum;
-
-            const Vector3& original = normalArray[v];
-            while (it.hasMore()) {
-                const Vector3& N = it->normal;
-                const float cosAngle = N.dot(original);
-
-                if (cosAngle > cosThresholdAngle) {
-                    // This normal is close enough to consider.  Avoid underflow by scaling up
-                    sum += (N * 256.0f);
-                }
-                ++it;
-            }
-
-            const Vector3& average = sum.directionOrZero();
-
-            const bool indeterminate = average.isZero();
-            // Never "smooth" a normal so far that it points backwards
-            const bool backFacing    = original.dot(average) < 0;
-
-            if (indeterminate || backFacing) {
-                // Revert to the face normal
-                smoothNormalArray[v] = original;
-            } else {
-                // Average available normals
-                smoothNormalArray[v] = average;
-            }
-        }
+        TaskScheduler::global()->parallelFor(0, grid.numCells(), CELL_GRAIN_SIZE, body);
     }
 
 public:
@@ -346,12 +310,12 @@ public:
             unrolledVertexArray, unrolledTexCoordArray);
 
         // Put the output back into the input slots. 
-        outputVertexArray   = &vertexArray;
-        outputNormalArray   = &normalArray;
-        outputTexCoordArray = &texCoordArray;
-        outputVertexArray->fastClear();
-        outputNormalArray->fastClear();
-        outputTexCoordArray->fastClear();
+        vertexArray.fastClear();
+        normalArray.fastClear();
+        texCoordArray.fastClear();
+
+        // Bucket the unrolled vertices so that their neighbors can be found quickly
+        grid.set(unrolledVertexArray, vertexWeldRadius);
 
         // For every three vertices, generate their face normal and store it at 
         // each vertex. The output array has the same length as the input.
@@ -359,12 +323,13 @@ public:
 
         // Compute smooth normals at vertices.
         if (unrolledFaceNormalArray.size() > 0) {
-            smoothNormals(unrolledVertexArray, unrolledFaceNormalArray, unrolledSmoothNormalArray);
+            smoothNormals(unrolledFaceNormalArray, unrolledSmoothNormalArray);
             unrolledFaceNormalArray.clear();
         }
 
         // Regenerate the triangle lists
-        updateTriLists(indexArrayArray, unrolledVertexArray, unrolledSmoothNormalArray, unrolledTexCoordArray);
+        updateTriLists(indexArrayArray, unrolledVertexArray, unrolledSmoothNormalArray, unrolledTexCoordArray,
+            vertexArray, normalArray, texCoordArray);
 
         if (! hasTexCoords) {
             // Throw away the generated texCoords
@@ -373,7 +338,6 @@ public:
     }
 
     WeldHelper(float vertRadius) :
-        weldGrid(vertRadius, AreaMemoryManager::create()),
         vertexWeldRadius(vertRadius) {
     }
 
@@ -0,0 +1,528 @@
+/**
+ @file XMLReader.cpp
+
+ Pull-style streaming XML parser.
+ */
+
+#include "G3D/XMLReader.h"
+#include "G3D/BinaryInput.h"
+#include "G3D/TextInput.h"
+#include "G3D/ParseError.h"
+#include "G3D/stringutils.h"
+
+namespace G3D {
+
+static inline bool isXMLSpace(char c) {
+    return (c == ' ') || (c == '\n') || (c == '\r') || (c == '\t');
+}
+
+
+/** Appends the UTF-8 encoding of \a c to \a s */
+static void appendUTF8(std::string& s, uint32 c) {
+    if (c < 0x80) {
+        s += (char)c;
+    } else if (c < 0x800) {
+        s += (char)(0xC0 | (c >> 6));
+        s += (char)(0x80 | (c & 0x3F));
+    } else if (c < 0x10000) {
+        s += (char)(0xE0 | (c >> 12));
+        s += (char)(0x80 | ((c >> 6) & 0x3F));
+        s += (char)(0x80 | (c & 0x3F));
+    } else {
+        s += (char)(0xF0 | (c >> 18));
+        s += (char)(0x80 | ((c >> 12) & 0x3F));
+        s += (char)(0x80 | ((c >> 6) & 0x3F));
+        s += (char)(0x80 | (c & 0x3F));
+    }
+}
+
+
+/** Replaces \a s with [raw, raw + length) with entities decoded.
+    Unrecognized entities are copied unchanged. */
+static void decodeEntities(const char* raw, int length, std::string& s) {
+    s.clear();
+    const char* end = raw + length;
+    const char* p = raw;
+    while (p < end) {
+        const char* amp = (const char*)memchr(p, '&', end - p);
+        if (amp == NULL) {
+            s.append(p, end - p);
+            break;
+        }
+        s.append(p, amp - p);
+        p = amp;
+
+        const char* semi = (const char*)memchr(p, ';', min((int64)(end - p), (int64)12));
+        if (semi == NULL) {
+            s += '&';
+            ++p;
+            continue;
+        }
+
+        // The characters between '&' and ';'
+        const char* e = p + 1;
+        const int   n = (int)(semi - e);
+
+#       define IS_ENTITY(name) ((n == (int)sizeof(name) - 1) && (memcmp(e, name, n) == 0))
+        if (IS_ENTITY("lt")) {
+            s += '<';
+        } else if (IS_ENTITY("gt")) {
+            s += '>';
+        } else if (IS_ENTITY("amp")) {
+            s += '&';
+        } else if (IS_ENTITY("quot")) {
+            s += '\"';
+        } else if (IS_ENTITY("apos")) {
+            s += '\'';
+        } else if ((n > 1) && (e[0] == '#')) {
+            const bool hex = (e[1] == 'x') || (e[1] == 'X');
+            uint32 c = 0;
+            for (int i = hex ? 2 : 1; i < n; ++i) {
+                const char d = e[i];
+                if (isDigit(d)) {
+                    c = c * (hex ? 16 : 10) + (d - '0');
+                } else if (hex && (d >= 'a') && (d <= 'f')) {
+                    c = c * 16 + (d - 'a' + 10);
+                } else if (hex && (d >= 'A') && (d <= 'F')) {
+                    c = c * 16 + (d - 'A' + 10);
+                }
+            }
+            appendUTF8(s, c);
+        } else {
+            // Not an entity that we know; keep it
+            s.append(p, semi - p + 1);
+        }
+#       undef IS_ENTITY
+        p = semi + 1;
+    }
+}
+
+
+XMLReader::XMLReader(const std::string& filename) : m_input(NULL), m_filename(filename) {
+    m_input = new BinaryInput(filename, G3D_LITTLE_ENDIAN, false, true);
+    m_data  = (const char*)m_input->getCArray();
+    m_size  = m_input->size();
+    init();
+}
+
+
+XMLReader::XMLReader(FS fs, const std::string& str) : m_input(NULL), m_string(str) {
+    (void)fs;
+    if (str.length() < 14) {
+        m_filename = std::string("\"") + str + "\"";
+    } else {
+        m_filename = std::string("\"") + str.substr(0, 10) + "...\"";
+    }
+    m_data = m_string.data();
+    m_size = m_string.size();
+    init();
+}
+
+
+XMLReader::~XMLReader() {
+    delete m_input;
+    m_input = NULL;
+}
+
+
+void XMLReader::init() {
+    m_pos               = 0;
+    m_event             = END_OF_INPUT;
+    m_depth             = 0;
+    m_popPending        = false;
+    m_inTag             = false;
+    m_rawValue          = NULL;
+    m_rawValueLength    = 0;
+    m_decodeValue       = false;
+    m_valueReady        = true;
+    m_eventPos          = 0;
+
+    if ((m_size >= 3) && ((uint8)m_data[0] == 0xEF) && ((uint8)m_data[1] == 0xBB) && ((uint8)m_data[2] == 0xBF)) {
+        // UTF-8 byte order mark
+        m_pos = 3;
+    }
+}
+
+
+static int countLines(const char* data, int64 pos, int& character) {
+    int line = 1;
+    int64 lineStart = 0;
+    for (int64 i = 0; i < pos; ++i) {
+        if (data[i] == '\n') {
+            ++line;
+            lineStart = i + 1;
+        }
+    }
+    character = (int)(pos - lineStart) + 1;
+    return line;
+}
+
+
+int XMLReader::line() const {
+    int character;
+    return countLines(m_data, m_eventPos, character);
+}
+
+
+void XMLReader::parseError(int64 pos, const std::string& message) const {
+    int character;
+    const int line = countLines(m_data, min(pos, m_size), character);
+    throw ParseError(m_filename, line, character, message);
+}
+
+
+void XMLReader::skipPast(const char* terminator, const std::string& message) {
+    const int n = (int)strlen(terminator);
+    const int64 start = m_pos;
+    while (m_pos + n <= m_size) {
+        const char* p = (const char*)memchr(m_data + m_pos, terminator[0], (size_t)(m_size - m_pos));
+        if (p == NULL) {
+            break;
+        }
+        m_pos = p - m_data;
+        if ((m_pos + n <= m_size) && (memcmp(p, terminator, n) == 0)) {
+            m_pos += n;
+            return;
+        }
+        ++m_pos;
+    }
+    parseError(start, message);
+}
+
+
+int XMLReader::nameLength() const {
+    int64 i = m_pos;
+    while ((i < m_size) && ! isXMLSpace(m_data[i]) && (m_data[i] != '>') && (m_data[i] != '/') && (m_data[i] != '=')) {
+        ++i;
+    }
+    return (int)(i - m_pos);
+}
+
+
+void XMLReader::setValue(const char* raw, int length, bool decode) {
+    m_rawValue       = raw;
+    m_rawValueLength = length;
+    m_decodeValue    = decode;
+    m_valueReady     = false;
+}
+
+
+const std::string& XMLReader::name() const {
+    static const std::string empty;
+    switch (m_event) {
+    case START_TAG:
+    case END_TAG:
+        return m_stack[m_depth - 1];
+
+    case ATTRIBUTE:
+        return m_attributeName;
+
+    default:
+        return empty;
+    }
+}
+
+
+const std::string& XMLReader::value() const {
+    if (! m_valueReady) {
+        if (m_decodeValue && (memchr(m_rawValue, '&', m_rawValueLength) != NULL)) {
+            decodeEntities(m_rawValue, m_rawValueLength, m_value);
+        } else {
+            m_value.assign(m_rawValue, m_rawValueLength);
+        }
+        m_valueReady = true;
+    }
+    return m_value;
+}
+
+
+double XMLReader::number() const {
+    return TextInput::parseNumber(value());
+}
+
+
+bool XMLReader::next() {
+    if (m_popPending) {
+        --m_depth;
+        m_popPending = false;
+    }
+
+    // Values do not outlive their events
+    setValue("", 0, false);
+
+    if (m_inTag) {
+        return readAttributeOrTagEnd();
+    } else {
+        return readContent();
+    }
+}
+
+
+bool XMLReader::readAttributeOrTagEnd() {
+    while ((m_pos < m_size) && isXMLSpace(m_data[m_pos])) {
+        ++m_pos;
+    }
+    m_eventPos = m_pos;
+
+    if (m_pos >= m_size) {
+        parseError(m_pos, "Unterminated <" + m_stack[m_depth - 1] + "> tag");
+    }
+
+    const char c = m_data[m_pos];
+    if (c == '>') {
+        ++m_pos;
+        m_inTag = false;
+        return readContent();
+    }
+
+    if (c == '/') {
+        if ((m_pos + 1 >= m_size) || (m_data[m_pos + 1] != '>')) {
+            parseError(m_pos, "Expected '>' after '/'");
+        }
+        // Empty-element tag
+        m_pos += 2;
+        m_inTag = false;
+        m_event = END_TAG;
+        m_popPending = true;
+        return true;
+    }
+
+    // Attribute
+    const int n = nameLength();
+    if (n == 0) {
+        parseError(m_pos, "Expected an attribute name");
+    }
+    m_attributeName.assign(m_data + m_pos, n);
+    m_pos += n;
+
+    while ((m_pos < m_size) && isXMLSpace(m_data[m_pos])) {
+        ++m_pos;
+    }
+    if ((m_pos >= m_size) || (m_data[m_pos] != '=')) {
+        parseError(m_pos, "Expected '=' after attribute " + m_attributeName);
+    }
+    ++m_pos;
+    while ((m_pos < m_size) && isXMLSpace(m_data[m_pos])) {
+        ++m_pos;
+    }
+    if ((m_pos >= m_size) || ((m_data[m_pos] != '\"') && (m_data[m_pos] != '\''))) {
+        parseError(m_pos, "Expected a quoted value for attribute " + m_attributeName);
+    }
+
+    const char quote = m_data[m_pos];
+    ++m_pos;
+    const char* end = (const char*)memchr(m_data + m_pos, quote, (size_t)(m_size - m_pos));
+    if (end == NULL) {
+        parseError(m_pos - 1, "Unterminated value for attribute " + m_attributeName);
+    }
+    setValue(m_data + m_pos, (int)(end - (m_data + m_pos)), true);
+    m_pos = (end - m_data) + 1;
+
+    m_event = ATTRIBUTE;
+    return true;
+}
+
+
+bool XMLReader::readContent() {
+    while (true) {
+        m_eventPos = m_pos;
+
+        if (m_pos >= m_size) {
+            if (m_depth > 0) {
+                parseError(m_pos, "End of input inside <" + m_stack[m_depth - 1] + ">");
+            }
+            m_event = END_OF_INPUT;
+            return false;
+        }
+
+        if (m_data[m_pos] != '<') {
+            // Text up to the next tag
+            const char* start = m_data + m_pos;
+            const char* end = (const char*)memchr(start, '<', (size_t)(m_size - m_pos));
+            if (end == NULL) {
+                end = m_data + m_size;
+            }
+            m_pos = end - m_data;
+
+            while ((start < end) && isXMLSpace(*start)) {
+                ++start;
+            }
+            while ((end > start) && isXMLSpace(end[-1])) {
+                --end;
+            }
+
+            if (start < end) {
+                m_eventPos = start - m_data;
+                setValue(start, (int)(end - start), true);
+                m_event = TEXT;
+                return true;
+            }
+            continue;
+        }
+
+        const char* p = m_data + m_pos;
+        const int64 remaining = m_size - m_pos;
+
+        if ((remaining >= 4) && (memcmp(p, "<!--", 4) == 0)) {
+            m_pos += 4;
+            skipPast("-->", "Unterminated comment");
+
+        } else if ((remaining >= 9) && (memcmp(p, "<![CDATA[", 9) == 0)) {
+            m_pos += 9;
+            const int64 start = m_pos;
+            skipPast("]]>", "Unterminated CDATA section");
+            setValue(m_data + start, (int)(m_pos - 3 - start), false);
+            m_event = TEXT;
+            return true;
+
+        } else if ((remaining >= 2) && (p[1] == '?')) {
+            // Processing instruction
+            m_pos += 2;
+            skipPast("?>", "Unterminated processing instruction");
+
+        } else if ((remaining >= 2) && (p[1] == '!')) {
+            // DOCTYPE, which may have an internal subset in brackets
+            int bracketDepth = 0;
+            int64 i = m_pos + 2;
+            while ((i < m_size) && ((m_data[i] != '>') || (bracketDepth > 0))) {
+                if (m_data[i] == '[') {
+                    ++bracketDepth;
+                } else if (m_data[i] == ']') {
+                    --bracketDepth;
+                }
+                ++i;
+            }
+            if (i >= m_size) {
+                parseError(m_pos, "Unterminated <! declaration");
+            }
+            m_pos = i + 1;
+
+        } else if ((remaining >= 2) && (p[1] == '/')) {
+            // End tag
+            m_pos += 2;
+            const int n = nameLength();
+            if ((m_depth == 0) || (m_stack[m_depth - 1].compare(0, std::string::npos, m_data + m_pos, n) != 0)) {
+                parseError(m_eventPos, "Mismatched close tag </" + std::string(m_data + m_pos, n) + ">" +
+                           ((m_depth > 0) ? (" for <" + m_stack[m_depth - 1] + ">") : std::string()));
+            }
+            m_pos += n;
+            while ((m_pos < m_size) && isXMLSpace(m_data[m_pos])) {
+                ++m_pos;
+            }
+            if ((m_pos >= m_size) || (m_data[m_pos] != '>')) {
+                parseError(m_pos, "Expected '>'");
+            }
+            ++m_pos;
+
+            m_event = END_TAG;
+            m_popPending = true;
+            return true;
+
+        } else {
+            // Start tag
+            ++m_pos;
+            const int n = nameLength();
+            if (n == 0) {
+                parseError(m_eventPos, "Expected a tag name after '<'");
+            }
+
+            if (m_depth < m_stack.size()) {
+                m_stack[m_depth].assign(m_data + m_pos, n);
+            } else {
+                m_stack.append(std::string(m_data + m_pos, n));
+            }
+            ++m_depth;
+            m_pos += n;
+
+            m_inTag = true;
+            m_event = START_TAG;
+            return true;
+        }
+    }
+}
+
+
+bool XMLReader::pathMatches(const std::string& path) const {
+    const char* p = path.c_str();
+    if (*p == '/') {
+        ++p;
+    }
+
+    for (int i = 0; i < m_depth; ++i) {
+        const char* end = strchr(p, '/');
+        if (end == NULL) {
+            end = p + strlen(p);
+        }
+        const int n = (int)(end - p);
+        if ((n == 0) || ((i + 1 < m_depth) != (*end == '/'))) {
+            // Different number of names
+            return false;
+        }
+
+        if (! ((n == 1) && (*p == '*')) && (m_stack[i].compare(0, std::string::npos, p, n) != 0)) {
+            return false;
+        }
+
+        p = (*end == '/') ? end + 1 : end;
+    }
+
+    return (m_depth > 0) && (*p == '\0');
+}
+
+
+XML XMLReader::readSubtree() {
+    debugAssertM(m_event == START_TAG, "readSubtree() requires a START_TAG event");
+
+    const std::string name = this->name();
+    XML::AttributeTable attribute;
+    Array<XML> child;
+
+    while (next()) {
+        switch (m_event) {
+        case ATTRIBUTE:
+            attribute.set(m_attributeName, value());
+            break;
+
+        case TEXT:
+            child.append(XML(value()));
+            break;
+
+        case START_TAG:
+            child.append(readSubtree());
+            break;
+
+        case END_TAG:
+            // Nested elements were consumed recursively, so this is our end tag
+            return XML(XML::TAG, name, attribute, child);
+
+        case END_OF_INPUT:
+            break;
+        }
+    }
+
+    // next() throws before reaching the end inside an element
+    return XML(XML::TAG, name, attribute, child);
+}
+
+
+void XMLReader::skipSubtree() {
+    debugAssertM(m_event == START_TAG, "skipSubtree() requires a START_TAG event");
+    const int d = m_depth;
+    while (next() && ! ((m_event == END_TAG) && (m_depth == d))) {}
+}
+
+
+void XMLReader::materialize(const Array<std::string>& paths, Array<XML>& result) {
+    while (next()) {
+        if (m_event == START_TAG) {
+            for (int i = 0; i < paths.size(); ++i) {
+                if (pathMatches(paths[i])) {
+                    result.append(readSubtree());
+                    break;
+                }
+            }
+        }
+    }
+}
+
+} // namespace G3D
@@ -3,12 +3,25 @@
 
   @author Morgan McGuire, http://graphics.cs.williams.edu
   @created 2007-03-01
-  @edited  2007-03-01
+  @edited  2010-06-22
 
-  Copyright 2000-2007, Morgan McGuire.
+  Copyright 2000-2010, Morgan McGuire.
   All rights reserved.
  */
 #include "G3D/filter.h"
+#include "G3D/System.h"
+
+#if defined(G3D_WIN32) || defined(__i386__) || defined(__x86_64__)
+#   define G3D_FILTER_SIMD
+#   include <emmintrin.h>
+
+    // GCC only emits instructions beyond the compiler's target for functions that ask for them
+#   if defined(__GNUC__) && ! defined(__SSE2__)
+#       define G3D_TARGET_SSE2 __attribute__((target("sse2")))
+#   else
+#       define G3D_TARGET_SSE2
+#   endif
+#endif
 
 namespace G3D {
 
@@ -29,4 +42,309 @@ void gaussian1D(Array<float>& coeff, int N, float std) {
 }
 
 
+float ResampleFilter::support() const {
+    switch (value) {
+    case BOX:
+        return 0.5f;
+    case TENT:
+        return 1.0f;
+    case LANCZOS3:
+        return 3.0f;
+    case MITCHELL:
+        return 2.0f;
+    }
+    return 0.0f;
+}
+
+
+static float sinc(float x) {
+    if (x == 0.0f) {
+        return 1.0f;
+    }
+    x *= pif();
+    return sin(x) / x;
+}
+
+
+float ResampleFilter::evaluate(float offset) const {
+    // Every filter except BOX is symmetric
+    const float x = abs(offset);
+    switch (value) {
+    case BOX:
+        // Half-open on the signed offset, so that a source pixel on the
+        // boundary between two destination pixels counts toward exactly
+        // one of them
+        return ((-0.5f <= offset) && (offset < 0.5f)) ? 1.0f : 0.0f;
+
+    case TENT:
+        return max(0.0f, 1.0f - x);
+
+    case LANCZOS3:
+        return (x < 3.0f) ? sinc(x) * sinc(x / 3.0f) : 0.0f;
+
+    case MITCHELL:
+        {
+            static const float B = 1.0f / 3.0f;
+            static const float C = 1.0f / 3.0f;
+            const float x2 = x * x;
+            const float x3 = x2 * x;
+            if (x < 1.0f) {
+                return ((12 - 9 * B - 6 * C) * x3 + (-18 + 12 * B + 6 * C) * x2 + (6 - 2 * B)) / 6.0f;
+            } else if (x < 2.0f) {
+                return ((-B - 6 * C) * x3 + (6 * B + 30 * C) * x2 + (-12 * B - 48 * C) * x + (8 * B + 24 * C)) / 6.0f;
+            } else {
+                return 0.0f;
+            }
+        }
+    }
+    return 0.0f;
+}
+
+
+ResampleWeights::ResampleWeights(int srcSize, int dstSize, ResampleFilter filter, WrapMode wrap) : 
+    srcSize(srcSize), dstSize(dstSize), taps(1) {
+
+    debugAssert(srcSize > 0 && dstSize > 0);
+
+    if (srcSize == dstSize) {
+        index.resize(dstSize);
+        weight.resize(dstSize);
+        for (int i = 0; i < dstSize; ++i) {
+            index[i]  = i;
+            weight[i] = 1.0f;
+        }
+        return;
+    }
+
+    const double scale       = (double)srcSize / dstSize;
+    // Stretch the filter when minifying so that every source sample contributes
+    const double filterScale = G3D::max(scale, 1.0);
+    const double radius      = filter.support() * filterScale;
+    const int maxTaps        = iCeil(radius * 2) + 1;
+
+    // Normalized weights, shifted so that each row starts at its first nonzero tap
+    Array<double> w;
+    w.resize(dstSize * maxTaps);
+    Array<int> first;
+    first.resize(dstSize);
+
+    taps = 1;
+    for (int i = 0; i < dstSize; ++i) {
+        const double center = (i + 0.5) * scale - 0.5;
+        const int start     = iCeil(center - radius);
+        double* row         = w.getCArray() + i * maxTaps;
+
+        double sum = 0.0;
+        int lo = maxTaps, hi = -1;
+        for (int k = 0; k < maxTaps; ++k) {
+            row[k] = filter.evaluate((float)((start + k - center) / filterScale));
+            sum += row[k];
+            if (row[k] != 0.0) {
+                lo = iMin(lo, k);
+                hi = k;
+            }
+        }
+        if (hi < lo) {
+            lo = hi = 0;
+        }
+
+        for (int k = 0; k < maxTaps; ++k) {
+            row[k] = ((k + lo <= hi) && (sum != 0.0)) ? row[k + lo] / sum : 0.0;
+        }
+        first[i] = start + lo;
+        taps = iMax(taps, hi - lo + 1);
+    }
+
+    index.resize(dstSize * taps);
+    weight.resize(dstSize * taps);
+    for (int i = 0; i < dstSize; ++i) {
+        const double* row = w.getCArray() + i * maxTaps;
+        int*   outIndex   = index.getCArray()  + i * taps;
+        float* outWeight  = weight.getCArray() + i * taps;
+        for (int k = 0; k < taps; ++k) {
+            int j = first[i] + k;
+            float v = (float)row[k];
+            if ((j < 0) || (j >= srcSize)) {
+                switch (wrap) {
+                case WrapMode::TILE:
+                    j = iWrap(j, srcSize);
+                    break;
+
+                case WrapMode::ZERO:
+                    j = iClamp(j, 0, srcSize - 1);
+                    v = 0.0f;
+                    break;
+
+                default:
+                    j = iClamp(j, 0, srcSize - 1);
+                }
+            }
+            outIndex[k]  = j;
+            outWeight[k] = v;
+        }
+    }
+}
+
+
+namespace _internal {
+
+class ResampleHorizontal {
+public:
+    const float*            src;
+    float*                  dst;
+    int                     channels;
+    const ResampleWeights*  weights;
+    bool                    sse;
+
+    void operator()(int begin, int end) const;
+};
+
+
+class ResampleVertical {
+public:
+    const float*            src;
+    float*                  dst;
+    /** Floats per row */
+    int                     rowLength;
+    const ResampleWeights*  weights;
+    bool                    sse;
+
+    void operator()(int begin, int end) const;
+};
+
+
+#ifdef G3D_FILTER_SIMD
+static G3D_TARGET_SSE2 void resampleRow4_sse2(const float* src, float* dst, const ResampleWeights& weights) {
+    const int    taps   = weights.taps;
+    const int*   index  = weights.index.getCArray();
+    const float* weight = weights.weight.getCArray();
+    for (int x = 0; x < weights.dstSize; ++x, index += taps, weight += taps) {
+        __m128 sum = _mm_setzero_ps();
+        for (int k = 0; k < taps; ++k) {
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(src + 4 * index[k]), _mm_set1_ps(weight[k])));
+        }
+        _mm_storeu_ps(dst + 4 * x, sum);
+    }
+}
+
+
+/** Returns the number of leading floats written */
+static G3D_TARGET_SSE2 int resampleColumns_sse2(const float* const* row, const float* weight, int taps, float* dst, int rowLength) {
+    int n = 0;
+    for (; n + 8 <= rowLength; n += 8) {
+        __m128 sum0 = _mm_setzero_ps();
+        __m128 sum1 = _mm_setzero_ps();
+        for (int k = 0; k < taps; ++k) {
+            const __m128 w = _mm_set1_ps(weight[k]);
+            sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(row[k] + n), w));
+            sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(row[k] + n + 4), w));
+        }
+        _mm_storeu_ps(dst + n, sum0);
+        _mm_storeu_ps(dst + n + 4, sum1);
+    }
+    return n;
+}
+#endif
+
+
+void ResampleHorizontal::operator()(int begin, int end) const {
+    const int srcLength = weights->srcSize * channels;
+    const int dstLength = weights->dstSize * channels;
+    const int taps      = weights->taps;
+
+    for (int y = begin; y < end; ++y) {
+        const float* s = src + y * srcLength;
+        float*       d = dst + y * dstLength;
+
+#       ifdef G3D_FILTER_SIMD
+        if (sse && (channels == 4)) {
+            resampleRow4_sse2(s, d, *weights);
+            continue;
+        }
+#       endif
+
+        const int*   index  = weights->index.getCArray();
+        const float* weight = weights->weight.getCArray();
+        for (int x = 0; x < weights->dstSize; ++x, index += taps, weight += taps) {
+            for (int c = 0; c < channels; ++c) {
+                float sum = 0.0f;
+                for (int k = 0; k < taps; ++k) {
+                    sum += s[index[k] * channels + c] * weight[k];
+                }
+                d[x * channels + c] = sum;
+            }
+        }
+    }
+}
+
+
+void ResampleVertical::operator()(int begin, int end) const {
+    const int taps = weights->taps;
+    Array<const float*> row;
+    row.resize(taps);
+
+    for (int y = begin; y < end; ++y) {
+        const int*   index  = weights->index.getCArray()  + y * taps;
+        const float* weight = weights->weight.getCArray() + y * taps;
+        for (int k = 0; k < taps; ++k) {
+            row[k] = src + index[k] * rowLength;
+        }
+        float* d = dst + y * rowLength;
+
+        int n = 0;
+#       ifdef G3D_FILTER_SIMD
+        if (sse) {
+            n = resampleColumns_sse2(row.getCArray(), weight, taps, d, rowLength);
+        }
+#       endif
+
+        for (; n < rowLength; ++n) {
+            float sum = 0.0f;
+            for (int k = 0; k < taps; ++k) {
+                sum += row[k][n] * weight[k];
+            }
+            d[n] = sum;
+        }
+    }
+}
+
+
+void resampleFloat
+(const float*           src,
+ int                    channels,
+ const ResampleWeights& horizontal,
+ const ResampleWeights& vertical,
+ float*                 dst,
+ bool                   parallel) {
+
+    bool sse = false;
+#   ifdef G3D_FILTER_SIMD
+        sse = System::hasSSE2();
+#   endif
+
+    // Filter horizontally first, into a srcHeight x dstWidth buffer
+    float* temp = (float*)System::alignedMalloc(sizeof(float) * vertical.srcSize * horizontal.dstSize * channels, 16);
+
+    ResampleHorizontal h;
+    h.src      = src;
+    h.dst      = temp;
+    h.channels = channels;
+    h.weights  = &horizontal;
+    h.sse      = sse;
+    resampleRows(h, vertical.srcSize, horizontal.dstSize * horizontal.taps * channels, parallel);
+
+    ResampleVertical v;
+    v.src       = temp;
+    v.dst       = dst;
+    v.rowLength = horizontal.dstSize * channels;
+    v.weights   = &vertical;
+    v.sse       = sse;
+    resampleRows(v, vertical.dstSize, v.rowLength * vertical.taps, parallel);
+
+    System::alignedFree(temp);
+}
+
+} // _internal
+
+
 } // namespace
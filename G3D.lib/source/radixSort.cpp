@@ -0,0 +1,171 @@
+/**
+  @file radixSort.cpp
+
+  Each pass counts the digits of fixed-size blocks of the input in
+  parallel, computes the output position of every (digit, block) pair
+  with one serial prefix sum in digit-major order, and then scatters
+  the blocks in parallel.  Because blocks are contiguous and each
+  block writes its elements in order, the sort is stable.
+ */
+
+#include "G3D/radixSort.h"
+#include "G3D/TaskScheduler.h"
+#include <string.h>
+#include <algorithm>
+
+namespace G3D {
+
+namespace _internal {
+
+enum {
+    RADIX_BITS       = 11,
+    RADIX            = 1 << RADIX_BITS,
+
+    /** Elements per block, which is also the unit of parallel work */
+    RADIX_BLOCK_SIZE = 1 << 16
+};
+
+
+class RadixCount {
+public:
+    const uint64*   key;
+    int             size;
+    int             shift;
+
+    /** RADIX counters per block */
+    int*            count;
+
+    void operator()(int begin, int end) const {
+        for (int b = begin; b < end; ++b) {
+            int* c = count + b * RADIX;
+            memset(c, 0, sizeof(int) * RADIX);
+
+            const int last = iMin(size, (b + 1) * RADIX_BLOCK_SIZE);
+            for (int i = b * RADIX_BLOCK_SIZE; i < last; ++i) {
+                ++c[(key[i] >> shift) & (RADIX - 1)];
+            }
+        }
+    }
+};
+
+
+class RadixScatter {
+public:
+    const uint64*   srcKey;
+    const int*      srcValue;
+    uint64*         dstKey;
+    int*            dstValue;
+    int             size;
+    int             shift;
+
+    /** Output position of the next element of each digit, RADIX per block */
+    int*            position;
+
+    void operator()(int begin, int end) const {
+        for (int b = begin; b < end; ++b) {
+            int* p = position + b * RADIX;
+
+            const int last = iMin(size, (b + 1) * RADIX_BLOCK_SIZE);
+            for (int i = b * RADIX_BLOCK_SIZE; i < last; ++i) {
+                const uint64 k = srcKey[i];
+                const int j = p[(k >> shift) & (RADIX - 1)]++;
+                dstKey[j]   = k;
+                dstValue[j] = srcValue[i];
+            }
+        }
+    }
+};
+
+} // namespace _internal
+
+
+void radixSort(Array<uint64>& key, Array<int>& value, int numBits, bool useThreads) {
+    using namespace _internal;
+
+    debugAssertM(key.size() == value.size(), "key and value must be parallel arrays");
+    debugAssert((numBits >= 0) && (numBits <= 64));
+
+    const int n = key.size();
+    if (n < 2) {
+        return;
+    }
+
+    const int numBlocks = (n + RADIX_BLOCK_SIZE - 1) / RADIX_BLOCK_SIZE;
+
+    Array<int> count;
+    count.resize(numBlocks * RADIX);
+
+    Array<uint64> tempKey;
+    Array<int>    tempValue;
+    tempKey.resize(n);
+    tempValue.resize(n);
+
+    uint64* srcKey   = key.getCArray();
+    int*    srcValue = value.getCArray();
+    uint64* dstKey   = tempKey.getCArray();
+    int*    dstValue = tempValue.getCArray();
+
+    for (int shift = 0; shift < numBits; shift += RADIX_BITS) {
+        RadixCount counter;
+        counter.key   = srcKey;
+        counter.size  = n;
+        counter.shift = shift;
+        counter.count = count.getCArray();
+
+        if (useThreads) {
+            TaskScheduler::global()->parallelFor(0, numBlocks, 1, counter);
+        } else {
+            counter(0, numBlocks);
+        }
+
+        // Convert the counts to output positions, digit-major so that
+        // equal digits from earlier blocks come first
+        int position = 0;
+        bool trivial = false;
+        for (int d = 0; d < RADIX; ++d) {
+            const int first = position;
+            for (int b = 0; b < numBlocks; ++b) {
+                int& c = count[b * RADIX + d];
+                const int t = c;
+                c = position;
+                position += t;
+            }
+
+            if (position - first == n) {
+                // Every key has this digit
+                trivial = true;
+                break;
+            }
+        }
+
+        if (trivial) {
+            continue;
+        }
+
+        RadixScatter scatter;
+        scatter.srcKey   = srcKey;
+        scatter.srcValue = srcValue;
+        scatter.dstKey   = dstKey;
+        scatter.dstValue = dstValue;
+        scatter.size     = n;
+        scatter.shift    = shift;
+        scatter.position = count.getCArray();
+
+        if (useThreads) {
+            TaskScheduler::global()->parallelFor(0, numBlocks, 1, scatter);
+        } else {
+            scatter(0, numBlocks);
+        }
+
+        std::swap(srcKey, dstKey);
+        std::swap(srcValue, dstValue);
+    }
+
+    if (srcKey != key.getCArray()) {
+        // An odd number of passes left the result in the temporary arrays
+        memcpy(key.getCArray(), srcKey, sizeof(uint64) * n);
+        memcpy(value.getCArray(), srcValue, sizeof(int) * n);
+    }
+}
+
+} // namespace G3D
@@ -9,6 +9,8 @@
 #include "G3D/Matrix4.h"
 #include "G3D/Welder.h"
 #include "G3D/Image1.h"
+#include "G3D/Rect2D.h"
+#include "G3D/GCamera.h"
 #include "GLG3D/VertexRange.h"
 #include "GLG3D/Surface.h"
 #include "GLG3D/Material.h"
@@ -148,13 +150,22 @@ public:
 
     /**
      Parameters applied when G3D::ArticulatedModel::Part::computeNormalsAndTangentSpace 
-     is caled by G3D::ArticulatedModel::updateAll.
+     and G3D::ArticulatedModel::Part::computeLOD are called by G3D::ArticulatedModel::updateAll.
      */
     class Settings {
     public:
         Welder::Settings                     weld;
 
-        inline Settings() {}
+        /** Number of simplified levels of detail to build for each
+            part.  Default is <b>0</b>, which builds none.
+            \sa Part::lodArray */
+        int                                  numLODLevels;
+
+        /** Fraction of the triangles of the previous level kept in each
+            level of detail.  Default is <b>0.5</b>. */
+        float                                lodReduction;
+
+        inline Settings() : numLODLevels(0), lodReduction(0.5f) {}
 
         /** This forces "flat shading" on the model and causes it to render significantly
             slower than a smooth shaded object. However, it can be very useful for debugging in certain
@@ -255,6 +266,27 @@ public:
 		
         /** A collection of meshes that describe this part.*/
         Array<TriList::Ref>         triList;
+
+        /** A simplified version of the triLists of a Part.  It shares the
+            vertices (and VertexRanges) of the Part, so only the indices
+            differ. */
+        class LOD {
+        public:
+            /** Approximate largest distance in object space between
+                this level and the full resolution surface. */
+            float                   error;
+
+            /** Parallel to Part::triList.  Elements are NULL where those of
+                Part::triList are. */
+            Array<TriList::Ref>     triList;
+
+            LOD() : error(0) {}
+        };
+
+        /** Levels of detail in order of increasing error, computed by
+            computeLOD.  Empty unless Settings::numLODLevels is positive.
+            \sa ArticulatedModel::pose */
+        Array<LOD>                  lodArray;
         
         /** Indices into part array of sub-parts (scene graph children) in the containing model.*/
         Array<int>                  subPartArray;
@@ -270,6 +302,7 @@ public:
         /** Removes CPU geometry but retains GPU geometry (until next update()), cframe, and hierarchy.*/
         void removeGeometry() {
             triList.clear();
+            lodArray.clear();
             packedTangentArray.clear();
             texCoordArray.clear();
             geometry.clear();
@@ -289,13 +322,29 @@ public:
          */
         void render(RenderDevice* rd, const CoordinateFrame& parent, const Pose& pose) const;
 
-        /** Called by ArticulatedModel::pose */
+        /** Called by ArticulatedModel::pose.
+            \param camera If not NULL, pose the level of detail chosen by
+            chooseLOD for this camera instead of the full resolution triLists. */
         void pose(
             const ArticulatedModel::Ref& model,
             int                     partIndex,
             Array<Surface::Ref>&    posedArray,
             const CoordinateFrame&  parent, 
-            const Pose&             posex) const;
+            const Pose&             posex,
+            const GCamera*          camera = NULL,
+            const Rect2D&           viewport = Rect2D(),
+            float                   maxPixelError = 1.0f) const;
+
+        /** Returns the index into lodArray of the coarsest level of
+            detail whose error covers at most \a maxPixelError pixels
+            when this part is at \a frame, or -1 for full resolution.
+            The error is projected at the point of the part's bounds
+            nearest to the camera, using GCamera::worldToScreenSpaceArea. */
+        int chooseLOD(
+            const CoordinateFrame&  frame,
+            const GCamera&          camera,
+            const Rect2D&           viewport,
+            float                   maxPixelError) const;
 
         /** Some parts have no geometry because they are interior nodes in the hierarchy. */
         inline bool hasGeometry() const {
@@ -314,6 +363,24 @@ public:
         /** Called automatically by updateAll */
         void computeIndexArray();
 
+        /** Rebuilds lodArray from the triLists with MeshAlg::simplify,
+            using Settings::numLODLevels, Settings::lodReduction, and the
+            weld settings to find seams.  Called automatically by
+            updateAll, after computeNormalsAndTangentSpace. */
+        void computeLOD(const ArticulatedModel::Settings& settings);
+
+        /** Welds the vertices with \a settings.weld and then reorders
+            the triangles of each triList for the post-transform vertex
+            cache and to reduce overdraw, and the vertices for sequential
+            fetch.  Changes only the order of the triangles and vertices,
+            not the surface.  Invoke before updateAll.
+
+            \sa MeshAlg::optimizeVertexCache, MeshAlg::optimizeOverdraw,
+            MeshAlg::optimizeVertexFetch, Preprocess::optimize
+
+            \param overdrawThreshold See MeshAlg::optimizeOverdraw */
+        void optimize(const ArticulatedModel::Settings& settings, float overdrawThreshold = 1.05f);
+
         /** When geometry or texCoordArray is changed, invoke to
             update (or allocate for the first time) the VertexRange data.  You
             should either call updateNormals first, or write your own
@@ -403,6 +470,10 @@ public:
           <b>mergeByMaterial();</b>
             For each triList, merge all other triLists (of all parts) that have 
             the same material into it.
+
+          <b>optimize( [parts] );</b>
+            Reorder the triangles and vertices of the parts (default: all parts)
+            for rendering speed.  See Part::optimize.
         </pre>
     */
     class Operation : public ReferenceCountedObject {
@@ -486,6 +557,15 @@ public:
         static Ref create(const Any& any);
     };
 
+    /** Invokes Part::optimize on whole parts. */
+    class OptimizeOperation : public TriListOperation {
+    protected:
+        virtual void process(ArticulatedModel::Ref model, int partIndex, Part& part);
+    public:
+        typedef ReferenceCountedPointer<OptimizeOperation> Ref;
+        static Ref create(const Any& any);
+    };
+
     /** Transforms the geometry, but not the cframe or the sub-parts. */
     class TransformOperation : public Operation {
     protected:
@@ -563,19 +643,24 @@ public:
 
         /** Operations are performed after all other transformations during loading, except for replaceTwoSidedWithGeometry. */
         Array<Operation::Ref>         program;
+
+        /** If true, invoke Part::optimize on every part after the program
+            and replaceTwoSidedWithGeometry, for faster rendering.  This welds
+            the geometry an extra time while loading.  Default is <b>false</b>. */
+        bool                          optimize;
         
         Preprocess(const Any& any);
         operator Any() const;
 
-        inline Preprocess() : stripMaterials(false), xform(Matrix4::identity()), addBumpMaps(false), parallaxSteps(0), bumpMapScale(0.05f), normalMapWhiteHeightInPixels(-0.02f), replaceTwoSidedWithGeometry(false) {}
+        inline Preprocess() : stripMaterials(false), xform(Matrix4::identity()), addBumpMaps(false), parallaxSteps(0), bumpMapScale(0.05f), normalMapWhiteHeightInPixels(-0.02f), replaceTwoSidedWithGeometry(false), optimize(false) {}
 
-        explicit inline Preprocess(const Matrix4& m) : stripMaterials(false), xform(m), addBumpMaps(false), parallaxSteps(0), bumpMapScale(0.05f), normalMapWhiteHeightInPixels(-0.02f), replaceTwoSidedWithGeometry(false) {}
+        explicit inline Preprocess(const Matrix4& m) : stripMaterials(false), xform(m), addBumpMaps(false), parallaxSteps(0), bumpMapScale(0.05f), normalMapWhiteHeightInPixels(-0.02f), replaceTwoSidedWithGeometry(false), optimize(false) {}
 
         /** Initializes with a scale matrix */
-        explicit inline Preprocess(const Vector3& scale) : stripMaterials(false), xform(Matrix4::scale(scale)), addBumpMaps(false), parallaxSteps(0), bumpMapScale(0.05f), normalMapWhiteHeightInPixels(-0.02f), replaceTwoSidedWithGeometry(false) {}
+        explicit inline Preprocess(const Vector3& scale) : stripMaterials(false), xform(Matrix4::scale(scale)), addBumpMaps(false), parallaxSteps(0), bumpMapScale(0.05f), normalMapWhiteHeightInPixels(-0.02f), replaceTwoSidedWithGeometry(false), optimize(false) {}
  
         /** Initializes with a scale matrix */
-        explicit inline Preprocess(const float scale) : stripMaterials(false), xform(Matrix4::scale(scale)), addBumpMaps(false), parallaxSteps(0), bumpMapScale(0.05f), normalMapWhiteHeightInPixels(-0.02f), replaceTwoSidedWithGeometry(false) {}
+        explicit inline Preprocess(const float scale) : stripMaterials(false), xform(Matrix4::scale(scale)), addBumpMaps(false), parallaxSteps(0), bumpMapScale(0.05f), normalMapWhiteHeightInPixels(-0.02f), replaceTwoSidedWithGeometry(false), optimize(false) {}
     };
 
 
@@ -664,6 +749,18 @@ public:
         Array<Surface::Ref>&  posedModelArray,
         const CoordinateFrame&   cframe = CoordinateFrame(),
         const Pose&              pose = defaultPose());
+
+    /** Like the other pose(), but each part that has levels of detail
+        (see Settings::numLODLevels) is posed at the coarsest level whose
+        error covers at most \a maxPixelError pixels as seen by \a camera.
+        Use this for crowds of distant models. */
+    void pose(
+        Array<Surface::Ref>&     posedModelArray,
+        const CoordinateFrame&   cframe,
+        const Pose&              pose,
+        const GCamera&           camera,
+        const Rect2D&            viewport,
+        float                    maxPixelError = 1.0f);
   
 
     /** Converts a part name to an index.  Returns -1 if the part name is not found.*/
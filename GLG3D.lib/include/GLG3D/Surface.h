@@ -177,6 +177,49 @@ public:
     /** Computes the array of models that can be seen by @a camera*/
     static void cull(const class GCamera& camera, const class Rect2D& viewport, const Array<Surface::Ref>& allModels, Array<Surface::Ref>& outModels);
 
+    /** 
+      Computes the array of models that can be seen by @a camera by
+      culling their world-space bounding boxes with @a hierarchy, which
+      the caller keeps from frame to frame.  This is much faster than
+      the other cull() for scenes with thousands of surfaces.
+
+      Leaf <i>i</i> of @a hierarchy holds <code>allModels[i]</code>.  When
+      the number of models differs from the size of @a hierarchy, the
+      hierarchy is rebuilt.  Otherwise, if @a updateBounds is true (the
+      default), every surface's world-space bounding box is recomputed
+      and passed to DynamicBVH::update(), which ignores unchanged boxes
+      and refits only the parts of the hierarchy above surfaces that
+      moved.  This gives correct results even when the surfaces are
+      re-posed into new objects every frame.
+
+      Pass false only when @a hierarchy is already current, such as
+      when the caller has called DynamicBVH::update() for every surface
+      that moved, or when culling the same surfaces again for another
+      camera.  That skips recomputing the boxes.
+
+      @a outModels is in the same order as @a allModels.
+     */
+    static void cull(const class GCamera& camera, const class Rect2D& viewport, const Array<Surface::Ref>& allModels, Array<Surface::Ref>& outModels,
+                     class DynamicBVH& hierarchy, bool updateBounds = true);
+
+    /** 
+      Adds the triangles of each of @a occluders to @a occlusion for the
+      next OcclusionBuffer::render().  The geometry is referenced, not
+      copied, so the surfaces must not change until render() returns.
+      Choose large surfaces with few triangles, such as walls and
+      terrain, as occluders.
+     */
+    static void addOccluders(class OcclusionBuffer& occlusion, const Array<Surface::Ref>& occluders);
+
+    /** 
+      Removes from @a models the surfaces whose world-space bounding
+      boxes are hidden behind the occluders drawn by @a occlusion
+      (see OcclusionBuffer::occluded), preserving the order of the
+      rest.  Call after cull() so that only surfaces in the view
+      frustum are tested.
+     */
+    static void cullOccluded(const class OcclusionBuffer& occlusion, Array<Surface::Ref>& models);
+
     /** Object to world space coordinate frame.*/
     virtual void getCoordinateFrame(CoordinateFrame& c) const = 0;
 
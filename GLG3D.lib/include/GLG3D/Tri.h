@@ -42,6 +42,9 @@ private:
     // Intersector is declared below
     friend class Intersector;
 
+    // Uses the internal representation for packet intersection
+    friend class TriTree;
+
     // The size of the Tri class does not appear to significantly impact
     // the performance of ray tracing under the current kd tree implementation.
 
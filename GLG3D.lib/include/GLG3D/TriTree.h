@@ -19,6 +19,7 @@
 #include "G3D/SmallArray.h"
 #include "G3D/Intersect.h"
 #include "G3D/CollisionDetection.h"
+#include "G3D/GMutex.h"
 #include "GLG3D/Tri.h"
 #include "GLG3D/Component.h"
 #ifndef _MSC_VER
@@ -70,7 +71,16 @@ public:
             Theory indicates that this gives the highest performance
             for ray intersection, although that may not be the case
             for specific scenes and rays.*/
-        SAH};
+        SAH,
+
+        /** Approximate the Surface Area Heuristic by sorting triangle
+            centroids into Settings::numSAHBins equal-width bins along
+            each axis and only considering bin boundaries as splitting
+            planes.  Costs \f$O(n)\f$ per node, independent of
+            accurateSAHCountThreshold, and produces trees nearly as
+            good as SAH.  Recommended for large or frequently rebuilt
+            scenes.*/
+        BINNED_SAH};
 
     class Settings {
     public:
@@ -102,13 +112,29 @@ public:
             the fast method.*/
         int                accurateSAHCountThreshold;
 
+        /** Number of candidate splitting planes per axis considered by
+            BINNED_SAH.  Clamped to [2, MAX_SAH_BINS]. */
+        int                numSAHBins;
+
+        /** Nodes containing at least this many triangles build their
+            two children concurrently on TaskScheduler::global(), with
+            each worker allocating from its own AreaMemoryManager.
+
+            Set to <code>std::numeric_limits<int>::max()</code> to build
+            the entire tree on the calling thread.*/
+        int                parallelBuildThreshold;
+
         inline Settings() : 
             algorithm(MEAN_EXTENT), 
             maxAreaFraction(1.0f / 11.0f), 
             valuesPerLeaf(4),
-            accurateSAHCountThreshold(125) {}
+            accurateSAHCountThreshold(125),
+            numSAHBins(32),
+            parallelBuildThreshold(5000) {}
     };
 
+    enum {MAX_SAH_BINS = 64};
+
     static const char* algorithmName(SplitAlgorithm s);
 
     class Stats {
@@ -138,6 +164,18 @@ public:
                   depth(0), largestNode(0) {}
     };
 
+    /** Result of intersectRays() for one ray.  The inherited
+        Tri::Intersector members describe the hit, if any. */
+    class Hit : public Tri::Intersector {
+    public:
+        /** On input, the ray ignores intersections at or beyond this
+            distance.  On output, the distance to the closest hit if
+            there was one, otherwise unchanged.*/
+        float       distance;
+
+        Hit() : distance(finf()) {}
+    };
+
 private:
     /** A convex polygon formed by repeatedly clipping a Tri with axis-aligned planes */
     class Poly {
@@ -264,6 +302,18 @@ private:
         AABox            bounds;
     };
     
+    /** Up to four rays in structure-of-arrays form, defined in TriTree.cpp */
+    class RayPacket;
+
+    /** Tests every Tri in \a values against the rays of \a packet
+        whose bits are set in \a activeMask. */
+    static void __fastcall intersectValues
+    (RayPacket&          packet,
+     int                 activeMask,
+     const ValueArray&   values,
+     const Ray*          ray,
+     Hit*                hit);
+
     class Node {
     private:
         
@@ -312,7 +362,7 @@ private:
             
             Called from the constructor. */
         void split(Array<Poly>& original, const Settings& settings, 
-                   const MemoryManager::Ref& mm);
+                   const MemoryManager::Ref& mm, TriTree* tree);
 
         /** Called from the constructor to choose a splitting plane
             and axis. Assumes that this->bounds is already set. */
@@ -333,6 +383,8 @@ private:
 
         float chooseSAHSplitLocationFast(Array<Poly>& source, Vector3::Axis axis, const Settings& settings);
 
+        float chooseSAHSplitLocationBinned(const Array<Poly>& source, Vector3::Axis axis, const Settings& settings);
+
         /** The SAHCost of tracing against just this array. */
         static float SAHCost(int size, float area, float containingArea);
 
@@ -345,10 +397,15 @@ private:
           TODO: Why does the algorithm use full counts to
           penalize the cost, since we expect to only have to
           intersect log(n) triangles on each side?
+
+          \param lowArray, highArray, spanArray Scratch space, passed
+          in so that concurrent builds do not share storage.
         */
         static float SAHCost(Vector3::Axis axis, float offset,
                              const Array<Poly>& original, float containingArea, 
-                             const Settings& settings);
+                             const Settings& settings,
+                             Array<Poly>& lowArray, Array<Poly>& highArray,
+                             Array<Poly>& spanArray);
 
         /** Called from intersect to determine which child the ray hits first.
 
@@ -397,8 +454,10 @@ private:
 
     public:
 
+        /** \param tree Supplies memory managers for children that are
+            built on other threads. */
         Node(Array<Poly>& originals, const Settings& settings, 
-             const MemoryManager::Ref& mm);
+             const MemoryManager::Ref& mm, TriTree* tree);
 
         /** Call in lieu of delete to remove children.  Caller must
             free the Node itself.*/
@@ -414,11 +473,35 @@ private:
         (const Ray&      ray,
          Tri::Intersector& intersectCallback, 
          float&          distance) const;
+
+        /** Packet version of intersectRay.  Only the rays whose bits
+            are set in \a activeMask are traced.*/
+        void __fastcall intersectRays
+        (RayPacket&      packet,
+         int             activeMask,
+         const Ray*      ray,
+         Hit*            hit) const;
     };
 
+
+    /** Builds one child Node on a TaskScheduler worker */
+    class NodeBuildTask;
+
     /** Memory manager used to allocate Nodes and Tri arrays. */
     MemoryManager::Ref   m_memoryManager;
 
+    /** Additional AreaMemoryManagers used by subtrees that were built
+        concurrently.  AreaMemoryManager::free is a no-op, so Nodes in
+        these areas may be passed to m_memoryManager during destroy();
+        the memory is released when the managers are dropped in clear().*/
+    Array<MemoryManager::Ref> m_workerMemoryManager;
+
+    /** Protects m_workerMemoryManager during setContents */
+    GMutex               m_workerMemoryManagerLock;
+
+    /** Creates and retains a memory manager for a concurrently built subtree.  Threadsafe. */
+    MemoryManager::Ref createWorkerMemoryManager(size_t sizeHint);
+
     /** Allocated with m_memoryManager */
     Node*                m_root;
 
@@ -480,6 +563,26 @@ public:
      Tri::Intersector& intersectCallback, 
      float& distance) const;
 
+    /** Intersects \a n rays with the tree, storing the closest hit for
+        <code>ray[i]</code> in <code>hit[i]</code>.  Returns the number
+        of rays that hit something closer than their initial
+        Hit::distance.
+
+        Rays are traced in groups of four using SSE, sharing one
+        traversal of the tree, so this is fastest when consecutive rays
+        are coherent---e.g., primary rays ordered by 2x2 pixel
+        blocks or shadow rays towards a single light.  On platforms
+        without SSE this is equivalent to calling intersectRay for
+        each ray.
+
+        <pre>
+           Array<TriTree::Hit> hit;
+           hit.resize(ray.size());
+           tree.intersectRays(ray.getCArray(), ray.size(), hit.getCArray());
+        </pre>
+     */
+    int intersectRays(const Ray* ray, int n, Hit* hit) const;
+
     /** Render the tree for debugging and visualization purposes. 
         Inefficent.
 
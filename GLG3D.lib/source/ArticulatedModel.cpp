@@ -64,6 +64,8 @@ ArticulatedModel::Preprocess::Preprocess(const Any& any) {
             addBumpMaps = it->value.boolean();
         } else if (key == "replacetwosidedwithgeometry") {
             replaceTwoSidedWithGeometry = it->value.boolean();
+        } else if (key == "optimize") {
+            optimize = it->value.boolean();
         } else if (key == "xform") {
             xform = it->value;
         } else if (key == "parallaxsteps") {
@@ -100,6 +102,7 @@ ArticulatedModel::Preprocess::operator Any() const {
     a.set("bumpMapScale", bumpMapScale);
     a.set("normalMapWhiteHeightInPixels", normalMapWhiteHeightInPixels);
     a.set("replaceTwoSidedWithGeometry", replaceTwoSidedWithGeometry);
+    a.set("optimize", optimize);
     //a["materialSubstitution"] = materialSubstitution
 
     return a;
@@ -114,6 +117,10 @@ ArticulatedModel::Settings::Settings(const Any& any) {
         const std::string& key = toLower(it->key);
         if (key == "weld") {
             weld = it->value;
+        } else if (key == "numlodlevels") {
+            numLODLevels = it->value;
+        } else if (key == "lodreduction") {
+            lodReduction = it->value;
         } else {
             any.verify(false, "Illegal key: " + it->key);
         }
@@ -123,6 +130,8 @@ ArticulatedModel::Settings::Settings(const Any& any) {
 ArticulatedModel::Settings::operator Any() const {
     Any a(Any::TABLE, "ArticulatedModel::Settings");
     a.set("weld", weld);
+    a.set("numLODLevels", numLODLevels);
+    a.set("lodReduction", lodReduction);
     return a;
 }
 //////////////////////////////////////////////////////////
@@ -246,6 +255,12 @@ ArticulatedModel::Ref ArticulatedModel::fromFile(const std::string& filename, co
         model->replaceTwoSidedWithGeometry();
     }
 
+    if (preprocess.optimize) {
+        for (int p = 0; p < model->partArray.size(); ++p) {
+            model->partArray[p].optimize(model->settings());
+        }
+    }
+
     model->updateAll();
 
     return model;
@@ -692,7 +707,7 @@ void ArticulatedModel::Part::computeNormalsAndTangentSpace
     }
 
     Array<MeshAlg::Face>    faceArray;
-    Array<MeshAlg::Vertex>  vertexArray;
+    MeshAlg::CompactVertexArray vertexArray;
     Array<MeshAlg::Edge>    edgeArray;
     Array<Vector3>          faceNormalArray;
 
@@ -749,6 +764,15 @@ void ArticulatedModel::Part::updateVAR(VertexBuffer::UsageHint hint) {
             triList[i]->updateVAR(hint, vertexVAR, normalVAR, packedTangentVAR, texCoord0VAR);
         }
     }
+
+    for (int L = 0; L < lodArray.size(); ++L) {
+        const Array<TriList::Ref>& lodTriList = lodArray[L].triList;
+        for (int i = 0; i < lodTriList.size(); ++i) {
+            if (lodTriList[i].notNull()) {
+                lodTriList[i]->updateVAR(hint, vertexVAR, normalVAR, packedTangentVAR, texCoord0VAR);
+            }
+        }
+    }
 }
 
 
@@ -758,6 +782,131 @@ void ArticulatedModel::Part::computeBounds() {
             triList[t]->computeBounds(*this);
         }
     }
+
+    for (int L = 0; L < lodArray.size(); ++L) {
+        const Array<TriList::Ref>& lodTriList = lodArray[L].triList;
+        for (int t = 0; t < lodTriList.size(); ++t) {
+            if (lodTriList[t].notNull()) {
+                lodTriList[t]->computeBounds(*this);
+            }
+        }
+    }
+}
+
+
+void ArticulatedModel::Part::computeLOD(const ArticulatedModel::Settings& settings) {
+    lodArray.clear();
+
+    if ((settings.numLODLevels <= 0) || (geometry.vertexArray.size() == 0)) {
+        return;
+    }
+
+    int numFaces = 0;
+    for (int t = 0; t < triList.size(); ++t) {
+        if (triList[t].notNull() && (triList[t]->primitive == PrimitiveType::TRIANGLES)) {
+            numFaces += triList[t]->indexArray.size() / 3;
+        }
+    }
+
+    // Each level is simplified from the previous one, so that the
+    // errors increase and the work decreases geometrically
+    Array<TriList::Ref> previous = triList;
+    for (int L = 0; L < settings.numLODLevels; ++L) {
+        const int targetNumFaces = iFloor(numFaces * settings.lodReduction);
+
+        Array<TriList::Ref> level;
+        Array<Array<int>*> indexArrayArray;
+        level.resize(previous.size());
+        indexArrayArray.resize(previous.size());
+        for (int t = 0; t < previous.size(); ++t) {
+            indexArrayArray[t] = NULL;
+            if (previous[t].notNull()) {
+                TriList* src = previous[t].pointer();
+                TriList* dst = new TriList();
+                dst->primitive  = src->primitive;
+                dst->twoSided   = src->twoSided;
+                dst->material   = src->material;
+                dst->indexArray = src->indexArray;
+                level[t] = dst;
+
+                if (dst->primitive == PrimitiveType::TRIANGLES) {
+                    indexArrayArray[t] = &(dst->indexArray);
+                }
+            }
+        }
+
+        float error = 0.0f;
+        MeshAlg::simplify(geometry, texCoordArray, indexArrayArray, targetNumFaces, error, finf(), settings.weld);
+
+        int newNumFaces = 0;
+        for (int t = 0; t < indexArrayArray.size(); ++t) {
+            if (indexArrayArray[t] != NULL) {
+                newNumFaces += indexArrayArray[t]->size() / 3;
+            }
+        }
+
+        if (newNumFaces == numFaces) {
+            // Seams and borders prevent further simplification
+            break;
+        }
+
+        // The error was measured against the previous level, so the sum
+        // bounds the distance to the full resolution surface
+        const float previousError = (L > 0) ? lodArray[L - 1].error : 0.0f;
+        LOD& lod = lodArray.next();
+        lod.error = previousError + error;
+        lod.triList = level;
+
+        previous = level;
+        numFaces = newNumFaces;
+    }
+}
+
+
+int ArticulatedModel::Part::chooseLOD
+   (const CoordinateFrame&  frame,
+    const GCamera&          camera,
+    const Rect2D&           viewport,
+    float                   maxPixelError) const {
+
+    if (lodArray.size() == 0) {
+        return -1;
+    }
+
+    AABox box;
+    bool first = true;
+    for (int t = 0; t < triList.size(); ++t) {
+        if (triList[t].notNull() && (triList[t]->indexArray.size() > 0)) {
+            if (first) {
+                box = triList[t]->boxBounds;
+                first = false;
+            } else {
+                box.merge(triList[t]->boxBounds);
+            }
+        }
+    }
+    if (first) {
+        return -1;
+    }
+
+    Sphere sphere;
+    box.getBounds(sphere);
+
+    // Camera-space depth of the nearest point of the bounds
+    const Vector3& center = camera.coordinateFrame().pointToObjectSpace(frame.pointToWorldSpace(sphere.center));
+    const float z = center.z + sphere.radius;
+
+    int best = -1;
+    for (int L = 0; L < lodArray.size(); ++L) {
+        const float pixelArea = camera.worldToScreenSpaceArea(square(lodArray[L].error), z, viewport);
+        if (pixelArea <= square(maxPixelError)) {
+            best = L;
+        } else {
+            break;
+        }
+    }
+
+    return best;
 }
 
 /** Used by ArticulatedModel::updateAll */
@@ -787,6 +936,7 @@ public:
         for (int i = m_startIndex; i <= m_endIndex; ++i) {
             ArticulatedModel::Part* part = m_partArray[i];
             part->computeNormalsAndTangentSpace(m_settings);
+            part->computeLOD(m_settings);
             part->computeBounds();
             debugAssert(part->geometry.normalArray.size() ==
                         part->geometry.vertexArray.size());
@@ -805,6 +955,7 @@ void ArticulatedModel::updateAll() {
         } else {
             // Cheap to update this part right here, since it has nothing in it
             part->computeNormalsAndTangentSpace(m_settings);
+            part->computeLOD(m_settings);
             part->computeBounds();
             part->updateVAR();
         }
@@ -931,6 +1082,68 @@ void ArticulatedModel::Part::computeIndexArray() {
 }
 
 
+/** Returns the array with element i taken from src[toOld[i]] */
+template<class T>
+static Array<T> permute(const Array<T>& src, const Array<int>& toOld) {
+    Array<T> dst;
+    dst.resize(toOld.size());
+    for (int i = 0; i < toOld.size(); ++i) {
+        dst[i] = src[toOld[i]];
+    }
+    return dst;
+}
+
+
+void ArticulatedModel::Part::optimize(const ArticulatedModel::Settings& settings, float overdrawThreshold) {
+    if (geometry.vertexArray.size() == 0) {
+        return;
+    }
+
+    Array<Array<int>*> indexArrayArray;
+    indexArrayArray.resize(triList.size());
+    for (int t = 0; t < triList.size(); ++t) {
+        if (triList[t].notNull()) {
+            indexArrayArray[t] = &(triList[t]->indexArray);
+        } else {
+            indexArrayArray[t] = NULL;
+        }
+    }
+
+    // Unindexed input shares no vertices, so weld before reordering.
+    // updateAll welds again, which preserves the order computed here.
+    Welder::weld(geometry.vertexArray,
+                 texCoordArray,
+                 geometry.normalArray,
+                 indexArrayArray,
+                 settings.weld);
+
+    const int numVertices = geometry.vertexArray.size();
+    for (int t = 0; t < triList.size(); ++t) {
+        if (triList[t].notNull() && (triList[t]->primitive == PrimitiveType::TRIANGLES)) {
+            Array<int>& index = triList[t]->indexArray;
+            MeshAlg::optimizeVertexCache(index, numVertices);
+            MeshAlg::optimizeOverdraw(geometry.vertexArray, index, overdrawThreshold);
+        }
+    }
+
+    Array<int> toNew, toOld;
+    MeshAlg::optimizeVertexFetch(indexArrayArray, numVertices, toNew, toOld);
+
+    geometry.vertexArray = permute(geometry.vertexArray, toOld);
+    if (geometry.normalArray.size() == numVertices) {
+        geometry.normalArray = permute(geometry.normalArray, toOld);
+    }
+    if (texCoordArray.size() == numVertices) {
+        texCoordArray = permute(texCoordArray, toOld);
+    }
+    if (packedTangentArray.size() == numVertices) {
+        packedTangentArray = permute(packedTangentArray, toOld);
+    }
+
+    computeIndexArray();
+}
+
+
 static void addRect(const Vector3& v0, const Vector3& v1, 
                     const Vector3& v2, const Vector3& v3, 
                     Array<Vector3>& vertexArray, 
@@ -1058,12 +1271,32 @@ void ArticulatedModel::pose(
 }
 
 
+void ArticulatedModel::pose(
+    Array<Surface::Ref>&     posedArray, 
+    const CoordinateFrame&      cframe, 
+    const Pose&                 posex,
+    const GCamera&              camera,
+    const Rect2D&               viewport,
+    float                       maxPixelError) {
+
+    for (int p = 0; p < partArray.size(); ++p) {
+        const Part& part = partArray[p];
+        if (part.parent == -1) {
+            part.pose(this, p, posedArray, cframe, posex, &camera, viewport, maxPixelError);
+        }
+    }
+}
+
+
 void ArticulatedModel::Part::pose
     (const ArticulatedModel::Ref&      model,
      int                               partIndex,
      Array<Surface::Ref>&              posedArray,
      const CoordinateFrame&            parent, 
-     const Pose&                       posex) const {
+     const Pose&                       posex,
+     const GCamera*                    camera,
+     const Rect2D&                     viewport,
+     float                             maxPixelError) const {
 
     CoordinateFrame frame;
 
@@ -1078,12 +1311,15 @@ void ArticulatedModel::Part::pose
 
     if (hasGeometry()) {
 
-        for (int t = 0; t < triList.size(); ++t) {
-            if (triList[t].notNull() && (triList[t]->indexArray.size() > 0)) {
-                SuperSurface::CPUGeom cpuGeom(&triList[t]->indexArray, &geometry, 
+        const int L = (camera != NULL) ? chooseLOD(frame, *camera, viewport, maxPixelError) : -1;
+        const Array<TriList::Ref>& lodTriList = (L == -1) ? triList : lodArray[L].triList;
+
+        for (int t = 0; t < lodTriList.size(); ++t) {
+            if (lodTriList[t].notNull() && (lodTriList[t]->indexArray.size() > 0)) {
+                SuperSurface::CPUGeom cpuGeom(&lodTriList[t]->indexArray, &geometry, 
                                               &texCoordArray, &packedTangentArray);
 
-                posedArray.append(SuperSurface::create(model->name, frame, triList[t],
+                posedArray.append(SuperSurface::create(model->name, frame, lodTriList[t],
                                                             cpuGeom, model));
             }
         }
@@ -1095,7 +1331,7 @@ void ArticulatedModel::Part::pose
         debugAssertM(model->partArray[p].parent == partIndex,
             "Parent and child pointers do not match.");(void)partIndex;
 
-        model->partArray[p].pose(model, p, posedArray, frame, posex);
+        model->partArray[p].pose(model, p, posedArray, frame, posex, camera, viewport, maxPixelError);
     }
 }
 
@@ -194,6 +194,14 @@ static Vector3 readVertex(TextInput& ti, const Matrix4& xform) {
 }
 
 
+/** Throws unless \a token is the symbol "/" separating the indices of a face vertex */
+static void readSlash(const TextInput& ti, const TokenView& token) {
+    if (! token.equals("/")) {
+        throw TextInput::WrongSymbol(ti.filename(), token.line(), token.character(), "/", token.string());
+    }
+}
+
+
 static Vector3 readNormal(TextInput& ti, const Matrix3& normalXform) {
     Vector3 n;
     n.x = ti.readNumber();
@@ -267,28 +275,35 @@ void ArticulatedModel::initOBJ(const std::string& filename, const Preprocess& pr
     const std::string& basePath = FilePath::parent(FileSystem::resolve(filename));
 
     {
+        // OBJ files are large, so this loop reads TokenViews instead of
+        // Tokens and never peeks, which avoids copying each token.
         TextInput ti(filename, set);
-        while (ti.hasMore()) {
+        while (true) {
             // Consume comments/newlines
-            while (ti.hasMore() && (ti.peek().type() == Token::NEWLINE)) {
-                // Consume the newline
-                ti.read();
+            TokenView cmd = ti.readView();
+            while (cmd.type() == Token::NEWLINE) {
+                cmd = ti.readView();
             }
 
-            if (! ti.hasMore()) {
+            if (cmd.type() == Token::END) {
                 break;
             }
 
-            // Process one line
-            const std::string& cmd = ti.readSymbol();
+            if (cmd.type() != Token::SYMBOL) {
+                throw TextInput::WrongTokenType(ti.filename(), cmd.line(), cmd.character(), Token::SYMBOL, cmd.type());
+            }
 
-            if (cmd == "mtllib") {
+            // True once the newline ending this line has been read
+            bool lineDone = false;
+
+            // Process one line.  The text of cmd is only valid until the next read.
+            if (cmd.equals("mtllib")) {
 
                 // Specify material library 
                 const std::string& mtlFilename = ti.readUntilNewlineAsString();
                 loadMTL(FilePath::concat(basePath, mtlFilename), materialLibrary, preprocess);
 
-            } else if (cmd == "g") {
+            } else if (cmd.equals("g")) {
 
                 // New trilist
                 const std::string& name = ti.readUntilNewlineAsString();
@@ -301,28 +316,32 @@ void ArticulatedModel::initOBJ(const std::string& filename, const Preprocess& pr
                 }
 
 
-            } else if (cmd == "usemtl") {
+            } else if (cmd.equals("usemtl")) {
                 if (currentTriList) {
                     currentTriList->materialName = ti.readUntilNewlineAsString();
                 }
-            } else if (cmd == "v") {
+            } else if (cmd.equals("v")) {
                 rawVertex.append(readVertex(ti, preprocess.xform));
-            } else if (cmd == "vt") {
+            } else if (cmd.equals("vt")) {
                 // Texcoord
                 Vector2& t = rawTexCoord.next();
                 t.x = ti.readNumber();
                 t.y = 1.0f - ti.readNumber();
-            } else if (cmd == "vn") {
+            } else if (cmd.equals("vn")) {
                 // Normal
                 rawNormal.append(readNormal(ti, normalXform));
-            } else if ((cmd == "f") && currentTriList) {
+            } else if (cmd.equals("f") && currentTriList) {
                 // Face
 
                 // Read each vertex
-                while (ti.hasMore() && (ti.peek().type() != Token::NEWLINE)) {
+                TokenView token = ti.readView();
+                while ((token.type() != Token::NEWLINE) && (token.type() != Token::END)) {
 
                     // Read one 3-part index
-                    int v = ti.readNumber();
+                    if (token.type() != Token::NUMBER) {
+                        throw TextInput::WrongTokenType(ti.filename(), token.line(), token.character(), Token::NUMBER, token.type());
+                    }
+                    int v = (int)token.number();
                     if (v < 0) {
                         v = rawVertex.size() + 1 + v;
                     }
@@ -330,21 +349,26 @@ void ArticulatedModel::initOBJ(const std::string& filename, const Preprocess& pr
                     int n = 0;
                     int t = 0;
 
-                    if (ti.peek().type() == Token::SYMBOL) {
-                        ti.readSymbol("/");
-                        if (ti.peek().type() == Token::NUMBER) {
-                            t = ti.readNumber();
+                    token = ti.readView();
+                    if (token.type() == Token::SYMBOL) {
+                        readSlash(ti, token);
+                        token = ti.readView();
+                        if (token.type() == Token::NUMBER) {
+                            t = (int)token.number();
                             if (t < 0) {
                                 t = rawTexCoord.size() + 1 + t;
                             }
+                            token = ti.readView();
                         }
-                        if (ti.peek().type() == Token::SYMBOL) {
-                            ti.readSymbol("/");
-                            if (ti.peek().type() == Token::NUMBER) {
-                                n = ti.readNumber();
+                        if (token.type() == Token::SYMBOL) {
+                            readSlash(ti, token);
+                            token = ti.readView();
+                            if (token.type() == Token::NUMBER) {
+                                n = (int)token.number();
                                 if (n < 0) {
                                     n = rawNormal.size() + 1 + n;
                                 }
+                                token = ti.readView();
                             }
                         }
                     }
@@ -381,11 +405,16 @@ void ArticulatedModel::initOBJ(const std::string& filename, const Preprocess& pr
                 } 
 
                 faceTempIndex.fastClear();
-
+                lineDone = true;
             }
 
             // Read until the end of the line
-            while (ti.hasMore() && (ti.read().type() != Token::NEWLINE));
+            if (! lineDone) {
+                Token::Type type;
+                do {
+                    type = ti.readView().type();
+                } while ((type != Token::NEWLINE) && (type != Token::END));
+            }
         }
     }
 
@@ -46,6 +46,8 @@ ArticulatedModel::Operation::Ref ArticulatedModel::Operation::create(const Any&
         return SetCFrameOperation::create(any);
     } else if (any.nameEquals("mergeByMaterial")) {
         return MergeByMaterialOperation::create(any);
+    } else if (any.nameEquals("optimize")) {
+        return OptimizeOperation::create(any);
     } else {
         any.verify(false, "Unrecognized operation type: " + any.name());
         return NULL;
@@ -223,6 +225,22 @@ void ArticulatedModel::SetTwoSidedOperation::process(ArticulatedModel::Ref model
 
 ////////////////////////////////////////////////////////////////////////
 
+ArticulatedModel::OptimizeOperation::Ref ArticulatedModel::OptimizeOperation::create(const Any& any) {
+    any.verifyName("optimize");
+    any.verify(any.size() <= 1, "optimize applies to whole parts and takes at most one argument");
+
+    Ref op = new OptimizeOperation();
+    op->parseTarget(any, 0);
+    return op;
+}
+
+
+void ArticulatedModel::OptimizeOperation::process(ArticulatedModel::Ref model, int, Part& part) {
+    part.optimize(model->settings());
+}
+
+////////////////////////////////////////////////////////////////////////
+
 ArticulatedModel::SetMaterialOperation::Ref ArticulatedModel::SetMaterialOperation::create(const Any& any) {
     any.verifyName("setMaterial");
     any.verify(any.size() <= 3, "Cannot take more than three arguments");
@@ -15,6 +15,8 @@
 #include "G3D/debugPrintf.h"
 #include "G3D/Log.h"
 #include "G3D/AABox.h"
+#include "G3D/DynamicBVH.h"
+#include "G3D/OcclusionBuffer.h"
 #include "G3D/Sphere.h"
 #include "GLG3D/Surface.h"
 #include "GLG3D/RenderDevice.h"
@@ -71,6 +73,71 @@ void Surface::cull(const GCamera& camera, const Rect2D& viewport, const Array<Su
 }
 
 
+void Surface::cull
+(const GCamera&               camera,
+ const Rect2D&                viewport,
+ const Array<Surface::Ref>&   allModels,
+ Array<Surface::Ref>&         outModels,
+ DynamicBVH&                  hierarchy,
+ bool                         updateBounds) {
+
+    outModels.fastClear();
+
+    AABox box;
+    if (hierarchy.size() != allModels.size()) {
+        // Handles are assigned in order after clear(), so leaf i is allModels[i]
+        hierarchy.clear();
+        for (int i = 0; i < allModels.size(); ++i) {
+            allModels[i]->getWorldSpaceBoundingBox(box);
+            hierarchy.insert(box, i);
+        }
+    } else if (updateBounds) {
+        for (int i = 0; i < allModels.size(); ++i) {
+            allModels[i]->getWorldSpaceBoundingBox(box);
+            hierarchy.update(i, box);
+        }
+    }
+
+    Array<Plane> clipPlanes;
+    camera.getClipPlanes(viewport, clipPlanes);
+
+    Array<int> visible;
+    hierarchy.cull(clipPlanes, visible);
+    visible.sort();
+
+    outModels.resize(visible.size());
+    for (int i = 0; i < visible.size(); ++i) {
+        outModels[i] = allModels[visible[i]];
+    }
+}
+
+
+void Surface::addOccluders(OcclusionBuffer& occlusion, const Array<Surface::Ref>& occluders) {
+    CoordinateFrame cframe;
+    for (int i = 0; i < occluders.size(); ++i) {
+        const Surface::Ref& surface = occluders[i];
+        surface->getCoordinateFrame(cframe);
+        occlusion.addOccluder(cframe, surface->objectSpaceGeometry(), surface->triangleIndices());
+    }
+}
+
+
+void Surface::cullOccluded(const OcclusionBuffer& occlusion, Array<Surface::Ref>& models) {
+    AABox box;
+    int n = 0;
+    for (int i = 0; i < models.size(); ++i) {
+        models[i]->getWorldSpaceBoundingBox(box);
+        if (! occlusion.occluded(box)) {
+            if (n != i) {
+                models[n] = models[i];
+            }
+            ++n;
+        }
+    }
+    models.resize(n, DONT_SHRINK_UNDERLYING_ARRAY);
+}
+
+
 void Surface::renderDepthOnly
 (RenderDevice* rd, 
  const Array<Surface::Ref>& allModels, 
@@ -160,6 +227,11 @@ void Surface::sortAndRender
 
     Lighting::Ref lighting = _lighting->clone();
 
+    // Built by the first cull with shadows and shared by the shadow map
+    // and camera culls, which all see the same surfaces, so none of
+    // them needs to update its bounds
+    DynamicBVH hierarchy;
+
     bool renderShadows =
         (shadowMaps.size() > 0) && 
         (lighting->shadowedLightArray.size() > 0) && 
@@ -189,7 +261,7 @@ void Surface::sortAndRender
 
             ShadowMap::computeMatrices(light, sceneBounds, lightFrame, lightProjectionMatrix);
 
-            Surface::cull(lightFrame, shadowMaps[L]->rect2DBounds(), allModels, lightVisible);
+            Surface::cull(lightFrame, shadowMaps[L]->rect2DBounds(), allModels, lightVisible, hierarchy, false);
             Surface::sortFrontToBack(lightVisible, lightFrame.coordinateFrame().lookVector());
             shadowMaps[L]->updateDepth(rd, lightFrame.coordinateFrame(), lightProjectionMatrix, lightVisible);
 
@@ -205,8 +277,13 @@ void Surface::sortAndRender
     // All objects visible to the camera; gets stripped down to opaque non-super
     static Array<Surface::Ref> visible;
 
-    // Cull objects outside the view frustum
-    cull(camera, rd->viewport(), allModels, visible);
+    // Cull objects outside the view frustum.  A single cull is cheaper
+    // without building a hierarchy.
+    if (renderShadows) {
+        cull(camera, rd->viewport(), allModels, visible, hierarchy, false);
+    } else {
+        cull(camera, rd->viewport(), allModels, visible);
+    }
 
     rd->pushState();
 
@@ -7,7 +7,15 @@
   @edited  2010-06-20
 */
 
+#include "G3D/platform.h"
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 1))
+    // Packet traversal
+#   define G3D_TRITREE_SSE
+#   include <xmmintrin.h>
+#endif
+
 #include "G3D/AreaMemoryManager.h"
+#include "G3D/TaskScheduler.h"
 #include "GLG3D/TriTree.h"
 #include "GLG3D/RenderDevice.h"
 #include "GLG3D/Draw.h"
@@ -16,11 +24,39 @@
 namespace G3D {
 
 const char* TriTree::algorithmName(SplitAlgorithm s) {
-    const char* n[] = {"Mean extent", "Median area", "Median count", "SAH"};
+    const char* n[] = {"Mean extent", "Median area", "Median count", "SAH", "Binned SAH"};
     return n[s];
 }
 
 
+class TriTree::NodeBuildTask : public Task {
+public:
+    Node*                   node;
+    Array<Poly>*            source;
+    const Settings*         settings;
+    MemoryManager::Ref      memoryManager;
+    TriTree*                tree;
+
+    NodeBuildTask(Node* n, Array<Poly>& src, const Settings& s, TriTree* t) :
+        node(n), source(&src), settings(&s), 
+        // Generous estimate of the nodes and value arrays for the subtree
+        memoryManager(t->createWorkerMemoryManager(iMax(64 * 1024, src.size() * 64))),
+        tree(t) {}
+
+    virtual void run() {
+        new (node) Node(*source, *settings, memoryManager, tree);
+    }
+};
+
+
+MemoryManager::Ref TriTree::createWorkerMemoryManager(size_t sizeHint) {
+    MemoryManager::Ref mm = AreaMemoryManager::create(sizeHint);
+    GMutexLock lock(&m_workerMemoryManagerLock);
+    m_workerMemoryManager.append(mm);
+    return mm;
+}
+
+
 void TriTree::setContents(const Array<Surface::Ref>& surfaceArray, ImageStorage newStorage, const Settings& settings) {
     Array<Tri> triArray;
 
@@ -88,7 +124,7 @@ bool TriTree::Node::badSplit(int numOriginalSources, int numLow, int numHigh) {
 }
 
 
-void TriTree::Node::split(Array<Poly>& original, const Settings& settings, const MemoryManager::Ref& mm) {
+void TriTree::Node::split(Array<Poly>& original, const Settings& settings, const MemoryManager::Ref& mm, TriTree* tree) {
     // Order in which we'd like to split along axes
     Vector3::Axis preferredAxis[3];
     const Vector3& extent = bounds.extent();
@@ -137,8 +173,20 @@ void TriTree::Node::split(Array<Poly>& original, const Settings& settings, const
                           format("Pointer is not a multiple of four bytes: %d", (int)(long)ptr));
             packedChildAxis = reinterpret_cast<uintptr_t>(ptr) | static_cast<uintptr_t>(axis);
 
-            new (ptr) Node(lowArray, settings, mm);
-            new (ptr + 1) Node(highArray, settings, mm);
+            if ((original.size() >= settings.parallelBuildThreshold) && 
+                (TaskScheduler::global()->numWorkers() > 0)) {
+                // Build the high side on another thread.  It gets its
+                // own memory manager because AreaMemoryManager is not
+                // threadsafe; this thread keeps using mm for the low side.
+                NodeBuildTask highTask(ptr + 1, highArray, settings, tree);
+                TaskGroup group;
+                group.run(&highTask);
+                new (ptr) Node(lowArray, settings, mm, tree);
+                group.wait();
+            } else {
+                new (ptr) Node(lowArray, settings, mm, tree);
+                new (ptr + 1) Node(highArray, settings, mm, tree);
+            }
             return;
         }
     }
@@ -178,6 +226,9 @@ float TriTree::Node::chooseSplitLocation(Array<Poly>& source, const Settings& se
         
     case SAH:
         return chooseSAHSplitLocation(source, axis, settings);
+
+    case BINNED_SAH:
+        return chooseSAHSplitLocationBinned(source, axis, settings);
         
     default:
         alwaysAssertM(false, "Fell through switch");
@@ -323,11 +374,12 @@ float TriTree::Node::chooseSAHSplitLocationAccurate(Array<Poly>& source, Vector3
     positionSet.getMembers(position);
     positionSet.clear();
     
+    Array<Poly> lowArray, highArray, spanArray;
     int lowestCostIndex = 0;
     float lowestCost = inf();
     //debugPrintf("\nChoosing split:\n");
     for (int i = 0; i < position.size(); ++i) {
-        float cost = SAHCost(axis, position[i], source, bounds.area(), settings);
+        float cost = SAHCost(axis, position[i], source, bounds.area(), settings, lowArray, highArray, spanArray);
         //debugPrintf("  pos = %f, cost = %f\n", position[i], cost);
         if (cost < lowestCost) {
             lowestCost = cost;
@@ -339,6 +391,80 @@ float TriTree::Node::chooseSAHSplitLocationAccurate(Array<Poly>& source, Vector3
 }
 
 
+float TriTree::Node::chooseSAHSplitLocationBinned(const Array<Poly>& source, Vector3::Axis axis, const Settings& settings) {
+    const float lo = bounds.low()[axis];
+    const float hi = bounds.high()[axis];
+    if (! (hi > lo)) {
+        // Flat along this axis; any plane is as bad as any other
+        return bounds.center()[axis];
+    }
+
+    const int numBins = iClamp(settings.numSAHBins, 2, MAX_SAH_BINS);
+
+    // Bin the polys by the center of their bounds along the axis,
+    // tracking the count and bounds of each bin.
+    int     count[MAX_SAH_BINS];
+    Vector3 binLow[MAX_SAH_BINS];
+    Vector3 binHigh[MAX_SAH_BINS];
+    for (int b = 0; b < numBins; ++b) {
+        count[b]   = 0;
+        binLow[b]  = Vector3::inf();
+        binHigh[b] = -Vector3::inf();
+    }
+
+    const float binsPerUnit = numBins / (hi - lo);
+    for (int i = 0; i < source.size(); ++i) {
+        const Poly& p = source[i];
+        const float c = (p.low()[axis] + p.high()[axis]) * 0.5f;
+        const int b = iClamp(iFloor((c - lo) * binsPerUnit), 0, numBins - 1);
+        ++count[b];
+        binLow[b]  = binLow[b].min(p.low());
+        binHigh[b] = binHigh[b].max(p.high());
+    }
+
+    // Sweep from above for the cost of everything above each bin boundary.
+    // highCost[b] is the cost of bins b + 1 ... numBins - 1.
+    const float containingArea = bounds.area();
+    float highCost[MAX_SAH_BINS];
+    {
+        int n = 0;
+        Vector3 low  = Vector3::inf();
+        Vector3 high = -Vector3::inf();
+        for (int b = numBins - 1; b > 0; --b) {
+            n += count[b];
+            low  = low.min(binLow[b]);
+            high = high.max(binHigh[b]);
+            highCost[b - 1] = (n > 0) ? SAHCost(n, AABox(low, high).area(), containingArea) : 0.0f;
+        }
+    }
+
+    // Sweep from below, tracking the best boundary
+    float lowestCost = inf();
+    int   lowestCostBoundary = numBins / 2 - 1;
+    {
+        int n = 0;
+        Vector3 low  = Vector3::inf();
+        Vector3 high = -Vector3::inf();
+        for (int b = 0; b < numBins - 1; ++b) {
+            n += count[b];
+            low  = low.min(binLow[b]);
+            high = high.max(binHigh[b]);
+            if ((n == 0) || (n == source.size())) {
+                // Does not divide the polys
+                continue;
+            }
+            const float cost = SAHCost(n, AABox(low, high).area(), containingArea) + highCost[b];
+            if (cost < lowestCost) {
+                lowestCost = cost;
+                lowestCostBoundary = b;
+            }
+        }
+    }
+
+    return lo + (lowestCostBoundary + 1) / binsPerUnit;
+}
+
+
 float TriTree::Node::SAHCost(int size, float area, float containingArea) {
     static const float boxIntersectTime = 5;
     static const float triIntersectTime = 1;
@@ -351,9 +477,9 @@ float TriTree::Node::SAHCost(int size, float area, float containingArea) {
 }
 
 
-float TriTree::Node::SAHCost(Vector3::Axis axis, float offset, const Array<Poly>& original, float containingArea, const Settings& settings) {
-    // TODO: pass these arrays in for thread-safing
-    static Array<Poly> lowArray, highArray, spanArray;
+float TriTree::Node::SAHCost
+(Vector3::Axis axis, float offset, const Array<Poly>& original, float containingArea, const Settings& settings,
+ Array<Poly>& lowArray, Array<Poly>& highArray, Array<Poly>& spanArray) {
     
     lowArray.fastClear();
     highArray.fastClear();
@@ -436,7 +562,235 @@ void __fastcall TriTree::Node::intersectRay
 }
 
 
-TriTree::Node::Node(Array<Poly>& originals, const Settings& settings, const MemoryManager::Ref& mm) : 
+#ifdef G3D_TRITREE_SSE
+
+class TriTree::RayPacket {
+public:
+    __m128      origin[3];
+    __m128      direction[3];
+
+    /** Reciprocal of direction, clamped to a finite range so that 0 * invDirection
+        is 0 instead of NaN for axis-aligned rays. */
+    __m128      invDirection[3];
+
+    /** Distance to the closest hit so far */
+    __m128      distance;
+
+    /** Loads \a n <= 4 rays.  Unused lanes duplicate the first ray. */
+    void set(const Ray* ray, const Hit* hit, int n) {
+        static const float big = 1e30f;
+        float o[3 * 4];
+        float d[3 * 4];
+        float inv[3 * 4];
+        float t[4];
+        for (int i = 0; i < 4; ++i) {
+            const int r = (i < n) ? i : 0;
+            for (int a = 0; a < 3; ++a) {
+                o[a * 4 + i]   = ray[r].origin()[a];
+                d[a * 4 + i]   = ray[r].direction()[a];
+                inv[a * 4 + i] = clamp(ray[r].invDirection()[a], -big, big);
+            }
+            t[i] = hit[r].distance;
+        }
+        for (int a = 0; a < 3; ++a) {
+            origin[a]       = _mm_loadu_ps(o + a * 4);
+            direction[a]    = _mm_loadu_ps(d + a * 4);
+            invDirection[a] = _mm_loadu_ps(inv + a * 4);
+        }
+        distance = _mm_loadu_ps(t);
+    }
+
+    /** Bit i is set if ray i may hit \a box before its current distance. */
+    inline int __fastcall intersect(const AABox& box) const {
+        __m128 tmin = _mm_setzero_ps();
+        __m128 tmax = distance;
+        for (int a = 0; a < 3; ++a) {
+            const __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box.low()[a]),  origin[a]), invDirection[a]);
+            const __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box.high()[a]), origin[a]), invDirection[a]);
+            tmin = _mm_max_ps(tmin, _mm_min_ps(t1, t2));
+            tmax = _mm_min_ps(tmax, _mm_max_ps(t1, t2));
+        }
+        return _mm_movemask_ps(_mm_cmple_ps(tmin, tmax));
+    }
+};
+
+
+void __fastcall TriTree::intersectValues
+(RayPacket&          packet,
+ int                 activeMask,
+ const ValueArray&   values,
+ const Ray*          ray,
+ Hit*                hit) {
+
+    // Same algorithm and tolerances as Tri::Intersector::operator(),
+    // evaluated for four rays at once.
+    const __m128 EPS  = _mm_set1_ps(1e-12f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one  = _mm_set1_ps(1.0f);
+
+    const __m128* o = packet.origin;
+    const __m128* d = packet.direction;
+
+    for (int v = 0; v < values.size; ++v) {
+        const Tri& tri = *values.data[v];
+
+        // Backface test
+        const __m128 nd = 
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(tri.n.x), d[0]), 
+                                  _mm_mul_ps(_mm_set1_ps(tri.n.y), d[1])),
+                       _mm_mul_ps(_mm_set1_ps(tri.n.z), d[2]));
+        __m128 ok = _mm_cmplt_ps(nd, _mm_sub_ps(zero, EPS));
+        if ((_mm_movemask_ps(ok) & activeMask) == 0) {
+            continue;
+        }
+
+        const __m128 e1[3] = {_mm_set1_ps(tri.e1.x), _mm_set1_ps(tri.e1.y), _mm_set1_ps(tri.e1.z)};
+        const __m128 e2[3] = {_mm_set1_ps(tri.e2.x), _mm_set1_ps(tri.e2.y), _mm_set1_ps(tri.e2.z)};
+
+        // p = d x e2
+        const __m128 p[3] = {
+            _mm_sub_ps(_mm_mul_ps(d[1], e2[2]), _mm_mul_ps(d[2], e2[1])),
+            _mm_sub_ps(_mm_mul_ps(d[2], e2[0]), _mm_mul_ps(d[0], e2[2])),
+            _mm_sub_ps(_mm_mul_ps(d[0], e2[1]), _mm_mul_ps(d[1], e2[0]))};
+
+        const __m128 a = 
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1[0], p[0]), _mm_mul_ps(e1[1], p[1])), _mm_mul_ps(e1[2], p[2]));
+
+        // s = o - v0
+        const __m128 s[3] = {
+            _mm_sub_ps(o[0], _mm_set1_ps(tri.v0.x)),
+            _mm_sub_ps(o[1], _mm_set1_ps(tri.v0.y)),
+            _mm_sub_ps(o[2], _mm_set1_ps(tri.v0.z))};
+
+        const __m128 ua = 
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(s[0], p[0]), _mm_mul_ps(s[1], p[1])), _mm_mul_ps(s[2], p[2]));
+
+        ok = _mm_and_ps(ok, _mm_and_ps(_mm_cmpge_ps(ua, zero), _mm_cmple_ps(ua, a)));
+        if ((_mm_movemask_ps(ok) & activeMask) == 0) {
+            continue;
+        }
+
+        // q = s x e1
+        const __m128 q[3] = {
+            _mm_sub_ps(_mm_mul_ps(s[1], e1[2]), _mm_mul_ps(s[2], e1[1])),
+            _mm_sub_ps(_mm_mul_ps(s[2], e1[0]), _mm_mul_ps(s[0], e1[2])),
+            _mm_sub_ps(_mm_mul_ps(s[0], e1[1]), _mm_mul_ps(s[1], e1[0]))};
+
+        const __m128 va = 
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(d[0], q[0]), _mm_mul_ps(d[1], q[1])), _mm_mul_ps(d[2], q[2]));
+
+        ok = _mm_and_ps(ok, _mm_and_ps(_mm_cmpge_ps(va, zero), _mm_cmple_ps(_mm_add_ps(ua, va), a)));
+        ok = _mm_and_ps(ok, _mm_cmpge_ps(a, EPS));
+        if ((_mm_movemask_ps(ok) & activeMask) == 0) {
+            continue;
+        }
+
+        const __m128 f = _mm_div_ps(one, a);
+        const __m128 t = _mm_mul_ps(
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2[0], q[0]), _mm_mul_ps(e2[1], q[1])), _mm_mul_ps(e2[2], q[2])), f);
+
+        ok = _mm_and_ps(ok, _mm_and_ps(_mm_cmpgt_ps(t, zero), _mm_cmplt_ps(t, packet.distance)));
+        const int hitMask = _mm_movemask_ps(ok) & activeMask;
+        if (hitMask == 0) {
+            continue;
+        }
+
+        float tArray[4];
+        float uArray[4];
+        float vArray[4];
+        float distance[4];
+        _mm_storeu_ps(tArray, t);
+        _mm_storeu_ps(uArray, _mm_mul_ps(ua, f));
+        _mm_storeu_ps(vArray, _mm_mul_ps(va, f));
+        _mm_storeu_ps(distance, packet.distance);
+
+        const bool alphaTest = tri.m_material.notNull();
+        for (int i = 0; i < 4; ++i) {
+            if (hitMask & (1 << i)) {
+                if (alphaTest) {
+                    // Rare; let the scalar intersector evaluate the alpha mask
+                    hit[i](ray[i], tri, distance[i]);
+                } else {
+                    distance[i] = tArray[i];
+                    hit[i].tri  = &tri;
+                    hit[i].u    = uArray[i];
+                    hit[i].v    = vArray[i];
+                }
+            }
+        }
+        packet.distance = _mm_loadu_ps(distance);
+    }
+}
+
+
+void __fastcall TriTree::Node::intersectRays
+(RayPacket&      packet,
+ int             activeMask,
+ const Ray*      ray,
+ Hit*            hit) const {
+
+    if (! isLeaf()) {
+        activeMask &= packet.intersect(bounds);
+        if (activeMask == 0) {
+            return;
+        }
+    }
+
+    int firstChild = 0;
+    const Vector3::Axis axis = splitAxis();
+    if (! isLeaf()) {
+        // Visit the child that most of the rays are headed towards
+        // first.  Rays that disagree still get the correct result
+        // because hits are resolved by distance, not order.
+        const int negativeMask = _mm_movemask_ps(_mm_cmplt_ps(packet.direction[axis], _mm_setzero_ps())) & activeMask;
+        int numNegative = 0, numActive = 0;
+        for (int i = 0; i < 4; ++i) {
+            numNegative += (negativeMask >> i) & 1;
+            numActive += (activeMask >> i) & 1;
+        }
+        firstChild = (2 * numNegative > numActive) ? 1 : 0;
+
+        child(firstChild).intersectRays(packet, activeMask, ray, hit);
+    }
+
+    if (valueArray && (valueArray->size > 0)) {
+        const int valueMask = activeMask & packet.intersect(valueArray->bounds);
+        if (valueMask != 0) {
+            intersectValues(packet, valueMask, *valueArray, ray, hit);
+        }
+    }
+
+    if (isLeaf()) {
+        return;
+    }
+
+    // Drop rays that start on the near side and either move away from
+    // the splitting plane or have already hit something before it.
+    const __m128 split     = _mm_set1_ps(splitLocation);
+    const __m128 origin    = packet.origin[axis];
+    const __m128 direction = packet.direction[axis];
+    const __m128 zero      = _mm_setzero_ps();
+    __m128 nearSide, awaySide;
+    if (firstChild == 0) {
+        nearSide = _mm_cmplt_ps(origin, split);
+        awaySide = _mm_cmple_ps(direction, zero);
+    } else {
+        nearSide = _mm_cmpgt_ps(origin, split);
+        awaySide = _mm_cmpge_ps(direction, zero);
+    }
+    const __m128 distanceToSplittingPlane = _mm_mul_ps(_mm_sub_ps(split, origin), packet.invDirection[axis]);
+    const __m128 done = _mm_and_ps(nearSide, _mm_or_ps(awaySide, _mm_cmpgt_ps(distanceToSplittingPlane, packet.distance)));
+    activeMask &= ~_mm_movemask_ps(done);
+
+    if (activeMask != 0) {
+        child(1 - firstChild).intersectRays(packet, activeMask, ray, hit);
+    }
+}
+
+#endif
+
+
+TriTree::Node::Node(Array<Poly>& originals, const Settings& settings, const MemoryManager::Ref& mm, TriTree* tree) : 
     bounds(Poly::computeBounds(originals)), 
     splitLocation(0),
     packedChildAxis(NULL),
@@ -449,7 +803,7 @@ TriTree::Node::Node(Array<Poly>& originals, const Settings& settings, const Memo
         return;
     }
     
-    split(originals, settings, mm);
+    split(originals, settings, mm, tree);
     
     debugAssert((valueArray == NULL) ||
                 bounds.contains(valueArray->bounds));
@@ -583,6 +937,7 @@ void TriTree::clear() {
         m_triArray = NULL;
         m_size = 0;
         m_memoryManager = NULL;
+        m_workerMemoryManager.clear();
     }
 }
 
@@ -604,7 +959,7 @@ void TriTree::setContents(const Array<Tri>& triArray, const Settings& settings)
     m_size = source.size();
     if (source.size() > 0) {
         m_memoryManager = AreaMemoryManager::create();
-        m_root = new (m_memoryManager->alloc(sizeof(Node))) Node(source, settings, m_memoryManager);
+        m_root = new (m_memoryManager->alloc(sizeof(Node))) Node(source, settings, m_memoryManager, this);
     }
 }
 
@@ -629,4 +984,43 @@ bool TriTree::intersectRay
     return distance < initialDistance;
 }
 
+
+int TriTree::intersectRays(const Ray* ray, int n, Hit* hit) const {
+    int numHits = 0;
+    if (m_root == NULL) {
+        return numHits;
+    }
+
+#   ifdef G3D_TRITREE_SSE
+        RayPacket packet;
+        for (int i = 0; i < n; i += 4) {
+            const int m = iMin(4, n - i);
+            float initialDistance[4];
+            for (int j = 0; j < m; ++j) {
+                initialDistance[j] = hit[i + j].distance;
+            }
+
+            packet.set(ray + i, hit + i, m);
+            m_root->intersectRays(packet, (1 << m) - 1, ray + i, hit + i);
+
+            float distance[4];
+            _mm_storeu_ps(distance, packet.distance);
+            for (int j = 0; j < m; ++j) {
+                hit[i + j].distance = distance[j];
+                if (distance[j] < initialDistance[j]) {
+                    ++numHits;
+                }
+            }
+        }
+#   else
+        for (int i = 0; i < n; ++i) {
+            if (intersectRay(ray[i], hit[i], hit[i].distance)) {
+                ++numHits;
+            }
+        }
+#   endif
+
+    return numHits;
+}
+
 }
@@ -428,7 +428,9 @@ void VideoOutput::convertFrame(uint8* frame, const ImageFormat* format, bool inv
                                               format, 0, 
                                               outputBuffers, 
                                               ImageFormat::RGB8(), 0, 
-                                              invertRequired);
+                                              invertRequired,
+                                              ImageFormat::BayerAlgorithm::MHC,
+                                              true);
 
         throwException(converted, "Unable to add frame due to unsupported conversion of formats.");
 
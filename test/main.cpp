@@ -37,12 +37,20 @@ using G3D::uint8;
 
 // Forward declarations
 void testImageConvert();
+void perfImageConvert();
+
+void testGImage();
+void perfGImage();
+
+void testImageLoader();
+void perfImageLoader();
 
 void perfArray();
 void testArray();
 void testSmallArray();
 
 void testMatrix();
+void perfMatrix();
 
 void testFileSystem();
 
@@ -93,6 +101,21 @@ void testQuat();
 void perfKDTree();
 void testKDTree();
 
+void testDynamicBVH();
+void perfDynamicBVH();
+
+void testOcclusionBuffer();
+void perfOcclusionBuffer();
+
+void testMortonGrid();
+void perfMortonGrid();
+
+void testMeshAlgOptimize();
+void perfMeshAlgOptimize();
+
+void testMeshAlgSimplify();
+void perfMeshAlgSimplify();
+
 void testSphere();
 
 void testAABox();
@@ -103,7 +126,11 @@ void perfSystemMemcpy();
 void testSystemMemcpy();
 void testSystemMemset();
 
+void perfSystemMalloc();
+void testSystemMalloc();
+
 void testMap2D();
+void perfMap2D();
 
 void testReferenceCount();
 
@@ -116,12 +143,18 @@ void testMeshAlgTangentSpace();
 void perfQueue();
 void testQueue();
 
+void perfLockFreeQueue();
+void testLockFreeQueue();
+
 void testBinaryIO();
 void testHugeBinaryIO();
 void perfBinaryIO();
 
 void testTextInput();
 void testTextInput2();
+void perfTextInput();
+void testXMLReader();
+void perfXMLReader();
 
 void testTable();
 void testAdjacency();
@@ -134,9 +167,16 @@ void testCoordinateFrame();
 
 void testGThread();
 
+void testTaskScheduler();
+void perfTaskScheduler();
+
+void testTriTree();
+void perfTriTree();
+
 void testfilter();
 
 void testAny();
+void perfAny();
 
 
 void testPointHashGrid();
@@ -185,6 +225,10 @@ void testGCamera() {
     debugAssertM(lr == Vector3(1, -0.5, -1), lr.toString());
     debugAssertM(ll == Vector3(-1, -0.5, -1), ll.toString());
     debugAssertM(ul == Vector3(-1, 0.5, -1), ul.toString());
+
+    // The near plane is 2 units and 200 pixels wide, so a unit square ten units away covers 10 x 10 pixels
+    debugAssert(fuzzyEq(camera.worldToScreenSpaceArea(1.0f, -10.0f, viewport), 100.0f));
+    debugAssert(camera.worldToScreenSpaceArea(1.0f, 1.0f, viewport) == finf());
     printf("passed\n");
 }
 
@@ -684,8 +728,18 @@ int main(int argc, char* argv[]) {
 
         printf("%s\n", System::mallocPerformance().c_str());
 
+        perfSystemMalloc();
+
+        perfTaskScheduler();
+
+        perfTriTree();
+
         perfQueue();
 
+        perfLockFreeQueue();
+
+        perfMatrix();
+
         perfMatrix3();
 
         perfTextOutput();
@@ -696,6 +750,30 @@ int main(int argc, char* argv[]) {
 
         perfPointHashGrid();
 
+        perfDynamicBVH();
+
+        perfOcclusionBuffer();
+
+        perfMortonGrid();
+
+        perfMeshAlgOptimize();
+
+        perfMeshAlgSimplify();
+
+        perfImageConvert();
+
+        perfMap2D();
+
+        perfGImage();
+
+        perfImageLoader();
+
+        perfAny();
+
+        perfTextInput();
+
+        perfXMLReader();
+
 
         measureMemsetPerformance();
         measureNormalizationPerformance();
@@ -740,13 +818,29 @@ int main(int argc, char* argv[]) {
     testTextInput2();
     printf("  passed\n");
 
+    testXMLReader();
+
 
     testSphere();
 
     testImageConvert();
 
+    testGImage();
+
+    testImageLoader();
+
     testKDTree();
 
+    testDynamicBVH();
+
+    testOcclusionBuffer();
+
+    testMortonGrid();
+
+    testMeshAlgOptimize();
+
+    testMeshAlgSimplify();
+
     testMatrix();
 
     testLineSegment2D();
@@ -784,6 +878,10 @@ int main(int argc, char* argv[]) {
     testAtomicInt32();
 
     testGThread();
+
+    testTaskScheduler();
+
+    testTriTree();
     
     testWeakCache();
     
@@ -791,10 +889,14 @@ int main(int argc, char* argv[]) {
 
     testSystemMemcpy();
 
+    testSystemMalloc();
+
     testuint128();
 
     testQueue();
 
+    testLockFreeQueue();
+
     testMeshAlgTangentSpace();
 
     testConvexPolygon2D();
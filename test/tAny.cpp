@@ -13,6 +13,12 @@
 
 #include "G3D/G3DAll.h"
 #include <sstream>
+#include <cstdio>
+#ifdef G3D_WIN32
+#   include <sys/utime.h>
+#else
+#   include <utime.h>
+#endif
 
 static void testRefCount1() {
 
@@ -247,10 +253,118 @@ static void testParse() {
     
 }
 
+static void setModificationTime(const std::string& filename, int64 t) {
+#   ifdef G3D_WIN32
+        struct _utimbuf times;
+        times.actime  = (time_t)t;
+        times.modtime = (time_t)t;
+        _utime(filename.c_str(), &times);
+#   else
+        struct utimbuf times;
+        times.actime  = (time_t)t;
+        times.modtime = (time_t)t;
+        utime(filename.c_str(), &times);
+#   endif
+}
+
+
+static void testCompiled() {
+    const std::string& src = 
+        "// Scene\n"
+        "Scene {\n"
+        "   name = \"test scene\",\n"
+        "   models = {\n"
+        "      crate = ArticulatedModel::Specification { filename = \"crate.ifs\", scale = 0.25 },\n"
+        "      empty = {},\n"
+        "   },\n"
+        "   /* Entities */\n"
+        "   entities = [ Entity(\"a\", Vector3(1, -2.5, 1e10), true), Entity(\"b\", NONE, false), () ],\n"
+        "}";
+
+    Any a;
+    a.parse(src);
+    a.saveCompiled("Any-compiled-string.anyb");
+
+    Any b;
+    debugAssert(b.loadCompiled("Any-compiled-string.anyb"));
+    debugAssert(a == b);
+    debugAssert(a.unparse() == b.unparse());
+    debugAssert(b.nameEquals("Scene"));
+    debugAssert(b["entities"].comment() == "Entities");
+    debugAssert(b["models"]["crate"].name() == "ArticulatedModel::Specification");
+    debugAssert(b["entities"][0][1].name() == "Vector3");
+    debugAssert(b["entities"][1][1].isNone());
+    debugAssert(b["entities"][2].size() == 0);
+    debugAssert(b["name"].string() == "test scene");
+    debugAssert(b["entities"][0][1][2].number() == 1e10);
+    // Sources survive, so errors still refer to the text
+    debugAssert(b["models"]["crate"]["scale"].source().line == a["models"]["crate"]["scale"].source().line);
+    debugAssert(b["models"]["crate"]["scale"].source().character == a["models"]["crate"]["scale"].source().character);
+
+    // Truncated files are rejected
+    {
+        BinaryInput in("Any-compiled-string.anyb", G3D_LITTLE_ENDIAN);
+        BinaryOutput out("Any-compiled-truncated.anyb", G3D_LITTLE_ENDIAN);
+        out.writeBytes(in.getCArray(), (int)in.size() - 5);
+        out.commit();
+    }
+    Any c(Any::ARRAY);
+    debugAssert(! c.loadCompiled("Any-compiled-truncated.anyb"));
+    debugAssert(c.type() == Any::ARRAY);
+
+    // load() uses an up-to-date compiled file in place of the text
+    a.save("Any-compiled.any");
+    debugAssert(Any::compiledFilename("Any-compiled.any") == "Any-compiled.anyb");
+    debugAssert(Any::compiledFilename("Any-load.txt") == "Any-load.txt.anyb");
+
+    Any::setCompileOnLoad(true);
+    Any d;
+    d.load("Any-compiled.any");
+    Any::setCompileOnLoad(false);
+    debugAssert(a.unparse() == d.unparse());
+    debugAssert(FileSystem::exists("Any-compiled.anyb"));
+
+    // Substitute different values in the compiled file
+    d["name"] = "compiled";
+    d.saveCompiled("Any-compiled.anyb");
+    Any e;
+    e.load("Any-compiled.any");
+    debugAssert(e["name"].string() == "compiled");
+
+    // ...until the source changes, even within the same second
+    const std::string& full = FileSystem::resolve("Any-compiled.any");
+    const int64 savedTime = FileSystem::modificationTime(full);
+    {
+        Any f = a;
+        f["name"] = "edited";
+        f.save("Any-compiled.any");
+    }
+    setModificationTime(full, savedTime);
+    FileSystem::clearCache();
+    debugAssert(! e.loadCompiled("Any-compiled.anyb"));
+    e.load("Any-compiled.any");
+    debugAssert(e["name"].string() == "edited");
+    a.save("Any-compiled.any");
+    d.saveCompiled("Any-compiled.anyb");
+
+    setModificationTime(full, FileSystem::modificationTime(full) + 10);
+    debugAssert(! e.loadCompiled("Any-compiled.anyb"));
+    debugAssert(e.loadCompiled("Any-compiled.anyb", false));
+    e.load("Any-compiled.any");
+    debugAssert(e["name"].string() == a["name"].string());
+
+    ::remove("Any-compiled.any");
+    ::remove("Any-compiled.anyb");
+    ::remove("Any-compiled-string.anyb");
+    ::remove("Any-compiled-truncated.anyb");
+}
+
+
 void testAny() {
 
     printf("G3D::Any ");
     testParse();
+    testCompiled();
 
     testRefCount1();
     testRefCount2();
@@ -304,3 +418,41 @@ void testAny() {
     printf("passed\n");
 
 };    // void testAny()
+
+
+void perfAny() {
+    printf("----------------------------------------------------------\n");
+
+    // A scene description with 20000 entities
+    TextOutput to("Any-perf.any");
+    to.printf("Scene {\n  entities = {\n");
+    for (int i = 0; i < 20000; ++i) {
+        to.printf("    e%d = Entity { model = \"model%d\", position = Vector3(%d, 0.5, -%d), visible = true, "
+                  "frames = (%d, %d, %d) },\n", i, i % 50, i, i, i, i + 1, i + 2);
+    }
+    to.printf("  }\n}\n");
+    to.commit();
+
+    RealTime t0 = System::time();
+    Any text;
+    text.load("Any-perf.any");
+    const RealTime parseTime = System::time() - t0;
+
+    t0 = System::time();
+    text.saveCompiled("Any-perf.anyb");
+    const RealTime compileTime = System::time() - t0;
+
+    t0 = System::time();
+    Any compiled;
+    compiled.loadCompiled("Any-perf.anyb");
+    const RealTime loadTime = System::time() - t0;
+
+    printf("Any load (20000 entities, %d KB text, %d KB compiled):\n",
+           (int)(FileSystem::size("Any-perf.any") / 1024), (int)(FileSystem::size("Any-perf.anyb") / 1024));
+    printf("  parse text:      %6.3fs\n", parseTime);
+    printf("  saveCompiled:    %6.3fs\n", compileTime);
+    printf("  loadCompiled:    %6.3fs\n\n", loadTime);
+
+    ::remove("Any-perf.any");
+    ::remove("Any-perf.anyb");
+}
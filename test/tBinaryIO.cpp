@@ -148,8 +148,7 @@ static void testBitSerialization() {
 }
 
 
-static void testCompression() {
-    printf("BinaryInput & BinaryOutput\n");
+static void testCompressionFile() {
     BinaryOutput f("out.t", G3D_LITTLE_ENDIAN);
 
     for (int i = 0; i < 100; ++i) {
@@ -158,6 +157,12 @@ static void testCompression() {
     }
     f.compress();
     f.commit();
+}
+
+
+static void testCompression() {
+    printf("BinaryInput & BinaryOutput\n");
+    testCompressionFile();
 
     BinaryInput g("out.t", G3D_LITTLE_ENDIAN, true);
     for (int k = 0; k < 100; ++k) {
@@ -169,6 +174,340 @@ static void testCompression() {
 }
 
 
+static void testMemoryMap() {
+    printf("BinaryInput memory map\n");
+    {
+        BinaryOutput f("out.t", G3D_LITTLE_ENDIAN);
+        for (int i = 0; i < 10000; ++i) {
+            f.writeUInt32(i);
+        }
+        f.writeString("end");
+        f.commit();
+    }
+
+    {
+        BinaryInput g("out.t", G3D_LITTLE_ENDIAN, false, true);
+        debugAssert(g.memoryMapped());
+        debugAssert(g.getLength() == 10000 * 4 + 4);
+        debugAssert(g.getCArray() != NULL);
+
+        // Random access
+        for (int k = 0; k < 100; ++k) {
+            const int i = (k * 7919) % 10000;
+            g.setPosition(i * 4);
+            uint32 x = g.readUInt32();
+            debugAssert(x == (uint32)i); (void)x;
+        }
+
+        g.setPosition(10000 * 4);
+        debugAssert(g.readString() == "end");
+        debugAssert(! g.hasMore());
+    }
+
+    // Compressed files are decompressed out of the mapping
+    testCompressionFile();
+    {
+        BinaryInput g("out.t", G3D_LITTLE_ENDIAN, true, true);
+        debugAssert(! g.memoryMapped());
+        for (int k = 0; k < 100; ++k) {
+            uint32 i = g.readUInt32();
+            debugAssert(i == 1234); (void)i;
+            double j = g.readFloat64();
+            debugAssert(j == 1.234); (void)j;
+        }
+    }
+}
+
+
+static void testStreamingCompression() {
+    printf("BinaryInput & BinaryOutput streaming compression\n");
+    const int N = 300000;
+
+    for (int index = 0; index < 2; ++index) {
+        {
+            BinaryOutput f("out.t", G3D_LITTLE_ENDIAN);
+            f.setStreamingCompression(64 * 1024, index == 1);
+            for (int i = 0; i < N; ++i) {
+                f.writeUInt32(i);
+                if (i == 1000) {
+                    // Seek backwards within the current block
+                    f.setPosition(4 * 10);
+                    f.writeUInt32(10);
+                    f.setPosition(4 * 1001);
+                }
+            }
+            f.writeString("end");
+            f.commit();
+        }
+
+        // Only the blocks being read are decompressed
+        BinaryInput g("out.t", G3D_LITTLE_ENDIAN, true);
+        debugAssert(g.getLength() == N * 4 + 4);
+        for (int i = 0; i < N; ++i) {
+            uint32 x = g.readUInt32();
+            debugAssert(x == (uint32)i); (void)x;
+        }
+        debugAssert(g.readString() == "end");
+
+        for (int k = 0; k < 1000; ++k) {
+            const int i = (k * 7919) % N;
+            g.setPosition(i * 4);
+            uint32 x = g.readUInt32();
+            debugAssert(x == (uint32)i); (void)x;
+        }
+
+        // Read across a block boundary: the high half of word 16383
+        // followed by the low half of word 16384
+        g.setPosition(64 * 1024 - 2);
+        uint32 x = g.readUInt32();
+        debugAssert(x == (16384 << 16)); (void)x;
+
+        // Whole-buffer decompression from memory
+        BinaryInput raw("out.t", G3D_LITTLE_ENDIAN);
+        BinaryInput h(raw.getCArray(), raw.getLength(), G3D_LITTLE_ENDIAN, true);
+        debugAssert(h.getLength() == N * 4 + 4);
+        h.setPosition(4 * 12345);
+        x = h.readUInt32();
+        debugAssert(x == 12345);
+
+        // Corrupt block headers throw.  The first block header follows
+        // the 16-byte file header and holds the compressed, then
+        // uncompressed, length.
+        for (int field = 0; field < 2; ++field) {
+            Array<uint8> data;
+            data.resize((int)raw.getLength());
+            System::memcpy(data.getCArray(), raw.getCArray(), data.size());
+            const uint32 huge = 0x7FFFFFFF;
+            System::memcpy(data.getCArray() + 16 + 4 * field, &huge, 4);
+
+            bool threw = false;
+            try {
+                BinaryInput corrupt(data.getCArray(), data.size(), G3D_LITTLE_ENDIAN, true);
+            } catch (const std::string&) {
+                threw = true;
+            }
+            debugAssert(threw);
+
+            {
+                BinaryOutput out("out.t", G3D_LITTLE_ENDIAN);
+                out.writeBytes(data.getCArray(), data.size());
+                out.commit();
+            }
+
+            threw = false;
+            try {
+                BinaryInput corrupt("out.t", G3D_LITTLE_ENDIAN, true);
+                corrupt.readUInt32();
+            } catch (const std::string&) {
+                threw = true;
+            }
+            debugAssert(threw);
+        }
+
+        if (index == 1) {
+            // Corrupt index trailers throw instead of allocating or seeking
+            // with their counts.  The trailer is the last 16 bytes: the
+            // uncompressed length, the number of blocks, and a magic number.
+            // The block offsets precede it.
+            const int numBlocks = (N * 4 + 4 + 64 * 1024 - 1) / (64 * 1024);
+            for (int kind = 0; kind < 5; ++kind) {
+                Array<uint8> data;
+                data.resize((int)raw.getLength());
+                System::memcpy(data.getCArray(), raw.getCArray(), data.size());
+                uint8* trailer = data.getCArray() + data.size() - 16;
+                uint8* offsets = trailer - 8 * numBlocks;
+                const uint32 huge = 0x7FFFFFFF;
+                switch (kind) {
+                case 0:
+                    // More blocks than the file could hold
+                    System::memcpy(trailer + 8, &huge, 4);
+                    break;
+                case 1:
+                    // Longer than the blocks can hold
+                    System::memcpy(trailer + 4, &huge, 4);
+                    break;
+                case 2:
+                    // An offset inside the index
+                    System::memcpy(offsets + 8 * (numBlocks - 1), &huge, 4);
+                    break;
+                case 3:
+                    // Offsets out of order
+                    System::memcpy(offsets, offsets + 8, 8);
+                    break;
+                case 4:
+                    // Truncated
+                    data.resize(data.size() - 5);
+                    break;
+                }
+
+                {
+                    BinaryOutput out("out.t", G3D_LITTLE_ENDIAN);
+                    out.writeBytes(data.getCArray(), data.size());
+                    out.commit();
+                }
+
+                bool threw = false;
+                try {
+                    BinaryInput corrupt("out.t", G3D_LITTLE_ENDIAN, true);
+                } catch (const std::string&) {
+                    threw = true;
+                }
+                debugAssert(threw);
+            }
+        }
+    }
+}
+
+
+/** Writes the same mix of small and large writes, with a seek, to \a filename */
+static void writeChunkTestData(const std::string& filename, int blockSize, bool backgroundFlush,
+                               const TaskScheduler::Ref& scheduler = TaskScheduler::global()) {
+    BinaryOutput f(filename, G3D_LITTLE_ENDIAN);
+    if (blockSize > 0) {
+        f.setChunkedOutput(blockSize, backgroundFlush, scheduler);
+    }
+
+    Array<uint8> big;
+    big.resize(3 * 4096 + 17);
+    for (int i = 0; i < big.size(); ++i) {
+        big[i] = (uint8)(i * 13);
+    }
+
+    for (int i = 0; i < 20000; ++i) {
+        f.writeUInt32(i);
+        f.writeString("chunk");
+        if (i % 1000 == 0) {
+            // Larger than a block
+            f.writeBytes(big.getCArray(), big.size());
+        }
+        if (i == 15000) {
+            // Seek backwards within the current block
+            const int64 p = f.position();
+            f.setPosition(p - 6);
+            f.writeString("CHUNK");
+            debugAssert(f.position() == p);
+        }
+    }
+    debugAssert(f.size() == f.position());
+    f.writeFloat64(1.5);
+    f.commit();
+}
+
+
+static void testChunkedOutput() {
+    printf("BinaryOutput chunked\n");
+
+    writeChunkTestData("out.t", 0, false);
+    const std::string expected = readWholeFile("out.t");
+
+    for (int background = 0; background < 2; ++background) {
+        writeChunkTestData("out.t", 4096, background == 1);
+        debugAssert(readWholeFile("out.t") == expected);
+    }
+
+    // Without workers, background flushing writes each block as it fills
+    const TaskScheduler::Ref noWorkers = TaskScheduler::create(0);
+    writeChunkTestData("out.t", 4096, true, noWorkers);
+    debugAssert(readWholeFile("out.t") == expected);
+    {
+        BinaryOutput f("out.t", G3D_LITTLE_ENDIAN);
+        f.setChunkedOutput(4096, true, noWorkers);
+        for (int i = 0; i < 10 * 1024; ++i) {
+            f.writeInt32(i);
+        }
+
+        // The last block is only retired by the next write
+        FILE* file = fopen("out.t", "rb");
+        fseek(file, 0, SEEK_END);
+        debugAssert(ftell(file) == 9 * 4096);
+        fclose(file);
+        f.commit();
+    }
+
+    // Empty file
+    {
+        BinaryOutput f("out.t", G3D_LITTLE_ENDIAN);
+        f.setChunkedOutput(4096);
+        f.commit();
+        debugAssert(FileSystem::size("out.t") == 0);
+    }
+
+    // Destroying an uncommitted BinaryOutput does not leak or crash
+    {
+        BinaryOutput f("out.t", G3D_LITTLE_ENDIAN);
+        f.setChunkedOutput(4096);
+        for (int i = 0; i < 10000; ++i) {
+            f.writeInt32(i);
+        }
+    }
+}
+
+
+/** Writes a 96 MB file with and without chunked output */
+static void measureChunkedOutputPerformance() {
+    const int N = 4 * 1024 * 1024;
+    Array<Vector3> v;
+    v.resize(1024);
+    for (int i = 0; i < v.size(); ++i) {
+        v[i] = Vector3((float)i, 1.0f, 2.0f);
+    }
+
+    for (int mode = 0; mode < 3; ++mode) {
+        RealTime t0 = System::time();
+        {
+            BinaryOutput f("out.t", G3D_LITTLE_ENDIAN);
+            if (mode > 0) {
+                f.setChunkedOutput(1024 * 1024, mode == 2);
+            }
+            for (int i = 0; i < N; i += v.size()) {
+                for (int j = 0; j < v.size(); ++j) {
+                    f.writeVector3(v[j]);
+                }
+                f.writeFloat32((const float32*)v.getCArray(), v.size() * 3);
+            }
+            f.commit();
+        }
+        const RealTime t = System::time() - t0;
+
+        static const char* name[] = {"contiguous", "chunked", "chunked, background flush"};
+        printf("BinaryOutput %d MB %-26s %6.3fs\n", (int)(FileSystem::size("out.t") / (1024 * 1024)), name[mode], t);
+    }
+    printf("\n");
+}
+
+
+/** Reads random words from a 32 MB file with and without memory mapping */
+static void measureMemoryMapPerformance() {
+    const int N = 8 * 1024 * 1024;
+    {
+        BinaryOutput f("out.t", G3D_LITTLE_ENDIAN);
+        for (int i = 0; i < N; ++i) {
+            f.writeUInt32(i);
+        }
+        f.commit();
+    }
+
+    for (int m = 0; m < 2; ++m) {
+        const bool memoryMap = (m == 1);
+        RealTime t0 = System::time();
+        BinaryInput in("out.t", G3D_LITTLE_ENDIAN, false, memoryMap);
+        const RealTime openTime = System::time() - t0;
+
+        uint32 sum = 0;
+        t0 = System::time();
+        for (int k = 0; k < 100000; ++k) {
+            in.setPosition(((int64)k * 104729 % N) * 4);
+            sum += in.readUInt32();
+        }
+        const RealTime readTime = System::time() - t0;
+
+        printf("BinaryInput%s: open %6.4fs, 100k random reads %6.4fs (%u)\n", 
+               memoryMap ? " (memory mapped)" : "                ", openTime, readTime, sum);
+    }
+    printf("\n");
+}
+
+
 static void measureSerializerPerformance() {
     Array<uint8> x;
     x.resize(1024);
@@ -204,6 +543,8 @@ static void measureSerializerPerformance() {
 
 void perfBinaryIO() {
     measureSerializerPerformance();
+    measureChunkedOutputPerformance();
+    measureMemoryMapPerformance();
 }
 
 
@@ -234,4 +575,7 @@ void testBinaryIO() {
     testBasicSerialization();
     testBitSerialization();
     testCompression();
+    testMemoryMap();
+    testStreamingCompression();
+    testChunkedOutput();
 }
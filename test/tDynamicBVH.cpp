@@ -0,0 +1,262 @@
+#include "G3D/G3DAll.h"
+
+static AABox randomBox(Random& r, float worldSize, float maxSize) {
+    const Vector3 lo(r.uniform(-worldSize, worldSize), r.uniform(-worldSize, worldSize), r.uniform(-worldSize, worldSize));
+    return AABox(lo, lo + Vector3(r.uniform(0, maxSize), r.uniform(0, maxSize), r.uniform(0, maxSize)));
+}
+
+
+static void randomCamera(Random& r, float worldSize, bool infiniteFar, GCamera& camera) {
+    CoordinateFrame cframe(Vector3(r.uniform(-worldSize, worldSize), r.uniform(-worldSize, worldSize), r.uniform(-worldSize, worldSize)));
+    cframe.lookAt(Vector3(r.uniform(-worldSize, worldSize), r.uniform(-worldSize, worldSize), r.uniform(-worldSize, worldSize)));
+    camera.setCoordinateFrame(cframe);
+    camera.setFieldOfView(r.uniform(0.3f, 1.5f), GCamera::VERTICAL);
+    camera.setFarPlaneZ(infiniteFar ? -finf() : -r.uniform(10, worldSize));
+}
+
+
+/** Checks \a tree against AABox::culledBy for the leaves in \a box, whose values are their indices */
+static void checkCull(DynamicBVH& tree, const Array<AABox>& box, const Array<bool>& present, const Array<Plane>& plane) {
+    Array<int> expected;
+    for (int i = 0; i < box.size(); ++i) {
+        if (present[i] && ! box[i].culledBy(plane)) {
+            expected.append(i);
+        }
+    }
+
+    Array<int> actual;
+    tree.cull(plane, actual);
+    actual.sort();
+
+    debugAssertM(actual.size() == expected.size(), format("%d visible, expected %d", actual.size(), expected.size()));
+    for (int i = 0; i < actual.size(); ++i) {
+        debugAssert(actual[i] == expected[i]);
+    }
+}
+
+
+static void testRandomScene() {
+    Random r(17, false);
+    const float worldSize = 100.0f;
+
+    DynamicBVH tree;
+    debugAssert(tree.size() == 0);
+
+    Array<Plane> plane;
+    Array<int> result;
+    tree.cull(plane, result);
+    debugAssert(result.size() == 0);
+
+    Array<AABox> box;
+    Array<bool> present;
+    Array<int> handle;
+    for (int i = 0; i < 3000; ++i) {
+        box.append(randomBox(r, worldSize, (i % 100 == 0) ? 60.0f : 4.0f));
+        present.append(true);
+        handle.append(tree.insert(box.last(), i));
+        debugAssert(handle.last() == i);
+    }
+
+    // Infinite boxes are never culled
+    box.append(AABox::inf());
+    present.append(true);
+    handle.append(tree.insert(box.last(), box.size() - 1));
+
+    debugAssert(tree.size() == box.size());
+
+    // No planes
+    tree.cull(plane, result);
+    debugAssert(result.size() == box.size());
+
+    for (int frame = 0; frame < 30; ++frame) {
+        GCamera camera;
+        randomCamera(r, worldSize, (frame % 3) == 0, camera);
+        camera.getClipPlanes(Rect2D::xywh(0, 0, 640, 400), plane);
+        checkCull(tree, box, present, plane);
+
+        // Arbitrary plane sets
+        plane.fastClear();
+        const int numPlanes = r.integer(1, 12);
+        for (int p = 0; p < numPlanes; ++p) {
+            const Vector3& point = Vector3(r.uniform(-worldSize, worldSize), r.uniform(-worldSize, worldSize), r.uniform(-worldSize, worldSize)) * 0.5f;
+            plane.append(Plane(Vector3::random(r), point));
+        }
+        checkCull(tree, box, present, plane);
+
+        // Move a few boxes or many
+        const int numMoved = ((frame % 4) == 3) ? box.size() / 2 : 20;
+        for (int k = 0; k < numMoved; ++k) {
+            const int i = r.integer(0, box.size() - 2);
+            if (present[i]) {
+                box[i] = randomBox(r, worldSize, 4.0f);
+                tree.update(handle[i], box[i]);
+                debugAssert(tree.bounds(handle[i]) == box[i]);
+            }
+        }
+
+        // Remove and reinsert some
+        for (int k = 0; k < 40; ++k) {
+            const int i = r.integer(0, box.size() - 2);
+            if (present[i]) {
+                tree.remove(handle[i]);
+                present[i] = false;
+            } else {
+                box[i] = randomBox(r, worldSize, 4.0f);
+                handle[i] = tree.insert(box[i], i);
+                present[i] = true;
+            }
+        }
+
+        if (frame == 20) {
+            tree.rebuild();
+        }
+    }
+
+    // Removing every leaf
+    for (int i = 0; i < box.size(); ++i) {
+        if (present[i]) {
+            tree.remove(handle[i]);
+            present[i] = false;
+        }
+    }
+    debugAssert(tree.size() == 0);
+    result.fastClear();
+    tree.cull(plane, result);
+    debugAssert(result.size() == 0);
+
+    // Reuse after emptying
+    box[0] = randomBox(r, worldSize, 4.0f);
+    present[0] = true;
+    handle[0] = tree.insert(box[0], 0);
+    checkCull(tree, box, present, plane);
+
+    tree.clear();
+    debugAssert(tree.insert(box[0], 7) == 0);
+    debugAssert(tree.insert(box[1], 8) == 1);
+    debugAssert(tree.value(1) == 8);
+}
+
+
+static void testSmallTrees() {
+    // Trees of every size up to a few levels, to cover partially filled nodes
+    Random r(5, false);
+    for (int n = 1; n < 40; ++n) {
+        DynamicBVH tree;
+        Array<AABox> box;
+        Array<bool> present;
+        for (int i = 0; i < n; ++i) {
+            box.append(randomBox(r, 10.0f, 3.0f));
+            present.append(true);
+            tree.insert(box.last(), i);
+        }
+
+        for (int k = 0; k < 5; ++k) {
+            GCamera camera;
+            randomCamera(r, 10.0f, false, camera);
+            Array<Plane> plane;
+            camera.getClipPlanes(Rect2D::xywh(0, 0, 100, 100), plane);
+            checkCull(tree, box, present, plane);
+        }
+    }
+}
+
+
+void testDynamicBVH() {
+    printf("DynamicBVH ");
+
+    testSmallTrees();
+    testRandomScene();
+
+    printf("passed\n");
+}
+
+
+void perfDynamicBVH() {
+    printf("----------------------------------------------------------\n");
+
+    // A large, mostly flat world of small objects, as in an outdoor scene
+    const int N = 50000;
+    const float worldSize = 1000.0f;
+    Random r(11, false);
+
+    Array<AABox> box;
+    Array<Sphere> sphere;
+    for (int i = 0; i < N; ++i) {
+        const Vector3 lo(r.uniform(-worldSize, worldSize), r.uniform(0, 20), r.uniform(-worldSize, worldSize));
+        box.append(AABox(lo, lo + Vector3(r.uniform(0.5f, 4), r.uniform(0.5f, 4), r.uniform(0.5f, 4))));
+        sphere.append(Sphere(box.last().center(), box.last().extent().length() * 0.5f));
+    }
+
+    DynamicBVH tree;
+    RealTime t0 = System::time();
+    for (int i = 0; i < N; ++i) {
+        tree.insert(box[i], i);
+    }
+    tree.rebuild();
+    const RealTime buildTime = System::time() - t0;
+
+    GCamera camera;
+    camera.setFarPlaneZ(-400);
+    const int numFrames = 100;
+    Array<Array<Plane> > plane;
+    plane.resize(numFrames);
+    for (int f = 0; f < numFrames; ++f) {
+        const float angle = f * 0.02f;
+        CoordinateFrame cframe(Vector3(0, 10, 0));
+        cframe.lookAt(Vector3(cos(angle), 9.8f, sin(angle)));
+        camera.setCoordinateFrame(cframe);
+        camera.getClipPlanes(Rect2D::xywh(0, 0, 1280, 720), plane[f]);
+    }
+
+    int numSphere = 0;
+    t0 = System::time();
+    for (int f = 0; f < numFrames; ++f) {
+        for (int i = 0; i < N; ++i) {
+            if (! sphere[i].culledBy(plane[f])) {
+                ++numSphere;
+            }
+        }
+    }
+    const RealTime sphereTime = System::time() - t0;
+
+    int numBox = 0;
+    t0 = System::time();
+    for (int f = 0; f < numFrames; ++f) {
+        for (int i = 0; i < N; ++i) {
+            if (! box[i].culledBy(plane[f])) {
+                ++numBox;
+            }
+        }
+    }
+    const RealTime boxTime = System::time() - t0;
+
+    Array<int> visible;
+    int numTree = 0;
+    t0 = System::time();
+    for (int f = 0; f < numFrames; ++f) {
+        visible.fastClear();
+        tree.cull(plane[f], visible);
+        numTree += visible.size();
+    }
+    const RealTime treeTime = System::time() - t0;
+    debugAssert(numTree == numBox);
+
+    // 2% of the objects move every frame
+    t0 = System::time();
+    for (int f = 0; f < numFrames; ++f) {
+        for (int k = 0; k < N / 50; ++k) {
+            const int i = r.integer(0, N - 1);
+            tree.update(i, box[i] + Vector3(r.uniform(-1, 1), 0, r.uniform(-1, 1)));
+        }
+        visible.fastClear();
+        tree.cull(plane[f], visible);
+    }
+    const RealTime movingTime = System::time() - t0;
+
+    printf("DynamicBVH culling %d boxes against a view frustum (%d frames, %.1f%% visible):\n", N, numFrames, 100.0f * numTree / (N * numFrames));
+    printf("  Sphere::culledBy loop:        %6.3fs\n", sphereTime);
+    printf("  AABox::culledBy loop:         %6.3fs\n", boxTime);
+    printf("  DynamicBVH::cull:             %6.3fs  (build %.3fs)\n", treeTime, buildTime);
+    printf("  DynamicBVH::cull, 2%% moving:  %6.3fs\n\n", movingTime);
+    (void)numSphere;
+}
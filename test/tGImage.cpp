@@ -0,0 +1,238 @@
+#include "G3D/G3DAll.h"
+using G3D::uint8;
+using G3D::uint32;
+
+/** Records every band delivered by GImage::decodeRows */
+class CollectRows : public GImage::RowCallback {
+public:
+    int             width;
+    int             height;
+    int             channels;
+    int             nextY;
+    int             bandHeight;
+    Array<uint8>    pixels;
+
+    CollectRows(int bandHeight) : width(0), height(0), channels(0), nextY(0), bandHeight(bandHeight) {}
+
+    virtual void beginRows(int w, int h, int c) {
+        width    = w;
+        height   = h;
+        channels = c;
+        pixels.resize(w * h * c);
+    }
+
+    virtual void processRows(int y, int numRows, const uint8* src) {
+        // Bands arrive in order, without gaps
+        debugAssert(y == nextY);
+        debugAssert((numRows > 0) && (numRows <= bandHeight));
+        System::memcpy(pixels.getCArray() + y * width * channels, src, numRows * width * channels);
+        nextY += numRows;
+    }
+};
+
+
+/** Smooth test pattern, generated a band at a time */
+class GradientRows : public GImage::RowSource {
+public:
+    int     width;
+    int     channels;
+
+    GradientRows(int width, int channels) : width(width), channels(channels) {}
+
+    static uint8 value(int x, int y, int c) {
+        return (uint8)((x * (c + 1) + y * (3 - c) + 40 * c) & 0xFF);
+    }
+
+    virtual void fetchRows(int y, int numRows, uint8* dst) {
+        for (int r = 0; r < numRows; ++r) {
+            for (int x = 0; x < width; ++x) {
+                for (int c = 0; c < channels; ++c) {
+                    *dst++ = value(x / 2, (y + r) / 2, c);
+                }
+            }
+        }
+    }
+};
+
+
+static void makeImage(GImage& im, int w, int h, int channels) {
+    im.resize(w, h, channels);
+    GradientRows source(w, channels);
+    source.fetchRows(0, h, im.byte());
+}
+
+
+/** Box filter matching decodeRows' PNG downscaling */
+static uint8 boxAverage(const GImage& im, int ox, int oy, int c, int scale) {
+    uint32 sum = 0, count = 0;
+    for (int y = oy * scale; y < iMin(im.height(), (oy + 1) * scale); ++y) {
+        for (int x = ox * scale; x < iMin(im.width(), (ox + 1) * scale); ++x) {
+            sum += im.byte()[(x + y * im.width()) * im.channels() + c];
+            ++count;
+        }
+    }
+    return (uint8)((sum + count / 2) / count);
+}
+
+
+static void testPNGRows() {
+    const int channelCount[] = {1, 3, 4};
+    for (int i = 0; i < 3; ++i) {
+        GImage im;
+        makeImage(im, 133, 71, channelCount[i]);
+
+        BinaryOutput out("<memory>", G3D_LITTLE_ENDIAN);
+        im.encode(GImage::PNG, out);
+        BinaryInput in(out.getCArray(), out.length(), G3D_LITTLE_ENDIAN);
+
+        // Lossless at full size, in bands that do not divide the height
+        {
+            CollectRows rows(10);
+            GImage::decodeRows(in, GImage::PNG, rows, 1, 10);
+            debugAssert(rows.width == 133 && rows.height == 71 && rows.channels == channelCount[i]);
+            debugAssert(rows.nextY == 71);
+            debugAssert(memcmp(rows.pixels.getCArray(), im.byte(), rows.pixels.size()) == 0);
+        }
+
+        const int scale[] = {2, 4, 8};
+        for (int s = 0; s < 3; ++s) {
+            in.setPosition(0);
+            CollectRows rows(7);
+            GImage::decodeRows(in, GImage::AUTODETECT, rows, scale[s], 7);
+            debugAssert(rows.width == iCeil(133.0f / scale[s]) && rows.height == iCeil(71.0f / scale[s]));
+            for (int y = 0; y < rows.height; ++y) {
+                for (int x = 0; x < rows.width; ++x) {
+                    for (int c = 0; c < rows.channels; ++c) {
+                        debugAssert(rows.pixels[(x + y * rows.width) * rows.channels + c] == boxAverage(im, x, y, c, scale[s]));
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+static double meanAbsDifference(const uint8* a, const uint8* b, int n) {
+    double sum = 0;
+    for (int i = 0; i < n; ++i) {
+        sum += iAbs(a[i] - b[i]);
+    }
+    return sum / n;
+}
+
+
+static void testJPEGRows() {
+    const int w = 257, h = 130;
+
+    // Encode straight from a row source, never holding the image
+    GradientRows source(w, 3);
+    BinaryOutput out("<memory>", G3D_LITTLE_ENDIAN);
+    GImage::encodeRows(w, h, 3, source, GImage::JPEG, out, 16);
+
+    GImage reference;
+    makeImage(reference, w, h, 3);
+
+    BinaryInput in(out.getCArray(), out.length(), G3D_LITTLE_ENDIAN);
+    GImage decoded(out.getCArray(), out.length(), GImage::JPEG);
+    debugAssert(decoded.width() == w && decoded.height() == h && decoded.channels() == 3);
+    debugAssert(meanAbsDifference(decoded.byte(), reference.byte(), w * h * 3) < 3.0);
+
+    // DCT-scaled decoding approximates a box filter of the full image
+    const int scale[] = {2, 4, 8};
+    for (int s = 0; s < 3; ++s) {
+        in.setPosition(0);
+        CollectRows rows(5);
+        GImage::decodeRows(in, GImage::JPEG, rows, scale[s], 5);
+        debugAssert(rows.width == iCeil((float)w / scale[s]) && rows.height == iCeil((float)h / scale[s]));
+        debugAssert(rows.nextY == rows.height);
+
+        Array<uint8> expected;
+        for (int y = 0; y < rows.height; ++y) {
+            for (int x = 0; x < rows.width; ++x) {
+                for (int c = 0; c < 3; ++c) {
+                    expected.append(boxAverage(decoded, x, y, c, scale[s]));
+                }
+            }
+        }
+        debugAssert(meanAbsDifference(rows.pixels.getCArray(), expected.getCArray(), expected.size()) < 4.0);
+    }
+
+    // Alpha is dropped and grayscale is expanded, as decode() does
+    GImage rgba;
+    makeImage(rgba, 40, 30, 4);
+    BinaryOutput out4("<memory>", G3D_LITTLE_ENDIAN);
+    rgba.encode(GImage::JPEG, out4);
+    GImage rgb(out4.getCArray(), out4.length(), GImage::JPEG);
+    debugAssert(rgb.channels() == 3 && rgb.width() == 40);
+
+    GImage gray;
+    makeImage(gray, 40, 30, 1);
+    BinaryOutput out1("<memory>", G3D_LITTLE_ENDIAN);
+    gray.encode(GImage::JPEG, out1);
+    GImage grayDecoded(out1.getCArray(), out1.length(), GImage::JPEG);
+    debugAssert(grayDecoded.channels() == 3);
+    debugAssert(abs(grayDecoded.byte()[3 * 45] - gray.byte()[45]) < 8);
+    debugAssert(grayDecoded.byte()[3 * 45] == grayDecoded.byte()[3 * 45 + 2]);
+}
+
+
+void testGImage() {
+    printf("GImage row IO ");
+
+    testPNGRows();
+    testJPEGRows();
+
+    // Other formats are rejected
+    GImage im;
+    makeImage(im, 8, 8, 3);
+    BinaryOutput out("<memory>", G3D_LITTLE_ENDIAN);
+    im.encode(GImage::BMP, out);
+    BinaryInput in(out.getCArray(), out.length(), G3D_LITTLE_ENDIAN);
+    CollectRows rows(64);
+    bool threw = false;
+    try {
+        GImage::decodeRows(in, GImage::BMP, rows);
+    } catch (const GImage::Error&) {
+        threw = true;
+    }
+    debugAssert(threw);
+    (void)threw;
+
+    printf("passed\n");
+}
+
+
+/** Discards decoded rows */
+class IgnoreRows : public GImage::RowCallback {
+public:
+    virtual void processRows(int, int, const uint8*) {}
+};
+
+
+void perfGImage() {
+    printf("----------------------------------------------------------\n");
+    const int w = 4096, h = 4096;
+    printf("GImage JPEG row IO (%dx%d):\n", w, h);
+
+    GradientRows source(w, 3);
+    BinaryOutput out("<memory>", G3D_LITTLE_ENDIAN);
+    RealTime t0 = System::time();
+    GImage::encodeRows(w, h, 3, source, GImage::JPEG, out);
+    printf("  encodeRows                 %7.1f ms (%d-row band buffer instead of a %d MB image)\n", 
+           (System::time() - t0) * 1000, 64, w * h * 3 / (1024 * 1024));
+
+    BinaryInput in(out.getCArray(), out.length(), G3D_LITTLE_ENDIAN);
+    t0 = System::time();
+    GImage full(out.getCArray(), out.length(), GImage::JPEG);
+    printf("  decode full image          %7.1f ms\n", (System::time() - t0) * 1000);
+
+    const int scale[] = {1, 2, 4, 8};
+    for (int s = 0; s < 4; ++s) {
+        in.setPosition(0);
+        IgnoreRows ignore;
+        t0 = System::time();
+        GImage::decodeRows(in, GImage::JPEG, ignore, scale[s]);
+        printf("  decodeRows at 1/%d        %7.1f ms\n", scale[s], (System::time() - t0) * 1000);
+    }
+    printf("\n");
+}
@@ -58,6 +58,215 @@ static void printBoard(const Color4* b, int S) {
 #define RECAST reinterpret_cast<void*>
 
 
+/** A conversion with a SIMD kernel, and the row padding that its converter accepts */
+class SIMDConversion {
+public:
+    const ImageFormat*  src;
+    const ImageFormat*  dst;
+    int                 srcRowPadBits;
+    int                 dstRowPadBits;
+};
+
+static const int NUM_SIMD_CONVERSIONS = 14;
+
+static const SIMDConversion* simdConversions() {
+    static const SIMDConversion c[NUM_SIMD_CONVERSIONS] = {
+        {ImageFormat::L8(),      ImageFormat::RGB8(),          0,  0},
+        {ImageFormat::RGB8(),    ImageFormat::RGBA8(),         0,  0},
+        {ImageFormat::RGB8(),    ImageFormat::BGR8(),          0,  0},
+        {ImageFormat::BGR8(),    ImageFormat::RGB8(),          0,  0},
+        {ImageFormat::BGR8(),    ImageFormat::RGBA8(),         0,  0},
+        {ImageFormat::RGBA8(),   ImageFormat::RGB8(),          0,  0},
+        {ImageFormat::RGBA8(),   ImageFormat::BGR8(),          0,  0},
+        {ImageFormat::RGB8(),    ImageFormat::RGBA32F(),       24, 0},
+        {ImageFormat::BGR8(),    ImageFormat::RGBA32F(),       8,  0},
+        {ImageFormat::RGBA8(),   ImageFormat::RGBA32F(),       32, 0},
+        {ImageFormat::RGBA32F(), ImageFormat::RGB8(),          0,  8},
+        {ImageFormat::RGBA32F(), ImageFormat::RGBA8(),         0,  24},
+        {ImageFormat::RGBA32F(), ImageFormat::BGR8(),          0,  16},
+        {ImageFormat::RGB8(),    ImageFormat::YUV420_PLANAR(), 0,  0}};
+    return c;
+}
+
+
+/** Allocates the planes of a w x h image; only YUV420_PLANAR has more than one */
+static void allocatePlanes(const ImageFormat* format, int w, int h, int rowPadBits, Array<uint8*>& plane, Array<int>& planeBytes) {
+    if (format == ImageFormat::YUV420_PLANAR()) {
+        planeBytes.append(w * h, w * h / 4, w * h / 4);
+    } else {
+        planeBytes.append((w * format->cpuBitsPerPixel + rowPadBits) * h / 8);
+    }
+    for (int p = 0; p < planeBytes.size(); ++p) {
+        plane.append((uint8*)System::malloc(planeBytes[p]));
+    }
+}
+
+
+static void freePlanes(Array<uint8*>& plane) {
+    for (int p = 0; p < plane.size(); ++p) {
+        System::free(plane[p]);
+    }
+    plane.clear();
+}
+
+
+/** Random pixels.  Floats include values outside [0, 1] and exact multiples of 1/256 */
+static void randomize(const ImageFormat* format, uint8* data, int numBytes, Random& rnd) {
+    if (format->floatingPoint) {
+        float* f = reinterpret_cast<float*>(data);
+        for (int i = 0; i < numBytes / 4; ++i) {
+            switch (rnd.integer(0, 3)) {
+            case 0:
+                f[i] = rnd.integer(-4, 260) / 256.0f;
+                break;
+            case 1:
+                f[i] = rnd.uniform(-0.1f, 1.1f);
+                break;
+            default:
+                f[i] = rnd.uniform();
+            }
+        }
+    } else {
+        for (int i = 0; i < numBytes; ++i) {
+            data[i] = (uint8)rnd.integer(0, 255);
+        }
+    }
+}
+
+
+/** Every SIMD kernel must produce exactly the bytes of the scalar reference */
+static void testSIMDConformance() {
+    const ImageFormat::SIMDLevel best = ImageFormat::convertSIMDLevel();
+    Random rnd(1234);
+
+    const int numSizes = 6;
+    const int width[numSizes]  = {2, 6, 18, 34, 62, 100};
+    const int height[numSizes] = {2, 4, 2,  6,  4,  10};
+
+    for (int c = 0; c < NUM_SIMD_CONVERSIONS; ++c) {
+        const SIMDConversion& conversion = simdConversions()[c];
+        for (int s = 0; s < numSizes; ++s) {
+            // Odd widths too, where the format allows them
+            const int w = (conversion.dst == ImageFormat::YUV420_PLANAR()) ? width[s] : width[s] + (s & 1);
+            const int h = height[s];
+
+            for (int pass = 0; pass < 3; ++pass) {
+                const bool invertY = (pass == 1) && (conversion.dst != ImageFormat::YUV420_PLANAR());
+                const int srcPad   = (pass == 2) ? conversion.srcRowPadBits : 0;
+                const int dstPad   = (pass == 2) ? conversion.dstRowPadBits : 0;
+
+                Array<uint8*> src;
+                Array<int> srcBytes;
+                allocatePlanes(conversion.src, w, h, srcPad, src, srcBytes);
+                randomize(conversion.src, src[0], srcBytes[0], rnd);
+                Array<const void*> input;
+                input.append(src[0]);
+
+                Array<uint8*> expected[ImageFormat::SIMD_SSSE3 + 1];
+                Array<int> dstBytes;
+                for (int level = ImageFormat::SIMD_NONE; level <= best; ++level) {
+                    dstBytes.clear();
+                    allocatePlanes(conversion.dst, w, h, dstPad, expected[level], dstBytes);
+                    Array<void*> output;
+                    for (int p = 0; p < expected[level].size(); ++p) {
+                        // Padding bytes are not written by the converters
+                        System::memset(expected[level][p], 0, dstBytes[p]);
+                        output.append(expected[level][p]);
+                    }
+
+                    ImageFormat::setConvertSIMDLevel((ImageFormat::SIMDLevel)level);
+                    bool ok = ImageFormat::convert(input, w, h, conversion.src, srcPad, output, conversion.dst, dstPad, invertY);
+                    debugAssert(ok); (void)ok;
+
+                    for (int p = 0; p < dstBytes.size(); ++p) {
+                        debugAssertM(memcmp(expected[level][p], expected[ImageFormat::SIMD_NONE][p], dstBytes[p]) == 0,
+                                     format("%s -> %s differs from the reference at SIMD level %d (%dx%d)",
+                                            conversion.src->name().c_str(), conversion.dst->name().c_str(), level, w, h));
+                    }
+                }
+
+                for (int level = ImageFormat::SIMD_NONE; level <= best; ++level) {
+                    freePlanes(expected[level]);
+                }
+                freePlanes(src);
+            }
+        }
+    }
+
+    ImageFormat::setConvertSIMDLevel(best);
+    debugAssert(ImageFormat::convertSIMDLevel() == best);
+}
+
+
+
+/** Banded conversion must produce exactly the bytes of a serial conversion,
+    and invertY must flip the rows. */
+static void testParallelConversion() {
+    Random rnd(4321);
+
+    for (int c = 0; c < NUM_SIMD_CONVERSIONS; ++c) {
+        const SIMDConversion& conversion = simdConversions()[c];
+        const bool yuv = (conversion.dst == ImageFormat::YUV420_PLANAR());
+
+        // Large enough to be split, with an odd height where the format allows it
+        const int w = 700;
+        const int h = yuv ? 400 : 401;
+
+        for (int pass = 0; pass < 3; ++pass) {
+            const bool invertY = (pass == 1) && ! yuv;
+            const int srcPad   = (pass == 2) ? conversion.srcRowPadBits : 0;
+            const int dstPad   = (pass == 2) ? conversion.dstRowPadBits : 0;
+
+            Array<uint8*> src;
+            Array<int> srcBytes;
+            allocatePlanes(conversion.src, w, h, srcPad, src, srcBytes);
+            randomize(conversion.src, src[0], srcBytes[0], rnd);
+            Array<const void*> input;
+            input.append(src[0]);
+
+            Array<uint8*> dst[2];
+            Array<int> dstBytes;
+            for (int parallel = 0; parallel < 2; ++parallel) {
+                dstBytes.clear();
+                allocatePlanes(conversion.dst, w, h, dstPad, dst[parallel], dstBytes);
+                Array<void*> output;
+                for (int p = 0; p < dst[parallel].size(); ++p) {
+                    System::memset(dst[parallel][p], 0, dstBytes[p]);
+                    output.append(dst[parallel][p]);
+                }
+                bool ok = ImageFormat::convert(input, w, h, conversion.src, srcPad, output, conversion.dst, dstPad,
+                                               invertY, ImageFormat::BayerAlgorithm::MHC, parallel == 1);
+                debugAssert(ok); (void)ok;
+            }
+
+            for (int p = 0; p < dstBytes.size(); ++p) {
+                debugAssertM(memcmp(dst[0][p], dst[1][p], dstBytes[p]) == 0,
+                             format("Parallel %s -> %s differs from serial (pass %d)",
+                                    conversion.src->name().c_str(), conversion.dst->name().c_str(), pass));
+            }
+
+            if (pass == 0 && ! yuv) {
+                // The first row converted with invertY must match the last row converted without it
+                const int rowBytes = w * conversion.dst->cpuBitsPerPixel / 8;
+                Array<uint8*> flipped;
+                allocatePlanes(conversion.dst, w, h, 0, flipped, dstBytes);
+                Array<void*> output;
+                output.append(flipped[0]);
+                ImageFormat::convert(input, w, h, conversion.src, 0, output, conversion.dst, 0, true);
+                debugAssertM(memcmp(flipped[0], dst[0][0] + (h - 1) * rowBytes, rowBytes) == 0,
+                             format("%s -> %s ignores invertY", 
+                                    conversion.src->name().c_str(), conversion.dst->name().c_str()));
+                freePlanes(flipped);
+            }
+
+            freePlanes(dst[0]);
+            freePlanes(dst[1]);
+            freePlanes(src);
+        }
+    }
+}
+
+
 
 void testImageConvert() {
 
@@ -153,11 +362,86 @@ void testImageConvert() {
 
 
 
+    testSIMDConformance();
+    testParallelConversion();
+
     printf("passed\n");
 }
 
 
-void perfTest() {
-    printf("ImageFormat::convert performance test is not implemented.");
+void perfImageConvert() {
+    printf("----------------------------------------------------------\n");
+    const ImageFormat::SIMDLevel best = ImageFormat::convertSIMDLevel();
+    const char* levelName[] = {"scalar", "SSE2", "SSSE3"};
+    printf("ImageFormat::convert throughput (1920x1080, Mpixel/s; this CPU supports %s):\n", levelName[best]);
+
+    const int w = 1920, h = 1080, trials = 5;
+    Random rnd(5);
+
+    for (int c = 0; c < NUM_SIMD_CONVERSIONS; ++c) {
+        const SIMDConversion& conversion = simdConversions()[c];
+
+        Array<uint8*> src, dst;
+        Array<int> srcBytes, dstBytes;
+        allocatePlanes(conversion.src, w, h, 0, src, srcBytes);
+        allocatePlanes(conversion.dst, w, h, 0, dst, dstBytes);
+        randomize(conversion.src, src[0], srcBytes[0], rnd);
+
+        Array<const void*> input;
+        input.append(src[0]);
+        Array<void*> output;
+        for (int p = 0; p < dst.size(); ++p) {
+            output.append(dst[p]);
+        }
 
+        printf("  %-8s -> %-14s", conversion.src->name().c_str(), conversion.dst->name().c_str());
+        for (int level = ImageFormat::SIMD_NONE; level <= best; ++level) {
+            ImageFormat::setConvertSIMDLevel((ImageFormat::SIMDLevel)level);
+            RealTime t0 = System::time();
+            for (int t = 0; t < trials; ++t) {
+                ImageFormat::convert(input, w, h, conversion.src, 0, output, conversion.dst, 0);
+            }
+            const RealTime elapsed = System::time() - t0;
+            printf("  %s %7.1f", levelName[level], w * h * trials / elapsed / 1e6);
+        }
+        printf("\n");
+
+        freePlanes(src);
+        freePlanes(dst);
+    }
+    ImageFormat::setConvertSIMDLevel(best);
+    printf("\n");
+
+    printf("ImageFormat::convert serial vs. parallel (3840x2160 RGBA32F -> RGB8, %d TaskScheduler workers):\n", 
+           TaskScheduler::global()->numWorkers());
+    {
+        const int w = 3840, h = 2160;
+        Array<uint8*> src, dst;
+        Array<int> srcBytes, dstBytes;
+        allocatePlanes(ImageFormat::RGBA32F(), w, h, 0, src, srcBytes);
+        allocatePlanes(ImageFormat::RGB8(), w, h, 0, dst, dstBytes);
+        randomize(ImageFormat::RGBA32F(), src[0], srcBytes[0], rnd);
+
+        Array<const void*> input;
+        input.append(src[0]);
+        Array<void*> output;
+        output.append(dst[0]);
+
+        RealTime elapsed[2];
+        for (int parallel = 0; parallel < 2; ++parallel) {
+            RealTime t0 = System::time();
+            for (int t = 0; t < trials; ++t) {
+                ImageFormat::convert(input, w, h, ImageFormat::RGBA32F(), 0, output, ImageFormat::RGB8(), 0,
+                                     false, ImageFormat::BayerAlgorithm::MHC, parallel == 1);
+            }
+            elapsed[parallel] = (System::time() - t0) / trials;
+        }
+        printf("  serial %6.2f ms, parallel %6.2f ms (%.1fx)\n\n", 
+               elapsed[0] * 1000, elapsed[1] * 1000, elapsed[0] / elapsed[1]);
+
+        freePlanes(src);
+        freePlanes(dst);
+    }
 }
+
+
@@ -0,0 +1,253 @@
+#include "G3D/G3DAll.h"
+#include <cstdio>
+#ifdef G3D_WIN32
+#   include <sys/utime.h>
+#else
+#   include <utime.h>
+#endif
+using G3D::uint8;
+using G3D::uint32;
+using G3D::int64;
+
+/** Writes a w x h test pattern that differs for each \a seed */
+static void writePattern(const std::string& filename, int w, int h, int seed) {
+    GImage im(w, h, 3);
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            im.pixel3(x, y) = Color3uint8((x * 3 + seed * 40) & 0xFF, (y * 5 + seed) & 0xFF, ((x + y) * 7) & 0xFF);
+        }
+    }
+    im.save(filename);
+}
+
+
+static void setModificationTime(const std::string& filename, int64 t) {
+#   ifdef G3D_WIN32
+        struct _utimbuf times;
+        times.actime  = (time_t)t;
+        times.modtime = (time_t)t;
+        _utime(filename.c_str(), &times);
+#   else
+        struct utimbuf times;
+        times.actime  = (time_t)t;
+        times.modtime = (time_t)t;
+        utime(filename.c_str(), &times);
+#   endif
+}
+
+
+static bool sameImage(const GImage& a, const GImage& b) {
+    return (a.width() == b.width()) && (a.height() == b.height()) && (a.channels() == b.channels()) &&
+        (memcmp(a.byte(), b.byte(), a.width() * a.height() * a.channels()) == 0);
+}
+
+
+static void testBatch(Array<std::string>& filename) {
+    ImageLoader::Ref loader = ImageLoader::create();
+
+    Array<ImageLoader::Future::Ref> future;
+    loader->load(filename, future);
+    debugAssert(future.size() == filename.size());
+    debugAssert(loader->numCacheMisses() == filename.size());
+
+    for (int i = 0; i < future.size(); ++i) {
+        debugAssert(! future[i]->failed());
+        debugAssert(sameImage(future[i]->image(), GImage(filename[i])));
+    }
+
+    // Unchanged files come from the cache
+    Array<ImageLoader::Future::Ref> again;
+    loader->load(filename, again);
+    for (int i = 0; i < future.size(); ++i) {
+        debugAssert(again[i] == future[i]);
+    }
+    debugAssert(loader->numCacheHits() == filename.size());
+    debugAssert(loader->numCacheMisses() == filename.size());
+
+    // Relative and absolute paths share an entry
+    ImageLoader::Future::Ref absolute = loader->load(FileSystem::resolve(filename[0]));
+    debugAssert(absolute == future[0]);
+
+    // A modified file is decoded again
+    writePattern(filename[0], 40, 30, 99);
+    setModificationTime(filename[0], FileSystem::modificationTime(filename[0]) + 10);
+    ImageLoader::Future::Ref modified = loader->load(filename[0]);
+    debugAssert(modified != future[0]);
+    debugAssert(modified->image().width() == 40);
+    debugAssert(sameImage(modified->image(), GImage(filename[0])));
+    // ...but the old Future is unaffected
+    debugAssert(future[0]->image().width() != 40);
+
+    // Missing files fail without a task
+    ImageLoader::Future::Ref missing = loader->load("imageLoader-does-not-exist.png");
+    debugAssert(missing->isReady() && missing->failed());
+    debugAssert(missing->image().width() == 0);
+
+    // Files inside zipfiles are readable; this one is not an image
+    if (FileSystem::exists("apiTest.zip")) {
+        debugAssert(FileSystem::modificationTime("apiTest.zip/Test.txt") > 0);
+        ImageLoader::Future::Ref text = loader->load("apiTest.zip/Test.txt");
+        debugAssert(text->failed());
+        debugAssert(text->error() != "File not found.");
+    }
+}
+
+
+static void testEviction(const Array<std::string>& filename) {
+    // Each image is 64x64x3 bytes plus the GImage header
+    const int64 imageSize = GImage(64, 64, 3).sizeInMemory();
+    ImageLoader::Ref loader = ImageLoader::create(imageSize * 2);
+
+    // Release each Future immediately, so that only the cache retains it
+    for (int i = 0; i < 3; ++i) {
+        loader->load(filename[i])->wait();
+    }
+    loader->trimCache();
+    debugAssert(loader->cacheSize() == imageSize * 2);
+    debugAssert(loader->numCacheMisses() == 3);
+
+    // The least recently used image was evicted
+    loader->load(filename[2])->wait();
+    loader->load(filename[1])->wait();
+    debugAssert(loader->numCacheHits() == 2);
+    loader->load(filename[0])->wait();
+    debugAssert(loader->numCacheMisses() == 4);
+
+    // filename[2] is now the oldest
+    loader->trimCache();
+    loader->load(filename[1])->wait();
+    debugAssert(loader->numCacheHits() == 3);
+    loader->load(filename[2])->wait();
+    debugAssert(loader->numCacheMisses() == 5);
+
+    loader->setMaxCacheSize(0);
+    loader->trimCache();
+    debugAssert(loader->cacheSize() == 0);
+
+    loader->setMaxCacheSize(imageSize * 4);
+    loader->load(filename[3]);
+    loader->clearCache();
+    debugAssert(loader->cacheSize() == 0);
+}
+
+
+static void testTrimOnCompletion(const Array<std::string>& filename) {
+    const int64 imageSize = GImage(64, 64, 3).sizeInMemory();
+    // The trims that follow each decode run on this scheduler's workers
+    ImageLoader::Ref loader = ImageLoader::create(imageSize * 2, TaskScheduler::create(2));
+
+    {
+        Array<ImageLoader::Future::Ref> future;
+        loader->load(filename, future);
+        for (int i = 0; i < future.size(); ++i) {
+            future[i]->wait();
+        }
+    }
+
+    // The batch alone, with no further load() or trimCache(), brings the cache back under its limit
+    const RealTime timeout = System::time() + 10.0;
+    while ((loader->cacheSize() > imageSize * 2) && (System::time() < timeout)) {
+        System::sleep(0.001);
+    }
+    debugAssert(loader->cacheSize() <= imageSize * 2);
+    debugAssert(loader->numCacheMisses() == filename.size());
+}
+
+
+static void testConcurrentFileSystem(const Array<std::string>& filename) {
+    ImageLoader::Ref loader = ImageLoader::create(0, TaskScheduler::create(2));
+
+    Array<ImageLoader::Future::Ref> future;
+    loader->load(filename, future);
+
+    // FileSystem serializes its own calls, so this thread needs no
+    // lock while the workers open files
+    bool pending = true;
+    while (pending) {
+        FileSystem::clearCache();
+        debugAssert(FileSystem::exists(filename[0]));
+        pending = false;
+        for (int i = 0; i < future.size(); ++i) {
+            pending = pending || ! future[i]->isReady();
+        }
+    }
+
+    for (int i = 0; i < future.size(); ++i) {
+        debugAssert(sameImage(future[i]->image(), GImage(filename[i])));
+    }
+}
+
+
+static void makeFiles(int n, int w, int h, Array<std::string>& filename) {
+    filename.fastClear();
+    for (int i = 0; i < n; ++i) {
+        filename.append(format("imageLoader-%d.%s", i, (i & 1) ? "jpg" : "png"));
+        writePattern(filename.last(), w, h, i);
+    }
+}
+
+
+static void removeFiles(const Array<std::string>& filename) {
+    for (int i = 0; i < filename.size(); ++i) {
+        ::remove(filename[i].c_str());
+    }
+}
+
+
+void testImageLoader() {
+    printf("ImageLoader ");
+
+    Array<std::string> filename;
+    makeFiles(6, 64, 64, filename);
+
+    testBatch(filename);
+
+    // testBatch modified filename[0]
+    makeFiles(6, 64, 64, filename);
+    testEviction(filename);
+    testTrimOnCompletion(filename);
+    testConcurrentFileSystem(filename);
+
+    removeFiles(filename);
+
+    printf("passed\n");
+}
+
+
+void perfImageLoader() {
+    printf("----------------------------------------------------------\n");
+    printf("ImageLoader (32 files, 512x512):\n");
+
+    Array<std::string> filename;
+    makeFiles(32, 512, 512, filename);
+
+    RealTime t0 = System::time();
+    for (int i = 0; i < filename.size(); ++i) {
+        GImage im(filename[i]);
+    }
+    const RealTime serialTime = System::time() - t0;
+
+    ImageLoader::Ref loader = ImageLoader::create();
+    Array<ImageLoader::Future::Ref> future;
+    t0 = System::time();
+    loader->load(filename, future);
+    for (int i = 0; i < future.size(); ++i) {
+        future[i]->wait();
+    }
+    const RealTime batchTime = System::time() - t0;
+
+    future.fastClear();
+    t0 = System::time();
+    loader->load(filename, future);
+    for (int i = 0; i < future.size(); ++i) {
+        future[i]->wait();
+    }
+    const RealTime cachedTime = System::time() - t0;
+
+    printf("  GImage serial:       %6.3fs\n", serialTime);
+    printf("  ImageLoader batch:   %6.3fs (%d TaskScheduler workers)\n", batchTime, TaskScheduler::global()->numWorkers());
+    printf("  ImageLoader cached:  %6.3fs\n\n", cachedTime);
+
+    future.fastClear();
+    removeFiles(filename);
+}
@@ -88,6 +88,102 @@ static void testSerialize() {
 }
 
 
+static void testFreeze() {
+    KDTree<AABox> tree;
+    for (int i = 0; i < 2000; ++i) {
+        const Vector3 pt(uniformRandom(-10, 10), uniformRandom(-10, 10), uniformRandom(-10, 10));
+        tree.insert(AABox(pt, pt + Vector3(uniformRandom(0, 1), uniformRandom(0, 1), uniformRandom(0, 1))));
+    }
+    tree.balance();
+
+    Array<Plane> plane;
+    plane.append(Plane(Vector3(-1, 0, 0), Vector3(3, 1, 1)));
+    plane.append(Plane(Vector3(1, 0, 0), Vector3(-4, 1, 1)));
+    plane.append(Plane(Vector3(0, 0, -1), Vector3(1, 1, 3)));
+    plane.append(Plane(Vector3(0, 1, 0), Vector3(1, -3, 1)));
+
+    const AABox box(Vector3(-2, -1, 0), Vector3(3, 3, 4));
+    const Sphere sphere(Vector3(1, 2, -1), 3.5f);
+
+    Array<AABox*> before[3], after[3];
+    tree.getIntersectingMembers(box, before[0]);
+    tree.getIntersectingMembers(sphere, before[1]);
+    tree.getIntersectingMembers(plane, before[2]);
+
+    tree.freeze();
+    debugAssert(tree.isFrozen());
+    tree.getIntersectingMembers(box, after[0]);
+    tree.getIntersectingMembers(sphere, after[1]);
+    tree.getIntersectingMembers(plane, after[2]);
+
+    for (int q = 0; q < 3; ++q) {
+        // Traversal order differs, so compare sorted pointers
+        before[q].sort();
+        after[q].sort();
+        debugAssert(before[q].size() > 0);
+        debugAssert(before[q].size() == after[q].size());
+        for (int i = 0; i < before[q].size(); ++i) {
+            debugAssert(before[q][i] == after[q][i]);
+        }
+    }
+
+    // Round trip the flat structure, then refill and refreeze
+    BinaryOutput bo("<memory>", G3D_LITTLE_ENDIAN);
+    tree.serializeStructure(bo);
+    BinaryInput bi(bo.getCArray(), bo.length(), G3D_LITTLE_ENDIAN);
+
+    KDTree<AABox> copy;
+    copy.deserializeStructure(bi);
+    Array<AABox> members;
+    tree.getMembers(members);
+    for (int i = 0; i < members.size(); ++i) {
+        copy.insert(members[i]);
+    }
+    copy.freeze();
+
+    Array<AABox> a, b;
+    tree.getIntersectingMembers(box, a);
+    copy.getIntersectingMembers(box, b);
+    debugAssert(a.size() == before[0].size());
+    debugAssert(b.size() == a.size());
+
+    {
+        // Corrupt structures throw instead of building a broken tree.
+        // Records begin after the tag and count; each is 12 bytes,
+        // and the high child is at offset 8.
+        Array<uint8> data;
+        data.resize(bo.length());
+        System::memcpy(data.getCArray(), bo.getCArray(), bo.length());
+
+        // The root's high child refers to the root
+        int32 self = 0;
+        System::memcpy(data.getCArray() + 5 + 8, &self, sizeof(int32));
+        BinaryInput corrupt(data.getCArray(), data.size(), G3D_LITTLE_ENDIAN);
+        bool threw = false;
+        try {
+            copy.deserializeStructure(corrupt);
+        } catch (const char*) {
+            threw = true;
+        }
+        debugAssert(threw);
+
+        // The count exceeds the data
+        BinaryInput truncated(bo.getCArray(), bo.length() - 12, G3D_LITTLE_ENDIAN);
+        threw = false;
+        try {
+            copy.deserializeStructure(truncated);
+        } catch (const char*) {
+            threw = true;
+        }
+        debugAssert(threw);
+    }
+
+    // Modification thaws
+    tree.remove(members[0]);
+    debugAssert(! tree.isFrozen());
+}
+
+
 static void testBoxIntersect() {
 
 	KDTree<Vector3> tree;
@@ -140,7 +236,11 @@ void perfKDTree() {
     RealTime t1 = System::time();
     printf("KDTree<AABox>::balance() time for %d boxes: %gs\n\n", NUM_POINTS, t1 - t0);
 
-    uint64 bspcount = 0, arraycount = 0, boxcount = 0;
+    KDTree<AABox> frozenTree;
+    frozenTree.setContents(array);
+    frozenTree.freeze();
+
+    uint64 bspcount = 0, arraycount = 0, boxcount = 0, frozenbspcount = 0, frozenboxcount = 0;
 
     // Run twice to get cache issues out of the way
     for (int it = 0; it < 2; ++it) {
@@ -168,6 +268,18 @@ void perfKDTree() {
 
         point.clear();
 
+        System::beginCycleCount(frozenbspcount);
+        frozenTree.getIntersectingMembers(plane, point);
+        System::endCycleCount(frozenbspcount);
+
+        point.clear();
+
+        System::beginCycleCount(frozenboxcount);
+        frozenTree.getIntersectingMembers(box, point);
+        System::endCycleCount(frozenboxcount);
+
+        point.clear();
+
         System::beginCycleCount(arraycount);
         for (int i = 0; i < array.size(); ++i) {
             if (! array[i].culledBy(plane)) {
@@ -179,9 +291,13 @@ void perfKDTree() {
 
     printf("KDTree<AABox>::getIntersectingMembers(plane) %g Mcycles\n"
            "KDTree<AABox>::getIntersectingMembers(box)   %g Mcycles\n"
+           "Frozen getIntersectingMembers(plane)         %g Mcycles\n"
+           "Frozen getIntersectingMembers(box)           %g Mcycles\n"
            "Culled by on Array<AABox>                       %g Mcycles\n\n", 
            bspcount / 1e6, 
            boxcount / 1e6,
+           frozenbspcount / 1e6, 
+           frozenboxcount / 1e6,
            arraycount / 1e6);
 }
 
@@ -197,6 +313,7 @@ public:
 
 void testRayIntersect() {
     KDTree<Triangle> tree;
+    KDTree<Triangle> frozenTree;
 
     std::string name;
     Array<int> index;
@@ -211,11 +328,15 @@ void testRayIntersect() {
         int i1 = index[i + 1];
         int i2 = index[i + 2];
         tree.insert(Triangle(vertex[i0], vertex[i1], vertex[i2]));
+        frozenTree.insert(Triangle(vertex[i0], vertex[i1], vertex[i2]));
     }
     printf("balance tree, ");
     fflush(stdout);
     tree.balance();
 
+    frozenTree.balance();
+    frozenTree.freeze();
+
     Vector3 origin = Vector3(0, 5, 0);
     IntersectCallback intersectCallback;
     printf("raytrace, ");
@@ -248,6 +369,9 @@ void testRayIntersect() {
         float treeDistance2 = inf();
         tree.intersectRay(ray, intersectCallback, treeDistance2, false);
 
+        float frozenDistance = inf();
+        frozenTree.intersectRay(ray, intersectCallback, frozenDistance, false);
+
         debugAssertM(fuzzyEq(treeDistance, exhaustiveDistance),
                      format("KDTree::intersectRay found a point at %f, "
                             "exhaustive ray intersection found %f.",
@@ -257,6 +381,11 @@ void testRayIntersect() {
                      format("KDTree::intersectRay found a point at %f, "
                             "exhaustive ray intersection found %f.",
                             treeDistance2, exhaustiveDistance));
+
+        debugAssertM(fuzzyEq(frozenDistance, exhaustiveDistance),
+                     format("Frozen KDTree::intersectRay found a point at %f, "
+                            "exhaustive ray intersection found %f.",
+                            frozenDistance, exhaustiveDistance));
     }
     printf("done) ");
 }
@@ -268,6 +397,7 @@ void testKDTree() {
     testRayIntersect();
     testBoxIntersect();
     testSerialize();
+    testFreeze();
 
     printf("passed\n");
 }
@@ -0,0 +1,276 @@
+#include "G3D/G3DAll.h"
+using G3D::uint8;
+using G3D::uint32;
+using G3D::uint64;
+
+static void yieldThread() {
+#   ifdef G3D_WIN32
+        Sleep(0);
+#   else
+        sched_yield();
+#   endif
+}
+
+
+/** Values pushed by each producer thread */
+static const int NUM_VALUES = 200000;
+
+template<class Q>
+class Producer {
+public:
+    Q*          queue;
+    /** Pushes (id << 24) | i for i in [0, NUM_VALUES) */
+    int         id;
+
+    static void run(void* p) {
+        Producer* self = (Producer*)p;
+        for (int i = 0; i < NUM_VALUES; ++i) {
+            const int value = (self->id << 24) | i;
+            while (! self->queue->pushBack(value)) {
+                yieldThread();
+            }
+        }
+    }
+};
+
+
+template<class Q>
+class Consumer {
+public:
+    Q*              queue;
+    int             numProducers;
+    AtomicInt32*    remaining;
+
+    /** Sum of the values popped */
+    uint64          sum;
+    /** True if the values from some producer arrived out of order */
+    bool            outOfOrder;
+
+    static void run(void* p) {
+        Consumer* self = (Consumer*)p;
+        self->sum = 0;
+        self->outOfOrder = false;
+
+        Array<int> last;
+        last.resize(self->numProducers);
+        for (int i = 0; i < last.size(); ++i) {
+            last[i] = -1;
+        }
+
+        while (self->remaining->value() > 0) {
+            int value;
+            if (self->queue->popFront(value)) {
+                self->remaining->sub(1);
+                const int id = value >> 24;
+                const int i  = value & 0xFFFFFF;
+                self->outOfOrder = self->outOfOrder || (i <= last[id]);
+                last[id] = i;
+                self->sum += value;
+            } else {
+                yieldThread();
+            }
+        }
+    }
+};
+
+
+/** Runs numProducers and numConsumers threads through q, and returns the time taken */
+template<class Q>
+static RealTime runThreads(Q& q, int numProducers, int numConsumers) {
+    Array<Producer<Q> > producer;
+    producer.resize(numProducers);
+    Array<Consumer<Q> > consumer;
+    consumer.resize(numConsumers);
+    AtomicInt32 remaining(numProducers * NUM_VALUES);
+
+    Array<GThreadRef> thread;
+    for (int c = 0; c < numConsumers; ++c) {
+        consumer[c].queue        = &q;
+        consumer[c].numProducers = numProducers;
+        consumer[c].remaining    = &remaining;
+        thread.append(GThread::create("Consumer", &Consumer<Q>::run, &consumer[c]));
+    }
+    for (int p = 0; p < numProducers; ++p) {
+        producer[p].queue = &q;
+        producer[p].id    = p;
+        thread.append(GThread::create("Producer", &Producer<Q>::run, &producer[p]));
+    }
+
+    const RealTime t0 = System::time();
+    for (int t = 0; t < thread.size(); ++t) {
+        thread[t]->start();
+    }
+    for (int t = 0; t < thread.size(); ++t) {
+        thread[t]->waitForCompletion();
+    }
+    const RealTime elapsed = System::time() - t0;
+
+    uint64 expected = 0;
+    for (int p = 0; p < numProducers; ++p) {
+        for (int i = 0; i < NUM_VALUES; ++i) {
+            expected += (p << 24) | i;
+        }
+    }
+
+    uint64 sum = 0;
+    for (int c = 0; c < numConsumers; ++c) {
+        // Each producer's values must come out in order
+        debugAssert(! consumer[c].outOfOrder);
+        sum += consumer[c].sum;
+    }
+    debugAssert(sum == expected);
+    debugAssert(q.empty());
+    (void)expected;
+
+    return elapsed;
+}
+
+
+template<class Q>
+static void testSingleThreaded() {
+    Q q(5);
+    debugAssert(q.capacity() == 8);
+    debugAssert(q.empty());
+
+    int x = -1;
+    debugAssert(! q.popFront(x));
+    debugAssert(x == -1);
+
+    // Wrap around several times, filling the queue completely
+    int next = 0, expected = 0;
+    for (int lap = 0; lap < 5; ++lap) {
+        while (q.pushBack(next)) {
+            ++next;
+        }
+        debugAssert(q.size() == 8);
+        for (int i = 0; i < 5; ++i) {
+            bool ok = q.popFront(x);
+            debugAssert(ok && (x == expected));
+            (void)ok;
+            ++expected;
+        }
+        debugAssert(q.size() == 3);
+    }
+    while (q.popFront(x)) {
+        debugAssert(x == expected);
+        ++expected;
+    }
+    debugAssert(expected == next);
+    debugAssert(q.empty());
+}
+
+
+class QueueItem : public ReferenceCountedObject {
+public:
+    static int  numAlive;
+    QueueItem()  { ++numAlive; }
+    ~QueueItem() { --numAlive; }
+};
+
+int QueueItem::numAlive = 0;
+
+/** Popped values must not be retained by the queue */
+template<class Q>
+static void testReferenceRelease() {
+    Q q(4);
+    q.pushBack(ReferenceCountedPointer<QueueItem>(new QueueItem()));
+    q.pushBack(ReferenceCountedPointer<QueueItem>(new QueueItem()));
+    debugAssert(QueueItem::numAlive == 2);
+    {
+        ReferenceCountedPointer<QueueItem> item;
+        q.popFront(item);
+        q.popFront(item);
+    }
+    debugAssert(QueueItem::numAlive == 0);
+}
+
+
+void testLockFreeQueue() {
+    printf("SPSCQueue, MPMCQueue ");
+
+    testSingleThreaded<SPSCQueue<int> >();
+    testSingleThreaded<MPMCQueue<int> >();
+    testReferenceRelease<SPSCQueue<ReferenceCountedPointer<QueueItem> > >();
+    testReferenceRelease<MPMCQueue<ReferenceCountedPointer<QueueItem> > >();
+
+    {
+        SPSCQueue<int> q(64);
+        runThreads(q, 1, 1);
+    }
+    {
+        MPMCQueue<int> q(64);
+        runThreads(q, 3, 2);
+    }
+
+    printf("passed\n");
+}
+
+
+/** Queue protected by a GMutex, for comparison */
+class LockedQueue {
+public:
+    GMutex          mutex;
+    Queue<int>      queue;
+    int             maxSize;
+
+    LockedQueue(int maxSize) : maxSize(maxSize) {}
+
+    bool pushBack(int x) {
+        GMutexLock lock(&mutex);
+        if (queue.size() == maxSize) {
+            return false;
+        }
+        queue.pushBack(x);
+        return true;
+    }
+
+    bool popFront(int& x) {
+        GMutexLock lock(&mutex);
+        if (queue.size() == 0) {
+            return false;
+        }
+        x = queue.popFront();
+        return true;
+    }
+
+    bool empty() {
+        GMutexLock lock(&mutex);
+        return queue.size() == 0;
+    }
+};
+
+
+void perfLockFreeQueue() {
+    printf("----------------------------------------------------------\n");
+    printf("Lock-free queue throughput (%d values per producer, capacity 1024):\n", NUM_VALUES);
+
+    const int numCases = 3;
+    const int numProducers[numCases] = {1, 2, 4};
+    const int numConsumers[numCases] = {1, 2, 4};
+
+    for (int c = 0; c < numCases; ++c) {
+        const int p = numProducers[c];
+        const int n = numConsumers[c];
+        const double total = p * NUM_VALUES;
+
+        RealTime spsc = 0;
+        if ((p == 1) && (n == 1)) {
+            SPSCQueue<int> q(1024);
+            spsc = runThreads(q, p, n);
+        }
+
+        MPMCQueue<int> mpmc(1024);
+        const RealTime mpmcTime = runThreads(mpmc, p, n);
+
+        LockedQueue locked(1024);
+        const RealTime lockedTime = runThreads(locked, p, n);
+
+        printf("  %d producer(s), %d consumer(s):", p, n);
+        if (spsc > 0) {
+            printf("  SPSCQueue %5.1f Mop/s,", total / spsc / 1e6);
+        }
+        printf("  MPMCQueue %5.1f Mop/s,  GMutex+Queue %5.1f Mop/s\n",
+               total / mpmcTime / 1e6, total / lockedTime / 1e6);
+    }
+    printf("\n");
+}
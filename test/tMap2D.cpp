@@ -1,4 +1,9 @@
 #include "G3D/Map2D.h"
+#include "G3D/Image3.h"
+#include "G3D/Image4.h"
+#include "G3D/Image3uint8.h"
+#include "G3D/Random.h"
+#include "G3D/System.h"
 
 using namespace G3D;
 
@@ -42,6 +47,221 @@ void testBicubic() {
 }
 
 
+typedef Map2D<float64, float64> DoubleMap;
+
+static const ResampleFilter allFilters[] = {ResampleFilter::BOX, ResampleFilter::TENT, ResampleFilter::LANCZOS3, ResampleFilter::MITCHELL};
+
+
+static Image4::Ref randomImage4(int w, int h, Random& rnd) {
+    Image4::Ref im = Image4::createEmpty(w, h);
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            im->set(x, y, Color4(rnd.uniform(), rnd.uniform(), rnd.uniform(), rnd.uniform()));
+        }
+    }
+    return im;
+}
+
+
+/** Halving with BOX averages 2x2 blocks, and each level is half the previous one */
+static void testMipChain() {
+    Random rnd(7);
+    Image4::Ref base = randomImage4(64, 16, rnd);
+
+    Array<Image4::Ref> chain;
+    base->generateMipChain(chain);
+    debugAssert(chain.size() == 6);
+    debugAssert(chain.last()->width() == 1 && chain.last()->height() == 1);
+    debugAssert(chain[3]->width() == 4 && chain[3]->height() == 1);
+
+    for (int y = 0; y < chain[0]->height(); ++y) {
+        for (int x = 0; x < chain[0]->width(); ++x) {
+            const Color4 expected = (base->get(2 * x, 2 * y) + base->get(2 * x + 1, 2 * y) +
+                                     base->get(2 * x, 2 * y + 1) + base->get(2 * x + 1, 2 * y + 1)) * 0.25f;
+            const Color4 actual = chain[0]->get(x, y);
+            debugAssert((actual - expected).rgb().max() < 1e-5f && fuzzyEq(actual.a, expected.a));
+            (void)actual; (void)expected;
+        }
+    }
+
+    // The 1x1 level is the mean of the whole image
+    const Color4 mean = base->average();
+    debugAssert(fabs(chain.last()->get(0, 0).r - mean.r) < 1e-4f);
+    debugAssert(fabs(chain.last()->get(0, 0).a - mean.a) < 1e-4f);
+    (void)mean;
+
+    // Odd sizes round down and still reach 1x1
+    Map2D<float, float>::Ref odd = Map2D<float, float>::create(13, 5);
+    odd->setAll(2.0f);
+    Array<Map2D<float, float>::Ref> oddChain;
+    odd->generateMipChain(oddChain, ResampleFilter::TENT);
+    debugAssert(oddChain.size() == 3);
+    debugAssert(oddChain[0]->width() == 6 && oddChain[0]->height() == 2);
+    debugAssert(oddChain[2]->width() == 1 && oddChain[2]->height() == 1);
+    debugAssert(fuzzyEq(oddChain[2]->get(0, 0), 2.0f));
+}
+
+
+/** The packed-float (SSE) path must match the generic Compute path, which 
+    is exercised here through float64 storage */
+static void testResampleFloatPath() {
+    Random rnd(11);
+    const int srcW = 23, srcH = 17;
+    Image4::Ref src = randomImage4(srcW, srcH, rnd);
+
+    DoubleMap::Ref channel[4];
+    for (int c = 0; c < 4; ++c) {
+        channel[c] = DoubleMap::create(srcW, srcH);
+        for (int y = 0; y < srcH; ++y) {
+            for (int x = 0; x < srcW; ++x) {
+                channel[c]->set(x, y, src->get(x, y)[c]);
+            }
+        }
+    }
+
+    const int numSizes = 4;
+    const int dstW[numSizes] = {7, 40, 23, 5};
+    const int dstH[numSizes] = {9, 35, 8, 17};
+    const WrapMode wrap[] = {WrapMode::CLAMP, WrapMode::TILE, WrapMode::ZERO};
+
+    for (int f = 0; f < 4; ++f) {
+        for (int m = 0; m < 3; ++m) {
+            src->setWrapMode(wrap[m]);
+            for (int s = 0; s < numSizes; ++s) {
+                Image4::Ref dst = Image4::createEmpty(0, 0);
+                src->resample(*dst, dstW[s], dstH[s], allFilters[f]);
+                debugAssert(dst->width() == dstW[s] && dst->height() == dstH[s]);
+                debugAssert(dst->wrapMode() == wrap[m]);
+
+                for (int c = 0; c < 4; ++c) {
+                    channel[c]->setWrapMode(wrap[m]);
+                    DoubleMap::Ref expected = DoubleMap::create();
+                    channel[c]->resample(*expected, dstW[s], dstH[s], allFilters[f]);
+                    for (int y = 0; y < dstH[s]; ++y) {
+                        for (int x = 0; x < dstW[s]; ++x) {
+                            debugAssertM(fabs(dst->get(x, y)[c] - expected->get(x, y)) < 1e-4, 
+                                format("%s: (%d, %d) channel %d differs", allFilters[f].toString(), x, y, c));
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+/** Normalized filters preserve constants; rows split across threads give the same bits */
+static void testResampleProperties() {
+    Random rnd(3);
+
+    Image3::Ref flat = Image3::createEmpty(31, 19, WrapMode::CLAMP);
+    flat->setAll(Color3(0.25f, 0.5f, 0.75f));
+    for (int f = 0; f < 4; ++f) {
+        Image3::Ref dst = Image3::createEmpty();
+        flat->resample(*dst, 70, 6, allFilters[f]);
+        for (int i = 0; i < dst->width() * dst->height(); ++i) {
+            const Color3 d = dst->getCArray()[i] - Color3(0.25f, 0.5f, 0.75f);
+            debugAssert(d.max() < 1e-5f && -d.min() < 1e-5f);
+            (void)d;
+        }
+    }
+
+    Image4::Ref big = randomImage4(300, 200, rnd);
+    Image4::Ref serial = Image4::createEmpty();
+    Image4::Ref parallel = Image4::createEmpty();
+    big->resample(*serial, 123, 457, ResampleFilter::LANCZOS3, false);
+    big->resample(*parallel, 123, 457, ResampleFilter::LANCZOS3, true);
+    debugAssert(memcmp(serial->getCArray(), parallel->getCArray(), sizeof(Color4) * 123 * 457) == 0);
+
+    // Ringing must not wrap around 8-bit storage
+    Image3uint8::Ref edge = Image3uint8::createEmpty(16, 4, WrapMode::CLAMP);
+    for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 16; ++x) {
+            edge->set(x, y, (x < 8) ? Color3uint8(0, 0, 0) : Color3uint8(255, 255, 255));
+        }
+    }
+    Image3uint8::Ref edgeUp = Image3uint8::createEmpty();
+    edge->resample(*edgeUp, 64, 4, ResampleFilter::LANCZOS3);
+    for (int x = 0; x < 28; ++x) {
+        debugAssert(edgeUp->get(x, 0).r < 128);
+    }
+    for (int x = 36; x < 64; ++x) {
+        debugAssert(edgeUp->get(x, 0).r >= 128);
+    }
+}
+
+
+/** BOX counts a source pixel that lies exactly on the boundary between
+    two destination pixels toward exactly one of them */
+static void testBoxBoundary() {
+    typedef Map2D<float, float> FloatMap;
+    FloatMap::Ref src = FloatMap::create(5, 1, WrapMode::CLAMP);
+    const float value[5] = {1.0f, 2.0f, 4.0f, 8.0f, 16.0f};
+    for (int x = 0; x < 5; ++x) {
+        src->set(x, 0, value[x]);
+    }
+
+    // Source pixel 2 is at +0.5 from destination pixel 0 and at -0.5 from
+    // destination pixel 1
+    FloatMap::Ref dst = FloatMap::create();
+    src->resample(*dst, 2, 1, ResampleFilter::BOX);
+    debugAssert(fuzzyEq(dst->get(0, 0), (1.0f + 2.0f) / 2.0f));
+    debugAssert(fuzzyEq(dst->get(1, 0), (4.0f + 8.0f + 16.0f) / 3.0f));
+
+    ResampleWeights weights(5, 2, ResampleFilter::BOX, WrapMode::CLAMP);
+    int count[5] = {0, 0, 0, 0, 0};
+    for (int i = 0; i < weights.index.size(); ++i) {
+        if (weights.weight[i] != 0.0f) {
+            ++count[weights.index[i]];
+        }
+    }
+    for (int x = 0; x < 5; ++x) {
+        debugAssert(count[x] == 1);
+    }
+}
+
+
 void testMap2D() {
     testBicubic();
+    testMipChain();
+    testBoxBoundary();
+    testResampleFloatPath();
+    testResampleProperties();
+}
+
+
+void perfMap2D() {
+    printf("----------------------------------------------------------\n");
+    printf("Map2D resampling (%d TaskScheduler workers):\n", TaskScheduler::global()->numWorkers());
+
+    Random rnd(1);
+    Image4::Ref src = randomImage4(1920, 1080, rnd);
+    src->setWrapMode(WrapMode::CLAMP);
+    const int dstW = 640, dstH = 360;
+
+    // Baseline: one bicubic() lookup per output pixel
+    Image4::Ref dst = Image4::createEmpty(dstW, dstH);
+    RealTime t0 = System::time();
+    const float sx = (float)src->width() / dstW, sy = (float)src->height() / dstH;
+    for (int y = 0; y < dstH; ++y) {
+        for (int x = 0; x < dstW; ++x) {
+            dst->set(x, y, src->bicubic((x + 0.5f) * sx - 0.5f, (y + 0.5f) * sy - 0.5f));
+        }
+    }
+    printf("  1920x1080 -> 640x360 Color4  bicubic() per pixel    %6.1f ms\n", (System::time() - t0) * 1000);
+
+    for (int f = 0; f < 4; ++f) {
+        for (int parallel = 0; parallel < 2; ++parallel) {
+            t0 = System::time();
+            src->resample(*dst, dstW, dstH, allFilters[f], parallel == 1);
+            printf("  1920x1080 -> 640x360 Color4  resample %-8s %-8s %6.1f ms\n", 
+                   allFilters[f].toString(), parallel ? "parallel" : "serial", (System::time() - t0) * 1000);
+        }
+    }
+
+    Image4::Ref base = randomImage4(2048, 2048, rnd);
+    Array<Image4::Ref> chain;
+    t0 = System::time();
+    base->generateMipChain(chain);
+    printf("  2048x2048 Color4 mip chain (BOX)                    %6.1f ms\n\n", (System::time() - t0) * 1000);
 }
@@ -58,6 +58,152 @@ void testPseudoInverse() {
         debugAssertM((H1-H2).norm() < normThreshold, format("4x%d case failed, error=%f",n,(H1-H2).norm()));
     }
 }
+/** Reference triple loop for checking the blocked multiply */
+static Matrix naiveMul(const Matrix& A, const Matrix& B) {
+    Matrix C(A.rows(), B.cols());
+    for (int r = 0; r < A.rows(); ++r) {
+        for (int c = 0; c < B.cols(); ++c) {
+            double sum = 0;
+            for (int i = 0; i < A.cols(); ++i) {
+                sum += A.get(r, i) * B.get(i, c);
+            }
+            C.set(r, c, (float)sum);
+        }
+    }
+    return C;
+}
+
+
+static void testBlockedMul() {
+    // Sizes that exercise the 4 x 8 tiles, the edges, and several cache blocks
+    const int size[][3] = {{1, 1, 1}, {3, 5, 7}, {4, 8, 4}, {13, 130, 17}, {67, 129, 600}, {150, 150, 150}};
+    for (int s = 0; s < (int)(sizeof(size) / sizeof(size[0])); ++s) {
+        const Matrix& A = Matrix::random(size[s][0], size[s][1]);
+        const Matrix& B = Matrix::random(size[s][1], size[s][2]);
+        const Matrix& C = A * B;
+        const float err = (float)((C - naiveMul(A, B)).norm() / C.norm());
+        debugAssertM(err < 1e-5f, format("%dx%d * %dx%d error = %g", size[s][0], size[s][1], size[s][1], size[s][2], err));
+        (void)err;
+    }
+
+    // Elementwise operators over lengths that are not multiples of four
+    const Matrix& A = Matrix::random(7, 9);
+    const Matrix& B = Matrix::random(7, 9) + 1.0f;
+    const Matrix& sum  = A + B;
+    Matrix quot = A.arrayMul(B);
+    quot /= 2.0f;
+    for (int r = 0; r < A.rows(); ++r) {
+        for (int c = 0; c < A.cols(); ++c) {
+            debugAssert(sum.get(r, c) == A.get(r, c) + B.get(r, c));
+            debugAssert(fuzzyEq(quot.get(r, c), A.get(r, c) * B.get(r, c) / 2.0f));
+        }
+    }
+}
+
+
+static void testFactorizations() {
+    // LU
+    {
+        Matrix A = Matrix::random(70, 70);
+        Matrix L, U;
+        Array<int> permutation;
+        bool ok = A.lu(L, U, permutation);
+        debugAssert(ok);
+
+        Matrix PA(70, 70);
+        for (int r = 0; r < 70; ++r) {
+            PA.setRow(r, A.row(permutation[r]));
+            for (int c = 0; c < 70; ++c) {
+                debugAssert((c <= r) || (L.get(r, c) == 0));
+                debugAssert((c >= r) || (U.get(r, c) == 0));
+            }
+            debugAssert(L.get(r, r) == 1);
+        }
+        debugAssert((L * U - PA).norm() / PA.norm() < 1e-5);
+
+        Matrix S = Matrix::identity(3);
+        S.setRow(2, S.row(1));
+        ok = S.lu(L, U, permutation);
+        debugAssert(! ok);
+        (void)ok;
+    }
+
+    // Determinant of a matrix larger than 3x3
+    {
+        Matrix A = Matrix::identity(12) * 2.0f;
+        A.swapRows(0, 5);
+        debugAssert(fuzzyEq(A.determinant(), -4096.0f));
+    }
+
+    // Cholesky
+    {
+        const Matrix& X = Matrix::random(40, 30);
+        const Matrix& A = X.transpose() * X + Matrix::identity(30);
+        Matrix L;
+        bool ok = A.cholesky(L);
+        debugAssert(ok);
+        debugAssert((L * L.transpose() - A).norm() / A.norm() < 1e-5);
+        debugAssert(L.get(0, 1) == 0);
+
+        ok = (-A).cholesky(L);
+        debugAssert(! ok);
+        (void)ok;
+    }
+
+    // Square solve
+    {
+        const Matrix& A = Matrix::random(50, 50) + Matrix::identity(50) * 10.0f;
+        const Matrix& X = Matrix::random(50, 3);
+        const Matrix& B = A * X;
+        debugAssert((A.solve(B) - X).norm() / X.norm() < 1e-4);
+    }
+
+    // Least squares fit of a quadratic to noisy samples
+    {
+        const int N = 2000;
+        Matrix A(N, 3);
+        Matrix b(N, 1);
+        Random rnd(7, false);
+        for (int i = 0; i < N; ++i) {
+            const float x = rnd.uniform(-2, 2);
+            A.set(i, 0, 1.0f);
+            A.set(i, 1, x);
+            A.set(i, 2, x * x);
+            b.set(i, 0, 3.0f - 2.0f * x + 0.5f * x * x + rnd.uniform(-0.01f, 0.01f));
+        }
+        const Matrix& coeff = A.solve(b);
+        debugAssert(coeff.rows() == 3 && coeff.cols() == 1);
+        debugAssert(abs(coeff.get(0, 0) - 3.0f) < 0.01f);
+        debugAssert(abs(coeff.get(1, 0) + 2.0f) < 0.01f);
+        debugAssert(abs(coeff.get(2, 0) - 0.5f) < 0.01f);
+        debugAssert((coeff - A.pseudoInverse() * b).norm() < 0.01);
+    }
+
+    // A quartic on [0, 1] is ill-conditioned enough that forming the
+    // normal equations in single precision would lose most of the digits
+    {
+        const int N = 1000;
+        const float expected[5] = {1.0f, -3.0f, 2.0f, 4.0f, -2.5f};
+        Matrix A(N, 5);
+        Matrix b(N, 1);
+        for (int i = 0; i < N; ++i) {
+            const float x = (i + 0.5f) / N;
+            float p = 1.0f, y = 0.0f;
+            for (int c = 0; c < 5; ++c) {
+                A.set(i, c, p);
+                y += expected[c] * p;
+                p *= x;
+            }
+            b.set(i, 0, y);
+        }
+        const Matrix& coeff = A.solve(b);
+        for (int c = 0; c < 5; ++c) {
+            debugAssert(abs(coeff.get(c, 0) - expected[c]) < 1e-3f);
+        }
+    }
+}
+
+
 void testMatrix() {
     printf("Matrix ");
     // Zeros
@@ -246,6 +392,8 @@ void testMatrix() {
     }
 
     testPseudoInverse();
+    testBlockedMul();
+    testFactorizations();
 
     /*
     Matrix a(3, 5);
@@ -267,3 +415,63 @@ void testMatrix() {
 
     printf("passed\n");
 }
+
+
+void perfMatrix() {
+    printf("----------------------------------------------------------\n");
+    printf("Matrix (%d TaskScheduler workers)\n", TaskScheduler::global()->numWorkers());
+
+    {
+        const int N = 300;
+        const Matrix& A = Matrix::random(N, N);
+        const Matrix& B = Matrix::random(N, N);
+
+        RealTime t0 = System::time();
+        const Matrix& C0 = naiveMul(A, B);
+        const RealTime naiveTime = System::time() - t0;
+
+        t0 = System::time();
+        const Matrix& C1 = A * B;
+        const RealTime blockedTime = System::time() - t0;
+        debugAssert((C1 - C0).norm() / C0.norm() < 1e-5);
+
+        printf("  %dx%d multiply:   naive %6.3fs  blocked %6.3fs  (%.1f GFLOPS)\n",
+               N, N, naiveTime, blockedTime, 2.0 * N * N * N / (blockedTime * 1e9));
+    }
+
+    {
+        const int N = 300;
+        const Matrix& A = Matrix::random(N, N) + Matrix::identity(N) * (float)N;
+        const Matrix& b = Matrix::random(N, 1);
+
+        RealTime t0 = System::time();
+        const Matrix& x0 = A.inverse() * b;
+        const RealTime inverseTime = System::time() - t0;
+
+        t0 = System::time();
+        const Matrix& x1 = A.solve(b);
+        const RealTime solveTime = System::time() - t0;
+        debugAssert((x1 - x0).norm() / x0.norm() < 1e-3);
+        (void)x1;
+
+        printf("  %dx%d solve:      inverse() * b %6.3fs  solve() %6.3fs\n", N, N, inverseTime, solveTime);
+    }
+
+    {
+        // Least squares fit of 20 coefficients to 5000 samples
+        const Matrix& A = Matrix::random(5000, 20);
+        const Matrix& b = Matrix::random(5000, 1);
+
+        RealTime t0 = System::time();
+        const Matrix& x0 = A.pseudoInverse() * b;
+        const RealTime svdTime = System::time() - t0;
+
+        t0 = System::time();
+        const Matrix& x1 = A.solve(b);
+        const RealTime solveTime = System::time() - t0;
+        debugAssert((x1 - x0).norm() / x0.norm() < 1e-2);
+        (void)x1;
+
+        printf("  5000x20 least squares: pseudoInverse() * b %6.3fs  solve() %6.3fs\n\n", svdTime, solveTime);
+    }
+}
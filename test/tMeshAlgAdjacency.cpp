@@ -304,5 +304,52 @@ void testAdjacency() {
         debugAssert(edgeArray[4].boundary());
 
     }
-    
+
+    {
+        // Random meshes with degenerate faces and edges shared by more
+        // than two faces; the compact and regular forms must agree
+        Random r(4, false);
+        for (int trial = 0; trial < 50; ++trial) {
+            Array<Vector3> vertex;
+            Array<int> index;
+            const int numVertices = 1 + r.integer(0, 40);
+            for (int v = 0; v < numVertices; ++v) {
+                vertex.append(Vector3(r.uniform(), r.uniform(), r.uniform()));
+            }
+            const int numFaces = r.integer(0, 80);
+            for (int i = 0; i < 3 * numFaces; ++i) {
+                index.append(r.integer(0, numVertices - 1));
+            }
+
+            Array<MeshAlg::Face>    faceArray;
+            Array<MeshAlg::Edge>    edgeArray;
+            Array<MeshAlg::Vertex>  vertexArray;
+            MeshAlg::computeAdjacency(vertex, index, faceArray, edgeArray, vertexArray);
+            MeshAlg::debugCheckConsistency(faceArray, edgeArray, vertexArray);
+
+            Array<MeshAlg::Face>    faceArray2;
+            Array<MeshAlg::Edge>    edgeArray2;
+            MeshAlg::CompactVertexArray compact;
+            MeshAlg::computeAdjacency(vertex, index, faceArray2, edgeArray2, compact);
+
+            debugAssert(faceArray2.size() == faceArray.size());
+            debugAssert(edgeArray2.size() == edgeArray.size());
+            debugAssert(compact.size() == vertexArray.size());
+            for (int f = 0; f < faceArray.size(); ++f) {
+                for (int j = 0; j < 3; ++j) {
+                    debugAssert(faceArray[f].edgeIndex[j] == faceArray2[f].edgeIndex[j]);
+                }
+            }
+            for (int v = 0; v < vertexArray.size(); ++v) {
+                debugAssert(compact.numFaces(v) == vertexArray[v].faceIndex.size());
+                debugAssert(compact.numEdges(v) == vertexArray[v].edgeIndex.size());
+                for (int i = 0; i < compact.numFaces(v); ++i) {
+                    debugAssert(compact.face(v)[i] == vertexArray[v].faceIndex[i]);
+                }
+                for (int i = 0; i < compact.numEdges(v); ++i) {
+                    debugAssert(compact.edge(v)[i] == vertexArray[v].edgeIndex[i]);
+                }
+            }
+        }
+    }
 }
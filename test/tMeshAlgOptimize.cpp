@@ -0,0 +1,263 @@
+#include "G3D/G3DAll.h"
+
+/** An N x N vertex grid, with triangles in row order */
+static void makeGrid(int N, Array<Vector3>& vertex, Array<int>& index) {
+    for (int y = 0; y < N; ++y) {
+        for (int x = 0; x < N; ++x) {
+            vertex.append(Vector3(float(x), sin(x * 0.3f) * cos(y * 0.2f), float(y)));
+        }
+    }
+
+    for (int y = 0; y < N - 1; ++y) {
+        for (int x = 0; x < N - 1; ++x) {
+            const int a = y * N + x;
+            index.append(a, a + 1, a + N);
+            index.append(a + 1, a + N + 1, a + N);
+        }
+    }
+}
+
+
+class TriangleLess {
+public:
+    bool operator()(const Vector3int32& p, const Vector3int32& q) const {
+        return (p.x < q.x) || ((p.x == q.x) && ((p.y < q.y) || ((p.y == q.y) && (p.z < q.z))));
+    }
+};
+
+
+/** Returns the triangles rotated so that the smallest index is first, preserving winding, and sorted */
+static Array<Vector3int32> canonicalTriangles(const Array<int>& index) {
+    Array<Vector3int32> tri;
+    for (int i = 0; i < index.size(); i += 3) {
+        int a = index[i], b = index[i + 1], c = index[i + 2];
+        while ((a > b) || (a > c)) {
+            const int t = a; a = b; b = c; c = t;
+        }
+        tri.append(Vector3int32(a, b, c));
+    }
+
+    std::sort(tri.begin(), tri.end(), TriangleLess());
+    return tri;
+}
+
+
+static void checkSameTriangles(const Array<int>& a, const Array<int>& b) {
+    debugAssert(a.size() == b.size());
+    const Array<Vector3int32>& ta = canonicalTriangles(a);
+    const Array<Vector3int32>& tb = canonicalTriangles(b);
+    for (int i = 0; i < ta.size(); ++i) {
+        debugAssertM(ta[i] == tb[i], "Triangles were changed by reordering");
+    }
+}
+
+
+static void testVertexCacheStatistics() {
+    Array<int> index;
+    float acmr, atvr;
+
+    // A single triangle transforms each vertex once
+    index.append(0, 1, 2);
+    MeshAlg::computeVertexCacheStatistics(index, 3, acmr, atvr);
+    debugAssert(acmr == 3.0f);
+    debugAssert(atvr == 1.0f);
+
+    // A quad shares two vertices
+    index.append(2, 1, 3);
+    MeshAlg::computeVertexCacheStatistics(index, 4, acmr, atvr);
+    debugAssert(acmr == 2.0f);
+    debugAssert(atvr == 1.0f);
+
+    // With a cache of one vertex, only the last vertex of the first triangle is reused
+    MeshAlg::computeVertexCacheStatistics(index, 4, acmr, atvr, 1);
+    debugAssert(acmr == 2.5f);
+    debugAssert(atvr == 1.25f);
+
+    index.clear();
+    MeshAlg::computeVertexCacheStatistics(index, 0, acmr, atvr);
+    debugAssert(acmr == 0.0f);
+    debugAssert(atvr == 0.0f);
+}
+
+
+static void testOptimizeVertexCache() {
+    const int N = 60;
+    Array<Vector3> vertex;
+    Array<int> original;
+    makeGrid(N, vertex, original);
+
+    // Shuffle the triangles, which defeats the cache entirely
+    Array<int> shuffled = original;
+    Random r(3, false);
+    for (int f = shuffled.size() / 3 - 1; f > 0; --f) {
+        const int g = r.integer(0, f);
+        for (int j = 0; j < 3; ++j) {
+            std::swap(shuffled[3 * f + j], shuffled[3 * g + j]);
+        }
+    }
+
+    float originalACMR, shuffledACMR, optimizedACMR, atvr;
+    MeshAlg::computeVertexCacheStatistics(original, vertex.size(), originalACMR, atvr);
+    MeshAlg::computeVertexCacheStatistics(shuffled, vertex.size(), shuffledACMR, atvr);
+
+    Array<int> index = shuffled;
+    MeshAlg::optimizeVertexCache(index, vertex.size());
+    checkSameTriangles(index, original);
+
+    MeshAlg::computeVertexCacheStatistics(index, vertex.size(), optimizedACMR, atvr);
+    debugAssert(shuffledACMR > 2.5f);
+    debugAssert(optimizedACMR < 0.8f);
+    debugAssert(optimizedACMR < originalACMR);
+    debugAssert(atvr < 1.5f);
+
+    // The row order is already good, but is still improved
+    index = original;
+    MeshAlg::optimizeVertexCache(index, vertex.size());
+    checkSameTriangles(index, original);
+    MeshAlg::computeVertexCacheStatistics(index, vertex.size(), optimizedACMR, atvr);
+    debugAssert(optimizedACMR < originalACMR);
+
+    // Disconnected and degenerate triangles
+    index.clear();
+    index.append(0, 1, 2);
+    index.append(5, 5, 5);
+    index.append(3, 4, 5);
+    index.append(0, 0, 1);
+    Array<int> copy = index;
+    MeshAlg::optimizeVertexCache(index, 6);
+    checkSameTriangles(index, copy);
+
+    index.clear();
+    MeshAlg::optimizeVertexCache(index, 0);
+    debugAssert(index.size() == 0);
+}
+
+
+static void testOptimizeOverdraw() {
+    // A wrinkled grid
+    Array<Vector3> vertex;
+    Array<int> index;
+    makeGrid(40, vertex, index);
+
+    MeshAlg::optimizeVertexCache(index, vertex.size());
+    Array<int> cacheOptimized = index;
+    float cacheACMR, overdrawACMR, atvr;
+    MeshAlg::computeVertexCacheStatistics(cacheOptimized, vertex.size(), cacheACMR, atvr);
+
+    const float threshold = 1.05f;
+    MeshAlg::optimizeOverdraw(vertex, index, threshold);
+    checkSameTriangles(index, cacheOptimized);
+    MeshAlg::computeVertexCacheStatistics(index, vertex.size(), overdrawACMR, atvr);
+
+    // Clustering may only cost a little vertex locality
+    debugAssert(overdrawACMR <= cacheACMR * threshold * 1.1f);
+
+    // A larger threshold allows more clusters
+    index = cacheOptimized;
+    MeshAlg::optimizeOverdraw(vertex, index, 2.0f);
+    checkSameTriangles(index, cacheOptimized);
+
+    // Degenerate inputs
+    index.clear();
+    MeshAlg::optimizeOverdraw(vertex, index);
+    debugAssert(index.size() == 0);
+
+    index.append(0, 0, 0);
+    index.append(1, 1, 1);
+    MeshAlg::optimizeOverdraw(vertex, index);
+    debugAssert(index.size() == 6);
+}
+
+
+static void testOptimizeVertexFetch() {
+    Array<int> a, b;
+    a.append(5, 2, 7);
+    a.append(7, 2, 0);
+    b.append(3, 5, 0);
+    const Array<int> oldA = a, oldB = b;
+
+    Array<Array<int>*> indexArrayArray;
+    indexArrayArray.append(&a, NULL, &b);
+
+    Array<int> toNew, toOld;
+    MeshAlg::optimizeVertexFetch(indexArrayArray, 9, toNew, toOld);
+
+    debugAssert(toNew.size() == 9);
+    debugAssert(toOld.size() == 9);
+    for (int v = 0; v < 9; ++v) {
+        debugAssert(toOld[toNew[v]] == v);
+    }
+
+    // First use order
+    debugAssert(toOld[0] == 5);
+    debugAssert(toOld[1] == 2);
+    debugAssert(toOld[2] == 7);
+    debugAssert(toOld[3] == 0);
+    debugAssert(toOld[4] == 3);
+
+    // Unused vertices at the end, in order
+    debugAssert(toOld[5] == 1);
+    debugAssert(toOld[6] == 4);
+    debugAssert(toOld[7] == 6);
+    debugAssert(toOld[8] == 8);
+
+    for (int i = 0; i < a.size(); ++i) {
+        debugAssert(toOld[a[i]] == oldA[i]);
+    }
+    for (int i = 0; i < b.size(); ++i) {
+        debugAssert(toOld[b[i]] == oldB[i]);
+    }
+
+    // Indices are sequential after the first use of each vertex
+    int next = 0;
+    for (int i = 0; i < a.size(); ++i) {
+        debugAssert(a[i] <= next);
+        next = iMax(next, a[i] + 1);
+    }
+}
+
+
+void testMeshAlgOptimize() {
+    printf("MeshAlg::optimize ");
+
+    testVertexCacheStatistics();
+    testOptimizeVertexCache();
+    testOptimizeOverdraw();
+    testOptimizeVertexFetch();
+
+    printf("passed\n");
+}
+
+
+void perfMeshAlgOptimize() {
+    printf("----------------------------------------------------------\n");
+
+    const int N = 400;
+    Array<Vector3> vertex;
+    Array<int> index;
+    makeGrid(N, vertex, index);
+
+    float acmr, atvr;
+    MeshAlg::computeVertexCacheStatistics(index, vertex.size(), acmr, atvr);
+    printf("Row order                           ACMR %5.3f  ATVR %5.3f\n", acmr, atvr);
+
+    Stopwatch timer;
+    timer.tick();
+    MeshAlg::optimizeVertexCache(index, vertex.size());
+    timer.tock();
+    MeshAlg::computeVertexCacheStatistics(index, vertex.size(), acmr, atvr);
+    printf("MeshAlg::optimizeVertexCache (%d faces) %6.3f s  ACMR %5.3f  ATVR %5.3f\n",
+           index.size() / 3, timer.elapsedTime(), acmr, atvr);
+
+    timer.tick();
+    MeshAlg::optimizeOverdraw(vertex, index);
+    timer.tock();
+    MeshAlg::computeVertexCacheStatistics(index, vertex.size(), acmr, atvr);
+    printf("MeshAlg::optimizeOverdraw            %6.3f s  ACMR %5.3f  ATVR %5.3f\n", timer.elapsedTime(), acmr, atvr);
+
+    Array<int> toNew, toOld;
+    timer.tick();
+    MeshAlg::optimizeVertexFetch(index, vertex.size(), toNew, toOld);
+    timer.tock();
+    printf("MeshAlg::optimizeVertexFetch         %6.3f s\n\n", timer.elapsedTime());
+}
@@ -0,0 +1,248 @@
+#include "G3D/G3DAll.h"
+
+/** An N x N vertex grid in the XZ plane with height h(x, z), facing +Y */
+static void makeTerrain(int N, float amplitude, MeshAlg::Geometry& geometry, Array<Vector2>& texCoord, Array<int>& index) {
+    for (int z = 0; z < N; ++z) {
+        for (int x = 0; x < N; ++x) {
+            geometry.vertexArray.append(Vector3(float(x), amplitude * sin(x * 0.4f) * cos(z * 0.3f), float(z)));
+            texCoord.append(Vector2(float(x), float(z)) / float(N - 1));
+        }
+    }
+
+    for (int z = 0; z < N - 1; ++z) {
+        for (int x = 0; x < N - 1; ++x) {
+            const int a = z * N + x;
+            index.append(a, a + N, a + 1);
+            index.append(a + 1, a + N, a + N + 1);
+        }
+    }
+}
+
+
+static Vector3 faceNormal(const Array<Vector3>& vertex, const Array<int>& index, int f) {
+    const Vector3& v0 = vertex[index[3 * f]];
+    return (vertex[index[3 * f + 1]] - v0).cross(vertex[index[3 * f + 2]] - v0);
+}
+
+
+static float totalArea(const Array<Vector3>& vertex, const Array<int>& index) {
+    float area = 0.0f;
+    for (int f = 0; f < index.size() / 3; ++f) {
+        area += faceNormal(vertex, index, f).length() * 0.5f;
+    }
+    return area;
+}
+
+
+static void testFlat() {
+    const int N = 20;
+    MeshAlg::Geometry geometry;
+    Array<Vector2> texCoord;
+    Array<int> index;
+    makeTerrain(N, 0.0f, geometry, texCoord, index);
+
+    // Without texture coordinates, a plane reduces to a handful of
+    // triangles with no error
+    float error;
+    Array<int> simple = index;
+    MeshAlg::simplify(geometry, Array<Vector2>(), simple, 0, error, 1e-3f);
+    debugAssert(simple.size() % 3 == 0);
+    debugAssert(simple.size() / 3 <= 8);
+    debugAssert(error < 1e-3f);
+    debugAssert(fuzzyEq(totalArea(geometry.vertexArray, simple), square(float(N - 1))));
+    for (int f = 0; f < simple.size() / 3; ++f) {
+        debugAssert(faceNormal(geometry.vertexArray, simple, f).y > 0.0f);
+    }
+
+    // Texture coordinates that vary over the plane do not prevent
+    // collapses, since they are only used to find seams
+    simple = index;
+    MeshAlg::simplify(geometry, texCoord, simple, 0, error, 1e-3f);
+    debugAssert(simple.size() / 3 <= 8);
+
+    // The target stops simplification
+    simple = index;
+    MeshAlg::simplify(geometry, texCoord, simple, 300, error);
+    debugAssert(simple.size() / 3 <= 300);
+    debugAssert(simple.size() / 3 > 250);
+}
+
+
+static void testTerrain() {
+    const int N = 40;
+    MeshAlg::Geometry geometry;
+    Array<Vector2> texCoord;
+    Array<int> index;
+    makeTerrain(N, 0.5f, geometry, texCoord, index);
+
+    const int numFaces = index.size() / 3;
+    float previousError = 0.0f;
+    for (int level = 1; level <= 4; ++level) {
+        const int target = numFaces >> level;
+
+        float error;
+        Array<int> simple = index;
+        MeshAlg::simplify(geometry, texCoord, simple, target, error);
+        debugAssert(simple.size() / 3 <= target);
+        debugAssert(simple.size() / 3 > target * 0.9f);
+
+        // Coarser levels are less accurate
+        debugAssert(error > 0.0f);
+        debugAssert(error >= previousError);
+        previousError = error;
+
+        // Faces turn at most about 75 degrees from the faces they
+        // replace, so none of this gentle terrain may face down
+        for (int f = 0; f < simple.size() / 3; ++f) {
+            debugAssert(faceNormal(geometry.vertexArray, simple, f).y > 0.0f);
+        }
+
+        // The outline is preserved
+        debugAssert(abs(totalArea(geometry.vertexArray, simple) / totalArea(geometry.vertexArray, index) - 1.0f) < 0.1f);
+    }
+
+    // A tight error bound stops simplification early
+    float error;
+    Array<int> simple = index;
+    MeshAlg::simplify(geometry, texCoord, simple, 0, error, 0.01f);
+    debugAssert(error <= 0.01f);
+    debugAssert(simple.size() / 3 > numFaces / 4);
+}
+
+
+static void testSeams() {
+    // Two charts of a plane that meet along the column x = S, with
+    // vertices duplicated along the seam, drawn as two index arrays
+    const int N = 16, S = 8;
+    MeshAlg::Geometry geometry;
+    Array<Vector2> texCoord;
+    Array<int> left, right;
+    Array<int> vertexIndex;
+    vertexIndex.resize(N * N);
+    Array<int> seamIndex;
+    seamIndex.resize(N);
+
+    for (int z = 0; z < N; ++z) {
+        for (int x = 0; x < N; ++x) {
+            vertexIndex[z * N + x] = geometry.vertexArray.size();
+            geometry.vertexArray.append(Vector3(float(x), 0.0f, float(z)));
+            texCoord.append(Vector2(float(x), float(z)));
+        }
+
+        // The right chart's copy of the seam vertex
+        seamIndex[z] = geometry.vertexArray.size();
+        geometry.vertexArray.append(Vector3(float(S), 0.0f, float(z)));
+        texCoord.append(Vector2(100.0f, float(z)));
+    }
+
+    for (int z = 0; z < N - 1; ++z) {
+        for (int x = 0; x < N - 1; ++x) {
+            int a = vertexIndex[z * N + x], b = vertexIndex[z * N + x + 1];
+            int c = vertexIndex[(z + 1) * N + x], d = vertexIndex[(z + 1) * N + x + 1];
+            if (x == S) {
+                a = seamIndex[z];
+                c = seamIndex[z + 1];
+            }
+
+            Array<int>& index = (x < S) ? left : right;
+            index.append(a, c, b);
+            index.append(b, c, d);
+        }
+    }
+
+    Array<Array<int>*> indexArrayArray;
+    indexArrayArray.append(&left, &right);
+
+    float error;
+    MeshAlg::simplify(geometry, texCoord, indexArrayArray, 0, error, 1e-3f);
+    debugAssert(left.size() < (N - 1) * S * 6 / 4);
+
+    Array<bool> used, rightCopy;
+    used.resize(geometry.vertexArray.size());
+    rightCopy.resize(geometry.vertexArray.size());
+    System::memset(used.getCArray(), 0, used.size() * sizeof(bool));
+    System::memset(rightCopy.getCArray(), 0, rightCopy.size() * sizeof(bool));
+    for (int z = 0; z < N; ++z) {
+        rightCopy[seamIndex[z]] = true;
+    }
+
+    // Each chart keeps its own copy of the seam
+    for (int i = 0; i < left.size(); ++i) {
+        used[left[i]] = true;
+        debugAssert(! rightCopy[left[i]]);
+    }
+    for (int i = 0; i < right.size(); ++i) {
+        used[right[i]] = true;
+        debugAssert(rightCopy[right[i]] || (geometry.vertexArray[right[i]].x > S));
+    }
+
+    // Neither side of the seam was moved
+    for (int z = 0; z < N; ++z) {
+        debugAssert(used[vertexIndex[z * N + S]]);
+        debugAssert(used[seamIndex[z]]);
+    }
+
+    // The charts still cover the plane exactly
+    debugAssert(fuzzyEq(totalArea(geometry.vertexArray, left), float(S * (N - 1))));
+    debugAssert(fuzzyEq(totalArea(geometry.vertexArray, right), float((N - 1 - S) * (N - 1))));
+}
+
+
+static void testDegenerate() {
+    MeshAlg::Geometry geometry;
+    Array<int> index;
+    float error;
+    MeshAlg::simplify(geometry, Array<Vector2>(), index, 0, error);
+    debugAssert(index.size() == 0);
+
+    // Collapsing a lone triangle moves its corners far from its edges
+    geometry.vertexArray.append(Vector3(0, 0, 0), Vector3(1, 0, 0), Vector3(0, 1, 0), Vector3(0, 0, 1));
+    index.append(0, 1, 2);
+    MeshAlg::simplify(geometry, Array<Vector2>(), index, 0, error, 0.1f);
+    debugAssert(index.size() == 3);
+
+    // A tetrahedron cannot be reduced without becoming two coincident faces
+
+    index.append(0, 3, 1);
+    index.append(0, 2, 3);
+    index.append(1, 3, 2);
+    MeshAlg::simplify(geometry, Array<Vector2>(), index, 0, error);
+    debugAssert(index.size() == 12);
+
+    // Degenerate faces are removed
+    index.append(1, 1, 2);
+    MeshAlg::simplify(geometry, Array<Vector2>(), index, 100, error);
+    debugAssert(index.size() == 12);
+}
+
+
+void testMeshAlgSimplify() {
+    printf("MeshAlg::simplify ");
+
+    testFlat();
+    testTerrain();
+    testSeams();
+    testDegenerate();
+
+    printf("passed\n");
+}
+
+
+void perfMeshAlgSimplify() {
+    printf("----------------------------------------------------------\n");
+
+    const int N = 300;
+    MeshAlg::Geometry geometry;
+    Array<Vector2> texCoord;
+    Array<int> index;
+    makeTerrain(N, 5.0f, geometry, texCoord, index);
+
+    Stopwatch timer;
+    float error;
+    Array<int> simple = index;
+    timer.tick();
+    MeshAlg::simplify(geometry, texCoord, simple, index.size() / 30, error);
+    timer.tock();
+    printf("MeshAlg::simplify (%d -> %d faces)   %6.3f s  error %f\n\n",
+           index.size() / 3, simple.size() / 3, timer.elapsedTime(), error);
+}
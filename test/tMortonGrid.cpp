@@ -0,0 +1,292 @@
+#include "G3D/G3DAll.h"
+
+static void testRadixSort() {
+    printf("radixSort ");
+
+    Random r(11, false);
+    for (int trial = 0; trial < 20; ++trial) {
+        // Include sizes that span several blocks
+        const int n = (trial < 10) ? r.integer(0, 100) : r.integer(60000, 200000);
+        const int numBits = (trial % 4 == 0) ? 64 : r.integer(1, 40);
+
+        Array<uint64> key;
+        Array<int> value;
+        for (int i = 0; i < n; ++i) {
+            uint64 k = (uint64(r.bits()) << 32) | r.bits();
+            if (numBits < 64) {
+                // Few distinct keys so that stability matters
+                k &= (uint64(1) << iMin(numBits, (trial & 1) ? 4 : numBits)) - 1;
+            }
+            key.append(k);
+            value.append(i);
+        }
+
+        Array<uint64> sortedKey = key;
+        Array<int> sortedValue = value;
+        radixSort(sortedKey, sortedValue, numBits, (trial & 2) != 0);
+
+        for (int i = 0; i < n; ++i) {
+            debugAssert(sortedKey[i] == key[sortedValue[i]]);
+            if (i > 0) {
+                debugAssert(sortedKey[i - 1] <= sortedKey[i]);
+                if (sortedKey[i - 1] == sortedKey[i]) {
+                    debugAssertM(sortedValue[i - 1] < sortedValue[i], "radixSort is not stable");
+                }
+            }
+        }
+    }
+
+    printf("passed\n");
+}
+
+
+/** Clusters by distance alone, preferring the closest representative */
+class DistanceRule {
+public:
+    const Array<Vector3>*   point;
+    float                   radius;
+
+    bool match(int i, int j) const {
+        return ((*point)[i] - (*point)[j]).squaredMagnitude() <= square(radius);
+    }
+
+    float cost(int i, int j) const {
+        return ((*point)[i] - (*point)[j]).squaredMagnitude();
+    }
+};
+
+
+static void testCluster(const Array<Vector3>& point, float radius, bool useThreads) {
+    MortonGrid grid;
+    grid.set(point, radius, useThreads);
+    debugAssert(grid.size() == point.size());
+
+    DistanceRule rule;
+    rule.point = &point;
+    rule.radius = radius;
+
+    Array<int> representative;
+    grid.cluster(radius, rule, representative, useThreads);
+    debugAssert(representative.size() == point.size());
+
+    // Compare against the serial greedy algorithm
+    Array<int> rep;
+    for (int i = 0; i < point.size(); ++i) {
+        bool isRep = true;
+        for (int k = 0; (k < rep.size()) && isRep; ++k) {
+            isRep = ! rule.match(i, rep[k]);
+        }
+
+        if (isRep) {
+            rep.append(i);
+        }
+        debugAssert((representative[i] == i) == isRep);
+    }
+
+    // Every other point goes to the cheapest matching representative, even a later one
+    for (int i = 0; i < point.size(); ++i) {
+        if (representative[i] != i) {
+            int best = -1;
+            for (int k = 0; k < rep.size(); ++k) {
+                if (rule.match(i, rep[k]) && ((best == -1) || (rule.cost(i, rep[k]) < rule.cost(i, best)))) {
+                    best = rep[k];
+                }
+            }
+            debugAssert(representative[i] == best);
+        }
+    }
+}
+
+
+static void testMortonGridCells() {
+    Random r(5, false);
+    Array<Vector3> point;
+    for (int i = 0; i < 2000; ++i) {
+        point.append(Vector3(r.uniform(-10, 10), r.uniform(-1, 1), r.uniform(0, 30)));
+    }
+
+    MortonGrid grid;
+    grid.set(point, 0.5f);
+
+    // Every point is in exactly one cell, in index order
+    Array<int> count;
+    count.resize(point.size());
+    System::memset(count.getCArray(), 0, count.size() * sizeof(int));
+    for (int c = 0; c < grid.numCells(); ++c) {
+        for (int k = grid.cellBegin(c); k < grid.cellEnd(c); ++k) {
+            debugAssert(grid.position(k) == point[grid.index(k)]);
+            ++count[grid.index(k)];
+            if (k > grid.cellBegin(c)) {
+                debugAssert(grid.index(k - 1) < grid.index(k));
+            }
+        }
+    }
+    for (int i = 0; i < count.size(); ++i) {
+        debugAssert(count[i] == 1);
+    }
+
+    // Box queries find every point in the box
+    for (int q = 0; q < 50; ++q) {
+        const Vector3 c(r.uniform(-12, 12), r.uniform(-2, 2), r.uniform(-2, 32));
+        const Vector3 e = Vector3(r.uniform(0, 3), r.uniform(0, 3), r.uniform(0, 3)) * ((q < 5) ? 10.0f : 1.0f);
+        const AABox box(c - e, c + e);
+
+        Array<int> cell;
+        grid.getCells(box, cell);
+
+        Array<bool> found;
+        found.resize(point.size());
+        System::memset(found.getCArray(), 0, found.size() * sizeof(bool));
+        for (int i = 0; i < cell.size(); ++i) {
+            for (int k = grid.cellBegin(cell[i]); k < grid.cellEnd(cell[i]); ++k) {
+                found[grid.index(k)] = true;
+            }
+        }
+        for (int i = 0; i < point.size(); ++i) {
+            if (box.contains(point[i])) {
+                debugAssert(found[i]);
+            }
+        }
+    }
+}
+
+
+static void testComputeWeld() {
+    Random r(9, false);
+
+    // Many near-duplicates, as produced by unindexed meshes
+    Array<Vector3> oldVertex;
+    for (int i = 0; i < 3000; ++i) {
+        // Every lattice point at least once
+        const int k = (i < 21 * 21) ? i : r.integer(0, 21 * 21 - 1);
+        const Vector3 v(float(k % 21), float(k / 21), 0.0f);
+        oldVertex.append(v + Vector3(r.uniform(-1, 1), r.uniform(-1, 1), r.uniform(-1, 1)) * 0.001f);
+    }
+
+    Array<Vector3> newVertex;
+    Array<int> toNew, toOld;
+    const double radius = 0.01;
+    MeshAlg::computeWeld(oldVertex, newVertex, toNew, toOld, radius);
+
+    debugAssert(newVertex.size() == 21 * 21);
+    debugAssert(toNew.size() == oldVertex.size());
+    debugAssert(toOld.size() == newVertex.size());
+    for (int ni = 0; ni < newVertex.size(); ++ni) {
+        // New vertices are the first occurrences, in order
+        debugAssert(newVertex[ni] == oldVertex[ni]);
+        debugAssert(toNew[toOld[ni]] == ni);
+    }
+    for (int oi = 0; oi < oldVertex.size(); ++oi) {
+        debugAssert(toOld[toNew[oi]] >= oi);
+        debugAssert((oldVertex[oi] - newVertex[toNew[oi]]).length() <= radius);
+    }
+}
+
+
+void testMortonGrid() {
+    printf("MortonGrid ");
+
+    testMortonGridCells();
+
+    Random r(1, false);
+    for (int trial = 0; trial < 6; ++trial) {
+        Array<Vector3> point;
+        const int n = 200 + 400 * trial;
+        for (int i = 0; i < n; ++i) {
+            if ((trial > 2) && (i > 0) && (r.uniform() < 0.3f)) {
+                // Exact duplicates
+                point.append(point[r.integer(0, i - 1)]);
+            } else {
+                point.append(Vector3(r.uniform(0, 10), r.uniform(0, 10), r.uniform(0, 0.1f)));
+            }
+        }
+        testCluster(point, 0.25f + 0.1f * trial, (trial & 1) != 0);
+    }
+
+    {
+        // A long chain of points closer than the radius forces the serial fallback
+        Array<Vector3> point;
+        for (int i = 0; i < 1000; ++i) {
+            point.append(Vector3(i * 0.3f, 0, 0));
+        }
+        testCluster(point, 0.5f, true);
+    }
+
+    {
+        // Degenerate inputs
+        Array<Vector3> point;
+        testCluster(point, 1.0f, true);
+        point.append(Vector3(1, 2, 3));
+        testCluster(point, 0.0f, true);
+        point.append(Vector3(1, 2, 3), Vector3(1, 2, 3));
+        testCluster(point, 0.0f, true);
+    }
+
+    testComputeWeld();
+
+    printf("passed\n");
+
+    testRadixSort();
+}
+
+
+void perfMortonGrid() {
+    printf("----------------------------------------------------------\n");
+
+    // A finely tessellated, unindexed terrain
+    const int N = 600;
+    Array<Vector3> grid;
+    for (int y = 0; y < N; ++y) {
+        for (int x = 0; x < N; ++x) {
+            grid.append(Vector3(float(x), sin(x * 0.1f) * cos(y * 0.07f) * 10.0f, float(y)));
+        }
+    }
+
+    Array<int> index;
+    Array<Vector3> unindexed;
+    for (int y = 0; y < N - 1; ++y) {
+        for (int x = 0; x < N - 1; ++x) {
+            const int a = y * N + x;
+            index.append(a, a + 1, a + N);
+            index.append(a + 1, a + N + 1, a + N);
+        }
+    }
+    for (int i = 0; i < index.size(); ++i) {
+        unindexed.append(grid[index[i]]);
+    }
+
+    Stopwatch timer;
+    Array<Vector3> welded;
+    Array<int> toNew, toOld;
+    timer.tick();
+    MeshAlg::computeWeld(unindexed, welded, toNew, toOld, 0.01);
+    timer.tock();
+    debugAssert(welded.size() == grid.size());
+    printf("MeshAlg::computeWeld (%d vertices)         %6.3f s\n", unindexed.size(), timer.elapsedTime());
+
+    Array<MeshAlg::Face> face;
+    Array<MeshAlg::Edge> edge;
+    Array<MeshAlg::Vertex> vertex;
+    MeshAlg::CompactVertexArray compact;
+    timer.tick();
+    MeshAlg::computeAdjacency(grid, index, face, edge, compact);
+    timer.tock();
+    printf("MeshAlg::computeAdjacency (%d faces, CSR)   %6.3f s\n", face.size(), timer.elapsedTime());
+
+    timer.tick();
+    MeshAlg::computeAdjacency(grid, index, face, edge, vertex);
+    timer.tock();
+    printf("MeshAlg::computeAdjacency (%d faces)        %6.3f s\n", face.size(), timer.elapsedTime());
+
+    Array<uint64> key;
+    Array<int> value;
+    Random r(2, false);
+    for (int i = 0; i < 4000000; ++i) {
+        key.append(((uint64(r.bits()) << 32) | r.bits()) & 0xFFFFFFFFFFULL);
+        value.append(i);
+    }
+    timer.tick();
+    radixSort(key, value, 40);
+    timer.tock();
+    printf("radixSort (%d 40-bit keys)            %6.3f s\n\n", key.size(), timer.elapsedTime());
+}
@@ -0,0 +1,251 @@
+#include "G3D/G3DAll.h"
+
+/** Appends an axis-aligned box as twelve triangles */
+static void appendBox(const AABox& box, Array<Vector3>& vertex, Array<int>& index) {
+    const int first = vertex.size();
+    for (int c = 0; c < 8; ++c) {
+        vertex.append(Vector3((c & 1) ? box.high().x : box.low().x,
+                              (c & 2) ? box.high().y : box.low().y,
+                              (c & 4) ? box.high().z : box.low().z));
+    }
+
+    static const int face[6][4] = {{0, 1, 3, 2}, {4, 6, 7, 5}, {0, 4, 5, 1}, {2, 3, 7, 6}, {0, 2, 6, 4}, {1, 5, 7, 3}};
+    for (int f = 0; f < 6; ++f) {
+        index.append(first + face[f][0], first + face[f][1], first + face[f][2]);
+        index.append(first + face[f][0], first + face[f][2], first + face[f][3]);
+    }
+}
+
+
+/** Appends a quad with corners a, b, c, d */
+static void appendQuad(const Vector3& a, const Vector3& b, const Vector3& c, const Vector3& d, Array<Vector3>& vertex, Array<int>& index) {
+    const int first = vertex.size();
+    vertex.append(a, b, c, d);
+    index.append(first, first + 1, first + 2);
+    index.append(first, first + 2, first + 3);
+}
+
+
+static AABox boxAt(const Vector3& center, float radius) {
+    return AABox(center - Vector3(radius, radius, radius), center + Vector3(radius, radius, radius));
+}
+
+
+static void testWall() {
+    // The default camera is at the origin looking along -z
+    GCamera camera;
+    const Rect2D viewport = Rect2D::xywh(0, 0, 640, 400);
+
+    OcclusionBuffer::Ref occlusion = OcclusionBuffer::create(100, 60);
+    debugAssert(occlusion->width() == 128 && occlusion->height() == 64);
+
+    // A wall at z = -10 that fills the view
+    Array<Vector3> vertex;
+    Array<int> index;
+    appendQuad(Vector3(-100, -100, -10), Vector3(100, -100, -10), Vector3(100, 100, -10), Vector3(-100, 100, -10), vertex, index);
+
+    occlusion->setCamera(camera, viewport);
+    occlusion->addOccluder(CoordinateFrame(), vertex, index);
+    occlusion->render();
+    debugAssert(occlusion->numTriangles() == 2);
+
+    for (int y = 0; y < occlusion->height(); y += 7) {
+        for (int x = 0; x < occlusion->width(); x += 5) {
+            debugAssert(fuzzyEq(occlusion->depth(x, y), 0.1f));
+        }
+    }
+
+    debugAssert(occlusion->occluded(boxAt(Vector3(0, 0, -20), 1)));
+    debugAssert(occlusion->occluded(boxAt(Vector3(3, -2, -50), 4)));
+    debugAssert(! occlusion->occluded(boxAt(Vector3(0, 0, -5), 1)));
+    // Intersects the wall
+    debugAssert(! occlusion->occluded(boxAt(Vector3(0, 0, -10.5f), 1)));
+    // Behind the camera and crossing the near plane
+    debugAssert(! occlusion->occluded(boxAt(Vector3(0, 0, 5), 1)));
+    debugAssert(! occlusion->occluded(boxAt(Vector3(0, 0, 0), 2)));
+    debugAssert(! occlusion->occluded(AABox::inf()));
+
+    // Move the wall with the object-to-world frame; it is now behind the boxes
+    occlusion->setCamera(camera, viewport);
+    occlusion->addOccluder(CoordinateFrame(Vector3(0, 0, -100)), vertex, index);
+    occlusion->render();
+    debugAssert(! occlusion->occluded(boxAt(Vector3(0, 0, -20), 1)));
+    debugAssert(occlusion->occluded(boxAt(Vector3(0, 0, -200), 1)));
+
+    // No occluders
+    occlusion->setCamera(camera, viewport);
+    occlusion->render();
+    debugAssert(occlusion->numTriangles() == 0);
+    debugAssert(! occlusion->occluded(boxAt(Vector3(0, 0, -20), 1)));
+}
+
+
+static void testPartialOccluders() {
+    GCamera camera;
+    const Rect2D viewport = Rect2D::xywh(0, 0, 640, 400);
+    OcclusionBuffer::Ref occlusion = OcclusionBuffer::create(256, 128);
+
+    // A wall covering the left half of the view, as MeshAlg::Geometry
+    MeshAlg::Geometry wall;
+    Array<int> wallIndex;
+    appendQuad(Vector3(-100, -100, -10), Vector3(0, -100, -10), Vector3(0, 100, -10), Vector3(-100, 100, -10), wall.vertexArray, wallIndex);
+
+    // A ground plane at y = -2 that extends behind the camera, so that it is clipped by the near plane
+    Array<Vector3> ground;
+    Array<int> groundIndex;
+    appendQuad(Vector3(-1000, -2, 50), Vector3(1000, -2, 50), Vector3(1000, -2, -1000), Vector3(-1000, -2, -1000), ground, groundIndex);
+
+    occlusion->setCamera(camera, viewport);
+    occlusion->addOccluder(CoordinateFrame(), wall, wallIndex);
+    occlusion->addOccluder(CoordinateFrame(), ground, groundIndex);
+    occlusion->render();
+
+    // Behind the wall
+    debugAssert(occlusion->occluded(boxAt(Vector3(-10, 0, -30), 2)));
+    // Right of the wall
+    debugAssert(! occlusion->occluded(boxAt(Vector3(10, 0, -30), 2)));
+    // Straddles the edge of the wall
+    debugAssert(! occlusion->occluded(boxAt(Vector3(0, 0, -30), 2)));
+
+    // Below the ground
+    debugAssert(occlusion->occluded(boxAt(Vector3(10, -8, -30), 2)));
+    debugAssert(occlusion->occluded(boxAt(Vector3(3, -4, -10), 1)));
+    // Standing on the ground
+    debugAssert(! occlusion->occluded(boxAt(Vector3(10, -1, -30), 0.9f)));
+}
+
+
+/** Compares the buffer to ray casts through the pixel centers */
+static void testAgainstRayCasting() {
+    Random r(7, false);
+    const Rect2D viewport = Rect2D::xywh(0, 0, 400, 300);
+
+    GCamera camera;
+    camera.setCoordinateFrame(CoordinateFrame(Vector3(1, 2, 3)));
+    camera.setFieldOfView(toRadians(70), GCamera::VERTICAL);
+
+    Array<Vector3> vertex;
+    Array<int> index;
+    for (int i = 0; i < 40; ++i) {
+        const Vector3 center(r.uniform(-20, 20), r.uniform(-15, 15), r.uniform(-40, 5));
+        vertex.append(center + Vector3::random(r) * 8, center + Vector3::random(r) * 8, center + Vector3::random(r) * 8);
+        index.append(vertex.size() - 3, vertex.size() - 2, vertex.size() - 1);
+    }
+    const CoordinateFrame objectToWorld(Matrix3::fromAxisAngle(Vector3::unitY(), 0.3f), Vector3(1, 1, 0));
+
+    // Ray::intersectionTime ignores back faces, so include both windings
+    Array<Triangle> triangle;
+    for (int i = 0; i < index.size(); i += 3) {
+        const Vector3& a = objectToWorld.pointToWorldSpace(vertex[index[i]]);
+        const Vector3& b = objectToWorld.pointToWorldSpace(vertex[index[i + 1]]);
+        const Vector3& c = objectToWorld.pointToWorldSpace(vertex[index[i + 2]]);
+        triangle.append(Triangle(a, b, c), Triangle(a, c, b));
+    }
+
+    OcclusionBuffer::Ref occlusion = OcclusionBuffer::create(160, 96);
+    occlusion->setCamera(camera, viewport);
+    occlusion->addOccluder(objectToWorld, vertex, index);
+    occlusion->render();
+
+    const Vector3& look = camera.coordinateFrame().lookVector();
+    const float nearDistance = -camera.nearPlaneZ();
+    int numMismatched = 0;
+    for (int y = 0; y < occlusion->height(); ++y) {
+        for (int x = 0; x < occlusion->width(); ++x) {
+            const Ray& ray = camera.worldRay((x + 0.5f) * viewport.width() / occlusion->width(),
+                                             (y + 0.5f) * viewport.height() / occlusion->height(), viewport);
+            float expected = 0.0f;
+            for (int t = 0; t < triangle.size(); ++t) {
+                const float d = ray.intersectionTime(triangle[t]);
+                if (d < finf()) {
+                    const float w = (ray.direction() * d).dot(look);
+                    if (w >= nearDistance) {
+                        expected = max(expected, 1.0f / w);
+                    }
+                }
+            }
+
+            if (abs(occlusion->depth(x, y) - expected) > 1e-3f * max(expected, 0.01f)) {
+                // Pixel centers on edges may be classified either way
+                ++numMismatched;
+            }
+        }
+    }
+    debugAssertM(numMismatched < occlusion->width() * occlusion->height() / 200, format("%d pixels differ", numMismatched));
+    (void)numMismatched;
+}
+
+
+void testOcclusionBuffer() {
+    printf("OcclusionBuffer ");
+
+    testWall();
+    testPartialOccluders();
+    testAgainstRayCasting();
+
+    printf("passed\n");
+}
+
+
+void perfOcclusionBuffer() {
+    printf("----------------------------------------------------------\n");
+
+    // A city of 40 x 40 buildings with small objects on the streets
+    Random r(3, false);
+    Array<Vector3> vertex;
+    Array<int> index;
+    Array<AABox> object;
+    const float spacing = 20.0f;
+    for (int i = 0; i < 40; ++i) {
+        for (int j = 0; j < 40; ++j) {
+            const Vector3 corner((i - 20) * spacing, 0, (j - 20) * spacing);
+            appendBox(AABox(corner, corner + Vector3(14, r.uniform(10, 60), 14)), vertex, index);
+            for (int k = 0; k < 30; ++k) {
+                const Vector3 p = corner + Vector3(r.uniform(14, spacing), 0, r.uniform(0, spacing));
+                object.append(AABox(p, p + Vector3(1, r.uniform(1, 3), 1)));
+            }
+        }
+    }
+
+    GCamera camera;
+    camera.setFarPlaneZ(-1000);
+    const Rect2D viewport = Rect2D::xywh(0, 0, 1280, 720);
+    OcclusionBuffer::Ref occlusion = OcclusionBuffer::create();
+
+    const int numFrames = 50;
+    int numVisible = 0;
+    int numOccluded = 0;
+    RealTime renderTime = 0, testTime = 0;
+    for (int f = 0; f < numFrames; ++f) {
+        CoordinateFrame cframe(Vector3(-3, 2, -3));
+        cframe.lookAt(cframe.translation + Vector3(cos(f * 0.1f), 0, sin(f * 0.1f)));
+        camera.setCoordinateFrame(cframe);
+
+        RealTime t0 = System::time();
+        occlusion->setCamera(camera, viewport);
+        occlusion->addOccluder(CoordinateFrame(), vertex, index);
+        occlusion->render();
+        renderTime += System::time() - t0;
+
+        Array<Plane> clip;
+        camera.getClipPlanes(viewport, clip);
+        t0 = System::time();
+        for (int i = 0; i < object.size(); ++i) {
+            if (! object[i].culledBy(clip)) {
+                if (occlusion->occluded(object[i])) {
+                    ++numOccluded;
+                } else {
+                    ++numVisible;
+                }
+            }
+        }
+        testTime += System::time() - t0;
+    }
+
+    printf("OcclusionBuffer, %d occluder triangles at %dx%d, %d boxes (%d frames):\n",
+           index.size() / 3, occlusion->width(), occlusion->height(), object.size(), numFrames);
+    printf("  render:            %6.3fs  (%d triangles after clipping in the last frame)\n", renderTime, occlusion->numTriangles());
+    printf("  frustum + occlusion tests: %6.3fs\n", testTime);
+    printf("  %.1f boxes per frame in the frustum, %.1f of them occluded\n\n",
+           (numVisible + numOccluded) / (float)numFrames, numOccluded / (float)numFrames);
+}
@@ -174,9 +174,90 @@ void testSphereIterator() {
     }
 }
 
+static void testBatchQueries() {
+    PointHashGrid<Vector3> grid(0.1f);
+    Array<Vector3> point;
+    for (int i = 0; i < 3000; ++i) {
+        point.append(Vector3(uniformRandom(0,1), uniformRandom(0,1), uniformRandom(0,1)));
+    }
+    grid.insert(point);
+
+    Array<Vector3> query;
+    for (int i = 0; i < 2500; ++i) {
+        query.append(Vector3(uniformRandom(-0.1f, 1.1f), uniformRandom(-0.1f, 1.1f), uniformRandom(-0.1f, 1.1f)));
+    }
+
+    // Radius larger than the cell width exercises the outer shells
+    const float radius[] = {0.07f, 0.25f};
+    for (int r = 0; r < 2; ++r) {
+        for (int threads = 0; threads < 2; ++threads) {
+            Array<int> offset;
+            Array<const Vector3*> result;
+            grid.radiusSearchAll(query, radius[r], offset, result, threads == 1);
+            debugAssert(offset.size() == query.size() + 1);
+            debugAssert(offset.last() == result.size());
+
+            for (int q = 0; q < query.size(); ++q) {
+                int expected = 0;
+                for (int i = 0; i < point.size(); ++i) {
+                    if ((point[i] - query[q]).squaredLength() <= square(radius[r])) {
+                        ++expected;
+                    }
+                }
+                debugAssert(offset[q + 1] - offset[q] == expected);
+                for (int j = offset[q]; j < offset[q + 1]; ++j) {
+                    debugAssert((*result[j] - query[q]).squaredLength() <= square(radius[r]));
+                }
+            }
+        }
+    }
+
+    {
+        const int k = 5;
+        Array<const Vector3*> result;
+        grid.kNearest(query, k, result);
+        debugAssert(result.size() == query.size() * k);
+        for (int q = 0; q < query.size(); ++q) {
+            Array<float> d;
+            for (int i = 0; i < point.size(); ++i) {
+                d.append((point[i] - query[q]).squaredLength());
+            }
+            d.sort();
+            for (int j = 0; j < k; ++j) {
+                debugAssert(result[q * k + j] != NULL);
+                debugAssert(fuzzyEq((*result[q * k + j] - query[q]).squaredLength(), d[j]));
+            }
+        }
+
+        // Not enough values within maxDistance
+        grid.kNearest(query, k, result, 0.01f);
+        for (int i = 0; i < result.size(); ++i) {
+            const int q = i / k;
+            debugAssert((result[i] == NULL) || ((*result[i] - query[q]).length() <= 0.01f));
+        }
+
+        // Queries hundreds of cells outside the bounds, with no maxDistance
+        Array<Vector3> far;
+        far.append(Vector3(50, 0.5f, 0.5f), Vector3(-30, -30, -30), Vector3(0.5f, 0.5f, 200));
+        grid.kNearest(far, k, result);
+        for (int q = 0; q < far.size(); ++q) {
+            Array<float> d;
+            for (int i = 0; i < point.size(); ++i) {
+                d.append((point[i] - far[q]).squaredLength());
+            }
+            d.sort();
+            for (int j = 0; j < k; ++j) {
+                debugAssert(result[q * k + j] != NULL);
+                debugAssert(fuzzyEq((*result[q * k + j] - far[q]).squaredLength(), d[j]));
+            }
+        }
+    }
+}
+
 void testPointHashGrid() {
     testSphereIterator();
     correctPointHashGrid();
+    testBatchQueries();
 
     Array<Vector3> vec3Array;
     vec3Array.append(Vector3(0.0, 0.0, 0.0));
@@ -371,4 +452,21 @@ void perfPointHashGrid() {
     printf("PointHashGrid   %10f s  %10f us (%.3gX faster)\n", hashGridTimer.elapsedTime(), hashGridTimer.elapsedTime() * 1e6 / count,
            treeTimer.elapsedTime()/hashGridTimer.elapsedTime());
     printf("\nPointHashGrid performance: max bucket size = %d, average length = %f\n", hashGrid.debugGetDeepestBucketSize(), hashGrid.debugGetAverageBucketSize());
+
+    Stopwatch batchTimer;
+    Array<int> offset;
+    Array<const Vector3*> neighbor;
+    batchTimer.tick();
+    hashGrid.radiusSearchAll(pos, sphere.radius, offset, neighbor);
+    batchTimer.tock();
+
+    Stopwatch kNearestTimer;
+    kNearestTimer.tick();
+    hashGrid.kNearest(pos, 8, neighbor);
+    kNearestTimer.tock();
+
+    printf("PointHashGrid::radiusSearchAll %10f s (%.3gX faster than SphereIterator, %d workers)\n", 
+           batchTimer.elapsedTime(), hashGridTimer.elapsedTime() / batchTimer.elapsedTime(),
+           TaskScheduler::global()->numWorkers());
+    printf("PointHashGrid::kNearest(k = 8) %10f s\n", kNearestTimer.elapsedTime());
 }
@@ -0,0 +1,236 @@
+#include "G3D/G3DAll.h"
+using G3D::uint8;
+using G3D::uint32;
+using G3D::uint64;
+
+/** Allocates and frees a mix of tiny, small, medium, and heap buffers,
+    stamping each with a per-thread byte so that overlapping allocations
+    between threads are detected. */
+class MallocThread : public GThread {
+public:
+    int     m_iterations;
+    uint8   m_stamp;
+    bool    m_ok;
+
+    MallocThread(int iterations, uint8 stamp) : GThread("MallocThread"),
+        m_iterations(iterations), m_stamp(stamp), m_ok(true) {}
+
+protected:
+
+    virtual void threadMain() {
+        static const int N = 64;
+        static const size_t sizes[] = {8, 100, 128, 500, 1024, 3000, 4096, 10000};
+        static const int numSizes = sizeof(sizes) / sizeof(sizes[0]);
+
+        uint8* ptr[N];
+        size_t bytes[N];
+        System::memset(ptr, 0, sizeof(ptr));
+
+        for (int i = 0; i < m_iterations; ++i) {
+            int j = i % N;
+            if (ptr[j] != NULL) {
+                for (size_t b = 0; b < bytes[j]; ++b) {
+                    if (ptr[j][b] != m_stamp) {
+                        m_ok = false;
+                    }
+                }
+                System::free(ptr[j]);
+            }
+
+            bytes[j] = sizes[(i * 7 + j) % numSizes];
+            ptr[j] = (uint8*)System::malloc(bytes[j]);
+            System::memset(ptr[j], m_stamp, bytes[j]);
+        }
+
+        for (int j = 0; j < N; ++j) {
+            System::free(ptr[j]);
+        }
+    }
+};
+
+
+/** Blocks passed from a ProducerThread to a ConsumerThread */
+class BlockQueue {
+public:
+    class Block {
+    public:
+        uint8*  ptr;
+        size_t  bytes;
+        uint8   stamp;
+    };
+
+    GMutex          mutex;
+    Queue<Block>    queue;
+};
+
+
+/** Allocates and stamps blocks that a ConsumerThread frees */
+class ProducerThread : public GThread {
+public:
+    BlockQueue*     m_queue;
+    int             m_count;
+
+    ProducerThread(BlockQueue* queue, int count) : GThread("ProducerThread"), m_queue(queue), m_count(count) {}
+
+protected:
+
+    virtual void threadMain() {
+        static const size_t sizes[] = {8, 100, 128, 500, 1024, 3000, 4096, 10000};
+        static const int numSizes = sizeof(sizes) / sizeof(sizes[0]);
+
+        for (int i = 0; i < m_count; ++i) {
+            BlockQueue::Block b;
+            b.bytes = sizes[i % numSizes];
+            b.stamp = (uint8)(i * 13 + 1);
+            b.ptr   = (uint8*)System::malloc(b.bytes);
+            System::memset(b.ptr, b.stamp, b.bytes);
+
+            // Keep the queue short so that freed blocks come back to this thread
+            bool full = true;
+            while (full) {
+                m_queue->mutex.lock();
+                full = (m_queue->queue.size() >= 256);
+                if (! full) {
+                    m_queue->queue.pushBack(b);
+                }
+                m_queue->mutex.unlock();
+                if (full) {
+                    System::sleep(0);
+                }
+            }
+        }
+    }
+};
+
+
+/** Frees the blocks allocated by a ProducerThread, checking that no
+    other allocation overwrote them first */
+class ConsumerThread : public GThread {
+public:
+    BlockQueue*     m_queue;
+    int             m_count;
+    bool            m_ok;
+
+    ConsumerThread(BlockQueue* queue, int count) : GThread("ConsumerThread"), m_queue(queue), m_count(count), m_ok(true) {}
+
+protected:
+
+    virtual void threadMain() {
+        int received = 0;
+        while (received < m_count) {
+            m_queue->mutex.lock();
+            const bool empty = (m_queue->queue.size() == 0);
+            BlockQueue::Block b;
+            if (! empty) {
+                b = m_queue->queue.popFront();
+            }
+            m_queue->mutex.unlock();
+
+            if (empty) {
+                System::sleep(0);
+                continue;
+            }
+
+            for (size_t i = 0; i < b.bytes; ++i) {
+                if (b.ptr[i] != b.stamp) {
+                    m_ok = false;
+                }
+            }
+            System::free(b.ptr);
+            ++received;
+        }
+    }
+};
+
+
+static RealTime runMallocThreads(int numThreads, int iterations, bool& ok) {
+    ThreadSet threads;
+    Array<ReferenceCountedPointer<MallocThread> > list;
+    for (int t = 0; t < numThreads; ++t) {
+        list.append(new MallocThread(iterations, (uint8)(t + 1)));
+        threads.insert(list.last());
+    }
+
+    RealTime t0 = System::time();
+    threads.start();
+    threads.waitForCompletion();
+    RealTime elapsed = System::time() - t0;
+
+    ok = true;
+    for (int t = 0; t < list.size(); ++t) {
+        ok = ok && list[t]->m_ok;
+    }
+    return elapsed;
+}
+
+
+void testSystemMalloc() {
+    printf("System::malloc ");
+
+    {
+        // Alignment must work for pool blocks, which are offset by a size header
+        for (int i = 0; i < 100; ++i) {
+            void* p = System::alignedMalloc(i * 37 + 1, 16);
+            debugAssert(((size_t)p & 15) == 0);
+            System::alignedFree(p);
+        }
+    }
+
+    {
+        // Realloc preserves contents across size classes
+        uint8* p = (uint8*)System::malloc(100);
+        for (int i = 0; i < 100; ++i) {
+            p[i] = (uint8)i;
+        }
+        p = (uint8*)System::realloc(p, 2000);
+        p = (uint8*)System::realloc(p, 9000);
+        for (int i = 0; i < 100; ++i) {
+            debugAssert(p[i] == (uint8)i);
+        }
+        System::free(p);
+    }
+
+    {
+        // Threads sharing the pools do not receive each other's live blocks
+        bool ok = false;
+        runMallocThreads(4, 20000, ok);
+        debugAssert(ok);
+        (void)ok;
+    }
+
+    {
+        // Blocks allocated on one thread and freed on another return
+        // to the shared pools and are reused by the allocating thread
+        // without corruption
+        BlockQueue queue;
+        const int count = 20000;
+        ThreadSet threads;
+        ReferenceCountedPointer<ProducerThread> producer = new ProducerThread(&queue, count);
+        ReferenceCountedPointer<ConsumerThread> consumer = new ConsumerThread(&queue, count);
+        threads.insert(producer);
+        threads.insert(consumer);
+        threads.start();
+        threads.waitForCompletion();
+        debugAssert(consumer->m_ok);
+        debugAssert(queue.queue.size() == 0);
+    }
+
+    System::flushThreadMallocCache();
+
+    printf("passed\n");
+}
+
+
+void perfSystemMalloc() {
+    printf("----------------------------------------------------------\n");
+    printf("System::malloc scaling (1M malloc/free pairs per thread):\n");
+
+    const int iterations = 1000000;
+    bool ok = false;
+    const RealTime base = runMallocThreads(1, iterations, ok);
+    for (int n = 1; n <= iMax(2, System::numCores()); n *= 2) {
+        RealTime t = runMallocThreads(n, iterations, ok);
+        printf("  %2d threads: %6.3fs (%4.2fx throughput)\n", n, t, n * base / t);
+    }
+    printf("  %s\n\n", System::mallocPerformance().c_str());
+}
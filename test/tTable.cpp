@@ -62,6 +62,88 @@ bool operator==(const TableKeyWithCustomHashStruct& lhs, const TableKeyWithCusto
 }
 
 
+/** Checks FlatTable against Table under random insertions and removals */
+static void testFlatTable() {
+    {
+        FlatTable<int, int> flat;
+        Table<int, int> table;
+        Random rnd(7);
+
+        for (int i = 0; i < 20000; ++i) {
+            const int key = rnd.integer(0, 3000);
+            if (rnd.uniform() < 0.6f) {
+                flat.set(key, i);
+                table.set(key, i);
+            } else {
+                const bool removed = flat.remove(key);
+                debugAssert(removed == table.remove(key));
+                (void)removed;
+            }
+            debugAssert(flat.size() == table.size());
+            debugAssert(flat.load() <= flat.maxLoadFactor());
+        }
+
+        for (int key = 0; key <= 3000; ++key) {
+            int expected = 0;
+            const bool present = table.get(key, expected);
+            debugAssert(flat.containsKey(key) == present);
+            const int* v = flat.getPointer(key);
+            debugAssert((v != NULL) == present);
+            debugAssert((v == NULL) || (*v == expected));
+            (void)v;
+        }
+
+        int count = 0;
+        for (FlatTable<int, int>::Iterator it = flat.begin(); it.hasMore(); ++it) {
+            debugAssert(table[it->key] == it->value);
+            ++count;
+        }
+        debugAssert(count == (int)table.size());
+
+        FlatTable<int, int> copy(flat);
+        debugAssert(copy.size() == flat.size());
+        Array<int> keys;
+        flat.getKeys(keys);
+        for (int k = 0; k < keys.size(); ++k) {
+            debugAssert(copy[keys[k]] == flat[keys[k]]);
+            copy.remove(keys[k]);
+        }
+        debugAssert(copy.size() == 0);
+        debugAssert(copy.begin() == copy.end());
+    }
+
+    // Every key has the same hash code
+    {
+        TableKey        x[100];
+        FlatTable<TableKey*, int> table;
+        for (int i = 0; i < 100; ++i) {
+            x[i].value = i;
+            table.set(x + i, i);
+        }
+        debugAssert(table.size() == 100);
+        debugAssert(table.debugGetLongestProbe() == 100);
+        for (int i = 0; i < 100; i += 2) {
+            table.remove(x + i);
+        }
+        for (int i = 0; i < 100; ++i) {
+            debugAssert(table.containsKey(x + i) == (i % 2 == 1));
+        }
+    }
+
+    {
+        FlatTable<std::string, int> table(0.5f);
+        table.setSizeHint(100);
+        const size_t capacity = table.capacity();
+        for (int i = 0; i < 100; ++i) {
+            table.getCreate(format("%d", i)) = i;
+        }
+        debugAssert(table.capacity() == capacity);
+        debugAssert(table["42"] == 42);
+        (void)capacity;
+    }
+}
+
+
 void testTable() {
 
     printf("G3D::Table  ");
@@ -196,6 +278,8 @@ void testTable() {
         Table<WrapMode, int> table;
     }
 
+    testFlatTable();
+
     printf("passed\n");
 }
 
@@ -203,6 +287,7 @@ void testTable() {
 template<class K, class V>
 void perfTest(const char* description, const K* keys, const V* vals, int M) {
     uint64 tableSet = 0, tableGet = 0, tableRemove = 0;
+    uint64 flatSet = 0, flatGet = 0, flatRemove = 0;
     uint64 mapSet = 0, mapGet = 0, mapRemove = 0;
 #   ifdef HAS_HASH_MAP
     uint64 hashMapSet = 0, hashMapGet = 0, hashMapRemove = 0;
@@ -247,6 +332,28 @@ void perfTest(const char* description, const K* keys, const V* vals, int M) {
 
         /////////////////////////////////
 
+        {FlatTable<K, V> t;
+        System::beginCycleCount(flatSet);
+        for (int i = 0; i < M; ++i) {
+            t.set(keys[i], vals[i]);
+        }
+        System::endCycleCount(flatSet);
+        
+        System::beginCycleCount(flatGet);
+        for (int i = 0; i < M; ++i) {
+            t[keys[i]];
+        }
+        System::endCycleCount(flatGet);
+
+        System::beginCycleCount(flatRemove);
+        for (int i = 0; i < M; ++i) {
+            t.remove(keys[i]);
+        }
+        System::endCycleCount(flatRemove);
+        }
+
+        /////////////////////////////////
+
         {std::map<K, V> t;
         System::beginCycleCount(mapSet);
         for (int i = 0; i < M; ++i) {
@@ -300,6 +407,18 @@ void perfTest(const char* description, const K* keys, const V* vals, int M) {
     }
     tableRemove -= overhead;
 
+    flatSet -= overhead;
+    if (flatGet < overhead) {
+        flatGet = 0;
+    } else {
+        flatGet -= overhead;
+    }
+    if (flatRemove < overhead) {
+        flatRemove = 0;
+    } else {
+        flatRemove -= overhead;
+    }
+
     mapSet -= overhead;
     mapGet -= overhead;
     mapRemove -= overhead;
@@ -313,6 +432,8 @@ void perfTest(const char* description, const K* keys, const V* vals, int M) {
     printf("Table         %9.1f  %9.1f  %9.1f   %s\n", 
            (float)tableSet / N, (float)tableGet / N, (float)tableRemove / N,
            G3Dwin ? " ok " : "FAIL"); 
+    printf("FlatTable     %9.1f  %9.1f  %9.1f\n", 
+           (float)flatSet / N, (float)flatGet / N, (float)flatRemove / N); 
 #   ifdef HAS_HASH_MAP
     printf("hash_map      %9.1f  %9.1f  %9.1f\n", (float)hashMapSet / N, (float)hashMapGet / N, (float)hashMapRemove / N); 
 #   endif
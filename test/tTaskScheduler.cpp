@@ -0,0 +1,197 @@
+#include "G3D/G3DAll.h"
+using G3D::uint8;
+using G3D::uint32;
+using G3D::uint64;
+
+namespace {
+
+class Square {
+public:
+    int*    data;
+
+    void operator()(int begin, int end) const {
+        for (int i = begin; i < end; ++i) {
+            data[i] = i * i;
+        }
+    }
+};
+
+
+/** Recursive fork/join, exercising nested TaskGroup::wait on worker threads */
+class FibTask : public Task {
+public:
+    int     n;
+    int     result;
+
+    FibTask(int n) : n(n), result(0) {}
+
+    virtual void run() {
+        if (n < 2) {
+            result = n;
+        } else {
+            FibTask a(n - 1);
+            FibTask b(n - 2);
+            TaskGroup group;
+            group.run(&a);
+            b.run();
+            group.wait();
+            result = a.result + b.result;
+        }
+    }
+};
+
+
+class CountTask : public Task {
+public:
+    AtomicInt32*    count;
+
+    virtual void run() {
+        count->increment();
+    }
+};
+
+
+class SumThread : public GThread {
+public:
+    const int*      data;
+    int             begin;
+    int             end;
+    int64           sum;
+
+    SumThread(const int* d, int b, int e) : GThread("SumThread"), data(d), begin(b), end(e), sum(0) {}
+
+protected:
+    virtual void threadMain() {
+        for (int i = begin; i < end; ++i) {
+            sum += data[i];
+        }
+    }
+};
+
+
+class Sum {
+public:
+    const int*      data;
+    AtomicInt32*    total;
+
+    void operator()(int begin, int end) const {
+        int s = 0;
+        for (int i = begin; i < end; ++i) {
+            s += data[i] & 1;
+        }
+        total->add(s);
+    }
+};
+
+
+/** Counts the indices it is invoked on and the subranges larger than grainSize */
+class GrainCheck {
+public:
+    int             grainSize;
+    AtomicInt32*    count;
+    AtomicInt32*    tooLarge;
+
+    void operator()(int begin, int end) const {
+        count->add(end - begin);
+        if (end - begin > grainSize) {
+            tooLarge->increment();
+        }
+    }
+};
+
+} // namespace
+
+
+void testTaskScheduler() {
+    printf("G3D::TaskScheduler ");
+
+    {
+        Array<int> a;
+        a.resize(100001);
+        Square s;
+        s.data = a.getCArray();
+        TaskScheduler::global()->parallelFor(0, a.size(), 1000, s);
+        for (int i = 0; i < a.size(); ++i) {
+            debugAssert(a[i] == i * i);
+        }
+    }
+
+    {
+        // An explicit scheduler, including one with no workers
+        for (int w = 0; w < 3; ++w) {
+            TaskScheduler::Ref scheduler = TaskScheduler::create(w);
+            debugAssert(scheduler->numWorkers() == w);
+
+            AtomicInt32 count(0);
+            Array<CountTask> task;
+            task.resize(500);
+            {
+                TaskGroup group(scheduler);
+                for (int i = 0; i < task.size(); ++i) {
+                    task[i].count = &count;
+                    group.run(&task[i]);
+                }
+                group.wait();
+            }
+            debugAssert(count.value() == task.size());
+
+            // Subranges never exceed the grain size, even without workers
+            AtomicInt32 indices(0), tooLarge(0);
+            GrainCheck check;
+            check.grainSize = 7;
+            check.count     = &indices;
+            check.tooLarge  = &tooLarge;
+            scheduler->parallelFor(3, 100, check.grainSize, check);
+            debugAssert(indices.value() == 97);
+            debugAssert(tooLarge.value() == 0);
+        }
+    }
+
+    {
+        FibTask f(18);
+        f.run();
+        debugAssert(f.result == 2584);
+    }
+
+    printf("passed\n");
+}
+
+
+void perfTaskScheduler() {
+    printf("----------------------------------------------------------\n");
+    printf("TaskScheduler vs. ThreadSet (1000 batches of %d jobs):\n", System::numCores());
+
+    Array<int> data;
+    data.resize(1 << 16);
+    for (int i = 0; i < data.size(); ++i) {
+        data[i] = i;
+    }
+
+    const int batches = 1000;
+    const int jobs = iMax(2, System::numCores());
+    const int grain = data.size() / jobs;
+
+    RealTime t0 = System::time();
+    for (int b = 0; b < batches; ++b) {
+        ThreadSet threads;
+        for (int j = 0; j < jobs; ++j) {
+            threads.insert(new SumThread(data.getCArray(), j * grain, (j + 1) * grain));
+        }
+        threads.start(GThread::USE_CURRENT_THREAD);
+        threads.waitForCompletion();
+    }
+    RealTime threadSetTime = System::time() - t0;
+
+    AtomicInt32 total(0);
+    Sum sum;
+    sum.data = data.getCArray();
+    sum.total = &total;
+    t0 = System::time();
+    for (int b = 0; b < batches; ++b) {
+        TaskScheduler::global()->parallelFor(0, data.size(), grain, sum);
+    }
+    RealTime schedulerTime = System::time() - t0;
+
+    printf("  ThreadSet:     %6.3fs\n", threadSetTime);
+    printf("  TaskScheduler: %6.3fs (%d workers)\n\n", schedulerTime, TaskScheduler::global()->numWorkers());
+}
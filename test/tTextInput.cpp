@@ -4,6 +4,8 @@ static void tfunc1();
 static void tfunc2();
 static void tCommentTokens();
 static void tNewlineTokens();
+static void tTokenView();
+static void tParseNumber();
 
 void testTextInput() {
     printf("TextInput\n");
@@ -320,6 +322,9 @@ void testTextInput() {
     
     tCommentTokens();
     tNewlineTokens();
+
+    tTokenView();
+    tParseNumber();
 }
 
     // these defines are duplicated in tTextInput2.cpp
@@ -497,4 +502,232 @@ static void tNewlineTokens() {
         CHECK_SYM_TOKEN(ti, "text", 5, 1);
         CHECK_END_TOKEN(ti,         6, 1);
     }
-}
\ No newline at end of file
+}
+
+
+/** Checks that readView() produces exactly the tokens that read() does on \a source */
+static void checkViewMatchesRead(const std::string& source, const TextInput::Settings& settings) {
+    TextInput a(TextInput::FROM_STRING, source, settings);
+    TextInput b(TextInput::FROM_STRING, source, settings);
+
+    while (true) {
+        const Token t = a.read();
+        const TokenView v = b.readView();
+
+        alwaysAssertM((v.type() == t.type()) && (v.extendedType() == t.extendedType()) &&
+                      (v.string() == t.string()), 
+                      format("readView returned \"%s\" instead of \"%s\" at %d:%d",
+                             v.string().c_str(), t.string().c_str(), t.line(), t.character()));
+        alwaysAssertM((v.line() == t.line()) && (v.character() == t.character()) && 
+                      (v.bytePosition() == t.bytePosition()), 
+                      format("Wrong position for \"%s\"", t.string().c_str()));
+        alwaysAssertM(v.boolean() == t.boolean(), "Wrong boolean");
+        alwaysAssertM((v.number() == t.number()) || (isNaN(v.number()) && isNaN(t.number())),
+                      format("readView parsed \"%s\" as %g", t.string().c_str(), v.number()));
+
+        if (t.type() == Token::END) {
+            break;
+        }
+    }
+}
+
+
+static void tTokenView() {
+    const std::string common = 
+        "name = \"Max\", height = 6; x->y != z\n"
+        "  true false True yes _under score9 caf\xe9s\r\n"
+        "1 -2 +3 1.5 .5 -.5 +.25 1. 1e10 1.5e-3f 2E+5 1e 7f 0x1F -0x10 +0xff 0\r"
+        "123456789012345678901234 1e300 3.14159265358979 0.1 -0 00012\n"
+        "-inf +inf inf nan info -infx -1.#INF00 1.#IND00 -1.#IND00\n"
+        "- -- -= -> + ++ += : :: := = == => * *= / /= ! != ~ ~= ^ ^=\n"
+        "> >> >= < << <= <- <: <:: | || |- |= & && &= . .. ... ::> ::=\n"
+        "@ ( ) , ; { } [ ] # $ ? % \\# \\; \\x\n"
+        "\"double\" \"esc\\n\\t\\\"q\\\"\" \"multi\nline\" \"\"\n"
+        "// line comment\n"
+        "a /* block\r\n comment */ b # hash ; semi\n"
+        "c// tight\n"
+        "/**/d/*\n\n*/e\n\n\r\r\n\v\f\t end";
+
+    // ' is not a legal token when some other character is the single quote
+    const std::string source = common + "\n'single' 'it\\'s' ''";
+
+    Array<TextInput::Settings> settings;
+    settings.append(TextInput::Settings());
+
+    settings.next().generateNewlineTokens = true;
+
+    settings.next().generateCommentTokens = true;
+    settings.last().generateNewlineTokens = true;
+
+    settings.next().otherCommentCharacter  = '#';
+    settings.last().otherCommentCharacter2 = ';';
+
+    settings.next().otherCommentCharacter  = '#';
+    settings.last().generateCommentTokens  = true;
+
+    settings.next().signedNumbers = false;
+    settings.next().proofSymbols = true;
+    settings.next().msvcFloatSpecials = false;
+    settings.next().simpleFloatSpecials = false;
+    settings.next().singleQuotedStrings = false;
+    settings.next().escapeSequencesInStrings = false;
+    settings.next().cppBlockComments = false;
+    settings.last().cppLineComments  = false;
+
+    settings.next().singleQuoteCharacter = ',';
+
+    settings.next().caseSensitive = false;
+    settings.last().trueSymbols.insert("yes");
+
+    settings.next().trueSymbols.clear();
+    settings.last().falseSymbols.clear();
+
+    settings.next().startingLineNumberOffset = 10;
+
+    for (int i = 0; i < settings.size(); ++i) {
+        const bool apostrophe = (settings[i].singleQuoteCharacter == '\'');
+        checkViewMatchesRead(apostrophe ? source : common, settings[i]);
+        checkViewMatchesRead("", settings[i]);
+        checkViewMatchesRead(" \"unterminated", settings[i]);
+        checkViewMatchesRead("x /* unterminated", settings[i]);
+        checkViewMatchesRead("1.5", settings[i]);
+    }
+
+    {
+        // Mixing readView with peek and push
+        TextInput ti(TextInput::FROM_STRING, "alpha beta 3 gamma");
+        debugAssert(ti.peek().string() == "alpha");
+        TokenView v = ti.readView();
+        debugAssert(v.equals("alpha") && (v.length() == 5));
+        v = ti.readView();
+        debugAssert(v.equals("beta") && ! v.equals("bet") && ! v.equals("betas"));
+        Token beta = v.token();
+        debugAssert(ti.readView().number() == 3);
+        ti.push(beta);
+        debugAssert(ti.read().string() == "beta");
+        debugAssert(ti.readView().equals(std::string("gamma")));
+        debugAssert(ti.readView().type() == Token::END);
+        debugAssert(! ti.hasMore());
+    }
+
+    {
+        // The readNumber and readSymbol fast paths leave mismatched tokens unread
+        TextInput ti(TextInput::FROM_STRING, "x = 3 y");
+        ti.readSymbols("x", "=");
+        debugAssert(ti.readNumber() == 3);
+        try {
+            ti.readNumber();
+            debugAssertM(false, "readNumber should have thrown");
+        } catch (const TextInput::WrongTokenType& e) {
+            debugAssert(e.character == 7);
+            (void)e;
+        }
+        try {
+            ti.readSymbol("z");
+            debugAssertM(false, "readSymbol should have thrown");
+        } catch (const TextInput::WrongSymbol& e) {
+            debugAssert(e.actual == "y");
+            (void)e;
+        }
+        ti.readSymbol("y");
+        debugAssert(! ti.hasMore());
+    }
+}
+
+
+/** Compares parseNumber, which has a fast path for short decimals, against sscanf */
+static void tParseNumber() {
+    Array<std::string> s;
+    s.append("0", "-0", "1", "-1");
+    s.append("0.1", "1e22", "1e23", "9007199254740992");
+    s.append("9007199254740993", "1234567890123456789", "12345678901234567890", "0.000001");
+    s.append("1e-22", "1e-23", "4.35", ".5");
+    s.append("-.5e1", "5.f", "+7");
+
+    Random r(7, false);
+    for (int i = 0; i < 2000; ++i) {
+        const double x = r.uniform(-1000, 1000) * pow(10.0, r.integer(-8, 8));
+        s.append(format("%.*g", r.integer(1, 17), x));
+    }
+
+    for (int i = 0; i < s.size(); ++i) {
+        double expected;
+        sscanf(s[i].c_str(), "%lg", &expected);
+        const double actual = TextInput::parseNumber(s[i]);
+        alwaysAssertM(memcmp(&expected, &actual, sizeof(double)) == 0, 
+                      format("parseNumber(\"%s\") = %.17g instead of %.17g", s[i].c_str(), actual, expected));
+    }
+
+    debugAssert(TextInput::parseNumber("0x10") == 16);
+    debugAssert(TextInput::parseNumber("-1.#INF00") == -inf());
+    debugAssert(isNaN(TextInput::parseNumber("nan")));
+}
+
+
+/** A synthetic OBJ-style file of about \a numLines lines */
+static std::string makeOBJText(int numLines) {
+    std::string s;
+    Random r(1, false);
+    for (int i = 0; i < numLines; ++i) {
+        switch (i % 4) {
+        case 0:
+            s += format("v %f %f %f\n", r.uniform(-100, 100), r.uniform(-100, 100), r.uniform(-100, 100));
+            break;
+        case 1:
+            s += format("vn %f %f %f\n", r.uniform(-1, 1), r.uniform(-1, 1), r.uniform(-1, 1));
+            break;
+        case 2:
+            s += format("vt %f %f\n", r.uniform(0, 1), r.uniform(0, 1));
+            break;
+        default:
+            s += format("f %d/%d/%d %d/%d/%d %d/%d/%d # face\n", i, i, i, i + 1, i + 1, i + 1, i + 2, i + 2, i + 2);
+        }
+    }
+    return s;
+}
+
+
+void perfTextInput() {
+    printf("----------------------------------------------------------\n");
+
+    const std::string source = makeOBJText(400000);
+    printf("TextInput tokenizing %.1f MB of OBJ text:\n", source.size() / 1e6);
+
+    TextInput::Settings settings;
+    settings.cppBlockComments       = false;
+    settings.cppLineComments        = false;
+    settings.otherCommentCharacter  = '#';
+    settings.generateNewlineTokens  = true;
+
+    int numTokens = 0;
+    double sum = 0;
+    RealTime t0 = System::time();
+    {
+        TextInput ti(TextInput::FROM_STRING, source, settings);
+        for (Token t = ti.read(); t.type() != Token::END; t = ti.read()) {
+            sum += t.number();
+            ++numTokens;
+        }
+    }
+    const RealTime readTime = System::time() - t0;
+
+    int numViews = 0;
+    double viewSum = 0;
+    t0 = System::time();
+    {
+        TextInput ti(TextInput::FROM_STRING, source, settings);
+        for (TokenView v = ti.readView(); v.type() != Token::END; v = ti.readView()) {
+            viewSum += v.number();
+            ++numViews;
+        }
+    }
+    const RealTime viewTime = System::time() - t0;
+
+    debugAssert((numTokens == numViews) && (sum == viewSum));
+    (void)viewSum;
+
+    printf("  read():     %6.3fs  %6.1f MB/s  %5.1f Mtokens/s\n", 
+           readTime, source.size() / readTime / 1e6, numTokens / readTime / 1e6);
+    printf("  readView(): %6.3fs  %6.1f MB/s  %5.1f Mtokens/s\n\n", 
+           viewTime, source.size() / viewTime / 1e6, numViews / viewTime / 1e6);
+}
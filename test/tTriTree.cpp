@@ -0,0 +1,175 @@
+#include "G3D/G3DAll.h"
+using G3D::uint8;
+using G3D::uint32;
+using G3D::uint64;
+
+/** Random small triangles scattered through a unit cube */
+static void makeTriSoup(int n, Array<Tri>& triArray) {
+    Random rnd(n);
+    triArray.fastClear();
+    for (int i = 0; i < n; ++i) {
+        const Vector3 c(rnd.uniform(-1, 1), rnd.uniform(-1, 1), rnd.uniform(-1, 1));
+        const Vector3 v0 = c + Vector3(rnd.uniform(), rnd.uniform(), rnd.uniform()) * 0.05f;
+        const Vector3 v1 = c + Vector3(rnd.uniform(), rnd.uniform(), rnd.uniform()) * 0.05f;
+        const Vector3 v2 = c + Vector3(rnd.uniform(), rnd.uniform(), rnd.uniform()) * 0.05f;
+        const Vector3 n = (v1 - v0).cross(v2 - v0).directionOrZero();
+        triArray.append(Tri(v0, v1, v2, n, n, n));
+    }
+}
+
+
+static void makeRays(int n, Array<Ray>& rayArray) {
+    Random rnd(n + 1);
+    rayArray.fastClear();
+    for (int i = 0; i < n; ++i) {
+        const Vector3 origin(rnd.uniform(-1.5f, 1.5f), rnd.uniform(-1.5f, 1.5f), rnd.uniform(-1.5f, 1.5f));
+        rayArray.append(Ray::fromOriginAndDirection(origin, Vector3::random(rnd)));
+    }
+}
+
+
+static void testTriTreeAlgorithm(TriTree::SplitAlgorithm algorithm, const Array<Tri>& triArray, const Array<Ray>& rayArray) {
+    TriTree::Settings settings;
+    settings.algorithm = algorithm;
+    // Force concurrent subtree construction on small inputs
+    settings.parallelBuildThreshold = 100;
+
+    TriTree tree;
+    tree.setContents(triArray, settings);
+    debugAssert(tree.size() == triArray.size());
+
+    for (int r = 0; r < rayArray.size(); ++r) {
+        const Ray& ray = rayArray[r];
+
+        float bruteDistance = finf();
+        Tri::Intersector bruteHit;
+        for (int t = 0; t < triArray.size(); ++t) {
+            bruteHit(ray, triArray[t], bruteDistance);
+        }
+
+        float treeDistance = finf();
+        Tri::Intersector treeHit;
+        bool hit = tree.intersectRay(ray, treeHit, treeDistance);
+        debugAssertM(hit == (bruteHit.tri != NULL), TriTree::algorithmName(algorithm));
+        debugAssertM(fuzzyEq(treeDistance, bruteDistance) || (! hit), TriTree::algorithmName(algorithm));
+        (void)hit;
+    }
+
+    // Packets must agree with single rays, including a partial final packet
+    Array<TriTree::Hit> hitArray;
+    hitArray.resize(rayArray.size() - 1);
+    int numHits = tree.intersectRays(rayArray.getCArray(), hitArray.size(), hitArray.getCArray());
+    int numExpected = 0;
+    for (int r = 0; r < hitArray.size(); ++r) {
+        float distance = finf();
+        Tri::Intersector expected;
+        if (tree.intersectRay(rayArray[r], expected, distance)) {
+            ++numExpected;
+        }
+        debugAssert(hitArray[r].tri == expected.tri);
+        debugAssert(fuzzyEq(hitArray[r].distance, distance) || (expected.tri == NULL));
+    }
+    debugAssert(numHits == numExpected);
+    (void)numHits;
+}
+
+
+/** Camera rays through a w x h grid, ordered by 2x2 pixel blocks so that
+    each group of four is coherent. */
+static void makeCoherentRays(int w, int h, Array<Ray>& rayArray) {
+    rayArray.fastClear();
+    const Vector3 eye(0, 0, 3);
+    for (int y = 0; y < h; y += 2) {
+        for (int x = 0; x < w; x += 2) {
+            for (int i = 0; i < 4; ++i) {
+                const Vector3 target((x + (i & 1)) * 2.0f / w - 1.0f, 1.0f - (y + (i >> 1)) * 2.0f / h, 0.0f);
+                rayArray.append(Ray::fromOriginAndDirection(eye, (target - eye).direction()));
+            }
+        }
+    }
+}
+
+
+void testTriTree() {
+    printf("TriTree ");
+
+    Array<Tri> triArray;
+    makeTriSoup(3000, triArray);
+
+    Array<Ray> rayArray;
+    makeRays(500, rayArray);
+
+    testTriTreeAlgorithm(TriTree::MEAN_EXTENT, triArray, rayArray);
+    testTriTreeAlgorithm(TriTree::SAH, triArray, rayArray);
+    testTriTreeAlgorithm(TriTree::BINNED_SAH, triArray, rayArray);
+
+    printf("passed\n");
+}
+
+
+void perfTriTree() {
+    printf("----------------------------------------------------------\n");
+    printf("TriTree build and trace (50k tris, 100k rays):\n");
+
+    Array<Tri> triArray;
+    makeTriSoup(50000, triArray);
+
+    Array<Ray> rayArray;
+    makeRays(100000, rayArray);
+
+    const TriTree::SplitAlgorithm algorithm[] = {TriTree::MEAN_EXTENT, TriTree::SAH, TriTree::BINNED_SAH};
+    for (int a = 0; a < 3; ++a) {
+        TriTree::Settings settings;
+        settings.algorithm = algorithm[a];
+
+        TriTree tree;
+        RealTime t0 = System::time();
+        tree.setContents(triArray, settings);
+        const RealTime buildTime = System::time() - t0;
+
+        int hits = 0;
+        t0 = System::time();
+        for (int r = 0; r < rayArray.size(); ++r) {
+            float distance = finf();
+            Tri::Intersector hit;
+            if (tree.intersectRay(rayArray[r], hit, distance)) {
+                ++hits;
+            }
+        }
+        const RealTime traceTime = System::time() - t0;
+
+        printf("  %-12s build %6.3fs, trace %6.3fs (%d hits)\n",
+               TriTree::algorithmName(algorithm[a]), buildTime, traceTime, hits);
+    }
+    printf("  (%d TaskScheduler workers)\n\n", TaskScheduler::global()->numWorkers());
+
+    printf("TriTree::intersectRays vs. intersectRay (512x512 camera rays):\n");
+    {
+        TriTree::Settings settings;
+        settings.algorithm = TriTree::BINNED_SAH;
+        TriTree tree;
+        tree.setContents(triArray, settings);
+
+        makeCoherentRays(512, 512, rayArray);
+        Array<TriTree::Hit> hitArray;
+        hitArray.resize(rayArray.size());
+
+        RealTime t0 = System::time();
+        int singleHits = 0;
+        for (int r = 0; r < rayArray.size(); ++r) {
+            float distance = finf();
+            Tri::Intersector hit;
+            if (tree.intersectRay(rayArray[r], hit, distance)) {
+                ++singleHits;
+            }
+        }
+        const RealTime singleTime = System::time() - t0;
+
+        t0 = System::time();
+        const int packetHits = tree.intersectRays(rayArray.getCArray(), rayArray.size(), hitArray.getCArray());
+        const RealTime packetTime = System::time() - t0;
+
+        printf("  intersectRay:  %6.3fs (%d hits)\n", singleTime, singleHits);
+        printf("  intersectRays: %6.3fs (%d hits)\n\n", packetTime, packetHits);
+    }
+}
@@ -0,0 +1,246 @@
+#include "G3D/G3DAll.h"
+
+/** Appends a description of every event in \a reader to \a s, one per line */
+static std::string eventString(XMLReader& reader) {
+    std::string s;
+    while (reader.next()) {
+        switch (reader.event()) {
+        case XMLReader::START_TAG:
+            s += format("<%s %d\n", reader.name().c_str(), reader.depth());
+            break;
+
+        case XMLReader::ATTRIBUTE:
+            s += format("@%s=%s\n", reader.name().c_str(), reader.value().c_str());
+            break;
+
+        case XMLReader::TEXT:
+            s += format("'%s'\n", reader.value().c_str());
+            break;
+
+        case XMLReader::END_TAG:
+            s += format(">%s %d\n", reader.name().c_str(), reader.depth());
+            break;
+
+        case XMLReader::END_OF_INPUT:
+            s += "END OF INPUT\n";
+            break;
+        }
+    }
+    debugAssert(reader.event() == XMLReader::END_OF_INPUT);
+    return s;
+}
+
+
+static const char* document =
+    "<?xml version=\"1.0\" encoding=\"ISO-8859-1\"?>\n"
+    "<!DOCTYPE note [ <!ELEMENT note (to)> ]>\n"
+    "<!-- a comment with <tags> -->\n"
+    "<note id=\"7\" lang='en'>\n"
+    "  <to>  Tove &amp; Jani  </to>\n"
+    "  <x:from a = \"&lt;&#65;&#x42;&gt;\"/>\n"
+    "  <body>Don't <b>forget</b> me<![CDATA[ <raw> &amp; ]]></body>\n"
+    "  <empty></empty>\n"
+    "</note>\n";
+
+
+static void testEvents() {
+    XMLReader reader(XMLReader::FROM_STRING, document);
+    const std::string& s = eventString(reader);
+
+    const std::string expected =
+        "<note 1\n"
+        "@id=7\n"
+        "@lang=en\n"
+        "<to 2\n"
+        "'Tove & Jani'\n"
+        ">to 2\n"
+        "<x:from 2\n"
+        "@a=<AB>\n"
+        ">x:from 2\n"
+        "<body 2\n"
+        "'Don't'\n"
+        "<b 3\n"
+        "'forget'\n"
+        ">b 3\n"
+        "'me'\n"
+        "' <raw> &amp; '\n"
+        ">body 2\n"
+        "<empty 2\n"
+        ">empty 2\n"
+        ">note 1\n";
+
+    debugAssertM(s == expected, s);
+    (void)expected;
+}
+
+
+static void testSubtrees() {
+    {
+        XMLReader reader(XMLReader::FROM_STRING, document);
+        while (reader.next() && ! ((reader.event() == XMLReader::START_TAG) && (reader.name() == "to"))) {}
+        debugAssert(reader.pathMatches("note/to"));
+        debugAssert(reader.pathMatches("/note/to"));
+        debugAssert(reader.pathMatches("*/to"));
+        debugAssert(! reader.pathMatches("note"));
+        debugAssert(! reader.pathMatches("note/to/x"));
+        debugAssert(! reader.pathMatches("note/t"));
+        debugAssert(reader.pathName(0) == "note");
+
+        reader.skipSubtree();
+        debugAssert((reader.event() == XMLReader::END_TAG) && (reader.name() == "to"));
+
+        reader.next();
+        const XML& from = reader.readSubtree();
+        debugAssert(from.type() == XML::TAG);
+        debugAssert(from.name() == "x:from");
+        debugAssert(from[std::string("a")].string() == "<AB>");
+        debugAssert(from.numChildren() == 0);
+
+        reader.next();
+        const XML& body = reader.readSubtree();
+        debugAssert(body.name() == "body");
+        debugAssert(body.numChildren() == 4);
+        debugAssert(body[0].string() == "Don't");
+        debugAssert(body[1].name() == "b");
+        debugAssert(body[1][0].string() == "forget");
+        debugAssert(body[3].string() == " <raw> &amp; ");
+        debugAssert(reader.depth() == 2);
+    }
+
+    {
+        XMLReader reader(XMLReader::FROM_STRING, document);
+        Array<std::string> paths;
+        paths.append("note/*", "note/body/b");
+        Array<XML> result;
+        reader.materialize(paths, result);
+        // note/body/b is inside note/body, so it is not matched separately
+        debugAssert(result.size() == 4);
+        debugAssert(result[0].name() == "to");
+        debugAssert(result[0][0].string() == "Tove & Jani");
+        debugAssert(result[3].name() == "empty");
+    }
+}
+
+
+static void testErrors() {
+    const char* bad[] = {
+        "<a><b></a></b>",
+        "<a>",
+        "<a x=1></a>",
+        "<a x=\"1></a>",
+        "<!-- unterminated",
+        "</a>",
+        "<a/ >"};
+
+    for (int i = 0; i < (int)(sizeof(bad) / sizeof(bad[0])); ++i) {
+        bool threw = false;
+        try {
+            XMLReader reader(XMLReader::FROM_STRING, bad[i]);
+            while (reader.next()) {}
+        } catch (const ParseError&) {
+            threw = true;
+        }
+        debugAssertM(threw, bad[i]);
+        (void)threw;
+    }
+
+    try {
+        XMLReader reader(XMLReader::FROM_STRING, "<a>\n  <b>\n  </c>\n</a>");
+        while (reader.next()) {}
+        debugAssertM(false, "Should have thrown");
+    } catch (const ParseError& e) {
+        debugAssert((e.line == 3) && (e.character == 3));
+        (void)e;
+    }
+}
+
+
+static void testFile() {
+    writeWholeFile("XMLReader-test.xml", document);
+    {
+        XMLReader fromFile("XMLReader-test.xml");
+        XMLReader fromString(XMLReader::FROM_STRING, document);
+        debugAssert(eventString(fromFile) == eventString(fromString));
+        debugAssert(fromFile.filename() == "XMLReader-test.xml");
+    }
+    ::remove("XMLReader-test.xml");
+}
+
+
+void testXMLReader() {
+    printf("XMLReader ");
+
+    testEvents();
+    testSubtrees();
+    testErrors();
+    testFile();
+
+    printf("passed\n");
+}
+
+
+/** A document shaped like a COLLADA file, with \a numGeometry meshes */
+static std::string makeCOLLADAText(int numGeometry) {
+    std::string s = "<?xml version=\"1.0\"?>\n<COLLADA version=\"1.4.1\">\n<library_geometries>\n";
+    Random r(3, false);
+    for (int g = 0; g < numGeometry; ++g) {
+        s += format("<geometry id=\"mesh%d\" name=\"mesh%d\"><mesh>\n<source id=\"mesh%d-positions\">\n"
+                    "<float_array id=\"mesh%d-array\" count=\"300\">", g, g, g, g);
+        for (int i = 0; i < 300; ++i) {
+            s += format("%.4f ", r.uniform(-10, 10));
+        }
+        s += "</float_array>\n</source>\n<triangles count=\"100\" material=\"mat\"><p>";
+        for (int i = 0; i < 300; ++i) {
+            s += format("%d ", r.integer(0, 99));
+        }
+        s += "</p></triangles>\n</mesh></geometry>\n";
+    }
+    s += "</library_geometries>\n<scene><instance_visual_scene url=\"#scene\"/></scene>\n</COLLADA>\n";
+    return s;
+}
+
+
+void perfXMLReader() {
+    printf("----------------------------------------------------------\n");
+
+    const std::string& source = makeCOLLADAText(1500);
+    printf("XML parsing %.1f MB of COLLADA-style text:\n", source.size() / 1e6);
+
+    RealTime t0 = System::time();
+    {
+        XML xml;
+        xml.parse(source);
+    }
+    const RealTime domTime = System::time() - t0;
+
+    int numEvents = 0;
+    size_t textLength = 0;
+    t0 = System::time();
+    {
+        XMLReader reader(XMLReader::FROM_STRING, source);
+        while (reader.next()) {
+            ++numEvents;
+            if (reader.event() != XMLReader::START_TAG) {
+                // Values are only copied out of the input when requested
+                textLength += reader.value().size();
+            }
+        }
+    }
+    debugAssert(textLength > 0);
+    const RealTime eventTime = System::time() - t0;
+
+    t0 = System::time();
+    Array<XML> scene;
+    {
+        XMLReader reader(XMLReader::FROM_STRING, source);
+        Array<std::string> paths;
+        paths.append("COLLADA/scene");
+        reader.materialize(paths, scene);
+    }
+    const RealTime selectiveTime = System::time() - t0;
+    debugAssert(scene.size() == 1);
+
+    printf("  XML::parse (full tree):       %6.3fs\n", domTime);
+    printf("  XMLReader events:             %6.3fs  (%d events)\n", eventTime, numEvents);
+    printf("  XMLReader::materialize scene: %6.3fs\n\n", selectiveTime);
+}